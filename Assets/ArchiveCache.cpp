@@ -6,561 +6,591 @@
 
 #include "ArchiveCache.h"
 #include "ChunkFile.h"
+#include "AssetSetInternal.h"       // (for AssetTable)
 #include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/PathUtils.h"
+#include "../Utility/Threading/TaskScheduler.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/LockFree.h"      // (for XlCreateEvent, etc)
+#include "../Utility/SystemUtils.h"
 #include "../Utility/PtrUtils.h"
-#include "../Utility/HeapUtils.h"
 #include "../Utility/MemoryUtils.h"
-#include "../Utility/IteratorUtils.h"
+#include "../Utility/StringFormat.h"
 #include <algorithm>
 
 namespace Assets
 {
     static const uint64 ChunkType_ArchiveDirectory = ConstHash64<'Arch', 'ive', 'Dir'>::Value;
-    static const uint64 ChunkType_ArchiveAttachments = ConstHash64<'Arch', 'ive', 'Attc'>::Value;
+    static const unsigned ArchiveDirectoryVersion = 1;
 
-    class ArchiveDirectoryBlock 
+        //  The ".dir" file just records which generation of the log is active
+    class ArchiveDirectoryChunk
     {
     public:
-        uint64 _id;
-        unsigned _start, _size;
+        unsigned _generation;
+        unsigned _dummy[3];
     };
-    
-    class DirectoryChunk
+
+        //  Log files begin with a header, and then a sequence of records. Each
+        //  record is a header, the block data and then the attached string; padded
+        //  to a 16 byte boundary. The file is extended in large steps, so there
+        //  is normally zeroed space after the last record.
+        //
+        //  The record magic value is written last, and every record has a checksum
+        //  of its header and contents. So a record that was only partially written
+        //  (either because we crashed while copying it, or because the OS only wrote
+        //  some of its pages before a power loss) is never accepted on open.
+    static const uint32 ArchiveLogMagic = uint32('X') | (uint32('L') << 8) | (uint32('A') << 16) | (uint32('L') << 24);
+    static const uint32 ArchiveRecordMagic = uint32('X') | (uint32('L') << 8) | (uint32('A') << 16) | (uint32('R') << 24);
+    static const unsigned ArchiveLogVersion = 1;
+    static const size_t ArchiveLogAlignment = 16;
+    static const size_t ArchiveLogMinCapacity = 1024*1024;
+
+    class ArchiveLogHeader
+    {
+    public:
+        uint32      _magic;
+        unsigned    _version;
+        char        _buildVersion[64];
+        char        _buildDate[64];
+        unsigned    _dummy[2];
+    };
+
+    class ArchiveLogRecord
+    {
+    public:
+        uint32      _magic;
+        unsigned    _dataSize;
+        uint64      _id;
+        unsigned    _attachedStringSize;
+        uint32      _checksum;
+        unsigned    _dummy[2];
+    };
+
+    static size_t AlignLog(size_t size) { return (size + ArchiveLogAlignment - 1) & ~(ArchiveLogAlignment - 1); }
+    static size_t RecordSize(const ArchiveLogRecord& r) { return AlignLog(sizeof(ArchiveLogRecord) + r._dataSize + r._attachedStringSize); }
+
+    static uint32 CalculateChecksum(const ArchiveLogRecord& r, const void* payload)
+    {
+            //  (the magic value and the checksum itself are excluded)
+        ArchiveLogRecord hdr = r;
+        hdr._magic = 0;
+        hdr._checksum = 0;
+        auto seed = Hash32(&hdr, PtrAdd(&hdr, sizeof(hdr)));
+        return Hash32(payload, PtrAdd(payload, r._dataSize + r._attachedStringSize), seed);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class ArchiveIndexEntry
     {
     public:
-        unsigned _blockCount;
-        unsigned _spanningHeapSize;
+        Interlocked::Value64 _recordOffset;     // (offset of the ArchiveLogRecord in the log file)
+        explicit ArchiveIndexEntry(uint64 offset) : _recordOffset(offset) {}
+    };
+    using ArchiveIndex = Internal::AssetTable<ArchiveIndexEntry>;
 
-            // list of blocks follows, and then the flattened spanning heap data
-        DirectoryChunk() : _blockCount(0), _spanningHeapSize(0) {}
+        //  A snapshot of the log that readers can use without locking. A new snapshot
+        //  is published when the log grows (new mapping, same index) or is compacted
+        //  (new mapping and new index). Readers keep the old snapshot alive for as long
+        //  as they need it.
+    class ArchiveLogSnapshot
+    {
+    public:
+        std::shared_ptr<MemoryMappedFile>   _mapping;
+        size_t                              _capacity;
+        std::shared_ptr<ArchiveIndex>       _index;
+        unsigned                            _generation;
 
-        class CompareBlock
+        const ArchiveLogRecord* GetRecord(uint64 offset) const
         {
-        public:
-            bool operator()(const ArchiveDirectoryBlock& lhs, uint64 rhs) { return lhs._id < rhs; }
-            bool operator()(uint64 lhs, const ArchiveDirectoryBlock& rhs) { return lhs < rhs._id; }
-            bool operator()(const ArchiveDirectoryBlock& lhs, const ArchiveDirectoryBlock& rhs) { return lhs._id < rhs._id; }
-        };
+            if (offset + sizeof(ArchiveLogRecord) > _capacity) return nullptr;
+            auto* r = (const ArchiveLogRecord*)PtrAdd(_mapping->GetData(), ptrdiff_t(offset));
+            if (offset + RecordSize(*r) > _capacity) return nullptr;
+            return r;
+        }
     };
 
-    class AttachedStringChunk
+    class ArchiveCache::Pimpl : public std::enable_shared_from_this<ArchiveCache::Pimpl>
     {
     public:
-        class Block
+        std::string _mainFileName, _directoryFileName;
+        const char* _buildVersionString;
+        const char* _buildDateString;
+
+            // readers only lock this for long enough to copy the snapshot pointer
+        mutable Threading::Mutex _snapshotLock;
+        std::shared_ptr<ArchiveLogSnapshot> _snapshot;
+
+            // commits and compaction are serialized by this lock
+        Threading::Mutex _appendLock;
+        size_t _tail;
+        size_t _liveSpace, _deadSpace;
+        unsigned _compactionCount;
+        std::vector<std::function<void()>> _pendingFlushes;
+        std::vector<std::string> _retiredFiles;
+
+        Interlocked::Value _compactionQueued;
+        XlHandle _compactionIdleEvent;      // (manual reset; set while no compaction is queued)
+
+        Pimpl();
+        ~Pimpl();
+
+        std::shared_ptr<ArchiveLogSnapshot> GetSnapshot() const
         {
-        public:
-            uint64 _id;
-            unsigned _start, _size;
-        };
-        unsigned _blockCount;
+            ScopedLock(_snapshotLock);
+            return _snapshot;
+        }
 
-        AttachedStringChunk() : _blockCount(0) {}
+        void SetSnapshot(std::shared_ptr<ArchiveLogSnapshot> newSnapshot)
+        {
+            ScopedLock(_snapshotLock);
+            _snapshot = std::move(newSnapshot);
+        }
 
-        class CompareBlock
+        std::string LogFileName(unsigned generation) const
         {
-        public:
-            bool operator()(const Block& lhs, uint64 rhs) { return lhs._id < rhs; }
-            bool operator()(uint64 lhs, const Block& rhs) { return lhs < rhs._id; }
-            bool operator()(const Block& lhs, const Block& rhs) { return lhs._id < rhs._id; }
-        };
+            return _mainFileName + "." + std::to_string(generation) + ".log";
+        }
+
+        std::shared_ptr<MemoryMappedFile> MapLog(const std::string& filename, size_t capacity);
+        void Open();
+        void Grow(size_t requiredCapacity);
+        void CompactAlreadyLocked();
+        void WriteDirectory(unsigned generation);
+        void TryDeleteRetiredFiles();
+        void QueueCompactionIfRequired();
     };
 
-    ArchiveCache::PendingCommit::PendingCommit(PendingCommit&& moveFrom)
-        : _id(moveFrom._id)
-        , _pendingCommitPtr(moveFrom._pendingCommitPtr)
-        , _onFlush(std::move(moveFrom._onFlush))
+    ArchiveCache::Pimpl::Pimpl()
     {
-        _data = std::move(moveFrom._data);
-        #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-            _attachedString = std::move(moveFrom._attachedString);
-        #endif
+        _tail = _liveSpace = _deadSpace = 0;
+        _compactionCount = 0;
+        _compactionQueued = 0;
+        _compactionIdleEvent = XlCreateEvent(true);
+        XlSetEvent(_compactionIdleEvent);
     }
 
-    auto ArchiveCache::PendingCommit::operator=(PendingCommit&& moveFrom) -> PendingCommit&
+    ArchiveCache::Pimpl::~Pimpl()
     {
-        _id = moveFrom._id;
-        _pendingCommitPtr = moveFrom._pendingCommitPtr;
-        _data = std::move(moveFrom._data);
-        #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-            _attachedString = std::move(moveFrom._attachedString);
-        #endif
-        _onFlush = std::move(moveFrom._onFlush);
-        return *this;
+        XlCloseSyncObject(_compactionIdleEvent);
     }
 
-    ArchiveCache::PendingCommit::PendingCommit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush)
-        : _id(id)
-        #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-        , _attachedString(attachedString)
-        #endif
-        , _onFlush(std::forward<std::function<void()>>(onFlush))
+    std::shared_ptr<MemoryMappedFile> ArchiveCache::Pimpl::MapLog(const std::string& filename, size_t capacity)
     {
-        _data = std::move(data);
-    }
-
-    void ArchiveCache::Commit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush)
-    {
-            // for for an existing pending commit, and replace it if it exists
-        ScopedLock(_pendingBlocksLock);
-        auto i = std::lower_bound(_pendingBlocks.begin(), _pendingBlocks.end(), id, ComparePendingCommit());
-        if (i!=_pendingBlocks.end() && i->_id == id) {
-            i->_data = std::forward<BlockAndSize>(data);
-            #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-                i->_attachedString = attachedString;
-            #endif
-            i->_onFlush = std::forward<std::function<void()>>(onFlush);
-        } else {
-            _pendingBlocks.insert(i, PendingCommit(id, std::forward<BlockAndSize>(data), attachedString, std::forward<std::function<void()>>(onFlush)));
-        }
+            //  We map with both read & write share modes, because we will map the same
+            //  file multiple times as it grows (and older mappings may still be in use)
+        auto result = std::make_shared<MemoryMappedFile>(
+            filename.c_str(), capacity,
+            MemoryMappedFile::Access::Read|MemoryMappedFile::Access::Write|MemoryMappedFile::Access::OpenAlways,
+            BasicFile::ShareMode::Read|BasicFile::ShareMode::Write);
+        if (!result->IsValid())
+            Throw(::Exceptions::BasicLabel("Failed while mapping archive log file (%s)", filename.c_str()));
+        return result;
     }
 
-    static bool LoadBlockList(const char filename[], std::vector<ArchiveDirectoryBlock>& blocks)
+    static unsigned LoadActiveGeneration(const char filename[])
     {
         using namespace Serialization::ChunkFile;
         BasicFile directoryFile;
         if (directoryFile.TryOpen(filename, "rb") != BasicFile::Reason::Success)
-            return false;
-
-        auto chunkTable = LoadChunkTable(directoryFile);
-        auto chunk = FindChunk(filename, chunkTable, ChunkType_ArchiveDirectory, 0);
-
-        DirectoryChunk dirHdr;
-        directoryFile.Seek(chunk._fileOffset, SEEK_SET);
-        directoryFile.Read(&dirHdr, sizeof(dirHdr), 1);
+            return 0;
 
-        // we're going to remove any previous contents of "blocks"
-        blocks.clear();
-        blocks.resize(dirHdr._blockCount);
-        directoryFile.Read(AsPointer(blocks.begin()), sizeof(ArchiveDirectoryBlock), dirHdr._blockCount);
-        return true;
+        TRY {
+            auto chunkTable = LoadChunkTable(directoryFile);
+            auto chunk = FindChunk(filename, chunkTable, ChunkType_ArchiveDirectory, ArchiveDirectoryVersion);
+            ArchiveDirectoryChunk dir;
+            directoryFile.Seek(chunk._fileOffset, SEEK_SET);
+            if (directoryFile.Read(&dir, sizeof(dir), 1) == 1)
+                return dir._generation;
+        } CATCH (...) {
+            // older archive formats will end up here. We just start again with an empty archive
+        } CATCH_END
+        return 0;
     }
 
-    auto ArchiveCache::GetBlockList() const -> const std::vector<ArchiveDirectoryBlock>*
+    void ArchiveCache::Pimpl::WriteDirectory(unsigned generation)
     {
-        if (!_cachedBlockListValid) {
-            // note that on failure, we will continue to attempt to open the file each time
-            if (!LoadBlockList(_directoryFileName.c_str(), _cachedBlockList))
-                return nullptr;
-
-            _cachedBlockListValid = true;
-        }
-        return &_cachedBlockList;
+        using namespace Serialization::ChunkFile;
+        SimpleChunkFileWriter dirFile(1, _buildVersionString, _buildDateString, std::make_tuple(_directoryFileName.c_str(), "wb", 0));
+        dirFile.BeginChunk(ChunkType_ArchiveDirectory, ArchiveDirectoryVersion, "ArchiveCache");
+        ArchiveDirectoryChunk dir;
+        XlZeroMemory(dir);
+        dir._generation = generation;
+        dirFile.Write(&dir, sizeof(dir), 1);
     }
 
-    auto ArchiveCache::TryOpenFromCache(uint64 id) -> BlockAndSize
+    void ArchiveCache::Pimpl::Open()
     {
-            // first, check our pending commits
-            // if it's not there, we have to lock and open the file
-            // note that we're keeping the pending block lock permanently locked
-        ScopedLock(_pendingBlocksLock);
-        auto i = std::lower_bound(_pendingBlocks.begin(), _pendingBlocks.end(), id, ComparePendingCommit());
-        if (i!=_pendingBlocks.end() && i->_id == id) {
-            return i->_data;
+            //  Map the active log, and scan through the records to build the index.
+            //  We only touch the record headers here, not the block data. The scan stops at
+            //  the first invalid record -- that's either the zeroed space at the end of the
+            //  log, or a partially written record from a crash. Either way, new records will
+            //  be appended from there.
+        auto generation = LoadActiveGeneration(_directoryFileName.c_str());
+        auto filename = LogFileName(generation);
+        auto existingSize = (size_t)GetFileSize(filename.c_str());
+        auto capacity = std::max(existingSize, ArchiveLogMinCapacity);
+
+        auto snapshot = std::make_shared<ArchiveLogSnapshot>();
+        snapshot->_mapping = MapLog(filename, capacity);
+        snapshot->_capacity = capacity;
+        snapshot->_index = std::make_shared<ArchiveIndex>();
+        snapshot->_generation = generation;
+
+        auto& hdr = *(ArchiveLogHeader*)snapshot->_mapping->GetData();
+        if (hdr._magic != ArchiveLogMagic || hdr._version != ArchiveLogVersion) {
+                // (also clear the first record header, so we don't try to read records from an older format)
+            XlZeroMemory(snapshot->_mapping->GetData(), std::min(capacity, AlignLog(sizeof(ArchiveLogHeader)) + sizeof(ArchiveLogRecord)));
+            hdr._magic = ArchiveLogMagic;
+            hdr._version = ArchiveLogVersion;
+            XlCopyString(hdr._buildVersion, dimof(hdr._buildVersion), _buildVersionString);
+            XlCopyString(hdr._buildDate, dimof(hdr._buildDate), _buildDateString);
+            WriteDirectory(generation);
         }
 
-            // lock and open the directory, and look for the given item
-            // note that a flush could be happening in a background 
-            // thread -- in that case, we need to stall waiting for the
-            // flush to complete.
+        _tail = AlignLog(sizeof(ArchiveLogHeader));
+        _liveSpace = _deadSpace = 0;
+        for (;;) {
+                //  Note that validating the checksum means reading every record in the log.
+                //  But we only do this once, when the archive is first opened.
+            auto* r = snapshot->GetRecord(_tail);
+            if (!r || r->_magic != ArchiveRecordMagic) break;
+            if (r->_checksum != CalculateChecksum(*r, PtrAdd(r, sizeof(ArchiveLogRecord)))) {
+                LogWarning << "Discarding partially written record at the end of archive (" << filename << ")";
+                break;
+            }
 
-        {
-            const auto* blocks = GetBlockList();
-            if (!blocks) return nullptr;
-
-                // we maintain the blocks array sorted by id to make this check faster...
-            auto bi = std::lower_bound(blocks->begin(), blocks->end(), id, DirectoryChunk::CompareBlock());
-            if (bi != blocks->end() && bi->_id == id) {
-                BasicFile dataFile;
-                if (dataFile.TryOpen(_mainFileName.c_str(), "rb") == BasicFile::Reason::Success) {
-                    dataFile.Seek(bi->_start, SEEK_SET);
-                    auto result = std::make_shared<std::vector<uint8>>(bi->_size);
-                    dataFile.Read(AsPointer(result->begin()), 1, bi->_size);
-                    return result;
-                }
+            auto* existing = snapshot->_index->Find(r->_id);
+            if (existing) {
+                auto& oldRecord = *snapshot->GetRecord(existing->_recordOffset);
+                _deadSpace += RecordSize(oldRecord);
+                _liveSpace -= RecordSize(oldRecord);
+                existing->_recordOffset = _tail;
+            } else {
+                snapshot->_index->Insert(r->_id, std::make_unique<ArchiveIndexEntry>(_tail));
             }
+            _liveSpace += RecordSize(*r);
+            _tail += RecordSize(*r);
         }
 
-        return nullptr;     // this block doesn't exist in the cache
+            // clear out anything after the last valid record (eg, a partially written record)
+        auto* tailPtr = PtrAdd(snapshot->_mapping->GetData(), ptrdiff_t(_tail));
+        auto tailSpace = std::min(capacity - _tail, sizeof(ArchiveLogRecord));
+        if (tailSpace) XlZeroMemory(tailPtr, tailSpace);
+
+            //  Archives in the older format were a single data file with the same name as 
+            //  the archive (plus a ".debug" file for the attached strings). They can't be
+            //  used any more, so remove them.
+        XlDeleteFile((const utf8*)_mainFileName.c_str());
+        XlDeleteFile((const utf8*)(_mainFileName + ".debug").c_str());
+
+        SetSnapshot(std::move(snapshot));
+
+            // try to remove the previous generation (which can remain if it was still mapped during compaction)
+        if (generation) {
+            _retiredFiles.push_back(LogFileName(generation-1));
+            TryDeleteRetiredFiles();
+        }
     }
-    
-    bool ArchiveCache::HasItem(uint64 id) const
+
+    void ArchiveCache::Pimpl::Grow(size_t requiredCapacity)
     {
-        ScopedLock(_pendingBlocksLock);
-        auto i = std::lower_bound(_pendingBlocks.begin(), _pendingBlocks.end(), id, ComparePendingCommit());
-        if (i!=_pendingBlocks.end() && i->_id == id) {
-            return true;
+            //  Map the file again with a larger size (which extends the file). The old
+            //  mapping remains valid for readers that are still using it.
+        auto oldSnapshot = GetSnapshot();
+        auto newCapacity = oldSnapshot->_capacity;
+        while (newCapacity < requiredCapacity) newCapacity *= 2;
+
+        auto newSnapshot = std::make_shared<ArchiveLogSnapshot>(*oldSnapshot);
+        newSnapshot->_mapping = MapLog(LogFileName(oldSnapshot->_generation), newCapacity);
+        newSnapshot->_capacity = newCapacity;
+        SetSnapshot(std::move(newSnapshot));
+    }
+
+    void ArchiveCache::Pimpl::CompactAlreadyLocked()
+    {
+            //  Copy the live records into a new log file, and switch to it.
+            //  Readers can continue using the old log during this process (and they can
+            //  continue to use spans from it after we've switched over).
+        auto oldSnapshot = GetSnapshot();
+        auto newGeneration = oldSnapshot->_generation+1;
+        auto newFilename = LogFileName(newGeneration);
+        auto requiredSize = AlignLog(sizeof(ArchiveLogHeader)) + _liveSpace + sizeof(ArchiveLogRecord);
+        auto capacity = std::max(ArchiveLogMinCapacity, requiredSize + requiredSize / 4);
+
+            // (there may be an out-of-date file from an earlier failed compaction)
+        XlDeleteFile((const utf8*)newFilename.c_str());
+
+        auto newSnapshot = std::make_shared<ArchiveLogSnapshot>();
+        newSnapshot->_mapping = MapLog(newFilename, capacity);
+        newSnapshot->_capacity = capacity;
+        newSnapshot->_index = std::make_shared<ArchiveIndex>();
+        newSnapshot->_generation = newGeneration;
+
+        auto* dst = newSnapshot->_mapping->GetData();
+        XlCopyMemory(dst, oldSnapshot->_mapping->GetData(), sizeof(ArchiveLogHeader));
+
+        size_t newTail = AlignLog(sizeof(ArchiveLogHeader));
+        for (const auto& i:*oldSnapshot->_index) {
+            auto* r = oldSnapshot->GetRecord((uint64)i.second->_recordOffset);
+            if (!r) continue;
+            auto size = RecordSize(*r);
+            XlCopyMemory(PtrAdd(dst, ptrdiff_t(newTail)), r, size);
+            newSnapshot->_index->Insert(i.first, std::make_unique<ArchiveIndexEntry>(newTail));
+            newTail += size;
         }
 
-        TRY {
-            const auto* blocks = GetBlockList();
-            auto bi = std::lower_bound(blocks->begin(), blocks->end(), id, DirectoryChunk::CompareBlock());
-            return (bi != blocks->end() && bi->_id == id);
-        } CATCH (...) {
-            return false;
-        } CATCH_END
+            //  Commit to the new generation. If we crash before writing the directory,
+            //  we'll just continue to use the old generation. The new log must be on
+            //  disk before the directory refers to it.
+        if (!newSnapshot->_mapping->Flush(0, newTail))
+            Throw(::Exceptions::BasicLabel("Failed while flushing archive log file (%s)", newFilename.c_str()));
+        WriteDirectory(newGeneration);
+        _retiredFiles.push_back(LogFileName(oldSnapshot->_generation));
+        SetSnapshot(std::move(newSnapshot));
+        oldSnapshot.reset();
+
+        _tail = newTail;
+        _deadSpace = 0;
+        ++_compactionCount;
+
+        TryDeleteRetiredFiles();
     }
 
-    void ArchiveCache::FlushToDisk()
+    void ArchiveCache::Pimpl::TryDeleteRetiredFiles()
     {
-        ScopedLock(_pendingBlocksLock);
-        if (_pendingBlocks.empty()) { return; }
-
-        _cachedBlockListValid = false;
-
-            // 1.   Open the directory and initialize our heap
-            //      representation
-            // 2.   Find older versions of the same blocks we
-            //      want to write
-            // 3.   Deallocate all blocks that have changed size
-            // 4.   Allocate new blocks as required
-            // 5.   Open the data file and write all the new blocks
-            //      to disk
-            // 6.   Flush out the new directory file
-            //
-            //  Note that the table of blocks is stored in order of id (for fast
-            //  searches) not in the order that they appear in the file.
+            // deletion will fail for files that are still mapped (eg, by an outstanding BlockSpan)
+        auto i = std::remove_if(_retiredFiles.begin(), _retiredFiles.end(),
+            [](const std::string& f)
+            {
+                XlDeleteFile((const utf8*)f.c_str());
+                return !DoesFileExist(f.c_str());
+            });
+        _retiredFiles.erase(i, _retiredFiles.end());
+    }
 
-        using namespace Serialization::ChunkFile;
-        {
-            DirectoryChunk dirHdr;
-            std::vector<ArchiveDirectoryBlock> blocks;
-            std::unique_ptr<uint8[]> flattenedSpanningHeap;
-        
-            BasicFile directoryFile;
-            bool directoryFileOpened = false;
-
-            // using a soft "TryOpen" to prevent annoying exception messages when the file is being created for the first time
-            if (directoryFile.TryOpen(_directoryFileName.c_str(), "r+b") == BasicFile::Reason::Success) {
+    void ArchiveCache::Pimpl::QueueCompactionIfRequired()
+    {
+            //  Compact when more than half of the log is dead (and there's enough dead
+            //  space to make it worthwhile)
+        const size_t minDeadSpace = 4*1024*1024;
+        if (_deadSpace < minDeadSpace || _deadSpace < _liveSpace) return;
+        if (Interlocked::CompareExchange(&_compactionQueued, 1, 0) != 0) return;
+        XlResetEvent(_compactionIdleEvent);
+
+        auto pimpl = shared_from_this();
+        ConsoleRig::GlobalServices::GetLongTaskThreadPool().Enqueue(
+            [pimpl]()
+            {
                 TRY {
-                    auto chunkTable = LoadChunkTable(directoryFile);
-                    auto chunk = FindChunk(_directoryFileName.c_str(), chunkTable, ChunkType_ArchiveDirectory, 0);
-
-                    directoryFile.Seek(chunk._fileOffset, SEEK_SET);
-                    directoryFile.Read(&dirHdr, sizeof(dirHdr), 1);
-
-                    blocks.resize(dirHdr._blockCount);
-                    directoryFile.Read(AsPointer(blocks.begin()), sizeof(ArchiveDirectoryBlock), dirHdr._blockCount);
-                    flattenedSpanningHeap = std::make_unique<uint8[]>(dirHdr._spanningHeapSize);
-                    directoryFile.Read(flattenedSpanningHeap.get(), 1, dirHdr._spanningHeapSize);
-                    directoryFileOpened = true;
-                } CATCH (...) {
-                    // We can get format errors while reading. In this case, will just overwrite the file
+                    ScopedLock(pimpl->_appendLock);
+                    pimpl->CompactAlreadyLocked();
+                } CATCH (const std::exception& e) {
+                    LogWarning << "Archive compaction failed for (" << pimpl->_mainFileName << "): " << e.what();
                 } CATCH_END
-            }
-
-            if (!directoryFileOpened) {
-                directoryFile = BasicFile();
-                directoryFile = BasicFile(_directoryFileName.c_str(), "wb");
-            }
-
-            SpanningHeap<uint32> spanningHeap(flattenedSpanningHeap.get(), dirHdr._spanningHeapSize);
-            for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
-                i->_pendingCommitPtr = ~unsigned(0x0);
-
-                // find an existing block with the same id
-                auto b = std::lower_bound(blocks.cbegin(), blocks.cend(), i->_id, DirectoryChunk::CompareBlock());
-                if (b != blocks.cend() && b->_id == i->_id) {
-                        // todo -- Often we just want to resize the last block. This would be better if
-                        //          we could reallocate that last block (by shortening or expanding it)
-                    if (b->_size == i->_data->size()) {
-                            // same size; just reuse
-                        i->_pendingCommitPtr = b->_start;
-                    } else {
-                            // destroy the old block (new block will be reallocated later)
-                        spanningHeap.Deallocate(b->_start, b->_size);
-                        blocks.erase(b);
-                    }
-                }
-            }
+                Interlocked::Exchange(&pimpl->_compactionQueued, 0);
+                XlSetEvent(pimpl->_compactionIdleEvent);
+            });
+    }
 
-                // Allocate space for new blocks. Allocate from largest to smallest.
-            std::sort(_pendingBlocks.begin(), _pendingBlocks.end(), 
-                [](const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._data->size() > rhs._data->size(); });
-            for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
-                if (i->_pendingCommitPtr == ~unsigned(0x0)) {
-
-                        // we need to allocate a new block
-                    auto newBlockSize = (unsigned)i->_data->size();
-                    
-                    #if defined(_DEBUG)
-                        auto originalHeapSize = spanningHeap.CalculateHeapSize();
-                        auto originalAllocatedSize = spanningHeap.CalculateAllocatedSpace();
-                    #endif
-
-                    i->_pendingCommitPtr = spanningHeap.Allocate(newBlockSize);
-                    if (i->_pendingCommitPtr == ~unsigned(0x0)) {
-                        i->_pendingCommitPtr = spanningHeap.AppendNewBlock(newBlockSize);
-                    }
-
-                    assert(spanningHeap.CalculateAllocatedSpace() >= (originalAllocatedSize + newBlockSize));
-                    assert(spanningHeap.CalculateHeapSize() >= originalHeapSize);
-
-                        // make sure we're not overlapping another block (just to make sure the allocators are working)
-                    #if defined(_DEBUG)
-                        for (auto b=blocks.cbegin(); b!=blocks.cend(); ++b) {
-                            assert((b->_start + b->_size) <= originalHeapSize);
-                            assert(
-                                ((i->_pendingCommitPtr + newBlockSize) <= b->_start)
-                                || (i->_pendingCommitPtr >= (b->_start + b->_size)));
-                        }
-                    #endif
-
-                    auto b = std::lower_bound(blocks.begin(), blocks.end(), i->_id, DirectoryChunk::CompareBlock());
-                    assert(b==blocks.cend() || b->_id != i->_id);
-                    ArchiveDirectoryBlock newBlock = { i->_id, i->_pendingCommitPtr, newBlockSize };
-                    blocks.insert(b, newBlock);
-
-                }
-            }
+///////////////////////////////////////////////////////////////////////////////////////////////////
 
-                //  everything is allocated... we need to write the blocks to the data file
-                //  sort by pending commit ptr for convenience
-            std::sort(_pendingBlocks.begin(), _pendingBlocks.end(), 
-                [](const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._pendingCommitPtr < rhs._pendingCommitPtr; });
-            {
-                BasicFile dataFile;
-                bool good = dataFile.TryOpen(_mainFileName.c_str(), "r+b") == BasicFile::Reason::Success;
-                if (!good)
-                    dataFile = BasicFile(_mainFileName.c_str(), "wb");
-                for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
-                    dataFile.Seek(i->_pendingCommitPtr, SEEK_SET);
-                    dataFile.Write(AsPointer(i->_data->cbegin()), 1, i->_data->size());
-                }
-            }
-
-                // write the new directory file (including the blocks list and spanning heap)
-            {
-                ChunkFileHeader fileHeader;
-                XlZeroMemory(fileHeader);
-                fileHeader._magic = MagicHeader;
-                fileHeader._fileVersionNumber = 0;
-                XlCopyString(fileHeader._buildVersion, dimof(fileHeader._buildVersion), _buildVersionString);
-                XlCopyString(fileHeader._buildDate, dimof(fileHeader._buildDate), _buildDateString);
-                fileHeader._chunkCount = 1;
-
-                auto flattenedHeap = spanningHeap.Flatten();
-            
-                ChunkHeader chunkHeader(
-                    ChunkType_ArchiveDirectory, 0, "ArchiveCache", unsigned(sizeof(DirectoryChunk) + blocks.size() * sizeof(ArchiveDirectoryBlock) + flattenedHeap.second));
-                chunkHeader._fileOffset = sizeof(ChunkFileHeader) + sizeof(ChunkHeader);
-
-                DirectoryChunk chunkData;
-                chunkData._blockCount = (unsigned)blocks.size();
-                chunkData._spanningHeapSize = (unsigned)flattenedHeap.second;
-
-                    // Write blank header data to the file
-                    //  note that there's a potential problem here, because
-                    //  we don't truncate the file before writing this. So if there is
-                    //  some data in there (but invalid data), then it will remain in the file
-                directoryFile.Seek(0, SEEK_SET);
-                directoryFile.Write(&fileHeader, sizeof(fileHeader), 1);
-                directoryFile.Write(&chunkHeader, sizeof(chunkHeader), 1);
-                directoryFile.Write(&chunkData, sizeof(chunkData), 1);
-                directoryFile.Write(AsPointer(blocks.begin()), sizeof(ArchiveDirectoryBlock), blocks.size());
-                directoryFile.Write(flattenedHeap.first.get(), 1, flattenedHeap.second);
-            }
+    void ArchiveCache::Commit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush)
+    {
+            //  Append a new record to the end of the log. Readers aren't blocked by this; we only
+            //  publish the new record (by updating the index) after it's completely written
+        #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
+            auto stringSize = unsigned(attachedString.size());
+        #else
+            unsigned stringSize = 0;
+        #endif
+        auto dataSize = data ? unsigned(data->size()) : 0u;
+
+        ScopedLock(_pimpl->_appendLock);
+        ArchiveLogRecord hdr;
+        XlZeroMemory(hdr);
+        hdr._magic = 0;         // (written last, below)
+        hdr._dataSize = dataSize;
+        hdr._id = id;
+        hdr._attachedStringSize = stringSize;
+        auto recordSize = RecordSize(hdr);
+
+            // (always leave room for a zeroed record header after the last record)
+        auto snapshot = _pimpl->GetSnapshot();
+        if (_pimpl->_tail + recordSize + sizeof(ArchiveLogRecord) > snapshot->_capacity) {
+            _pimpl->Grow(_pimpl->_tail + recordSize + sizeof(ArchiveLogRecord));
+            snapshot = _pimpl->GetSnapshot();
         }
 
+            //  Write everything except the magic value first, and then calculate the 
+            //  checksum from what is in the mapping. The magic value goes in last, once
+            //  everything else is in place.
+        auto* dst = PtrAdd(snapshot->_mapping->GetData(), ptrdiff_t(_pimpl->_tail));
+        XlCopyMemory(dst, &hdr, sizeof(hdr));
+        if (dataSize) XlCopyMemory(PtrAdd(dst, sizeof(hdr)), AsPointer(data->cbegin()), dataSize);
         #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-            {
-                        //  read the old string table, and then merge it
-                        //  with the new. This will destroy and re-write the entire debugging file in one go.
-                char debugFilename[MaxPath];
-                XlCombineString(debugFilename, dimof(debugFilename), _mainFileName.c_str(), ".debug");
-                    
-                std::vector<std::pair<uint64, std::string>> attachedStrings;
-
-                // try to open an existing file -- but if there are any errors, we can just discard the
-                // old contents
-                BasicFile debugFile;
-                if (debugFile.TryOpen(debugFilename, "rb") == BasicFile::Reason::Success) {
-                    auto chunkTable = LoadChunkTable(debugFile);
-                    auto chunk = FindChunk(debugFilename, chunkTable, ChunkType_ArchiveAttachments, 0);
-
-                    AttachedStringChunk hdr;
-                    debugFile.Seek(chunk._fileOffset, SEEK_SET);
-                    debugFile.Read(&hdr, sizeof(hdr), 1);
-
-                    std::vector<AttachedStringChunk::Block> attachedBlocks;
-                    attachedStrings.resize(hdr._blockCount);
-                    debugFile.Read(AsPointer(attachedBlocks.begin()), sizeof(AttachedStringChunk::Block), hdr._blockCount);
-                    auto startPt = debugFile.TellP();
-                    for (auto b=attachedBlocks.cbegin(); b!=attachedBlocks.cend(); ++b) {
-                        debugFile.Seek(startPt + b->_start, SEEK_SET);
-                        std::string t; t.resize(b->_size);
-                        debugFile.Read(AsPointer(t.begin()), 1, b->_size);
-                        attachedStrings.push_back(std::make_pair(b->_id, t));
-                    }
-                }
-
-                        // merge in the new strings
-                for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
-                    auto c = LowerBound(attachedStrings, i->_id);
-                    if (c!=attachedStrings.end() && c->first == i->_id) {
-                        c->second = i->_attachedString;
-                    } else {
-                        attachedStrings.insert(c, std::make_pair(i->_id, i->_attachedString));
-                    }
-                }
-
-                        // write the new debugging file
-                TRY {
-                    SimpleChunkFileWriter debugFile(1, _buildVersionString, _buildDateString, std::make_tuple(debugFilename, "wb", 0));
-                    debugFile.BeginChunk(ChunkType_ArchiveAttachments, 0, "ArchiveAttachments");
-
-                    AttachedStringChunk hdr;
-                    hdr._blockCount = (unsigned)attachedStrings.size();
-                    debugFile.Write(&hdr, sizeof(AttachedStringChunk), 1);
-
-                    unsigned offset = 0;
-                    for (auto b=attachedStrings.cbegin(); b!=attachedStrings.cend(); ++b) {
-                        AttachedStringChunk::Block block;
-                        block._id = b->first;
-                        block._start = offset;
-                        block._size = (unsigned)b->second.size();
-                        offset += block._size;
-                        debugFile.Write(&block, sizeof(block), 1);
-                    }
-
-                    for (auto b=attachedStrings.cbegin(); b!=attachedStrings.cend(); ++b) {
-                        debugFile.Write(AsPointer(b->second.begin()), sizeof(std::string::value_type), b->second.size());
-                    }
-                } CATCH (...) {
-                } CATCH_END
-            }
+            if (stringSize) XlCopyMemory(PtrAdd(dst, sizeof(hdr) + dataSize), attachedString.c_str(), stringSize);
         #endif
+        auto* dstRecord = (ArchiveLogRecord*)dst;
+        dstRecord->_checksum = CalculateChecksum(hdr, PtrAdd(dst, sizeof(hdr)));
+        Interlocked::Exchange((Interlocked::Value*)&dstRecord->_magic, (Interlocked::Value)ArchiveRecordMagic);
+
+        auto* existing = snapshot->_index->Find(id);
+        if (existing) {
+            auto size = RecordSize(*snapshot->GetRecord((uint64)existing->_recordOffset));
+            _pimpl->_deadSpace += size;
+            _pimpl->_liveSpace -= size;
+            Interlocked::Exchange64(&existing->_recordOffset, (Interlocked::Value64)_pimpl->_tail);
+        } else {
+            snapshot->_index->Insert(id, std::make_unique<ArchiveIndexEntry>(_pimpl->_tail));
+        }
+        _pimpl->_liveSpace += recordSize;
+        _pimpl->_tail += recordSize;
 
-        for (const auto& i:_pendingBlocks)
-            i._onFlush();
-
-            // clear all pending block (now that they're flushed to disk)
-        _pendingBlocks.clear();
+        if (onFlush)
+            _pimpl->_pendingFlushes.push_back(std::move(onFlush));
+        _pimpl->QueueCompactionIfRequired();
     }
-    
-    auto ArchiveCache::GetMetrics() const -> Metrics
+
+    auto ArchiveCache::TryOpenSpan(uint64 id) const -> BlockSpan
     {
-        using namespace Serialization::ChunkFile;
+        for (;;) {
+            auto snapshot = _pimpl->GetSnapshot();
+            auto* entry = snapshot->_index->Find(id);
+            if (!entry) return BlockSpan();
+
+                //  If the log grew after we took our snapshot, the record may be beyond
+                //  the end of our mapping. In that case, just get a new snapshot
+            auto* r = snapshot->GetRecord((uint64)Interlocked::Load64(&entry->_recordOffset));
+            if (!r) continue;
+
+            BlockSpan result;
+            result._data = PtrAdd(r, sizeof(ArchiveLogRecord));
+            result._size = r->_dataSize;
+            result._mapping = snapshot->_mapping;
+            return result;
+        }
+    }
 
-            // We need to open the file and get metrics information
-            // for the blocks contained within
-        ////////////////////////////////////////////////////////////////////////////////////
-        std::vector<ArchiveDirectoryBlock> fileBlocks;
-        TRY {
-            BasicFile directoryFile(_directoryFileName.c_str(), "rb");
+    auto ArchiveCache::TryOpenFromCache(uint64 id) -> BlockAndSize
+    {
+        auto span = TryOpenSpan(id);
+        if (!span) return nullptr;
+        return std::make_shared<std::vector<uint8>>((const uint8*)span._data, PtrAdd((const uint8*)span._data, span._size));
+    }
 
-            auto chunkTable = LoadChunkTable(directoryFile);
-            auto chunk = FindChunk(_directoryFileName.c_str(), chunkTable, ChunkType_ArchiveDirectory, 0);
+    bool ArchiveCache::HasItem(uint64 id) const
+    {
+        return _pimpl->GetSnapshot()->_index->Find(id) != nullptr;
+    }
 
-            directoryFile.Seek(chunk._fileOffset, SEEK_SET);
-            DirectoryChunk dirHdr;
-            directoryFile.Read(&dirHdr, sizeof(dirHdr), 1);
+    void ArchiveCache::FlushToDisk()
+    {
+            //  The records are written through the mapping as they are committed. Here we 
+            //  force the OS to write them to disk, and only then call the flush callbacks 
+            //  for the records that were committed before the flush.
+        std::vector<std::function<void()>> flushes;
+        std::shared_ptr<ArchiveLogSnapshot> snapshot;
+        size_t tail;
+        {
+            ScopedLock(_pimpl->_appendLock);
+            std::swap(flushes, _pimpl->_pendingFlushes);
+            snapshot = _pimpl->GetSnapshot();
+            tail = _pimpl->_tail;
+        }
 
-            fileBlocks.resize(dirHdr._blockCount);
-            directoryFile.Read(AsPointer(fileBlocks.begin()), sizeof(ArchiveDirectoryBlock), dirHdr._blockCount);
-        } CATCH (...) {
-        } CATCH_END
+        if (!snapshot->_mapping->Flush(0, tail)) {
+                // (put the callbacks back, so they will be called by the next successful flush)
+            {
+                ScopedLock(_pimpl->_appendLock);
+                _pimpl->_pendingFlushes.insert(
+                    _pimpl->_pendingFlushes.begin(),
+                    std::make_move_iterator(flushes.begin()), std::make_move_iterator(flushes.end()));
+            }
+            Throw(::Exceptions::BasicLabel("Failed while flushing archive (%s) to disk", _pimpl->_mainFileName.c_str()));
+        }
 
-        ////////////////////////////////////////////////////////////////////////////////////
-        #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-            std::vector<AttachedStringChunk::Block> attachedBlocks;
-            BasicFile debugFile;
-            unsigned debugFileStartPoint = 0;
-            TRY {
-                char debugFilename[MaxPath];
-                XlCombineString(debugFilename, dimof(debugFilename), _mainFileName.c_str(), ".debug");
-                debugFile = BasicFile(debugFilename, "rb");
-
-                auto chunkTable = LoadChunkTable(debugFile);
-                auto chunk = FindChunk(_directoryFileName.c_str(), chunkTable, ChunkType_ArchiveAttachments, 0);
-
-                debugFile.Seek(chunk._fileOffset, SEEK_SET);
-                AttachedStringChunk dirHdr;
-                debugFile.Read(&dirHdr, sizeof(dirHdr), 1);
-
-                attachedBlocks.resize(dirHdr._blockCount);
-                debugFile.Read(AsPointer(attachedBlocks.begin()), sizeof(AttachedStringChunk::Block), dirHdr._blockCount);
-                debugFileStartPoint = (unsigned)debugFile.TellP();
-            } CATCH (...) {
-            } CATCH_END
-        #endif
+        for (const auto& f:flushes)
+            f();
+    }
 
-        ////////////////////////////////////////////////////////////////////////////////////
-        std::vector<BlockMetrics> blocks;
-        unsigned usedSpace = 0;
-        for (auto b=fileBlocks.cbegin(); b!=fileBlocks.cend(); ++b) {
-            BlockMetrics metrics;
-            metrics._id = b->_id;
-            metrics._offset = b->_start;
-            metrics._size = b->_size;
+    void ArchiveCache::Compact()
+    {
+        ScopedLock(_pimpl->_appendLock);
+        _pimpl->CompactAlreadyLocked();
+    }
 
-            #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-                auto s = std::lower_bound(attachedBlocks.cbegin(), attachedBlocks.cend(), 
-                    b->_id, AttachedStringChunk::CompareBlock());
-                if (s != attachedBlocks.cend() && s->_id == b->_id) {
-                    TRY {
-                        std::string t;
-                        t.resize(s->_size);
-                        debugFile.Seek(s->_start + debugFileStartPoint, SEEK_SET);
-                        debugFile.Read(AsPointer(t.begin()), 1, s->_size);
-                        metrics._attachedString = t;
-                    } CATCH (...) {
-                    } CATCH_END
-                }
-            #endif
+    auto ArchiveCache::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        std::shared_ptr<ArchiveLogSnapshot> snapshot;
 
-            blocks.push_back(metrics);
-            usedSpace += metrics._size;
+            //  Commit can insert into the index while we're iterating through it,
+            //  so we must copy the index while holding the lock. The records themselves
+            //  are never modified once written, and the snapshot keeps them mapped.
+        std::vector<std::pair<uint64, uint64>> records;
+        {
+            ScopedLock(_pimpl->_appendLock);
+            snapshot = _pimpl->GetSnapshot();
+            result._allocatedFileSize = unsigned(snapshot->_capacity);
+            result._usedSpace = unsigned(_pimpl->_liveSpace);
+            result._deadSpace = unsigned(_pimpl->_deadSpace);
+            result._compactionCount = _pimpl->_compactionCount;
+
+            records.reserve(snapshot->_index->size());
+            for (const auto& i:*snapshot->_index)
+                records.push_back(std::make_pair(i.first, (uint64)Interlocked::Load64(&i.second->_recordOffset)));
         }
 
-        ////////////////////////////////////////////////////////////////////////////////////
-        for (auto p=_pendingBlocks.cbegin(); p!=_pendingBlocks.cend(); ++p) {
+        result._generation = snapshot->_generation;
+        result._blocks.reserve(records.size());
+        for (const auto& i:records) {
+            auto offset = i.second;
+            auto* r = snapshot->GetRecord(offset);
+            if (!r) continue;
 
-            BlockMetrics newMetrics;
-            newMetrics._id = p->_id;
-            newMetrics._size = (unsigned)p->_data->size();
-            newMetrics._offset = ~unsigned(0x0);
+            BlockMetrics metrics;
+            metrics._id = i.first;
+            metrics._offset = unsigned(offset + sizeof(ArchiveLogRecord));
+            metrics._size = r->_dataSize;
             #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-                newMetrics._attachedString = p->_attachedString;
+                auto* str = (const char*)PtrAdd(r, sizeof(ArchiveLogRecord) + r->_dataSize);
+                metrics._attachedString = std::string(str, str + r->_attachedStringSize);
             #endif
-
-            auto b = std::find_if(blocks.begin(), blocks.end(),
-                [=](const BlockMetrics& t) { return t._id == newMetrics._id; });
-            if (b != blocks.end()) {
-                *b = newMetrics;
-            } else {
-                blocks.push_back(newMetrics);
-            }
+            result._blocks.push_back(std::move(metrics));
         }
-
-        ////////////////////////////////////////////////////////////////////////////////////
-        Metrics result;
-        result._blocks = std::move(blocks);
-        result._usedSpace = usedSpace;
-        result._allocatedFileSize = unsigned(Utility::GetFileSize(_mainFileName.c_str()));
         return result;
     }
 
     ArchiveCache::ArchiveCache(
         const char archiveName[],
         const char buildVersionString[],
-        const char buildDateString[]) 
-    : _mainFileName(archiveName)
-    , _buildVersionString(buildVersionString)
-    , _buildDateString(buildDateString)
-    , _cachedBlockListValid(false)
+        const char buildDateString[])
     {
-        _directoryFileName = _mainFileName + ".dir";
+        auto pimpl = std::make_shared<Pimpl>();
+        pimpl->_mainFileName = archiveName;
+        pimpl->_directoryFileName = pimpl->_mainFileName + ".dir";
+        pimpl->_buildVersionString = buildVersionString;
+        pimpl->_buildDateString = buildDateString;
 
             // (make sure the directory provided exists)
         char dirName[MaxPath];
-        XlDirname(dirName, dimof(dirName), _mainFileName.c_str());
+        XlDirname(dirName, dimof(dirName), pimpl->_mainFileName.c_str());
         CreateDirectoryRecursive(dirName);
+
+        pimpl->Open();
+        _pimpl = std::move(pimpl);
     }
 
-    ArchiveCache::~ArchiveCache() 
+    ArchiveCache::~ArchiveCache()
     {
+            // wait for any background compaction to finish
+        XlWaitForSyncObject(_pimpl->_compactionIdleEvent, XL_INFINITE);
+
         TRY {
             FlushToDisk();
         } CATCH (const std::exception& e) {
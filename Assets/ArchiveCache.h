@@ -6,28 +6,59 @@
 
 #pragma once
 
-#include "../Utility/Threading/Mutex.h"
 #include "../Core/Types.h"
 
 #include <memory>
 #include <vector>
+#include <string>
+#include <functional>
 
 #define ARCHIVE_CACHE_ATTACHED_STRINGS
 
 namespace Assets
 {
-    class ArchiveDirectoryBlock;
-
+    /// <summary>Stores many small blocks of data in a single file</summary>
+    /// Blocks are identified by a 64 bit id. The archive is an append-only log that is
+    /// memory mapped for reading:
+    ///  <list>
+    ///     <item>Commit() appends a new record to the end of the log. If there is an older
+    ///         record with the same id, it becomes dead (but remains readable by anyone
+    ///         still holding a span to it).</item>
+    ///     <item>TryOpenSpan() returns a pointer directly into the mapping (no file reads
+    ///         or copies). Readers are never blocked by commits.</item>
+    ///     <item>When enough of the log is dead, a background compactor writes the live
+    ///         records into a new log file (a new "generation"), and switches over to it.</item>
+    ///  </list>
+    /// The small ".dir" file records the active generation.
     class ArchiveCache
     {
     public:
         typedef std::shared_ptr<std::vector<uint8>> BlockAndSize;
 
+            /// <summary>Block data referenced in place in the archive</summary>
+            /// The span keeps the underlying mapping alive; so it remains valid even
+            /// if the block is replaced or the archive is compacted.
+        class BlockSpan
+        {
+        public:
+            const void*             _data;
+            size_t                  _size;
+            std::shared_ptr<void>   _mapping;
+
+            explicit operator bool() const { return _data != nullptr; }
+            BlockSpan() : _data(nullptr), _size(0) {}
+        };
+
         void            Commit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush);
+        BlockSpan       TryOpenSpan(uint64 id) const;
         BlockAndSize    TryOpenFromCache(uint64 id);
         bool            HasItem(uint64 id) const;
         void            FlushToDisk();
-        
+
+            /// <summary>Write all live blocks into a new log file</summary>
+            /// Normally this happens automatically in a background thread.
+        void            Compact();
+
         class BlockMetrics
         {
         public:
@@ -40,6 +71,9 @@ namespace Assets
         public:
             unsigned _allocatedFileSize;
             unsigned _usedSpace;
+            unsigned _deadSpace;
+            unsigned _generation;
+            unsigned _compactionCount;
             std::vector<BlockMetrics> _blocks;
         };
 
@@ -56,47 +90,9 @@ namespace Assets
         ArchiveCache& operator=(ArchiveCache&&) = delete;
 
     protected:
-        class PendingCommit
-        {
-        public:
-            uint64          _id;
-            BlockAndSize    _data;
-            unsigned        _pendingCommitPtr;      // (only used during FlushToDisk)
-            std::function<void()> _onFlush;
-
-            #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
-                std::string     _attachedString;    // used for appending debugging/profiling information. user defined format
-            #endif
-
-            PendingCommit() {}
-            PendingCommit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush);
-            PendingCommit(PendingCommit&& moveFrom);
-            PendingCommit& operator=(PendingCommit&& moveFrom);
-
-        private:
-            PendingCommit(const PendingCommit&);
-            PendingCommit& operator=(const PendingCommit&);
-        };
-
-        mutable Threading::Mutex _pendingBlocksLock;
-        std::vector<PendingCommit> _pendingBlocks;
-        std::string _mainFileName, _directoryFileName;
-
-        const char*     _buildVersionString;
-        const char*     _buildDateString;
-
-        class ComparePendingCommit
-        {
-        public:
-            bool operator()(const PendingCommit& lhs, uint64 rhs) { return lhs._id < rhs; }
-            bool operator()(uint64 lhs, const PendingCommit& rhs) { return lhs < rhs._id; }
-            bool operator()(const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._id < rhs._id; }
-        };
-
-        mutable std::vector<ArchiveDirectoryBlock> _cachedBlockList;
-        mutable bool _cachedBlockListValid;
-        const std::vector<ArchiveDirectoryBlock>* GetBlockList() const;
+        class Pimpl;
+        std::shared_ptr<Pimpl> _pimpl;
     };
 
 
-}
\ No newline at end of file
+}
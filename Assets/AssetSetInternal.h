@@ -8,7 +8,9 @@
 
 #include "AssetSetManager.h"
 #include "AssetsCore.h"
+#include "../Utility/Threading/ThreadingUtils.h"
 #include <vector>
+#include <memory>
 #include <assert.h>
 
 #define ASSETS_STORE_NAMES
@@ -61,12 +63,178 @@ namespace Assets { namespace Internal
         ::Assets::rstring _initializer;
     };
 
+        //  Hash table used to store the assets in an AssetSet.
+        //
+        //  Find() is lock free, and can be called at the same time as Insert(). But only one
+        //  thread may call Insert() at a time (AssetSet uses its lock for this).
+        //
+        //  The table is split into shards (using the top bits of the hash). Each shard is an
+        //  open addressing table with linear probing, and is kept at most half full. When a
+        //  shard needs to grow, we build a new slot array on the side and publish it with a
+        //  single pointer exchange. Readers may still be searching the old array, so old arrays
+        //  are retained until Clear(). The total size of the retired arrays is always smaller
+        //  than the active arrays, so this costs very little.
+        //
+        //  Values are owned by the table, and never move after they are inserted.
+    template <typename Value>
+        class AssetTable
+    {
+    public:
+        using Values = std::vector<std::pair<uint64, std::unique_ptr<Value>>>;
+
+        Value*      Find(uint64 hash) const never_throws;
+        Value*      Insert(uint64 hash, std::unique_ptr<Value>&& value);
+        void        Clear();
+
+        size_t                              size() const    { return _values.size(); }
+        typename Values::const_iterator     begin() const   { return _values.cbegin(); }
+        typename Values::const_iterator     end() const     { return _values.cend(); }
+        unsigned                            GetGrowthCount() const { return _growthCount; }
+
+        AssetTable();
+        ~AssetTable();
+        AssetTable(const AssetTable&) = delete;
+        AssetTable& operator=(const AssetTable&) = delete;
+
+    private:
+        class Slot
+        {
+        public:
+            Interlocked::Value64    _key;       // (0 means empty)
+            void* volatile          _value;
+        };
+
+        class SlotArray
+        {
+        public:
+            std::unique_ptr<Slot[]> _slots;
+            unsigned                _mask;
+        };
+
+        static const unsigned ShardCountLog2 = 4;
+        static const unsigned ShardCount = 1u << ShardCountLog2;
+        static const unsigned InitialShardSize = 16;
+
+        class Shard
+        {
+        public:
+            void* volatile                          _active;        // SlotArray*
+            unsigned                                _count;
+            std::vector<std::unique_ptr<SlotArray>> _arrays;        // the active array is always at the back
+        };
+
+        Shard           _shards[ShardCount];
+        void* volatile  _zeroKeyValue;      // (0 is reserved for empty slots, so hash 0 is handled separately)
+        Values          _values;
+        unsigned        _growthCount;
+
+        static unsigned ShardIndex(uint64 hash) { return unsigned(hash >> (64 - ShardCountLog2)); }
+        static void     WriteSlot(SlotArray& arr, uint64 hash, void* value);
+        SlotArray&      AllocateArray(Shard& shard, unsigned slotCount);
+    };
+
+    template <typename Value>
+        Value* AssetTable<Value>::Find(uint64 hash) const never_throws
+    {
+        if (!hash) return (Value*)Interlocked::LoadPointer(&_zeroKeyValue);
+
+        const auto& shard = _shards[ShardIndex(hash)];
+        auto* arr = (const SlotArray*)Interlocked::LoadPointer(&shard._active);
+        if (!arr) return nullptr;
+
+        auto* slots = arr->_slots.get();
+        for (auto c=unsigned(hash) & arr->_mask;; c=(c+1) & arr->_mask) {
+            auto key = (uint64)Interlocked::Load64(&slots[c]._key);
+            if (key == hash) return (Value*)Interlocked::LoadPointer(&slots[c]._value);
+            if (!key) return nullptr;
+        }
+    }
+
+    template <typename Value>
+        void AssetTable<Value>::WriteSlot(SlotArray& arr, uint64 hash, void* value)
+    {
+        auto* slots = arr._slots.get();
+        auto c = unsigned(hash) & arr._mask;
+        while (slots[c]._key) c = (c+1) & arr._mask;
+
+            // write the value first; readers only look at the value after they see the key
+        Interlocked::ExchangePointer(&slots[c]._value, value);
+        Interlocked::Exchange64(&slots[c]._key, (Interlocked::Value64)hash);
+    }
+
+    template <typename Value>
+        auto AssetTable<Value>::AllocateArray(Shard& shard, unsigned slotCount) -> SlotArray&
+    {
+        auto arr = std::make_unique<SlotArray>();
+        arr->_slots = std::make_unique<Slot[]>(slotCount);
+        arr->_mask = slotCount-1;
+        shard._arrays.push_back(std::move(arr));
+        return *shard._arrays.back();
+    }
+
+    template <typename Value>
+        Value* AssetTable<Value>::Insert(uint64 hash, std::unique_ptr<Value>&& value)
+    {
+        assert(!Find(hash));    // each hash can only be inserted once
+        auto* result = value.get();
+        _values.push_back(std::make_pair(hash, std::move(value)));
+
+        if (!hash) {
+            Interlocked::ExchangePointer(&_zeroKeyValue, result);
+            return result;
+        }
+
+        auto& shard = _shards[ShardIndex(hash)];
+        auto* arr = (SlotArray*)shard._active;
+        if (!arr || (shard._count+1)*2 > (arr->_mask+1)) {
+                // build a bigger array with all of the existing entries, and then publish it
+            auto& newArr = AllocateArray(shard, arr ? (arr->_mask+1)*2 : InitialShardSize);
+            if (arr) {
+                for (unsigned c=0; c<=arr->_mask; ++c)
+                    if (arr->_slots[c]._key)
+                        WriteSlot(newArr, (uint64)arr->_slots[c]._key, arr->_slots[c]._value);
+                ++_growthCount;
+            }
+            Interlocked::ExchangePointer(&shard._active, &newArr);
+            arr = &newArr;
+        }
+
+        WriteSlot(*arr, hash, result);
+        ++shard._count;
+        return result;
+    }
+
+    template <typename Value>
+        void AssetTable<Value>::Clear()
+    {
+            // (not safe to call at the same time as Find)
+        for (auto& s:_shards) {
+            s._active = nullptr;
+            s._count = 0;
+            s._arrays.clear();
+        }
+        _zeroKeyValue = nullptr;
+        _values.clear();
+    }
+
+    template <typename Value>
+        AssetTable<Value>::AssetTable()
+    {
+        for (auto& s:_shards) { s._active = nullptr; s._count = 0; }
+        _zeroKeyValue = nullptr;
+        _growthCount = 0;
+    }
+
+    template <typename Value>
+        AssetTable<Value>::~AssetTable() {}
+
     template <typename AssetType>
         class AssetSet : public IAssetSet
     {
     public:
         void            Clear();
         void            LogReport() const;
+        AssetSetMetrics GetMetrics() const;
 
         uint64          GetTypeCode() const;
         const char*     GetTypeName() const;
@@ -80,28 +248,43 @@ namespace Assets { namespace Internal
         public:
             std::unique_ptr<AssetType> _active;
             std::unique_ptr<AssetType> _pendingReplacement;
+            void* volatile _published;      // _active, when it can be returned without taking the lock
 
-            AssetContainer() {}
-            AssetContainer(std::unique_ptr<AssetType>&& active, std::unique_ptr<AssetType>&& pendingReplacement) : _active(std::move(active)), _pendingReplacement(std::move(pendingReplacement)) {}
-            AssetContainer(AssetContainer&& moveFrom) never_throws : _active(std::move(moveFrom._active)), _pendingReplacement(std::move(moveFrom._pendingReplacement)) {}
-            AssetContainer& operator=(AssetContainer&& moveFrom) never_throws { _active = std::move(moveFrom._active); _pendingReplacement = std::move(moveFrom._pendingReplacement); return *this; }
+                // call (with the lock held) after changing _active or _pendingReplacement
+            void Publish() { Interlocked::ExchangePointer(&_published, _pendingReplacement ? nullptr : _active.get()); }
+
+            AssetContainer() : _published(nullptr) {}
+            AssetContainer(std::unique_ptr<AssetType>&& active, std::unique_ptr<AssetType>&& pendingReplacement) : _active(std::move(active)), _pendingReplacement(std::move(pendingReplacement)), _published(nullptr) { Publish(); }
+            AssetContainer(const AssetContainer&) = delete;
+            AssetContainer& operator=(const AssetContainer&) = delete;
         };
 
-        std::vector<std::pair<uint64, AssetContainer>> _assets;
+        AssetTable<AssetContainer> _assets;
         std::vector<std::pair<uint64, ActiveCompileOperation>> _activeCompiles;
 
+            // (these are only for metrics)
+        Interlocked::Value _lockedLookups;
+        Interlocked::Value _contendedLocks;
+
         AssetType* Add(uint64 hash, std::unique_ptr<AssetType>&& asset)
         {
             AssetType* result = asset.get();
-            auto i = LowerBound(_assets, hash);
-            auto t = AssetSet<AssetType>::AssetContainer(std::move(asset), std::unique_ptr<AssetType>());
-            _assets.insert(i, std::make_pair(hash, std::move(t)));
+            auto* existing = _assets.Find(hash);
+            if (existing) {
+                    // (this can happen when a divergent asset replaces an invalid asset)
+                existing->_pendingReplacement.reset();
+                existing->_active = std::move(asset);
+                existing->Publish();
+                return result;
+            }
+            _assets.Insert(hash, std::make_unique<AssetContainer>(std::move(asset), std::unique_ptr<AssetType>()));
             return result;
         }
 			
 		#if defined(ASSETS_STORE_DIVERGENT)
 			using DivAsset = typename AssetTraits<AssetType>::DivAsset;
 			std::vector<std::pair<uint64, std::shared_ptr<DivAsset>>> _divergentAssets;
+            Interlocked::Value _divergentCount;     // (divergent assets disable lock free lookups)
 		#endif
 
         #if defined(ASSETS_STORE_NAMES)
@@ -127,6 +310,7 @@ namespace Assets { namespace Internal
 
         std::unique_ptr<Utility::Threading::RecursiveMutex> CreateRecursiveMutexPtr();
         void LockMutex(Utility::Threading::RecursiveMutex&);
+        bool TryLockMutex(Utility::Threading::RecursiveMutex&);
         void UnlockMutex(Utility::Threading::RecursiveMutex&);
 
         template <typename AssetType>
@@ -140,7 +324,10 @@ namespace Assets { namespace Internal
             AssetSetPtr(AssetSet<AssetType>& assetSet)
                 : _assetSet(&assetSet) 
             {
-                LockMutex(*_assetSet->_lock);
+                if (!TryLockMutex(*_assetSet->_lock)) {
+                    Interlocked::Increment(&_assetSet->_contendedLocks);
+                    LockMutex(*_assetSet->_lock);
+                }
             }
             ~AssetSetPtr() 
             {
@@ -176,11 +363,19 @@ namespace Assets { namespace Internal
         uint64 hash, const std::string& name);
 
     template<typename AssetType>
-        AssetSetPtr<AssetType> GetAssetSet() 
+        AssetSet<AssetType>& GetAssetSetUnlocked()
     {
+            // Only use the result of this function with lock free methods (eg, AssetTable::Find)
         static AssetSet<AssetType>* set = nullptr;
         if (!set)
             set = GetAssetSetManager().GetSetForType<AssetType>();
+        return *set;
+    }
+
+    template<typename AssetType>
+        AssetSetPtr<AssetType> GetAssetSet() 
+    {
+        auto* set = &GetAssetSetUnlocked<AssetType>();
             
         #if defined(ASSETS_STORE_NAMES)
                 // These should agree. If there's a mismatch, there may be a threading problem
@@ -58,6 +58,17 @@ namespace Assets
         }
     }
 
+    std::vector<AssetSetMetrics> AssetSetManager::GetMetrics()
+    {
+        Lock();
+        std::vector<AssetSetMetrics> result;
+        result.reserve(_pimpl->_sets.size());
+        for (auto i=_pimpl->_sets.begin(); i!=_pimpl->_sets.end(); ++i)
+            result.push_back(i->second->GetMetrics());
+        Unlock();
+        return std::move(result);
+    }
+
 	bool AssetSetManager::IsBoundThread() const
 	{
 		return _pimpl->_boundThreadId == Threading::CurrentThreadId();
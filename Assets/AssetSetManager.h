@@ -9,9 +9,25 @@
 #include "../Core/Types.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace Assets
 {
+        /// <summary>Profiling information for a single asset set</summary>
+        /// Lookups for assets that exist and are up-to-date don't take the asset set lock, 
+        /// and aren't counted. "_lockedLookups" counts lookups that needed the lock (eg, new
+        /// assets, invalidated assets), and "_contendedLocks" counts the times a thread had
+        /// to wait for the lock.
+    class AssetSetMetrics
+    {
+    public:
+        const char* _typeName;
+        unsigned    _assetCount;
+        unsigned    _lockedLookups;
+        unsigned    _contendedLocks;
+        unsigned    _tableGrowths;
+    };
+
     class IAssetSet
     {
     public:
@@ -23,6 +39,7 @@ namespace Assets
         virtual uint64          GetDivergentId(unsigned index) const = 0;
         virtual bool            DivergentHasChanges(unsigned index) const = 0;
         virtual std::string     GetAssetName(uint64 id) const = 0;
+        virtual AssetSetMetrics GetMetrics() const = 0;
         virtual ~IAssetSet();
     };
 
@@ -36,6 +53,7 @@ namespace Assets
 
         void Clear();
         void LogReport();
+        std::vector<AssetSetMetrics> GetMetrics();
         unsigned BoundThreadId() const;
         bool IsBoundThread() const;
 
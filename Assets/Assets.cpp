@@ -67,6 +67,7 @@ namespace Assets
 
         std::unique_ptr<Threading::RecursiveMutex> CreateRecursiveMutexPtr() { return std::make_unique<Threading::RecursiveMutex>(); }
         void LockMutex(Threading::RecursiveMutex& mutex) { mutex.lock(); }
+        bool TryLockMutex(Threading::RecursiveMutex& mutex) { return mutex.try_lock(); }
         void UnlockMutex(Threading::RecursiveMutex& mutex) { mutex.unlock(); }
 
         AssetSetManager& GetAssetSetManager()
@@ -164,6 +164,23 @@ namespace Assets { namespace Internal
     inline bool ReadyForReplacement(...) { return true; /* can't query, must do immediate replacement */ }
     #pragma managed(pop)
 
+        //  Lookup without taking the asset set lock. Returns null if the asset doesn't exist yet,
+        //  or if it needs a refresh (or anything else that requires the full GetAsset path)
+    template<bool DoCheckDependancy, typename AssetType>
+        const AssetType* TryGetAssetLockFree(AssetSet<AssetType>& assetSet, uint64 hash)
+        {
+            #if defined(ASSETS_STORE_DIVERGENT)
+                if (Interlocked::Load(&assetSet._divergentCount)) return nullptr;
+            #endif
+
+            auto* cnt = assetSet._assets.Find(hash);
+            if (!cnt) return nullptr;
+
+            auto* asset = (const AssetType*)Interlocked::LoadPointer(&cnt->_published);
+            if (!asset || CheckDependancy<DoCheckDependancy>::NeedsRefresh(asset)) return nullptr;
+            return asset;
+        }
+
 	template<bool DoCheckDependancy, bool DoBackgroundCompile, typename AssetType, typename... Params>
 		const AssetType& GetAsset(AssetSetPtr<AssetType>& assetSet, Params... initialisers)
         {
@@ -177,6 +194,7 @@ namespace Assets { namespace Internal
                 //      * otherwise we build a new asset
                 //
 			auto hash = BuildHash(initialisers...);
+            Interlocked::Increment(&assetSet->_lockedLookups);
 
 			#if defined(ASSETS_STORE_DIVERGENT)
 					// divergent assets will always shadow normal assets
@@ -187,10 +205,9 @@ namespace Assets { namespace Internal
 				}
 			#endif
 
-            auto& assets = assetSet->_assets;
-			auto i = LowerBound(assets, hash);
-			if (i != assets.end() && i->first == hash) {
-                auto& cnt = i->second;
+			auto* existing = assetSet->_assets.Find(hash);
+			if (existing) {
+                auto& cnt = *existing;
 
                 auto* checkForRefresh = cnt._active.get();
                 if (cnt._pendingReplacement) checkForRefresh = cnt._pendingReplacement.get();
@@ -205,11 +222,14 @@ namespace Assets { namespace Internal
                         //  asset set.
                     cnt._pendingReplacement.reset();
                     cnt._pendingReplacement = ConstructAsset<DoBackgroundCompile>::Create<AssetType>(*assetSet.get(), hash, std::forward<Params>(initialisers)...);
+                    cnt.Publish();  // (unpublishes _active, so lock free lookups will come through here)
                 }
 
                 // note that this will sometimes replace a "valid" asset with an "invalid" one
-                if (!cnt._active || (cnt._pendingReplacement && ReadyForReplacement(*cnt._pendingReplacement)))
+                if (!cnt._active || (cnt._pendingReplacement && ReadyForReplacement(*cnt._pendingReplacement))) {
                     cnt._active = std::move(cnt._pendingReplacement);
+                    cnt.Publish();
+                }
 
                 return *cnt._active;
             }
@@ -242,6 +262,13 @@ namespace Assets { namespace Internal
     template<bool DoCheckDependancy, bool DoBackgroundCompile, typename AssetType, typename... Params>
 		const AssetType& GetAsset(Params... initialisers)
         {
+                //  Most of the time the asset will already exist and be up-to-date. In that case
+                //  we can return it without locking the asset set. Otherwise, we take the lock
+                //  and go through the full path
+            auto* existing = TryGetAssetLockFree<DoCheckDependancy>(
+                GetAssetSetUnlocked<AssetType>(), BuildHash(initialisers...));
+            if (existing) return *existing;
+
             auto assetSet = GetAssetSet<AssetType>();
             return GetAsset<DoCheckDependancy, DoBackgroundCompile, AssetType, Params...>(assetSet, std::forward<Params>(initialisers)...);
         }
@@ -294,6 +321,7 @@ namespace Assets { namespace Internal
 					// is it possible that constructing an asset could create a new divergent
 					// asset of the same type? It seems unlikely
 				assert(di == LowerBound(assetSet->_divergentAssets, hash));
+                Interlocked::Increment(&assetSet->_divergentCount);
 				return assetSet->_divergentAssets.insert(di, std::make_pair(hash, std::move(newDivAsset)))->second;
 
 			#endif
@@ -302,7 +330,13 @@ namespace Assets { namespace Internal
     template <typename AssetType>
         AssetSet<AssetType>::AssetSet() 
         : _lock(CreateRecursiveMutexPtr())
-    {}
+    {
+        _lockedLookups = 0;
+        _contendedLocks = 0;
+        #if defined(ASSETS_STORE_DIVERGENT)
+            _divergentCount = 0;
+        #endif
+    }
 
     template <typename AssetType>
         AssetSet<AssetType>::~AssetSet() {}
@@ -310,9 +344,10 @@ namespace Assets { namespace Internal
     template <typename AssetType>
         void AssetSet<AssetType>::Clear() 
         {
-            _assets.clear();
+            _assets.Clear();
 			#if defined(ASSETS_STORE_DIVERGENT)
 				_divergentAssets.clear();
+                Interlocked::Exchange(&_divergentCount, 0);
 			#endif
             #if defined(ASSETS_STORE_NAMES)
                 _assetNames.clear();
@@ -323,31 +358,32 @@ namespace Assets { namespace Internal
         void AssetSet<AssetType>::LogReport() const 
         {
             LogHeader(unsigned(_assets.size()), typeid(AssetType).name());
-            #if defined(ASSETS_STORE_NAMES)
-                auto i = _assets.cbegin();
-                auto ni = _assetNames.cbegin();
-                unsigned index = 0;
-                for (;i != _assets.cend(); ++i, ++index) {
-                    while (ni->first < i->first && ni != _assetNames.cend()) { ++ni; }
+            unsigned index = 0;
+            for (auto i=_assets.begin(); i != _assets.end(); ++i, ++index) {
+                #if defined(ASSETS_STORE_NAMES)
+                    auto ni = LowerBound(_assetNames, i->first);
                     if (ni != _assetNames.cend() && ni->first == i->first) {
                         LogAssetName(index, ni->second.c_str());
-                    } else {
-                        char buffer[256];
-                        _snprintf_s(buffer, _TRUNCATE, "Unnamed asset with hash (0x%08x%08x)", 
-                            uint32(i->first>>32), uint32(i->first));
-                        LogAssetName(index, buffer);
+                        continue;
                     }
-                }
-            #else
-                auto i = _assets.cbegin();
-                unsigned index = 0;
-                for (;i != _assets.cend(); ++i, ++index) {
-                    char buffer[256];
-                    _snprintf_s(buffer, _TRUNCATE, "Unnamed asset with hash (0x%08x%08x)", 
-                        uint32(i->first>>32), uint32(i->first));
-                    LogAssetName(index, buffer);
-                }
-            #endif
+                #endif
+                char buffer[256];
+                _snprintf_s(buffer, _TRUNCATE, "Unnamed asset with hash (0x%08x%08x)", 
+                    uint32(i->first>>32), uint32(i->first));
+                LogAssetName(index, buffer);
+            }
+        }
+
+    template <typename AssetType>
+        AssetSetMetrics AssetSet<AssetType>::GetMetrics() const
+        {
+            AssetSetMetrics result;
+            result._typeName = typeid(AssetType).name();
+            result._assetCount = unsigned(_assets.size());
+            result._lockedLookups = unsigned(Interlocked::Load(const_cast<Interlocked::Value*>(&_lockedLookups)));
+            result._contendedLocks = unsigned(Interlocked::Load(const_cast<Interlocked::Value*>(&_contendedLocks)));
+            result._tableGrowths = _assets.GetGrowthCount();
+            return result;
         }
 
     template <typename AssetType>
@@ -5,7 +5,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "AsyncLoadOperation.h"
-#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/TaskScheduler.h"
 #include "../Utility/StringUtils.h"
 #include "../Core/SelectConfiguration.h"
 
@@ -61,7 +61,7 @@ namespace Assets
         } CATCH_END
     }
 
-    void AsyncLoadOperation::Enqueue(const ResChar filename[], CompletionThreadPool& pool)
+    void AsyncLoadOperation::Enqueue(const ResChar filename[], TaskScheduler& pool)
     {
         assert(!_hasBeenQueued);
         _hasBeenQueued = true;
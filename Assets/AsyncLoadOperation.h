@@ -10,7 +10,7 @@
 #include "../Utility/MemoryUtils.h"
 #include <memory>
 
-namespace Utility { class CompletionThreadPool; }
+namespace Utility { class TaskScheduler; }
 
 namespace Assets
 {
@@ -18,7 +18,7 @@ namespace Assets
     class AsyncLoadOperation : public ::Assets::PendingOperationMarker
     {
     public:
-        void Enqueue(const ResChar filename[], CompletionThreadPool& pool);
+        void Enqueue(const ResChar filename[], TaskScheduler& pool);
 
         AsyncLoadOperation();
         virtual ~AsyncLoadOperation();
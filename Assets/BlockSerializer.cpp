@@ -9,6 +9,7 @@
 #include "BlockSerializer.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/Streams/Serialization.h"
+#include "../Core/Exceptions.h"
 #include <vector>
 
 namespace Serialization
@@ -30,6 +31,18 @@ namespace Serialization
 
     void    NascentBlockSerializer::PushBackPlaceholder(SpecialBuffer::Enum specialBuffer)
     {
+        if (_format == BlockFormat::Relative) {
+                // placeholders must match the layout of the runtime types, RelativePtr & RelativeArray
+            if (specialBuffer == SpecialBuffer::VertexBuffer || specialBuffer == SpecialBuffer::IndexBuffer) {
+                assert(0);
+            } else if (specialBuffer == SpecialBuffer::String || specialBuffer == SpecialBuffer::Vector) {
+                _memory.insert(_memory.end(), sizeof(RelativeArray<uint8>), 0);
+            } else {
+                _memory.insert(_memory.end(), sizeof(RelativePtr<uint8>), 0);
+            }
+            return;
+        }
+
         if (specialBuffer == SpecialBuffer::String) {
             _memory.insert(_memory.end(), sizeof(std::string), 0);
         } else if (specialBuffer == SpecialBuffer::VertexBuffer || specialBuffer == SpecialBuffer::IndexBuffer) {
@@ -116,6 +129,10 @@ namespace Serialization
 
     void    NascentBlockSerializer::SerializeSubBlock(NascentBlockSerializer& subBlock, SpecialBuffer::Enum specialBuffer)
     {
+            // (both blocks must be the same format, because the sub block's placeholders are already written)
+        if (subBlock._format != _format)
+            Throw(::Exceptions::BasicLabel("Cannot merge block serializers with different formats"));
+
             //
             //      Merge in the block we've just serialised, and write
             //      an internal pointer record for it.
@@ -185,10 +202,24 @@ namespace Serialization
     
     size_t      NascentBlockSerializer::Size() const
     {
+            // (relative blocks don't need the internal pointer table)
+        auto pointerTableSize = (_format == BlockFormat::Relative) ? 0 : _internalPointers.size() * sizeof(InternalPointer);
         return sizeof(Header)
             + _memory.size()
             + _trailingSubBlocks.size()
-            + _internalPointers.size() * sizeof(InternalPointer);
+            + pointerTableSize;
+    }
+
+    static NascentBlockSerializer::InternalPointer AsFinalPointer(const NascentBlockSerializer::InternalPointer& ptr, size_t memorySize)
+    {
+        auto result = ptr;
+            //      pointers in the subblock part are marked as negative... But what about zero? 
+            //      It could be in the memory part, or the subblock part
+        if (result._pointerOffset & NascentBlockSerializer::PtrFlagBit) {
+            result._pointerOffset = (result._pointerOffset&NascentBlockSerializer::PtrMask) + memorySize;
+        }
+        result._subBlockOffset += memorySize;
+        return result;
     }
 
     std::unique_ptr<uint8[]>      NascentBlockSerializer::AsMemoryBlock() const
@@ -196,7 +227,7 @@ namespace Serialization
         std::unique_ptr<uint8[]> result = std::make_unique<uint8[]>(Size());
 
         ((Header*)result.get())->_rawMemorySize = _memory.size() + _trailingSubBlocks.size();
-        ((Header*)result.get())->_internalPointerCount = _internalPointers.size();
+        ((Header*)result.get())->_internalPointerCount = (_format == BlockFormat::Relative) ? 0 : _internalPointers.size();
 
         std::copy(  AsPointer(_memory.begin()), AsPointer(_memory.end()),
                     PtrAdd(result.get(), sizeof(Header)));
@@ -204,21 +235,28 @@ namespace Serialization
         std::copy(  AsPointer(_trailingSubBlocks.begin()), AsPointer(_trailingSubBlocks.end()),
                     PtrAdd(result.get(), _memory.size() + sizeof(Header)));
 
-        InternalPointer* d = (InternalPointer*)PtrAdd(result.get(), _memory.size() + _trailingSubBlocks.size() + sizeof(Header));
-        for (auto i=_internalPointers.cbegin(); i!=_internalPointers.cend(); ++i, ++d) {
-            *d = *i;
-                //      pointers in the subblock part are marked as negative... But what about zero? 
-                //      It could be in the memory part, or the subblock part
-            if (d->_pointerOffset & PtrFlagBit) {
-                d->_pointerOffset = (d->_pointerOffset&PtrMask) + _memory.size();
+        if (_format == BlockFormat::Relative) {
+                //  Write the offsets directly into the placeholders. Offsets are from the
+                //  start of the RelativePtr/RelativeArray object to the start of the sub block
+            for (const auto& i:_internalPointers) {
+                auto ptr = AsFinalPointer(i, _memory.size());
+                auto* dst = (int64*)PtrAdd(result.get(), sizeof(Header) + ptr._pointerOffset);
+                dst[0] = int64(ptr._subBlockOffset) - int64(ptr._pointerOffset);
+                if (ptr._specialBuffer == SpecialBuffer::String || ptr._specialBuffer == SpecialBuffer::Vector)
+                    dst[1] = int64(ptr._subBlockSize);
             }
-            d->_subBlockOffset += _memory.size();
+            return result;
         }
 
+        InternalPointer* d = (InternalPointer*)PtrAdd(result.get(), _memory.size() + _trailingSubBlocks.size() + sizeof(Header));
+        for (auto i=_internalPointers.cbegin(); i!=_internalPointers.cend(); ++i, ++d)
+            *d = AsFinalPointer(*i, _memory.size());
+
         return result;
     }
 
-    NascentBlockSerializer::NascentBlockSerializer()
+    NascentBlockSerializer::NascentBlockSerializer(BlockFormat::Enum format)
+    : _format(format)
     {
     }
 
@@ -316,6 +354,14 @@ namespace Serialization
         return h._rawMemorySize + h._internalPointerCount * sizeof(NascentBlockSerializer::InternalPointer) + sizeof(Header);
     }
 
+    bool            Block_IsPositionIndependent(const void* block)
+    {
+            //  Relative blocks have no internal pointer table. (Absolute blocks with no
+            //  internal pointers are position independent as well)
+        const Header& h = *(const Header*)block;
+        return h._internalPointerCount == 0;
+    }
+
     std::unique_ptr<uint8[]>  Block_Duplicate(const void* block)
     {
         size_t size = Block_GetSize(block);
@@ -14,12 +14,22 @@
 #include <vector>
 #include <iterator>
 #include <type_traits>
+#include <assert.h>
 
 namespace Serialization
 {
 
         ////////////////////////////////////////////////////
 
+        //  Absolute:   internal pointers are stored as real pointers (and std::vector,
+        //              std::string, std::unique_ptr objects). Block_Initialize must be 
+        //              called after loading to write them, so the block must be in
+        //              writable memory
+        //  Relative:   internal pointers are stored as self-relative offsets, and read
+        //              through RelativePtr<> & RelativeArray<>. The block needs no fix ups,
+        //              so it can be used directly from read-only (or shared) memory
+    namespace BlockFormat { enum Enum { Absolute, Relative }; }
+
     class NascentBlockSerializer
     {
     public:
@@ -66,8 +76,9 @@ namespace Serialization
 
         std::unique_ptr<uint8[]>        AsMemoryBlock() const;
         size_t                          Size() const;
+        BlockFormat::Enum               GetFormat() const { return _format; }
 
-        NascentBlockSerializer();
+        explicit NascentBlockSerializer(BlockFormat::Enum format = BlockFormat::Absolute);
         ~NascentBlockSerializer();
 
         class InternalPointer
@@ -83,6 +94,7 @@ namespace Serialization
         static const size_t PtrMask     = ~PtrFlagBit;
 
     protected:
+        BlockFormat::Enum               _format;
         std::vector<uint8>              _memory;
         std::vector<uint8>              _trailingSubBlocks;
         std::vector<InternalPointer>    _internalPointers;
@@ -97,14 +109,66 @@ namespace Serialization
     void            Block_Initialize(void* block, const void* base=nullptr);
     const void*     Block_GetFirstObject(const void* blockStart);
     size_t          Block_GetSize(const void* block);
+    bool            Block_IsPositionIndependent(const void* block);
     std::unique_ptr<uint8[]>     Block_Duplicate(const void* block);
 
         ////////////////////////////////////////////////////
 
+    #pragma pack(push)
+    #pragma pack(1)
+
+        /// <summary>Pointer within a BlockFormat::Relative block</summary>
+        /// Stores the offset from this object to the target, so the block can be
+        /// used at any address. These only ever exist inside of serialized blocks, 
+        /// so they can't be constructed or copied (a copy would point somewhere else).
+        /// This is the runtime side of a std::unique_ptr or a raw pointer sub block.
+    template<typename Type>
+        class RelativePtr
+    {
+    public:
+        const Type*     get() const         { return _offset ? (const Type*)PtrAdd(this, ptrdiff_t(_offset)) : nullptr; }
+        const Type&     operator*() const   { assert(_offset); return *get(); }
+        const Type*     operator->() const  { return get(); }
+        explicit operator bool() const      { return _offset != 0; }
+
+        RelativePtr() = delete;
+        RelativePtr(const RelativePtr&) = delete;
+        RelativePtr& operator=(const RelativePtr&) = delete;
+    private:
+        int64           _offset;
+    };
+
+        /// <summary>Array within a BlockFormat::Relative block</summary>
+        /// This is the runtime side of a std::vector, SerializableVector or std::string.
+        /// As with RelativePtr, these can't be constructed or copied.
+    template<typename Type>
+        class RelativeArray
+    {
+    public:
+        const Type*     begin() const       { return (const Type*)PtrAdd(this, ptrdiff_t(_offset)); }
+        const Type*     end() const         { return (const Type*)PtrAdd(this, ptrdiff_t(_offset + _size)); }
+        size_t          size() const        { return size_t(_size / sizeof(Type)); }
+        bool            empty() const       { return _size == 0; }
+        const Type&     operator[](size_t index) const { assert(index < size()); return begin()[index]; }
+
+        RelativeArray() = delete;
+        RelativeArray(const RelativeArray&) = delete;
+        RelativeArray& operator=(const RelativeArray&) = delete;
+    private:
+        int64           _offset;
+        uint64          _size;          // (in bytes)
+    };
+
+    using RelativeString = RelativeArray<char>;
+
+    #pragma pack(pop)
+
+        ////////////////////////////////////////////////////
+
     template<typename Type, typename std::enable_if< !std::is_pod<Type>::value >::type*>
         void    NascentBlockSerializer::SerializeSubBlock(const Type* begin, const Type* end, SpecialBuffer::Enum specialBuffer)
     {
-        NascentBlockSerializer temporaryBlock;
+        NascentBlockSerializer temporaryBlock(_format);
         for (auto i=begin; i!=end; ++i) {
             Serialize(temporaryBlock, *i);
         }
@@ -121,7 +185,7 @@ namespace Serialization
     template<typename Type>
         void    NascentBlockSerializer::SerializeSubBlock(const Type* type)
     {
-        NascentBlockSerializer temporaryBlock;
+        NascentBlockSerializer temporaryBlock(_format);
         Serialize(temporaryBlock, type);
         SerializeSubBlock(temporaryBlock, SpecialBuffer::Unknown);
     }
@@ -53,6 +53,39 @@ namespace Serialization { namespace ChunkFile
         return result;
     }
 
+    std::vector<ChunkHeader> LoadChunkTable(const void* fileData, size_t fileSize)
+    {
+            //  Same as above, but reading from a memory mapped file. We also
+            //  check that every chunk is within the file, because callers will
+            //  use the chunks in place
+        if (fileSize < sizeof(ChunkFileHeader)) {
+            throw FormatError("Incomplete file header");
+        }
+
+        const auto& fileHeader = *(const ChunkFileHeader*)fileData;
+        if (fileHeader._magic != MagicHeader) {
+            throw FormatError("Unrecognised format");
+        }
+
+        if (fileHeader._fileVersionNumber != ChunkFileVersion) {
+            throw FormatError("Bad chunk file format");
+        }
+
+        if ((fileSize - sizeof(ChunkFileHeader)) / sizeof(ChunkHeader) < fileHeader._chunkCount) {
+            throw FormatError("Incomplete file header");
+        }
+
+        auto* chunksStart = (const ChunkHeader*)PtrAdd(fileData, sizeof(ChunkFileHeader));
+        std::vector<ChunkHeader> result(chunksStart, chunksStart + fileHeader._chunkCount);
+        for (const auto& c:result) {
+            if (c._fileOffset > fileSize || c._size > (fileSize - c._fileOffset)) {
+                throw FormatError("Chunk extends past the end of the file");
+            }
+        }
+
+        return result;
+    }
+
     Serialization::ChunkFile::ChunkHeader FindChunk(
         const char filename[],
         std::vector<Serialization::ChunkFile::ChunkHeader>& hdrs,
@@ -83,13 +116,26 @@ namespace Serialization { namespace ChunkFile
             Serialization::ChunkFile::TypeIdentifier chunkType,
             unsigned expectedVersion)
     {
-        BasicFile file(filename, "rb");
-        auto chunks = Serialization::ChunkFile::LoadChunkTable(file);
+            //  Map the file and copy the chunk straight out of the mapping (rather
+            //  than going through the buffered file reads). If the file can't be mapped
+            //  (eg, it doesn't exist) we fall back to BasicFile, so the caller gets the
+            //  normal IOException.
+        MemoryMappedFile mappedFile(filename, 0ull, MemoryMappedFile::Access::Read, BasicFile::ShareMode::Read);
+        if (!mappedFile.IsValid()) {
+            BasicFile file(filename, "rb");
+            auto chunks = Serialization::ChunkFile::LoadChunkTable(file);
+
+            auto scaffoldChunk = FindChunk(filename, chunks, chunkType, expectedVersion);
+            auto rawMemoryBlock = std::make_unique<uint8[]>(scaffoldChunk._size);
+            file.Seek(scaffoldChunk._fileOffset, SEEK_SET);
+            file.Read(rawMemoryBlock.get(), 1, scaffoldChunk._size);
+            return std::move(rawMemoryBlock);
+        }
 
+        auto chunks = Serialization::ChunkFile::LoadChunkTable(mappedFile.GetData(), mappedFile.GetSize());
         auto scaffoldChunk = FindChunk(filename, chunks, chunkType, expectedVersion);
         auto rawMemoryBlock = std::make_unique<uint8[]>(scaffoldChunk._size);
-        file.Seek(scaffoldChunk._fileOffset, SEEK_SET);
-        file.Read(rawMemoryBlock.get(), 1, scaffoldChunk._size);
+        XlCopyMemory(rawMemoryBlock.get(), PtrAdd(mappedFile.GetData(), scaffoldChunk._fileOffset), scaffoldChunk._size);
         return std::move(rawMemoryBlock);
     }
 
@@ -64,6 +64,7 @@ namespace Serialization { namespace ChunkFile
 
     ChunkFileHeader MakeChunkFileHeader(unsigned chunkCount, const char buildVersionString[], const char buildDateString[]);
     std::vector<ChunkHeader> LoadChunkTable(Utility::BasicFile& file);
+    std::vector<ChunkHeader> LoadChunkTable(const void* fileData, size_t fileSize);
 
     ChunkHeader FindChunk(
         const char filename[], std::vector<ChunkHeader>& hdrs,
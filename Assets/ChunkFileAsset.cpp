@@ -10,10 +10,122 @@
 #include "../Utility/StringFormat.h"
 #include "../Core/Exceptions.h"
 #include "../ConsoleRig/Log.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/TimeUtils.h"
+#include <algorithm>
 
 namespace Assets
 {
-    static std::vector<AssetChunkResult> LoadRawData(
+    using ChunkHeader = Serialization::ChunkFile::ChunkHeader;
+
+    static std::vector<ChunkHeader>::const_iterator FindAndCheckChunk(
+        const std::vector<ChunkHeader>& chunks,
+        const AssetChunkRequest& r, const char filename[])
+    {
+        auto i = std::find_if(
+            chunks.begin(), chunks.end(), 
+            [&r](const ChunkHeader& c) { return c._type == r._type; });
+        if (i == chunks.end())
+            Throw(::Assets::Exceptions::FormatError(
+                StringMeld<128>() << "Missing chunk (" << r._name << ")", filename));
+
+        if (r._expectedVersion != AssetChunkRequest::AnyVersion && i->_chunkVersion != r._expectedVersion)
+            Throw(::Assets::Exceptions::FormatError(
+                ::Assets::Exceptions::FormatError::Reason::UnsupportedVersion,
+                StringMeld<256>() 
+                    << "Data chunk is incorrect version for chunk (" 
+                    << r._name << ") expected: " << r._expectedVersion << ", got: " << i->_chunkVersion, 
+                    filename));
+        return i;
+    }
+
+        //  Mappings created by PrefetchChunkFile are kept here until the next load of the
+        //  same file (or until they are pushed out by newer prefetches, or expire). We must
+        //  not hold them for long, because a mapped file can't be overwritten by a recompile.
+        //  So unused prefetches expire after a few seconds (checked on every load & prefetch,
+        //  and on CompileAndAsyncManager::Update), and the compilers call
+        //  ReleasePrefetchedChunkFile before they write a file.
+    class PrefetchedFiles
+    {
+    public:
+        std::shared_ptr<MemoryMappedFile> Take(const ResChar filename[])
+        {
+            std::shared_ptr<MemoryMappedFile> result;
+            std::vector<std::shared_ptr<MemoryMappedFile>> expired;
+            {
+                ScopedLock(_lock);
+                Expire(expired);
+                for (auto i=_files.begin(); i!=_files.end(); ++i)
+                    if (!XlCompareStringI(i->_filename.c_str(), filename)) {
+                        result = std::move(i->_file);
+                        _files.erase(i);
+                        break;
+                    }
+            }
+            return result;
+        }
+
+        void Add(const ResChar filename[], std::shared_ptr<MemoryMappedFile> file)
+        {
+            std::vector<std::shared_ptr<MemoryMappedFile>> expired;
+            ScopedLock(_lock);
+            Expire(expired);
+            for (auto i=_files.begin(); i!=_files.end(); ++i)
+                if (!XlCompareStringI(i->_filename.c_str(), filename)) {
+                    expired.push_back(std::move(i->_file));
+                    _files.erase(i);
+                    break;
+                }
+            if (_files.size() >= MaxFiles) {
+                expired.push_back(std::move(_files.begin()->_file));
+                _files.erase(_files.begin());
+            }
+            _files.push_back(Entry{rstring(filename), std::move(file), Millisecond_Now()});
+        }
+
+        void Release(const ResChar filename[]) { Take(filename); }
+
+        void ExpireOld()
+        {
+            std::vector<std::shared_ptr<MemoryMappedFile>> expired;
+            ScopedLock(_lock);
+            Expire(expired);
+        }
+
+        static PrefetchedFiles& GetInstance() { static PrefetchedFiles instance; return instance; }
+    private:
+        static const unsigned MaxFiles = 16;
+        static const Millisecond MaxAge = 5000;
+
+        struct Entry
+        {
+            rstring _filename;
+            std::shared_ptr<MemoryMappedFile> _file;
+            Millisecond _addTime;
+        };
+        Threading::Mutex _lock;
+        std::vector<Entry> _files;
+
+            // (expired mappings are moved into "expired", so they are unmapped after the lock is released)
+        void Expire(std::vector<std::shared_ptr<MemoryMappedFile>>& expired)
+        {
+            auto now = Millisecond_Now();
+            auto i = std::remove_if(
+                _files.begin(), _files.end(),
+                [now, &expired](Entry& e)
+                {
+                    if ((now - e._addTime) < MaxAge) return false;
+                    expired.push_back(std::move(e._file));
+                    return true;
+                });
+            _files.erase(i, _files.end());
+        }
+    };
+
+    static std::vector<AssetChunkResult> LoadRawData_File(
         const char filename[],
         IteratorRange<const AssetChunkRequest*> requests)
     {
@@ -25,34 +137,18 @@ namespace Assets
 
             // First scan through and check to see if we
             // have all of the chunks we need
-        using ChunkHeader = Serialization::ChunkFile::ChunkHeader;
-        for (const auto& r:requests) {
-            auto i = std::find_if(
-                chunks.begin(), chunks.end(), 
-                [&r](const ChunkHeader& c) { return c._type == r._type; });
-            if (i == chunks.end())
-                Throw(::Assets::Exceptions::FormatError(
-                    StringMeld<128>() << "Missing chunk (" << r._name << ")", filename));
-
-            if (i->_chunkVersion != r._expectedVersion)
-                Throw(::Assets::Exceptions::FormatError(
-                    ::Assets::Exceptions::FormatError::Reason::UnsupportedVersion,
-                    StringMeld<256>() 
-                        << "Data chunk is incorrect version for chunk (" 
-                        << r._name << ") expected: " << r._expectedVersion << ", got: " << i->_chunkVersion, 
-                        filename));
-        }
+        for (const auto& r:requests)
+            FindAndCheckChunk(chunks, r, filename);
 
         for (const auto& r:requests) {
-            auto i = std::find_if(
-                chunks.begin(), chunks.end(), 
-                [&r](const ChunkHeader& c) { return c._type == r._type; });
-            assert(i != chunks.end());
+            auto i = FindAndCheckChunk(chunks, r, filename);
 
             AssetChunkResult chunkResult;
             chunkResult._offset = i->_fileOffset;
             chunkResult._size = i->_size;
+            chunkResult._version = i->_chunkVersion;
 
+                // (without a mapping, "Mapped" chunks must be read like "Raw" chunks)
             if (r._dataType != AssetChunkRequest::DataType::DontLoad) {
                 chunkResult._buffer = std::make_unique<uint8[]>(i->_size);
                 file.Seek(i->_fileOffset, SEEK_SET);
@@ -61,6 +157,51 @@ namespace Assets
                 // initialize with the block serializer (if requested)
                 if (r._dataType == AssetChunkRequest::DataType::BlockSerializer)
                     Serialization::Block_Initialize(chunkResult._buffer.get());
+
+                if (r._dataType == AssetChunkRequest::DataType::Mapped)
+                    chunkResult._mappedData = chunkResult._buffer.get();
+            }
+
+            result.emplace_back(std::move(chunkResult));
+        }
+
+        return std::move(result);
+    }
+
+    static std::vector<AssetChunkResult> LoadRawData(
+        const char filename[],
+        IteratorRange<const AssetChunkRequest*> requests)
+    {
+            //  Map the file once, and hand out views into the mapping. Only chunks that
+            //  the resolver wants to own (Raw & BlockSerializer) are copied; and they are
+            //  copied straight from the mapping. If the file can't be mapped, we fall back
+            //  to normal file reads (which also gives us the right exception for missing files)
+        auto mappedFile = MapChunkFile(filename);
+        if (!mappedFile)
+            return LoadRawData_File(filename, requests);
+
+        auto chunks = Serialization::ChunkFile::LoadChunkTable(mappedFile->GetData(), mappedFile->GetSize());
+        for (const auto& r:requests)
+            FindAndCheckChunk(chunks, r, filename);
+
+        std::vector<AssetChunkResult> result;
+        result.reserve(requests.size());
+        for (const auto& r:requests) {
+            auto i = FindAndCheckChunk(chunks, r, filename);
+
+            AssetChunkResult chunkResult;
+            chunkResult._offset = i->_fileOffset;
+            chunkResult._size = i->_size;
+            chunkResult._version = i->_chunkVersion;
+            chunkResult._mappedData = PtrAdd(mappedFile->GetData(), i->_fileOffset);
+            chunkResult._mappedFile = mappedFile;
+
+            if (r._dataType == AssetChunkRequest::DataType::Raw || r._dataType == AssetChunkRequest::DataType::BlockSerializer) {
+                chunkResult._buffer = std::make_unique<uint8[]>(i->_size);
+                XlCopyMemory(chunkResult._buffer.get(), chunkResult._mappedData, i->_size);
+
+                if (r._dataType == AssetChunkRequest::DataType::BlockSerializer)
+                    Serialization::Block_Initialize(chunkResult._buffer.get());
             }
 
             result.emplace_back(std::move(chunkResult));
@@ -69,6 +210,48 @@ namespace Assets
         return std::move(result);
     }
 
+    std::shared_ptr<MemoryMappedFile> MapChunkFile(const ResChar filename[])
+    {
+        auto result = PrefetchedFiles::GetInstance().Take(filename);
+        if (result) return result;
+
+        result = std::make_shared<MemoryMappedFile>(filename, 0ull, MemoryMappedFile::Access::Read, BasicFile::ShareMode::Read);
+        if (!result->IsValid()) return nullptr;
+        return result;
+    }
+
+    void ReleasePrefetchedChunkFile(const ResChar filename[])
+    {
+        PrefetchedFiles::GetInstance().Release(filename);
+    }
+
+    void ExpirePrefetchedChunkFiles()
+    {
+        PrefetchedFiles::GetInstance().ExpireOld();
+    }
+
+    void PrefetchChunkFile(const ResChar filename[], IteratorRange<const AssetChunkRequest*> requests)
+    {
+        auto mappedFile = std::make_shared<MemoryMappedFile>(filename, 0ull, MemoryMappedFile::Access::Read, BasicFile::ShareMode::Read);
+        if (!mappedFile->IsValid()) return;
+
+        TRY
+        {
+            auto chunks = Serialization::ChunkFile::LoadChunkTable(mappedFile->GetData(), mappedFile->GetSize());
+            for (const auto& r:requests) {
+                auto i = std::find_if(
+                    chunks.cbegin(), chunks.cend(), 
+                    [&r](const ChunkHeader& c) { return c._type == r._type; });
+                if (i != chunks.cend())
+                    mappedFile->Prefetch(i->_fileOffset, i->_size);
+            }
+        }
+        CATCH(const ::Assets::Exceptions::FormatError&) { return; }     // (we'll get the same exception during the real load)
+        CATCH_END
+
+        PrefetchedFiles::GetInstance().Add(filename, std::move(mappedFile));
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     ChunkFileAsset::ChunkFileAsset(const char assetTypeName[])
@@ -21,11 +21,23 @@ namespace Assets
     public:
         const char*     _name;
         Serialization::ChunkFile::TypeIdentifier _type;
-        unsigned        _expectedVersion;
+        unsigned        _expectedVersion;       // (or AnyVersion, if the resolver checks AssetChunkResult::_version itself)
+        static const unsigned AnyVersion = ~0u;
         
+            //  DontLoad:         only the offset and size of the chunk are returned
+            //  Raw:              the chunk is copied into "_buffer"
+            //  BlockSerializer:  as Raw, and then Block_Initialize is called on the buffer
+            //  Mapped:           nothing is copied. "_mappedData" points into a read-only
+            //                    mapping of the file, which stays valid for as long as the
+            //                    resolver holds onto "_mappedFile". Note that while the
+            //                    mapping exists, the file can't be overwritten (eg, by a
+            //                    recompile). So only use this for short lived objects; long
+            //                    lived assets should use Raw (and let the mapping go).
+            //                    Blocks written with BlockFormat::Relative can be used
+            //                    in place from here (via Block_GetFirstObject).
         enum class DataType
         {
-            DontLoad, Raw, BlockSerializer
+            DontLoad, Raw, BlockSerializer, Mapped
         };
         DataType        _dataType;
     };
@@ -36,22 +48,63 @@ namespace Assets
         Serialization::ChunkFile::SizeType  _offset;
         std::unique_ptr<uint8[]> _buffer;
         size_t _size;
+        unsigned _version;
 
-        AssetChunkResult() : _offset(0), _size(0) {}
+            //  When the file could be mapped, every chunk also gets a view into the
+            //  mapping (regardless of the requested DataType). It's only guaranteed to be
+            //  non-null for DataType::Mapped chunks.
+        const void* _mappedData;
+        std::shared_ptr<MemoryMappedFile> _mappedFile;
+
+        AssetChunkResult() : _offset(0), _size(0), _version(0), _mappedData(nullptr) {}
         AssetChunkResult(AssetChunkResult&& moveFrom)
         : _offset(moveFrom._offset)
         , _buffer(std::move(moveFrom._buffer))
         , _size(moveFrom._size)
+        , _version(moveFrom._version)
+        , _mappedData(moveFrom._mappedData)
+        , _mappedFile(std::move(moveFrom._mappedFile))
         {}
         AssetChunkResult& operator=(AssetChunkResult&& moveFrom)
         {
             _offset = moveFrom._offset;
             _buffer = std::move(moveFrom._buffer);
             _size = moveFrom._size;
+            _version = moveFrom._version;
+            _mappedData = moveFrom._mappedData;
+            _mappedFile = std::move(moveFrom._mappedFile);
             return *this;
         }
     };
 
+        /// <summary>Start reading the given chunks of a chunk file in the background</summary>
+        /// Use this when we know that an asset will be loaded soon (eg, a model that is about
+        /// to come into view). It doesn't block on the disk; it just asks the OS to begin
+        /// reading the chunks into memory. The mapping used for the prefetch is kept for a
+        /// few seconds, so a following ChunkFileAsset load of the same file can reuse it.
+        /// (old prefetches are dropped by ExpirePrefetchedChunkFiles, which is called by
+        /// CompileAndAsyncManager::Update, and by every load & prefetch)
+        /// All requested chunks are prefetched (including DontLoad chunks, because those are
+        /// normally read soon after the asset is loaded, like the large blocks of a model).
+        /// Missing or invalid files are ignored.
+    void PrefetchChunkFile(const ResChar filename[], IteratorRange<const AssetChunkRequest*> requests);
+
+        /// <summary>Map a chunk file for reading</summary>
+        /// If the file was recently prefetched with PrefetchChunkFile, the mapping from the
+        /// prefetch is returned (and released from the prefetch list). Returns null if the
+        /// file can't be mapped.
+    std::shared_ptr<MemoryMappedFile> MapChunkFile(const ResChar filename[]);
+
+        /// <summary>Drop any mapping held for the given file by PrefetchChunkFile</summary>
+        /// A mapped file can't be overwritten. So call this before writing to a file
+        /// that might have been prefetched (eg, before a compiler writes its output).
+    void ReleasePrefetchedChunkFile(const ResChar filename[]);
+
+        /// <summary>Drop the mappings of prefetches that haven't been used for a few seconds</summary>
+        /// Called regularly by CompileAndAsyncManager::Update, so that an unused prefetch
+        /// doesn't stop a file from being rewritten.
+    void ExpirePrefetchedChunkFiles();
+
     /// <summary>Utility for building asset objects that load from chunk files (sometimes asychronously)</summary>
     /// Some simple assets simply want to load some raw data from a chunk in a file, or
     /// perhaps from a few chunks in the same file. This is a base class to take away some
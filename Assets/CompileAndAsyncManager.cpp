@@ -6,6 +6,7 @@
 
 #include "CompileAndAsyncManager.h"
 #include "IntermediateAssets.h"
+#include "ChunkFileAsset.h"
 #include "../ConsoleRig/Log.h"
 #include "../Utility/Threading/Mutex.h"
 #include "../Utility/Threading/ThreadingUtils.h"
@@ -46,6 +47,9 @@ namespace Assets
 			_pimpl->_threadPump->Update();
         }
 
+            // (unused prefetched chunk files must not stay mapped for long; see PrefetchChunkFile)
+        ExpirePrefetchedChunkFiles();
+
         if (_pimpl->_pollingProcessesLock.try_lock()) {
             TRY
             {
@@ -212,9 +212,9 @@ namespace Assets
 		const Asset& DivergentAsset<Asset>::GetPristineCopy() const
 	{
 		Internal::AssetSetPtr<Asset> lock(*const_cast<Internal::AssetSet<Asset>*>(_assetSet));
-		auto i = LowerBound(lock->_assets, _assetId);
-		if (i != lock->_assets.end() && i->first == _assetId)
-			return *i->second._active;
+		auto* cnt = lock->_assets.Find(_assetId);
+		if (cnt && cnt->_active)
+			return *cnt->_active;
 
 		// If we get here, we are in trouble. For every divergent asset, there should be an asset
 		// in the asset store with the same id. If we don't find it, we have no means to return a valid
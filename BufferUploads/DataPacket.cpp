@@ -8,7 +8,7 @@
 #include "PlatformInterface.h"
 #include "../ConsoleRig/Log.h"
 #include "../ConsoleRig/GlobalServices.h"
-#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/TaskScheduler.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/Conversion.h"
 #include "../Utility/StringUtils.h"
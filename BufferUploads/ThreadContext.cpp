@@ -50,7 +50,7 @@ namespace BufferUploads
         if (_requiresResolves) {
             newCommandList._deviceCommandList = _deviceContext.ResolveCommandList();
             newCommandList._commitStep.swap(_commitStepUnderConstruction);
-            _queuedCommandLists.push_overflow(std::move(newCommandList));
+            _queuedCommandLists.push_stall(std::move(newCommandList));
         } else {
                     // immediate resolve -- skip the render thread resolve step...
             _commitStepUnderConstruction.CommitToImmediate_PreCommandList(*_underlyingContext);
@@ -144,7 +144,7 @@ namespace BufferUploads
     private:
         CommandListMetrics _commandListUnderConstruction;
         CommitStep _commitStepUnderConstruction;
-        LockFree::FixedSizeQueue<CommandList, 32> _queuedCommandLists;
+        LockFree::SPSCQueue<CommandList, 64> _queuedCommandLists;     // (pushed by the background thread, popped by the foreground thread)
         #if defined(XL_BUFFER_UPLOAD_RECORD_THREAD_CONTEXT_METRICS)
             LockFree::FixedSizeQueue<CommandListMetrics, 32> _recentRetirements;
         #endif
@@ -37,6 +37,12 @@ namespace RenderCore { namespace ColladaConversion
             _constantsBindings = BindingConfig(doc.Element(u("Constants")));
             _vertexSemanticBindings = BindingConfig(doc.Element(u("VertexSemantics")));
 
+            auto animCompression = doc.Element(u("AnimationCompression"));
+            if (animCompression) {
+                _animationCompression._quantize = animCompression.Attribute(u("Quantize"), _animationCompression._quantize);
+                _animationCompression._keyReductionTolerance = animCompression.Attribute(u("KeyReductionTolerance"), _animationCompression._keyReductionTolerance);
+            }
+
         } CATCH(...) {
             LogWarning << "Problem while loading configuration file (" << filename << "). Using defaults.";
         } CATCH_END
@@ -187,6 +193,13 @@ namespace RenderCore { namespace ColladaConversion
         }
     }
 
+    Float3 GetPosition(const void* vertexData, size_t vertexStride, size_t vertexIndex, const Assets::VertexElement& elementDesc)
+    {
+        assert(elementDesc._alignedByteOffset != ~unsigned(0x0));
+        const void* v = PtrAdd(vertexData, vertexStride*vertexIndex + elementDesc._alignedByteOffset);
+        return Truncate(AsFloat4(v, Metal::NativeFormat::Enum(elementDesc._nativeFormat)));
+    }
+
     std::pair<Float3, Float3>       InvalidBoundingBox()
     {
         const Float3 mins(      std::numeric_limits<Float3::value_type>::max(),
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "../Assets/AssetsCore.h"
+#include "../RenderCore/Assets/RawAnimationCurve.h"
 #include "../Math/Vector.h"
 #include "../Math/Matrix.h"
 #include "../Utility/UTFUtils.h"
@@ -48,6 +49,7 @@ namespace RenderCore { namespace ColladaConversion
         const BindingConfig& GetResourceBindings() const { return _resourceBindings; }
         const BindingConfig& GetConstantBindings() const { return _constantsBindings; }
         const BindingConfig& GetVertexSemanticBindings() const { return _vertexSemanticBindings; }
+        const Assets::RawAnimationCurve::CompressionSettings& GetAnimationCompression() const { return _animationCompression; }
 
         const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const { return _depVal; }
 
@@ -58,6 +60,7 @@ namespace RenderCore { namespace ColladaConversion
         BindingConfig _resourceBindings;
         BindingConfig _constantsBindings;
         BindingConfig _vertexSemanticBindings;
+        Assets::RawAnimationCurve::CompressionSettings _animationCompression;
 
         std::shared_ptr<::Assets::DependencyValidation> _depVal;
     };
@@ -86,5 +89,7 @@ namespace RenderCore { namespace ColladaConversion
                             const Float4x4& localToWorld);
     std::pair<Float3, Float3>   InvalidBoundingBox();
 
+    Float3 GetPosition(const void* vertexData, size_t vertexStride, size_t vertexIndex, const Assets::VertexElement& elementDesc);
+
     Assets::VertexElement FindPositionElement(const Assets::VertexElement elements[], size_t elementCount);
 }}
@@ -23,6 +23,7 @@
 #include "../RenderCore/Assets/ModelImmutableData.h"      // just for RenderCore::Assets::SkeletonBinding
 #include "../RenderCore/Assets/AssetUtils.h"
 #include "../RenderCore/Assets/Material.h"
+#include "../RenderCore/Assets/ModelIntersection.h"
 
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/XmlStreamFormatter.h"
@@ -32,16 +33,15 @@
 #include "../Utility/Streams/FileSystemMonitor.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/Threading/TaskScheduler.h"
 #include "../ConsoleRig/OutputStream.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include <memory>
 
 namespace RenderCore { namespace ColladaConversion
 {
     using namespace ::ColladaConversion;
 
-    static const unsigned ModelScaffoldVersion = 1;
-    static const unsigned ModelScaffoldLargeBlocksVersion = 0;
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     class ColladaScaffold
@@ -111,9 +111,9 @@ namespace RenderCore { namespace ColladaConversion
     }
 
     template<typename Type>
-        static std::vector<uint8> SerializeToVector(const Type& obj)
+        static std::vector<uint8> SerializeToVector(const Type& obj, Serialization::BlockFormat::Enum format = Serialization::BlockFormat::Absolute)
     {
-        Serialization::NascentBlockSerializer serializer;
+        Serialization::NascentBlockSerializer serializer(format);
         ::Serialize(serializer, obj);
         return AsVector(serializer);
     }
@@ -253,10 +253,12 @@ namespace RenderCore { namespace ColladaConversion
         NascentGeometryObjects _geoObjects;
         NascentSkeleton _skeleton;
 
-        PreparedSkinFile(const ColladaScaffold&, const VisualScene&, StringSection<utf8>);
+        PreparedSkinFile(const ColladaScaffold&, const VisualScene&, StringSection<utf8>, TaskScheduler* conversionScheduler);
     };
 
-    PreparedSkinFile::PreparedSkinFile(const ColladaScaffold& input, const VisualScene& scene, StringSection<utf8> rootNode)
+    PreparedSkinFile::PreparedSkinFile(
+        const ColladaScaffold& input, const VisualScene& scene, StringSection<utf8> rootNode,
+        TaskScheduler* conversionScheduler)
     {
         using namespace RenderCore::ColladaConversion;
 
@@ -321,6 +323,29 @@ namespace RenderCore { namespace ColladaConversion
             // the geometry -- so that merging in the changes can be done in the instantiate
             // step.
 
+            // The heavy part of instantiation is the conversion of the raw geometry and
+            // skin controllers (vertex unification, normal & tangent generation, etc).
+            // Each conversion is independent, so we can do them all in parallel first.
+            // The instantiation itself (which registers objects and joints, and so depends
+            // on ordering) is still done serially below, in the same order as always.
+            // Without a scheduler, each object is converted as it is instantiated (the
+            // result should be identical either way).
+        PreconvertedGeometry preconverted;
+        PreconvertedGeometry* preconvertedPtr = nullptr;
+        if (conversionScheduler) {
+            for (auto c:refGeos._meshes)
+                preconverted.QueueInstance(
+                    scene.GetInstanceGeometry(c._objectIndex),
+                    optimizer.GetMergedOutputMatrix(c._outputMatrixIndex),
+                    input._resolveContext);
+            for (auto c:refGeos._skinControllers)
+                preconverted.QueueInstance(
+                    scene.GetInstanceController(c._objectIndex),
+                    input._resolveContext);
+            preconverted.ConvertAll(*conversionScheduler, input._resolveContext, input._cfg);
+            preconvertedPtr = &preconverted;
+        }
+
         for (auto c:refGeos._meshes) {
             TRY {
                 _cmdStream.Add(
@@ -329,7 +354,7 @@ namespace RenderCore { namespace ColladaConversion
                         c._outputMatrixIndex, optimizer.GetMergedOutputMatrix(c._outputMatrixIndex),
                         c._levelOfDetail,
                         input._resolveContext, _geoObjects, jointRefs,
-                        input._cfg));
+                        input._cfg, preconvertedPtr));
             } CATCH(const std::exception& e) {
                 LogWarning << "Got exception while instantiating geometry (" << scene.GetInstanceGeometry(c._objectIndex)._reference.AsString().c_str() << "). Exception details:";
                 LogWarning << e.what();
@@ -347,7 +372,7 @@ namespace RenderCore { namespace ColladaConversion
                         c._outputMatrixIndex,
                         c._levelOfDetail,
                         input._resolveContext, _geoObjects, jointRefs,
-                        input._cfg));
+                        input._cfg, preconvertedPtr));
                 skinSuccessful = true;
             } CATCH(const std::exception& e) {
                 LogWarning << "Got exception while instantiating controller (" << scene.GetInstanceController(c._objectIndex)._reference.AsString().c_str() << "). Exception details:";
@@ -369,7 +394,7 @@ namespace RenderCore { namespace ColladaConversion
                             scene.GetInstanceController(c._objectIndex),
                             c._outputMatrixIndex, Identity<Float4x4>(), c._levelOfDetail, 
                             input._resolveContext, _geoObjects, jointRefs,
-                            input._cfg));
+                            input._cfg, preconvertedPtr));
                 } CATCH(const std::exception& e) {
                     LogWarning << "Got exception while instantiating geometry (after controller failed) (" << scene.GetInstanceController(c._objectIndex)._reference.AsString().c_str() << "). Exception details:";
                     LogWarning << e.what();
@@ -476,7 +501,7 @@ namespace RenderCore { namespace ColladaConversion
         StreamOperator(stream, skinFile._skeleton.GetTransformationMachine());
     }
 
-    NascentChunkArray SerializeSkin(const ColladaScaffold& model, const char startingNode[])
+    static NascentChunkArray SerializeSkin(const ColladaScaffold& model, const char startingNode[], TaskScheduler* conversionScheduler)
     {
         Serialization::NascentBlockSerializer serializer;
         std::vector<uint8> largeResourcesBlock;
@@ -488,7 +513,7 @@ namespace RenderCore { namespace ColladaConversion
 
         StringSection<utf8> startingNodeName;
         if (startingNode) startingNodeName = (const utf8*)startingNode;
-        PreparedSkinFile skinFile(model, *scene, startingNodeName);
+        PreparedSkinFile skinFile(model, *scene, startingNodeName, conversionScheduler);
 
             // Serialize the prepared skin file data to a BlockSerializer
 
@@ -501,6 +526,7 @@ namespace RenderCore { namespace ColladaConversion
             // work out the transforms.
             // And that requires a bit of hack to get pointers to those 
             // run-time types
+        std::vector<uint8> intersectionBlock;
         {
             const auto& transMachine = skinFile._skeleton.GetTransformationMachine();
             const auto& cmdStream = skinFile._cmdStream;
@@ -513,6 +539,11 @@ namespace RenderCore { namespace ColladaConversion
             serializer.SerializeValue(size_t(defaultPoseData._defaultTransforms.size()));
             ::Serialize(serializer, defaultPoseData._boundingBox.first);
             ::Serialize(serializer, defaultPoseData._boundingBox.second);
+
+                // Build the BVH used for CPU side intersection tests (also in the default pose)
+            auto intersectionTriangles = geoObjects.BuildIntersectionTriangles(
+                cmdStream, MakeIteratorRange(defaultPoseData._defaultTransforms));
+            intersectionBlock = RenderCore::Assets::BuildModelIntersectionChunk(MakeIteratorRange(intersectionTriangles));
         }
 
             // Find the max LOD value, and serialize that
@@ -526,9 +557,11 @@ namespace RenderCore { namespace ColladaConversion
         auto metricsBlock = AsVector(metricsStream);
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_ModelScaffold, ModelScaffoldVersion, model._name.c_str(), unsigned(scaffoldBlock.size()));
+            RenderCore::Assets::ChunkType_ModelScaffold, RenderCore::Assets::ModelScaffoldVersion, model._name.c_str(), unsigned(scaffoldBlock.size()));
         Serialization::ChunkFile::ChunkHeader largeBlockChunk(
-            RenderCore::Assets::ChunkType_ModelScaffoldLargeBlocks, ModelScaffoldLargeBlocksVersion, model._name.c_str(), (unsigned)largeResourcesBlock.size());
+            RenderCore::Assets::ChunkType_ModelScaffoldLargeBlocks, RenderCore::Assets::ModelScaffoldLargeBlocksVersion, model._name.c_str(), (unsigned)largeResourcesBlock.size());
+        Serialization::ChunkFile::ChunkHeader intersectionChunk(
+            RenderCore::Assets::ChunkType_ModelIntersection, RenderCore::Assets::ModelIntersectionVersion, model._name.c_str(), (unsigned)intersectionBlock.size());
         Serialization::ChunkFile::ChunkHeader metricsChunk(
             RenderCore::Assets::ChunkType_Metrics, 0, "metrics", (unsigned)metricsBlock.size());
 
@@ -536,10 +569,21 @@ namespace RenderCore { namespace ColladaConversion
             {
                 NascentChunk(scaffoldChunk, std::move(scaffoldBlock)),
                 NascentChunk(largeBlockChunk, std::move(largeResourcesBlock)),
+                NascentChunk(intersectionChunk, std::move(intersectionBlock)),
                 NascentChunk(metricsChunk, std::move(metricsBlock))
             });
     }
 
+    NascentChunkArray SerializeSkin(const ColladaScaffold& model, const char startingNode[])
+    {
+        return SerializeSkin(model, startingNode, &ConsoleRig::GlobalServices::GetShortTaskThreadPool());
+    }
+
+    NascentChunkArray SerializeSkinSerial(const ColladaScaffold& model, const char startingNode[])
+    {
+        return SerializeSkin(model, startingNode, nullptr);
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     class PreparedSkeletonFile
@@ -573,14 +617,14 @@ namespace RenderCore { namespace ColladaConversion
     NascentChunkArray SerializeSkeleton(const ColladaScaffold& model, const char[])
     {
         PreparedSkeletonFile skeleFile(model);
-        auto block = SerializeToVector(skeleFile._skeleton);
+        auto block = SerializeToVector(skeleFile._skeleton, Serialization::BlockFormat::Relative);
 
         std::stringstream metricsStream;
         TraceMetrics(metricsStream, skeleFile);
         auto metricsBlock = AsVector(metricsStream);
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_Skeleton, 0, model._name.c_str(), unsigned(block.size()));
+            RenderCore::Assets::ChunkType_Skeleton, RenderCore::Assets::SkeletonVersion, model._name.c_str(), unsigned(block.size()));
         Serialization::ChunkFile::ChunkHeader metricsChunk(
             RenderCore::Assets::ChunkType_Metrics, 0, "metrics", (unsigned)metricsBlock.size());
 
@@ -666,19 +710,51 @@ namespace RenderCore { namespace ColladaConversion
 
     PreparedAnimationFile::PreparedAnimationFile(const ColladaScaffold& input)
     {
-        SkeletonRegistry jointRefs;
+            // Each animation is converted & compressed as a separate task. The results
+            // are merged into the animation set afterwards, in the original order (so the
+            // output is the same as if we had converted them serially).
+            // The skeleton registry isn't used after this, so each task can just have its own.
+        class ConvertedAnimation
+        {
+        public:
+            std::vector<UnboundAnimation::Curve>    _curves;
+            std::vector<Assets::RawAnimationCurve>  _compressed;
+        };
 
-        std::vector<UnboundAnimation> anims;
         const auto& animations = input._doc->_animations;
-        for (auto i=animations.cbegin(); i!=animations.cend(); ++i) {
-            TRY {
-                auto anim = Convert(*i, input._resolveContext, jointRefs); 
+        std::vector<ConvertedAnimation> converted(animations.size());
 
-                for (auto c=anim._curves.begin(); c!=anim._curves.end(); ++c) {
-                    _curves.emplace_back(std::move(c->_curve));
+        {
+            TaskGroup group(ConsoleRig::GlobalServices::GetShortTaskThreadPool());
+            for (size_t a=0; a<animations.size(); ++a) {
+                auto* src = &animations[a];
+                auto* dst = &converted[a];
+                group.Run(
+                    [src, dst, &input]()
+                    {
+                        TRY {
+                            SkeletonRegistry jointRefs;
+                            auto anim = Convert(*src, input._resolveContext, jointRefs);
+                            dst->_curves = std::move(anim._curves);
+                            dst->_compressed.reserve(dst->_curves.size());
+                            for (auto c=dst->_curves.begin(); c!=dst->_curves.end(); ++c)
+                                dst->_compressed.emplace_back(c->_curve.Compress(input._cfg.GetAnimationCompression()));
+                        } CATCH (...) {
+                        } CATCH_END
+                    });
+            }
+            group.Wait();
+        }
+
+        for (auto& a:converted) {
+            TRY {
+                    // (if compression failed part way through, only the curves before the
+                    // failure are added)
+                for (size_t c=0; c<a._compressed.size(); ++c) {
+                    _curves.emplace_back(std::move(a._compressed[c]));
                     _animationSet.AddAnimationDriver(
-                        c->_parameterName, unsigned(_curves.size()-1),
-                        c->_samplerType, c->_samplerOffset);
+                        a._curves[c]._parameterName, unsigned(_curves.size()-1),
+                        a._curves[c]._samplerType, a._curves[c]._samplerOffset);
                 }
             } CATCH (...) {
             } CATCH_END
@@ -715,7 +791,7 @@ namespace RenderCore { namespace ColladaConversion
         auto block = AsVector(serializer);
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_AnimationSet, 0, animSet._name.c_str(), unsigned(block.size()));
+            RenderCore::Assets::ChunkType_AnimationSet, RenderCore::Assets::AnimationSetVersion, animSet._name.c_str(), unsigned(block.size()));
 
         return MakeNascentChunkArray({NascentChunk(scaffoldChunk, std::move(block))});
     }
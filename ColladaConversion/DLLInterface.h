@@ -59,6 +59,9 @@ namespace RenderCore { namespace ColladaConversion
 
     CONVERSION_API std::shared_ptr<ColladaScaffold> CreateColladaScaffold(const ::Assets::ResChar identifier[]);
     CONVERSION_API NascentChunkArray SerializeSkin(const ColladaScaffold& model, const char startingNode[]);
+        /// Same output as SerializeSkin, but without converting the geometry in parallel first.
+        /// Used to verify the parallel path, and to measure the speed-up from it.
+    CONVERSION_API NascentChunkArray SerializeSkinSerial(const ColladaScaffold& model, const char startingNode[]);
     CONVERSION_API NascentChunkArray SerializeSkeleton(const ColladaScaffold& model, const char startingNode[]);
     CONVERSION_API NascentChunkArray SerializeMaterials(const ColladaScaffold& model, const char startingNode[]);
 
@@ -1274,7 +1274,7 @@ namespace RenderCore { namespace ColladaConversion
         size_t size = Serialization::Block_GetSize(block.get());
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_AnimationSet, 0, _name.c_str(), unsigned(size));
+            RenderCore::Assets::ChunkType_AnimationSet, RenderCore::Assets::AnimationSetVersion, _name.c_str(), unsigned(size));
 
         NascentChunkArray result(new std::vector<NascentChunk>(), &DestroyChunkArray);
         result->push_back(NascentChunk(scaffoldChunk, std::vector<uint8>(block.get(), PtrAdd(block.get(), size))));
@@ -1283,7 +1283,7 @@ namespace RenderCore { namespace ColladaConversion
 
     NascentChunkArray NascentModel::SerializeSkeleton() const
     {
-        Serialization::NascentBlockSerializer serializer;
+        Serialization::NascentBlockSerializer serializer(Serialization::BlockFormat::Relative);
 
         Serialization::Serialize(serializer, _skeleton);
         ConsoleRig::GetWarningStream().Flush();
@@ -1292,7 +1292,7 @@ namespace RenderCore { namespace ColladaConversion
         size_t size = Serialization::Block_GetSize(block.get());
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_Skeleton, 0, _name.c_str(), unsigned(size));
+            RenderCore::Assets::ChunkType_Skeleton, RenderCore::Assets::SkeletonVersion, _name.c_str(), unsigned(size));
 
         NascentChunkArray result(new std::vector<NascentChunk>(), &DestroyChunkArray);
         result->push_back(NascentChunk(scaffoldChunk, std::vector<uint8>(block.get(), PtrAdd(block.get(), size))));
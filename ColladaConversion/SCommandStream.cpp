@@ -18,10 +18,15 @@
 #include "ScaffoldParsingUtil.h"    // for AsString
 #include "ConversionUtil.h"
 #include "../RenderCore/Assets/Material.h"  // for MakeMaterialGuid
+#include "../RenderCore/Assets/ModelIntersection.h"
+#include "../Math/Transformations.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/Threading/TaskScheduler.h"
 #include "ConversionCore.h"
 #include <string>
+#include <exception>
+#include <algorithm>
 
 namespace ColladaConversion
 {
@@ -315,7 +320,8 @@ namespace RenderCore { namespace ColladaConversion
         const URIResolveContext& resolveContext,
         NascentGeometryObjects& objects,
         SkeletonRegistry& nodeRefs,
-        const ImportConfiguration& cfg)
+        const ImportConfiguration& cfg,
+        PreconvertedGeometry* preconverted)
     {
         GuidReference refGuid(instGeo._reference);
         ObjectGuid geoId(refGuid._id, refGuid._fileHash);
@@ -338,7 +344,8 @@ namespace RenderCore { namespace ColladaConversion
                     Throw(::Assets::Exceptions::FormatError("Could not found geometry object to instantiate (%s)",
                         AsString(instGeo._reference).c_str()));
 
-                auto convertedMesh = Convert(*scaffoldGeo, mergedTransform, resolveContext, cfg);
+                auto pre = preconverted ? preconverted->TakeGeometry(*scaffoldGeo, mergedTransform) : nullptr;
+                auto convertedMesh = pre ? std::move(*pre) : Convert(*scaffoldGeo, mergedTransform, resolveContext, cfg);
                 if (convertedMesh._mainDrawCalls.empty()) {
                     
                         // everything else should be empty as well...
@@ -415,7 +422,8 @@ namespace RenderCore { namespace ColladaConversion
         const URIResolveContext& resolveContext,
         NascentGeometryObjects& objects,
         SkeletonRegistry& nodeRefs,
-        const ImportConfiguration& cfg)
+        const ImportConfiguration& cfg,
+        PreconvertedGeometry* preconverted)
     {
         GuidReference controllerRef(instGeo._reference);
         ObjectGuid controllerId(controllerRef._id, controllerRef._fileHash);
@@ -424,7 +432,8 @@ namespace RenderCore { namespace ColladaConversion
             Throw(::Assets::Exceptions::FormatError("Could not find controller object to instantiate (%s)",
                 AsString(instGeo._reference).c_str()));
 
-        auto controller = Convert(*scaffoldController, resolveContext, cfg);
+        auto preController = preconverted ? preconverted->TakeController(*scaffoldController) : nullptr;
+        auto controller = preController ? std::move(*preController) : Convert(*scaffoldController, resolveContext, cfg);
 
         auto jointMatrices = BuildJointArray(instGeo.GetSkeleton(), controller, resolveContext, nodeRefs);
         if (!jointMatrices.size() || !jointMatrices.get())
@@ -445,7 +454,8 @@ namespace RenderCore { namespace ColladaConversion
                 if (!scaffoldGeo)
                     Throw(::Assets::Exceptions::FormatError("Could not find geometry object to instantiate (%s)",
                         AsString(instGeo._reference).c_str()));
-                tempBuffer = Convert(*scaffoldGeo, Identity<Float4x4>(), resolveContext, cfg);
+                auto pre = preconverted ? preconverted->TakeGeometry(*scaffoldGeo, Identity<Float4x4>()) : nullptr;
+                tempBuffer = pre ? std::move(*pre) : Convert(*scaffoldGeo, Identity<Float4x4>(), resolveContext, cfg);
                 source = &tempBuffer;
             } else {
                 source = &objects._rawGeos[geo].second;
@@ -468,6 +478,163 @@ namespace RenderCore { namespace ColladaConversion
             outputTransformIndex, std::move(materials), levelOfDetail);
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class PreconvertedGeometry::Pimpl
+    {
+    public:
+        template<typename Source, typename Result>
+            class Conversion
+            {
+            public:
+                const Source*               _source;
+                Float4x4                    _mergedTransform;
+                std::unique_ptr<Result>     _result;
+                std::exception_ptr          _exception;
+                bool                        _taken;
+
+                Conversion(const Source& source, const Float4x4& mergedTransform)
+                    : _source(&source), _mergedTransform(mergedTransform), _taken(false) {}
+                Conversion(Conversion&& moveFrom)
+                    : _source(moveFrom._source), _mergedTransform(moveFrom._mergedTransform)
+                    , _result(std::move(moveFrom._result)), _exception(std::move(moveFrom._exception))
+                    , _taken(moveFrom._taken) {}
+
+                std::unique_ptr<Result> Take()
+                {
+                    _taken = true;
+                    if (_exception)
+                        std::rethrow_exception(_exception);
+                    return std::move(_result);
+                }
+            };
+
+        std::vector<Conversion<MeshGeometry, NascentRawGeometry>>       _geos;
+        std::vector<Conversion<SkinController, UnboundSkinController>>  _controllers;
+
+            // The geometry objects that will be in the NascentGeometryObjects by
+            // the time the next queued instance is instantiated
+        std::vector<ObjectGuid>     _instantiatedGeos;
+
+        bool IsInstantiated(ObjectGuid id) const
+        {
+            return std::find(_instantiatedGeos.cbegin(), _instantiatedGeos.cend(), id) != _instantiatedGeos.cend();
+        }
+    };
+
+    void PreconvertedGeometry::QueueInstance(
+        const InstanceGeometry& instGeo, const Float4x4& mergedTransform,
+        const URIResolveContext& resolveContext)
+    {
+            // This must follow the same logic as InstantiateGeometry, to find
+            // the geometry objects that will actually be converted
+        GuidReference refGuid(instGeo._reference);
+        ObjectGuid geoId(refGuid._id, refGuid._fileHash);
+        if (_pimpl->IsInstantiated(geoId)) return;
+
+        auto* scaffoldGeo = FindElement(refGuid, resolveContext, &IDocScopeIdResolver::FindMeshGeometry);
+        if (!scaffoldGeo) {
+            auto* scaffoldController = FindElement(refGuid, resolveContext, &IDocScopeIdResolver::FindSkinController);
+            if (!scaffoldController) return;
+
+            GuidReference sourceMeshRefGuid(scaffoldController->GetBaseMesh());
+            if (_pimpl->IsInstantiated(ObjectGuid(sourceMeshRefGuid._id, refGuid._fileHash))) return;
+            scaffoldGeo = FindElement(sourceMeshRefGuid, resolveContext, &IDocScopeIdResolver::FindMeshGeometry);
+            if (!scaffoldGeo) return;
+        }
+
+        _pimpl->_instantiatedGeos.push_back(geoId);
+        _pimpl->_geos.emplace_back(*scaffoldGeo, mergedTransform);
+    }
+
+    void PreconvertedGeometry::QueueInstance(
+        const InstanceController& instController,
+        const URIResolveContext& resolveContext)
+    {
+            // This must follow the same logic as InstantiateController
+        GuidReference controllerRef(instController._reference);
+        auto* scaffoldController = FindElement(controllerRef, resolveContext, &IDocScopeIdResolver::FindSkinController);
+        if (!scaffoldController) return;
+
+        _pimpl->_controllers.emplace_back(*scaffoldController, Identity<Float4x4>());
+
+            // The source geometry only needs to be converted if it hasn't been instantiated
+            // already (and in this case, it's only a temporary, so it doesn't get added to
+            // _instantiatedGeos)
+        GuidReference sourceRef(scaffoldController->GetBaseMesh());
+        if (_pimpl->IsInstantiated(ObjectGuid(sourceRef._id, sourceRef._fileHash))) return;
+
+        auto* scaffoldGeo = FindElement(sourceRef, resolveContext, &IDocScopeIdResolver::FindMeshGeometry);
+        if (scaffoldGeo)
+            _pimpl->_geos.emplace_back(*scaffoldGeo, Identity<Float4x4>());
+    }
+
+    void PreconvertedGeometry::ConvertAll(
+        TaskScheduler& scheduler,
+        const URIResolveContext& resolveContext,
+        const ImportConfiguration& cfg)
+    {
+            // Each conversion is a separate task. Exceptions are stored with the
+            // conversion, so they will be thrown again at the point of instantiation
+            // (just as if the conversion had happened there)
+        TaskGroup group(scheduler);
+        for (auto& g:_pimpl->_geos) {
+            auto* conversion = &g;
+            group.Run(
+                [conversion, &resolveContext, &cfg]()
+                {
+                    TRY
+                    {
+                        conversion->_result = std::make_unique<NascentRawGeometry>(
+                            Convert(*conversion->_source, conversion->_mergedTransform, resolveContext, cfg));
+                    } CATCH (...) {
+                        conversion->_exception = std::current_exception();
+                    } CATCH_END
+                });
+        }
+
+        for (auto& c:_pimpl->_controllers) {
+            auto* conversion = &c;
+            group.Run(
+                [conversion, &resolveContext, &cfg]()
+                {
+                    TRY
+                    {
+                        conversion->_result = std::make_unique<UnboundSkinController>(
+                            Convert(*conversion->_source, resolveContext, cfg));
+                    } CATCH (...) {
+                        conversion->_exception = std::current_exception();
+                    } CATCH_END
+                });
+        }
+
+        group.Wait();
+    }
+
+    std::unique_ptr<NascentRawGeometry> PreconvertedGeometry::TakeGeometry(const MeshGeometry& geo, const Float4x4& mergedTransform)
+    {
+        for (auto& g:_pimpl->_geos)
+            if (    !g._taken && g._source == &geo
+                &&  !XlCompareMemory(&g._mergedTransform, &mergedTransform, sizeof(Float4x4)))
+                return g.Take();
+        return nullptr;
+    }
+
+    std::unique_ptr<UnboundSkinController> PreconvertedGeometry::TakeController(const SkinController& controller)
+    {
+        for (auto& c:_pimpl->_controllers)
+            if (!c._taken && c._source == &controller)
+                return c.Take();
+        return nullptr;
+    }
+
+    PreconvertedGeometry::PreconvertedGeometry()
+    {
+        _pimpl = std::make_unique<Pimpl>();
+    }
+
+    PreconvertedGeometry::~PreconvertedGeometry() {}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     unsigned NascentGeometryObjects::GetGeo(ObjectGuid id)
@@ -570,6 +737,103 @@ namespace RenderCore { namespace ColladaConversion
         return result;
     }
 
+    static unsigned GetIndex(const DynamicArray<uint8>& indices, NativeFormatPlaceholder indexFormat, unsigned i)
+    {
+        if (indexFormat == Metal::NativeFormat::R32_UINT) return ((const uint32*)indices.begin())[i];
+        if (indexFormat == Metal::NativeFormat::R16_UINT) return ((const uint16*)indices.begin())[i];
+        if (indexFormat == Metal::NativeFormat::R8_UINT) return ((const uint8*)indices.begin())[i];
+        Throw(::Assets::Exceptions::FormatError("Unrecognised index format while building intersection triangles"));
+    }
+
+    static void AddIntersectionTriangles(
+        std::vector<RenderCore::Assets::ModelIntersectionTriangle>& dst,
+        unsigned& drawCallIndex,
+        const void* vertexData, unsigned vertexStride, size_t vertexCount,
+        const GeoInputAssembly& ia,
+        const DynamicArray<uint8>& indices, NativeFormatPlaceholder indexFormat,
+        IteratorRange<const DrawCallDesc*> drawCalls,
+        const std::vector<NascentModelCommandStream::MaterialGuid>& materials,
+        const Float4x4& localToModel)
+    {
+        using namespace ColladaConversion;
+        auto positionDesc = FindPositionElement(AsPointer(ia._elements.begin()), ia._elements.size());
+        bool hasPositions = positionDesc._nativeFormat != Metal::NativeFormat::Unknown && vertexStride;
+
+        for (const auto& d:drawCalls) {
+                // (note that the draw call index should match the ordering in ModelRenderer)
+            if (!d._indexCount) continue;
+            auto thisDrawCallIndex = drawCallIndex++;
+            if (!hasPositions || d._topology != Metal::Topology::TriangleList) continue;
+
+            auto materialGuid = (d._subMaterialIndex < materials.size()) ? materials[d._subMaterialIndex] : NascentModelCommandStream::s_materialGuid_Invalid;
+            for (unsigned i=0; (i+3)<=d._indexCount; i+=3) {
+                RenderCore::Assets::ModelIntersectionTriangle tri;
+                bool valid = true;
+                for (unsigned q=0; q<3; ++q) {
+                    auto index = GetIndex(indices, indexFormat, d._firstIndex + i + q) + d._firstVertex;
+                    if (index >= vertexCount) { valid = false; break; }
+                    tri._pts[q] = TransformPoint(
+                        localToModel, GetPosition(vertexData, vertexStride, index, positionDesc));
+                }
+                if (!valid) continue;
+                tri._drawCallIndex = thisDrawCallIndex;
+                tri._materialGuid = materialGuid;
+                dst.push_back(tri);
+            }
+        }
+    }
+
+    std::vector<RenderCore::Assets::ModelIntersectionTriangle> NascentGeometryObjects::BuildIntersectionTriangles
+        (
+            const NascentModelCommandStream& scene,
+            IteratorRange<const Float4x4*> transforms
+        ) const
+    {
+            //
+            //      Collect all of the triangles in the highest level of detail, in
+            //      model space. As with CalculateBoundingBox, skinned geometry uses the
+            //      default pose.
+            //
+        std::vector<RenderCore::Assets::ModelIntersectionTriangle> result;
+        unsigned drawCallIndex = 0;
+
+        for (const auto& inst:scene._geometryInstances) {
+            if (inst._levelOfDetail != 0 || inst._id >= _rawGeos.size()) continue;
+            const auto& geo = _rawGeos[inst._id].second;
+
+            Float4x4 localToModel = Identity<Float4x4>();
+            if (inst._localToWorldId < transforms.size())
+                localToModel = transforms[inst._localToWorldId];
+
+            auto vertexStride = geo._mainDrawInputAssembly._vertexStride;
+            AddIntersectionTriangles(
+                result, drawCallIndex,
+                geo._vertices.get(), vertexStride, vertexStride ? (geo._vertices.size() / vertexStride) : 0,
+                geo._mainDrawInputAssembly, geo._indices, geo._indexFormat,
+                MakeIteratorRange(geo._mainDrawCalls), inst._materials, localToModel);
+        }
+
+        for (const auto& inst:scene._skinControllerInstances) {
+            if (inst._levelOfDetail != 0 || inst._id >= _skinnedGeos.size()) continue;
+            const auto& controller = _skinnedGeos[inst._id].second;
+
+            Float4x4 localToModel = Identity<Float4x4>();
+            if (inst._localToWorldId < transforms.size())
+                localToModel = transforms[inst._localToWorldId];
+            localToModel = Combine(controller._bindShapeMatrix, localToModel);
+
+                // positions are in the animated vertex elements (before skinning is applied)
+            auto vertexStride = controller._mainDrawAnimatedIA._vertexStride;
+            AddIntersectionTriangles(
+                result, drawCallIndex,
+                controller._animatedVertexElements.get(), vertexStride, vertexStride ? (controller._animatedVertexElements.size() / vertexStride) : 0,
+                controller._mainDrawAnimatedIA, controller._indices, controller._indexFormat,
+                MakeIteratorRange(controller._mainDrawCalls), inst._materials, localToModel);
+        }
+
+        return result;
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     static std::string SkeletonBindingName(const Node& node)    
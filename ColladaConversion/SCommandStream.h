@@ -8,8 +8,11 @@
 
 #include "NascentCommandStream.h"
 #include "../Utility/StringUtils.h"
+#include <memory>
 
-namespace ColladaConversion { class Node; class VisualScene; class URIResolveContext; class InstanceGeometry; class InstanceController; }
+namespace RenderCore { namespace Assets { class ModelIntersectionTriangle; }}
+namespace ColladaConversion { class Node; class VisualScene; class URIResolveContext; class InstanceGeometry; class InstanceController; class MeshGeometry; class SkinController; }
+namespace Utility { class TaskScheduler; }
 
 namespace RenderCore { namespace ColladaConversion
 {
@@ -18,6 +21,7 @@ namespace RenderCore { namespace ColladaConversion
     class ImportConfiguration;
     class NascentRawGeometry;
     class NascentBoundSkinnedGeometry;
+    class UnboundSkinController;
 
     void BuildSkeleton(
         NascentSkeleton& skeleton,
@@ -41,9 +45,51 @@ namespace RenderCore { namespace ColladaConversion
                 IteratorRange<const Float4x4*> transforms
             ) const;
 
+        std::vector<RenderCore::Assets::ModelIntersectionTriangle> BuildIntersectionTriangles
+            (
+                const NascentModelCommandStream& scene,
+                IteratorRange<const Float4x4*> transforms
+            ) const;
+
         friend std::ostream& operator<<(std::ostream&, const NascentGeometryObjects& geos);
     };
 
+        /// <summary>Geometry and skin controller conversions, done ahead of instantiation</summary>
+        /// Converting mesh geometry (vertex unification, normal & tangent generation, transforming
+        /// and building the native vertex buffers) and skin controllers (weight normalization) is
+        /// the expensive part of compiling a model. But each conversion depends only on the scaffold,
+        /// so we can do them all in parallel, before we start instantiating.
+        ///
+        /// Queue every instance that will be passed to InstantiateGeometry & InstantiateController
+        /// (in the same order), and then call ConvertAll. The instantiate functions will take the
+        /// converted objects from here, and will convert inline only if they can't find a match.
+        /// Since instantiation is still serial, the output is identical to the serial path.
+    class PreconvertedGeometry
+    {
+    public:
+        void QueueInstance(
+            const ::ColladaConversion::InstanceGeometry& instGeo, const Float4x4& mergedTransform,
+            const ::ColladaConversion::URIResolveContext& resolveContext);
+        void QueueInstance(
+            const ::ColladaConversion::InstanceController& instController,
+            const ::ColladaConversion::URIResolveContext& resolveContext);
+
+        void ConvertAll(
+            TaskScheduler& scheduler,
+            const ::ColladaConversion::URIResolveContext& resolveContext,
+            const ImportConfiguration& cfg);
+
+            // (returns nullptr if there is no matching conversion, or rethrows the exception from the conversion)
+        std::unique_ptr<NascentRawGeometry> TakeGeometry(const ::ColladaConversion::MeshGeometry& geo, const Float4x4& mergedTransform);
+        std::unique_ptr<UnboundSkinController> TakeController(const ::ColladaConversion::SkinController& controller);
+
+        PreconvertedGeometry();
+        ~PreconvertedGeometry();
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+
     NascentModelCommandStream::GeometryInstance InstantiateGeometry(
         const ::ColladaConversion::InstanceGeometry& instGeo,
         unsigned outputTransformIndex, const Float4x4& mergedTransform,
@@ -51,7 +97,8 @@ namespace RenderCore { namespace ColladaConversion
         const ::ColladaConversion::URIResolveContext& resolveContext,
         NascentGeometryObjects& objects,
         SkeletonRegistry& nodeRefs,
-        const ImportConfiguration& cfg);
+        const ImportConfiguration& cfg,
+        PreconvertedGeometry* preconverted = nullptr);
 
     NascentModelCommandStream::SkinControllerInstance InstantiateController(
         const ::ColladaConversion::InstanceController& instGeo,
@@ -59,7 +106,8 @@ namespace RenderCore { namespace ColladaConversion
         const ::ColladaConversion::URIResolveContext& resolveContext,
         NascentGeometryObjects& objects,
         SkeletonRegistry& nodeRefs,
-        const ImportConfiguration& cfg);
+        const ImportConfiguration& cfg,
+        PreconvertedGeometry* preconverted = nullptr);
 
     class ReferencedGeometries
     {
@@ -8,6 +8,7 @@
 
 #include "../Utility/Streams/XmlStreamFormatter.h"
 #include "../Utility/Conversion.h"
+#include "../Utility/FastParseValue.h"
 
 namespace ColladaConversion
 {
@@ -30,11 +31,11 @@ namespace ColladaConversion
         return table[0].first;  // first one is the default
     }
 
-    template<typename CharType> bool IsWhitespace(CharType chr);
-    template<typename CharType> const CharType* FastParseElement(uint32& dst, const CharType* start, const CharType* end);
-    template<typename CharType> const CharType* FastParseElement(int64& dst, const CharType* start, const CharType* end);
-    template<typename CharType> const CharType* FastParseElement(uint64& dst, const CharType* start, const CharType* end);
-    template<typename CharType> const CharType* FastParseElement(float& dst, const CharType* start, const CharType* end);
+    template<typename CharType>
+        __forceinline bool IsWhitespace(CharType chr)
+    {
+        return chr == 0x20 || chr == 0x9 || chr == 0xD || chr == 0xA;
+    }
 
     template<typename Type>
         auto ParseXMLList(Type dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, unsigned* outEleCount = nullptr) 
@@ -43,18 +44,11 @@ namespace ColladaConversion
         assert(destCount > 0);
 
         // in xml, lists are deliminated by white space.
-        unsigned elementCount = 0;
-        auto* eleStart = section._start;
-        while (elementCount < destCount) {
-            while (eleStart < section._end && IsWhitespace(*eleStart)) ++eleStart;
-
-            auto* eleEnd = FastParseElement(dest[elementCount], eleStart, section._end);
-            if (eleStart == eleEnd) {
-                if (outEleCount) *outEleCount = elementCount;
-                return eleEnd;
-            }
-            ++elementCount;
-            eleStart = eleEnd;
+        size_t elementCount = 0;
+        auto* eleStart = FastParseList(dest, destCount, section._start, section._end, elementCount);
+        if (elementCount < destCount) {
+            if (outEleCount) *outEleCount = unsigned(elementCount);
+            return eleStart;
         }
 
         // skip forward over any trailing whitespace (which should bring us right to the end if the array ends in whitespace)
@@ -64,16 +58,15 @@ namespace ColladaConversion
             // while there are remaining elements, we must count them...
             // we will return the correct number of elements, even if they don't
             // all fit in the destination array
+            Type temp[64];
             auto countingIterator = eleStart;
-            Type temp;
-            while (elementCount < destCount) {
-                while (countingIterator < section._end && IsWhitespace(*countingIterator)) ++countingIterator;
-                auto* eleEnd = FastParseElement(temp, countingIterator, section._end);
-                if (countingIterator == eleEnd) break;
-                ++elementCount;
-                countingIterator = eleEnd;
+            for (;;) {
+                size_t tempCount = 0;
+                countingIterator = FastParseList(temp, dimof(temp), countingIterator, section._end, tempCount);
+                elementCount += tempCount;
+                if (tempCount < dimof(temp)) break;
             }
-            *outEleCount = elementCount;
+            *outEleCount = unsigned(elementCount);
         }
         return eleStart;
     }
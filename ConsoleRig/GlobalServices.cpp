@@ -9,7 +9,7 @@
 #include "LogStartup.h"
 #include "Console.h"
 #include "IProgress.h"
-#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/TaskScheduler.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/SystemUtils.h"
@@ -142,8 +142,8 @@ namespace ConsoleRig
 
     GlobalServices::GlobalServices(const StartupConfig& cfg)
     {
-        _shortTaskPool = std::make_unique<CompletionThreadPool>(cfg._shortTaskThreadPoolCount);
-        _longTaskPool = std::make_unique<CompletionThreadPool>(cfg._longTaskThreadPoolCount);
+        _shortTaskPool = std::make_unique<TaskScheduler>(cfg._shortTaskThreadPoolCount);
+        _longTaskPool = std::make_unique<TaskScheduler>(cfg._longTaskThreadPoolCount);
 
         MainRig_Startup(cfg, _crossModule._services);
         _crossModule.Publish(*this);
@@ -10,7 +10,7 @@
 #include <string>
 #include <memory>
 
-namespace Utility { class CompletionThreadPool; }
+namespace Utility { class TaskScheduler; }
 
 namespace ConsoleRig
 {
@@ -110,8 +110,8 @@ namespace ConsoleRig
     {
     public:
         static CrossModule& GetCrossModule() { return s_instance->_crossModule; }
-        static CompletionThreadPool& GetShortTaskThreadPool() { return *s_instance->_shortTaskPool; }
-        static CompletionThreadPool& GetLongTaskThreadPool() { return *s_instance->_longTaskPool; }
+        static TaskScheduler& GetShortTaskThreadPool() { return *s_instance->_shortTaskPool; }
+        static TaskScheduler& GetLongTaskThreadPool() { return *s_instance->_longTaskPool; }
         static GlobalServices& GetInstance() { return *s_instance; }
 
         AttachRef<GlobalServices> Attach();
@@ -128,8 +128,8 @@ namespace ConsoleRig
         static GlobalServices* s_instance;
         CrossModule _crossModule;
 
-        std::unique_ptr<CompletionThreadPool> _shortTaskPool;
-        std::unique_ptr<CompletionThreadPool> _longTaskPool;
+        std::unique_ptr<TaskScheduler> _shortTaskPool;
+        std::unique_ptr<TaskScheduler> _longTaskPool;
     };
 
 }
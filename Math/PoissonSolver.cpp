@@ -10,9 +10,15 @@
 #include "./Math.h"
 #include "Vector.h"
 #include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/TaskScheduler.h"
+#include "../Utility/TimeUtils.h"
 #include "../Utility/PtrUtils.h"
+#include "../Utility/IteratorUtils.h"
 #include <vector>
+#include <algorithm>
 #include <assert.h>
+#include <emmintrin.h>
 
 #pragma warning(disable:4714)
 #pragma push_macro("new")
@@ -28,51 +34,300 @@ namespace XLEMath
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-    static void RunSOR(ScalarField1D& xv, const AMat& A, const ScalarField1D& b, float relaxationFactor)
+        //////////////////////////////////////////////////////////////////
+            //      P A R A L L E L   K E R N E L S                 //
+        //////////////////////////////////////////////////////////////////
+
+        //  All of the expensive operations in the solvers are simple loops over the
+        //  grid. We split these into fixed size chunks, and run them on the short task
+        //  pool. Reductions (dot products) are summed per chunk, and the chunk sums are
+        //  added in order -- so the result doesn't depend on the number of threads.
+    static const unsigned ParallelChunkSize = 16*1024;
+
+    template<typename Fn>
+        static float ParallelReduce(unsigned count, Fn&& fn)
     {
-        const auto width = GetWidth(A);
-        const auto height = GetHeight(A);
+        auto chunkCount = (count + ParallelChunkSize - 1) / ParallelChunkSize;
+        if (chunkCount <= 1)
+            return count ? fn(0u, count) : 0.f;
+
+        float partialsBuffer[256];
+        std::vector<float> partialsHeap;
+        float* partials = partialsBuffer;
+        if (chunkCount > dimof(partialsBuffer)) {
+            partialsHeap.resize(chunkCount);
+            partials = AsPointer(partialsHeap.begin());
+        }
 
-            // Note that "SOR" can't work correctly with wrapping borders
-            // Jacobi relaxation could work; but because SOR is done in-place,
-            // the results won't be correct if we attempt to read from a border
-            // wrapped around
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetShortTaskThreadPool(), chunkCount,
+            [&fn, partials, count](unsigned c)
+            {
+                partials[c] = fn(c*ParallelChunkSize, std::min(count, (c+1)*ParallelChunkSize));
+            });
+
+        float result = 0.f;
+        for (unsigned c=0; c<chunkCount; ++c) result += partials[c];
+        return result;
+    }
 
-        if (A._dimensionality==2) {
-            const UInt2 bor(1,1);   // can't fill in the edges using this method
-            for (unsigned y=bor[1]; y<height-bor[1]; ++y) {
-                for (unsigned x=bor[0]; x<width-bor[0]; ++x) {
-                    const unsigned i = y*width+x;
-                    auto v = b[i];
+    static float HorizontalAdd(__m128 v)
+    {
+        auto t = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        t = _mm_add_ss(t, _mm_shuffle_ps(t, t, 1));
+        return _mm_cvtss_f32(t);
+    }
+
+    static float DotRange(const float a[], const float b[], unsigned begin, unsigned end)
+    {
+        auto acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        unsigned i=begin;
+        for (; (i+8)<=end; i+=8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&a[i+4]), _mm_loadu_ps(&b[i+4])));
+        }
+        auto result = HorizontalAdd(_mm_add_ps(acc0, acc1));
+        for (; i<end; ++i) result += a[i] * b[i];
+        return result;
+    }
 
-                    v -= A._a1 * xv[i-1];
-                    v -= A._a1 * xv[i+1];
-                    v -= A._a1 * xv[i-width];
-                    v -= A._a1 * xv[i+width];
+    static float Dot(const ScalarField1D& a, const ScalarField1D& b, unsigned N)
+    {
+        const float* ap = a._u, *bp = b._u;
+        return ParallelReduce(N, 
+            [ap, bp](unsigned begin, unsigned end) { return DotRange(ap, bp, begin, end); });
+    }
 
-                    xv[i] = (1.f-relaxationFactor) * xv[i] + relaxationFactor * v / A._a0;
+        //  x += alpha * d; r -= alpha * q
+        //  returns r.r (calculated in the same pass, because the plain CG method needs it next)
+    static float UpdateSolutionAndResidual(
+        ScalarField1D& x, ScalarField1D& r, 
+        const ScalarField1D& d, const ScalarField1D& q, 
+        float alpha, unsigned N)
+    {
+        float* xp = x._u, *rp = r._u;
+        const float* dp = d._u, *qp = q._u;
+        return ParallelReduce(N, 
+            [xp, rp, dp, qp, alpha](unsigned begin, unsigned end)
+            {
+                auto va = _mm_set1_ps(alpha);
+                auto acc = _mm_setzero_ps();
+                unsigned i=begin;
+                for (; (i+4)<=end; i+=4) {
+                    _mm_storeu_ps(&xp[i], _mm_add_ps(_mm_loadu_ps(&xp[i]), _mm_mul_ps(va, _mm_loadu_ps(&dp[i]))));
+                    auto r = _mm_sub_ps(_mm_loadu_ps(&rp[i]), _mm_mul_ps(va, _mm_loadu_ps(&qp[i])));
+                    _mm_storeu_ps(&rp[i], r);
+                    acc = _mm_add_ps(acc, _mm_mul_ps(r, r));
                 }
+                auto result = HorizontalAdd(acc);
+                for (; i<end; ++i) {
+                    xp[i] += alpha * dp[i];
+                    rp[i] -= alpha * qp[i];
+                    result += rp[i] * rp[i];
+                }
+                return result;
+            });
+    }
+
+        //  d = s + beta * d
+    static void UpdateDirection(ScalarField1D& d, const ScalarField1D& s, float beta, unsigned N)
+    {
+        float* dp = d._u;
+        const float* sp = s._u;
+        ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), N, ParallelChunkSize,
+            [dp, sp, beta](unsigned begin, unsigned end)
+            {
+                auto vb = _mm_set1_ps(beta);
+                unsigned i=begin;
+                for (; (i+4)<=end; i+=4)
+                    _mm_storeu_ps(&dp[i], _mm_add_ps(_mm_loadu_ps(&sp[i]), _mm_mul_ps(vb, _mm_loadu_ps(&dp[i]))));
+                for (; i<end; ++i)
+                    dp[i] = sp[i] + beta * dp[i];
+            });
+    }
+
+        //  Rows are the interior rows of the grid (ie, excluding the border cells on
+        //  all sides). "rowIndex" is in the range [0, GetInteriorRowCount(A))
+    static unsigned GetInteriorRowCount(const AMat& A)
+    {
+        if (A._dimensionality==2) return GetHeight(A)-2;
+        return (GetHeight(A)-2) * (GetDepth(A)-2);
+    }
+
+    static UInt2 GetInteriorRow(const AMat& A, unsigned rowIndex)
+    {
+        if (A._dimensionality==2) return UInt2(rowIndex+1, 0);
+        return UInt2(1 + rowIndex%(GetHeight(A)-2), 1 + rowIndex/(GetHeight(A)-2));
+    }
+
+        //  Applies the 5 point (2D) or 7 point (3D) stencil to a row of interior cells
+        //  (planeStride is zero for 2D)
+    static void StencilRow(
+        float dst[], const float b[], 
+        unsigned begin, unsigned end, unsigned width, unsigned planeStride,
+        float a0, float a1)
+    {
+        auto va0 = _mm_set1_ps(a0), va1 = _mm_set1_ps(a1);
+        unsigned i=begin;
+        if (planeStride) {
+            for (; (i+4)<=end; i+=4) {
+                auto n = _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_add_ps(_mm_loadu_ps(&b[i-1]), _mm_loadu_ps(&b[i+1])),
+                        _mm_add_ps(_mm_loadu_ps(&b[i-width]), _mm_loadu_ps(&b[i+width]))),
+                    _mm_add_ps(_mm_loadu_ps(&b[i-planeStride]), _mm_loadu_ps(&b[i+planeStride])));
+                _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_mul_ps(va0, _mm_loadu_ps(&b[i])), _mm_mul_ps(va1, n)));
             }
+            for (; i<end; ++i)
+                dst[i] = a0 * b[i] + a1 * (((b[i-1] + b[i+1]) + (b[i-width] + b[i+width])) + (b[i-planeStride] + b[i+planeStride]));
         } else {
-            const UInt3 bor(1,1,1);
-            const auto depth = GetDepth(A);
-            for (unsigned z=bor[2]; z<depth-bor[2]; ++z) {
-                for (unsigned y=bor[1]; y<height-bor[1]; ++y) {
-                    for (unsigned x=bor[0]; x<width-bor[0]; ++x) {
-                        const unsigned i = (z*height+y)*width+x;
-                        auto v = b[i];
-
-                        v -= A._a1 * xv[i-width*height];
-                        v -= A._a1 * xv[i-width];
-                        v -= A._a1 * xv[i-1];
-                        v -= A._a1 * xv[i+1];
-                        v -= A._a1 * xv[i+width];
-                        v -= A._a1 * xv[i+width*height];
-
-                        xv[i] = (1.f-relaxationFactor) * xv[i] + relaxationFactor * v / A._a0;
+            for (; (i+4)<=end; i+=4) {
+                auto n = _mm_add_ps(
+                    _mm_add_ps(_mm_loadu_ps(&b[i-1]), _mm_loadu_ps(&b[i+1])),
+                    _mm_add_ps(_mm_loadu_ps(&b[i-width]), _mm_loadu_ps(&b[i+width])));
+                _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_mul_ps(va0, _mm_loadu_ps(&b[i])), _mm_mul_ps(va1, n)));
+            }
+            for (; i<end; ++i)
+                dst[i] = a0 * b[i] + a1 * ((b[i-1] + b[i+1]) + (b[i-width] + b[i+width]));
+        }
+    }
+
+        //  One colour of a red-black SOR pass on a row of interior cells. Only cells
+        //  where (x&1) == parity are written. The others are calculated along with them
+        //  (so we can use full SSE vectors), but discarded. Cells of one colour only
+        //  read cells of the other colour, so rows can be processed in parallel.
+    static void RedBlackRow(
+        float xv[], const float b[], 
+        unsigned rowStart, unsigned width, unsigned planeStride, unsigned parity,
+        float a0, float a1, float relaxationFactor)
+    {
+        const auto scale = relaxationFactor / a0;
+        const auto keep = 1.f - relaxationFactor;
+        auto vscale = _mm_set1_ps(scale), vkeep = _mm_set1_ps(keep), va1 = _mm_set1_ps(a1);
+
+            // x starts at 1 (which is odd), so the lanes to write are fixed for every vector
+        const unsigned firstLane = parity ^ 1u;
+        unsigned x=1;
+        for (; (x+4)<=(width-1); x+=4) {
+            const unsigned i = rowStart + x;
+            auto n = _mm_add_ps(
+                _mm_add_ps(_mm_loadu_ps(&xv[i-1]), _mm_loadu_ps(&xv[i+1])),
+                _mm_add_ps(_mm_loadu_ps(&xv[i-width]), _mm_loadu_ps(&xv[i+width])));
+            if (planeStride)
+                n = _mm_add_ps(n, _mm_add_ps(_mm_loadu_ps(&xv[i-planeStride]), _mm_loadu_ps(&xv[i+planeStride])));
+            auto v = _mm_add_ps(
+                _mm_mul_ps(vkeep, _mm_loadu_ps(&xv[i])),
+                _mm_mul_ps(vscale, _mm_sub_ps(_mm_loadu_ps(&b[i]), _mm_mul_ps(va1, n))));
+
+            float result[4];
+            _mm_storeu_ps(result, v);
+            xv[i+firstLane] = result[firstLane];
+            xv[i+firstLane+2] = result[firstLane+2];
+        }
+
+        for (x+=((x&1)!=parity); x<(width-1); x+=2) {
+            const unsigned i = rowStart + x;
+            auto n = (xv[i-1] + xv[i+1]) + (xv[i-width] + xv[i+width]);
+            if (planeStride) n += xv[i-planeStride] + xv[i+planeStride];
+            xv[i] = keep * xv[i] + scale * (b[i] - a1 * n);
+        }
+    }
+
+    static void RunSOR(ScalarField1D& xv, const AMat& A, const ScalarField1D& b, float relaxationFactor)
+    {
+            // This is a red-black ordering of successive over relaxation. Cells are
+            // coloured like a checker board; and we update all of the red cells, and then
+            // all of the black cells. Each pass can be split across many threads, and the
+            // result doesn't depend on the order we process the rows.
+            //
+            // Note that "SOR" can't work correctly with wrapping borders
+            // Jacobi relaxation could work; but because SOR is done in-place,
+            // the results won't be correct if we attempt to read from a border
+            // wrapped around
+        const auto width = GetWidth(A);
+        const auto height = GetHeight(A);
+        const auto planeStride = (A._dimensionality==2) ? 0u : (width*height);
+        const auto rowCount = GetInteriorRowCount(A);
+        if (width < 3 || !rowCount) return;
+
+        float* xp = xv._u;
+        const float* bp = b._u;
+        for (unsigned colour=0; colour<2; ++colour) {
+            ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), rowCount, ParallelChunkSize / width,
+                [&A, xp, bp, width, height, planeStride, colour, relaxationFactor](unsigned rowBegin, unsigned rowEnd)
+                {
+                    for (unsigned r=rowBegin; r<rowEnd; ++r) {
+                        auto yz = GetInteriorRow(A, r);
+                        auto parity = (colour ^ yz[0] ^ yz[1]) & 1u;
+                        RedBlackRow(
+                            xp, bp, (yz[1]*height+yz[0])*width, width, planeStride, parity,
+                            A._a0, A._a1, relaxationFactor);
+                    }
+                });
+        }
+    }
+
+    namespace PoissonSolverInternal
+    {
+        void Multiply(ScalarField1D& dst, const AMat& A, const ScalarField1D& b, unsigned N)
+        {
+            const auto width = GetWidth(A), height = GetHeight(A);
+            const auto planeStride = (A._dimensionality==2) ? 0u : (width*height);
+            const auto rowCount = GetInteriorRowCount(A);
+            assert(N == GetN(A)); (void)N;
+
+            float* dstp = dst._u;
+            const float* bp = b._u;
+            ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), rowCount, ParallelChunkSize / width,
+                [&A, dstp, bp, width, height, planeStride](unsigned rowBegin, unsigned rowEnd)
+                {
+                    for (unsigned r=rowBegin; r<rowEnd; ++r) {
+                        auto yz = GetInteriorRow(A, r);
+                        auto rowStart = (yz[1]*height+yz[0])*width;
+                        StencilRow(dstp, bp, rowStart+1, rowStart+width-1, width, planeStride, A._a0, A._a1);
                     }
+                });
+
+            if (A._dimensionality==2) {
+                    // do the borders, as well --
+                    //      4 edges & 4 corners
+                const auto w = width, h = height;
+                #define XY(x,y) XY_WH(x,y,w)
+                for (unsigned i=1; i<w-1; ++i) {
+                    dst[XY(i, 0)]       = A._a0ey *  b[XY(  i,   0)] 
+                                        + A._a1e  * (b[XY(  i,   1)] + b[XY(i-1, 0)] + b[XY(i+1, 0)])
+                                        + A._a1ry * (b[XY(  i, h-1)]);
+                    dst[XY(i, h-1)]     = A._a0ey *  b[XY(  i, h-1)] 
+                                        + A._a1e  * (b[XY(  i, h-2)] + b[XY(i-1, h-1)] + b[XY(i+1, h-1)])
+                                        + A._a1ry * (b[XY(  i,   0)]);
+                }
+
+                for (unsigned i=1; i<h-1; ++i) {
+                    dst[XY(0, i)]       = A._a0ex *  b[XY(  0,   i)] 
+                                        + A._a1e  * (b[XY(  1,   i)] + b[XY(0, i-1)] + b[XY(0, i+1)])
+                                        + A._a1rx * (b[XY(w-1,   i)]);
+                    dst[XY(w-1, i)]     = A._a0ex *  b[XY(w-1,   i)] 
+                                        + A._a1e  * (b[XY(w-2,   i)] + b[XY(w-1, i-1)] + b[XY(w-1, i+1)])
+                                        + A._a1rx * (b[XY(  0,   i)]);
                 }
+                
+                dst[XY(0, 0)]           = A._a0c *  b[XY(  0,   0)] 
+                                        + A._a1e * (b[XY(  0,   1)] + b[XY(  1,   0)])
+                                        + A._a1rx * b[XY(w-1,   0)] + A._a1ry * b[XY(  0, h-1)];
+                dst[XY(0, h-1)]         = A._a0c *  b[XY(  0, h-1)] 
+                                        + A._a1e * (b[XY(  0, h-2)] + b[XY(  1, h-1)])
+                                        + A._a1rx * b[XY(w-1, h-1)] + A._a1ry * b[XY(  0,   0)];
+
+                dst[XY(w-1, 0)]         = A._a0c *  b[XY(w-1,   0)] 
+                                        + A._a1e * (b[XY(w-1,   1)] + b[XY(w-2,   0)])
+                                        + A._a1rx * b[XY(  0,   0)] + A._a1ry * b[XY(w-1, h-1)];
+                dst[XY(w-1, h-1)]       = A._a0c *  b[XY(w-1, h-1)] 
+                                        + A._a1e * (b[XY(w-1, h-2)] + b[XY(w-2, h-1)])
+                                        + A._a1rx * b[XY(  0, h-1)] + A._a1ry * b[XY(w-1,   0)];
+                #undef XY
             }
+
+                // todo -- 3D borders, edges, faces!
         }
     }
 
@@ -149,47 +404,32 @@ namespace XLEMath
         //     /**/
         const auto N = GetN(A);
         assert(N == _N);
-        #define FOR_EACH_CELL                   \
-            for (unsigned i=0; i<N; ++i) {      \
-            /**/
-        #define FOR_EACH_CELL_END }
 
-        auto rAsField = AsScalarField1D(_r);
-        Multiply(rAsField, A, x, _N);
+            //  The vector operations below are SSE kernels, split across the short task
+            //  thread pool (see Dot, UpdateSolutionAndResidual & UpdateDirection)
+        auto r = AsScalarField1D(_r), d = AsScalarField1D(_d), q = AsScalarField1D(_q);
+        Multiply(r, A, x, _N);
         for (unsigned c=0; c<b._count; ++c) {
             _r[c] =  b[c] - _r[c];
             _d[c] = _r[c];
         }
-        auto rho = 0.f; // _r.dot(_r);
-        FOR_EACH_CELL
-            rho += _r[i] * _r[i];
-        FOR_EACH_CELL_END
+        auto rho = Dot(r, r, N);
 
         unsigned k=0;
         if (XlAbs(rho) > rhoThreshold) {
             for (; k<maxIterations; ++k) {
             
-                Multiply(_q, A, _d, _N);
-                auto dDotQ = 0.f; // _d.dot(_q);
-                FOR_EACH_CELL
-                    dDotQ += _d[i] * _q[i];
-                FOR_EACH_CELL_END
+                Multiply(q, A, d, _N);
+                auto dDotQ = Dot(d, q, N);
 
                 auto alpha = rho / dDotQ;
                 assert(isfinite(alpha) && !isnan(alpha));
-                FOR_EACH_CELL
-                     x[i] += alpha * _d[i];
-                        // _r should be an estimate the of the current error
-                        // Every few iterations, we can improve this estimate
-                        // by recalculating _r = b - A * x
-                    _r[i] -= alpha * _q[i]; 
-                FOR_EACH_CELL_END
-            
+
+                    // _r should be an estimate the of the current error
+                    // Every few iterations, we can improve this estimate
+                    // by recalculating _r = b - A * x
                 auto rhoOld = rho;
-                rho = 0.f; // _r.dot(_r);
-                FOR_EACH_CELL
-                    rho += _r[i] * _r[i];
-                FOR_EACH_CELL_END
+                rho = UpdateSolutionAndResidual(x, r, d, q, alpha, N);     // (returns _r.dot(_r))
 
                 if (XlAbs(rho) < rhoThreshold) break;
                 auto beta = rho / rhoOld;
@@ -197,16 +437,10 @@ namespace XLEMath
             
                     // we can skip the border for the following...
                     // (but that requires different cases for 2D/3D)
-                FOR_EACH_CELL
-                    _d[i] = _r[i] + beta * _d[i];
-                FOR_EACH_CELL_END
-
+                UpdateDirection(d, r, beta, N);
             }
         }
 
-        #undef FOR_EACH_CELL
-        #undef FOR_EACH_CELL_END
-
         return k;
     }
 
@@ -250,8 +484,8 @@ namespace XLEMath
         const auto rhoThreshold = 1e-10f;
         const auto maxIterations = 13u;
 
-        auto rAsField = AsScalarField1D(_r);
-        Multiply(rAsField, A, x, _N);    // r = AMat * x
+        auto r = AsScalarField1D(_r), d = AsScalarField1D(_d), q = AsScalarField1D(_q), sf = AsScalarField1D(_s);
+        Multiply(r, A, x, _N);    // r = AMat * x
         for (unsigned c=0; c<b._count; ++c)
             _r[c] = b[c] - _r[c];
             
@@ -269,25 +503,10 @@ namespace XLEMath
         //     }
         // #endif
 
-        // const UInt3 bor = GetBorders(A);
-        // const auto& dims = A._dims;
-        // #define FOR_EACH_CELL                                               \
-        //     for (unsigned qz=bor[2]; qz<dims[2]-bor[2]; ++qz)               \
-        //         for (unsigned qy=bor[1]; qy<dims[1]-bor[1]; ++qy)           \
-        //             for (unsigned qx=bor[0]; qx<dims[0]-bor[0]; ++qx) {     \
-        //                 auto i = (qz*dims[1]+qy)*dims[0]+qx;                \
-        //     /**/
         const auto N = GetN(A);
         assert(N == _N);
-        #define FOR_EACH_CELL                           \
-            for (unsigned i=0; i<N; ++i) {              \
-            /**/
-        #define FOR_EACH_CELL_END }
             
-        auto rho = 0.f;
-        FOR_EACH_CELL
-            rho += _r[i] * _d[i];       // calculating: auto rho = _r.dot(_d);
-        FOR_EACH_CELL_END
+        auto rho = Dot(r, d, N);
         // auto rho0 = rho;
             
         unsigned k=0;
@@ -303,40 +522,28 @@ namespace XLEMath
                     // simplified, because the vectors already have only one
                     // element per cell.
             
-                Multiply(_q, A, _d, _N);
-                auto dDotQ = 0.f; // _d.dot(_q);
-                FOR_EACH_CELL
-                    dDotQ += _d[i] * _q[i];
-                FOR_EACH_CELL_END
+                Multiply(q, A, d, _N);
+                auto dDotQ = Dot(d, q, N);
 
                 auto alpha = rho / dDotQ;
                 assert(isfinite(alpha) && !isnan(alpha));
-                FOR_EACH_CELL
-                     x[i] += alpha * _d[i];
-                    _r[i] -= alpha * _q[i];
-                FOR_EACH_CELL_END
+                UpdateSolutionAndResidual(x, r, d, q, alpha, N);
             
+                    // The forward substitution is inherently serial; so this part
+                    // isn't split across threads
                 SolveLowerTriangular(_s, precon, _r, _N);
                 auto rhoOld = rho;
-                rho = 0.f; // _r.dot(_s);
-                FOR_EACH_CELL
-                    rho += _r[i] * _s[i];
-                FOR_EACH_CELL_END
+                rho = Dot(r, sf, N);
                 if (XlAbs(rho) < rhoThreshold) break;
                 // assert(rho < rhoOld);
 
                 auto beta = rho / rhoOld;
                 assert(isfinite(beta) && !isnan(beta));
             
-                FOR_EACH_CELL
-                    _d[i] = _s[i] + beta * _d[i];
-                FOR_EACH_CELL_END
+                UpdateDirection(d, sf, beta, N);
             }
         }
 
-        #undef FOR_EACH_CELL
-        #undef FOR_EACH_CELL_END
-
         return k;
     }
 
@@ -396,38 +603,46 @@ namespace XLEMath
             // might want to move the sames to the center of the 
             // grid cells; which would mean that we should 
             // use a more complex operator here
-        for (unsigned y=1; y<dstDims[1]-1; ++y) {
-            for (unsigned x=1; x<dstDims[0]-1; ++x) {
-                unsigned sx = (x-1)*2+1, sy = (y-1)*2+1;
-                dst[y*dstDims[0]+x]
-                    = .25f * src[(sy+0)*srcDims[0]+(sx+0)]
-                    + .25f * src[(sy+0)*srcDims[0]+(sx+1)]
-                    + .25f * src[(sy+1)*srcDims[0]+(sx+0)]
-                    + .25f * src[(sy+1)*srcDims[0]+(sx+1)]
-                    ;
-            }
-        }
+        ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), dstDims[1]-2, ParallelChunkSize / dstDims[0],
+            [&](unsigned begin, unsigned end)
+            {
+                for (unsigned y=begin+1; y<end+1; ++y) {
+                    for (unsigned x=1; x<dstDims[0]-1; ++x) {
+                        unsigned sx = (x-1)*2+1, sy = (y-1)*2+1;
+                        dst[y*dstDims[0]+x]
+                            = .25f * src[(sy+0)*srcDims[0]+(sx+0)]
+                            + .25f * src[(sy+0)*srcDims[0]+(sx+1)]
+                            + .25f * src[(sy+1)*srcDims[0]+(sx+0)]
+                            + .25f * src[(sy+1)*srcDims[0]+(sx+1)]
+                            ;
+                    }
+                }
+            });
     }
 
     static void Restrict3D(ScalarField1D& dst, const ScalarField1D& src, UInt3 dstDims, UInt3 srcDims)
     {
-        for (unsigned z=1; z<dstDims[2]-1; ++z) {
-            for (unsigned y=1; y<dstDims[1]-1; ++y) {
-                for (unsigned x=1; x<dstDims[0]-1; ++x) {
-                    unsigned sx = (x-1)*2+1, sy = (y-1)*2+1, sz = (z-1)*2+1;
-                    dst[(z*dstDims[1]+y)*dstDims[0]+x]
-                        = .125f * src[((sz+0)*srcDims[1]+(sy+0))*srcDims[0]+(sx+0)]
-                        + .125f * src[((sz+0)*srcDims[1]+(sy+0))*srcDims[0]+(sx+1)]
-                        + .125f * src[((sz+0)*srcDims[1]+(sy+1))*srcDims[0]+(sx+0)]
-                        + .125f * src[((sz+0)*srcDims[1]+(sy+1))*srcDims[0]+(sx+1)]
-                        + .125f * src[((sz+1)*srcDims[1]+(sy+0))*srcDims[0]+(sx+0)]
-                        + .125f * src[((sz+1)*srcDims[1]+(sy+0))*srcDims[0]+(sx+1)]
-                        + .125f * src[((sz+1)*srcDims[1]+(sy+1))*srcDims[0]+(sx+0)]
-                        + .125f * src[((sz+1)*srcDims[1]+(sy+1))*srcDims[0]+(sx+1)]
-                        ;
+        ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), dstDims[2]-2, ParallelChunkSize / (dstDims[0]*dstDims[1]),
+            [&](unsigned begin, unsigned end)
+            {
+                for (unsigned z=begin+1; z<end+1; ++z) {
+                    for (unsigned y=1; y<dstDims[1]-1; ++y) {
+                        for (unsigned x=1; x<dstDims[0]-1; ++x) {
+                            unsigned sx = (x-1)*2+1, sy = (y-1)*2+1, sz = (z-1)*2+1;
+                            dst[(z*dstDims[1]+y)*dstDims[0]+x]
+                                = .125f * src[((sz+0)*srcDims[1]+(sy+0))*srcDims[0]+(sx+0)]
+                                + .125f * src[((sz+0)*srcDims[1]+(sy+0))*srcDims[0]+(sx+1)]
+                                + .125f * src[((sz+0)*srcDims[1]+(sy+1))*srcDims[0]+(sx+0)]
+                                + .125f * src[((sz+0)*srcDims[1]+(sy+1))*srcDims[0]+(sx+1)]
+                                + .125f * src[((sz+1)*srcDims[1]+(sy+0))*srcDims[0]+(sx+0)]
+                                + .125f * src[((sz+1)*srcDims[1]+(sy+0))*srcDims[0]+(sx+1)]
+                                + .125f * src[((sz+1)*srcDims[1]+(sy+1))*srcDims[0]+(sx+0)]
+                                + .125f * src[((sz+1)*srcDims[1]+(sy+1))*srcDims[0]+(sx+1)]
+                                ;
+                        }
+                    }
                 }
-            }
-        }
+            });
     }
 
     static void Prolongate2D(ScalarField1D& dst, const ScalarField1D& src, UInt2 dstDims, UInt2 srcDims)
@@ -437,61 +652,69 @@ namespace XLEMath
             // to use a simple bilinear sample, as if each
             // layer was a mipmap.
 
-        for (unsigned y=1; y<dstDims[1]-1; ++y) {
-            for (unsigned x=1; x<dstDims[0]-1; ++x) {
-                auto sx = (x-1)/2.f + 1.f;
-                auto sy = (y-1)/2.f + 1.f;
-                auto sx0 = XlFloor(sx), sy0 = XlFloor(sy);
-                auto a = sx - sx0, b = sy - sy0;
-                decltype(a) weights[] = {
-                    (1.0f - a) * (1.0f - b),
-                    a * (1.0f - b),
-                    (1.0f - a) * b,
-                    a * b
-                };
-                dst[y*dstDims[0]+x]
-                    = weights[0] * src[(unsigned(sy0)+0)*srcDims[0]+unsigned(sx0)]
-                    + weights[1] * src[(unsigned(sy0)+0)*srcDims[0]+unsigned(sx0)+1]
-                    + weights[2] * src[(unsigned(sy0)+1)*srcDims[0]+unsigned(sx0)]
-                    + weights[3] * src[(unsigned(sy0)+1)*srcDims[0]+unsigned(sx0)+1]
-                    ;
-            }
-        }
+        ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), dstDims[1]-2, ParallelChunkSize / dstDims[0],
+            [&](unsigned begin, unsigned end)
+            {
+                for (unsigned y=begin+1; y<end+1; ++y) {
+                    for (unsigned x=1; x<dstDims[0]-1; ++x) {
+                        auto sx = (x-1)/2.f + 1.f;
+                        auto sy = (y-1)/2.f + 1.f;
+                        auto sx0 = XlFloor(sx), sy0 = XlFloor(sy);
+                        auto a = sx - sx0, b = sy - sy0;
+                        decltype(a) weights[] = {
+                            (1.0f - a) * (1.0f - b),
+                            a * (1.0f - b),
+                            (1.0f - a) * b,
+                            a * b
+                        };
+                        dst[y*dstDims[0]+x]
+                            = weights[0] * src[(unsigned(sy0)+0)*srcDims[0]+unsigned(sx0)]
+                            + weights[1] * src[(unsigned(sy0)+0)*srcDims[0]+unsigned(sx0)+1]
+                            + weights[2] * src[(unsigned(sy0)+1)*srcDims[0]+unsigned(sx0)]
+                            + weights[3] * src[(unsigned(sy0)+1)*srcDims[0]+unsigned(sx0)+1]
+                            ;
+                    }
+                }
+            });
     }
 
     static void Prolongate3D(ScalarField1D& dst, const ScalarField1D& src, UInt3 dstDims, UInt3 srcDims)
     {
-        for (unsigned z=1; z<dstDims[2]-1; ++z) {
-            for (unsigned y=1; y<dstDims[1]-1; ++y) {
-                for (unsigned x=1; x<dstDims[0]-1; ++x) {
-                    auto sx = (x-1)/2.f + 1.f;
-                    auto sy = (y-1)/2.f + 1.f;
-                    auto sz = (z-1)/2.f + 1.f;
-                    auto sx0 = XlFloor(sx), sy0 = XlFloor(sy), sz0 = XlFloor(sz);
-                    auto a = sx - sx0, b = sy - sy0, c = sz - sz0;
-                    decltype(a) weights[] = {
-                        (1.0f - a) * (1.0f - b) * (1.0f - c),
-                        a * (1.0f - b) * (1.0f - c),
-                        (1.0f - a) * b * (1.0f - c),
-                        a * b * (1.0f - c),
-                        (1.0f - a) * (1.0f - b) * c,
-                        a * (1.0f - b) * c,
-                        (1.0f - a) * b * c,
-                        a * b * c
-                    };
-                    dst[(z*dstDims[1]+y)*dstDims[0]+x]
-                        = weights[0] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+0]
-                        + weights[1] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+1]
-                        + weights[2] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+0]
-                        + weights[3] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+1]
-                        + weights[4] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+0]
-                        + weights[5] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+1]
-                        + weights[6] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+0]
-                        + weights[7] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+1]
-                        ;
+        ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), dstDims[2]-2, ParallelChunkSize / (dstDims[0]*dstDims[1]),
+            [&](unsigned begin, unsigned end)
+            {
+                for (unsigned z=begin+1; z<end+1; ++z) {
+                    for (unsigned y=1; y<dstDims[1]-1; ++y) {
+                        for (unsigned x=1; x<dstDims[0]-1; ++x) {
+                            auto sx = (x-1)/2.f + 1.f;
+                            auto sy = (y-1)/2.f + 1.f;
+                            auto sz = (z-1)/2.f + 1.f;
+                            auto sx0 = XlFloor(sx), sy0 = XlFloor(sy), sz0 = XlFloor(sz);
+                            auto a = sx - sx0, b = sy - sy0, c = sz - sz0;
+                            decltype(a) weights[] = {
+                                (1.0f - a) * (1.0f - b) * (1.0f - c),
+                                a * (1.0f - b) * (1.0f - c),
+                                (1.0f - a) * b * (1.0f - c),
+                                a * b * (1.0f - c),
+                                (1.0f - a) * (1.0f - b) * c,
+                                a * (1.0f - b) * c,
+                                (1.0f - a) * b * c,
+                                a * b * c
+                            };
+                            dst[(z*dstDims[1]+y)*dstDims[0]+x]
+                                = weights[0] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+0]
+                                + weights[1] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+1]
+                                + weights[2] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+0]
+                                + weights[3] * src[((unsigned(sz0)+0)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+1]
+                                + weights[4] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+0]
+                                + weights[5] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+0))*srcDims[0]+unsigned(sx0)+1]
+                                + weights[6] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+0]
+                                + weights[7] * src[((unsigned(sz0)+1)*srcDims[1]+(unsigned(sy0)+1))*srcDims[0]+unsigned(sx0)+1]
+                                ;
+                        }
+                    }
                 }
-            }
-        }
+            });
     }
 
     template<typename Mat>
@@ -624,6 +847,8 @@ namespace XLEMath
         std::unique_ptr<Solver_PlainCG> _plainCGSolver;
         std::unique_ptr<Solver_PreconCG> _preconCGSolver;
         std::unique_ptr<Solver_Multigrid> _multigridSolver;
+
+        SolveStatistics _lastSolve;
     };
 
     class PoissonSolver::PreparedMatrix
@@ -664,6 +889,24 @@ namespace XLEMath
     unsigned PoissonSolver::Solve(
         ScalarField1D x, const PreparedMatrix& A, const ScalarField1D& b, 
         Method solver, Flags::BitField flags) const
+    {
+        auto startTime = GetPerformanceCounter();
+        auto iterations = SolveInternal(x, A, b, solver, flags);
+        auto endTime = GetPerformanceCounter();
+
+        _pimpl->_lastSolve._iterations = iterations;
+        _pimpl->_lastSolve._solveTime = float(double(endTime - startTime) * 1000.0 / double(GetPerformanceCounterFrequency()));
+        return iterations;
+    }
+
+    auto PoissonSolver::GetLastSolveStatistics() const -> SolveStatistics
+    {
+        return _pimpl->_lastSolve;
+    }
+
+    unsigned PoissonSolver::SolveInternal(
+        ScalarField1D x, const PreparedMatrix& A, const ScalarField1D& b, 
+        Method solver, Flags::BitField flags) const
     {
         //
         // Here is our basic solver for Poisson equations (such as the heat equation).
@@ -1304,6 +1547,8 @@ namespace XLEMath
         
         _pimpl->_tempBuffer = VectorX(N);
         _pimpl->_tempBuffer.fill(0.f);
+        _pimpl->_lastSolve._iterations = 0;
+        _pimpl->_lastSolve._solveTime = 0.f;
 
         #if defined(_DEBUG)
             {
@@ -72,6 +72,16 @@ namespace XLEMath
         unsigned Solve(
             ScalarField1D x, const PreparedMatrix& A, const ScalarField1D& b, 
             Method method, Flags::BitField flags = 0u) const;
+
+        class SolveStatistics
+        {
+        public:
+            unsigned    _iterations;
+            float       _solveTime;     // (in milliseconds)
+        };
+
+            // Returns the iteration count and time taken for the most recent call to Solve()
+        SolveStatistics GetLastSolveStatistics() const;
         
         std::shared_ptr<PreparedMatrix> PrepareDiffusionMatrix(
             float diffusionAmount, Method method, unsigned wrapEdgesFlags) const;
@@ -86,6 +96,10 @@ namespace XLEMath
     protected:
         class Pimpl;
         std::unique_ptr<Pimpl> _pimpl;
+
+        unsigned SolveInternal(
+            ScalarField1D x, const PreparedMatrix& A, const ScalarField1D& b, 
+            Method method, Flags::BitField flags) const;
     };
 }
 
@@ -128,87 +128,10 @@ namespace XLEMath
             }
         }
 
-        template <typename Vec>
-            static void Multiply(Vec& dst, const AMat& A, const Vec& b, unsigned N)
-        {
-            const auto width = GetWidth(A), height = GetHeight(A);
-
-            if (A._dimensionality==2) {
-                const UInt2 bor(1,1);
-                for (unsigned y=bor[1]; y<height-bor[1]; ++y) {
-                    for (unsigned x=bor[0]; x<width-bor[0]; ++x) {
-                        const unsigned i = y*width + x;
-
-                        auto v = A._a0 * b[i];
-                        v += A._a1 * b[i-1];
-                        v += A._a1 * b[i+1];
-                        v += A._a1 * b[i-width];
-                        v += A._a1 * b[i+width];
-
-                        dst[i] = v;
-                    }
-                }
-
-                    // do the borders, as well --
-                    //      4 edges & 4 corners
-                const auto w = width, h = height;
-                #define XY(x,y) XY_WH(x,y,w)
-                for (unsigned i=1; i<w-1; ++i) {
-                    dst[XY(i, 0)]       = A._a0ey *  b[XY(  i,   0)] 
-                                        + A._a1e  * (b[XY(  i,   1)] + b[XY(i-1, 0)] + b[XY(i+1, 0)])
-                                        + A._a1ry * (b[XY(  i, h-1)]);
-                    dst[XY(i, h-1)]     = A._a0ey *  b[XY(  i, h-1)] 
-                                        + A._a1e  * (b[XY(  i, h-2)] + b[XY(i-1, h-1)] + b[XY(i+1, h-1)])
-                                        + A._a1ry * (b[XY(  i,   0)]);
-                }
-
-                for (unsigned i=1; i<h-1; ++i) {
-                    dst[XY(0, i)]       = A._a0ex *  b[XY(  0,   i)] 
-                                        + A._a1e  * (b[XY(  1,   i)] + b[XY(0, i-1)] + b[XY(0, i+1)])
-                                        + A._a1rx * (b[XY(w-1,   i)]);
-                    dst[XY(w-1, i)]     = A._a0ex *  b[XY(w-1,   i)] 
-                                        + A._a1e  * (b[XY(w-2,   i)] + b[XY(w-1, i-1)] + b[XY(w-1, i+1)])
-                                        + A._a1rx * (b[XY(  0,   i)]);
-                }
-                
-                dst[XY(0, 0)]           = A._a0c *  b[XY(  0,   0)] 
-                                        + A._a1e * (b[XY(  0,   1)] + b[XY(  1,   0)])
-                                        + A._a1rx * b[XY(w-1,   0)] + A._a1ry * b[XY(  0, h-1)];
-                dst[XY(0, h-1)]         = A._a0c *  b[XY(  0, h-1)] 
-                                        + A._a1e * (b[XY(  0, h-2)] + b[XY(  1, h-1)])
-                                        + A._a1rx * b[XY(w-1, h-1)] + A._a1ry * b[XY(  0,   0)];
-
-                dst[XY(w-1, 0)]         = A._a0c *  b[XY(w-1,   0)] 
-                                        + A._a1e * (b[XY(w-1,   1)] + b[XY(w-2,   0)])
-                                        + A._a1rx * b[XY(  0,   0)] + A._a1ry * b[XY(w-1, h-1)];
-                dst[XY(w-1, h-1)]       = A._a0c *  b[XY(w-1, h-1)] 
-                                        + A._a1e * (b[XY(w-1, h-2)] + b[XY(w-2, h-1)])
-                                        + A._a1rx * b[XY(  0, h-1)] + A._a1ry * b[XY(w-1,   0)];
-                #undef XY
-
-            } else {
-                const UInt3 bor(1,1,1);
-                for (unsigned z=bor[2]; z<GetDepth(A)-bor[2]; ++z) {
-                    for (unsigned y=bor[1]; y<height-bor[1]; ++y) {
-                        for (unsigned x=bor[0]; x<width-bor[0]; ++x) {
-                            const unsigned i = (z*height+y)*width + x;
-
-                            auto v = A._a0 * b[i];
-                            v += A._a1 * b[i-width*height];
-                            v += A._a1 * b[i-width];
-                            v += A._a1 * b[i-1];
-                            v += A._a1 * b[i+1];
-                            v += A._a1 * b[i+width];
-                            v += A._a1 * b[i+width*height];
-
-                            dst[i] = v;
-                        }
-                    }
-                }
-
-                    // todo -- borders, edges, faces!
-            }
-        }
+            // Multiply by a "diffusion" type matrix. This is the most expensive part of the
+            // iterative solvers, so it's implemented with SSE and split across the short task
+            // thread pool (see PoissonSolver.cpp)
+        void Multiply(ScalarField1D& dst, const AMat& A, const ScalarField1D& b, unsigned N);
         
     }
 }
@@ -11,6 +11,7 @@
 #include "../Core/Prefix.h"
 #include <assert.h>
 #include <intrin.h>
+#include <algorithm>
 
 namespace XLEMath
 {
@@ -387,6 +388,355 @@ namespace XLEMath
         return TestAABB_SSE(AsFloatArray(localToProjection), mins, maxs);
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Batch AABB tests.
+        //
+        //  All of the kernels below use exactly the same arithmetic for each corner:
+        //      clip[r] = (m[r][0]*x + m[r][1]*y) + (m[r][2]*z + m[r][3])
+        //  and compare against the same 6 planes (x<-w, x>w, y<-w, y>w, z<0, z>w).
+        //  Because we never use fused multiply-add, and IEEE single precision add & multiply
+        //  are exact for both the scalar and vector instructions, the scalar, SSE and AVX
+        //  kernels will return bit-identical results. (This wouldn't be true on x87, but
+        //  we always compile with SSE2 float math).
+        //
+        //  Each box is transformed corner by corner, but the vector kernels work on 4 or 8
+        //  boxes at the same time. This avoids the shuffling and horizontal adds required
+        //  when working with a single box (as in TestAABB_SSE).
+
+    static void TestAABBs_ScalarRange(
+        unsigned& culledBits, unsigned& boundaryBits,
+        const float m[4][4],
+        const float* const mins[3], const float* const maxs[3],
+        size_t first, unsigned count)
+    {
+        for (unsigned b=0; b<count; ++b) {
+            auto i = first+b;
+            bool andPlanes[6] = { true, true, true, true, true, true };
+            bool orPlanes = false;
+            for (unsigned c=0; c<8; ++c) {
+                float x = (c & 1) ? maxs[0][i] : mins[0][i];
+                float y = (c & 2) ? maxs[1][i] : mins[1][i];
+                float z = (c & 4) ? maxs[2][i] : mins[2][i];
+
+                float clip[4];
+                for (unsigned r=0; r<4; ++r)
+                    clip[r] = (m[r][0] * x + m[r][1] * y) + (m[r][2] * z + m[r][3]);
+
+                float negW = 0.f - clip[3];
+                bool outside[6] = {
+                    clip[0] < negW, clip[0] > clip[3],
+                    clip[1] < negW, clip[1] > clip[3],
+                    clip[2] < 0.f,  clip[2] > clip[3]
+                };
+                for (unsigned p=0; p<6; ++p) {
+                    andPlanes[p] &= outside[p];
+                    orPlanes |= outside[p];
+                }
+            }
+
+            bool culled = andPlanes[0] | andPlanes[1] | andPlanes[2] | andPlanes[3] | andPlanes[4] | andPlanes[5];
+            if (culled)             culledBits |= 1u << b;
+            else if (orPlanes)      boundaryBits |= 1u << b;
+        }
+    }
+
+        //  Test 4 boxes (starting at box "i") against a pre-splatted matrix, and return
+        //  4 bit masks. This is shared by the SSE kernel, the AVX kernel tail and
+        //  AABBBatchTester::Test4.
+    static inline void TestAABBs_SSEBlock(
+        unsigned& culledBits, unsigned& boundaryBits,
+        const __m128 mat[4][4],
+        const float* const mins[3], const float* const maxs[3],
+        size_t i)
+    {
+        auto allTrue = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        auto zero = _mm_setzero_ps();
+
+        __m128 mn[3] = { _mm_loadu_ps(&mins[0][i]), _mm_loadu_ps(&mins[1][i]), _mm_loadu_ps(&mins[2][i]) };
+        __m128 mx[3] = { _mm_loadu_ps(&maxs[0][i]), _mm_loadu_ps(&maxs[1][i]), _mm_loadu_ps(&maxs[2][i]) };
+
+        __m128 andPlanes[6] = { allTrue, allTrue, allTrue, allTrue, allTrue, allTrue };
+        auto orPlanes = zero;
+
+        for (unsigned c=0; c<8; ++c) {
+            auto x = (c & 1) ? mx[0] : mn[0];
+            auto y = (c & 2) ? mx[1] : mn[1];
+            auto z = (c & 4) ? mx[2] : mn[2];
+
+            __m128 clip[4];
+            for (unsigned r=0; r<4; ++r) {
+                clip[r] = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(mat[r][0], x), _mm_mul_ps(mat[r][1], y)),
+                    _mm_add_ps(_mm_mul_ps(mat[r][2], z), mat[r][3]));
+            }
+
+            auto negW = _mm_sub_ps(zero, clip[3]);
+            __m128 outside[6] = {
+                _mm_cmplt_ps(clip[0], negW), _mm_cmpgt_ps(clip[0], clip[3]),
+                _mm_cmplt_ps(clip[1], negW), _mm_cmpgt_ps(clip[1], clip[3]),
+                _mm_cmplt_ps(clip[2], zero), _mm_cmpgt_ps(clip[2], clip[3])
+            };
+            for (unsigned p=0; p<6; ++p) {
+                andPlanes[p] = _mm_and_ps(andPlanes[p], outside[p]);
+                orPlanes = _mm_or_ps(orPlanes, outside[p]);
+            }
+        }
+
+        auto culled = _mm_or_ps(
+            _mm_or_ps(_mm_or_ps(andPlanes[0], andPlanes[1]), _mm_or_ps(andPlanes[2], andPlanes[3])),
+            _mm_or_ps(andPlanes[4], andPlanes[5]));
+        culledBits = unsigned(_mm_movemask_ps(culled));
+        boundaryBits = unsigned(_mm_movemask_ps(orPlanes)) & ~culledBits;
+    }
+
+    static void TestAABBs_SSERange(
+        unsigned& culledBits, unsigned& boundaryBits,
+        const float m[4][4],
+        const float* const mins[3], const float* const maxs[3],
+        size_t first, unsigned count)
+    {
+        __m128 mat[4][4];
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                mat[r][c] = _mm_set1_ps(m[r][c]);
+
+        unsigned b=0;
+        for (; (b+4)<=count; b+=4) {
+            unsigned c, bnd;
+            TestAABBs_SSEBlock(c, bnd, mat, mins, maxs, first+b);
+            culledBits |= c << b;
+            boundaryBits |= bnd << b;
+        }
+
+        if (b < count) {
+            unsigned tailCulled = 0, tailBoundary = 0;
+            TestAABBs_ScalarRange(tailCulled, tailBoundary, m, mins, maxs, first+b, count-b);
+            culledBits |= tailCulled << b;
+            boundaryBits |= tailBoundary << b;
+        }
+    }
+
+        //  The AVX kernel is compiled without /arch:AVX (so the rest of this file can run
+        //  on any SSE4.1 machine). It must only be called after checking CPU support.
+        //  On MSVC only the 256 bit intrinsics get VEX encodings, so keep 128 bit work
+        //  out of the part of the kernel where the upper halves are dirty.
+    #if COMPILER_ACTIVE == COMPILER_TYPE_GCC
+        #define AVX_KERNEL __attribute__((target("avx")))
+    #else
+        #define AVX_KERNEL
+    #endif
+
+    AVX_KERNEL static void TestAABBs_AVXRange(
+        unsigned& culledBits, unsigned& boundaryBits,
+        const float m[4][4],
+        const float* const mins[3], const float* const maxs[3],
+        size_t first, unsigned count)
+    {
+        __m256 mat[4][4];
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                mat[r][c] = _mm256_set1_ps(m[r][c]);
+
+        auto allTrue = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        auto zero = _mm256_setzero_ps();
+
+        unsigned b=0;
+        for (; (b+8)<=count; b+=8) {
+            auto i = first+b;
+            __m256 mn[3] = { _mm256_loadu_ps(&mins[0][i]), _mm256_loadu_ps(&mins[1][i]), _mm256_loadu_ps(&mins[2][i]) };
+            __m256 mx[3] = { _mm256_loadu_ps(&maxs[0][i]), _mm256_loadu_ps(&maxs[1][i]), _mm256_loadu_ps(&maxs[2][i]) };
+
+            __m256 andPlanes[6] = { allTrue, allTrue, allTrue, allTrue, allTrue, allTrue };
+            auto orPlanes = zero;
+
+            for (unsigned c=0; c<8; ++c) {
+                auto x = (c & 1) ? mx[0] : mn[0];
+                auto y = (c & 2) ? mx[1] : mn[1];
+                auto z = (c & 4) ? mx[2] : mn[2];
+
+                __m256 clip[4];
+                for (unsigned r=0; r<4; ++r) {
+                    clip[r] = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(mat[r][0], x), _mm256_mul_ps(mat[r][1], y)),
+                        _mm256_add_ps(_mm256_mul_ps(mat[r][2], z), mat[r][3]));
+                }
+
+                    // (ordered, non-signalling compares match the SSE cmplt/cmpgt behaviour for NaNs)
+                auto negW = _mm256_sub_ps(zero, clip[3]);
+                __m256 outside[6] = {
+                    _mm256_cmp_ps(clip[0], negW, _CMP_LT_OQ), _mm256_cmp_ps(clip[0], clip[3], _CMP_GT_OQ),
+                    _mm256_cmp_ps(clip[1], negW, _CMP_LT_OQ), _mm256_cmp_ps(clip[1], clip[3], _CMP_GT_OQ),
+                    _mm256_cmp_ps(clip[2], zero, _CMP_LT_OQ), _mm256_cmp_ps(clip[2], clip[3], _CMP_GT_OQ)
+                };
+                for (unsigned p=0; p<6; ++p) {
+                    andPlanes[p] = _mm256_and_ps(andPlanes[p], outside[p]);
+                    orPlanes = _mm256_or_ps(orPlanes, outside[p]);
+                }
+            }
+
+            auto culled = _mm256_or_ps(
+                _mm256_or_ps(_mm256_or_ps(andPlanes[0], andPlanes[1]), _mm256_or_ps(andPlanes[2], andPlanes[3])),
+                _mm256_or_ps(andPlanes[4], andPlanes[5]));
+            auto c = unsigned(_mm256_movemask_ps(culled));
+            culledBits |= c << b;
+            boundaryBits |= (unsigned(_mm256_movemask_ps(orPlanes)) & ~c) << b;
+        }
+
+            // avoid AVX -> SSE transition penalties (in the code below, and in the caller)
+        _mm256_zeroupper();
+
+            //  A remaining group of 4 boxes is done with 128 bit operations. This must come
+            //  after the vzeroupper. GCC builds this whole function with target("avx"), so
+            //  these would be VEX encoded; but MSVC has no per-function target, and without
+            //  /arch:AVX it uses the legacy SSE encodings for 128 bit intrinsics
+        if ((b+4) <= count) {
+            __m128 mat4[4][4];
+            for (unsigned r=0; r<4; ++r)
+                for (unsigned c=0; c<4; ++c)
+                    mat4[r][c] = _mm_set1_ps(m[r][c]);
+            unsigned c, bnd;
+            TestAABBs_SSEBlock(c, bnd, mat4, mins, maxs, first+b);
+            culledBits |= c << b;
+            boundaryBits |= bnd << b;
+            b += 4;
+        }
+
+        if (b < count) {
+            unsigned tailCulled = 0, tailBoundary = 0;
+            TestAABBs_ScalarRange(tailCulled, tailBoundary, m, mins, maxs, first+b, count-b);
+            culledBits |= tailCulled << b;
+            boundaryBits |= tailBoundary << b;
+        }
+    }
+
+    #undef AVX_KERNEL
+
+    static bool DetectAVXSupport()
+    {
+        #if COMPILER_ACTIVE == COMPILER_TYPE_GCC
+            return __builtin_cpu_supports("avx");
+        #else
+                //  Check both the CPU flag and the OS support for saving the
+                //  upper half of the ymm registers (OSXSAVE & XCR0 bits 1 & 2)
+            int info[4];
+            __cpuid(info, 1);
+            const int osxsave = 1<<27, avx = 1<<28;
+            if ((info[2] & (osxsave|avx)) != (osxsave|avx)) return false;
+            return (_xgetbv(0) & 6) == 6;
+        #endif
+    }
+
+    bool IsAABBBatchKernelSupported(AABBBatchKernel::Enum kernel)
+    {
+        static const bool hasAVX = DetectAVXSupport();
+        if (kernel == AABBBatchKernel::AVX) return hasAVX;
+        return true;    // (SSE4.1 is already required by TestAABB_SSE)
+    }
+
+    using AABBRangeFn = void(*)(unsigned&, unsigned&, const float[4][4], const float* const[3], const float* const[3], size_t, unsigned);
+
+    static AABBRangeFn SelectAABBRangeFn(AABBBatchKernel::Enum kernel)
+    {
+        if (kernel == AABBBatchKernel::Default)
+            kernel = IsAABBBatchKernelSupported(AABBBatchKernel::AVX) ? AABBBatchKernel::AVX : AABBBatchKernel::SSE;
+        assert(IsAABBBatchKernelSupported(kernel));
+
+        if (kernel == AABBBatchKernel::SSE)         return &TestAABBs_SSERange;
+        else if (kernel == AABBBatchKernel::AVX)    return &TestAABBs_AVXRange;
+        return &TestAABBs_ScalarRange;
+    }
+
+    static void RunAABBRangeFn(
+        AABBRangeFn fn,
+        unsigned culledMask[], unsigned boundaryMask[],
+        const float m[4][4],
+        const float* const mins[3], const float* const maxs[3],
+        size_t count)
+    {
+            //  Work on 32 boxes at a time, so that each kernel call writes
+            //  exactly one word of each mask
+        for (size_t first=0; first<count; first+=32) {
+            auto blockCount = unsigned(std::min(count-first, size_t(32)));
+            unsigned culledBits = 0, boundaryBits = 0;
+            (*fn)(culledBits, boundaryBits, m, mins, maxs, first, blockCount);
+            culledMask[first>>5] = culledBits;
+            if (boundaryMask) boundaryMask[first>>5] = boundaryBits;
+        }
+    }
+
+    void TestAABBs(
+        unsigned culledMask[], unsigned boundaryMask[],
+        const Float4x4& localToProjection,
+        const float* const mins[3], const float* const maxs[3],
+        size_t count,
+        AABBBatchKernel::Enum kernel)
+    {
+        float m[4][4];
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                m[r][c] = localToProjection(r, c);
+
+        RunAABBRangeFn(SelectAABBRangeFn(kernel), culledMask, boundaryMask, m, mins, maxs, count);
+    }
+
+    void AABBBatchTester::Test4(
+        unsigned& culledBits, unsigned& boundaryBits,
+        const float* const mins[3], const float* const maxs[3]) const
+    {
+        __m128 mat[4][4];
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                mat[r][c] = _mm_loadu_ps(_splat[r][c]);
+        TestAABBs_SSEBlock(culledBits, boundaryBits, mat, mins, maxs, 0);
+    }
+
+    void AABBBatchTester::Test(
+        unsigned culledMask[], unsigned boundaryMask[],
+        const float* const mins[3], const float* const maxs[3],
+        size_t count) const
+    {
+        RunAABBRangeFn((AABBRangeFn)_rangeFn, culledMask, boundaryMask, _m, mins, maxs, count);
+    }
+
+    void AABBBatchTester::TestBoxes(
+        unsigned culledMask[], unsigned boundaryMask[],
+        const std::pair<Float3, Float3>* boxes, size_t stride,
+        const unsigned indices[], size_t count) const
+    {
+            //  Gather the boxes into structure-of-arrays form, 32 at a time
+        auto fn = (AABBRangeFn)_rangeFn;
+        float soa[6][32];
+        const float* mins[3] = { soa[0], soa[1], soa[2] };
+        const float* maxs[3] = { soa[3], soa[4], soa[5] };
+        for (size_t first=0; first<count; first+=32) {
+            auto blockCount = unsigned(std::min(count-first, size_t(32)));
+            for (unsigned b=0; b<blockCount; ++b) {
+                auto index = indices ? indices[first+b] : unsigned(first+b);
+                const auto& box = *(const std::pair<Float3, Float3>*)((const char*)boxes + index * stride);
+                for (unsigned c=0; c<3; ++c) {
+                    soa[c][b] = box.first[c];
+                    soa[3+c][b] = box.second[c];
+                }
+            }
+            unsigned culledBits = 0, boundaryBits = 0;
+            (*fn)(culledBits, boundaryBits, _m, mins, maxs, 0, blockCount);
+            culledMask[first>>5] = culledBits;
+            if (boundaryMask) boundaryMask[first>>5] = boundaryBits;
+        }
+    }
+
+    AABBBatchTester::AABBBatchTester(const Float4x4& localToProjection, AABBBatchKernel::Enum kernel)
+    {
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c) {
+                _m[r][c] = localToProjection(r, c);
+                for (unsigned l=0; l<4; ++l)
+                    _splat[r][c][l] = _m[r][c];
+            }
+        _rangeFn = (void*)SelectAABBRangeFn(kernel);
+    }
+
     Float4 ExtractMinimalProjection(const Float4x4& projectionMatrix)
     {
         return Float4(projectionMatrix(0,0), projectionMatrix(1,1), projectionMatrix(2,2), projectionMatrix(2,3));
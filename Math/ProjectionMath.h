@@ -43,6 +43,66 @@ namespace XLEMath
             == AABBIntersection::Culled;
     }
 
+    namespace AABBBatchKernel {
+        enum Enum { Default, Scalar, SSE, AVX };
+    }
+
+        /// <summary>Test many bounding boxes against a frustum at once</summary>
+        /// The boxes are given as structure-of-arrays; "mins[0]" is the array of minimum
+        /// X values, "mins[1]" the minimum Y values, etc. The result is written as bit
+        /// masks, with one bit per box (32 boxes per unsigned, box "i" is bit "i&31" of
+        /// word "i>>5"). "culledMask" gets a bit for every box that would return
+        /// AABBIntersection::Culled from TestAABB, and "boundaryMask" (which can be null)
+        /// gets a bit for every box that would return AABBIntersection::Boundary. Both
+        /// masks must have space for (count+31)/32 words.
+        ///
+        /// The result is bit-identical regardless of which kernel is used, so the default
+        /// kernel (the widest supported by the current CPU) is the right choice except
+        /// for testing.
+    void TestAABBs(
+        unsigned culledMask[], unsigned boundaryMask[],
+        const Float4x4& localToProjection,
+        const float* const mins[3], const float* const maxs[3],
+        size_t count,
+        AABBBatchKernel::Enum kernel = AABBBatchKernel::Default);
+
+    bool IsAABBBatchKernelSupported(AABBBatchKernel::Enum kernel);
+
+        /// <summary>TestAABBs, prepared for many small batches against the same frustum</summary>
+        /// Tree traversals test only a few boxes at a time (eg, the 4 children of a node).
+        /// Calling TestAABBs for each of those would splat the matrix and select the kernel
+        /// every time; this class does that just once, in the constructor.
+        ///
+        /// Test4() tests exactly 4 boxes, always with the SSE kernel (a wider kernel can't
+        /// help with only 4 boxes). TestBoxes() takes (mins, maxs) pairs with an arbitrary
+        /// stride, and an optional list of indices into that array. It gathers them into
+        /// structure-of-arrays form internally. The masks are in the same form as TestAABBs,
+        /// and all results are bit-identical to TestAABBs.
+    class AABBBatchTester
+    {
+    public:
+        void Test4(
+            unsigned& culledBits, unsigned& boundaryBits,
+            const float* const mins[3], const float* const maxs[3]) const;
+        void Test(
+            unsigned culledMask[], unsigned boundaryMask[],
+            const float* const mins[3], const float* const maxs[3],
+            size_t count) const;
+        void TestBoxes(
+            unsigned culledMask[], unsigned boundaryMask[],
+            const std::pair<Float3, Float3>* boxes, size_t stride,
+            const unsigned indices[], size_t count) const;
+
+        AABBBatchTester(
+            const Float4x4& localToProjection,
+            AABBBatchKernel::Enum kernel = AABBBatchKernel::Default);
+
+    private:
+        float   _splat[4][4][4];    // (each matrix element repeated in 4 lanes)
+        float   _m[4][4];
+        void*   _rangeFn;
+    };
+
     Float4 ExtractMinimalProjection(const Float4x4& projectionMatrix);
     bool IsOrthogonalProjection(const Float4x4& projectionMatrix);
 
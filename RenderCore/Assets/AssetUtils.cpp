@@ -81,6 +81,14 @@ namespace RenderCore { namespace Assets
     {
     }
 
+    TransformationParameterSet::TransformationParameterSet(const RelativeImage& image)
+    :       _float4x4Parameters(image._float4x4Parameters.begin(), image._float4x4Parameters.end())
+    ,       _float4Parameters(image._float4Parameters.begin(), image._float4Parameters.end())
+    ,       _float3Parameters(image._float3Parameters.begin(), image._float3Parameters.end())
+    ,       _float1Parameters(image._float1Parameters.begin(), image._float1Parameters.end())
+    {
+    }
+
     TransformationParameterSet&  TransformationParameterSet::operator=(const TransformationParameterSet& copyFrom)
     {
         _float4x4Parameters = copyFrom._float4x4Parameters;
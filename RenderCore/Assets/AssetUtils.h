@@ -31,6 +31,14 @@ namespace RenderCore { namespace Assets
     static const uint64 ChunkType_Skeleton = ConstHash64<'Skel', 'eton'>::Value;
     static const uint64 ChunkType_RawMat = ConstHash64<'RawM', 'at'>::Value;
     static const uint64 ChunkType_Metrics = ConstHash64<'Metr', 'ics'>::Value;
+    static const uint64 ChunkType_ModelIntersection = ConstHash64<'Mode', 'lInt', 'ers'>::Value;
+
+        // (chunk versions shared by the compilers & the runtime loaders)
+    static const unsigned ModelScaffoldVersion = 4;
+    static const unsigned ModelScaffoldLargeBlocksVersion = 0;
+    static const unsigned ModelIntersectionVersion = 0;
+    static const unsigned AnimationSetVersion = 1;
+    static const unsigned SkeletonVersion = 3;        // (BlockFormat::Relative from version 3)
 
     class GeoInputAssembly;
     class DrawCallDesc;
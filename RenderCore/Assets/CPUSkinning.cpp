@@ -0,0 +1,363 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "CPUSkinning.h"
+#include "ModelRunTime.h"
+#include "ModelImmutableData.h"
+#include "ModelRendererInternal.h"      // for WriteJointTransforms
+#include "MeshDatabase.h"
+#include "../Metal/Format.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../ConsoleRig/Log.h"
+#include "../../Utility/Threading/TaskScheduler.h"
+#include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include <xmmintrin.h>
+#include <algorithm>
+
+namespace RenderCore { namespace Assets
+{
+    void SkinnedVertexStreamsSoA::Resize(size_t vertexCount, unsigned influenceCount, bool hasNormals)
+    {
+        auto paddedCount = (vertexCount + 3) & ~size_t(3);
+        _vertexCount = vertexCount;
+        _influenceCount = std::min(influenceCount, 4u);
+        for (unsigned c=0; c<3; ++c) {
+            _positions[c].resize(paddedCount, 0.f);
+            _normals[c].resize(hasNormals ? paddedCount : 0, 0.f);
+        }
+        for (unsigned c=0; c<4; ++c) {
+            _weights[c].resize(paddedCount, 0.f);
+            _jointIndices[c].resize(paddedCount, 0);
+        }
+    }
+
+    SkinnedVertexStreamsSoA::SkinnedVertexStreamsSoA() : _vertexCount(0), _influenceCount(0) {}
+
+    SkinnedVertexStreamsSoA::SkinnedVertexStreamsSoA(SkinnedVertexStreamsSoA&& moveFrom)
+    : _vertexCount(moveFrom._vertexCount), _influenceCount(moveFrom._influenceCount)
+    {
+        for (unsigned c=0; c<3; ++c) {
+            _positions[c] = std::move(moveFrom._positions[c]);
+            _normals[c] = std::move(moveFrom._normals[c]);
+        }
+        for (unsigned c=0; c<4; ++c) {
+            _weights[c] = std::move(moveFrom._weights[c]);
+            _jointIndices[c] = std::move(moveFrom._jointIndices[c]);
+        }
+    }
+
+    SkinnedVertexStreamsSoA& SkinnedVertexStreamsSoA::operator=(SkinnedVertexStreamsSoA&& moveFrom)
+    {
+        _vertexCount = moveFrom._vertexCount;
+        _influenceCount = moveFrom._influenceCount;
+        for (unsigned c=0; c<3; ++c) {
+            _positions[c] = std::move(moveFrom._positions[c]);
+            _normals[c] = std::move(moveFrom._normals[c]);
+        }
+        for (unsigned c=0; c<4; ++c) {
+            _weights[c] = std::move(moveFrom._weights[c]);
+            _jointIndices[c] = std::move(moveFrom._jointIndices[c]);
+        }
+        return *this;
+    }
+
+    SkinnedVertexStreamsSoA::~SkinnedVertexStreamsSoA() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void JointPaletteSoA::Set(IteratorRange<const Float3x4*> jointTransforms)
+    {
+        auto jointCount = jointTransforms.size();
+        for (unsigned e=0; e<12; ++e) {
+            _elements[e].resize(jointCount+1);
+            for (size_t j=0; j<jointCount; ++j)
+                _elements[e][j] = jointTransforms[j](e/4, e%4);
+            _elements[e][jointCount] = ((e/4) == (e%4)) ? 1.f : 0.f;   // identity joint
+        }
+    }
+
+    void SkinVerticesSoA(
+        float* dstPositions[3], float* dstNormals[3],
+        const SkinnedVertexStreamsSoA& src, const JointPaletteSoA& palette,
+        size_t begin, size_t end)
+    {
+        assert((begin%4)==0 && (end%4)==0 && end <= src.GetPaddedVertexCount());
+
+        const float* pal[12];
+        for (unsigned e=0; e<12; ++e) pal[e] = AsPointer(palette._elements[e].cbegin());
+
+        const bool doNormals = dstNormals && src.HasNormals();
+        const auto influenceCount = src._influenceCount;
+
+        for (size_t v=begin; v<end; v+=4) {
+                //  Build the blended joint transform for these 4 vertices (one
+                //  matrix element per register)
+            __m128 m[12];
+            for (unsigned e=0; e<12; ++e) m[e] = _mm_setzero_ps();
+
+            for (unsigned i=0; i<influenceCount; ++i) {
+                auto w = _mm_loadu_ps(&src._weights[i][v]);
+                const uint16* j = &src._jointIndices[i][v];
+                for (unsigned e=0; e<12; ++e) {
+                    auto p = _mm_setr_ps(pal[e][j[0]], pal[e][j[1]], pal[e][j[2]], pal[e][j[3]]);
+                    m[e] = _mm_add_ps(m[e], _mm_mul_ps(w, p));
+                }
+            }
+
+            auto x = _mm_loadu_ps(&src._positions[0][v]);
+            auto y = _mm_loadu_ps(&src._positions[1][v]);
+            auto z = _mm_loadu_ps(&src._positions[2][v]);
+            for (unsigned r=0; r<3; ++r) {
+                auto a = _mm_add_ps(_mm_mul_ps(m[r*4+0], x), _mm_mul_ps(m[r*4+1], y));
+                auto b = _mm_add_ps(_mm_mul_ps(m[r*4+2], z), m[r*4+3]);
+                _mm_storeu_ps(&dstPositions[r][v], _mm_add_ps(a, b));
+            }
+
+            if (doNormals) {
+                x = _mm_loadu_ps(&src._normals[0][v]);
+                y = _mm_loadu_ps(&src._normals[1][v]);
+                z = _mm_loadu_ps(&src._normals[2][v]);
+                for (unsigned r=0; r<3; ++r) {
+                    auto a = _mm_add_ps(_mm_mul_ps(m[r*4+0], x), _mm_mul_ps(m[r*4+1], y));
+                    _mm_storeu_ps(&dstNormals[r][v], _mm_add_ps(a, _mm_mul_ps(m[r*4+2], z)));
+                }
+            }
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class CPUSkinningMachine::Pimpl
+    {
+    public:
+        class Mesh
+        {
+        public:
+            unsigned                        _geoId;
+            const BoundSkinnedGeometry*     _controller;
+            SkinnedVertexStreamsSoA         _streams;
+        };
+        std::vector<Mesh> _meshes;
+    };
+
+    static const VertexElement* FindVertexElement(const GeoInputAssembly& ia, const char semantic[])
+    {
+        for (const auto& e:ia._elements)
+            if (XlEqStringI(e._semanticName, semantic) && e._semanticIndex == 0)
+                return &e;
+        return nullptr;
+    }
+
+    static unsigned Get8BitComponentCount(const VertexElement& ele)
+    {
+        auto fmt = Metal::NativeFormat::Enum(ele._nativeFormat);
+        if (Metal::GetComponentPrecision(fmt) != 8) return 0;
+        return Metal::GetComponentCount(Metal::GetComponents(fmt));
+    }
+
+    static bool LoadSkinnedMesh(
+        SkinnedVertexStreamsSoA& dst,
+        const BoundSkinnedGeometry& geo, const void* largeBlocks)
+    {
+            //  The animated vertex elements (position & normal) can be in a few different
+            //  formats. We'll use MeshDatabase to decode them.
+        const auto& animIA = geo._animatedVertexElements._ia;
+        const auto& bindIA = geo._skeletonBinding._ia;
+        if (!animIA._vertexStride || !bindIA._vertexStride) return false;
+
+        auto vertexCount = std::min(
+            geo._animatedVertexElements._size / animIA._vertexStride,
+            geo._skeletonBinding._size / bindIA._vertexStride);
+        const void* animStart = PtrAdd(largeBlocks, geo._animatedVertexElements._offset);
+        const void* animEnd = PtrAdd(animStart, geo._animatedVertexElements._size);
+
+        GeoProc::MeshDatabase mesh;
+        const char* semantics[] = { "POSITION", "NORMAL" };
+        for (auto s:semantics) {
+            auto* ele = FindVertexElement(animIA, s);
+            if (!ele) continue;
+            mesh.AddStream(
+                GeoProc::CreateRawDataSource(
+                    PtrAdd(animStart, ele->_alignedByteOffset), animEnd,
+                    vertexCount, animIA._vertexStride,
+                    Metal::NativeFormat::Enum(ele->_nativeFormat)),
+                std::vector<unsigned>(), ele->_semanticName, ele->_semanticIndex);
+        }
+
+        auto posElement = mesh.FindElement("POSITION");
+        auto normalElement = mesh.FindElement("NORMAL");
+        if (posElement == ~0u) {
+            LogWarning << "Skinned mesh has no animated positions. Cannot use CPU skinning for this mesh.";
+            return false;
+        }
+
+            //  Weights & joint indices are always 8 bit formats (UNORM & UINT respectively)
+        auto* weightsEle = FindVertexElement(bindIA, "WEIGHTS");
+        auto* indicesEle = FindVertexElement(bindIA, "JOINTINDICES");
+        unsigned weightCount = weightsEle ? Get8BitComponentCount(*weightsEle) : 0;
+        unsigned indexCount = indicesEle ? Get8BitComponentCount(*indicesEle) : 0;
+        auto influenceCount = std::min(std::min(weightCount, indexCount), 4u);
+        if (!influenceCount || !geo._jointMatrixCount) {
+            LogWarning << "Skinned mesh has unsupported skeleton binding format. Cannot use CPU skinning for this mesh.";
+            return false;
+        }
+
+        dst.Resize(vertexCount, influenceCount, normalElement != ~0u);
+        for (size_t v=0; v<vertexCount; ++v) {
+            auto p = mesh.GetUnifiedElement<Float3>(v, posElement);
+            dst._positions[0][v] = p[0]; dst._positions[1][v] = p[1]; dst._positions[2][v] = p[2];
+            if (normalElement != ~0u) {
+                auto n = mesh.GetUnifiedElement<Float3>(v, normalElement);
+                dst._normals[0][v] = n[0]; dst._normals[1][v] = n[1]; dst._normals[2][v] = n[2];
+            }
+        }
+
+            //  Every vertex starts bound to the identity joint. Then we fill in the
+            //  influences from the preskinning draw calls (which tell us how many
+            //  influences are actually used for each range of vertices). Vertices
+            //  with no influences are just passed through, as in the GPU path.
+        const uint16 identityJoint = uint16(geo._jointMatrixCount);
+        std::fill(dst._weights[0].begin(), dst._weights[0].end(), 1.f);
+        std::fill(dst._jointIndices[0].begin(), dst._jointIndices[0].end(), identityJoint);
+
+        const void* bindStart = PtrAdd(largeBlocks, geo._skeletonBinding._offset);
+        for (unsigned d=0; d<geo._preskinningDrawCallCount; ++d) {
+            const auto& drawCall = geo._preskinningDrawCalls[d];
+            auto drawCallInfluences = std::min(drawCall._subMaterialIndex, influenceCount);
+            if (!drawCallInfluences) continue;
+
+            auto vEnd = std::min(size_t(drawCall._firstVertex + drawCall._indexCount), vertexCount);
+            for (size_t v=drawCall._firstVertex; v<vEnd; ++v) {
+                auto* weights = (const uint8*)PtrAdd(bindStart, v*bindIA._vertexStride + weightsEle->_alignedByteOffset);
+                auto* indices = (const uint8*)PtrAdd(bindStart, v*bindIA._vertexStride + indicesEle->_alignedByteOffset);
+                for (unsigned i=0; i<drawCallInfluences; ++i) {
+                    if (indices[i] < geo._jointMatrixCount) {
+                        dst._weights[i][v] = float(weights[i]) / 255.f;
+                        dst._jointIndices[i][v] = indices[i];
+                    } else {
+                        dst._weights[i][v] = 0.f;
+                        dst._jointIndices[i][v] = identityJoint;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    auto CPUSkinningMachine::CreateOutput() const -> Output
+    {
+        Output result;
+        result._meshes.reserve(_pimpl->_meshes.size());
+        for (const auto& m:_pimpl->_meshes) {
+            Output::Mesh mesh;
+            mesh._geoId = m._geoId;
+            mesh._vertexCount = m._streams._vertexCount;
+            auto paddedCount = m._streams.GetPaddedVertexCount();
+            for (unsigned c=0; c<3; ++c) {
+                mesh._positions[c].resize(paddedCount, 0.f);
+                if (m._streams.HasNormals())
+                    mesh._normals[c].resize(paddedCount, 0.f);
+            }
+            result._meshes.push_back(std::move(mesh));
+        }
+        return std::move(result);
+    }
+
+    void CPUSkinningMachine::PrepareAnimation(
+        Output& output,
+        const Float4x4 transformationMachineResult[], size_t transformationMachineResultCount,
+        const SkeletonBinding& skeletonBinding) const
+    {
+        if (output._meshes.size() != _pimpl->_meshes.size())
+            Throw(::Exceptions::BasicLabel("Output object doesn't match CPUSkinningMachine. Use CPUSkinningMachine::CreateOutput"));
+
+            //  First, build the joint palettes for each mesh. This part is cheap
+            //  relative to the vertex work, so we just do it on this thread.
+        std::vector<JointPaletteSoA> palettes(_pimpl->_meshes.size());
+        std::vector<Float3x4> jointTransforms;
+        for (size_t m=0; m<_pimpl->_meshes.size(); ++m) {
+            const auto& controller = *_pimpl->_meshes[m]._controller;
+            jointTransforms.resize(controller._jointMatrixCount);
+            for (unsigned c=0; c<controller._jointMatrixCount; ++c) {
+                auto machineOutput = skeletonBinding.ModelJointToMachineOutput(controller._jointMatrices[c]);
+                if (machineOutput != ~0u && machineOutput >= transformationMachineResultCount)
+                    Throw(::Exceptions::BasicLabel("Transformation machine result is too small in CPUSkinningMachine::PrepareAnimation"));
+            }
+            WriteJointTransforms(
+                AsPointer(jointTransforms.begin()), jointTransforms.size(),
+                controller, transformationMachineResult, skeletonBinding);
+            palettes[m].Set(MakeIteratorRange(jointTransforms));
+        }
+
+            //  Split the vertex work into chunks, and run each chunk as a task in the short
+            //  task thread pool. This thread executes tasks as well, while it waits.
+        static const size_t ChunkSize = 2048;
+        class Chunk { public: unsigned _mesh; size_t _begin, _end; };
+        std::vector<Chunk> chunks;
+        for (size_t m=0; m<_pimpl->_meshes.size(); ++m) {
+            auto vertexCount = _pimpl->_meshes[m]._streams.GetPaddedVertexCount();
+            for (size_t v=0; v<vertexCount; v+=ChunkSize)
+                chunks.push_back(Chunk{unsigned(m), v, std::min(v+ChunkSize, vertexCount)});
+        }
+
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetShortTaskThreadPool(), unsigned(chunks.size()),
+            [this, &chunks, &palettes, &output](unsigned c)
+            {
+                const auto& chunk = chunks[c];
+                auto& dst = output._meshes[chunk._mesh];
+                float* dstPositions[3], *dstNormals[3];
+                for (unsigned q=0; q<3; ++q) {
+                    dstPositions[q] = AsPointer(dst._positions[q].begin());
+                    dstNormals[q] = dst._normals[q].empty() ? nullptr : AsPointer(dst._normals[q].begin());
+                }
+                SkinVerticesSoA(
+                    dstPositions, dstNormals[0] ? dstNormals : nullptr, 
+                    _pimpl->_meshes[chunk._mesh]._streams, palettes[chunk._mesh],
+                    chunk._begin, chunk._end);
+            });
+    }
+
+    CPUSkinningMachine::CPUSkinningMachine(const ModelScaffold& scaffold, unsigned levelOfDetail)
+    {
+        _pimpl = std::make_unique<Pimpl>();
+
+        const auto& cmdStream = scaffold.CommandStream();
+        const auto& immData = scaffold.ImmutableData();
+
+            //  Map the large blocks part of the scaffold file. We only need it while
+            //  building the SoA streams.
+        MemoryMappedFile file(scaffold.Filename().c_str(), 0ull, MemoryMappedFile::Access::Read);
+        if (!file.IsValid())
+            Throw(::Exceptions::BasicLabel("Could not open model file for CPU skinning (%s)", scaffold.Filename().c_str()));
+        const void* largeBlocks = PtrAdd(file.GetData(), scaffold.LargeBlocksOffset());
+
+        for (unsigned gi=0; gi<cmdStream.GetSkinCallCount(); ++gi) {
+            const auto& geoInst = cmdStream.GetSkinCall(gi);
+            if (geoInst._levelOfDetail != levelOfDetail) continue;
+            assert(geoInst._geoId < immData._boundSkinnedControllerCount);
+
+            auto existing = std::find_if(
+                _pimpl->_meshes.cbegin(), _pimpl->_meshes.cend(),
+                [&geoInst](const Pimpl::Mesh& m) { return m._geoId == geoInst._geoId; });
+            if (existing != _pimpl->_meshes.cend()) continue;
+
+            const auto& geo = immData._boundSkinnedControllers[geoInst._geoId];
+            Pimpl::Mesh mesh;
+            mesh._geoId = geoInst._geoId;
+            mesh._controller = &geo;
+            if (LoadSkinnedMesh(mesh._streams, geo, largeBlocks))
+                _pimpl->_meshes.push_back(std::move(mesh));
+        }
+    }
+
+    CPUSkinningMachine::~CPUSkinningMachine() {}
+
+}}
+
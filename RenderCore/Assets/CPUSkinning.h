@@ -0,0 +1,131 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Vector.h"
+#include "../../Math/Matrix.h"
+#include "../../Utility/IteratorUtils.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <memory>
+
+namespace RenderCore { namespace Assets
+{
+    class ModelScaffold;
+    class SkeletonBinding;
+    class BoundSkinnedGeometry;
+
+        /// <summary>Skinning input vertices in structure-of-arrays form</summary>
+        /// Each component is stored in a separate array, so the skinning kernel can
+        /// work on 4 vertices at a time. The arrays are padded up to a multiple of 4
+        /// vertices (padding vertices are bound to the identity joint).
+    class SkinnedVertexStreamsSoA
+    {
+    public:
+        std::vector<float>  _positions[3];
+        std::vector<float>  _normals[3];        // (empty if there are no animated normals)
+        std::vector<float>  _weights[4];
+        std::vector<uint16> _jointIndices[4];
+        size_t              _vertexCount;       // (not including padding)
+        unsigned            _influenceCount;    // (maximum number of joints influencing any vertex)
+
+        size_t  GetPaddedVertexCount() const { return _weights[0].size(); }
+        bool    HasNormals() const { return !_normals[0].empty(); }
+        void    Resize(size_t vertexCount, unsigned influenceCount, bool hasNormals);
+
+        SkinnedVertexStreamsSoA();
+        SkinnedVertexStreamsSoA(SkinnedVertexStreamsSoA&& moveFrom);
+        SkinnedVertexStreamsSoA& operator=(SkinnedVertexStreamsSoA&& moveFrom);
+        ~SkinnedVertexStreamsSoA();
+    };
+
+        /// <summary>Joint transforms in structure-of-arrays form</summary>
+        /// Each of the 12 elements of the 3x4 joint transforms is stored in a separate
+        /// array (row major order). This allows the skinning kernel to gather the
+        /// transforms for 4 vertices with simple loads.
+        /// The palette always has an extra identity joint at the end. Vertices with no
+        /// influences are bound to that joint, so they don't need special handling.
+    class JointPaletteSoA
+    {
+    public:
+        std::vector<float>  _elements[12];
+
+        void Set(IteratorRange<const Float3x4*> jointTransforms);
+        unsigned GetIdentityJoint() const { return unsigned(_elements[0].size()-1); }
+    };
+
+        /// <summary>Linear blend skinning of vertices [begin, end)</summary>
+        /// "begin" and "end" must be multiples of 4 (or "end" must be the padded
+        /// vertex count). Normals are transformed by the rotation part of the joint
+        /// transforms and are not renormalized (matching the GPU skinning shaders).
+        /// "dstNormals" can be null if the source has no normals.
+    void SkinVerticesSoA(
+        float* dstPositions[3], float* dstNormals[3],
+        const SkinnedVertexStreamsSoA& src, const JointPaletteSoA& palette,
+        size_t begin, size_t end);
+
+    /// <summary>Applies skinning to a model on the CPU</summary>
+    /// ModelRenderer::PrepareAnimation performs skinning on the GPU and writes the result
+    /// into a vertex buffer with stream output. That's ideal for rendering, but some systems
+    /// need the skinned vertices on the CPU (eg, ray tests against skinned models, server side
+    /// hit validation or tests that run without a device).
+    ///
+    /// CPUSkinningMachine loads the animated vertex streams and skeleton binding streams for
+    /// every skinned mesh in the model, and converts them into SkinnedVertexStreamsSoA form.
+    /// Skinning is split into chunks of vertices, and those chunks are distributed across
+    /// the short task thread pool.
+    ///
+    /// Usage is similar to ModelRenderer:
+    /// <code>
+    ///     CPUSkinningMachine cpuSkinning(modelScaffold);
+    ///     auto skinnedResult = cpuSkinning.CreateOutput();
+    ///
+    ///     skinPrepareMachine.PrepareAnimation(preparedAnim);
+    ///     cpuSkinning.PrepareAnimation(
+    ///         skinnedResult, preparedAnim._finalMatrices.get(),
+    ///         skinPrepareMachine.GetSkeletonOutputCount(),
+    ///         skinPrepareMachine.GetSkeletonBinding());
+    /// </code>
+    class CPUSkinningMachine
+    {
+    public:
+        class Output
+        {
+        public:
+            class Mesh
+            {
+            public:
+                unsigned            _geoId;
+                size_t              _vertexCount;
+                std::vector<float>  _positions[3];
+                std::vector<float>  _normals[3];    // (empty if the mesh has no animated normals)
+
+                Float3  GetPosition(size_t index) const { return Float3(_positions[0][index], _positions[1][index], _positions[2][index]); }
+                Float3  GetNormal(size_t index) const   { return Float3(_normals[0][index], _normals[1][index], _normals[2][index]); }
+            };
+
+            std::vector<Mesh>   _meshes;
+        };
+
+        Output  CreateOutput() const;
+        void    PrepareAnimation(
+            Output& output,
+            const Float4x4 transformationMachineResult[], size_t transformationMachineResultCount,
+            const SkeletonBinding& skeletonBinding) const;
+
+        CPUSkinningMachine(const ModelScaffold& scaffold, unsigned levelOfDetail = 0);
+        ~CPUSkinningMachine();
+
+        CPUSkinningMachine(const CPUSkinningMachine&) = delete;
+        CPUSkinningMachine& operator=(const CPUSkinningMachine&) = delete;
+    protected:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+
+}}
+
@@ -12,12 +12,15 @@
 #include "../../Assets/CompilerHelper.h"
 #include "../../Assets/InvalidAssetManager.h"
 #include "../../Assets/AssetServices.h"
+#include "../../Assets/ChunkFileAsset.h"
 #include "../../ConsoleRig/AttachableLibrary.h"
 #include "../../Utility/Threading/LockFree.h"
 #include "../../Utility/Threading/ThreadObject.h"
 #include "../../Utility/Streams/PathUtils.h"
 #include "../../Utility/Streams/FileUtils.h"
 #include "../../Utility/StringFormat.h"
+#include <thread>
+#include <algorithm>
 
 #define SUPPORT_OLD_PATH
 
@@ -138,6 +141,7 @@ namespace RenderCore { namespace Assets
             // a metrics file.
 
         {
+            ::Assets::ReleasePrefetchedChunkFile(destinationFilename);     // (a mapping would prevent us from overwriting the file)
             BasicFile outputFile(destinationFilename, "wb");
             BuildChunkFile(outputFile, chunks, versionInfo,
                 [](const ColladaConversion::NascentChunk& c) { return c._hdr._type != ChunkType_Metrics; });
@@ -157,6 +161,7 @@ namespace RenderCore { namespace Assets
         const char destinationFilename[],
         const ConsoleRig::LibVersionDesc& versionInfo)
     {
+        ::Assets::ReleasePrefetchedChunkFile(destinationFilename);     // (a mapping would prevent us from overwriting the file)
         BasicFile outputFile(destinationFilename, "wb");
         for (unsigned i=0; i<(unsigned)chunks->size(); ++i) {
             auto& c = (*chunks)[i];
@@ -172,6 +177,7 @@ namespace RenderCore { namespace Assets
     {
         auto chunks = (model.*fn)();
     
+        ::Assets::ReleasePrefetchedChunkFile(destinationFilename);     // (a mapping would prevent us from overwriting the file)
         BasicFile outputFile(destinationFilename, "wb");
         for (unsigned i=0; i<(unsigned)chunks->size(); ++i) {
             auto& c = (*chunks)[i];
@@ -190,12 +196,38 @@ namespace RenderCore { namespace Assets
             // (create the directory if we need to)
         CreateDirectoryRecursive(MakeFileNameSplitter(destinationFilename).DriveAndPath());
     
+        ::Assets::ReleasePrefetchedChunkFile(destinationFilename);     // (a mapping would prevent us from overwriting the file)
         BasicFile outputFile(destinationFilename, "wb");
         BuildChunkFile(outputFile, chunks, versionInfo,
             [](const ColladaConversion::NascentChunk& c) { return c._hdr._type != ChunkType_Metrics; });
     }
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+    static bool IsWithinDirectory(StringSection<::Assets::ResChar> path, StringSection<::Assets::ResChar> directory)
+    {
+        auto p = SplitPath<::Assets::ResChar>(path).Simplify();
+        auto d = SplitPath<::Assets::ResChar>(directory).Simplify();
+        p.EndsWithSeparator() = d.EndsWithSeparator() = false;
+        auto pString = p.Rebuild(), dString = d.Rebuild();
+        return pString.size() >= dString.size()
+            && std::equal(dString.begin(), dString.end(), pString.begin())
+            && (pString.size() == dString.size() || pString[dString.size()] == s_defaultFilenameRules.GetSeparator<::Assets::ResChar>());
+    }
+
+    static bool MustCompileFirst(const QueuedCompileOperation& first, const QueuedCompileOperation& second)
+    {
+            // Animation sets bind to the skeleton, so any skeletons in the same
+            // directory tree as an animation set should be compiled first.
+            // (the initializer for an animation set is the directory containing the 
+            // animation files)
+        if (first._typeCode != ColladaCompiler::Type_Skeleton || second._typeCode != ColladaCompiler::Type_AnimationSet)
+            return false;
+
+        auto skeletonDir = MakeFileNameSplitter(first._initializer0).DriveAndPath();
+        auto animDir = MakeStringSection(second._initializer0);
+        return IsWithinDirectory(skeletonDir, animDir) || IsWithinDirectory(animDir, skeletonDir);
+    }
+
     void ColladaCompiler::Pimpl::PerformCompile(QueuedCompileOperation& op)
     {
         TRY
@@ -433,13 +465,13 @@ namespace RenderCore { namespace Assets
         auto c = _compiler.lock();
         if (!c) return nullptr;
 
-            // Queue this compilation operation to occur in the background thread.
+            // Queue this compilation operation to occur in the background threads.
             //
             // With the old path,  we couldn't do multiple Collada compilation at the same time. 
-            // So this implementation just spawns a single dedicated threads.
+            // So in that case we just use a single dedicated thread.
             //
-            // However, with the new implementation, we could use one of the global thread pools
-            // and it should be ok to queue up multiple compilations at the same time.
+            // However, with the new implementation, it's ok to do multiple compilations at the
+            // same time. So we'll use one worker per hardware thread.
         auto backgroundOp = std::make_shared<QueuedCompileOperation>();
         backgroundOp->SetInitializer(_requestName.c_str());
         XlCopyString(backgroundOp->_initializer0, _requestName);
@@ -453,13 +485,28 @@ namespace RenderCore { namespace Assets
             ScopedLock(c->_pimpl->_threadLock);
             if (!c->_pimpl->_thread) {
                 auto* p = c->_pimpl.get();
+
+                    // (on failure, the same exception will be thrown again from PerformCompile)
+                TRY { p->AttachLibrary(); } CATCH (...) {} CATCH_END
+
+                unsigned workerCount = 1;
+                if (p->_newPathOk)
+                    workerCount = std::max(1u, std::thread::hardware_concurrency());
+
                 c->_pimpl->_thread = std::make_unique<CompilationThread>(
-                    [p](QueuedCompileOperation& op) { p->PerformCompile(op); });
+                    [p](QueuedCompileOperation& op) { p->PerformCompile(op); },
+                    workerCount, &MustCompileFirst);
             }
         }
-        c->_pimpl->_thread->Push(backgroundOp);
-        
-        return std::move(backgroundOp);
+
+            // Models & material settings are required to render anything, so they 
+            // go first. Animation sets are only needed after the skeleton is ready.
+        auto priority = TaskPriority::Normal;
+        if (_typeCode == Type_Model || _typeCode == Type_RawMat) priority = TaskPriority::High;
+        else if (_typeCode == Type_AnimationSet) priority = TaskPriority::Low;
+
+            // (if an identical compile is already queued, we'll get that back instead)
+        return c->_pimpl->_thread->Push(std::move(backgroundOp), priority);
     }
 
     StringSection<::Assets::ResChar> ColladaCompiler::Marker::Initializer() const
@@ -6,107 +6,328 @@
 
 #include "CompilationThread.h"
 #include "../../ConsoleRig/Log.h"
+#include "../../Utility/Threading/Mutex.h"
+#include "../../Utility/Threading/LockFree.h"
+#include "../../Utility/TimeUtils.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Utility/Streams/PathUtils.h"
+#include <thread>
+#include <vector>
+#include <deque>
+#include <algorithm>
 
-namespace RenderCore { namespace Assets 
+namespace RenderCore { namespace Assets
 {
-    void CompilationThread::StallOnPendingOperations(bool cancelAll)
+    class CompilationThread::Pimpl
+    {
+    public:
+        class Entry
+        {
+        public:
+            std::weak_ptr<QueuedCompileOperation> _op;
+            TaskPriority::Enum _priority;
+            uint64 _queueTime;
+            unsigned _id;       // (unique per push; used to find the entry again, even after _op expires)
+        };
+
+        CompileFn _compileOp;
+        OrderingFn _ordering;
+
+        Threading::Mutex _lock;
+        std::deque<Entry> _queue;           // sorted by priority, and then by push order
+        std::deque<Entry> _delayed;         // operations that are stalled on some other asset
+        std::vector<Entry> _running;
+        bool _workerQuit;
+        bool _cancelAll;
+        unsigned _nextId;
+
+        XlHandle _events[2];
+        std::vector<std::thread> _workers;
+
+        void WorkerFunction();
+        std::shared_ptr<QueuedCompileOperation> TakeNext(Entry& entry, bool& isDelayed);
+        bool IsBlocked(const QueuedCompileOperation& op) const;
+        bool IsDestinationBusy(const QueuedCompileOperation& op) const;
+        void Execute(const Entry& entry, QueuedCompileOperation& op);
+        void Enqueue(const Entry& entry);
+        std::shared_ptr<QueuedCompileOperation> FindDuplicate(const QueuedCompileOperation& op, TaskPriority::Enum priority);
+    };
+
+    static bool IsSameCompile(const QueuedCompileOperation& lhs, const QueuedCompileOperation& rhs)
+    {
+        return lhs._typeCode == rhs._typeCode
+            && lhs._destinationStore == rhs._destinationStore
+            && XlEqString(lhs._initializer0, rhs._initializer0)
+            && XlEqString(lhs._initializer1, rhs._initializer1);
+    }
+
+    static bool IsSameDestination(const QueuedCompileOperation& lhs, const QueuedCompileOperation& rhs)
     {
-        if (!_workerQuit) {
-            _workerQuit = true;
-            XlSetEvent(_events[1]);   // trigger a manual reset event should wake all threads (and keep them awake)
-            _thread.join();
+            //  The locator name can have parameters that aren't part of the filename
+            //  (eg, the material name for a rawmat compile). Compiles for different
+            //  parameters still write to the same file.
+        if (lhs._destinationStore != rhs._destinationStore) return false;
+        auto lhsFile = MakeFileNameSplitter(lhs.GetLocator()._sourceID0).AllExceptParameters();
+        auto rhsFile = MakeFileNameSplitter(rhs.GetLocator()._sourceID0).AllExceptParameters();
+        return !lhsFile.Empty() && XlEqString(lhsFile, rhsFile);
+    }
+
+    void CompilationThread::Pimpl::Enqueue(const Entry& entry)
+    {
+            // insert after all entries of the same or higher priority
+        auto i = std::find_if(_queue.begin(), _queue.end(),
+            [&entry](const Entry& e) { return e._priority > entry._priority; });
+        _queue.insert(i, entry);
+    }
+
+    std::shared_ptr<QueuedCompileOperation> CompilationThread::Pimpl::FindDuplicate(
+        const QueuedCompileOperation& op, TaskPriority::Enum priority)
+    {
+        for (auto i=_queue.begin(); i!=_queue.end(); ++i) {
+            auto o = i->_op.lock();
+            if (o && IsSameCompile(*o, op)) {
+                if (priority < i->_priority) {
+                    auto e = *i;
+                    e._priority = priority;
+                    _queue.erase(i);
+                    Enqueue(e);
+                }
+                return o;
+            }
+        }
+
+        for (const auto& e:_running) {
+            auto o = e._op.lock();
+            if (o && IsSameCompile(*o, op)) return o;
         }
+
+        for (const auto& e:_delayed) {
+            auto o = e._op.lock();
+            if (o && IsSameCompile(*o, op)) return o;
+        }
+
+        return nullptr;
+    }
+
+    bool CompilationThread::Pimpl::IsDestinationBusy(const QueuedCompileOperation& op) const
+    {
+        return std::any_of(_running.begin(), _running.end(),
+            [&op](const Entry& e)
+            {
+                auto o = e._op.lock();
+                return o && o.get() != &op && IsSameDestination(*o, op);
+            });
     }
-    
-    void CompilationThread::Push(std::shared_ptr<QueuedCompileOperation> op)
+
+    bool CompilationThread::Pimpl::IsBlocked(const QueuedCompileOperation& op) const
     {
-        if (!_workerQuit) {
-            _queue.push_overflow(std::move(op));
-            XlSetEvent(_events[0]);
+        if (IsDestinationBusy(op)) return true;
+        if (!_ordering) return false;
+
+        auto mustComeFirst =
+            [this, &op](const Entry& e)
+            {
+                auto o = e._op.lock();
+                return o && o.get() != &op && _ordering(*o, op);
+            };
+        return std::any_of(_running.begin(), _running.end(), mustComeFirst)
+            || std::any_of(_queue.begin(), _queue.end(), mustComeFirst)
+            || std::any_of(_delayed.begin(), _delayed.end(), mustComeFirst);
+    }
+
+    std::shared_ptr<QueuedCompileOperation> CompilationThread::Pimpl::TakeNext(Entry& entry, bool& isDelayed)
+    {
+            // (the caller must lock _lock)
+        for (auto i=_queue.begin(); i!=_queue.end();) {
+            auto o = i->_op.lock();
+            if (!o) { i = _queue.erase(i); continue; }     // (no one is waiting on this anymore)
+            if (!IsBlocked(*o)) {
+                entry = *i;
+                isDelayed = false;
+                _queue.erase(i);
+                return o;
+            }
+            ++i;
+        }
+
+            // Delayed operations get retried only when there is nothing else to
+            // do (new requests are processed first)
+        for (auto i=_delayed.begin(); i!=_delayed.end();) {
+            auto o = i->_op.lock();
+            if (!o) { i = _delayed.erase(i); continue; }
+            if (!IsDestinationBusy(*o)) {
+                entry = *i;
+                isDelayed = true;
+                _delayed.erase(i);
+                return o;
+            }
+            ++i;
         }
+
+            // If everything is blocked, but nothing is running, the ordering function
+            // must be inconsistent. Just start the first one, so we can't deadlock.
+        if (_running.empty() && !_queue.empty()) {
+            LogWarning << "Compile ordering could not be satisfied. Starting compile operations out of order";
+            entry = _queue.front();
+            _queue.pop_front();
+            isDelayed = false;
+            return entry._op.lock();
+        }
+
+        return nullptr;
     }
 
-    void CompilationThread::ThreadFunction()
+    void CompilationThread::Pimpl::Execute(const Entry& entry, QueuedCompileOperation& op)
     {
-        while (!_workerQuit) {
-            std::weak_ptr<QueuedCompileOperation>* op;
-            if (_queue.try_front(op)) {
-                auto o = op->lock();
-                TRY
-                {
-                    if (o) _compileOp(*o);
-                    _queue.pop();
-                }
-                CATCH (const ::Assets::Exceptions::PendingAsset&)
-                {
-                    // We need to stall on a pending asset while compiling
-                    // All we can do is delay the request, and try again later.
-                    // Let's move the request into a separate queue, so that
-                    // new request get processed first.
-                    _queue.pop();
-                    _delayedQueue.push(o);
-                }
-                CATCH (const std::exception& e)
-                {
-                    LogWarning << "Got exception while in asset compilation thread" << std::endl;
-                    LogWarning << "Asset: " << o->Initializer() << std::endl;
-                    LogWarning << "    " << e.what() << std::endl;
-                    _queue.pop();
-                }
-                CATCH_END
-            } else if (_delayedQueue.try_front(op)) {
-                
-                    // do a short sleep first, do avoid too much
-                    // trashing while processing delayed items. Note
-                    // that if any new request comes in during this Sleep,
-                    // then we won't handle that request in a prompt manner.
-                Sleep(1);
-                auto o = op->lock();
-                TRY
-                {
-                    if (o) _compileOp(*o);
-                    _delayedQueue.pop();
-                }
-                CATCH (const ::Assets::Exceptions::PendingAsset&)
-                {
-                    // We need to stall on a pending asset while compiling
-                    // All we can do is delay the request, and try again later.
-                    // Let's move the request into a separate queue, so that
-                    // new request get processed first.
-                    _delayedQueue.pop();
-                    _delayedQueue.push(o);
-                }
-                CATCH (const std::exception& e)
-                {
-                    LogWarning << "Got exception while in asset compilation thread" << std::endl;
-                    LogWarning << "Asset: " << o->Initializer() << std::endl;
-                    LogWarning << "    " << e.what() << std::endl;
-                    _delayedQueue.pop();
+        auto startTime = GetPerformanceCounter();
+        bool stalled = false;
+
+        TRY
+        {
+            _compileOp(op);
+        }
+        CATCH (const ::Assets::Exceptions::PendingAsset&)
+        {
+                // We need to stall on a pending asset while compiling
+                // All we can do is delay the request, and try again later.
+                // We'll move the request into a separate queue, so that
+                // new request get processed first.
+            stalled = true;
+        }
+        CATCH (const std::exception& e)
+        {
+            LogWarning << "Got exception while in asset compilation thread" << std::endl;
+            LogWarning << "Asset: " << op.Initializer() << std::endl;
+            LogWarning << "    " << e.what() << std::endl;
+        }
+        CATCH_END
+
+        auto endTime = GetPerformanceCounter();
+
+        {
+            ScopedLock(_lock);
+            auto id = entry._id;
+            auto i = std::find_if(_running.begin(), _running.end(),
+                [id](const Entry& e) { return e._id == id; });
+            if (i != _running.end()) _running.erase(i);
+            if (stalled && !_workerQuit) _delayed.push_back(entry);
+        }
+
+            // (finishing an operation might unblock some of the queued operations)
+        XlSetEvent(_events[0]);
+
+        if (!stalled) {
+            auto freq = float(GetPerformanceCounterFrequency());
+            LogInfo
+                << "Compile for (" << op.Initializer() << ") took "
+                << unsigned(1000.f * float(endTime - startTime) / freq) << "ms (queued for "
+                << unsigned(1000.f * float(startTime - entry._queueTime) / freq) << "ms)";
+        }
+    }
+
+    void CompilationThread::Pimpl::WorkerFunction()
+    {
+        for (;;) {
+            Entry entry;
+            bool isDelayed = false;
+            std::shared_ptr<QueuedCompileOperation> op;
+            bool moreWork = false;
+
+            {
+                ScopedLock(_lock);
+                if (_workerQuit && _cancelAll) break;
+
+                op = TakeNext(entry, isDelayed);
+                if (op) {
+                    _running.push_back(entry);
+                    moreWork = !_queue.empty();
+                } else if (_workerQuit) {
+                    break;
                 }
-                CATCH_END
-            } else {
+            }
+
+            if (!op) {
                 XlWaitForMultipleSyncObjects(
-                    2, this->_events,
+                    2, _events,
                     false, XL_INFINITE, true);
+                continue;
             }
+
+                // "_events[0]" only wakes a single worker. If there's more in the
+                // queue, pass it on to the next one
+            if (moreWork)
+                XlSetEvent(_events[0]);
+
+                // do a short sleep first, do avoid too much
+                // trashing while processing delayed items.
+            if (isDelayed)
+                Sleep(1);
+
+            Execute(entry, *op);
         }
     }
 
-    CompilationThread::CompilationThread(std::function<void(QueuedCompileOperation&)> compileOp)
-    : _compileOp(std::move(compileOp))
+    void CompilationThread::StallOnPendingOperations(bool cancelAll)
+    {
+        {
+            ScopedLock(_pimpl->_lock);
+            if (_pimpl->_workerQuit) return;
+            _pimpl->_workerQuit = true;
+            _pimpl->_cancelAll = cancelAll;
+            if (cancelAll) _pimpl->_queue.clear();
+            _pimpl->_delayed.clear();
+        }
+
+        XlSetEvent(_pimpl->_events[1]);   // trigger a manual reset event should wake all threads (and keep them awake)
+        for (auto& t:_pimpl->_workers) t.join();
+        _pimpl->_workers.clear();
+    }
+
+    std::shared_ptr<QueuedCompileOperation> CompilationThread::Push(
+        std::shared_ptr<QueuedCompileOperation> op,
+        TaskPriority::Enum priority)
+    {
+        {
+            ScopedLock(_pimpl->_lock);
+            if (_pimpl->_workerQuit) return op;
+
+            auto existing = _pimpl->FindDuplicate(*op, priority);
+            if (existing) return existing;
+
+            Pimpl::Entry entry;
+            entry._op = op;
+            entry._priority = priority;
+            entry._queueTime = GetPerformanceCounter();
+            entry._id = _pimpl->_nextId++;
+            _pimpl->Enqueue(entry);
+        }
+
+        XlSetEvent(_pimpl->_events[0]);
+        return op;
+    }
+
+    CompilationThread::CompilationThread(CompileFn compileOp, unsigned workerCount, OrderingFn ordering)
     {
-        _events[0] = XlCreateEvent(false);
-        _events[1] = XlCreateEvent(true);
-        _workerQuit = false;
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_compileOp = std::move(compileOp);
+        _pimpl->_ordering = std::move(ordering);
+        _pimpl->_events[0] = XlCreateEvent(false);
+        _pimpl->_events[1] = XlCreateEvent(true);
+        _pimpl->_workerQuit = false;
+        _pimpl->_cancelAll = false;
+        _pimpl->_nextId = 0;
 
-        _thread = std::thread(std::bind(&CompilationThread::ThreadFunction, this));
+        if (!workerCount) workerCount = 1;
+        auto* p = _pimpl.get();
+        for (unsigned c=0; c<workerCount; ++c)
+            _pimpl->_workers.emplace_back(std::thread([p]() { p->WorkerFunction(); }));
     }
 
     CompilationThread::~CompilationThread()
     {
         StallOnPendingOperations(true);
-        XlCloseSyncObject(_events[0]);
-        XlCloseSyncObject(_events[1]);
+        XlCloseSyncObject(_pimpl->_events[0]);
+        XlCloseSyncObject(_pimpl->_events[1]);
     }
 
 }}
@@ -8,9 +8,8 @@
 
 #include "../../Assets/AssetsCore.h"
 #include "../../Assets/IntermediateAssets.h"
-#include "../../Utility/Threading/LockFree.h"
+#include "../../Utility/Threading/TaskScheduler.h"      // (for TaskPriority)
 #include <memory>
-#include <thread>
 #include <functional>
 
 namespace RenderCore { namespace Assets 
@@ -26,24 +25,54 @@ namespace RenderCore { namespace Assets
     };
 
     /// <summary>Used by the compiler types to manage background operations</summary>
+    /// Operations are executed by a small set of dedicated worker threads. Compiles can
+    /// take a long time and sometimes stall on other assets, so we avoid using the global
+    /// thread pools for these.
+    ///
+    /// Higher priority operations are always started first. Within a priority, operations
+    /// are started in the order they were pushed.
+    ///
+    /// Pushing an operation that is identical to one that is already queued or running
+    /// (same type code, initializers and destination store) won't queue a second compile.
+    /// Instead, Push() will return the existing operation (and raise its priority, if
+    /// necessary).
+    ///
+    /// The "ordering" function can be used to keep dependent compiles in the right order.
+    /// An operation won't be started while there is another queued or running operation
+    /// that ordering(other, op) says must come first. (eg, a skeleton should be compiled
+    /// before the animation sets that bind to it).
+    ///
+    /// Operations that write to the same intermediate file (same destination store and
+    /// locator filename, ignoring any parameters on the locator name) are never run at
+    /// the same time, even if their initializers are different.
+    ///
+    /// If the compile function throws ::Assets::Exceptions::PendingAsset, the operation
+    /// will be retried later, after new requests have been processed.
     class CompilationThread
     {
     public:
-        void Push(std::shared_ptr<QueuedCompileOperation> op);
+        using CompileFn = std::function<void(QueuedCompileOperation&)>;
+        using OrderingFn = std::function<bool(const QueuedCompileOperation& first, const QueuedCompileOperation& second)>;
+
+        std::shared_ptr<QueuedCompileOperation> Push(
+            std::shared_ptr<QueuedCompileOperation> op,
+            TaskPriority::Enum priority = TaskPriority::Normal);
+
+            /// <summary>Shut down the worker threads</summary>
+            /// Operations that are already running are always completed. With "cancelAll"
+            /// operations that haven't been started yet are abandoned; otherwise the queue 
+            /// is completed first. Operations delayed waiting on other assets are always 
+            /// abandoned. No new operations are accepted afterwards.
         void StallOnPendingOperations(bool cancelAll);
 
-        CompilationThread(std::function<void(QueuedCompileOperation&)> compileOp);
+        CompilationThread(CompileFn compileOp, unsigned workerCount = 1, OrderingFn ordering = nullptr);
         ~CompilationThread();
+
+        CompilationThread(const CompilationThread&) = delete;
+        CompilationThread& operator=(const CompilationThread&) = delete;
     protected:
-        std::thread _thread;
-        XlHandle _events[2];
-        volatile bool _workerQuit;
-        using Queue = LockFree::FixedSizeQueue<std::weak_ptr<QueuedCompileOperation>, 256>;
-        Queue _queue;
-        Queue _delayedQueue;
-        std::function<void(QueuedCompileOperation&)> _compileOp;
-
-        void ThreadFunction();
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
     };
 }}
 
@@ -16,7 +16,7 @@
 #include "../../Assets/CompileAndAsyncManager.h"
 #include "../../Utility/Streams/PathUtils.h"
 #include "../../Utility/Streams/FileUtils.h"
-#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/Threading/TaskScheduler.h"
 #include "../../Foreign/tinyxml2-master/tinyxml2.h"
 
 #include "../../Core/WinAPI/IncludeWindows.h"
@@ -19,7 +19,7 @@
 #include "../../../ConsoleRig/GlobalServices.h"
 #include "../../../Utility/Streams/PathUtils.h"
 #include "../../../Utility/Streams/FileUtils.h"
-#include "../../../Utility/Threading/CompletionThreadPool.h"
+#include "../../../Utility/Threading/TaskScheduler.h"
 #include "../../../Utility/StringFormat.h"
 
 #include <functional>
@@ -615,6 +615,14 @@ namespace RenderCore { namespace Assets
         if (!initializers[0] || initializers[0][0] == '\0' || XlEqString(shaderId._filename, "null"))
             return nullptr;
 
+        if (_recordRequests) {
+            auto hash = HashCombine(Hash64(initializers[0]), Hash64(definesTable));
+            ScopedLock(_recordedRequestsLock);
+            auto i = LowerBound(_recordedRequests, hash);
+            if (i == _recordedRequests.end() || i->first != hash)
+                _recordedRequests.insert(i, std::make_pair(hash, std::make_pair(::Assets::rstring(initializers[0]), ::Assets::rstring(definesTable))));
+        }
+
         return std::make_shared<Marker>(initializers[0], shaderId, definesTable, destinationStore, shared_from_this());
     }
 
@@ -649,8 +657,24 @@ namespace RenderCore { namespace Assets
         }
     }
 
+    void LocalCompiledShaderSource::SetRequestRecording(bool enable)
+    {
+        _recordRequests = enable;
+    }
+
+    auto LocalCompiledShaderSource::GetRecordedRequests() const -> std::vector<RecordedRequest>
+    {
+        ScopedLock(_recordedRequestsLock);
+        std::vector<RecordedRequest> result;
+        result.reserve(_recordedRequests.size());
+        for (const auto& r:_recordedRequests)
+            result.push_back(r.second);
+        return std::move(result);
+    }
+
     LocalCompiledShaderSource::LocalCompiledShaderSource(std::shared_ptr<ShaderService::ILowLevelCompiler> compiler)
     : _compiler(std::move(compiler))
+    , _recordRequests(false)
     {
         CancelAllShaderCompiles = false;
         _shaderCacheSet = std::make_unique<ShaderCacheSet>();
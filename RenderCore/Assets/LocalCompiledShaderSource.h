@@ -41,6 +41,13 @@ namespace RenderCore { namespace Assets
 
         ShaderCacheSet& GetCacheSet() { return *_shaderCacheSet; }
 
+            /// <summary>Record every shader requested from this source</summary>
+            /// The recorded list can be saved and replayed with the ShaderPrecompiler, so
+            /// the shader archives are warm for the next run.
+        using RecordedRequest = std::pair<::Assets::rstring, ::Assets::rstring>;    // (initializer, defines table)
+        void SetRequestRecording(bool enable);
+        std::vector<RecordedRequest> GetRecordedRequests() const;
+
         LocalCompiledShaderSource(std::shared_ptr<ShaderService::ILowLevelCompiler> compiler);
         ~LocalCompiledShaderSource();
     protected:
@@ -50,6 +57,10 @@ namespace RenderCore { namespace Assets
         Threading::Mutex _activeCompileOperationsLock;
         std::shared_ptr<ShaderService::ILowLevelCompiler> _compiler;
 
+        bool _recordRequests;
+        std::vector<std::pair<uint64, RecordedRequest>> _recordedRequests;
+        mutable Threading::Mutex _recordedRequestsLock;
+
         class Marker;
     };
 }}
@@ -287,9 +287,8 @@ namespace RenderCore { namespace Assets
 				c->_pimpl->_thread = std::make_unique<CompilationThread>(
 					[](QueuedCompileOperation& op) { DoCompileMaterialScaffold(op); });
 		}
-		c->_pimpl->_thread->Push(backgroundOp);
-
-        return std::move(backgroundOp);
+            // (if an identical compile is already queued, we'll get that back instead)
+        return c->_pimpl->_thread->Push(std::move(backgroundOp));
     }
 
     StringSection<::Assets::ResChar> MatCompilerMarker::Initializer() const
@@ -122,6 +122,10 @@ namespace RenderCore { namespace Assets
 
             result._material = _pimpl->_materialScaffolds.Get(result._hashedMaterialName).get();
             if (!result._material || result._material->GetDependencyValidation()->GetValidationIndex() > 0) {
+                    //  The renderer will probably be built soon after the material is ready, so
+                    //  start reading the large blocks while the material compiles
+                result._model->PrefetchLargeBlocks();
+
                 auto mat = Internal::CreateMaterialScaffold(modelFilename, matNamePtr, *_pimpl->_format);
                 auto insertType = _pimpl->_materialScaffolds.Insert(result._hashedMaterialName, mat);
                 if (result._material || insertType == LRUCacheInsertType::EvictAndReplace) ++_pimpl->_reloadId;
@@ -0,0 +1,732 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ModelIntersection.h"
+#include "AssetUtils.h"
+#include "../../Assets/AssetsCore.h"
+#include "../../Math/ProjectionMath.h"
+#include "../../Math/Transformations.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Core/Exceptions.h"
+#include <xmmintrin.h>
+#include <algorithm>
+
+namespace RenderCore { namespace Assets
+{
+    namespace ModelIntersectionInternal
+    {
+            //  The chunk is a flat block of memory, with the following layout:
+            //      Header
+            //      Node[_nodeCount]
+            //      Packet[_packetCount]
+            //      TriangleDesc[_packetCount*4]
+            //
+            //  Each leaf node references a contiguous range of packets, and each
+            //  packet holds 4 triangles (padded with degenerate triangles, which
+            //  can never be hit by a ray). All of the structures are a multiple of
+            //  16 bytes, so the packets are aligned if the block is aligned.
+        class Header
+        {
+        public:
+            unsigned    _nodeCount;
+            unsigned    _packetCount;
+            unsigned    _triangleCount;
+            unsigned    _dummy;
+            float       _mins[3];
+            unsigned    _dummy1;
+            float       _maxs[3];
+            unsigned    _dummy2;
+        };
+
+        class Node
+        {
+        public:
+            float       _mins[3];
+            unsigned    _first;         // first packet (for leaves) or first child (for internal nodes)
+            float       _maxs[3];
+            unsigned    _packetCount;   // zero for internal nodes (children are _first and _first+1)
+        };
+
+        class Packet
+        {
+        public:
+            float       _v0[3][4];
+            float       _e1[3][4];
+            float       _e2[3][4];
+        };
+
+        class TriangleDesc
+        {
+        public:
+            float       _pts[3][3];
+            unsigned    _drawCallIndex;
+            uint64      _materialGuid;
+        };
+
+        static const unsigned PacketWidth = 4;
+        static const unsigned MaxStackDepth = 64;
+        static const unsigned InvalidDrawCall = ~0u;
+
+        class View
+        {
+        public:
+            const Header*       _header;
+            const Node*         _nodes;
+            const Packet*       _packets;
+            const TriangleDesc* _triangles;
+
+            View(const void* block)
+            {
+                _header = (const Header*)block;
+                _nodes = (const Node*)PtrAdd(block, sizeof(Header));
+                _packets = (const Packet*)PtrAdd(_nodes, sizeof(Node) * _header->_nodeCount);
+                _triangles = (const TriangleDesc*)PtrAdd(_packets, sizeof(Packet) * _header->_packetCount);
+            }
+        };
+
+        static size_t CalculateBlockSize(unsigned nodeCount, unsigned packetCount)
+        {
+            return sizeof(Header) + sizeof(Node) * nodeCount
+                + (sizeof(Packet) + sizeof(TriangleDesc) * PacketWidth) * packetCount;
+        }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        class BuildTriangle
+        {
+        public:
+            Float3      _mins, _maxs;
+            Float3      _centroid;
+            unsigned    _index;
+        };
+
+        class Bounds
+        {
+        public:
+            Float3 _mins, _maxs;
+
+            void Add(const Float3& mins, const Float3& maxs)
+            {
+                for (unsigned c=0; c<3; ++c) {
+                    _mins[c] = std::min(_mins[c], mins[c]);
+                    _maxs[c] = std::max(_maxs[c], maxs[c]);
+                }
+            }
+
+            float SurfaceArea() const
+            {
+                if (_mins[0] > _maxs[0]) return 0.f;
+                auto d = _maxs - _mins;
+                return 2.f * (d[0]*d[1] + d[1]*d[2] + d[2]*d[0]);
+            }
+
+            Bounds()
+            : _mins( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max(),  std::numeric_limits<float>::max())
+            , _maxs(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()) {}
+        };
+
+        class Builder
+        {
+        public:
+            std::vector<Node>           _nodes;
+            std::vector<Packet>         _packets;
+            std::vector<TriangleDesc>   _triangleDescs;
+
+            void Build(IteratorRange<const ModelIntersectionTriangle*> triangles);
+
+        private:
+            std::vector<BuildTriangle>  _working;
+            IteratorRange<const ModelIntersectionTriangle*> _input;
+
+            unsigned FindSplit(unsigned begin, unsigned end, const Bounds& centroidBounds);
+            void WriteLeaf(Node& node, unsigned begin, unsigned end);
+        };
+
+        static unsigned PacketCount(unsigned triangleCount) { return (triangleCount + PacketWidth - 1) / PacketWidth; }
+
+        unsigned Builder::FindSplit(unsigned begin, unsigned end, const Bounds& centroidBounds)
+        {
+                //  Binned surface area heuristic. We bin the triangles by centroid along
+                //  each axis, and evaluate the cost of splitting between each bin. Since
+                //  the leaves are tested a packet at a time, the cost of a leaf is the
+                //  number of packets, not the number of triangles.
+            const unsigned binCount = 16;
+            float bestCost = std::numeric_limits<float>::max();
+            unsigned bestAxis = ~0u, bestBin = 0;
+
+            for (unsigned axis=0; axis<3; ++axis) {
+                float extent = centroidBounds._maxs[axis] - centroidBounds._mins[axis];
+                if (extent <= 0.f) continue;
+                float binScale = float(binCount) / extent;
+
+                Bounds binBounds[binCount];
+                unsigned binTriCount[binCount];
+                std::fill(binTriCount, &binTriCount[binCount], 0u);
+                for (unsigned c=begin; c<end; ++c) {
+                    const auto& t = _working[c];
+                    auto b = std::min(unsigned((t._centroid[axis] - centroidBounds._mins[axis]) * binScale), binCount-1);
+                    binBounds[b].Add(t._mins, t._maxs);
+                    ++binTriCount[b];
+                }
+
+                    // sweep from the right to calculate the cost of the right hand side of each split
+                float rightCost[binCount];
+                {
+                    Bounds accumulated; unsigned count = 0;
+                    for (unsigned b=binCount-1; b>0; --b) {
+                        accumulated.Add(binBounds[b]._mins, binBounds[b]._maxs);
+                        count += binTriCount[b];
+                        rightCost[b] = accumulated.SurfaceArea() * float(PacketCount(count));
+                    }
+                }
+
+                Bounds accumulated; unsigned count = 0;
+                for (unsigned b=0; b<binCount-1; ++b) {
+                    accumulated.Add(binBounds[b]._mins, binBounds[b]._maxs);
+                    count += binTriCount[b];
+                    if (!count || count == (end-begin)) continue;
+                    float cost = accumulated.SurfaceArea() * float(PacketCount(count)) + rightCost[b+1];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b;
+                    }
+                }
+            }
+
+            if (bestAxis == ~0u) {
+                    // All centroids are in the same place (or the binning couldn't separate
+                    // them). Just split the list in half.
+                return begin + (end-begin)/2;
+            }
+
+            float binScale = float(binCount) / (centroidBounds._maxs[bestAxis] - centroidBounds._mins[bestAxis]);
+            auto minCentroid = centroidBounds._mins[bestAxis];
+            auto i = std::partition(
+                _working.begin() + begin, _working.begin() + end,
+                [=](const BuildTriangle& t)
+                {
+                    auto b = std::min(unsigned((t._centroid[bestAxis] - minCentroid) * binScale), binCount-1);
+                    return b <= bestBin;
+                });
+            auto result = unsigned(std::distance(_working.begin(), i));
+            if (result == begin || result == end)
+                result = begin + (end-begin)/2;
+            return result;
+        }
+
+        void Builder::WriteLeaf(Node& node, unsigned begin, unsigned end)
+        {
+            node._first = unsigned(_packets.size());
+            node._packetCount = PacketCount(end-begin);
+
+            for (unsigned p=0; p<node._packetCount; ++p) {
+                Packet packet;
+                XlZeroMemory(packet);
+                for (unsigned lane=0; lane<PacketWidth; ++lane) {
+                    TriangleDesc desc;
+                    XlZeroMemory(desc);
+                    desc._drawCallIndex = InvalidDrawCall;
+
+                    unsigned t = begin + p*PacketWidth + lane;
+                    if (t < end) {
+                        const auto& tri = _input[_working[t]._index];
+                        for (unsigned c=0; c<3; ++c) {
+                            packet._v0[c][lane] = tri._pts[0][c];
+                            packet._e1[c][lane] = tri._pts[1][c] - tri._pts[0][c];
+                            packet._e2[c][lane] = tri._pts[2][c] - tri._pts[0][c];
+                            for (unsigned q=0; q<3; ++q)
+                                desc._pts[q][c] = tri._pts[q][c];
+                        }
+                        desc._drawCallIndex = tri._drawCallIndex;
+                        desc._materialGuid = tri._materialGuid;
+                    }
+                    _triangleDescs.push_back(desc);
+                }
+                _packets.push_back(packet);
+            }
+        }
+
+        void Builder::Build(IteratorRange<const ModelIntersectionTriangle*> triangles)
+        {
+            _input = triangles;
+            _working.clear();
+            _working.reserve(triangles.size());
+            for (unsigned c=0; c<unsigned(triangles.size()); ++c) {
+                const auto& t = triangles[c];
+                BuildTriangle b;
+                for (unsigned q=0; q<3; ++q) {
+                    b._mins[q] = std::min(std::min(t._pts[0][q], t._pts[1][q]), t._pts[2][q]);
+                    b._maxs[q] = std::max(std::max(t._pts[0][q], t._pts[1][q]), t._pts[2][q]);
+                }
+                b._centroid = .5f * (b._mins + b._maxs);
+                b._index = c;
+                _working.push_back(b);
+            }
+
+            _nodes.clear(); _packets.clear(); _triangleDescs.clear();
+            if (_working.empty()) return;
+
+            _nodes.reserve(2 * PacketCount(unsigned(_working.size())));
+            _nodes.push_back(Node());
+
+            class PendingNode { public: unsigned _node, _begin, _end, _depth; };
+            std::vector<PendingNode> stack;
+            stack.push_back(PendingNode{0, 0, unsigned(_working.size()), 0});
+            while (!stack.empty()) {
+                auto pending = stack.back();
+                stack.pop_back();
+
+                Bounds bounds, centroidBounds;
+                for (unsigned c=pending._begin; c<pending._end; ++c) {
+                    bounds.Add(_working[c]._mins, _working[c]._maxs);
+                    centroidBounds.Add(_working[c]._centroid, _working[c]._centroid);
+                }
+
+                auto& node = _nodes[pending._node];
+                for (unsigned c=0; c<3; ++c) {
+                    node._mins[c] = bounds._mins[c];
+                    node._maxs[c] = bounds._maxs[c];
+                }
+
+                    // The runtime queries use a fixed size stack, so we must limit the depth
+                    // of the tree. Very unbalanced splits could otherwise exceed it; in those
+                    // cases we just accept a leaf with more than one packet.
+                if ((pending._end - pending._begin) <= PacketWidth || (pending._depth+2) >= MaxStackDepth) {
+                    WriteLeaf(node, pending._begin, pending._end);
+                    continue;
+                }
+
+                auto split = FindSplit(pending._begin, pending._end, centroidBounds);
+                auto firstChild = unsigned(_nodes.size());
+                node._first = firstChild;
+                node._packetCount = 0;
+                    // (note that "node" is invalidated here)
+                _nodes.push_back(Node());
+                _nodes.push_back(Node());
+                stack.push_back(PendingNode{firstChild+1, split, pending._end, pending._depth+1});
+                stack.push_back(PendingNode{firstChild, pending._begin, split, pending._depth+1});
+            }
+        }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        class Ray
+        {
+        public:
+            float _origin[3], _dir[3], _invDir[3];
+            float _minT, _maxT;
+
+            Ray(const Float3& start, const Float3& end)
+            {
+                auto dir = end - start;
+                for (unsigned c=0; c<3; ++c) {
+                    _origin[c] = start[c];
+                    _dir[c] = dir[c];
+                    _invDir[c] = 1.f / dir[c];
+                }
+                    // Similar to the GPU test, we reject intersections very close to the
+                    // ray start.
+                _minT = 1e-5f / std::max(Magnitude(dir), 1e-5f);
+                _maxT = 1.f;
+            }
+        };
+
+        static bool RayVsNode(const Ray& ray, const Node& node, float maxT, float& entryT)
+        {
+            float tmin = 0.f, tmax = maxT;
+            for (unsigned c=0; c<3; ++c) {
+                float t0 = (node._mins[c] - ray._origin[c]) * ray._invDir[c];
+                float t1 = (node._maxs[c] - ray._origin[c]) * ray._invDir[c];
+                if (t0 > t1) std::swap(t0, t1);
+                    // (written so that NaNs, from a zero direction component with the origin
+                    // on the box boundary, don't cull the node)
+                tmin = (t0 > tmin) ? t0 : tmin;
+                tmax = (t1 < tmax) ? t1 : tmax;
+            }
+            entryT = tmin;
+            return tmin <= tmax;
+        }
+
+            //  Test a ray against the 4 triangles in a packet at once. Returns a mask with a
+            //  bit set for each lane that has an intersection (within the ray limits), and
+            //  writes the ray parameter and barycentric coordinates for all lanes.
+        static unsigned RayVsPacket(
+            const Ray& ray, const Packet& packet, float maxT,
+            float t[4], float u[4], float v[4])
+        {
+            __m128 v0x = _mm_loadu_ps(packet._v0[0]), v0y = _mm_loadu_ps(packet._v0[1]), v0z = _mm_loadu_ps(packet._v0[2]);
+            __m128 e1x = _mm_loadu_ps(packet._e1[0]), e1y = _mm_loadu_ps(packet._e1[1]), e1z = _mm_loadu_ps(packet._e1[2]);
+            __m128 e2x = _mm_loadu_ps(packet._e2[0]), e2y = _mm_loadu_ps(packet._e2[1]), e2z = _mm_loadu_ps(packet._e2[2]);
+
+            __m128 dx = _mm_set1_ps(ray._dir[0]), dy = _mm_set1_ps(ray._dir[1]), dz = _mm_set1_ps(ray._dir[2]);
+
+                // h = cross(d, e2); a = dot(e1, h)
+            __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+
+                // Like the GPU test, we only reject exactly zero determinants (ie, degenerate
+                // triangles and rays parallel to the triangle). The padding triangles in
+                // each packet are always rejected here.
+            __m128 zero = _mm_setzero_ps();
+            __m128 mask = _mm_cmpneq_ps(a, zero);
+            __m128 f = _mm_div_ps(_mm_set1_ps(1.f), a);
+
+                // s = origin - v0; u = f * dot(s, h)
+            __m128 sx = _mm_sub_ps(_mm_set1_ps(ray._origin[0]), v0x);
+            __m128 sy = _mm_sub_ps(_mm_set1_ps(ray._origin[1]), v0y);
+            __m128 sz = _mm_sub_ps(_mm_set1_ps(ray._origin[2]), v0z);
+            __m128 uu = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+                // q = cross(s, e1); v = f * dot(d, q); t = f * dot(e2, q)
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            __m128 vv = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+            __m128 tt = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.f)));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(tt, _mm_set1_ps(ray._minT)));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(tt, _mm_set1_ps(maxT)));
+
+            _mm_storeu_ps(t, tt);
+            _mm_storeu_ps(u, uu);
+            _mm_storeu_ps(v, vv);
+            return unsigned(_mm_movemask_ps(mask));
+        }
+
+        static ModelIntersectionHit MakeHit(const TriangleDesc& desc, float t, float u, float v)
+        {
+            ModelIntersectionHit hit;
+            hit._distance = t;
+            hit._barycentric = Float3(1.f - u - v, u, v);
+            for (unsigned q=0; q<3; ++q)
+                hit._pts[q] = Float3(desc._pts[q][0], desc._pts[q][1], desc._pts[q][2]);
+            hit._drawCallIndex = desc._drawCallIndex;
+            hit._materialGuid = desc._materialGuid;
+            return hit;
+        }
+
+        static bool TriangleInFrustum(const Float4x4& modelToProjection, const TriangleDesc& desc)
+        {
+                //  All points must be rejected by the same frustum plane for the triangle
+                //  to be rejected. This matches the test in the "raytest.gsh" geometry shader
+                //  (it's conservative for large triangles that straddle a frustum corner)
+            Float4 p[3];
+            for (unsigned q=0; q<3; ++q)
+                p[q] = modelToProjection * Float4(desc._pts[q][0], desc._pts[q][1], desc._pts[q][2], 1.f);
+
+            if (p[0][0] < -p[0][3] && p[1][0] < -p[1][3] && p[2][0] < -p[2][3]) return false;
+            if (p[0][0] >  p[0][3] && p[1][0] >  p[1][3] && p[2][0] >  p[2][3]) return false;
+            if (p[0][1] < -p[0][3] && p[1][1] < -p[1][3] && p[2][1] < -p[2][3]) return false;
+            if (p[0][1] >  p[0][3] && p[1][1] >  p[1][3] && p[2][1] >  p[2][3]) return false;
+            if (p[0][2] < 0.f      && p[1][2] < 0.f      && p[2][2] < 0.f) return false;
+            if (p[0][2] >  p[0][3] && p[1][2] >  p[1][3] && p[2][2] >  p[2][3]) return false;
+            return true;
+        }
+
+        template<typename Fn>
+            static void VisitFrustum(const View& view, const Float4x4& modelToProjection, Fn&& fn)
+        {
+                //  Walk through the BVH, calling "fn" for every triangle that is within the
+                //  frustum. If "fn" returns false, we stop immediately.
+                //  When a node is entirely within the frustum, we don't need to test the
+                //  individual triangles -- all of the triangles in that node are hits.
+            class StackEntry { public: unsigned _node; bool _within; };
+            StackEntry stack[MaxStackDepth];
+            unsigned stackSize = 0;
+            stack[stackSize++] = StackEntry{0, false};
+
+            while (stackSize) {
+                auto entry = stack[--stackSize];
+                const auto& node = view._nodes[entry._node];
+
+                bool within = entry._within;
+                if (!within) {
+                    auto test = TestAABB(
+                        modelToProjection,
+                        Float3(node._mins[0], node._mins[1], node._mins[2]),
+                        Float3(node._maxs[0], node._maxs[1], node._maxs[2]));
+                    if (test == AABBIntersection::Culled) continue;
+                    within = test == AABBIntersection::Within;
+                }
+
+                if (node._packetCount) {
+                    auto firstTri = node._first * PacketWidth;
+                    auto endTri = (node._first + node._packetCount) * PacketWidth;
+                    for (auto t=firstTri; t<endTri; ++t) {
+                        const auto& desc = view._triangles[t];
+                        if (desc._drawCallIndex == InvalidDrawCall) continue;
+                        if (!within && !TriangleInFrustum(modelToProjection, desc)) continue;
+                        if (!fn(desc)) return;
+                    }
+                } else {
+                    assert((stackSize+2) <= MaxStackDepth);
+                    stack[stackSize++] = StackEntry{node._first+1, within};
+                    stack[stackSize++] = StackEntry{node._first, within};
+                }
+            }
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    std::vector<uint8> BuildModelIntersectionChunk(IteratorRange<const ModelIntersectionTriangle*> triangles)
+    {
+        using namespace ModelIntersectionInternal;
+        Builder builder;
+        builder.Build(triangles);
+
+        auto nodeCount = unsigned(builder._nodes.size());
+        auto packetCount = unsigned(builder._packets.size());
+        std::vector<uint8> result(CalculateBlockSize(nodeCount, packetCount), uint8(0));
+
+        auto& header = *(Header*)AsPointer(result.begin());
+        header._nodeCount = nodeCount;
+        header._packetCount = packetCount;
+        header._triangleCount = unsigned(triangles.size());
+        for (unsigned c=0; c<3; ++c) {
+            header._mins[c] = nodeCount ? builder._nodes[0]._mins[c] : 0.f;
+            header._maxs[c] = nodeCount ? builder._nodes[0]._maxs[c] : 0.f;
+        }
+
+        auto* dst = PtrAdd(AsPointer(result.begin()), sizeof(Header));
+        if (nodeCount) XlCopyMemory(dst, AsPointer(builder._nodes.cbegin()), sizeof(Node) * nodeCount);
+        dst = PtrAdd(dst, sizeof(Node) * nodeCount);
+        if (packetCount) XlCopyMemory(dst, AsPointer(builder._packets.cbegin()), sizeof(Packet) * packetCount);
+        dst = PtrAdd(dst, sizeof(Packet) * packetCount);
+        if (packetCount) XlCopyMemory(dst, AsPointer(builder._triangleDescs.cbegin()), sizeof(TriangleDesc) * PacketWidth * packetCount);
+
+        return result;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    std::vector<ModelIntersectionHit> ModelIntersectionScaffold::RayTest(const Float3& rayStart, const Float3& rayEnd) const
+    {
+        using namespace ModelIntersectionInternal;
+        Resolve();
+
+        std::vector<ModelIntersectionHit> result;
+        View view(_block);
+        if (!view._header->_nodeCount) return result;
+
+        Ray ray(rayStart, rayEnd);
+        unsigned stack[MaxStackDepth];
+        unsigned stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize) {
+            const auto& node = view._nodes[stack[--stackSize]];
+            float entryT;
+            if (!RayVsNode(ray, node, ray._maxT, entryT)) continue;
+
+            if (node._packetCount) {
+                for (unsigned p=0; p<node._packetCount; ++p) {
+                    float t[4], u[4], v[4];
+                    auto mask = RayVsPacket(ray, view._packets[node._first+p], ray._maxT, t, u, v);
+                    for (unsigned lane=0; lane<PacketWidth; ++lane)
+                        if (mask & (1<<lane))
+                            result.push_back(MakeHit(view._triangles[(node._first+p)*PacketWidth+lane], t[lane], u[lane], v[lane]));
+                }
+            } else {
+                assert((stackSize+2) <= MaxStackDepth);
+                stack[stackSize++] = node._first+1;
+                stack[stackSize++] = node._first;
+            }
+        }
+
+        std::sort(result.begin(), result.end(),
+            [](const ModelIntersectionHit& lhs, const ModelIntersectionHit& rhs) { return lhs._distance < rhs._distance; });
+        return result;
+    }
+
+    bool ModelIntersectionScaffold::FirstRayIntersection(ModelIntersectionHit& result, const Float3& rayStart, const Float3& rayEnd) const
+    {
+        using namespace ModelIntersectionInternal;
+        Resolve();
+
+        View view(_block);
+        if (!view._header->_nodeCount) return false;
+
+        Ray ray(rayStart, rayEnd);
+        float closest = ray._maxT;
+        bool gotHit = false;
+
+        class StackEntry { public: unsigned _node; float _entryT; };
+        StackEntry stack[MaxStackDepth];
+        unsigned stackSize = 0;
+        {
+            float entryT;
+            if (!RayVsNode(ray, view._nodes[0], closest, entryT)) return false;
+            stack[stackSize++] = StackEntry{0, entryT};
+        }
+
+        while (stackSize) {
+            auto entry = stack[--stackSize];
+            if (entry._entryT > closest) continue;
+            const auto& node = view._nodes[entry._node];
+
+            if (node._packetCount) {
+                for (unsigned p=0; p<node._packetCount; ++p) {
+                    float t[4], u[4], v[4];
+                    auto mask = RayVsPacket(ray, view._packets[node._first+p], closest, t, u, v);
+                    for (unsigned lane=0; lane<PacketWidth; ++lane)
+                        if ((mask & (1<<lane)) && t[lane] < closest) {
+                            closest = t[lane];
+                            result = MakeHit(view._triangles[(node._first+p)*PacketWidth+lane], t[lane], u[lane], v[lane]);
+                            gotHit = true;
+                        }
+                }
+            } else {
+                    // Push the further child first, so we visit the closer one first. That
+                    // should give us a good "closest" value early on, and allow us to skip
+                    // more of the tree.
+                float entryA, entryB;
+                bool hitA = RayVsNode(ray, view._nodes[node._first], closest, entryA);
+                bool hitB = RayVsNode(ray, view._nodes[node._first+1], closest, entryB);
+                assert((stackSize+2) <= MaxStackDepth);
+                if (hitA && hitB) {
+                    if (entryA <= entryB) {
+                        stack[stackSize++] = StackEntry{node._first+1, entryB};
+                        stack[stackSize++] = StackEntry{node._first, entryA};
+                    } else {
+                        stack[stackSize++] = StackEntry{node._first, entryA};
+                        stack[stackSize++] = StackEntry{node._first+1, entryB};
+                    }
+                } else if (hitA) {
+                    stack[stackSize++] = StackEntry{node._first, entryA};
+                } else if (hitB) {
+                    stack[stackSize++] = StackEntry{node._first+1, entryB};
+                }
+            }
+        }
+
+        return gotHit;
+    }
+
+    std::vector<ModelIntersectionHit> ModelIntersectionScaffold::FrustumTest(const Float4x4& modelToProjection) const
+    {
+        using namespace ModelIntersectionInternal;
+        Resolve();
+
+        std::vector<ModelIntersectionHit> result;
+        View view(_block);
+        if (!view._header->_nodeCount) return result;
+
+        VisitFrustum(view, modelToProjection,
+            [&result](const TriangleDesc& desc) -> bool
+            {
+                result.push_back(MakeHit(desc, 0.f, 0.f, 0.f));
+                return true;
+            });
+        return result;
+    }
+
+    bool ModelIntersectionScaffold::AnyWithinFrustum(const Float4x4& modelToProjection) const
+    {
+        using namespace ModelIntersectionInternal;
+        Resolve();
+
+        View view(_block);
+        if (!view._header->_nodeCount) return false;
+
+        bool result = false;
+        VisitFrustum(view, modelToProjection,
+            [&result](const TriangleDesc&) -> bool { result = true; return false; });
+        return result;
+    }
+
+    std::pair<Float3, Float3> ModelIntersectionScaffold::GetBoundingBox() const
+    {
+        Resolve();
+        const auto& header = *(const ModelIntersectionInternal::Header*)_block;
+        return std::make_pair(
+            Float3(header._mins[0], header._mins[1], header._mins[2]),
+            Float3(header._maxs[0], header._maxs[1], header._maxs[2]));
+    }
+
+    unsigned ModelIntersectionScaffold::GetTriangleCount() const
+    {
+        Resolve();
+        return ((const ModelIntersectionInternal::Header*)_block)->_triangleCount;
+    }
+
+    static const ::Assets::AssetChunkRequest ModelIntersectionChunkRequests[]
+    {
+            // (the scaffold chunk isn't loaded, but checking its version will force a recompile
+            //  of files built before the intersection chunk was added)
+        ::Assets::AssetChunkRequest { "Scaffold", ChunkType_ModelScaffold, ModelScaffoldVersion, ::Assets::AssetChunkRequest::DataType::DontLoad },
+        ::Assets::AssetChunkRequest { "Intersection", ChunkType_ModelIntersection, ModelIntersectionVersion, ::Assets::AssetChunkRequest::DataType::Raw }
+    };
+
+    ModelIntersectionScaffold::ModelIntersectionScaffold(const ::Assets::ResChar filename[])
+    : ChunkFileAsset("ModelIntersectionScaffold")
+    , _block(nullptr)
+    , _blockSize(0)
+    {
+        Prepare(filename, ResolveOp{MakeIteratorRange(ModelIntersectionChunkRequests), &Resolver});
+    }
+
+    ModelIntersectionScaffold::ModelIntersectionScaffold(std::shared_ptr<::Assets::ICompileMarker>&& marker)
+    : ChunkFileAsset("ModelIntersectionScaffold")
+    , _block(nullptr)
+    , _blockSize(0)
+    {
+        Prepare(*marker, ResolveOp{MakeIteratorRange(ModelIntersectionChunkRequests), &Resolver});
+    }
+
+    ModelIntersectionScaffold::ModelIntersectionScaffold(ModelIntersectionScaffold&& moveFrom) never_throws
+    : ::Assets::ChunkFileAsset(std::move(moveFrom))
+    , _rawMemoryBlock(std::move(moveFrom._rawMemoryBlock))
+    , _block(moveFrom._block)
+    , _blockSize(moveFrom._blockSize)
+    {
+        moveFrom._block = nullptr;
+        moveFrom._blockSize = 0;
+    }
+
+    ModelIntersectionScaffold& ModelIntersectionScaffold::operator=(ModelIntersectionScaffold&& moveFrom) never_throws
+    {
+        ::Assets::ChunkFileAsset::operator=(std::move(moveFrom));
+        _rawMemoryBlock = std::move(moveFrom._rawMemoryBlock);
+        _block = moveFrom._block;
+        _blockSize = moveFrom._blockSize;
+        moveFrom._block = nullptr;
+        moveFrom._blockSize = 0;
+        return *this;
+    }
+
+    ModelIntersectionScaffold::~ModelIntersectionScaffold() {}
+
+    void ModelIntersectionScaffold::Resolver(void* obj, IteratorRange<::Assets::AssetChunkResult*> chunks)
+    {
+        using namespace ModelIntersectionInternal;
+        auto* scaffold = (ModelIntersectionScaffold*)obj;
+        if (!scaffold) return;
+
+            // Validate the sizes in the header before we accept the block. The runtime
+            // queries index directly into the block without any further checking.
+        auto& chunk = chunks[1];
+        if (chunk._size < sizeof(Header))
+            Throw(::Assets::Exceptions::FormatError("Model intersection chunk is too small"));
+        const auto& header = *(const Header*)chunk._buffer.get();
+        if (chunk._size != CalculateBlockSize(header._nodeCount, header._packetCount))
+            Throw(::Assets::Exceptions::FormatError("Model intersection chunk size doesn't match header"));
+
+            //  The block is copied out of the file (rather than used in place from the
+            //  mapping) because this scaffold lives as long as the model does, and a mapping
+            //  would prevent the model file from being recompiled.
+        scaffold->_rawMemoryBlock = std::move(chunk._buffer);
+        scaffold->_block = scaffold->_rawMemoryBlock.get();
+        scaffold->_blockSize = chunk._size;
+    }
+}}
+
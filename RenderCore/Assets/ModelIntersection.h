@@ -0,0 +1,103 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Assets/AssetsCore.h"
+#include "../../Assets/ChunkFileAsset.h"
+#include "../../Math/Vector.h"
+#include "../../Math/Matrix.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/IteratorUtils.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <memory>
+
+namespace Assets { class ICompileMarker; }
+
+namespace RenderCore { namespace Assets
+{
+        /// <summary>Input triangle for BuildModelIntersectionChunk</summary>
+        /// Points should be in model space (ie, with the default pose transforms applied).
+        /// The draw call index should match the order in which draw calls appear in
+        /// the model scaffold (unskinned geo calls first, then skinned calls).
+    class ModelIntersectionTriangle
+    {
+    public:
+        Float3      _pts[3];
+        unsigned    _drawCallIndex;
+        uint64      _materialGuid;
+    };
+
+    class ModelIntersectionHit
+    {
+    public:
+        float       _distance;          // (as a fraction of the ray length)
+        Float3      _barycentric;
+        Float3      _pts[3];            // (model space)
+        unsigned    _drawCallIndex;
+        uint64      _materialGuid;
+    };
+
+        /// <summary>Build a triangle BVH for ray and frustum tests against a model</summary>
+        /// The result is a flat block of memory that can be written directly into a chunk
+        /// file (with type ChunkType_ModelIntersection). It's loaded at runtime by
+        /// ModelIntersectionScaffold without any fix-ups.
+    std::vector<uint8> BuildModelIntersectionChunk(IteratorRange<const ModelIntersectionTriangle*> triangles);
+
+    /// <summary>CPU side acceleration structure for model intersection tests</summary>
+    /// This is a bounding volume hierarchy of the triangles in a model, built at compile
+    /// time along with the ModelScaffold (and stored in the same file). It allows us to
+    /// do ray and frustum tests against the model without the GPU (and so without requiring
+    /// the immediate context, or a device at all).
+    ///
+    /// All queries are in model space. Leaves store 4 triangles in structure-of-arrays
+    /// form, so the ray test can work on a full leaf at once.
+    ///
+    /// Skinned geometry is stored in the default pose, and the highest level of detail is
+    /// used for all queries.
+    ///
+    /// <seealso cref="ModelScaffold" />
+    class ModelIntersectionScaffold : public ::Assets::ChunkFileAsset
+    {
+    public:
+            /// <summary>Find intersections between a model space line segment and the model</summary>
+            /// Returns all intersections, sorted from closest to furthest. Both front and
+            /// back faces are considered.
+        std::vector<ModelIntersectionHit> RayTest(const Float3& rayStart, const Float3& rayEnd) const;
+
+            /// <summary>Find the closest intersection between a line segment and the model</summary>
+            /// Faster than RayTest, because we can skip any parts of the BVH that are further
+            /// away than the closest intersection found so far. Returns false on no intersection.
+        bool FirstRayIntersection(ModelIntersectionHit& result, const Float3& rayStart, const Float3& rayEnd) const;
+
+            /// <summary>Find the triangles that are at least partially within the given frustum</summary>
+            /// As with the GPU test, a triangle is considered rejected only if all of its points
+            /// are outside of the same frustum plane. Returned hits have zero distance.
+        std::vector<ModelIntersectionHit> FrustumTest(const Float4x4& modelToProjection) const;
+
+            /// <summary>Returns true iff at least one triangle is within the frustum</summary>
+        bool AnyWithinFrustum(const Float4x4& modelToProjection) const;
+
+        std::pair<Float3, Float3> GetBoundingBox() const;
+        unsigned GetTriangleCount() const;
+
+        static const auto CompileProcessType = ConstHash64<'Mode', 'l'>::Value;
+
+        ModelIntersectionScaffold(const ::Assets::ResChar filename[]);
+        ModelIntersectionScaffold(std::shared_ptr<::Assets::ICompileMarker>&& marker);
+        ModelIntersectionScaffold(ModelIntersectionScaffold&& moveFrom) never_throws;
+        ModelIntersectionScaffold& operator=(ModelIntersectionScaffold&& moveFrom) never_throws;
+        ~ModelIntersectionScaffold();
+
+    private:
+        std::unique_ptr<uint8[]>    _rawMemoryBlock;
+        const void*                 _block;
+        size_t                      _blockSize;
+        static void Resolver(void*, IteratorRange<::Assets::AssetChunkResult*>);
+    };
+}}
+
@@ -251,6 +251,12 @@ namespace RenderCore { namespace Assets
             AsPointer(source.cbegin()), (unsigned)source.size(), lowLevelSlot);
     }
 
+    void WriteJointTransforms(
+        Float3x4 destination[], size_t destinationCount,
+        const BoundSkinnedGeometry& controller,
+        const Float4x4 transformationMachineResult[],
+        const SkeletonBinding& skeletonBinding);
+
     template <typename Type>
         void DestroyArray(const Type* begin, const Type* end)
         {
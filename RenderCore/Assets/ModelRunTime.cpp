@@ -51,9 +51,6 @@ namespace RenderCore { namespace Assets
 {
     using ::Assets::ResChar;
 
-    static const unsigned ModelScaffoldVersion = 1;
-    static const unsigned ModelScaffoldLargeBlocksVersion = 0;
-
     /// <summary>Internal namespace with utilities for constructing models</summary>
     /// These functions are normally used within the constructor of ModelRenderer
     namespace ModelConstruction
@@ -144,11 +141,6 @@ namespace RenderCore { namespace Assets
             return false;       // didn't find any draw calls with good material information. This whole geo object can be ignored.
         }
 
-        static void LoadBlock(BasicFile& file, uint8 destination[], size_t fileOffset, size_t readSize)
-        {
-            file.Seek(fileOffset, SEEK_SET);
-            file.Read(destination, 1, readSize);
-        }
 
         static bool HasElement(const GeoInputAssembly& ia, const char name[])
         {
@@ -446,16 +438,27 @@ namespace RenderCore { namespace Assets
             }
         }
 
+        static std::shared_ptr<MemoryMappedFile> MapLargeBlocks(const ::Assets::ResChar filename[])
+        {
+            auto result = ::Assets::MapChunkFile(filename);
+            if (!result)
+                Throw(::Exceptions::BasicLabel("Could not map model file while loading large blocks (%s)", filename));
+            return result;
+        }
+
         static void ReadImmediately(
             std::vector<uint8>& nascentBuffer,
-            BasicFile& file, unsigned largeBlocksOffset,
+            const MemoryMappedFile& file, unsigned largeBlocksOffset,
             IteratorRange<PendingGeoUpload*> uploads, unsigned supplementIndex = ~0u)
         {
             for (auto u=uploads.cbegin(); u!=uploads.cend(); ++u)
-                if (u->_supplementIndex==supplementIndex)
-                    LoadBlock(
-                        file, &nascentBuffer[u->_bufferDestination], 
-                        largeBlocksOffset + u->_sourceFileOffset, u->_size);
+                if (u->_supplementIndex==supplementIndex) {
+                    if ((size_t(largeBlocksOffset) + u->_sourceFileOffset + u->_size) > file.GetSize())
+                        Throw(::Exceptions::BasicLabel("Large block extends past the end of the model file"));
+                    XlCopyMemory(
+                        &nascentBuffer[u->_bufferDestination], 
+                        PtrAdd(file.GetData(), largeBlocksOffset + u->_sourceFileOffset), u->_size);
+                }
         }
     }
 
@@ -647,19 +650,22 @@ namespace RenderCore { namespace Assets
                 //      -- todo -- this part can be pushed into the background
                 //          using the buffer uploads system
                 //
+                //  The blocks are copied directly from a mapping of the file (which
+                //  may have already been prefetched, see ModelScaffold::PrefetchLargeBlocks)
+                //
         std::vector<uint8> nascentVB, nascentIB;
         nascentVB.resize(workingBuffers._vbSize);
         nascentIB.resize(workingBuffers._ibSize);
 
         {
-            BasicFile file(scaffold.Filename().c_str(), "rb");
-            ReadImmediately(nascentIB, file, scaffold.LargeBlocksOffset(), MakeIteratorRange(workingBuffers._ibUploads));
-            ReadImmediately(nascentVB, file, scaffold.LargeBlocksOffset(), MakeIteratorRange(workingBuffers._vbUploads));
+            auto file = MapLargeBlocks(scaffold.Filename().c_str());
+            ReadImmediately(nascentIB, *file, scaffold.LargeBlocksOffset(), MakeIteratorRange(workingBuffers._ibUploads));
+            ReadImmediately(nascentVB, *file, scaffold.LargeBlocksOffset(), MakeIteratorRange(workingBuffers._vbUploads));
         }
 
         for (unsigned s=0; s<supplements.size(); ++s) {
-            BasicFile file(supplements[s]->Filename().c_str(), "rb");
-            ReadImmediately(nascentVB, file, supplements[s]->LargeBlocksOffset(), MakeIteratorRange(workingBuffers._vbUploads), s);
+            auto file = MapLargeBlocks(supplements[s]->Filename().c_str());
+            ReadImmediately(nascentVB, *file, supplements[s]->LargeBlocksOffset(), MakeIteratorRange(workingBuffers._vbUploads), s);
         }
 
             ////////////////////////////////////////////////////////////////////////
@@ -1781,6 +1787,12 @@ namespace RenderCore { namespace Assets
             data->~ModelImmutableData();
     }
 
+    void ModelScaffold::PrefetchLargeBlocks() const
+    {
+        Resolve();
+        ::Assets::PrefetchChunkFile(Filename().c_str(), MakeIteratorRange(&ModelScaffoldChunkRequests[1], &ModelScaffoldChunkRequests[2]));
+    }
+
     void ModelScaffold::Resolver(void* obj, IteratorRange<::Assets::AssetChunkResult*> chunks)
     {
         auto* scaffold = (ModelScaffold*)obj;
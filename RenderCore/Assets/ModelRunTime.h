@@ -85,6 +85,11 @@ namespace RenderCore { namespace Assets
         std::pair<Float3, Float3>       GetStaticBoundingBox(unsigned lodIndex = 0) const;
         unsigned                        GetMaxLOD() const;
 
+            /// <summary>Start reading the large blocks (vertex & index data) in the background</summary>
+            /// Call this when we know a ModelRenderer will be built from this scaffold soon.
+            /// The renderer will then find the data in memory, rather than stalling on the disk.
+        void                            PrefetchLargeBlocks() const;
+
         static const auto CompileProcessType = ConstHash64<'Mode', 'l'>::Value;
 
         ModelScaffold(const ::Assets::ResChar filename[]);
@@ -309,6 +314,7 @@ namespace RenderCore { namespace Assets
         ~SkeletonScaffold();
     private:
         std::unique_ptr<uint8[]>    _rawMemoryBlock;
+        std::unique_ptr<TransformationMachine> _relativeMachine;    // (bound to _rawMemoryBlock, for BlockFormat::Relative chunks)
         static void Resolver(void*, IteratorRange<::Assets::AssetChunkResult*>);
         const TransformationMachine*   TryImmutableData() const;
     };
@@ -390,6 +396,7 @@ namespace RenderCore { namespace Assets
     public:
         void PrepareAnimation(  Metal::DeviceContext* context, 
                                 ModelRenderer::PreparedAnimation& state) const;
+        void PrepareAnimation(  ModelRenderer::PreparedAnimation& state) const;
         const SkeletonBinding& GetSkeletonBinding() const;
         unsigned GetSkeletonOutputCount() const;
 
@@ -107,6 +107,11 @@ namespace RenderCore { namespace Assets
         outputSerializer.SerializeSubBlock(AsPointer(jointHashNames.cbegin()), AsPointer(jointHashNames.cend()));
         outputSerializer.SerializeSubBlock(AsPointer(jointInverseBindMatrices.cbegin()), AsPointer(jointInverseBindMatrices.cend()));
         outputSerializer.SerializeValue(size_t(_outputMatrixCount));
+
+            //
+            //      Finally, the precompiled (flattened) form of the command stream
+            //
+        ::Serialize(outputSerializer, CompileTransformationMachine(MakeIteratorRange(_commandStream), _outputMatrixCount));
     }
 
     std::pair<std::vector<uint64>, std::vector<Float4x4>> NascentTransformationMachine::GetOutputInterface() const
@@ -9,7 +9,11 @@
 #include "RawAnimationCurve.h"
 #include "../../Math/Matrix.h"
 #include "../../Math/Interpolation.h"
+#include "../../Math/Transformations.h"
+#include "../../Utility/MemoryUtils.h"
 #include "../../Core/Exceptions.h"
+#include <algorithm>
+#include <vector>
 
 namespace RenderCore { namespace Assets
 {
@@ -24,29 +28,204 @@ namespace RenderCore { namespace Assets
         return (input - A) / (B-A);
     }
 
-    template<typename OutType>
-        OutType        RawAnimationCurve::Calculate(float inputTime) const never_throws
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //  Key quantization
+
+        //  In "smallest three" encoding, we drop the largest component of the 
+        //  (normalized) quaternion, and reconstruct it from the other three. The 
+        //  remaining components must then be in the range [-1/sqrt(2), 1/sqrt(2)].
+        //  We store them with 15 bits of precision, and use the top bits of the
+        //  first two components to record which component was dropped.
+    static const float QuaternionComponentRange = 0.70710678f;
+    static const unsigned TransformKeySize = sizeof(uint16) * 9;
+    static const unsigned TransformTableSize = sizeof(float) * 12;
+
+    static void EncodeQuaternion(uint16 dst[3], const Quaternion& q)
     {
-        assert(_positionFormat == ExpectedFormat<OutType>());
+        float c[4] = { q[0], q[1], q[2], q[3] };
+        unsigned largest = 0;
+        for (unsigned i=1; i<4; ++i)
+            if (XlAbs(c[i]) > XlAbs(c[largest])) largest = i;
 
-            // note -- clamping at start and end positions of the curve
-        if (inputTime < _timeMarkers[0])
-            return *(OutType*)_parameterData.get();
+            // q and -q are the same rotation; so we can make the dropped component positive
+        if (c[largest] < 0.f)
+            for (unsigned i=0; i<4; ++i) c[i] = -c[i];
 
-        if (_interpolationType == Linear) {
+        unsigned o = 0;
+        for (unsigned i=0; i<4; ++i) {
+            if (i == largest) continue;
+            float n = Clamp((c[i] / QuaternionComponentRange) * .5f + .5f, 0.f, 1.f);
+            dst[o++] = uint16(n * 32767.f + .5f);
+        }
+        dst[0] |= uint16((largest & 1) << 15);
+        dst[1] |= uint16((largest >> 1) << 15);
+    }
 
-            for (unsigned c=0; c<(_keyCount-1); ++c) {
-                if (inputTime < _timeMarkers[c+1]) {
-                    assert(_timeMarkers[c+1] > _timeMarkers[c]);
-                    float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
+    static Quaternion DecodeQuaternion(const uint16 src[3])
+    {
+        unsigned largest = (src[0] >> 15) | ((src[1] >> 15) << 1);
+        float c[3];
+        for (unsigned i=0; i<3; ++i)
+            c[i] = ((src[i] & 0x7fff) * (2.f / 32767.f) - 1.f) * QuaternionComponentRange;
 
-                    const OutType& P0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize);
-                    const OutType& P1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize);
-                    return SphericalInterpolate(P0, P1, alpha);
-                }
+        Quaternion result;
+        unsigned o = 0;
+        for (unsigned i=0; i<4; ++i) {
+            if (i == largest) continue;
+            result[i] = c[o++];
+        }
+        result[largest] = XlSqrt(std::max(0.f, 1.f - c[0]*c[0] - c[1]*c[1] - c[2]*c[2]));
+        return result;
+    }
+
+        //  Fixed point values are decoded as "offset + value * scale". The dequantization
+        //  table contains all of the offsets, followed by all of the scales.
+    static uint16 EncodeFixedPoint(float input, float offset, float scale)
+    {
+        if (scale == 0.f) return 0;
+        return uint16(Clamp((input - offset) / scale + .5f, 0.f, 65535.f));
+    }
+
+    static void BuildDequantizationTable(float offsets[], float scales[], const float* values, unsigned componentCount, size_t valueCount, size_t valueStride)
+    {
+        for (unsigned c=0; c<componentCount; ++c) {
+            float minValue = FLT_MAX, maxValue = -FLT_MAX;
+            for (size_t k=0; k<valueCount; ++k) {
+                float v = values[k*valueStride + c];
+                minValue = std::min(minValue, v);
+                maxValue = std::max(maxValue, v);
             }
+            offsets[c] = minValue;
+            scales[c] = (maxValue - minValue) / 65535.f;
+        }
+    }
+
+    template<typename OutType> static OutType DecodeKey(const void* key, const float* table);
+
+    template<> float DecodeKey<float>(const void* key, const float* table)
+    {
+        auto* k = (const uint16*)key;
+        return table[0] + k[0] * table[1];
+    }
+
+    template<> Float3 DecodeKey<Float3>(const void* key, const float* table)
+    {
+        auto* k = (const uint16*)key;
+        return Float3(table[0] + k[0] * table[3], table[1] + k[1] * table[4], table[2] + k[2] * table[5]);
+    }
 
-        } else if (_interpolationType == Bezier || _interpolationType == Hermite) {
+    template<> Float4 DecodeKey<Float4>(const void* key, const float* table)
+    {
+        auto* k = (const uint16*)key;
+        return Float4(
+            table[0] + k[0] * table[4], table[1] + k[1] * table[5], 
+            table[2] + k[2] * table[6], table[3] + k[3] * table[7]);
+    }
+
+    static ScaleRotationTranslationQ DecodeTransformKey(const void* key, const float* table)
+    {
+            // table: translation offsets, translation scales, scale offsets, scale scales
+        auto* k = (const uint16*)key;
+        return ScaleRotationTranslationQ(
+            Float3(table[6] + k[6] * table[9], table[7] + k[7] * table[10], table[8] + k[8] * table[11]),
+            DecodeQuaternion(k),
+            Float3(table[0] + k[3] * table[3], table[1] + k[4] * table[4], table[2] + k[5] * table[5]));
+    }
+
+    template<> Float4x4 DecodeKey<Float4x4>(const void* key, const float* table)
+    {
+        return AsFloat4x4(DecodeTransformKey(key, table));
+    }
+
+    template<typename OutType>
+        static OutType InterpolateQuantized(const void* key0, const void* key1, const float* table, float alpha)
+    {
+        return SphericalInterpolate(DecodeKey<OutType>(key0, table), DecodeKey<OutType>(key1, table), alpha);
+    }
+
+    template<>
+        Float4x4 InterpolateQuantized<Float4x4>(const void* key0, const void* key1, const float* table, float alpha)
+    {
+            // We can interpolate directly in the decompressed form, and avoid converting
+            // to a matrix and back again.
+            // Since the encoding can flip the sign of the quaternion, we must make sure
+            // we take the shortest path here.
+        auto A = DecodeTransformKey(key0, table);
+        auto B = DecodeTransformKey(key1, table);
+        float d = A._rotation[0]*B._rotation[0] + A._rotation[1]*B._rotation[1] + A._rotation[2]*B._rotation[2] + A._rotation[3]*B._rotation[3];
+        if (d < 0.f)
+            for (unsigned c=0; c<4; ++c) B._rotation[c] = -B._rotation[c];
+        return AsFloat4x4(SphericalInterpolate(A, B, alpha));
+    }
+
+    size_t      RawAnimationCurve::GetKeyDataOffset() const
+    {
+        if (_keyEncoding == Quantized16) return 4 * _elementSize;     // (2 floats per 16 bit component)
+        if (_keyEncoding == QuantizedTransform) return TransformTableSize;
+        return 0;
+    }
+
+    template<typename OutType>
+        OutType     RawAnimationCurve::GetKeyValue(unsigned keyIndex) const never_throws
+    {
+        if (_keyEncoding == Uncompressed)
+            return *(const OutType*)PtrAdd(_parameterData.get(), keyIndex * _elementSize);
+
+        return DecodeKey<OutType>(
+            PtrAdd(_parameterData.get(), GetKeyDataOffset() + keyIndex * _elementSize),
+            (const float*)_parameterData.get());
+    }
+
+    unsigned    RawAnimationCurve::FindKey(float inputTime) const never_throws
+    {
+            // Find the first key with a time marker greater than "inputTime" (ignoring
+            // the first key), and return the key before it. If there are none, we will
+            // return the last key.
+            // note -- there's no special case for inputTime < _timeMarkers[0] here. The
+            //      caller must clamp at the start of the curve.
+        if (_keyCount <= 1) return 0;
+        auto i = std::upper_bound(&_timeMarkers[1], &_timeMarkers[_keyCount], inputTime);
+        return unsigned(i - &_timeMarkers[1]);
+    }
+
+    unsigned    RawAnimationCurve::FindKey(float inputTime, unsigned keyCursor) const never_throws
+    {
+            // Check the key from the cursor, and the one immediately after it, before
+            // falling back to the binary search. 
+        if ((keyCursor+1) < _keyCount && inputTime >= _timeMarkers[keyCursor]) {
+            if (inputTime < _timeMarkers[keyCursor+1]) return keyCursor;
+            if ((keyCursor+2) >= _keyCount) return keyCursor+1;
+            if (inputTime < _timeMarkers[keyCursor+2]) return keyCursor+1;
+        }
+        return FindKey(inputTime);
+    }
+
+    template<typename OutType>
+        OutType     RawAnimationCurve::EvaluateKey(unsigned c, float inputTime) const never_throws
+    {
+        if ((c+1) >= _keyCount)
+            return GetKeyValue<OutType>(unsigned(_keyCount-1));
+
+        assert(_timeMarkers[c+1] > _timeMarkers[c]);
+        float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
+
+        if (_keyEncoding != Uncompressed) {
+                // compressed curves are always linear
+            assert(_interpolationType == Linear);
+            auto keyData = PtrAdd(_parameterData.get(), GetKeyDataOffset());
+            return InterpolateQuantized<OutType>(
+                PtrAdd(keyData, c * _elementSize), PtrAdd(keyData, (c+1) * _elementSize),
+                (const float*)_parameterData.get(), alpha);
+        }
+
+        const OutType& P0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize);
+        const OutType& P1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize);
+
+        if (_interpolationType == Linear) {
+
+            return SphericalInterpolate(P0, P1, alpha);
+
+        } else if (_interpolationType == Bezier) {
 
             assert(_inTangentFormat != Metal::NativeFormat::Unknown);
             assert(_outTangentFormat != Metal::NativeFormat::Unknown);
@@ -54,30 +233,81 @@ namespace RenderCore { namespace Assets
             const size_t inTangentOffset = Metal::BitsPerPixel(_positionFormat)/8;
             const size_t outTangentOffset = inTangentOffset + Metal::BitsPerPixel(_inTangentFormat)/8;
 
-            if (_interpolationType == Bezier) {
+            const OutType& C0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize + outTangentOffset);
+            const OutType& C1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize + inTangentOffset);
 
-                for (unsigned c=0; c<(_keyCount-1); ++c) {
-                    if (inputTime < _timeMarkers[c+1]) {
-                        assert(_timeMarkers[c+1] > _timeMarkers[c]);
-                        float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
+            return SphericalBezierInterpolate(P0, C0, C1, P1, alpha);
 
-                        const OutType& P0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize);
-                        const OutType& P1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize);
+        } else {
+            assert(0);      // hermite version not implemented (though we could just convert on load in)
+        }
 
-                        const OutType& C0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize + outTangentOffset);
-                        const OutType& C1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize + inTangentOffset);
+        return *(OutType*)PtrAdd(_parameterData.get(), (_keyCount-1) * _elementSize);
+    }
 
-                        return SphericalBezierInterpolate(P0, C0, C1, P1, alpha);
-                    }
-                }
+    template<typename OutType>
+        OutType        RawAnimationCurve::Calculate(float inputTime) const never_throws
+    {
+        assert(_positionFormat == ExpectedFormat<OutType>());
 
-            } else {
-                assert(0);      // hermite version not implemented (though we could just convert on load in)
-            }
+            // note -- clamping at start and end positions of the curve
+        if (inputTime < _timeMarkers[0])
+            return GetKeyValue<OutType>(0);
+
+        return EvaluateKey<OutType>(FindKey(inputTime), inputTime);
+    }
+
+    template<typename OutType>
+        OutType        RawAnimationCurve::Calculate(float inputTime, unsigned& keyCursor) const never_throws
+    {
+        assert(_positionFormat == ExpectedFormat<OutType>());
 
+        if (inputTime < _timeMarkers[0]) {
+            keyCursor = 0;
+            return GetKeyValue<OutType>(0);
         }
 
-        return *(OutType*)PtrAdd(_parameterData.get(), (_keyCount-1) * _elementSize );
+        keyCursor = FindKey(inputTime, keyCursor);
+        return EvaluateKey<OutType>(keyCursor, inputTime);
+    }
+
+    template<typename OutType>
+        void    RawAnimationCurve::CalculateBatch(
+            IteratorRange<OutType*> dst,
+            IteratorRange<const RawAnimationCurve*const*> curves,
+            float inputTime, unsigned* keyCursors) never_throws
+    {
+        assert(dst.size() == curves.size());
+        auto count = std::min(dst.size(), curves.size());
+
+            // Keys are found for all curves first, and then evaluated in a second pass.
+            // This keeps the (branchy) search separate from the interpolation math.
+        unsigned tempKeys[64];
+        for (size_t base=0; base<count; base+=dimof(tempKeys)) {
+            auto blockCount = std::min(count-base, dimof(tempKeys));
+            for (size_t c=0; c<blockCount; ++c) {
+                const auto& curve = *curves[base+c];
+                assert(curve._positionFormat == ExpectedFormat<OutType>());
+                if (inputTime < curve._timeMarkers[0]) {
+                    tempKeys[c] = ~0u;
+                } else if (keyCursors) {
+                    tempKeys[c] = curve.FindKey(inputTime, keyCursors[base+c]);
+                } else {
+                    tempKeys[c] = curve.FindKey(inputTime);
+                }
+            }
+
+            for (size_t c=0; c<blockCount; ++c) {
+                const auto& curve = *curves[base+c];
+                if (tempKeys[c] == ~0u) {
+                    dst[base+c] = curve.GetKeyValue<OutType>(0);
+                    if (keyCursors) keyCursors[base+c] = 0;
+                } else {
+                    dst[base+c] = curve.EvaluateKey<OutType>(tempKeys[c], inputTime);
+                    if (keyCursors) keyCursors[base+c] = tempKeys[c];
+                }
+            }
+        }
     }
 
     float       RawAnimationCurve::StartTime() const
@@ -101,12 +331,178 @@ namespace RenderCore { namespace Assets
     template Float4     RawAnimationCurve::Calculate(float inputTime) const never_throws;
     template Float4x4   RawAnimationCurve::Calculate(float inputTime) const never_throws;
 
+    template float      RawAnimationCurve::Calculate(float inputTime, unsigned&) const never_throws;
+    template Float3     RawAnimationCurve::Calculate(float inputTime, unsigned&) const never_throws;
+    template Float4     RawAnimationCurve::Calculate(float inputTime, unsigned&) const never_throws;
+    template Float4x4   RawAnimationCurve::Calculate(float inputTime, unsigned&) const never_throws;
+
+    template void RawAnimationCurve::CalculateBatch(IteratorRange<float*>, IteratorRange<const RawAnimationCurve*const*>, float, unsigned*) never_throws;
+    template void RawAnimationCurve::CalculateBatch(IteratorRange<Float3*>, IteratorRange<const RawAnimationCurve*const*>, float, unsigned*) never_throws;
+    template void RawAnimationCurve::CalculateBatch(IteratorRange<Float4*>, IteratorRange<const RawAnimationCurve*const*>, float, unsigned*) never_throws;
+    template void RawAnimationCurve::CalculateBatch(IteratorRange<Float4x4*>, IteratorRange<const RawAnimationCurve*const*>, float, unsigned*) never_throws;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename Type>
+        static std::vector<unsigned> FindRequiredKeys(
+            const float timeMarkers[], const void* keyData, size_t elementSize, size_t keyCount, 
+            float tolerance)
+    {
+            //  Greedy key removal. Starting from an "anchor" key, we extend the segment 
+            //  as far as we can, while every key we're skipping can be reconstructed 
+            //  (within tolerance) by interpolating between the end points. Note that we 
+            //  use the same interpolation function as Calculate().
+        std::vector<unsigned> result;
+        result.push_back(0);
+        unsigned anchor = 0;
+        for (unsigned e=2; e<keyCount; ++e) {
+            const auto& A = *(const Type*)PtrAdd(keyData, anchor * elementSize);
+            const auto& B = *(const Type*)PtrAdd(keyData, e * elementSize);
+            bool canSkip = true;
+            for (unsigned k=anchor+1; k<e && canSkip; ++k) {
+                float alpha = LerpParameter(timeMarkers[anchor], timeMarkers[e], timeMarkers[k]);
+                canSkip = Equivalent(
+                    SphericalInterpolate(A, B, alpha), 
+                    *(const Type*)PtrAdd(keyData, k * elementSize), tolerance);
+            }
+
+            if (!canSkip) {
+                result.push_back(e-1);
+                anchor = e-1;
+            }
+        }
+        result.push_back(unsigned(keyCount-1));
+        return result;
+    }
+
+    static DynamicArray<uint8, BlockSerializerDeleter<uint8[]>> AsDynamicArray(const std::vector<uint8>& input)
+    {
+        std::unique_ptr<uint8[], BlockSerializerDeleter<uint8[]>> block(new uint8[input.size()]);
+        std::copy(input.begin(), input.end(), block.get());
+        return DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>(std::move(block), input.size());
+    }
+
+    RawAnimationCurve   RawAnimationCurve::Compress(const CompressionSettings& settings) const
+    {
+        if (_interpolationType != Linear || _keyEncoding != Uncompressed || _keyCount < 2)
+            return RawAnimationCurve(*this);
+
+            //  First, find the keys we can't remove
+        std::vector<unsigned> keys;
+        if (settings._keyReductionTolerance > 0.f) {
+            using namespace Metal::NativeFormat;
+            auto tolerance = settings._keyReductionTolerance;
+            switch (_positionFormat) {
+            case R32_FLOAT:             keys = FindRequiredKeys<float>(_timeMarkers.get(), _parameterData.get(), _elementSize, _keyCount, tolerance); break;
+            case R32G32B32_FLOAT:       keys = FindRequiredKeys<Float3>(_timeMarkers.get(), _parameterData.get(), _elementSize, _keyCount, tolerance); break;
+            case R32G32B32A32_FLOAT:    keys = FindRequiredKeys<Float4>(_timeMarkers.get(), _parameterData.get(), _elementSize, _keyCount, tolerance); break;
+            case Matrix4x4:             keys = FindRequiredKeys<Float4x4>(_timeMarkers.get(), _parameterData.get(), _elementSize, _keyCount, tolerance); break;
+            default: break;
+            }
+        }
+
+        if (keys.empty()) {
+            keys.reserve(_keyCount);
+            for (unsigned c=0; c<_keyCount; ++c) keys.push_back(c);
+        }
+
+        auto newKeyCount = keys.size();
+        std::unique_ptr<float[], BlockSerializerDeleter<float[]>> newTimeMarkers(new float[newKeyCount]);
+        for (size_t c=0; c<newKeyCount; ++c)
+            newTimeMarkers[c] = _timeMarkers[keys[c]];
+
+        auto srcKey = [this, &keys](size_t c) { return PtrAdd(_parameterData.get(), keys[c] * _elementSize); };
+
+            //  Now quantize the remaining keys (if we can)
+        KeyEncoding encoding = Uncompressed;
+        size_t newElementSize = _elementSize;
+        std::vector<uint8> newData;
+
+        if (settings._quantize) {
+            if (_positionFormat == Metal::NativeFormat::Matrix4x4) {
+
+                    // Only matrices that decompose cleanly into scale, rotation & translation
+                    // (ie, no skew) can use the transform encoding
+                std::vector<Quaternion> rotations; rotations.reserve(newKeyCount);
+                std::vector<Float3> translations; translations.reserve(newKeyCount);
+                std::vector<Float3> scales; scales.reserve(newKeyCount);
+                bool goodDecomposition = true;
+                for (size_t c=0; c<newKeyCount && goodDecomposition; ++c) {
+                    ScaleRotationTranslationQ decomposed(*(const Float4x4*)srcKey(c), goodDecomposition);
+                    rotations.push_back(cml::normalize(decomposed._rotation));
+                    translations.push_back(decomposed._translation);
+                    scales.push_back(decomposed._scale);
+                }
+
+                if (goodDecomposition) {
+                    encoding = QuantizedTransform;
+                    newElementSize = TransformKeySize;
+                    newData.resize(TransformTableSize + newKeyCount * TransformKeySize);
+
+                    auto* table = (float*)AsPointer(newData.begin());
+                    BuildDequantizationTable(&table[0], &table[3], &translations[0][0], 3, newKeyCount, 3);
+                    BuildDequantizationTable(&table[6], &table[9], &scales[0][0], 3, newKeyCount, 3);
+
+                    for (size_t c=0; c<newKeyCount; ++c) {
+                        auto* dst = (uint16*)PtrAdd(AsPointer(newData.begin()), TransformTableSize + c * TransformKeySize);
+                        EncodeQuaternion(dst, rotations[c]);
+                        for (unsigned q=0; q<3; ++q) {
+                            dst[3+q] = EncodeFixedPoint(translations[c][q], table[q], table[3+q]);
+                            dst[6+q] = EncodeFixedPoint(scales[c][q], table[6+q], table[9+q]);
+                        }
+                    }
+                }
+
+            } else {
+
+                unsigned componentCount = 0;
+                if (_positionFormat == Metal::NativeFormat::R32_FLOAT) componentCount = 1;
+                else if (_positionFormat == Metal::NativeFormat::R32G32B32_FLOAT) componentCount = 3;
+                else if (_positionFormat == Metal::NativeFormat::R32G32B32A32_FLOAT) componentCount = 4;
+
+                if (componentCount && _elementSize == componentCount * sizeof(float)) {
+                    encoding = Quantized16;
+                    newElementSize = componentCount * sizeof(uint16);
+                    const auto tableSize = 2 * componentCount * sizeof(float);
+                    newData.resize(tableSize + newKeyCount * newElementSize);
+
+                    std::vector<float> values(newKeyCount * componentCount);
+                    for (size_t c=0; c<newKeyCount; ++c)
+                        std::copy((const float*)srcKey(c), (const float*)srcKey(c) + componentCount, &values[c*componentCount]);
+
+                    auto* table = (float*)AsPointer(newData.begin());
+                    BuildDequantizationTable(table, &table[componentCount], AsPointer(values.begin()), componentCount, newKeyCount, componentCount);
+
+                    for (size_t c=0; c<newKeyCount; ++c) {
+                        auto* dst = (uint16*)PtrAdd(AsPointer(newData.begin()), tableSize + c * newElementSize);
+                        for (unsigned q=0; q<componentCount; ++q)
+                            dst[q] = EncodeFixedPoint(values[c*componentCount+q], table[q], table[componentCount+q]);
+                    }
+                }
+
+            }
+        }
+
+        if (encoding == Uncompressed) {
+            newData.resize(newKeyCount * _elementSize);
+            for (size_t c=0; c<newKeyCount; ++c)
+                XlCopyMemory(PtrAdd(AsPointer(newData.begin()), c * _elementSize), srcKey(c), _elementSize);
+        }
+
+        return RawAnimationCurve(
+            newKeyCount, std::move(newTimeMarkers), AsDynamicArray(newData),
+            newElementSize, _interpolationType,
+            _positionFormat, _inTangentFormat, _outTangentFormat,
+            encoding);
+    }
+
     RawAnimationCurve::RawAnimationCurve(   size_t keyCount, 
                                             std::unique_ptr<float[], BlockSerializerDeleter<float[]>>&&  timeMarkers, 
                                             DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>&&       keyPositions,
                                             size_t elementSize, InterpolationType interpolationType,
                                             Metal::NativeFormat::Enum positionFormat, Metal::NativeFormat::Enum inTangentFormat, 
-                                            Metal::NativeFormat::Enum outTangentFormat)
+                                            Metal::NativeFormat::Enum outTangentFormat,
+                                            KeyEncoding keyEncoding)
     :       _keyCount(keyCount)
     ,       _timeMarkers(std::forward<std::unique_ptr<float[], BlockSerializerDeleter<float[]>>>(timeMarkers))
     ,       _parameterData(std::forward<DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>>(keyPositions))
@@ -115,6 +511,7 @@ namespace RenderCore { namespace Assets
     ,       _positionFormat(positionFormat)
     ,       _inTangentFormat(inTangentFormat)
     ,       _outTangentFormat(outTangentFormat)
+    ,       _keyEncoding(keyEncoding)
     {}
 
     RawAnimationCurve::RawAnimationCurve(RawAnimationCurve&& curve)
@@ -126,6 +523,7 @@ namespace RenderCore { namespace Assets
     ,       _positionFormat(curve._positionFormat)
     ,       _inTangentFormat(curve._inTangentFormat)
     ,       _outTangentFormat(curve._outTangentFormat)
+    ,       _keyEncoding(curve._keyEncoding)
     {}
 
     RawAnimationCurve::RawAnimationCurve(const RawAnimationCurve& copyFrom)
@@ -136,6 +534,7 @@ namespace RenderCore { namespace Assets
     ,       _positionFormat(copyFrom._positionFormat)
     ,       _inTangentFormat(copyFrom._inTangentFormat)
     ,       _outTangentFormat(copyFrom._outTangentFormat)
+    ,       _keyEncoding(copyFrom._keyEncoding)
     {
         _timeMarkers.reset(new float[_keyCount]);
         std::copy(copyFrom._timeMarkers.get(), &copyFrom._timeMarkers[_keyCount], _timeMarkers.get());
@@ -151,6 +550,7 @@ namespace RenderCore { namespace Assets
         _positionFormat = curve._positionFormat;
         _inTangentFormat = curve._inTangentFormat;
         _outTangentFormat = curve._outTangentFormat;
+        _keyEncoding = curve._keyEncoding;
         return *this;
     }
 
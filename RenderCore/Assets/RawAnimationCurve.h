@@ -9,6 +9,7 @@
 #include "../Metal/Format.h"
 #include "../../Utility/PtrUtils.h"
 #include "../../Utility/Streams/Serialization.h"
+#include "../../Utility/IteratorUtils.h"
 #include "../../Core/Types.h"
 #include <memory>
 
@@ -19,12 +20,29 @@ namespace RenderCore { namespace Assets
     public:
         enum InterpolationType { Linear, Bezier, Hermite };
 
+            //  Compressed curves store a small dequantization table at the start of 
+            //  _parameterData, followed by the packed keys. "_positionFormat" is always 
+            //  the decompressed format (ie, the type returned from Calculate).
+            //      Quantized16         -- 16 bit fixed point per component (float, Float3, Float4)
+            //      QuantizedTransform  -- Float4x4 stored as smallest-three quaternion, plus 
+            //                              16 bit fixed point scale and translation
+        enum KeyEncoding { Uncompressed, Quantized16, QuantizedTransform };
+
+        class CompressionSettings
+        {
+        public:
+            float   _keyReductionTolerance;     ///< max error allowed when removing keys (0 disables key removal)
+            bool    _quantize;
+            CompressionSettings() : _keyReductionTolerance(0.f), _quantize(false) {}
+        };
+
         RawAnimationCurve(  size_t keyCount, 
                             std::unique_ptr<float[], BlockSerializerDeleter<float[]>>&&  timeMarkers, 
                             DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>&&       keyPositions,
                             size_t elementSize, InterpolationType interpolationType,
                             Metal::NativeFormat::Enum positionFormat, Metal::NativeFormat::Enum inTangentFormat, 
-                            Metal::NativeFormat::Enum outTangentFormat);
+                            Metal::NativeFormat::Enum outTangentFormat,
+                            KeyEncoding keyEncoding = Uncompressed);
         RawAnimationCurve(RawAnimationCurve&& curve);
         RawAnimationCurve(const RawAnimationCurve& copyFrom);
         RawAnimationCurve& operator=(RawAnimationCurve&& curve);
@@ -38,6 +56,35 @@ namespace RenderCore { namespace Assets
         template<typename OutType>
             OutType        Calculate(float inputTime) const never_throws;
 
+            /// <summary>Calculate with a persistent key cursor</summary>
+            /// The cursor records the key used in the previous evaluation. During monotonic
+            /// playback the next evaluation will usually land on the same key (or the one
+            /// after it), and in those cases we can skip the binary search entirely.
+            /// Each animated instance should own its own cursor (initialize to 0).
+        template<typename OutType>
+            OutType        Calculate(float inputTime, unsigned& keyCursor) const never_throws;
+
+            /// <summary>Evaluate many curves at the same time</summary>
+            /// Writes one result per curve into "dst" (so dst.size() must match curves.size()).
+            /// All curves must have the same output type. When "keyCursors" is not null, it
+            /// must contain one cursor per curve.
+        template<typename OutType>
+            static void    CalculateBatch(
+                IteratorRange<OutType*> dst,
+                IteratorRange<const RawAnimationCurve*const*> curves,
+                float inputTime, unsigned* keyCursors = nullptr) never_throws;
+
+        unsigned    FindKey(float inputTime) const never_throws;
+        unsigned    FindKey(float inputTime, unsigned keyCursor) const never_throws;
+        size_t      GetKeyCount() const { return _keyCount; }
+        size_t      GetDataSize() const { return _parameterData.size() + _keyCount * sizeof(float); }
+
+            /// <summary>Build a compressed version of this curve</summary>
+            /// Removes keys that can be reconstructed from their neighbours (within the 
+            /// given tolerance) and optionally quantizes the remaining keys. Only linear
+            /// curves are compressed; other curves are returned unchanged.
+        RawAnimationCurve   Compress(const CompressionSettings& settings) const;
+
     protected:
         size_t                          _keyCount;
         std::unique_ptr<float[], BlockSerializerDeleter<float[]>>    _timeMarkers;
@@ -48,9 +95,16 @@ namespace RenderCore { namespace Assets
         Metal::NativeFormat::Enum       _positionFormat;
         Metal::NativeFormat::Enum       _inTangentFormat;
         Metal::NativeFormat::Enum       _outTangentFormat;
+        KeyEncoding                     _keyEncoding;
 
         template<typename OutType>
             static Metal::NativeFormat::Enum   ExpectedFormat();
+
+        template<typename OutType>
+            OutType     EvaluateKey(unsigned keyIndex, float inputTime) const never_throws;
+        template<typename OutType>
+            OutType     GetKeyValue(unsigned keyIndex) const never_throws;
+        size_t          GetKeyDataOffset() const;
     };
 
     template<typename Serializer>
@@ -64,6 +118,7 @@ namespace RenderCore { namespace Assets
         ::Serialize(outputSerializer, unsigned(_positionFormat));
         ::Serialize(outputSerializer, unsigned(_inTangentFormat));
         ::Serialize(outputSerializer, unsigned(_outTangentFormat));
+        ::Serialize(outputSerializer, unsigned(_keyEncoding));
     }
 
 }}
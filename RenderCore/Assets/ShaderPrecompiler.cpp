@@ -0,0 +1,277 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ShaderPrecompiler.h"
+#include "LocalCompiledShaderSource.h"
+#include "../Techniques/Techniques.h"
+#include "../ShaderService.h"
+
+#include "../../Assets/Assets.h"
+#include "../../Assets/IntermediateAssets.h"
+#include "../../Assets/ArchiveCache.h"
+#include "../../Assets/AssetUtils.h"
+
+#include "../../ConsoleRig/Log.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/Threading/TaskScheduler.h"
+#include "../../Utility/IteratorUtils.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Core/Exceptions.h"
+
+#include <deque>
+#include <algorithm>
+
+namespace RenderCore { namespace Assets
+{
+    using ::Assets::ResChar;
+
+        ////////////////////////////////////////////////////////////
+
+    void ShaderVariationDomain::Add(const utf8 parameterName[], const std::vector<std::string>& values)
+    {
+        auto hash = ParameterBox::MakeParameterNameHash(parameterName);
+        auto i = LowerBound(_values, hash);
+        if (i != _values.end() && i->first == hash) {
+            i->second = values;
+        } else {
+            _values.insert(i, std::make_pair(hash, values));
+        }
+    }
+
+    void ShaderVariationDomain::Add(const utf8 parameterName[], std::initializer_list<const char*> values)
+    {
+        std::vector<std::string> v;
+        v.reserve(values.size());
+        for (auto i:values) v.push_back(i);
+        Add(parameterName, v);
+    }
+
+    auto ShaderVariationDomain::Find(ParameterBox::ParameterNameHash parameterName) const -> const std::vector<std::string>*
+    {
+        auto i = LowerBound(_values, parameterName);
+        if (i != _values.cend() && i->first == parameterName)
+            return &i->second;
+        return nullptr;
+    }
+
+    ShaderVariationDomain::ShaderVariationDomain() {}
+    ShaderVariationDomain::~ShaderVariationDomain() {}
+
+        ////////////////////////////////////////////////////////////
+
+    void ShaderPrecompiler::AddRequest(const ResChar initializer[], const ResChar definesTable[])
+    {
+        if (!initializer || !*initializer) return;
+        if (!definesTable) definesTable = "";
+
+        auto hash = HashCombine(Hash64(initializer), Hash64(definesTable));
+        auto i = LowerBound(_requests, hash);
+        if (i == _requests.end() || i->first != hash)
+            _requests.insert(i, std::make_pair(hash, Request(initializer, definesTable)));
+    }
+
+    void ShaderPrecompiler::AddTechniqueVariations(const Techniques::Technique& technique, const ShaderVariationDomain& domain)
+    {
+        if (!technique.IsValid()) return;
+
+        using Source = Techniques::ShaderParameters::Source;
+
+            //  Each technique parameter with values in the domain is an "axis" of the
+            //  permutation space. Parameters that the technique doesn't know about don't
+            //  change the shader, so they are never permuted
+        class Axis
+        {
+        public:
+            unsigned                            _source;
+            const utf8*                         _name;
+            const std::vector<std::string>*     _values;
+        };
+        std::vector<Axis> axes;
+        const auto& baseParameters = technique.GetBaseParameters();
+        for (unsigned s=0; s<Source::Max; ++s) {
+            for (auto i=baseParameters._parameters[s].Begin(); !i.IsEnd(); ++i) {
+                auto* values = domain.Find(i.HashName());
+                if (values && !values->empty()) {
+                    Axis axis;
+                    axis._source = s;
+                    axis._name = i.Name();
+                    axis._values = values;
+                    axes.push_back(axis);
+                }
+            }
+        }
+
+        ParameterBox boxes[Source::Max];
+        const ParameterBox* state[Source::Max];
+        for (unsigned s=0; s<Source::Max; ++s) state[s] = &boxes[s];
+
+        std::vector<unsigned> indices(axes.size(), 0);
+        for (unsigned permutationCount=0;;) {
+            for (size_t a=0; a<axes.size(); ++a)
+                boxes[axes[a]._source].SetParameter(axes[a]._name, (*axes[a]._values)[indices[a]]);
+
+            auto initializers = technique.MakeShaderInitializers(state);
+            AddRequest(initializers._vertexShader.c_str(), initializers._definesTable.c_str());
+            AddRequest(initializers._pixelShader.c_str(), initializers._definesTable.c_str());
+            if (!initializers._geometryShader.empty())
+                AddRequest(initializers._geometryShader.c_str(), initializers._definesTable.c_str());
+
+            if (++permutationCount >= MaxPermutationsPerTechnique) {
+                LogWarning << "Too many permutations while enumerating variations for technique (" << initializers._vertexShader << "). Some variations will be skipped.";
+                break;
+            }
+
+                // advance to the next permutation (like an odometer)
+            size_t a = 0;
+            for (; a<axes.size(); ++a) {
+                if (++indices[a] < axes[a]._values->size()) break;
+                indices[a] = 0;
+            }
+            if (a == axes.size()) break;
+        }
+    }
+
+    void ShaderPrecompiler::AddShaderType(const ResChar techniqueConfig[], const ShaderVariationDomain& domain)
+    {
+        TRY
+        {
+            Techniques::ShaderType shaderType(techniqueConfig);
+            for (unsigned c=0; c<Techniques::TechniqueIndex::Max; ++c)
+                AddTechniqueVariations(shaderType.GetTechnique(c), domain);
+        } CATCH (const std::exception& e) {
+            LogWarning << "Error while enumerating variations in technique config (" << techniqueConfig << "): " << e.what();
+        } CATCH_END
+    }
+
+    void ShaderPrecompiler::AddTechniqueConfigs(const ResChar baseDirectory[], const ShaderVariationDomain& domain)
+    {
+        auto files = FindFilesHierarchical(baseDirectory, "*.tech", FindFilesFilter::File);
+        for (const auto& f:files)
+            AddShaderType(f.c_str(), domain);
+    }
+
+    void ShaderPrecompiler::AddRecordedRequests(const LocalCompiledShaderSource& source)
+    {
+        auto recorded = source.GetRecordedRequests();
+        for (const auto& r:recorded)
+            AddRequest(r.first.c_str(), r.second.c_str());
+    }
+
+        //  The request list is a text file, with one request per line:
+        //      {initializer} <tab> {defines table}
+        //  (neither the initializers nor the defines tables can contain tabs or new lines)
+    void ShaderPrecompiler::LoadRequestList(const ResChar filename[])
+    {
+        size_t fileSize = 0;
+        auto file = LoadFileAsMemoryBlock(filename, &fileSize);
+        if (!file || !fileSize) {
+            LogWarning << "Could not load shader request list (" << filename << ")";
+            return;
+        }
+
+        auto* i = (const char*)file.get();
+        auto* end = i + fileSize;
+        while (i < end) {
+            auto* lineEnd = std::find(i, end, '\n');
+            auto* tab = std::find(i, lineEnd, '\t');
+            if (tab != lineEnd) {
+                auto* definesEnd = lineEnd;
+                if (definesEnd > tab+1 && *(definesEnd-1) == '\r') --definesEnd;
+                AddRequest(::Assets::rstring(i, tab).c_str(), ::Assets::rstring(tab+1, definesEnd).c_str());
+            }
+            i = (lineEnd == end) ? end : (lineEnd+1);
+        }
+    }
+
+    void ShaderPrecompiler::SaveRequestList(const ResChar filename[]) const
+    {
+        BasicFile file(filename, "wb");
+        for (const auto& r:_requests) {
+            file.Write(r.second.first.c_str(), 1, r.second.first.size());
+            file.Write("\t", 1, 1);
+            file.Write(r.second.second.c_str(), 1, r.second.second.size());
+            file.Write("\n", 1, 1);
+        }
+    }
+
+    auto ShaderPrecompiler::Execute(unsigned maxInFlight) -> Result
+    {
+        Result result;
+        result._compiled = result._alreadyInArchive = result._failed = 0;
+
+        if (!maxInFlight)
+            maxInFlight = 4 * std::max(1u, ConsoleRig::GlobalServices::GetLongTaskThreadPool().GetWorkerCount());
+
+            //  Compiles are pushed through the normal intermediate asset path (so the results
+            //  end up in exactly the same archive, with the same id, that the runtime will look
+            //  for). The compile itself happens in the background on the long task pool; we just
+            //  limit the number queued at once, and stall on the oldest when we hit that limit.
+        std::deque<std::shared_ptr<::Assets::PendingCompileMarker>> inFlight;
+        std::vector<std::shared_ptr<::Assets::ArchiveCache>> archives;
+
+        auto retireOldest = [&inFlight, &archives, &result]()
+        {
+            auto marker = std::move(inFlight.front());
+            inFlight.pop_front();
+            if (marker->StallWhilePending() == ::Assets::AssetState::Ready) {
+                ++result._compiled;
+            } else
+                ++result._failed;
+
+            auto& archive = marker->GetLocator()._archive;
+            if (archive && std::find(archives.begin(), archives.end(), archive) == archives.end())
+                archives.push_back(archive);
+        };
+
+        for (const auto& r:_requests) {
+            const ResChar* initializers[] = { r.second.first.c_str(), r.second.second.c_str() };
+            auto marker = _shaderSource->PrepareAsset(
+                CompiledShaderByteCode::CompileProcessType,
+                initializers, dimof(initializers), *_store);
+            if (!marker) continue;      // (null shader)
+
+            auto existing = marker->GetExistingAsset();
+            if (    existing._archive && existing._dependencyValidation
+                &&  existing._dependencyValidation->GetValidationIndex() == 0
+                &&  existing._archive->HasItem(existing._sourceID1)) {
+                ++result._alreadyInArchive;
+                continue;
+            }
+
+            auto pending = marker->InvokeCompile();
+            if (!pending) {
+                ++result._failed;
+                continue;
+            }
+
+            inFlight.push_back(std::move(pending));
+            while (inFlight.size() >= maxInFlight)
+                retireOldest();
+        }
+
+        while (!inFlight.empty())
+            retireOldest();
+
+            // flushing the archives also writes the dependency files for each new shader
+        for (const auto& a:archives)
+            a->FlushToDisk();
+
+        LogInfo << "Shader precompile: " << result._compiled << " compiled, " << result._alreadyInArchive << " already in archive, " << result._failed << " failed";
+        return result;
+    }
+
+    ShaderPrecompiler::ShaderPrecompiler(
+        std::shared_ptr<LocalCompiledShaderSource> shaderSource,
+        const ::Assets::IntermediateAssets::Store& store)
+    : _shaderSource(std::move(shaderSource))
+    , _store(&store)
+    {}
+
+    ShaderPrecompiler::~ShaderPrecompiler() {}
+
+}}
+
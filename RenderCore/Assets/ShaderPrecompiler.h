@@ -0,0 +1,103 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Assets/AssetsCore.h"
+#include "../../Utility/ParameterBox.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <initializer_list>
+
+namespace Assets { namespace IntermediateAssets { class Store; } }
+namespace RenderCore { namespace Techniques { class Technique; } }
+
+namespace RenderCore { namespace Assets
+{
+    class LocalCompiledShaderSource;
+
+        /// <summary>Values to try for technique parameters, when enumerating variations</summary>
+        /// Technique parameters that don't appear in the domain keep their default value.
+    class ShaderVariationDomain
+    {
+    public:
+        void    Add(const utf8 parameterName[], std::initializer_list<const char*> values);
+        void    Add(const utf8 parameterName[], const std::vector<std::string>& values);
+        auto    Find(ParameterBox::ParameterNameHash parameterName) const -> const std::vector<std::string>*;
+
+        ShaderVariationDomain();
+        ~ShaderVariationDomain();
+    private:
+        std::vector<std::pair<ParameterBox::ParameterNameHash, std::vector<std::string>>> _values;
+    };
+
+    /// <summary>Compiles shader variations ahead of time, into the shader archives</summary>
+    /// Normally technique variations are only compiled the first time they are used. That
+    /// can cause hitches when a new variation appears. The precompiler builds a list of
+    /// shader compile requests, and pushes them through the given LocalCompiledShaderSource
+    /// (and so into the same ArchiveCache files the runtime will search). On the next run,
+    /// the requests will be found in the archives.
+    ///
+    /// Requests can come from:
+    ///  <list>
+    ///     <item>technique config files -- we enumerate the permutations of the technique
+    ///         parameters, using the values in a ShaderVariationDomain</item>
+    ///     <item>a list recorded during a previous run (see LocalCompiledShaderSource::SetRequestRecording)</item>
+    ///  </list>
+    ///
+    /// Compiles are run in parallel, on the long task thread pool. The low level compiler
+    /// is whatever the LocalCompiledShaderSource was constructed with; so a stub compiler
+    /// can be used to test the scheduling and archive writing on platforms without
+    /// a shader compiler.
+    class ShaderPrecompiler
+    {
+    public:
+        void    AddRequest(const ::Assets::ResChar initializer[], const ::Assets::ResChar definesTable[]);
+
+        void    AddTechniqueVariations(const Techniques::Technique& technique, const ShaderVariationDomain& domain);
+        void    AddShaderType(const ::Assets::ResChar techniqueConfig[], const ShaderVariationDomain& domain);
+        void    AddTechniqueConfigs(const ::Assets::ResChar baseDirectory[], const ShaderVariationDomain& domain);
+        void    AddRecordedRequests(const LocalCompiledShaderSource& source);
+
+        void    LoadRequestList(const ::Assets::ResChar filename[]);
+        void    SaveRequestList(const ::Assets::ResChar filename[]) const;
+
+        size_t  GetRequestCount() const { return _requests.size(); }
+
+        class Result
+        {
+        public:
+            unsigned _compiled;
+            unsigned _alreadyInArchive;
+            unsigned _failed;
+        };
+
+            /// <summary>Compile all requests that aren't already in the archives</summary>
+            /// Blocks until all compiles are complete, and the archives have been flushed.
+            /// "maxInFlight" limits the number of compiles queued at any one time (0 means
+            /// a default based on the number of worker threads).
+        Result  Execute(unsigned maxInFlight = 0);
+
+        static const unsigned MaxPermutationsPerTechnique = 4096;
+
+        ShaderPrecompiler(
+            std::shared_ptr<LocalCompiledShaderSource> shaderSource,
+            const ::Assets::IntermediateAssets::Store& store);
+        ~ShaderPrecompiler();
+
+        ShaderPrecompiler(const ShaderPrecompiler&) = delete;
+        ShaderPrecompiler& operator=(const ShaderPrecompiler&) = delete;
+    private:
+        using Request = std::pair<::Assets::rstring, ::Assets::rstring>;   // (initializer, defines table)
+        std::vector<std::pair<uint64, Request>> _requests;
+
+        std::shared_ptr<LocalCompiledShaderSource> _shaderSource;
+        const ::Assets::IntermediateAssets::Store* _store;
+    };
+}}
+
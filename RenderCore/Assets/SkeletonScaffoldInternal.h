@@ -38,6 +38,11 @@ namespace RenderCore { namespace Assets
                                             const TransformationParameterSet*   parameterSet,
                                             const DebugIterator& debugIterator) const;
 
+            /// <summary>Generate output transforms for many instances of this skeleton</summary>
+            /// The output for instance "i" begins at output[i*outputCount]
+        void GenerateOutputTransformsBatch( Float4x4 output[], unsigned outputCount,
+                                            IteratorRange<const TransformationParameterSet*const*> parameterSets) const;
+
         class InputInterface
         {
         public:
@@ -63,6 +68,27 @@ namespace RenderCore { namespace Assets
         const InputInterface&   GetInputInterface() const   { return _inputInterface; }
         const OutputInterface&  GetOutputInterface() const  { return _outputInterface; }
 
+            /// <summary>Layout of a TransformationMachine in a BlockFormat::Relative block</summary>
+            /// Skeleton chunks are written in this form from SkeletonVersion 3. The members
+            /// match the absolute layout above, field for field.
+        struct RelativeImage
+        {
+            Serialization::RelativePtr<uint32>                      _commandStream;
+            size_t                                                  _commandStreamSize;
+            unsigned                                                _outputMatrixCount;
+            TransformationParameterSet::RelativeImage               _defaultParameters;
+            Serialization::RelativePtr<InputInterface::Parameter>   _parameters;
+            size_t                                                  _parameterCount;
+            Serialization::RelativePtr<uint64>                      _outputMatrixNames;
+            Serialization::RelativePtr<Float4x4>                    _skeletonInverseBindMatrices;
+            size_t                                                  _outputMatrixNameCount;
+            TransformationProgram::RelativeImage                    _program;
+        };
+
+            /// <summary>Bind to a TransformationMachine in a BlockFormat::Relative block</summary>
+            /// The command stream and the interfaces are used in place, so the block must 
+            /// outlive this object. The default parameters and the program are copied out.
+        explicit TransformationMachine(const RelativeImage& image);
         TransformationMachine();
         ~TransformationMachine();
     protected:
@@ -74,6 +100,8 @@ namespace RenderCore { namespace Assets
         InputInterface      _inputInterface;
         OutputInterface     _outputInterface;
 
+        TransformationProgram   _program;       // (precompiled form of _commandStream)
+
         const uint32*   GetCommandStream()      { return _commandStream; }
         const size_t    GetCommandStreamSize()  { return _commandStreamSize; }
     };
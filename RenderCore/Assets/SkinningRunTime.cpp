@@ -250,6 +250,22 @@ namespace RenderCore { namespace Assets
     {
         if (outputCount < _outputMatrixCount)
             Throw(::Exceptions::BasicLabel("Output buffer to TransformationMachine::GenerateOutputTransforms is too small"));
+
+            // Prefer the precompiled program, when we have one. It needs working space
+            // for every node; most skeletons will fit in the fixed size buffer
+        if (!_program.IsEmpty()) {
+            const auto nodeCount = _program.GetNodeCount();
+            Float4x4 fixedWorkingSpace[256];
+            std::unique_ptr<Float4x4[]> heapWorkingSpace;
+            auto workingSpace = MakeIteratorRange(fixedWorkingSpace);
+            if (nodeCount > dimof(fixedWorkingSpace)) {
+                heapWorkingSpace = std::make_unique<Float4x4[]>(nodeCount);
+                workingSpace = MakeIteratorRange(heapWorkingSpace.get(), &heapWorkingSpace[nodeCount]);
+            }
+            _program.GenerateOutputTransforms(output, outputCount, parameterSet, workingSpace);
+            return;
+        }
+
         GenerateOutputTransformsFree(
             output, outputCount, parameterSet, 
             MakeIteratorRange(_commandStream, _commandStream + _commandStreamSize));
@@ -268,6 +284,17 @@ namespace RenderCore { namespace Assets
             debugIterator);
     }
 
+    void TransformationMachine::GenerateOutputTransformsBatch(
+        Float4x4 output[], unsigned outputCount,
+        IteratorRange<const TransformationParameterSet*const*> parameterSets) const
+    {
+        if (outputCount < _outputMatrixCount)
+            Throw(::Exceptions::BasicLabel("Output buffer to TransformationMachine::GenerateOutputTransformsBatch is too small"));
+        GenerateOutputTransformsBatch(
+            output, outputCount, parameterSets,
+            MakeIteratorRange(_commandStream, _commandStream + _commandStreamSize));
+    }
+
     TransformationMachine::TransformationMachine()
     {
         _commandStream = nullptr;
@@ -275,6 +302,22 @@ namespace RenderCore { namespace Assets
         _outputMatrixCount = 0;
     }
 
+    TransformationMachine::TransformationMachine(const RelativeImage& image)
+    : _defaultParameters(image._defaultParameters)
+    , _program(image._program)
+    {
+            //  (these members are shared with the absolute format, which is why they aren't
+            //  const. But nothing writes through them)
+        _commandStream = const_cast<uint32*>(image._commandStream.get());
+        _commandStreamSize = image._commandStreamSize;
+        _outputMatrixCount = image._outputMatrixCount;
+        _inputInterface._parameters = const_cast<InputInterface::Parameter*>(image._parameters.get());
+        _inputInterface._parameterCount = image._parameterCount;
+        _outputInterface._outputMatrixNames = const_cast<uint64*>(image._outputMatrixNames.get());
+        _outputInterface._skeletonInverseBindMatrices = const_cast<Float4x4*>(image._skeletonInverseBindMatrices.get());
+        _outputInterface._outputMatrixNameCount = image._outputMatrixNameCount;
+    }
+
     TransformationMachine::~TransformationMachine()
     {
     }
@@ -308,7 +351,7 @@ namespace RenderCore { namespace Assets
         }
     }
 
-    static void WriteJointTransforms(   Float3x4 destination[], size_t destinationCount,
+    void WriteJointTransforms(          Float3x4 destination[], size_t destinationCount,
                                         const BoundSkinnedGeometry& controller,
                                         const Float4x4              transformationMachineResult[],
                                         const SkeletonBinding&      skeletonBinding)
@@ -897,6 +940,11 @@ namespace RenderCore { namespace Assets
     void SkinPrepareMachine::PrepareAnimation(   
             Metal::DeviceContext* context, 
             ModelRenderer::PreparedAnimation& state) const
+    {
+        PrepareAnimation(state);
+    }
+
+    void SkinPrepareMachine::PrepareAnimation(ModelRenderer::PreparedAnimation& state) const
     {
         auto& skeleton = *_pimpl->_transMachine;
             
@@ -958,18 +1006,24 @@ namespace RenderCore { namespace Assets
     const TransformationMachine&   SkeletonScaffold::GetTransformationMachine() const                
     {
         Resolve(); 
+        if (_relativeMachine) return *_relativeMachine;
         return *(const TransformationMachine*)Serialization::Block_GetFirstObject(_rawMemoryBlock.get());
     }
 
     const TransformationMachine*   SkeletonScaffold::TryImmutableData() const
     {
+        if (_relativeMachine) return _relativeMachine.get();
         if (!_rawMemoryBlock) return nullptr;
         return (const TransformationMachine*)Serialization::Block_GetFirstObject(_rawMemoryBlock.get());
     }
 
+        //  Skeleton chunks before version 3 were written with BlockFormat::Absolute. We can 
+        //  still load those; the resolver picks the format from the chunk version
+    static const unsigned SkeletonVersion_Absolute = 2;
+
     static const ::Assets::AssetChunkRequest SkeletonScaffoldChunkRequests[]
     {
-        ::Assets::AssetChunkRequest { "Scaffold", ChunkType_Skeleton, 0, ::Assets::AssetChunkRequest::DataType::BlockSerializer },
+        ::Assets::AssetChunkRequest { "Scaffold", ChunkType_Skeleton, ::Assets::AssetChunkRequest::AnyVersion, ::Assets::AssetChunkRequest::DataType::Raw },
     };
     
     SkeletonScaffold::SkeletonScaffold(const ::Assets::ResChar filename[])
@@ -987,17 +1041,21 @@ namespace RenderCore { namespace Assets
     SkeletonScaffold::SkeletonScaffold(SkeletonScaffold&& moveFrom)
     : ::Assets::ChunkFileAsset(std::move(moveFrom)) 
     , _rawMemoryBlock(std::move(moveFrom._rawMemoryBlock))
+    , _relativeMachine(std::move(moveFrom._relativeMachine))
     {}
 
     SkeletonScaffold& SkeletonScaffold::operator=(SkeletonScaffold&& moveFrom)
     {
         ::Assets::ChunkFileAsset::operator=(std::move(moveFrom));
+        _relativeMachine = std::move(moveFrom._relativeMachine);
         _rawMemoryBlock = std::move(moveFrom._rawMemoryBlock);
         return *this;
     }
 
     SkeletonScaffold::~SkeletonScaffold()
     {
+            // (only the absolute format has an object constructed within the block)
+        if (_relativeMachine) return;
         auto* data = TryImmutableData();
         if (data)
             data->~TransformationMachine();
@@ -1007,7 +1065,20 @@ namespace RenderCore { namespace Assets
     {
         auto* scaffold = (SkeletonScaffold*)obj;
         if (scaffold) {
-            scaffold->_rawMemoryBlock = std::move(chunks[0]._buffer);
+            auto& chunk = chunks[0];
+            if (chunk._version == SkeletonVersion) {
+                    // relative blocks need no Block_Initialize; we just bind to the block in place
+                const auto& image = *(const TransformationMachine::RelativeImage*)Serialization::Block_GetFirstObject(chunk._buffer.get());
+                scaffold->_relativeMachine = std::make_unique<TransformationMachine>(image);
+            } else if (chunk._version == SkeletonVersion_Absolute) {
+                Serialization::Block_Initialize(chunk._buffer.get());
+            } else {
+                Throw(::Assets::Exceptions::FormatError(
+                    ::Assets::Exceptions::FormatError::Reason::UnsupportedVersion,
+                    "Skeleton chunk is an unsupported version (%u) in file (%s)", 
+                    chunk._version, scaffold->Filename().c_str()));
+            }
+            scaffold->_rawMemoryBlock = std::move(chunk._buffer);
         }
     }
 
@@ -1027,7 +1098,7 @@ namespace RenderCore { namespace Assets
 
     static const ::Assets::AssetChunkRequest AnimationSetScaffoldChunkRequests[]
     {
-        ::Assets::AssetChunkRequest { "Scaffold", ChunkType_AnimationSet, 0, ::Assets::AssetChunkRequest::DataType::BlockSerializer },
+        ::Assets::AssetChunkRequest { "Scaffold", ChunkType_AnimationSet, AnimationSetVersion, ::Assets::AssetChunkRequest::DataType::BlockSerializer },
     };
     
     AnimationSetScaffold::AnimationSetScaffold(const ::Assets::ResChar filename[])
@@ -6,6 +6,8 @@
 
 #include "TransformationCommands.h"
 #include "../../ConsoleRig/Log.h"
+#include <smmintrin.h>
+#include <algorithm>
 
 #pragma warning(disable:4127)
 #pragma warning(disable:4505)       // unreferenced function removed
@@ -1031,6 +1033,681 @@ namespace RenderCore { namespace Assets
 
         ///////////////////////////////////////////////////////
 
+        //  Batched interpreter. We process 4 instances at a time in SSE registers.
+        //  The working transforms are stored "instance interleaved" -- each
+        //  __m128 holds the same matrix element for 4 different instances. This
+        //  way, the math is identical for every lane, and we never need to 
+        //  shuffle within a register.
+        //  Note that all transforms in the command stream right-multiply the
+        //  working transform (ie, W' = W * T). The kernels below follow the 
+        //  scalar Combine_InPlace() implementations, so rows that the scalar 
+        //  path doesn't touch aren't touched here either.
+    static const unsigned BatchWidth = 4;
+
+    class Float4x4x4
+    {
+    public:
+        __m128 _m[4][4];
+    };
+
+    static void BroadcastMatrix(Float4x4x4& dst, const Float4x4& src)
+    {
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                dst._m[r][c] = _mm_set1_ps(src(r,c));
+    }
+
+    static void InterleaveMatrices(Float4x4x4& dst, const Float4x4* src[BatchWidth])
+    {
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                dst._m[r][c] = _mm_setr_ps((*src[0])(r,c), (*src[1])(r,c), (*src[2])(r,c), (*src[3])(r,c));
+    }
+
+    static void DeinterleaveMatrix(Float4x4* dst[BatchWidth], unsigned laneCount, const Float4x4x4& src)
+    {
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c) {
+                float temp[BatchWidth];
+                _mm_storeu_ps(temp, src._m[r][c]);
+                for (unsigned l=0; l<laneCount; ++l)
+                    (*dst[l])(r,c) = temp[l];
+            }
+    }
+
+    static void Multiply_InPlace(Float4x4x4& W, const Float4x4x4& T)
+    {
+        for (unsigned r=0; r<4; ++r) {
+            auto w0 = W._m[r][0], w1 = W._m[r][1], w2 = W._m[r][2], w3 = W._m[r][3];
+            for (unsigned c=0; c<4; ++c) {
+                auto a = _mm_add_ps(_mm_mul_ps(w0, T._m[0][c]), _mm_mul_ps(w1, T._m[1][c]));
+                auto b = _mm_add_ps(_mm_mul_ps(w2, T._m[2][c]), _mm_mul_ps(w3, T._m[3][c]));
+                W._m[r][c] = _mm_add_ps(a, b);
+            }
+        }
+    }
+
+    static void Translate_InPlace(Float4x4x4& W, __m128 t0, __m128 t1, __m128 t2)
+    {
+        for (unsigned r=0; r<4; ++r) {
+            auto a = _mm_add_ps(_mm_mul_ps(W._m[r][0], t0), _mm_mul_ps(W._m[r][1], t1));
+            auto b = _mm_add_ps(_mm_mul_ps(W._m[r][2], t2), W._m[r][3]);
+            W._m[r][3] = _mm_add_ps(a, b);
+        }
+    }
+
+    static void Scale_InPlace(Float4x4x4& W, __m128 s0, __m128 s1, __m128 s2)
+    {
+        for (unsigned r=0; r<3; ++r) {
+            W._m[r][0] = _mm_mul_ps(W._m[r][0], s0);
+            W._m[r][1] = _mm_mul_ps(W._m[r][1], s1);
+            W._m[r][2] = _mm_mul_ps(W._m[r][2], s2);
+        }
+    }
+
+        // rotation in the plane of columns "a" & "b" (sine must be negated for rotations around Y)
+    static void RotatePlane_InPlace(Float4x4x4& W, unsigned a, unsigned b, __m128 cosine, __m128 sine)
+    {
+        for (unsigned r=0; r<3; ++r) {
+            auto wa = W._m[r][a], wb = W._m[r][b];
+            W._m[r][a] = _mm_add_ps(_mm_mul_ps(wa, cosine), _mm_mul_ps(wb, sine));
+            W._m[r][b] = _mm_sub_ps(_mm_mul_ps(wb, cosine), _mm_mul_ps(wa, sine));
+        }
+    }
+
+    static void SinCosLanes(__m128& sine, __m128& cosine, const float degrees[BatchWidth], bool negateSine)
+    {
+        float s[BatchWidth], c[BatchWidth];
+        for (unsigned l=0; l<BatchWidth; ++l) {
+            std::tie(s[l], c[l]) = XlSinCos(Deg2Rad(degrees[l]));
+            if (negateSine) s[l] = -s[l];
+        }
+        sine = _mm_loadu_ps(s);
+        cosine = _mm_loadu_ps(c);
+    }
+
+    template<typename Type>
+        static bool GatherParameters(
+            Type dst[BatchWidth], uint32 parameterIndex, 
+            const TransformationParameterSet* parameterSets[BatchWidth],
+            const Type* (TransformationParameterSet::*getter)() const,
+            size_t (TransformationParameterSet::*counter)() const,
+            const Type& defaultValue)
+    {
+        bool good = true;
+        for (unsigned l=0; l<BatchWidth; ++l) {
+            const auto* set = parameterSets[l];
+            if (set && parameterIndex < (set->*counter)()) {
+                dst[l] = (set->*getter)()[parameterIndex];
+            } else {
+                dst[l] = defaultValue;
+                good = false;
+            }
+        }
+        return good;
+    }
+
+    static bool GatherFloat1s(float dst[BatchWidth], uint32 index, const TransformationParameterSet* sets[BatchWidth], float def)
+    {
+        return GatherParameters<float>(dst, index, sets, &TransformationParameterSet::GetFloat1Parameters, &TransformationParameterSet::GetFloat1ParametersCount, def);
+    }
+
+    static bool GatherFloat3s(Float3 dst[BatchWidth], uint32 index, const TransformationParameterSet* sets[BatchWidth], Float3 def)
+    {
+        return GatherParameters<Float3>(dst, index, sets, &TransformationParameterSet::GetFloat3Parameters, &TransformationParameterSet::GetFloat3ParametersCount, def);
+    }
+
+    static bool GatherFloat4s(Float4 dst[BatchWidth], uint32 index, const TransformationParameterSet* sets[BatchWidth], Float4 def)
+    {
+        return GatherParameters<Float4>(dst, index, sets, &TransformationParameterSet::GetFloat4Parameters, &TransformationParameterSet::GetFloat4ParametersCount, def);
+    }
+
+    static bool GatherFloat4x4s(Float4x4 dst[BatchWidth], uint32 index, const TransformationParameterSet* sets[BatchWidth])
+    {
+        return GatherParameters<Float4x4>(dst, index, sets, &TransformationParameterSet::GetFloat4x4Parameters, &TransformationParameterSet::GetFloat4x4ParametersCount, Identity<Float4x4>());
+    }
+
+    static void GenerateOutputTransformsBatch_Int(
+        Float4x4*                                   results[BatchWidth],
+        unsigned                                    laneCount,
+        size_t                                      resultCount,
+        const TransformationParameterSet*           parameterSets[BatchWidth],
+        IteratorRange<const uint32*>                commandStream)
+    {
+        for (unsigned l=0; l<laneCount; ++l)
+            std::fill(results[l], &results[l][resultCount], Identity<Float4x4>());
+
+        Float4x4x4 workingStack[64];
+        Float4x4x4* workingTransform = workingStack;
+        BroadcastMatrix(*workingTransform, Identity<Float4x4>());
+
+        float       float1s[BatchWidth];
+        Float3      float3s[BatchWidth];
+        Float4      float4s[BatchWidth];
+        Float4x4    float4x4s[BatchWidth];
+        Float4x4x4  temp;
+
+        for (auto i=commandStream.cbegin(); i!=commandStream.cend();) {
+            auto commandIndex = *i++;
+            switch ((TransformStackCommand)commandIndex) {
+            case TransformStackCommand::PushLocalToWorld:
+                if ((workingTransform+1) >= &workingStack[dimof(workingStack)])
+                    Throw(::Exceptions::BasicLabel("Exceeded maximum stack depth in GenerateOutputTransformsBatch"));
+                *(workingTransform+1) = *workingTransform;
+                ++workingTransform;
+                break;
+
+            case TransformStackCommand::PopLocalToWorld:
+                {
+                    auto popCount = *i++;
+                    if (workingTransform < workingStack+popCount)
+                        Throw(::Exceptions::BasicLabel("Stack underflow in GenerateOutputTransformsBatch"));
+                    workingTransform -= popCount;
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4_Static:
+                BroadcastMatrix(temp, *reinterpret_cast<const Float4x4*>(AsPointer(i)));
+                Multiply_InPlace(*workingTransform, temp);
+                i += 16;
+                break;
+
+            case TransformStackCommand::Translate_Static:
+                {
+                    auto* f = reinterpret_cast<const float*>(AsPointer(i));
+                    Translate_InPlace(*workingTransform, _mm_set1_ps(f[0]), _mm_set1_ps(f[1]), _mm_set1_ps(f[2]));
+                    i += 3;
+                }
+                break;
+
+            case TransformStackCommand::RotateX_Static:
+            case TransformStackCommand::RotateY_Static:
+            case TransformStackCommand::RotateZ_Static:
+                {
+                    auto cmd = (TransformStackCommand)commandIndex;
+                    float sine, cosine;
+                    std::tie(sine, cosine) = XlSinCos(Deg2Rad(*reinterpret_cast<const float*>(AsPointer(i))));
+                    if (cmd == TransformStackCommand::RotateX_Static)       RotatePlane_InPlace(*workingTransform, 1, 2, _mm_set1_ps(cosine), _mm_set1_ps(sine));
+                    else if (cmd == TransformStackCommand::RotateY_Static)  RotatePlane_InPlace(*workingTransform, 0, 2, _mm_set1_ps(cosine), _mm_set1_ps(-sine));
+                    else                                                    RotatePlane_InPlace(*workingTransform, 0, 1, _mm_set1_ps(cosine), _mm_set1_ps(sine));
+                    i++;
+                }
+                break;
+
+            case TransformStackCommand::Rotate_Static:
+                {
+                    auto* f = reinterpret_cast<const float*>(AsPointer(i));
+                    BroadcastMatrix(temp, AsFloat4x4(MakeRotationMatrix(AsFloat3(f), Deg2Rad(f[3]))));
+                    Multiply_InPlace(*workingTransform, temp);
+                    i += 4;
+                }
+                break;
+
+            case TransformStackCommand::UniformScale_Static:
+                {
+                    auto s = _mm_set1_ps(*reinterpret_cast<const float*>(AsPointer(i)));
+                    Scale_InPlace(*workingTransform, s, s, s);
+                    i++;
+                }
+                break;
+
+            case TransformStackCommand::ArbitraryScale_Static:
+                {
+                    auto* f = reinterpret_cast<const float*>(AsPointer(i));
+                    Scale_InPlace(*workingTransform, _mm_set1_ps(f[0]), _mm_set1_ps(f[1]), _mm_set1_ps(f[2]));
+                    i += 3;
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4_Parameter:
+                {
+                    uint32 parameterIndex = *i++;
+                    if (!GatherFloat4x4s(float4x4s, parameterIndex, parameterSets))
+                        LogWarning << "Warning -- bad parameter index for TransformFloat4x4_Parameter command (" << parameterIndex << ")";
+                    const Float4x4* src[BatchWidth] = { &float4x4s[0], &float4x4s[1], &float4x4s[2], &float4x4s[3] };
+                    InterleaveMatrices(temp, src);
+                    Multiply_InPlace(*workingTransform, temp);
+                }
+                break;
+
+            case TransformStackCommand::Translate_Parameter:
+                {
+                    uint32 parameterIndex = *i++;
+                    if (!GatherFloat3s(float3s, parameterIndex, parameterSets, Zero<Float3>()))
+                        LogWarning << "Warning -- bad parameter index for Translate_Parameter command (" << parameterIndex << ")";
+                    Translate_InPlace(
+                        *workingTransform,
+                        _mm_setr_ps(float3s[0][0], float3s[1][0], float3s[2][0], float3s[3][0]),
+                        _mm_setr_ps(float3s[0][1], float3s[1][1], float3s[2][1], float3s[3][1]),
+                        _mm_setr_ps(float3s[0][2], float3s[1][2], float3s[2][2], float3s[3][2]));
+                }
+                break;
+
+            case TransformStackCommand::RotateX_Parameter:
+            case TransformStackCommand::RotateY_Parameter:
+            case TransformStackCommand::RotateZ_Parameter:
+                {
+                    auto cmd = (TransformStackCommand)commandIndex;
+                    uint32 parameterIndex = *i++;
+                    if (!GatherFloat1s(float1s, parameterIndex, parameterSets, 0.f))
+                        LogWarning << "Warning -- bad parameter index for rotation parameter command (" << parameterIndex << ")";
+                    __m128 sine, cosine;
+                    SinCosLanes(sine, cosine, float1s, cmd == TransformStackCommand::RotateY_Parameter);
+                    if (cmd == TransformStackCommand::RotateX_Parameter)        RotatePlane_InPlace(*workingTransform, 1, 2, cosine, sine);
+                    else if (cmd == TransformStackCommand::RotateY_Parameter)   RotatePlane_InPlace(*workingTransform, 0, 2, cosine, sine);
+                    else                                                        RotatePlane_InPlace(*workingTransform, 0, 1, cosine, sine);
+                }
+                break;
+
+            case TransformStackCommand::Rotate_Parameter:
+                {
+                    uint32 parameterIndex = *i++;
+                    if (!GatherFloat4s(float4s, parameterIndex, parameterSets, Float4(0.f, 0.f, 1.f, 0.f)))
+                        LogWarning << "Warning -- bad parameter index for Rotate_Parameter command (" << parameterIndex << ")";
+                    for (unsigned l=0; l<BatchWidth; ++l)
+                        float4x4s[l] = AsFloat4x4(MakeRotationMatrix(Truncate(float4s[l]), Deg2Rad(float4s[l][3])));
+                    const Float4x4* src[BatchWidth] = { &float4x4s[0], &float4x4s[1], &float4x4s[2], &float4x4s[3] };
+                    InterleaveMatrices(temp, src);
+                    Multiply_InPlace(*workingTransform, temp);
+                }
+                break;
+
+            case TransformStackCommand::UniformScale_Parameter:
+                {
+                    uint32 parameterIndex = *i++;
+                    if (!GatherFloat1s(float1s, parameterIndex, parameterSets, 1.f))
+                        LogWarning << "Warning -- bad parameter index for UniformScale_Parameter command (" << parameterIndex << ")";
+                    auto s = _mm_loadu_ps(float1s);
+                    Scale_InPlace(*workingTransform, s, s, s);
+                }
+                break;
+
+            case TransformStackCommand::ArbitraryScale_Parameter:
+                {
+                    uint32 parameterIndex = *i++;
+                    if (!GatherFloat3s(float3s, parameterIndex, parameterSets, Float3(1.f, 1.f, 1.f)))
+                        LogWarning << "Warning -- bad parameter index for ArbitraryScale_Parameter command (" << parameterIndex << ")";
+                    Scale_InPlace(
+                        *workingTransform,
+                        _mm_setr_ps(float3s[0][0], float3s[1][0], float3s[2][0], float3s[3][0]),
+                        _mm_setr_ps(float3s[0][1], float3s[1][1], float3s[2][1], float3s[3][1]),
+                        _mm_setr_ps(float3s[0][2], float3s[1][2], float3s[2][2], float3s[3][2]));
+                }
+                break;
+
+            case TransformStackCommand::WriteOutputMatrix:
+                {
+                    uint32 outputIndex = *i++;
+                    if (outputIndex < resultCount) {
+                        Float4x4* dst[BatchWidth] = { &results[0][outputIndex], &results[1][outputIndex], &results[2][outputIndex], &results[3][outputIndex] };
+                        DeinterleaveMatrix(dst, laneCount, *workingTransform);
+                    } else
+                        LogWarning << "Warning -- bad output matrix index (" << outputIndex << ")";
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4AndWrite_Static:
+            case TransformStackCommand::TransformFloat4x4AndWrite_Parameter:
+                {
+                    auto cmd = (TransformStackCommand)commandIndex;
+                    uint32 outputIndex = *i++;
+                    if (cmd == TransformStackCommand::TransformFloat4x4AndWrite_Static) {
+                        BroadcastMatrix(temp, *reinterpret_cast<const Float4x4*>(AsPointer(i)));
+                        i += 16;
+                    } else {
+                        uint32 parameterIndex = *i++;
+                        if (!GatherFloat4x4s(float4x4s, parameterIndex, parameterSets))
+                            LogWarning << "Warning -- bad parameter index for TransformFloat4x4AndWrite_Parameter command (" << parameterIndex << ")";
+                        const Float4x4* src[BatchWidth] = { &float4x4s[0], &float4x4s[1], &float4x4s[2], &float4x4s[3] };
+                        InterleaveMatrices(temp, src);
+                    }
+
+                    if (outputIndex < resultCount) {
+                        Float4x4x4 combined = *workingTransform;
+                        Multiply_InPlace(combined, temp);
+                        Float4x4* dst[BatchWidth] = { &results[0][outputIndex], &results[1][outputIndex], &results[2][outputIndex], &results[3][outputIndex] };
+                        DeinterleaveMatrix(dst, laneCount, combined);
+                    } else
+                        LogWarning << "Warning -- bad output matrix index in TransformFloat4x4AndWrite command (" << outputIndex << ")";
+                }
+                break;
+
+            case TransformStackCommand::Comment:
+                i+=64/4;
+                break;
+            }
+        }
+    }
+
+    void GenerateOutputTransformsBatch(
+        Float4x4                                    result[],
+        size_t                                      resultCount,
+        IteratorRange<const TransformationParameterSet*const*> parameterSets,
+        IteratorRange<const uint32*>                commandStream)
+    {
+        for (size_t base=0; base<parameterSets.size(); base+=BatchWidth) {
+            auto laneCount = (unsigned)std::min(parameterSets.size()-base, size_t(BatchWidth));
+
+                // Partial batches just repeat the last instance in the unused lanes
+                // (those lanes are never written to the output)
+            const TransformationParameterSet* sets[BatchWidth];
+            Float4x4* results[BatchWidth];
+            for (unsigned l=0; l<BatchWidth; ++l) {
+                auto src = base + std::min(l, laneCount-1);
+                sets[l] = parameterSets[src];
+                results[l] = &result[src * resultCount];
+            }
+
+            GenerateOutputTransformsBatch_Int(results, laneCount, resultCount, sets, commandStream);
+        }
+    }
+
+        ///////////////////////////////////////////////////////
+
+    void TransformationProgram::GenerateOutputTransforms(
+        Float4x4                            result[],
+        size_t                              resultCount,
+        const TransformationParameterSet*   parameterSet,
+        IteratorRange<Float4x4*>            workingSpace) const
+    {
+        const auto nodeCount = _parents.size();
+        if (workingSpace.size() < nodeCount)
+            Throw(::Exceptions::BasicLabel("Working space too small in TransformationProgram::GenerateOutputTransforms"));
+
+            //  First, build the local transforms for every node. Static nodes are
+            //  just a copy; animated nodes are built with one loop per op type.
+        Float4x4* nodes = workingSpace.begin();
+        std::copy(_staticLocals.cbegin(), _staticLocals.cend(), nodes);
+
+        const float*    float1s = nullptr;
+        const Float3*   float3s = nullptr;
+        const Float4*   float4s = nullptr;
+        const Float4x4* float4x4s = nullptr;
+        size_t    float1Count = 0, float3Count = 0, float4Count = 0, float4x4Count = 0;
+        if (parameterSet) {
+            float1s         = parameterSet->GetFloat1Parameters();
+            float3s         = parameterSet->GetFloat3Parameters();
+            float4s         = parameterSet->GetFloat4Parameters();
+            float4x4s       = parameterSet->GetFloat4x4Parameters();
+            float1Count     = parameterSet->GetFloat1ParametersCount();
+            float3Count     = parameterSet->GetFloat3ParametersCount();
+            float4Count     = parameterSet->GetFloat4ParametersCount();
+            float4x4Count   = parameterSet->GetFloat4x4ParametersCount();
+        }
+
+            //  Bad parameter indices leave the local transform as identity (which is the
+            //  same as the interpreter skipping the command)
+        bool badParameter = false;
+        for (const auto& op:_parameterOps[OpType::TransformFloat4x4]) {
+            if (op.second < float4x4Count)  nodes[op.first] = float4x4s[op.second];
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::Translate]) {
+            if (op.second < float3Count)    nodes[op.first] = AsFloat4x4(float3s[op.second]);
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::RotateX]) {
+            if (op.second < float1Count)    nodes[op.first] = AsFloat4x4(RotationX(Deg2Rad(float1s[op.second])));
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::RotateY]) {
+            if (op.second < float1Count)    nodes[op.first] = AsFloat4x4(RotationY(Deg2Rad(float1s[op.second])));
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::RotateZ]) {
+            if (op.second < float1Count)    nodes[op.first] = AsFloat4x4(RotationZ(Deg2Rad(float1s[op.second])));
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::Rotate]) {
+            if (op.second < float4Count)    nodes[op.first] = AsFloat4x4(MakeRotationMatrix(Truncate(float4s[op.second]), Deg2Rad(float4s[op.second][3])));
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::UniformScale]) {
+            if (op.second < float1Count)    nodes[op.first] = AsFloat4x4(UniformScale(float1s[op.second]));
+            else                            badParameter = true;
+        }
+        for (const auto& op:_parameterOps[OpType::ArbitraryScale]) {
+            if (op.second < float3Count)    nodes[op.first] = AsFloat4x4(ArbitraryScale(float3s[op.second]));
+            else                            badParameter = true;
+        }
+        if (badParameter)
+            LogWarning << "Warning -- bad parameter index in TransformationProgram::GenerateOutputTransforms";
+
+            //  Parents always come before their children, so a single pass 
+            //  resolves the full hierarchy.
+        for (size_t n=1; n<nodeCount; ++n)
+            nodes[n] = Combine(nodes[n], nodes[_parents[n]]);
+
+        auto outputCount = std::min(resultCount, _outputNodes.size());
+        for (size_t o=0; o<outputCount; ++o)
+            result[o] = nodes[_outputNodes[o]];
+        std::fill(&result[outputCount], &result[resultCount], Identity<Float4x4>());
+
+        for (const auto& w:_conditionalOutputs) {
+            const auto& op = _parameterOps[OpType::TransformFloat4x4][w.second];
+            if (w.first < outputCount && op.second < float4x4Count)
+                result[w.first] = nodes[op.first];
+        }
+    }
+
+    void TransformationProgram::Serialize(Serialization::NascentBlockSerializer& outputSerializer) const
+    {
+        ::Serialize(outputSerializer, _parents);
+        ::Serialize(outputSerializer, _staticLocals);
+        for (unsigned c=0; c<dimof(_parameterOps); ++c)
+            ::Serialize(outputSerializer, _parameterOps[c]);
+        ::Serialize(outputSerializer, _outputNodes);
+        ::Serialize(outputSerializer, _conditionalOutputs);
+    }
+
+    TransformationProgram::TransformationProgram() {}
+
+    TransformationProgram::TransformationProgram(const RelativeImage& image)
+    : _parents(image._parents.begin(), image._parents.end())
+    , _staticLocals(image._staticLocals.begin(), image._staticLocals.end())
+    , _outputNodes(image._outputNodes.begin(), image._outputNodes.end())
+    , _conditionalOutputs(image._conditionalOutputs.begin(), image._conditionalOutputs.end())
+    {
+        for (unsigned c=0; c<dimof(_parameterOps); ++c)
+            _parameterOps[c].assign(image._parameterOps[c].begin(), image._parameterOps[c].end());
+    }
+
+    TransformationProgram::TransformationProgram(TransformationProgram&& moveFrom)
+    : _parents(std::move(moveFrom._parents))
+    , _staticLocals(std::move(moveFrom._staticLocals))
+    , _outputNodes(std::move(moveFrom._outputNodes))
+    , _conditionalOutputs(std::move(moveFrom._conditionalOutputs))
+    {
+        for (unsigned c=0; c<dimof(_parameterOps); ++c)
+            _parameterOps[c] = std::move(moveFrom._parameterOps[c]);
+    }
+
+    TransformationProgram& TransformationProgram::operator=(TransformationProgram&& moveFrom)
+    {
+        _parents = std::move(moveFrom._parents);
+        _staticLocals = std::move(moveFrom._staticLocals);
+        for (unsigned c=0; c<dimof(_parameterOps); ++c)
+            _parameterOps[c] = std::move(moveFrom._parameterOps[c]);
+        _outputNodes = std::move(moveFrom._outputNodes);
+        _conditionalOutputs = std::move(moveFrom._conditionalOutputs);
+        return *this;
+    }
+
+    TransformationProgram::~TransformationProgram() {}
+
+    TransformationProgram CompileTransformationMachine(
+        IteratorRange<const uint32*>    commandStream,
+        size_t                          outputMatrixCount)
+    {
+            //  We walk through the command stream once, tracking which node represents
+            //  the working transform at each stack level. Static transforms are merged
+            //  into the current node while it's still "open" (ie, while no other node
+            //  or output refers to it). Every parameter command creates a new node.
+        using OpType = TransformationProgram::OpType;
+        TransformationProgram result;
+        result._parents.push_back(0);
+        result._staticLocals.push_back(Identity<Float4x4>());
+        result._outputNodes.resize(outputMatrixCount, 0);
+
+        uint32 stack[64];
+        unsigned stackDepth = 0;
+        uint32 currentNode = 0;
+        bool currentIsOpen = false;
+
+        auto addNode = [&result](uint32 parent) -> uint32
+            {
+                result._parents.push_back(parent);
+                result._staticLocals.push_back(Identity<Float4x4>());
+                return uint32(result._parents.size()-1);
+            };
+
+        auto addStatic = [&](const Float4x4& transform)
+            {
+                if (!currentIsOpen) {
+                    currentNode = addNode(currentNode);
+                    currentIsOpen = true;
+                }
+                result._staticLocals[currentNode] = Combine(transform, result._staticLocals[currentNode]);
+            };
+
+        auto addParameter = [&](OpType::Enum type, uint32 parameterIndex)
+            {
+                currentNode = addNode(currentNode);
+                currentIsOpen = false;
+                result._parameterOps[type].push_back(std::make_pair(currentNode, parameterIndex));
+            };
+
+        auto setOutput = [&result](uint32 outputIndex, uint32 node)
+            {
+                if (outputIndex < result._outputNodes.size()) {
+                    result._outputNodes[outputIndex] = node;
+                        // (this overrides any earlier conditional writes to the same output)
+                    auto& conditional = result._conditionalOutputs;
+                    conditional.erase(
+                        std::remove_if(conditional.begin(), conditional.end(),
+                            [outputIndex](const std::pair<uint32, uint32>& w) { return w.first == outputIndex; }),
+                        conditional.end());
+                } else
+                    LogWarning << "Warning -- bad output matrix index (" << outputIndex << ")";
+            };
+
+        for (auto i=commandStream.cbegin(); i!=commandStream.cend();) {
+            auto commandIndex = *i++;
+            switch ((TransformStackCommand)commandIndex) {
+            case TransformStackCommand::PushLocalToWorld:
+                if (stackDepth >= dimof(stack))
+                    Throw(::Exceptions::BasicLabel("Exceeded maximum stack depth in CompileTransformationMachine"));
+                stack[stackDepth++] = currentNode;
+                currentIsOpen = false;
+                break;
+
+            case TransformStackCommand::PopLocalToWorld:
+                {
+                    auto popCount = *i++;
+                    if (stackDepth < popCount)
+                        Throw(::Exceptions::BasicLabel("Stack underflow in CompileTransformationMachine"));
+                    stackDepth -= popCount;
+                    currentNode = stack[stackDepth];
+                    currentIsOpen = false;
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4_Static:
+                addStatic(*reinterpret_cast<const Float4x4*>(AsPointer(i)));
+                i += 16;
+                break;
+
+            case TransformStackCommand::Translate_Static:
+                addStatic(AsFloat4x4(AsFloat3(reinterpret_cast<const float*>(AsPointer(i)))));
+                i += 3;
+                break;
+
+            case TransformStackCommand::RotateX_Static:
+                addStatic(AsFloat4x4(RotationX(Deg2Rad(*reinterpret_cast<const float*>(AsPointer(i))))));
+                i++;
+                break;
+
+            case TransformStackCommand::RotateY_Static:
+                addStatic(AsFloat4x4(RotationY(Deg2Rad(*reinterpret_cast<const float*>(AsPointer(i))))));
+                i++;
+                break;
+
+            case TransformStackCommand::RotateZ_Static:
+                addStatic(AsFloat4x4(RotationZ(Deg2Rad(*reinterpret_cast<const float*>(AsPointer(i))))));
+                i++;
+                break;
+
+            case TransformStackCommand::Rotate_Static:
+                {
+                    auto* f = reinterpret_cast<const float*>(AsPointer(i));
+                    addStatic(AsFloat4x4(MakeRotationMatrix(AsFloat3(f), Deg2Rad(f[3]))));
+                    i += 4;
+                }
+                break;
+
+            case TransformStackCommand::UniformScale_Static:
+                addStatic(AsFloat4x4(UniformScale(*reinterpret_cast<const float*>(AsPointer(i)))));
+                i++;
+                break;
+
+            case TransformStackCommand::ArbitraryScale_Static:
+                addStatic(AsFloat4x4(ArbitraryScale(AsFloat3(reinterpret_cast<const float*>(AsPointer(i))))));
+                i += 3;
+                break;
+
+            case TransformStackCommand::TransformFloat4x4_Parameter:    addParameter(OpType::TransformFloat4x4, *i++); break;
+            case TransformStackCommand::Translate_Parameter:            addParameter(OpType::Translate, *i++); break;
+            case TransformStackCommand::RotateX_Parameter:              addParameter(OpType::RotateX, *i++); break;
+            case TransformStackCommand::RotateY_Parameter:              addParameter(OpType::RotateY, *i++); break;
+            case TransformStackCommand::RotateZ_Parameter:              addParameter(OpType::RotateZ, *i++); break;
+            case TransformStackCommand::Rotate_Parameter:               addParameter(OpType::Rotate, *i++); break;
+            case TransformStackCommand::UniformScale_Parameter:         addParameter(OpType::UniformScale, *i++); break;
+            case TransformStackCommand::ArbitraryScale_Parameter:       addParameter(OpType::ArbitraryScale, *i++); break;
+
+            case TransformStackCommand::WriteOutputMatrix:
+                setOutput(*i++, currentNode);
+                currentIsOpen = false;
+                break;
+
+            case TransformStackCommand::TransformFloat4x4AndWrite_Static:
+                {
+                    uint32 outputIndex = *i++;
+                    auto node = addNode(currentNode);
+                    result._staticLocals[node] = *reinterpret_cast<const Float4x4*>(AsPointer(i));
+                    i += 16;
+                    setOutput(outputIndex, node);
+                    currentIsOpen = false;
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4AndWrite_Parameter:
+                {
+                    uint32 outputIndex = *i++;
+                    uint32 parameterIndex = *i++;
+                    auto node = addNode(currentNode);
+                    auto& ops = result._parameterOps[OpType::TransformFloat4x4];
+                    ops.push_back(std::make_pair(node, parameterIndex));
+                        // The interpreter skips this write entirely if the parameter is bad
+                        // (leaving any previous value in the output)
+                    if (outputIndex < result._outputNodes.size()) {
+                        result._conditionalOutputs.push_back(std::make_pair(outputIndex, uint32(ops.size()-1)));
+                    } else
+                        LogWarning << "Warning -- bad output matrix index (" << outputIndex << ")";
+                    currentIsOpen = false;
+                }
+                break;
+
+            case TransformStackCommand::Comment:
+                i+=64/4;
+                break;
+            }
+        }
+
+        return std::move(result);
+    }
+
+        ///////////////////////////////////////////////////////
+
     static void MakeIndentBuffer(char buffer[], unsigned bufferSize, signed identLevel)
     {
         std::fill(buffer, &buffer[std::min(std::max(0,identLevel*2), signed(bufferSize-1))], ' ');
@@ -95,6 +95,20 @@ namespace RenderCore { namespace Assets
 
         void    Serialize(Serialization::NascentBlockSerializer& outputSerializer) const;
 
+        #pragma pack(push)
+        #pragma pack(1)
+            /// <summary>Layout written by Serialize() into a BlockFormat::Relative block</summary>
+        struct RelativeImage
+        {
+            Serialization::RelativeArray<Float4x4>  _float4x4Parameters;
+            Serialization::RelativeArray<Float4>    _float4Parameters;
+            Serialization::RelativeArray<Float3>    _float3Parameters;
+            Serialization::RelativeArray<float>     _float1Parameters;
+        };
+        #pragma pack(pop)
+
+        explicit TransformationParameterSet(const RelativeImage& image);
+
     private:
         SerializableVector<Float4x4>    _float4x4Parameters;
         SerializableVector<Float4>      _float4Parameters;
@@ -117,6 +131,91 @@ namespace RenderCore { namespace Assets
         IteratorRange<const uint32*>                commandStream,
         const std::function<void(const Float4x4&, const Float4x4&)>&     debugIterator);
 
+        /// <summary>Evaluate the same command stream for many instances at once</summary>
+        /// Each instance uses its own parameter set (which can be null). The output is
+        /// written instance by instance, so the results for instance "i" begin at
+        /// result[i*resultCount]. The instances are evaluated in groups using SIMD 
+        /// instructions, so this is much faster than calling GenerateOutputTransformsFree
+        /// for each instance separately.
+    void GenerateOutputTransformsBatch(
+        Float4x4                                    result[],
+        size_t                                      resultCount,
+        IteratorRange<const TransformationParameterSet*const*> parameterSets,
+        IteratorRange<const uint32*>                commandStream);
+
+        //////////////////////////////////////////////////////////
+
+        /// <summary>Transformation machine flattened into a list of nodes</summary>
+        /// The command stream can be "compiled" ahead of time into a list of nodes. Each
+        /// node has a parent (which always comes earlier in the list) and a local transform.
+        /// The local transform is either a precalculated static matrix, or built from a 
+        /// single animation parameter. 
+        /// Evaluation is a single linear pass through the list, with no working stack and
+        /// no dispatch on command type. Node 0 is always the identity root.
+        /// See CompileTransformationMachine()
+    class TransformationProgram
+    {
+    public:
+        struct OpType 
+        { 
+            enum Enum 
+            { 
+                TransformFloat4x4, Translate, RotateX, RotateY, RotateZ, Rotate, UniformScale, ArbitraryScale, 
+                Max 
+            }; 
+        };
+
+        using ParameterOp = std::pair<uint32, uint32>;     // (node index, parameter index)
+
+        void GenerateOutputTransforms(
+            Float4x4                            result[],
+            size_t                              resultCount,
+            const TransformationParameterSet*   parameterSet,
+            IteratorRange<Float4x4*>            workingSpace) const;
+
+        size_t  GetNodeCount() const    { return _parents.size(); }
+        size_t  GetOutputCount() const  { return _outputNodes.size(); }
+        bool    IsEmpty() const         { return _parents.empty(); }
+
+        void    Serialize(Serialization::NascentBlockSerializer& outputSerializer) const;
+
+        #pragma pack(push)
+        #pragma pack(1)
+            /// <summary>Layout written by Serialize() into a BlockFormat::Relative block</summary>
+        struct RelativeImage
+        {
+            Serialization::RelativeArray<uint32>        _parents;
+            Serialization::RelativeArray<Float4x4>      _staticLocals;
+            Serialization::RelativeArray<ParameterOp>   _parameterOps[OpType::Max];
+            Serialization::RelativeArray<uint32>        _outputNodes;
+            Serialization::RelativeArray<std::pair<uint32, uint32>> _conditionalOutputs;
+        };
+        #pragma pack(pop)
+
+        explicit TransformationProgram(const RelativeImage& image);
+        TransformationProgram();
+        TransformationProgram(TransformationProgram&& moveFrom);
+        TransformationProgram& operator=(TransformationProgram&& moveFrom);
+        ~TransformationProgram();
+
+    private:
+        SerializableVector<uint32>      _parents;
+        SerializableVector<Float4x4>    _staticLocals;      // (one per node; identity for animated nodes)
+        SerializableVector<ParameterOp> _parameterOps[OpType::Max];
+        SerializableVector<uint32>      _outputNodes;
+
+            //  TransformFloat4x4AndWrite_Parameter doesn't write anything when the parameter
+            //  is bad. So these writes are conditional. They are applied after _outputNodes,
+            //  in command stream order, only if the parameter is valid.
+        SerializableVector<std::pair<uint32, uint32>> _conditionalOutputs;  // (output index, index into _parameterOps[TransformFloat4x4])
+
+        friend TransformationProgram CompileTransformationMachine(IteratorRange<const uint32*>, size_t);
+    };
+
+    TransformationProgram CompileTransformationMachine(
+        IteratorRange<const uint32*>    commandStream,
+        size_t                          outputMatrixCount);
+
     void TraceTransformationMachine(
         std::ostream&                   outputStream,
         IteratorRange<const uint32*>    commandStream,
@@ -5,6 +5,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "Techniques.h"
+#include "VariationTable.h"
 #include "ParsingContext.h"
 #include "RenderStateResolver.h"
 #include "../Metal/Shader.h"
@@ -22,6 +23,10 @@
 #include "../../Utility/IteratorUtils.h"
 #include "../../Utility/StringUtils.h"
 #include "../../Utility/Conversion.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Utility/Threading/ThreadingUtils.h"
+#include "../../Utility/Threading/Mutex.h"
 #include <algorithm>
 
 namespace RenderCore { namespace Techniques
@@ -131,6 +136,99 @@ namespace RenderCore { namespace Techniques
         return *this;
     }
 
+        ///////////////////////   V A R I A T I O N   C A C H E   ///////////////////////////
+
+    class Technique::VariationCache
+    {
+    public:
+        VariationTable                                  _table;
+
+            //  Everything below is only used while "_lock" is held
+
+        Threading::Mutex                                _lock;
+
+        class DefineTable
+        {
+        public:
+            std::vector<const utf8*>    _names;             // sorted, in the order they appear in the flattened string
+            std::vector<size_t>         _nameLengths;
+            std::vector<std::string>    _defaultValues;
+            std::vector<std::pair<ParameterBox::ParameterNameHash, unsigned>> _nameHashToIndex;
+            unsigned                    _vsModel, _psModel, _gsModel;
+            bool                        _built;
+
+            unsigned Find(ParameterBox::ParameterNameHash nameHash) const;
+        };
+        DefineTable                                     _defines;
+        std::vector<std::pair<uint64, std::unique_ptr<std::string>>> _internedValues;
+
+        std::vector<std::unique_ptr<ResolvedShader>>            _resolvedShaders;
+        std::vector<std::unique_ptr<Metal::ShaderProgram>>      _shaderPrograms;
+        std::vector<std::unique_ptr<Metal::BoundUniforms>>      _boundUniforms;
+        std::vector<std::unique_ptr<Metal::BoundInputLayout>>   _boundInputLayouts;
+
+        void                BuildDefineTable(const ShaderParameters& baseParameters);
+        const std::string&  InternValue(const void* value, const ImpliedTyping::TypeDesc& type);
+
+        VariationCache();
+        ~VariationCache();
+    };
+
+    unsigned Technique::VariationCache::DefineTable::Find(ParameterBox::ParameterNameHash nameHash) const
+    {
+        auto i = LowerBound(_nameHashToIndex, nameHash);
+        if (i != _nameHashToIndex.cend() && i->first == nameHash)
+            return i->second;
+        return ~0u;
+    }
+
+    void Technique::VariationCache::BuildDefineTable(const ShaderParameters& baseParameters)
+    {
+            //  The base parameters don't change after the technique is loaded, so the string
+            //  form of the defaults only needs to be built once. Resolving a variation then just
+            //  selects (interned) strings for the values overridden by the global state.
+        std::vector<std::pair<const utf8*, std::string>> defines;
+        baseParameters.BuildStringTable(defines);
+
+        auto& t = _defines;
+        t._names.reserve(defines.size());
+        t._nameLengths.reserve(defines.size());
+        t._defaultValues.reserve(defines.size());
+        t._nameHashToIndex.reserve(defines.size());
+        for (unsigned c=0; c<unsigned(defines.size()); ++c) {
+            t._names.push_back(defines[c].first);
+            t._nameLengths.push_back(XlStringLen(defines[c].first));
+            t._defaultValues.push_back(std::move(defines[c].second));
+            t._nameHashToIndex.push_back(std::make_pair(ParameterBox::MakeParameterNameHash(defines[c].first), c));
+        }
+        std::sort(
+            t._nameHashToIndex.begin(), t._nameHashToIndex.end(), 
+            CompareFirst<ParameterBox::ParameterNameHash, unsigned>());
+
+        t._vsModel = t.Find(ParameterBox::MakeParameterNameHash("vs_"));
+        t._psModel = t.Find(ParameterBox::MakeParameterNameHash("ps_"));
+        t._gsModel = t.Find(ParameterBox::MakeParameterNameHash("gs_"));
+        t._built = true;
+    }
+
+    const std::string& Technique::VariationCache::InternValue(const void* value, const ImpliedTyping::TypeDesc& type)
+    {
+        auto size = type.GetSize();
+        auto hash = Hash64(value, PtrAdd(value, size), *(const uint32*)&type);
+        auto i = LowerBound(_internedValues, hash);
+        if (i == _internedValues.end() || i->first != hash)
+            i = _internedValues.insert(i, std::make_pair(hash, std::make_unique<std::string>(ImpliedTyping::AsString(value, size, type))));
+        return *i->second;
+    }
+
+    Technique::VariationCache::VariationCache()
+    {
+        _defines._vsModel = _defines._psModel = _defines._gsModel = ~0u;
+        _defines._built = false;
+    }
+
+    Technique::VariationCache::~VariationCache() {}
+
         ///////////////////////   T E C H N I Q U E   I N T E R F A C E   ///////////////////////////
 
     #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
@@ -198,27 +296,35 @@ namespace RenderCore { namespace Techniques
             //                  itself. This could allow us to have different bindings without worrying
             //                  about invoking redundant shader compiles.
             //
-        uint64 inputHash = 0;
-		const bool simpleHash = false;
-		if (constant_expression<simpleHash>::result()) {
-			for (unsigned c = 0; c < ShaderParameters::Source::Max; ++c) {
-				inputHash ^= globalState[c]->GetParameterNamesHash();
-				inputHash ^= globalState[c]->GetHash() << (c * 6);    // we have to be careful of cases where the values in one box is very similar to the values in another
-			}
-		} else {
-			inputHash = HashCombine(globalState[0]->GetHash(), globalState[0]->GetParameterNamesHash());
-			for (unsigned c = 1; c < ShaderParameters::Source::Max; ++c) {
-				inputHash = HashCombine(globalState[c]->GetParameterNamesHash(), inputHash);
-				inputHash = HashCombine(globalState[c]->GetHash(), inputHash);
-			}
-		}
-        
+        const auto& cache = *_variationCache;
+        uint64 boxHashes[VariationTable::BoxHashCount];
+        for (unsigned c = 0; c < ShaderParameters::Source::Max; ++c) {
+            boxHashes[c*2+0] = globalState[c]->GetHash();
+            boxHashes[c*2+1] = globalState[c]->GetParameterNamesHash();
+        }
+
+        #if !defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
+                //  Lock free path (per-thread memo, then the global state table). We only fall 
+                //  through to the slow path if we need to build a new variation (or rebuild one, 
+                //  after a source change)
+            auto* resolved = cache._table.Find(boxHashes, techniqueInterface.GetHashValue());
+            if (resolved) return *resolved;
+        #endif
+
+        return FindVariationSlowPath(VariationTable::CalculateInputHash(boxHashes), globalState, techniqueInterface);
+    }
+
+    const ResolvedShader& Technique::FindVariationSlowPath(
+        uint64 inputHash,
+        const ParameterBox* globalState[ShaderParameters::Source::Max],
+        const TechniqueInterface& techniqueInterface) const
+    {
+        auto& cache = *_variationCache;
+        ScopedLock(cache._lock);
+
         uint64 globalHashWithInterface = inputHash ^ techniqueInterface.GetHashValue();
-        auto i = std::lower_bound(_globalToResolved.begin(), _globalToResolved.end(), globalHashWithInterface, CompareFirst<uint64, ResolvedShader>());
-        if (i!=_globalToResolved.cend() && i->first == globalHashWithInterface) {
-            if (i->second._shaderProgram && (i->second._shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0)) {
-                ResolveAndBind(i->second, globalState, techniqueInterface);
-            }
+        auto* entry = cache._table.FindGlobal(globalHashWithInterface);
+        if (entry) {
 
             #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
                 auto ti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
@@ -227,87 +333,126 @@ namespace RenderCore { namespace Techniques
 
                 OutputDebugString((BuildParamsAsString(_baseParameters, ti->second._globalState) + "\r\n").c_str());
             #endif
-            return i->second;
-        }
-
-        uint64 filteredHashValue = _baseParameters.CalculateFilteredHash(inputHash, globalState);
-        uint64 filteredHashWithInterface = filteredHashValue ^ techniqueInterface.GetHashValue();
-        auto i2 = std::lower_bound(_filteredToResolved.begin(), _filteredToResolved.end(), filteredHashWithInterface, CompareFirst<uint64, ResolvedShader>());
-        if (i2!=_filteredToResolved.cend() && i2->first == filteredHashWithInterface) {
-            _globalToResolved.insert(i, std::make_pair(globalHashWithInterface, i2->second));
-            if (i2->second._shaderProgram && (i2->second._shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0)) {
-                ResolveAndBind(i2->second, globalState, techniqueInterface);
+        } else {
+            uint64 filteredHashValue = _baseParameters.CalculateFilteredHash(inputHash, globalState);
+            uint64 filteredHashWithInterface = filteredHashValue ^ techniqueInterface.GetHashValue();
+            entry = cache._table.FindFiltered(filteredHashWithInterface);
+            if (entry) {
+                #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
+                    auto lti = std::lower_bound(_localToResolvedTest.begin(), _localToResolvedTest.end(), filteredHashWithInterface, CompareFirst<uint64, HashConflictTest>());
+                    assert(lti!=_localToResolvedTest.cend() && lti->first == filteredHashWithInterface);
+                    TestHashConflict(globalState, lti->second);
+
+                    auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
+                    _globalToResolvedTest.insert(gti, std::make_pair(globalHashWithInterface, HashConflictTest(lti->second._globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
+
+                    OutputDebugString((BuildParamsAsString(_baseParameters, lti->second._globalState) + "\r\n").c_str());
+                #endif
+            } else {
+                auto newResolvedShader = std::make_unique<ResolvedShader>();
+                newResolvedShader->_variationHash = filteredHashValue;
+                ResolveAndBind(*newResolvedShader, globalState, techniqueInterface);
+
+                entry = cache._table.InsertFiltered(filteredHashWithInterface, newResolvedShader.get());
+                cache._resolvedShaders.push_back(std::move(newResolvedShader));
+
+                #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
+                    auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
+                    _globalToResolvedTest.insert(gti, std::make_pair(globalHashWithInterface, HashConflictTest(globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
+
+                    auto lti = std::lower_bound(_localToResolvedTest.begin(), _localToResolvedTest.end(), filteredHashWithInterface, CompareFirst<uint64, HashConflictTest>());
+                    _localToResolvedTest.insert(lti, std::make_pair(filteredHashWithInterface, HashConflictTest(globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
+                #endif
             }
 
-            #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
-                auto lti = std::lower_bound(_localToResolvedTest.begin(), _localToResolvedTest.end(), filteredHashWithInterface, CompareFirst<uint64, HashConflictTest>());
-                assert(lti!=_localToResolvedTest.cend() && lti->first == filteredHashWithInterface);
-				TestHashConflict(globalState, lti->second);
+            cache._table.InsertGlobal(globalHashWithInterface, entry);
+        }
 
-                auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
-                _globalToResolvedTest.insert(gti, std::make_pair(globalHashWithInterface, HashConflictTest(lti->second._globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
+            //  If the shader source has changed since this variation was resolved, build
+            //  a replacement and publish it. Readers may still be using the old one, so it
+            //  is retained.
+        auto* resolved = VariationTable::GetCurrent(*entry);
+        if (VariationTable::IsInvalidated(*resolved)) {
+            auto rebuilt = std::make_unique<ResolvedShader>(*resolved);
+            ResolveAndBind(*rebuilt, globalState, techniqueInterface);
+            resolved = rebuilt.get();
+            cache._resolvedShaders.push_back(std::move(rebuilt));
+            VariationTable::Publish(*entry, resolved);
+        }
+        return *resolved;
+    }
 
-                OutputDebugString((BuildParamsAsString(_baseParameters, lti->second._globalState) + "\r\n").c_str());
-            #endif
-            return i2->second;
+    static std::string AsShaderModel(
+        const char prefix[], unsigned defineIndex,
+        const std::vector<const std::string*>& values, const char defaultModel[])
+    {
+        if (defineIndex >= values.size()) return defaultModel;
+        char buffer[32];
+        int integerValue = Utility::XlAtoI32(values[defineIndex]->c_str());
+        sprintf_s(buffer, dimof(buffer), ":%s_%i_%i", prefix, integerValue/10, integerValue%10);
+        return buffer;
+    }
+
+    void        Technique::BuildShaderInitializers( ShaderVariationInitializers& result,
+                                                    const ParameterBox* globalState[ShaderParameters::Source::Max]) const
+    {
+            // (caller must hold the variation cache lock)
+        auto& cache = *_variationCache;
+        auto& defines = cache._defines;
+        if (!defines._built)
+            cache.BuildDefineTable(_baseParameters);
+
+            //  Override the defaults with the global state. Matching is done on the parameter 
+            //  name hashes, and we only select pointers to interned value strings here. The only
+            //  string built is the final flattened one.
+        std::vector<const std::string*> values(defines._names.size());
+        for (size_t c=0; c<values.size(); ++c)
+            values[c] = &defines._defaultValues[c];
+        for (unsigned c=0; c<ShaderParameters::Source::Max; ++c) {
+            for (auto i=globalState[c]->Begin(); !i.IsEnd(); ++i) {
+                auto d = defines.Find(i.HashName());
+                if (d < values.size())
+                    values[d] = &cache.InternValue(i.RawValue(), i.Type());
+            }
         }
 
-        ResolvedShader newResolvedShader;
-        newResolvedShader._variationHash = filteredHashValue;
-        ResolveAndBind(newResolvedShader, globalState, techniqueInterface);
-        _filteredToResolved.insert(i2, std::make_pair(filteredHashWithInterface, newResolvedShader));
-        _globalToResolved.insert(i, std::make_pair(globalHashWithInterface, newResolvedShader));
+        auto& combinedStrings = result._definesTable;
+        combinedStrings.clear();
+        size_t size = 0;
+        for (size_t c=0; c<values.size(); ++c)
+            size += 2 + defines._nameLengths[c] + values[c]->size();
+        combinedStrings.reserve(size+1);
+        for (size_t c=0; c<values.size(); ++c) {
+            combinedStrings.append((const char*)defines._names[c], defines._nameLengths[c]);
+            combinedStrings.push_back('=');
+            combinedStrings.append(*values[c]);
+            combinedStrings.push_back(';');
+        }
 
-        #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
-            auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
-            _globalToResolvedTest.insert(gti, std::make_pair(globalHashWithInterface, HashConflictTest(globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
+        result._vertexShader = _vertexShaderName + AsShaderModel("vs", defines._vsModel, values, ":" VS_DefShaderModel);
+        result._pixelShader = _pixelShaderName + AsShaderModel("ps", defines._psModel, values, ":" PS_DefShaderModel);
+        if (!_geometryShaderName.empty()) {
+            result._geometryShader = _geometryShaderName + AsShaderModel("gs", defines._gsModel, values, ":" GS_DefShaderModel);
+        } else 
+            result._geometryShader.clear();
+    }
 
-            auto lti = std::lower_bound(_localToResolvedTest.begin(), _localToResolvedTest.end(), filteredHashWithInterface, CompareFirst<uint64, HashConflictTest>());
-            _localToResolvedTest.insert(lti, std::make_pair(filteredHashWithInterface, HashConflictTest(globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
-        #endif
-        return newResolvedShader;
+    ShaderVariationInitializers Technique::MakeShaderInitializers(const ParameterBox* globalState[ShaderParameters::Source::Max]) const
+    {
+        ScopedLock(_variationCache->_lock);
+        ShaderVariationInitializers result;
+        BuildShaderInitializers(result, globalState);
+        return std::move(result);
     }
 
     void        Technique::ResolveAndBind(  ResolvedShader& resolvedShader, 
                                             const ParameterBox* globalState[ShaderParameters::Source::Max],
                                             const TechniqueInterface& techniqueInterface) const
     {
-        std::vector<std::pair<const utf8*, std::string>> defines;
-        _baseParameters.BuildStringTable(defines);
-        for (unsigned c=0; c<ShaderParameters::Source::Max; ++c) {
-            OverrideStringTable(defines, *globalState[c]);
-        }
-
-        auto combinedStrings = FlattenStringTable(defines);
-
-        std::string vsShaderModel, psShaderModel, gsShaderModel;
-        auto vsi = std::lower_bound(defines.cbegin(), defines.cend(), (const utf8*)"vs_", CompareFirst<const utf8*, std::string>());
-        if (vsi != defines.cend() && !XlCompareString(vsi->first, (const utf8*)"vs_")) {
-            char buffer[32];
-            int integerValue = Utility::XlAtoI32(vsi->second.c_str());
-            sprintf_s(buffer, dimof(buffer), ":vs_%i_%i", integerValue/10, integerValue%10);
-            vsShaderModel = buffer;
-        } else {
-            vsShaderModel = ":" VS_DefShaderModel;
-        }
-        auto psi = std::lower_bound(defines.cbegin(), defines.cend(), (const utf8*)"ps_", CompareFirst<const utf8*, std::string>());
-        if (psi != defines.cend() && !XlCompareString(psi->first, (const utf8*)"ps_")) {
-            char buffer[32];
-            int integerValue = Utility::XlAtoI32(psi->second.c_str());
-            sprintf_s(buffer, dimof(buffer), ":ps_%i_%i", integerValue/10, integerValue%10);
-            psShaderModel = buffer;
-        } else {
-            psShaderModel = ":" PS_DefShaderModel;
-        }
-        auto gsi = std::lower_bound(defines.cbegin(), defines.cend(), (const utf8*)"gs_", CompareFirst<const utf8*, std::string>());
-        if (gsi != defines.cend() && !XlCompareString(gsi->first, (const utf8*)"gs_")) {
-            char buffer[32];
-            int integerValue = Utility::XlAtoI32(psi->second.c_str());
-            sprintf_s(buffer, dimof(buffer), ":gs_%i_%i", integerValue/10, integerValue%10);
-            gsShaderModel = buffer;
-        } else {
-            gsShaderModel = ":" GS_DefShaderModel;
-        }
+            // (caller must hold the variation cache lock)
+        auto& cache = *_variationCache;
+        ShaderVariationInitializers initializers;
+        BuildShaderInitializers(initializers, globalState);
 
         using namespace Metal;
     
@@ -315,17 +460,17 @@ namespace RenderCore { namespace Techniques
         std::unique_ptr<BoundUniforms> boundUniforms;
         std::unique_ptr<BoundInputLayout> boundInputLayout;
 
-        if (_geometryShaderName.empty()) {
+        if (initializers._geometryShader.empty()) {
             shaderProgram = std::make_unique<ShaderProgram>(
-                (_vertexShaderName + vsShaderModel).c_str(), 
-                (_pixelShaderName + psShaderModel).c_str(), 
-                combinedStrings.c_str());
+                initializers._vertexShader.c_str(), 
+                initializers._pixelShader.c_str(), 
+                initializers._definesTable.c_str());
         } else {
             shaderProgram = std::make_unique<ShaderProgram>(
-                (_vertexShaderName + vsShaderModel).c_str(), 
-                (_geometryShaderName + gsShaderModel).c_str(), 
-                (_pixelShaderName + psShaderModel).c_str(), 
-                combinedStrings.c_str());
+                initializers._vertexShader.c_str(), 
+                initializers._geometryShader.c_str(), 
+                initializers._pixelShader.c_str(), 
+                initializers._definesTable.c_str());
         }
 
         boundUniforms = std::make_unique<BoundUniforms>(std::ref(*shaderProgram));
@@ -346,9 +491,9 @@ namespace RenderCore { namespace Techniques
         resolvedShader._shaderProgram = shaderProgram.get();
         resolvedShader._boundUniforms = boundUniforms.get();
         resolvedShader._boundLayout = boundInputLayout.get();
-        _resolvedShaderPrograms.push_back(std::move(shaderProgram));
-        _resolvedBoundUniforms.push_back(std::move(boundUniforms));
-        _resolvedBoundInputLayouts.push_back(std::move(boundInputLayout));
+        cache._shaderPrograms.push_back(std::move(shaderProgram));
+        cache._boundUniforms.push_back(std::move(boundUniforms));
+        cache._boundInputLayouts.push_back(std::move(boundInputLayout));
     }
 
     static const char* s_parameterBoxNames[] = 
@@ -603,6 +748,7 @@ namespace RenderCore { namespace Techniques
         const std::string& name,
         const ::Assets::DirectorySearchRules* searchRules,
         std::vector<std::shared_ptr<::Assets::DependencyValidation>>* inherited)
+    : _variationCache(std::make_unique<VariationCache>())
     {
             //
             //      There are some parameters that will we always have an effect on the
@@ -676,6 +822,9 @@ namespace RenderCore { namespace Techniques
             for (auto i = s.Begin(); !i.IsEnd(); ++i)
                 d.SetParameter(i.Name(), i.RawValue(), i.Type());
         }
+
+            // the base parameters have changed, so any variations we've resolved are invalid
+        _variationCache = std::make_unique<VariationCache>();
     }
 
 	template<typename Char>
@@ -704,26 +853,24 @@ namespace RenderCore { namespace Techniques
     Technique::Technique(Technique&& moveFrom)
     :   _name(moveFrom._name)
     ,   _baseParameters(std::move(moveFrom._baseParameters))
-    ,   _filteredToResolved(std::move(moveFrom._filteredToResolved))
-    ,   _globalToResolved(std::move(moveFrom._globalToResolved))
     ,   _vertexShaderName(moveFrom._vertexShaderName)
     ,   _pixelShaderName(moveFrom._pixelShaderName)
     ,   _geometryShaderName(moveFrom._geometryShaderName)
+    ,   _variationCache(std::move(moveFrom._variationCache))
     {}
 
     Technique& Technique::operator=(Technique&& moveFrom)
     {
         _name = moveFrom._name;
         _baseParameters = std::move(moveFrom._baseParameters);
-        _filteredToResolved = std::move(moveFrom._filteredToResolved);
-        _globalToResolved = std::move(moveFrom._globalToResolved);
         _vertexShaderName = moveFrom._vertexShaderName;
         _pixelShaderName = moveFrom._pixelShaderName;
         _geometryShaderName = moveFrom._geometryShaderName;
+        _variationCache = std::move(moveFrom._variationCache);
         return *this;
     }
 
-    Technique::Technique() {}
+    Technique::Technique() : _variationCache(std::make_unique<VariationCache>()) {}
     Technique::~Technique() {}
 
 
@@ -740,6 +887,12 @@ namespace RenderCore { namespace Techniques
         return _technique[techniqueIndex].FindVariation(globalState, techniqueInterface);
     }
 
+    const Technique& ShaderType::GetTechnique(unsigned techniqueIndex) const
+    {
+        assert(techniqueIndex < dimof(_technique));
+        return _technique[techniqueIndex];
+    }
+
     T1(Pair) class CompareFirstString
     {
     public:
@@ -113,6 +113,18 @@ namespace RenderCore { namespace Techniques
         friend class Technique; // makes internal structure easier
     };
 
+        /// <summary>Shader initializers and defines table for a technique variation</summary>
+        /// These are the same strings used to construct the shader program for the variation.
+        /// So they can be used to precompile the shaders for a variation offline.
+    class ShaderVariationInitializers
+    {
+    public:
+        ::Assets::rstring   _vertexShader;
+        ::Assets::rstring   _pixelShader;
+        ::Assets::rstring   _geometryShader;        // (empty if there is no geometry shader)
+        std::string         _definesTable;
+    };
+
     // #if defined(_DEBUG)
     //     #define CHECK_TECHNIQUE_HASH_CONFLICTS
     // #endif
@@ -124,6 +136,10 @@ namespace RenderCore { namespace Techniques
             const ParameterBox* globalState[ShaderParameters::Source::Max], 
             const TechniqueInterface& techniqueInterface) const;
 
+        ShaderVariationInitializers MakeShaderInitializers(
+            const ParameterBox* globalState[ShaderParameters::Source::Max]) const;
+        const ShaderParameters& GetBaseParameters() const { return _baseParameters; }
+
         bool IsValid() const { return !_vertexShaderName.empty(); }
         void MergeIn(const Technique& source);
 		void ReplaceSelfReference(StringSection<::Assets::ResChar> filename);
@@ -140,8 +156,6 @@ namespace RenderCore { namespace Techniques
     protected:
         std::string         _name;
         ShaderParameters    _baseParameters;
-        mutable std::vector<std::pair<uint64, ResolvedShader>>  _filteredToResolved;
-        mutable std::vector<std::pair<uint64, ResolvedShader>>  _globalToResolved;
         ::Assets::rstring   _vertexShaderName;
         ::Assets::rstring   _pixelShaderName;
         ::Assets::rstring   _geometryShaderName;
@@ -167,14 +181,26 @@ namespace RenderCore { namespace Techniques
                 const HashConflictTest& comparison) const;
         #endif
 
+            //  Resolved variations are stored in a 2 level lock free hash table
+            //  (global state hash -> filtered state hash -> resolved shader; see
+            //  VariationTable). Only the misses (which require building a new shader)
+            //  take a lock.
+        class VariationCache;
+        std::unique_ptr<VariationCache> _variationCache;
+
+        const ResolvedShader& FindVariationSlowPath(
+            uint64 inputHash,
+            const ParameterBox* globalState[ShaderParameters::Source::Max],
+            const TechniqueInterface& techniqueInterface) const;
+
+        void        BuildShaderInitializers(
+            ShaderVariationInitializers& result,
+            const ParameterBox* globalState[ShaderParameters::Source::Max]) const;
+
         void        ResolveAndBind( 
             ResolvedShader& shader, 
             const ParameterBox* globalState[ShaderParameters::Source::Max],
             const TechniqueInterface& techniqueInterface) const;
-
-        mutable std::vector<std::unique_ptr<Metal::ShaderProgram>> _resolvedShaderPrograms;
-        mutable std::vector<std::unique_ptr<Metal::BoundUniforms>> _resolvedBoundUniforms;
-        mutable std::vector<std::unique_ptr<Metal::BoundInputLayout>> _resolvedBoundInputLayouts;
     };
 
     class ShaderType
@@ -185,6 +211,8 @@ namespace RenderCore { namespace Techniques
             const ParameterBox* globalState[ShaderParameters::Source::Max], 
             const TechniqueInterface& techniqueInterface) const;
 
+        const Technique& GetTechnique(unsigned techniqueIndex) const;
+
         auto GetDependencyValidation() const -> const ::Assets::DepValPtr& { return _validationCallback; }
         bool HasEmbeddedCBLayout() const { return _hasEmbeddedCBLayout; }
 
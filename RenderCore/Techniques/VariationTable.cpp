@@ -0,0 +1,138 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "VariationTable.h"
+#include "../Metal/Shader.h"
+#include "../../Assets/AssetUtils.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/Threading/ThreadingUtils.h"
+
+namespace RenderCore { namespace Techniques
+{
+    static Interlocked::Value s_nextVariationTableId = 0;
+
+        //  Per-thread memo of recent lookups. Within a frame the same few states are looked
+        //  up over and over again; those lookups become just a few compares (without
+        //  combining hashes or probing the tables).
+    class VariationMemoSlot
+    {
+    public:
+        unsigned    _tableId;
+        uint64      _boxHashes[VariationTable::BoxHashCount];
+        uint64      _interfaceHash;
+        const VariationTable::Entry* _entry;
+    };
+
+    static const unsigned VariationMemoSize = 32;
+    static thread_local VariationMemoSlot s_variationMemo[VariationMemoSize];
+
+    static VariationMemoSlot& GetMemoSlot(unsigned tableId, const uint64 boxHashes[], uint64 interfaceHash)
+    {
+        auto h = interfaceHash ^ (uint64(tableId) * 0x9E3779B97F4A7C15ull);
+        for (unsigned c=0; c<VariationTable::BoxHashCount; ++c)
+            h ^= boxHashes[c] >> c;
+        h ^= h >> 29;
+        return s_variationMemo[unsigned(h) & (VariationMemoSize-1)];
+    }
+
+    static bool IsMatch(const VariationMemoSlot& slot, unsigned tableId, const uint64 boxHashes[], uint64 interfaceHash)
+    {
+        if (slot._tableId != tableId || slot._interfaceHash != interfaceHash) return false;
+        for (unsigned c=0; c<VariationTable::BoxHashCount; ++c)
+            if (slot._boxHashes[c] != boxHashes[c]) return false;
+        return true;
+    }
+
+    uint64 VariationTable::CalculateInputHash(const uint64 boxHashes[BoxHashCount])
+    {
+        uint64 inputHash = HashCombine(boxHashes[0], boxHashes[1]);
+        for (unsigned c = 1; c < ShaderParameters::Source::Max; ++c) {
+            inputHash = HashCombine(boxHashes[c*2+1], inputHash);
+            inputHash = HashCombine(boxHashes[c*2+0], inputHash);
+        }
+        return inputHash;
+    }
+
+    bool VariationTable::IsInvalidated(const ResolvedShader& shader)
+    {
+        return shader._shaderProgram && (shader._shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0);
+    }
+
+    const ResolvedShader* VariationTable::Find(
+        const uint64 boxHashes[BoxHashCount], uint64 interfaceHash,
+        LookupResult::Enum* result) const
+    {
+        auto& memo = GetMemoSlot(_id, boxHashes, interfaceHash);
+        const Entry* entry = nullptr;
+        bool memoHit = IsMatch(memo, _id, boxHashes, interfaceHash);
+        if (memoHit) {
+            entry = memo._entry;
+        } else {
+            auto* global = _globalTable.Find(CalculateInputHash(boxHashes) ^ interfaceHash);
+            if (global) entry = global->_filtered;
+        }
+
+        if (entry) {
+            auto* resolved = GetCurrent(*entry);
+            if (!IsInvalidated(*resolved)) {
+                if (!memoHit) {
+                    memo._tableId = _id;
+                    memo._interfaceHash = interfaceHash;
+                    XlCopyMemory(memo._boxHashes, boxHashes, sizeof(memo._boxHashes));
+                    memo._entry = entry;
+                }
+                if (result) *result = memoHit ? LookupResult::MemoHit : LookupResult::TableHit;
+                return resolved;
+            }
+        }
+
+        if (result) *result = LookupResult::Miss;
+        return nullptr;
+    }
+
+    auto VariationTable::FindGlobal(uint64 globalHashWithInterface) const -> Entry*
+    {
+        auto* global = _globalTable.Find(globalHashWithInterface);
+        return global ? global->_filtered : nullptr;
+    }
+
+    auto VariationTable::FindFiltered(uint64 filteredHashWithInterface) const -> Entry*
+    {
+        return _filteredTable.Find(filteredHashWithInterface);
+    }
+
+    auto VariationTable::InsertFiltered(uint64 filteredHashWithInterface, const ResolvedShader* shader) -> Entry*
+    {
+        auto newEntry = std::make_unique<Entry>();
+        newEntry->_current = (void*)shader;
+        return _filteredTable.Insert(filteredHashWithInterface, std::move(newEntry));
+    }
+
+    void VariationTable::InsertGlobal(uint64 globalHashWithInterface, Entry* filtered)
+    {
+        auto newGlobal = std::make_unique<GlobalEntry>();
+        newGlobal->_filtered = filtered;
+        _globalTable.Insert(globalHashWithInterface, std::move(newGlobal));
+    }
+
+    const ResolvedShader* VariationTable::GetCurrent(const Entry& entry)
+    {
+        return (const ResolvedShader*)Interlocked::LoadPointer(&entry._current);
+    }
+
+    void VariationTable::Publish(Entry& entry, const ResolvedShader* shader)
+    {
+        Interlocked::ExchangePointer(&entry._current, (void*)shader);
+    }
+
+    VariationTable::VariationTable()
+    {
+        _id = unsigned(Interlocked::Increment(&s_nextVariationTableId)) + 1;    // (0 is reserved for empty memo slots)
+    }
+
+    VariationTable::~VariationTable() {}
+}}
+
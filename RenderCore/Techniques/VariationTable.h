@@ -0,0 +1,79 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Techniques.h"
+#include "../../Assets/AssetSetInternal.h"      // (for AssetTable)
+#include "../../Core/Types.h"
+
+namespace RenderCore { namespace Techniques
+{
+        /// <summary>Lock free lookup of the resolved variations of a Technique</summary>
+        /// Resolved variations are stored in 2 tables (global state hash -> filtered state
+        /// hash -> resolved shader). Many global states usually map onto the same filtered
+        /// state, and so share the same resolved shader.
+        ///
+        /// A small per-thread memo sits in front of the tables. It's keyed on the raw hash
+        /// values of the global state boxes (which are reset whenever a ParameterBox changes),
+        /// so repeated lookups within a frame are just a few compares. The memo is direct
+        /// mapped, so a lookup can evict a different state from it (that state is then
+        /// found in the tables again on the next lookup).
+        ///
+        /// Find() never takes a lock. The Insert & Publish methods must be serialized by the
+        /// caller. The table doesn't own the resolved shaders, they must outlive it.
+    class VariationTable
+    {
+    public:
+            //  "_current" is replaced (never modified in place) when the variation is rebuilt
+            //  after a source change. So a reader on another thread always sees a complete
+            //  ResolvedShader.
+        class Entry
+        {
+        public:
+            void* volatile  _current;       // const ResolvedShader*
+        };
+
+        struct LookupResult { enum Enum { MemoHit, TableHit, Miss }; };
+
+        static const unsigned BoxHashCount = ShaderParameters::Source::Max*2;
+        static uint64 CalculateInputHash(const uint64 boxHashes[BoxHashCount]);
+        static bool IsInvalidated(const ResolvedShader& shader);
+
+            /// <summary>Find a valid variation, without locking</summary>
+            /// "boxHashes" are the hash and the parameter names hash of each global state box
+            /// (interleaved). Returns null if the variation hasn't been built yet, or if it has
+            /// been invalidated by a source change.
+        const ResolvedShader* Find(
+            const uint64 boxHashes[BoxHashCount], uint64 interfaceHash,
+            LookupResult::Enum* result = nullptr) const;
+
+        Entry*  FindGlobal(uint64 globalHashWithInterface) const;
+        Entry*  FindFiltered(uint64 filteredHashWithInterface) const;
+        Entry*  InsertFiltered(uint64 filteredHashWithInterface, const ResolvedShader* shader);
+        void    InsertGlobal(uint64 globalHashWithInterface, Entry* filtered);
+
+        static const ResolvedShader* GetCurrent(const Entry& entry);
+        static void Publish(Entry& entry, const ResolvedShader* shader);
+
+        VariationTable();
+        ~VariationTable();
+        VariationTable(const VariationTable&) = delete;
+        VariationTable& operator=(const VariationTable&) = delete;
+
+    private:
+        class GlobalEntry
+        {
+        public:
+            Entry*          _filtered;
+        };
+
+        ::Assets::Internal::AssetTable<GlobalEntry>     _globalTable;
+        ::Assets::Internal::AssetTable<Entry>           _filteredTable;
+        unsigned                                        _id;
+    };
+}}
+
@@ -0,0 +1,84 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../SceneEngine/Fluid.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../ConsoleRig/Log.h"
+#include "../../Utility/Streams/StreamFormatter.h"
+#include "../../Utility/Streams/StreamDOM.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Utility/TimeUtils.h"
+#include <iostream>
+#include <algorithm>
+
+namespace FluidBenchmark
+{
+        //  Runs the 3D fluid solver for a number of ticks, with no rendering, and
+        //  reports the time per tick. Command line parameters (all optional):
+        //      ticks=<tick count> width=<x> height=<y> depth=<z> tiled=<0 or 1>
+    void Execute(StringSection<char> cmdLine)
+    {
+        MemoryMappedInputStream stream(cmdLine.begin(), cmdLine.end());
+        InputStreamFormatter<char> formatter(stream);
+        Document<InputStreamFormatter<char>> doc(formatter);
+
+        const auto ticks = doc.Attribute("ticks", 100u);
+        const UInt3 dims(
+            doc.Attribute("width", 64u),
+            doc.Attribute("height", 64u),
+            doc.Attribute("depth", 64u));
+
+        SceneEngine::FluidSolver3D::Settings settings;
+        settings._tiledExecution = doc.Attribute("tiled", 1);
+        SceneEngine::FluidSolver3D solver(dims);
+
+        std::cout 
+            << "Fluid benchmark: " << dims[0] << "x" << dims[1] << "x" << dims[2] 
+            << ", " << ticks << " ticks, " << (settings._tiledExecution ? "tiled" : "serial") 
+            << std::endl;
+
+        const float deltaTime = 1.f / 30.f;
+        uint64 totalTime = 0, worstTime = 0;
+        for (unsigned t=0; t<ticks; ++t) {
+                // keep adding density near the floor, so there's always something moving
+            solver.AddDensity(UInt3(dims[0]/2, dims[1]/2, 1), 1.f);
+
+            auto start = GetPerformanceCounter();
+            solver.Tick(deltaTime, settings);
+            auto elapsed = GetPerformanceCounter() - start;
+            totalTime += elapsed;
+            worstTime = std::max(worstTime, elapsed);
+        }
+
+        const auto freq = double(GetPerformanceCounterFrequency());
+        std::cout 
+            << "Average tick: " << (1000.0 * double(totalTime) / freq / double(std::max(ticks, 1u))) << "ms, "
+            << "worst tick: " << (1000.0 * double(worstTime) / freq) << "ms"
+            << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ConsoleRig::StartupConfig cfg("fluidbenchmark");
+    cfg._setWorkingDir = false;
+    cfg._redirectCout = false;
+    ConsoleRig::GlobalServices services(cfg);
+
+    TRY {
+        std::string cmdLine;
+        for (unsigned c=1; c<unsigned(argc); ++c) {
+            if (c!=0) cmdLine += " ";
+            cmdLine += argv[c];
+        }
+        FluidBenchmark::Execute(MakeStringSection(cmdLine));
+    } CATCH (const std::exception& e) {
+        LogAlwaysError << "Hit top level exception. Aborting program!";
+        LogAlwaysError << e.what();
+    } CATCH_END
+
+    return 0;
+}
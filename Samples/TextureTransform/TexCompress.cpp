@@ -11,7 +11,7 @@
 #include "../../Utility/ParameterBox.h"
 #include "../../Utility/Conversion.h"
 #include "../../Utility/StringUtils.h"
-#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/Threading/TaskScheduler.h"
 #include "../../Utility/Threading/ThreadingUtils.h"
 #include "../../Foreign/half-1.9.2/include/half.hpp"
 #include <thread>
@@ -181,7 +181,7 @@ namespace TextureTransform
         // each face into strips of some reasonable size (say, 16 blocks high).
 
         auto concurrency = std::thread::hardware_concurrency();
-        CompletionThreadPool threadPool(concurrency);
+        TaskScheduler threadPool(concurrency);
 
         unsigned rowsPerStrip = 64; // normally input textures will be large, so we should have wide strips
         unsigned totalTaskCount = 0;
@@ -8,7 +8,11 @@
 #include "../Math/Matrix.h"
 #include "../Math/Transformations.h"
 #include "../Math/Geometry.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/TaskScheduler.h"
 #include "../Utility/PtrUtils.h"
+#include "../Core/Types.h"
+#include <functional>
 
 #pragma warning(disable:4714)
 #pragma push_macro("new")
@@ -53,16 +57,27 @@ namespace SceneEngine
             , _massPointAccum(Zero<Float3>()), _massPointCount(0) {}
     };
 
-    static EdgeIntersection  TestEdge(  const Float3& e0, const Float3& e1, float d0, float d1, 
-                                        const IVolumeDensityFunction& fn)
+    class EdgeSearch
     {
-            //  Test the edge between these points, and attempt to find the point where
+    public:
+        Float3  _e0, _e1;
+        float   _x0, _x1, _d0, _d1;
+        float   _x, _d;
+
+        EdgeSearch(const Float3& e0, const Float3& e1, float d0, float d1)
+            : _e0(e0), _e1(e1), _x0(0.f), _x1(1.f), _d0(d0), _d1(d1), _x(1.f), _d(FLT_MAX) {}
+    };
+
+    static void TestEdges(  std::vector<EdgeIntersection>& result, 
+                            std::vector<EdgeSearch>& edges,
+                            const IVolumeDensityFunction& fn)
+    {
+            //  Test the edges between these points, and attempt to find the point where
             //  the surface passes through. 
             //
             //  The caller should have filtered out edges
             //  that don't pass through the surface.
-        assert((d0 < 0.f) != (d1 < 0.f));
-
+            //
             //      It might be a good idea to further improve the
             //      result by taking a few steps to try to get to the
             //      smallest density value. note that a very strange
@@ -70,41 +85,77 @@ namespace SceneEngine
             //      and so produce strange results when trying to
             //      find the intersection (particularly if there are
             //      really multiple intersections).
+            //
+            //  All of the edges step forward together, so that we can query the
+            //  density function for every edge that is still improving in a 
+            //  single batch.
+        const unsigned maxImprovementSteps = 6;
+
+        std::vector<unsigned> active;
+        active.reserve(edges.size());
+        for (unsigned c=0; c<unsigned(edges.size()); ++c) {
+            assert((edges[c]._d0 < 0.f) != (edges[c]._d1 < 0.f));
+            active.push_back(c);
+        }
 
-        float x0 = 0.f, x1 = 1.f;
-        float x = 1.f, d = FLT_MAX;
-        unsigned maxImprovementSteps = 6;
-        for (unsigned c=0; ; ++c) {
-            float prevD = d; float prevX = x;
-            x = LinearInterpolate(x0, x1, -d0 / (d1 - d0));
-            d = fn.GetDensity(LinearInterpolate(e0, e1, x));
-
-                // along noisy edges we could end up getting a worse result after a step
-                //  In these cases, just give up at the last reasonable result
-            if (XlAbs(d) > XlAbs(prevD)) {
-                x = prevX;
-                break;
+        std::vector<Float3> pts;
+        std::vector<float> prevX, prevD, densities;
+        pts.reserve(edges.size()); prevX.reserve(edges.size()); prevD.reserve(edges.size());
+        for (unsigned c=0; !active.empty(); ++c) {
+            pts.clear(); prevX.clear(); prevD.clear();
+            for (auto i:active) {
+                auto& e = edges[i];
+                prevX.push_back(e._x); prevD.push_back(e._d);
+                e._x = LinearInterpolate(e._x0, e._x1, -e._d0 / (e._d1 - e._d0));
+                pts.push_back(LinearInterpolate(e._e0, e._e1, e._x));
             }
 
-            if (XlAbs(d) < 1e-6f) break;   // if we get close enough, just stop
-            if ((c+1)>=maxImprovementSteps) break;
+            densities.resize(pts.size());
+            fn.GetDensities(densities.data(), pts.data(), unsigned(pts.size()));
 
-                //  We're going to attempt another improvement.
-                //  Divide the search area again, depending on where
-                //  the origin falls
-            if ((d < 0.f) != (d1 < 0.f)) {
-                x0 = x;
-                d0 = d;
-            } else {
-                x1 = x;
-                d1 = d;
+            unsigned stillActive = 0;
+            for (unsigned q=0; q<unsigned(active.size()); ++q) {
+                auto& e = edges[active[q]];
+                e._d = densities[q];
+
+                    // along noisy edges we could end up getting a worse result after a step
+                    //  In these cases, just give up at the last reasonable result
+                if (XlAbs(e._d) > XlAbs(prevD[q])) {
+                    e._x = prevX[q];
+                    continue;
+                }
+
+                if (XlAbs(e._d) < 1e-6f) continue;   // if we get close enough, just stop
+                if ((c+1)>=maxImprovementSteps) continue;
+
+                    //  We're going to attempt another improvement.
+                    //  Divide the search area again, depending on where
+                    //  the origin falls
+                if ((e._d < 0.f) != (e._d1 < 0.f)) {
+                    e._x0 = e._x;
+                    e._d0 = e._d;
+                } else {
+                    e._x1 = e._x;
+                    e._d1 = e._d;
+                }
+                active[stillActive++] = active[q];
             }
+            active.resize(stillActive);
+        }
+
+        pts.clear();
+        for (const auto& e:edges) {
+            assert(e._x>=0.f && e._x <= 1.f);
+            pts.push_back(LinearInterpolate(e._e0, e._e1, e._x));
         }
 
-        assert(x>=0.f && x <= 1.f);
-        Float3 bestIntersection = LinearInterpolate(e0, e1, x);
-        Float3 normal = fn.GetNormal(bestIntersection);     // note -- we might need to tell the function the sampling density
-        return EdgeIntersection(bestIntersection, normal);
+        std::vector<Float3> normals(pts.size());      // note -- we might need to tell the function the sampling density
+        fn.GetNormals(normals.data(), pts.data(), unsigned(pts.size()));
+
+        result.clear();
+        result.reserve(edges.size());
+        for (unsigned c=0; c<unsigned(pts.size()); ++c)
+            result.push_back(EdgeIntersection(pts[c], normals[c]));
     }
 
     static void RotateToUpperTriangle(Eigen::Matrix<float,5,4>& A)
@@ -449,254 +500,484 @@ namespace SceneEngine
 
 #endif
     
-    static void AddQuad(DualContourMesh& mesh, const DualContourMesh::Quad& quad, bool flipDirection)
+    static void AddQuad(std::vector<DualContourMesh::Quad>& quads, const DualContourMesh::Quad& quad, bool flipDirection)
     {
         auto q = quad;
         if (flipDirection)
             std::swap(q._verts[1], q._verts[2]);
-        mesh._quads.push_back(q);
+        quads.push_back(q);
     }
 
-    DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
-                                                const IVolumeDensityFunction& fn)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class DualContourGrid
     {
-            //  Build a mesh of triangles from the given input function
-            //      (using dual contouring method)
-            //
-            //  First we'll build a grid containing information for each
-            //  voxel. Then we'll go through a calculate the QEF's at
-            //  each grid point -- that will give us enough information
-            //  to generate the triangles needed. Note that the algorithm
-            //  should naturally build quads most of the time. They'll need
-            //  to be split up into triangles.
-            //
-            //  Ideally, we would also do simplification before we calculate
-            //  the QEF's and generate the triangles. But currently, no
-            //  simplification.
-        auto boundary = fn.GetBoundary();
-        auto gridElements = std::make_unique<GridElement[]>(
-            samplingGridDimensions*samplingGridDimensions*samplingGridDimensions);
-
-            //  For each grid element, let's fill it in with the values from the
-            //  density function. Note that we could reduce the work here slightly
-            //  by finding a point within the grid that lies on the surface, and
-            //  then marching along the surface, into each new grid that takes us.
-            //
-            //  The current method will create many redundant tests of the volume
-            //  function -- because most grids are probably not on the surface of the 
-            //  volume.
+    public:
+        unsigned    _dims;              // cells along each axis (there is one more corner than cells)
+        unsigned    _brickSize;
+        unsigned    _bricksPerAxis;
+        unsigned    _coarseStride;
+        Float3      _mins, _maxs;
+        Float3      _cellSize;
+
+        unsigned    BrickCount() const  { return _bricksPerAxis*_bricksPerAxis*_bricksPerAxis; }
+        unsigned    CornerIndex(unsigned x, unsigned y, unsigned z) const { return (z * (_dims+1) + y) * (_dims+1) + x; }
+
+        Float3      CornerPosition(unsigned x, unsigned y, unsigned z) const
+        {
+            return Float3(
+                _mins[0] + float(x) * _cellSize[0],
+                _mins[1] + float(y) * _cellSize[1],
+                _mins[2] + float(z) * _cellSize[2]);
+        }
+
+        Float3      CellCenter(unsigned x, unsigned y, unsigned z) const
+        {
+            return Float3(
+                LinearInterpolate(_mins[0], _maxs[0], (float(x) + .5f) / float(_dims)),
+                LinearInterpolate(_mins[1], _maxs[1], (float(y) + .5f) / float(_dims)),
+                LinearInterpolate(_mins[2], _maxs[2], (float(z) + .5f) / float(_dims)));
+        }
+
+        UInt3       BrickMins(unsigned brick) const
+        {
+            return UInt3(
+                (brick % _bricksPerAxis) * _brickSize,
+                ((brick / _bricksPerAxis) % _bricksPerAxis) * _brickSize,
+                (brick / (_bricksPerAxis*_bricksPerAxis)) * _brickSize);
+        }
+
+        UInt3       BrickMaxs(unsigned brick) const
+        {
+            auto mins = BrickMins(brick);
+            return UInt3(
+                std::min(mins[0] + _brickSize, _dims),
+                std::min(mins[1] + _brickSize, _dims),
+                std::min(mins[2] + _brickSize, _dims));
+        }
+
+        DualContourGrid(unsigned dims, const IVolumeDensityFunction::Boundary& boundary, const DualContourSettings& settings)
+        {
+            _dims = dims;
+            _mins = boundary.first;
+            _maxs = boundary.second;
+            _cellSize = Float3(
+                (_maxs[0] - _mins[0]) / float(dims),
+                (_maxs[1] - _mins[1]) / float(dims),
+                (_maxs[2] - _mins[2]) / float(dims));
+
+                // (coarse samples must fall on the brick boundaries)
+            _brickSize = std::max(1u, settings._brickSize);
+            _coarseStride = std::max(1u, std::min(settings._coarseStride, _brickSize));
+            _brickSize = (_brickSize + _coarseStride - 1) / _coarseStride * _coarseStride;
+            _bricksPerAxis = (dims + _brickSize - 1) / _brickSize;
+        }
+    };
+
+    class DualContourBrick
+    {
+    public:
+        bool                                    _hasSurface;
+        std::vector<DualContourMesh::Vertex>    _vertices;
+        std::vector<unsigned>                   _cellVertices;      // index into _vertices for each cell in the brick (or ~0u)
+        std::vector<DualContourMesh::Quad>      _quads;
+        unsigned                                _vertexOffset;
+
+        DualContourBrick() : _hasSurface(false), _vertexOffset(0) {}
+    };
+
+    template<typename Fn>
+        static void RunBricks(unsigned count, Fn&& fn, bool parallel)
+    {
+        if (parallel) {
+            ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), count, std::forward<Fn>(fn));
+        } else {
+            for (unsigned c=0; c<count; ++c)
+                fn(c);
+        }
+    }
+
+    static void SampleDensities(
+        float dst[], const DualContourGrid& grid,
+        const IVolumeDensityFunction& fn, const DualContourSettings& settings)
+    {
+            //  Calculate the density at every corner of the sampling grid. 
             //
-            //  Let's find and test each edge. When we find a edge that crosses the 
-            //  boundary, we can merge that into the QEF's for that adjacent grid
-            //  elements.
+            //  In adaptive mode, we first sample a coarse lattice (every "_coarseStride"
+            //  corners). A brick is "active" if the coarse samples within it don't all
+            //  have the same sign. Only corners that touch an active brick (or a neighbour
+            //  of an active brick) are sampled at full resolution. Everything else is
+            //  filled in by interpolating the coarse samples -- which will have the same
+            //  sign as those samples, and so won't generate any surface.
             //
-            //  It's a good idea to calculate the density results at each corner first
-            //  This will help reduce the number of times we need to call the
-            //  GetDensity() function.
-
-        Float3x4 gridToSampleSpace = Zero<Float3x4>();
-        gridToSampleSpace(0,0) = (boundary.second[0] - boundary.first[0]) / float(samplingGridDimensions);
-        gridToSampleSpace(1,1) = (boundary.second[1] - boundary.first[1]) / float(samplingGridDimensions);
-        gridToSampleSpace(2,2) = (boundary.second[2] - boundary.first[2]) / float(samplingGridDimensions);
-        gridToSampleSpace(0,3) = boundary.first[0];
-        gridToSampleSpace(1,3) = boundary.first[1];
-        gridToSampleSpace(2,3) = boundary.first[2];
-        
-        auto densityResults = std::make_unique<float[]>(
-            (samplingGridDimensions+1)*(samplingGridDimensions+1)*(samplingGridDimensions+1));
-        for (int z=0; z<int(samplingGridDimensions+1); ++z)
-            for (int y=0; y<int(samplingGridDimensions+1); ++y)
-                for (int x=0; x<int(samplingGridDimensions+1); ++x) {
-                    Float3 p0 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z)));
-                    densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x] = fn.GetDensity(p0);
-                }
-
-            // note --  The order of the cell offsets here is important, because it 
-            //          determines the order of the vertices in the quad.
-        Int3 cellOffsetsX[] = { Int3(0, 0, 0), Int3(0, -1, 0), Int3(0, 0, -1), Int3(0, -1, -1) };
-        Int3 cellOffsetsY[] = { Int3(0, 0, 0), Int3(0, 0, -1), Int3(-1, 0, 0), Int3(-1, 0, -1) };
-        Int3 cellOffsetsZ[] = { Int3(0, 0, 0), Int3(-1, 0, 0), Int3(0, -1, 0), Int3(-1, -1, 0) };
-
-        for (int z=0; z<int(samplingGridDimensions); ++z) {
-            for (int y=0; y<int(samplingGridDimensions); ++y) {
-                for (int x=0; x<int(samplingGridDimensions); ++x) {
-
-                        //  For each grid element, we're going to test 3 edges.
-                        //  we'll add the effect of those edges to adjacent grids
-                        //  as well. This means each edges gets tested once.
-                        //  However, some edges on the extreme positive boundary
-                        //  of the sampling area will never be tested. We'll assume 
-                        //  that the function doesn't go through these boundary edges.
-
-                    Float3 p0 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z)));
-                    Float3 p1 = TransformPoint(gridToSampleSpace, Float3(float(x+1), float(y), float(z)));
-                    Float3 p2 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y+1), float(z)));
-                    Float3 p3 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z+1)));
-
-                    float d0 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-                    float d1 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x + 1];
-                    float d2 = densityResults[(z * (samplingGridDimensions+1) + y + 1) * (samplingGridDimensions+1) + x];
-                    float d3 = densityResults[((z + 1) * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-
-                        //  Look for edges that contain intersections with the surface, and then merge 
-                        //  those edge into all of the grid cells that contain them.
-                        //  Note that TestEdge() will do extra calls to GetDensity to improve the 
-                        //  intersection point.
-                    
-                    if ((d0 < 0.f) != (d1 < 0.f)) {
-                        auto intersection = TestEdge(p0, p1, d0, d1, fn);
-                        for (unsigned c=0; c<dimof(cellOffsetsX); ++c) {
-                            Int3 g(x + cellOffsetsX[c][0], y + cellOffsetsX[c][1], z + cellOffsetsX[c][2]);
-                            if (g[0] >= 0 && g[1] >= 0 && g[2] >= 0) {
-                                const auto cellCenter = Float3(
-                                    LinearInterpolate(boundary.first[0], boundary.second[0], (float(g[0]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[1], boundary.second[1], (float(g[1]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[2], boundary.second[2], (float(g[2]) + .5f) / float(samplingGridDimensions)));
-
-                                MergeInEdgeIntersection(
-                                    gridElements[(g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0]],
-                                    intersection, cellCenter);
-                            }
+            //  This is an approximation -- features smaller than the coarse stride that
+            //  fall entirely within an inactive region will be lost. But every later stage
+            //  works only from the values in "dst" (and each corner is written exactly
+            //  once) so the mesh is always consistent across brick boundaries.
+        const auto N = grid._dims;
+        const auto B = grid._brickSize;
+        const auto bricksPerAxis = grid._bricksPerAxis;
+        const auto stride = grid._coarseStride;
+        const bool adaptive = settings._adaptive;
+
+        std::vector<float> coarse;
+        std::vector<uint8> denseBricks;
+        unsigned coarseDims = 0;
+        if (adaptive) {
+            coarseDims = (N + stride - 1) / stride + 1;
+            coarse.resize(coarseDims*coarseDims*coarseDims);
+            RunBricks(
+                coarseDims, 
+                [&coarse, &grid, &fn, coarseDims, stride, N](unsigned z)
+                {
+                    std::vector<Float3> pts;
+                    pts.reserve(coarseDims*coarseDims);
+                    for (unsigned y=0; y<coarseDims; ++y)
+                        for (unsigned x=0; x<coarseDims; ++x)
+                            pts.push_back(grid.CornerPosition(
+                                std::min(x*stride, N), std::min(y*stride, N), std::min(z*stride, N)));
+                    fn.GetDensities(&coarse[z*coarseDims*coarseDims], pts.data(), unsigned(pts.size()));
+                }, settings._parallel);
+
+            std::vector<uint8> activeBricks(grid.BrickCount(), 0);
+            for (unsigned b=0; b<grid.BrickCount(); ++b) {
+                auto mins = grid.BrickMins(b), maxs = grid.BrickMaxs(b);
+                UInt3 coarseMins(mins[0]/stride, mins[1]/stride, mins[2]/stride);
+                UInt3 coarseMaxs(
+                    (maxs[0] == N) ? (coarseDims-1) : (maxs[0]/stride),
+                    (maxs[1] == N) ? (coarseDims-1) : (maxs[1]/stride),
+                    (maxs[2] == N) ? (coarseDims-1) : (maxs[2]/stride));
+                bool positive = false, negative = false;
+                for (unsigned z=coarseMins[2]; z<=coarseMaxs[2]; ++z)
+                    for (unsigned y=coarseMins[1]; y<=coarseMaxs[1]; ++y)
+                        for (unsigned x=coarseMins[0]; x<=coarseMaxs[0]; ++x) {
+                            if (coarse[(z*coarseDims+y)*coarseDims+x] < 0.f) negative = true;
+                            else positive = true;
                         }
-                    }
+                activeBricks[b] = uint8(positive && negative);
+            }
 
-                    if ((d0 < 0.f) != (d2 < 0.f)) {
-                        auto intersection = TestEdge(p0, p2, d0, d2, fn);
-                        for (unsigned c=0; c<dimof(cellOffsetsY); ++c) {
-                            Int3 g(x + cellOffsetsY[c][0], y + cellOffsetsY[c][1], z + cellOffsetsY[c][2]);
-                            if (g[0] >= 0 && g[1] >= 0 && g[2] >= 0) {
-                                const auto cellCenter = Float3(
-                                    LinearInterpolate(boundary.first[0], boundary.second[0], (float(g[0]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[1], boundary.second[1], (float(g[1]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[2], boundary.second[2], (float(g[2]) + .5f) / float(samplingGridDimensions)));
-
-                                MergeInEdgeIntersection(
-                                    gridElements[(g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0]],
-                                    intersection, cellCenter);
-                            }
+                // the surface might cross into a neighbouring brick between coarse samples;
+                // so sample all the neighbours of active bricks, also
+            denseBricks.resize(grid.BrickCount(), 0);
+            for (unsigned b=0; b<grid.BrickCount(); ++b) {
+                if (!activeBricks[b]) continue;
+                int bx = int(b % bricksPerAxis), by = int((b / bricksPerAxis) % bricksPerAxis), bz = int(b / (bricksPerAxis*bricksPerAxis));
+                for (int z=std::max(bz-1, 0); z<=std::min(bz+1, int(bricksPerAxis)-1); ++z)
+                    for (int y=std::max(by-1, 0); y<=std::min(by+1, int(bricksPerAxis)-1); ++y)
+                        for (int x=std::max(bx-1, 0); x<=std::min(bx+1, int(bricksPerAxis)-1); ++x)
+                            denseBricks[(z*bricksPerAxis+y)*bricksPerAxis+x] = 1;
+            }
+        }
+
+        auto cornerIsDense = [&denseBricks, B, bricksPerAxis](unsigned x, unsigned y, unsigned z) -> bool
+        {
+                // corners on a brick face are shared with the brick on the other side
+            const unsigned c[] = { x, y, z };
+            unsigned lo[3], hi[3];
+            for (unsigned a=0; a<3; ++a) {
+                hi[a] = std::min(c[a]/B, bricksPerAxis-1);
+                lo[a] = (c[a]%B == 0 && c[a] > 0) ? (c[a]/B - 1) : hi[a];
+            }
+            for (unsigned bz=lo[2]; bz<=hi[2]; ++bz)
+                for (unsigned by=lo[1]; by<=hi[1]; ++by)
+                    for (unsigned bx=lo[0]; bx<=hi[0]; ++bx)
+                        if (denseBricks[(bz*bricksPerAxis+by)*bricksPerAxis+bx]) return true;
+            return false;
+        };
+
+        auto coarseValue = [&coarse, coarseDims, stride, N](unsigned x, unsigned y, unsigned z) -> float
+        {
+            const unsigned c[] = { x, y, z };
+            unsigned i[3]; float t[3];
+            for (unsigned a=0; a<3; ++a) {
+                i[a] = std::min(c[a]/stride, coarseDims-2);
+                auto p0 = i[a]*stride, p1 = std::min((i[a]+1)*stride, N);
+                t[a] = float(c[a]-p0) / float(p1-p0);
+            }
+            auto s = [&](unsigned dx, unsigned dy, unsigned dz) 
+                { return coarse[((i[2]+dz)*coarseDims + i[1]+dy)*coarseDims + i[0]+dx]; };
+            return LinearInterpolate(
+                LinearInterpolate(
+                    LinearInterpolate(s(0,0,0), s(1,0,0), t[0]),
+                    LinearInterpolate(s(0,1,0), s(1,1,0), t[0]), t[1]),
+                LinearInterpolate(
+                    LinearInterpolate(s(0,0,1), s(1,0,1), t[0]),
+                    LinearInterpolate(s(0,1,1), s(1,1,1), t[0]), t[1]),
+                t[2]);
+        };
+
+            //  Each brick writes only the corners it "owns" (ie, excluding the corners
+            //  on the positive faces, except on the edge of the grid)
+        RunBricks(
+            grid.BrickCount(),
+            [&](unsigned b)
+            {
+                auto mins = grid.BrickMins(b), maxs = grid.BrickMaxs(b);
+                UInt3 cornerMaxs(
+                    (maxs[0] == N) ? (N+1) : maxs[0],
+                    (maxs[1] == N) ? (N+1) : maxs[1],
+                    (maxs[2] == N) ? (N+1) : maxs[2]);
+
+                std::vector<Float3> pts;
+                std::vector<unsigned> indices;
+                std::vector<float> values;
+                for (unsigned z=mins[2]; z<cornerMaxs[2]; ++z) {
+                    pts.clear(); indices.clear();
+                    for (unsigned y=mins[1]; y<cornerMaxs[1]; ++y)
+                        for (unsigned x=mins[0]; x<cornerMaxs[0]; ++x) {
+                            if (!adaptive || cornerIsDense(x, y, z)) {
+                                pts.push_back(grid.CornerPosition(x, y, z));
+                                indices.push_back(grid.CornerIndex(x, y, z));
+                            } else 
+                                dst[grid.CornerIndex(x, y, z)] = coarseValue(x, y, z);
                         }
-                    }
 
-                    if ((d0 < 0.f) != (d3 < 0.f)) {
-                        auto intersection = TestEdge(p0, p3, d0, d3, fn);
-                        for (unsigned c=0; c<dimof(cellOffsetsZ); ++c) {
-                            Int3 g(x + cellOffsetsZ[c][0], y + cellOffsetsZ[c][1], z + cellOffsetsZ[c][2]);
-                            if (g[0] >= 0 && g[1] >= 0 && g[2] >= 0) {
-                                const auto cellCenter = Float3(
-                                    LinearInterpolate(boundary.first[0], boundary.second[0], (float(g[0]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[1], boundary.second[1], (float(g[1]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[2], boundary.second[2], (float(g[2]) + .5f) / float(samplingGridDimensions)));
-
-                                MergeInEdgeIntersection(
-                                    gridElements[(g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0]],
-                                    intersection, cellCenter);
-                            }
+                    if (pts.empty()) continue;
+                    values.resize(pts.size());
+                    fn.GetDensities(values.data(), pts.data(), unsigned(pts.size()));
+                    for (unsigned c=0; c<unsigned(indices.size()); ++c)
+                        dst[indices[c]] = values[c];
+                }
+            }, settings._parallel);
+    }
+
+        //  The 12 edges of a cell, as (axis, corner offset)
+    static const unsigned s_cellEdges[12][4] = 
+    {
+        { 0, 0, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 }, { 0, 0, 1, 1 },
+        { 1, 0, 0, 0 }, { 1, 1, 0, 0 }, { 1, 0, 0, 1 }, { 1, 1, 0, 1 },
+        { 2, 0, 0, 0 }, { 2, 1, 0, 0 }, { 2, 0, 1, 0 }, { 2, 1, 1, 0 }
+    };
+
+    static void BuildBrickVertices(
+        DualContourBrick& brick, UInt3 mins, UInt3 maxs,
+        const DualContourGrid& grid, const float densities[],
+        const IVolumeDensityFunction& fn)
+    {
+            //  Most bricks won't touch the surface at all. We can check for that
+            //  by looking for a sign change in any of the corners of the brick
+            //  (including the corners on the positive faces)
+        bool positive = false, negative = false;
+        for (unsigned z=mins[2]; z<=maxs[2]; ++z)
+            for (unsigned y=mins[1]; y<=maxs[1]; ++y)
+                for (unsigned x=mins[0]; x<=maxs[0]; ++x) {
+                    if (densities[grid.CornerIndex(x, y, z)] < 0.f) negative = true;
+                    else positive = true;
+                }
+        brick._hasSurface = positive && negative;
+        if (!brick._hasSurface) return;
+
+        const UInt3 cellDims(maxs[0] - mins[0], maxs[1] - mins[1], maxs[2] - mins[2]);
+        const UInt3 cornerDims(cellDims[0]+1, cellDims[1]+1, cellDims[2]+1);
+        const auto cornerCount = cornerDims[0]*cornerDims[1]*cornerDims[2];
+
+            //  Find every edge touching a cell in this brick that crosses the surface. 
+            //  Edges on the faces of the brick are also tested by the neighbouring brick;
+            //  but both will calculate exactly the same intersection.
+        std::vector<EdgeSearch> searches;
+        std::vector<unsigned> edgeIntersections[3];
+        for (unsigned a=0; a<3; ++a)
+            edgeIntersections[a].resize(cornerCount, ~0u);
+
+        for (unsigned z=0; z<cornerDims[2]; ++z)
+            for (unsigned y=0; y<cornerDims[1]; ++y)
+                for (unsigned x=0; x<cornerDims[0]; ++x) {
+                    const UInt3 g(mins[0]+x, mins[1]+y, mins[2]+z);
+                    const float d0 = densities[grid.CornerIndex(g[0], g[1], g[2])];
+                    const UInt3 local(x, y, z);
+                    for (unsigned a=0; a<3; ++a) {
+                        if (local[a] >= cellDims[a]) continue;
+                        UInt3 g1 = g; ++g1[a];
+                        const float d1 = densities[grid.CornerIndex(g1[0], g1[1], g1[2])];
+                        if ((d0 < 0.f) != (d1 < 0.f)) {
+                            edgeIntersections[a][(z*cornerDims[1]+y)*cornerDims[0]+x] = unsigned(searches.size());
+                            searches.push_back(EdgeSearch(
+                                grid.CornerPosition(g[0], g[1], g[2]), 
+                                grid.CornerPosition(g1[0], g1[1], g1[2]),
+                                d0, d1));
                         }
                     }
-
                 }
-            }
-        }
 
-            //  Now, we've calculated the error functions for all of the grid elements.
-            //  For each grid element, we can calculate the appropriate point for that
-            //  element. Let's make sure we do this only one per grid element (because
-            //  typically each vertex will be used in multiple quads.
-
-        const auto cellSize = Float3(
-            (boundary.second[0] - boundary.first[0]) / float(samplingGridDimensions),
-            (boundary.second[1] - boundary.first[1]) / float(samplingGridDimensions),
-            (boundary.second[2] - boundary.first[2]) / float(samplingGridDimensions));
-
-        std::vector<DualContourMesh::Vertex> vertices;
-        auto vertexIndices = std::make_unique<unsigned[]>(
-            samplingGridDimensions*samplingGridDimensions*samplingGridDimensions);
-        for (int z=0; z<int(samplingGridDimensions); ++z) {
-            for (int y=0; y<int(samplingGridDimensions); ++y) {
-                for (int x=0; x<int(samplingGridDimensions); ++x) {
-                    auto index = (z * samplingGridDimensions + y) * samplingGridDimensions + x;
-                    const auto& g = gridElements[index];
-                    if (!g._massPointCount) {
-                        vertexIndices[index] = 0xffffffff;
-                        continue;
+        std::vector<EdgeIntersection> intersections;
+        TestEdges(intersections, searches, fn);
+
+            //  Merge the intersections into the QEF for each cell, and calculate 
+            //  the vertex position for that cell.
+        brick._cellVertices.resize(cellDims[0]*cellDims[1]*cellDims[2], ~0u);
+        std::vector<Float3> vertexPts;
+        for (unsigned z=0; z<cellDims[2]; ++z)
+            for (unsigned y=0; y<cellDims[1]; ++y)
+                for (unsigned x=0; x<cellDims[0]; ++x) {
+                    const auto cellCenter = grid.CellCenter(mins[0]+x, mins[1]+y, mins[2]+z);
+                    GridElement element;
+                    for (unsigned e=0; e<dimof(s_cellEdges); ++e) {
+                        const auto* edge = s_cellEdges[e];
+                        auto i = edgeIntersections[edge[0]][((z+edge[3])*cornerDims[1]+y+edge[2])*cornerDims[0]+x+edge[1]];
+                        if (i != ~0u)
+                            MergeInEdgeIntersection(element, intersections[i], cellCenter);
                     }
+                    if (!element._massPointCount) continue;
 
-                    const auto cellCenter = Float3(
-                        LinearInterpolate(boundary.first[0], boundary.second[0], (float(x) + .5f) / float(samplingGridDimensions)),
-                        LinearInterpolate(boundary.first[1], boundary.second[1], (float(y) + .5f) / float(samplingGridDimensions)),
-                        LinearInterpolate(boundary.first[2], boundary.second[2], (float(z) + .5f) / float(samplingGridDimensions)));
-                    auto pt = CalculateCellPoint(g, cellSize) + cellCenter;
-
-                        //  We need the normal at this location, also.
-                        //  We've lost the locations of the edge intersections -- so we can't
-                        //  just add together the normals from them. However. We can 
-                        //  query the density field again to get the normal at this location.
-                    auto normal = fn.GetNormal(pt);
-                    vertices.push_back(DualContourMesh::Vertex(pt, normal));
-                    vertexIndices[index] = unsigned(vertices.size()-1);
+                    brick._cellVertices[(z*cellDims[1]+y)*cellDims[0]+x] = unsigned(vertexPts.size());
+                    vertexPts.push_back(CalculateCellPoint(element, grid._cellSize) + cellCenter);
                 }
-            }
-        }
-
-            //  We just need to calculate the triangles. 
-            //  For each edge with an intersection, we want to create a quad.
-            //  we start at one here, because the edge cells have nothing to join
-            //  on to.
 
-        DualContourMesh mesh;
-        mesh._vertices = std::move(vertices);
+            //  We need the normal at this location, also.
+            //  We can just query the density field again to get the normal at this location.
+        std::vector<Float3> normals(vertexPts.size());
+        fn.GetNormals(normals.data(), vertexPts.data(), unsigned(vertexPts.size()));
+        brick._vertices.reserve(vertexPts.size());
+        for (unsigned c=0; c<unsigned(vertexPts.size()); ++c)
+            brick._vertices.push_back(DualContourMesh::Vertex(vertexPts[c], normals[c]));
+    }
 
-        for (int z=1; z<int(samplingGridDimensions); ++z) {
-            for (int y=1; y<int(samplingGridDimensions); ++y) {
-                for (int x=1; x<int(samplingGridDimensions); ++x) {
+    static void BuildBrickQuads(
+        DualContourBrick& brick, UInt3 mins, UInt3 maxs,
+        const DualContourGrid& grid, const float densities[],
+        const std::vector<DualContourBrick>& bricks)
+    {
+        if (!brick._hasSurface) return;
+
+        auto cellVertex = [&grid, &bricks](unsigned x, unsigned y, unsigned z) -> unsigned
+        {
+            const auto B = grid._brickSize;
+            const auto brickIndex = ((z/B)*grid._bricksPerAxis + y/B)*grid._bricksPerAxis + x/B;
+            const auto& b = bricks[brickIndex];
+            auto bMins = grid.BrickMins(brickIndex), bMaxs = grid.BrickMaxs(brickIndex);
+            auto local = ((z-bMins[2])*(bMaxs[1]-bMins[1]) + (y-bMins[1]))*(bMaxs[0]-bMins[0]) + (x-bMins[0]);
+            assert(local < b._cellVertices.size() && b._cellVertices[local] != ~0u);
+            return b._vertexOffset + b._cellVertices[local];
+        };
 
-                    float d0 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-                    float d1 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x + 1];
-                    float d2 = densityResults[(z * (samplingGridDimensions+1) + y + 1) * (samplingGridDimensions+1) + x];
-                    float d3 = densityResults[((z + 1) * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
+            // note --  The order of the cell offsets here is important, because it 
+            //          determines the order of the vertices in the quad.
+        static const int cellOffsets[3][4][3] = 
+        {
+            { { 0, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 }, { 0, -1, -1 } },
+            { { 0, 0, 0 }, { 0, 0, -1 }, { -1, 0, 0 }, { -1, 0, -1 } },
+            { { 0, 0, 0 }, { -1, 0, 0 }, { 0, -1, 0 }, { -1, -1, 0 } }
+        };
+
+            //  For each edge with an intersection, we want to create a quad by joining 
+            //  together all of the cells that use this edge. Each brick only looks at 
+            //  the edges that start within it; but the cells can come from neighbouring
+            //  bricks. Edges on the negative faces of the grid have nothing to join on to.
+        for (unsigned z=mins[2]; z<maxs[2]; ++z)
+            for (unsigned y=mins[1]; y<maxs[1]; ++y)
+                for (unsigned x=mins[0]; x<maxs[0]; ++x) {
+                    const UInt3 g(x, y, z);
+                    const float d0 = densities[grid.CornerIndex(x, y, z)];
+                    for (unsigned a=0; a<3; ++a) {
+                        if (g[(a+1)%3] == 0 || g[(a+2)%3] == 0) continue;
+                        UInt3 g1 = g; ++g1[a];
+                        const float d1 = densities[grid.CornerIndex(g1[0], g1[1], g1[2])];
+                        if ((d0 < 0.f) == (d1 < 0.f)) continue;
 
-                        //  If the edge has a intersection point. We want to create a 
-                        //  quad by joining together all of the cells that use this edge.
-                    if ((d0 < 0.f) != (d1 < 0.f)) {
                         DualContourMesh::Quad q;
-                        for (unsigned c=0; c<4; ++c) {
-                            Int3 g(x + cellOffsetsX[c][0], y + cellOffsetsX[c][1], z + cellOffsetsX[c][2]);
-                            auto index = (g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0];
-                            q._verts[c] = vertexIndices[index];
-                            assert(q._verts[c] < mesh._vertices.size());
-                        }
-                        AddQuad(mesh, q, d0 < 0.f);
+                        for (unsigned c=0; c<4; ++c)
+                            q._verts[c] = cellVertex(
+                                unsigned(int(x) + cellOffsets[a][c][0]),
+                                unsigned(int(y) + cellOffsets[a][c][1]),
+                                unsigned(int(z) + cellOffsets[a][c][2]));
+                        AddQuad(brick._quads, q, d0 < 0.f);
                     }
+                }
+    }
 
-                    if ((d0 < 0.f) != (d2 < 0.f)) {
-                        DualContourMesh::Quad q;
-                        for (unsigned c=0; c<4; ++c) {
-                            Int3 g(x + cellOffsetsY[c][0], y + cellOffsetsY[c][1], z + cellOffsetsY[c][2]);
-                            auto index = (g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0];
-                            q._verts[c] = vertexIndices[index];
-                            assert(q._verts[c] < mesh._vertices.size());
-                        }
-                        AddQuad(mesh, q, d0 < 0.f);
-                    }
+    DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
+                                                const IVolumeDensityFunction& fn,
+                                                const DualContourSettings& settings)
+    {
+            //  Build a mesh of triangles from the given input function
+            //      (using dual contouring method)
+            //
+            //  First we'll sample the density function at each corner of the
+            //  grid. Then we'll go through a calculate the QEF's at each grid 
+            //  cell that touches the surface -- that will give us enough 
+            //  information to generate the triangles needed. Note that the algorithm
+            //  should naturally build quads most of the time. They'll need
+            //  to be split up into triangles.
+            //
+            //  The grid is split into bricks, and each stage runs on the bricks
+            //  in parallel. Since every stage works from the same set of corner
+            //  densities, the bricks always agree on which edges cross the surface,
+            //  and so on which cells need vertices. Vertices are numbered in brick
+            //  order (after all bricks are finished) so that quads can join cells
+            //  in different bricks, and so that the result doesn't depend on the 
+            //  threading.
+            //
+            //  Ideally, we would also do simplification before we calculate
+            //  the QEF's and generate the triangles. But currently, no
+            //  simplification.
+        DualContourMesh mesh;
+        if (!samplingGridDimensions) return mesh;
 
-                    if ((d0 < 0.f) != (d3 < 0.f)) {
-                        DualContourMesh::Quad q;
-                        for (unsigned c=0; c<4; ++c) {
-                            Int3 g(x + cellOffsetsZ[c][0], y + cellOffsetsZ[c][1], z + cellOffsetsZ[c][2]);
-                            auto index = (g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0];
-                            q._verts[c] = vertexIndices[index];
-                            assert(q._verts[c] < mesh._vertices.size());
-                        }
-                        AddQuad(mesh, q, d0 < 0.f);
-                    }
+        const DualContourGrid grid(samplingGridDimensions, fn.GetBoundary(), settings);
+        auto densities = std::make_unique<float[]>(
+            (samplingGridDimensions+1)*(samplingGridDimensions+1)*(samplingGridDimensions+1));
+        SampleDensities(densities.get(), grid, fn, settings);
+
+        std::vector<DualContourBrick> bricks(grid.BrickCount());
+        RunBricks(
+            grid.BrickCount(),
+            [&bricks, &grid, &densities, &fn](unsigned b)
+            {
+                BuildBrickVertices(bricks[b], grid.BrickMins(b), grid.BrickMaxs(b), grid, densities.get(), fn);
+            }, settings._parallel);
+
+        unsigned vertexCount = 0;
+        for (auto& b:bricks) {
+            b._vertexOffset = vertexCount;
+            vertexCount += unsigned(b._vertices.size());
+        }
 
-                }
-            }
+        RunBricks(
+            grid.BrickCount(),
+            [&bricks, &grid, &densities](unsigned b)
+            {
+                BuildBrickQuads(bricks[b], grid.BrickMins(b), grid.BrickMaxs(b), grid, densities.get(), bricks);
+            }, settings._parallel);
+
+        size_t quadCount = 0;
+        for (const auto& b:bricks) quadCount += b._quads.size();
+        mesh._vertices.reserve(vertexCount);
+        mesh._quads.reserve(quadCount);
+        for (const auto& b:bricks) {
+            mesh._vertices.insert(mesh._vertices.end(), b._vertices.begin(), b._vertices.end());
+            mesh._quads.insert(mesh._quads.end(), b._quads.begin(), b._quads.end());
         }
 
         return mesh;
     }
 
+    DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
+                                                const IVolumeDensityFunction& fn)
+    {
+        return DualContourMesh_Build(samplingGridDimensions, fn, DualContourSettings());
+    }
+
+    DualContourSettings::DualContourSettings()
+    {
+        _brickSize = 16;
+        _coarseStride = 4;
+        _adaptive = false;
+        _parallel = true;
+    }
+
+    void IVolumeDensityFunction::GetDensities(float dst[], const Float3 pts[], unsigned count) const
+    {
+        for (unsigned c=0; c<count; ++c)
+            dst[c] = GetDensity(pts[c]);
+    }
+
+    void IVolumeDensityFunction::GetNormals(Float3 dst[], const Float3 pts[], unsigned count) const
+    {
+        for (unsigned c=0; c<count; ++c)
+            dst[c] = GetNormal(pts[c]);
+    }
+
 
 
     DualContourMesh::DualContourMesh() {}
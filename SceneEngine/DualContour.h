@@ -23,6 +23,14 @@ namespace SceneEngine
         virtual Boundary    GetBoundary() const = 0;
         virtual float       GetDensity(const Float3& pt) const = 0;
         virtual Float3      GetNormal(const Float3& pt) const = 0;
+
+            //  Batched versions of GetDensity() & GetNormal(). The mesh builder
+            //  always queries through these; so implementations that can evaluate
+            //  many points at once cheaply should override them. The defaults
+            //  just call GetDensity() & GetNormal() for each point.
+            //  Note that these can be called from multiple threads at once.
+        virtual void        GetDensities(float dst[], const Float3 pts[], unsigned count) const;
+        virtual void        GetNormals(Float3 dst[], const Float3 pts[], unsigned count) const;
     };
 
         ////////////////////////////////////////////////////////
@@ -44,9 +52,24 @@ namespace SceneEngine
 
         ////////////////////////////////////////////////////////
 
+    class DualContourSettings
+    {
+    public:
+        unsigned    _brickSize;         ///< cells along each axis of a brick (the unit of work for threading)
+        unsigned    _coarseStride;      ///< spacing of the coarse samples used to find empty bricks in adaptive mode
+        bool        _adaptive;          ///< skip sampling bricks that the coarse samples say are entirely inside or outside
+        bool        _parallel;
+
+        DualContourSettings();
+    };
+
     DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
                                                 const IVolumeDensityFunction& fn);
 
+    DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
+                                                const IVolumeDensityFunction& fn,
+                                                const DualContourSettings& settings);
+
         ////////////////////////////////////////////////////////
 
 }
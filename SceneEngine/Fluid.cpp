@@ -473,7 +473,6 @@ namespace SceneEngine
     void FluidSolver3D::Tick(float deltaTime, const Settings& settings)
     {
         float dt = deltaTime;
-        const auto N = _pimpl->_N;
         auto& velUT0 = _pimpl->_velU[0];
         auto& velUT1 = _pimpl->_velU[1];
         auto& velUSrc = _pimpl->_velU[2];
@@ -494,24 +493,36 @@ namespace SceneEngine
         auto& densityT1 = _pimpl->_density[1];
 
             // simple buoyancy... just add upwards force where there is density
+            // This is fused with the pass that adds the sources to the working fields;
+            // each cell only depends on the same cell in the other fields.
         static float buoyancyScale = 25.f;
         const UInt3 border(1u,1u,1u);
-        for (unsigned z=border[1]; z<_pimpl->_dimsWithBorder[2]-border[2]; ++z)
-            for (unsigned y=border[1]; y<_pimpl->_dimsWithBorder[1]-border[1]; ++y)
-                for (unsigned x=border[0]; x<_pimpl->_dimsWithBorder[0]-border[0]; ++x) {
-                    unsigned i = (z*_pimpl->_dimsWithBorder[1]+y)*_pimpl->_dimsWithBorder[0]+x;
-                    velWSrc[i] += buoyancyScale * densityT1[i];
-                }
-
-        for (unsigned c=0; c<N; ++c) {
-            velUT0[c] = velUT1[c];
-            velVT0[c] = velVT1[c];
-            velWT0[c] = velWT1[c];
-            velUWorking[c] = velUT1[c] + dt * velUSrc[c];
-            velVWorking[c] = velVT1[c] + dt * velVSrc[c];
-            velWWorking[c] = velWT1[c] + dt * velWSrc[c];
-            densityWorking[c] = densityT1[c] + dt * densitySrc[c];
-        }
+        const auto dims = _pimpl->_dimsWithBorder;
+        const bool tiled = settings._tiledExecution != 0;
+        ForEachBrick(
+            UInt3(0u, 0u, 0u), dims,
+            [&](UInt3 bMins, UInt3 bMaxs)
+            {
+                for (unsigned z=bMins[2]; z<bMaxs[2]; ++z)
+                    for (unsigned y=bMins[1]; y<bMaxs[1]; ++y) {
+                        const bool interiorRow = 
+                                z >= border[2] && z < dims[2]-border[2]
+                            &&  y >= border[1] && y < dims[1]-border[1];
+                        for (unsigned x=bMins[0]; x<bMaxs[0]; ++x) {
+                            unsigned c = (z*dims[1]+y)*dims[0]+x;
+                            if (interiorRow && x >= border[0] && x < dims[0]-border[0])
+                                velWSrc[c] += buoyancyScale * densityT1[c];
+
+                            velUT0[c] = velUT1[c];
+                            velVT0[c] = velVT1[c];
+                            velWT0[c] = velWT1[c];
+                            velUWorking[c] = velUT1[c] + dt * velUSrc[c];
+                            velVWorking[c] = velVT1[c] + dt * velVSrc[c];
+                            velWWorking[c] = velWT1[c] + dt * velWSrc[c];
+                            densityWorking[c] = densityT1[c] + dt * densitySrc[c];
+                        }
+                    }
+            }, tiled);
 
         _pimpl->VelocityDiffusion(deltaTime, settings);
 
@@ -519,6 +530,7 @@ namespace SceneEngine
             (AdvectionMethod)settings._advectionMethod, (AdvectionInterp)settings._interpolationMethod, settings._advectionSteps,
             AdvectionBorder::Margin, AdvectionBorder::Margin, AdvectionBorder::Margin
         };
+        advSettings._tiled = tiled;
         PerformAdvection(
             VectorField3D(&velUT1,      &velVT1,        &velWT1,        _pimpl->_dimsWithBorder),
             VectorField3D(&velUWorking, &velVWorking,   &velWWorking,   _pimpl->_dimsWithBorder),
@@ -532,7 +544,7 @@ namespace SceneEngine
         EnforceIncompressibility(
             VectorField3D(&velUT1, &velVT1, &velWT1, _pimpl->_dimsWithBorder),
             _pimpl->_poissonSolver, *_pimpl->_incompressibility,
-            (PoissonSolver::Method)settings._enforceIncompressibilityMethod);
+            (PoissonSolver::Method)settings._enforceIncompressibilityMethod, tiled);
 
         _pimpl->DensityDiffusion(deltaTime, settings);
         PerformAdvection(
@@ -542,12 +554,20 @@ namespace SceneEngine
             VectorField3D(&velUT1, &velVT1, &velWT1, _pimpl->_dimsWithBorder),
             deltaTime, advSettings);
 
-        for (unsigned c=0; c<N; ++c) {
-            velUSrc[c] = 0.f;
-            velVSrc[c] = 0.f;
-            velWSrc[c] = 0.f;
-            densitySrc[c] = 0.f;
-        }
+        ForEachBrick(
+            UInt3(0u, 0u, 0u), dims,
+            [&](UInt3 bMins, UInt3 bMaxs)
+            {
+                for (unsigned z=bMins[2]; z<bMaxs[2]; ++z)
+                    for (unsigned y=bMins[1]; y<bMaxs[1]; ++y)
+                        for (unsigned x=bMins[0]; x<bMaxs[0]; ++x) {
+                            unsigned c = (z*dims[1]+y)*dims[0]+x;
+                            velUSrc[c] = 0.f;
+                            velVSrc[c] = 0.f;
+                            velWSrc[c] = 0.f;
+                            densitySrc[c] = 0.f;
+                        }
+            }, tiled);
     }
 
     void FluidSolver3D::AddDensity(UInt3 coords, float amount)
@@ -621,6 +641,8 @@ namespace SceneEngine
 
     UInt3 FluidSolver3D::GetDimensions() const { return _pimpl->_dimsWithoutBorder; }
 
+    const float* FluidSolver3D::GetDensityField() const { return _pimpl->_density[1].data(); }
+
     FluidSolver3D::FluidSolver3D(UInt3 dimensions)
     {
         _pimpl = std::make_unique<Pimpl>();
@@ -664,6 +686,7 @@ namespace SceneEngine
         _enforceIncompressibilityMethod = 3;
         _vorticityConfinement = 0.75f;
         _interpolationMethod = 0;
+        _tiledExecution = 1;
     }
 
 
@@ -728,6 +751,8 @@ template<> const ClassAccessors& GetAccessors<SceneEngine::FluidSolver3D::Settin
 
         props.Add(u("EnforceIncompressibility"), DefaultGet(Obj, _enforceIncompressibilityMethod),  DefaultSet(Obj, _enforceIncompressibilityMethod));
         props.Add(u("VorticityConfinement"), DefaultGet(Obj, _vorticityConfinement),  DefaultSet(Obj, _vorticityConfinement));
+
+        props.Add(u("TiledExecution"), DefaultGet(Obj, _tiledExecution),  DefaultSet(Obj, _tiledExecution));
         
         init = true;
     }
@@ -122,6 +122,9 @@ namespace SceneEngine
             float       _addDensity;
             float       _addTemperature;
 
+                // execution
+            int         _tiledExecution;    ///< split each stage into bricks, and run them on the task pool
+
             Settings();
         };
 
@@ -129,6 +132,10 @@ namespace SceneEngine
         void AddDensity(UInt3 coords, float amount);
         UInt3 GetDimensions() const;
 
+            /// Density field, including a 1 cell border on every side
+            /// (ie, with dimensions of GetDimensions() + UInt3(2,2,2))
+        const float* GetDensityField() const;
+
         void RenderDebugging(
             RenderCore::Metal::DeviceContext& metalContext,
             LightingParserContext& parserContext,
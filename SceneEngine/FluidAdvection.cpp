@@ -5,6 +5,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "FluidAdvection.h"
+#include "FluidHelper.h"
 #include "../Math/RegularNumberField.h"
 
 #pragma warning(disable:4714)
@@ -146,11 +147,24 @@ namespace SceneEngine
             }
         }
     
+    template<typename Dims>
+        static UInt3 GetAdvectionMargin(Dims dimensions, const AdvectionSettings& settings)
+    {
+            // when the border condition is "margin" we create a 1 cell margin on that
+            // edge that will be read from, but not written to
+        UInt3 margin = As3DBorder(dimensions);
+        if (settings._borderX != AdvectionBorder::Margin) margin[0] = 0;
+        if (settings._borderY != AdvectionBorder::Margin) margin[1] = 0;
+        if (settings._borderZ != AdvectionBorder::Margin) margin[2] = 0;
+        return margin;
+    }
+
     template<unsigned WrappingFlags, typename Field, typename VelField>
         static void PerformAdvection_Internal(
             Field dstValues, Field srcValues, 
             VelField velFieldT0, VelField velFieldT1,
-            float deltaTime, const AdvectionSettings& settings)
+            float deltaTime, const AdvectionSettings& settings,
+            UInt3 rangeMins, UInt3 rangeMaxs)
     {
         //
         // This is the advection step. We will use the method of characteristics.
@@ -183,12 +197,8 @@ namespace SceneEngine
         assert(dstValues.Dimensions() == velFieldT1.Dimensions());
         const UInt3 dims = As3DDims(dstValues.Dimensions());
 
-            // when the border condition is "margin" we create a 1 cell margin on that
-            // edge that will be read from, but not written to
-        UInt3 margin = As3DBorder(dstValues.Dimensions());
-        if (settings._borderX != AdvectionBorder::Margin) margin[0] = 0;
-        if (settings._borderY != AdvectionBorder::Margin) margin[1] = 0;
-        if (settings._borderZ != AdvectionBorder::Margin) margin[2] = 0;
+            // we only write to cells in [rangeMins, rangeMaxs) (which must be within the margin)
+        const UInt3 margin = GetAdvectionMargin(dstValues.Dimensions(), settings);
 
         using FloatCoord = typename VelField::FloatCoord;
         using Coord = typename VelField::Coord;
@@ -205,9 +215,9 @@ namespace SceneEngine
                 //  through the velocity field to find an approximation
                 //  of where the point was in the previous frame.
 
-            for (unsigned z=margin[2]; z<dims[2]-margin[2]; ++z)
-                for (unsigned y=margin[1]; y<dims[1]-margin[1]; ++y)
-                    for (unsigned x=margin[0]; x<dims[0]-margin[0]; ++x) {
+            for (unsigned z=rangeMins[2]; z<rangeMaxs[2]; ++z)
+                for (unsigned y=rangeMins[1]; y<rangeMaxs[1]; ++y)
+                    for (unsigned x=rangeMins[0]; x<rangeMaxs[0]; ++x) {
                         auto coord = ConvertVector<Coord>(UInt3(x, y, z));
                         auto startVel = velFieldT1.Load(coord);
                         FloatCoord tap = ConvertVector<FloatCoord>(coord) - MultiplyAcross(deltaTime * velFieldScale, startVel);
@@ -218,9 +228,9 @@ namespace SceneEngine
         } else if (advectionMethod == AdvectionMethod::ForwardEulerDiv) {
 
             auto stepScale = decltype(velFieldScale)(deltaTime * velFieldScale / float(adjvectionSteps));
-            for (unsigned z=margin[2]; z<dims[2]-margin[2]; ++z)
-                for (unsigned y=margin[1]; y<dims[1]-margin[1]; ++y)
-                    for (unsigned x=margin[0]; x<dims[0]-margin[0]; ++x) {
+            for (unsigned z=rangeMins[2]; z<rangeMaxs[2]; ++z)
+                for (unsigned y=rangeMins[1]; y<rangeMaxs[1]; ++y)
+                    for (unsigned x=rangeMins[0]; x<rangeMaxs[0]; ++x) {
 
                         auto coord = ConvertVector<Coord>(UInt3(x, y, z));
                         auto tap = ConvertVector<FloatCoord>(UInt3(x, y, z));
@@ -244,9 +254,9 @@ namespace SceneEngine
             if (settings._interpolation == AdvectionInterp::Bilinear) {
 
                 const auto SamplingFlags = WrappingFlags;
-                for (unsigned z=margin[2]; z<dims[2]-margin[2]; ++z)
-                    for (unsigned y=margin[1]; y<dims[1]-margin[1]; ++y)
-                        for (unsigned x=margin[0]; x<dims[0]-margin[0]; ++x) {
+                for (unsigned z=rangeMins[2]; z<rangeMaxs[2]; ++z)
+                    for (unsigned y=rangeMins[1]; y<rangeMaxs[1]; ++y)
+                        for (unsigned x=rangeMins[0]; x<rangeMaxs[0]; ++x) {
 
                                 // This is the RK4 version
                                 // We'll use the average of the velocity field at t and
@@ -265,9 +275,9 @@ namespace SceneEngine
             } else {
 
                 const auto SamplingFlags = RNFSample::Cubic|WrappingFlags;
-                for (unsigned z=margin[2]; z<dims[2]-margin[2]; ++z)
-                    for (unsigned y=margin[1]; y<dims[1]-margin[1]; ++y)
-                        for (unsigned x=margin[0]; x<dims[0]-margin[0]; ++x) {
+                for (unsigned z=rangeMins[2]; z<rangeMaxs[2]; ++z)
+                    for (unsigned y=rangeMins[1]; y<rangeMaxs[1]; ++y)
+                        for (unsigned x=rangeMins[0]; x<rangeMaxs[0]; ++x) {
                             auto coord = ConvertVector<Coord>(UInt3(x, y, z));
                             const auto tap = AdvectRK4<SamplingFlags>(velFieldT1, velFieldT0, coord, -deltaTime * velFieldScale);
                             dstValues.Write(coord, srcValues.Sample<SamplingFlags>(tap));
@@ -305,9 +315,9 @@ namespace SceneEngine
             if (settings._interpolation == AdvectionInterp::Bilinear) {
 
                 const auto SamplingFlags = WrappingFlags;
-                for (unsigned z=margin[2]; z<dims[2]-margin[2]; ++z)
-                    for (unsigned y=margin[1]; y<dims[1]-margin[1]; ++y)
-                        for (unsigned x=margin[0]; x<dims[0]-margin[0]; ++x) {
+                for (unsigned z=rangeMins[2]; z<rangeMaxs[2]; ++z)
+                    for (unsigned y=rangeMins[1]; y<rangeMaxs[1]; ++y)
+                        for (unsigned x=rangeMins[0]; x<rangeMaxs[0]; ++x) {
 
                             auto coord = ConvertVector<Coord>(UInt3(x, y, z));
 
@@ -342,9 +352,9 @@ namespace SceneEngine
             } else {
 
                 const auto SamplingFlags = RNFSample::Cubic|WrappingFlags;
-                for (unsigned z=margin[2]; z<dims[2]-margin[2]; ++z)
-                    for (unsigned y=margin[1]; y<dims[1]-margin[1]; ++y)
-                        for (unsigned x=margin[0]; x<dims[0]-margin[0]; ++x) {
+                for (unsigned z=rangeMins[2]; z<rangeMaxs[2]; ++z)
+                    for (unsigned y=rangeMins[1]; y<rangeMaxs[1]; ++y)
+                        for (unsigned x=rangeMins[0]; x<rangeMaxs[0]; ++x) {
 
                             auto coord = ConvertVector<Coord>(UInt3(x, y, z));
                             const auto predictor = AdvectRK4<SamplingFlags>(velFieldT1, velFieldT0, coord, -deltaTime * velFieldScale);
@@ -369,6 +379,28 @@ namespace SceneEngine
 
     }
 
+    template<unsigned WrappingFlags, typename Field, typename VelField>
+        static void PerformAdvection_Bricks(
+            Field dstValues, Field srcValues, 
+            VelField velFieldT0, VelField velFieldT1,
+            float deltaTime, const AdvectionSettings& settings)
+    {
+            // Every cell is advected independently (we write only to the destination cell,
+            // and read only from fields that aren't written). So we can split the grid into
+            // bricks and run them in parallel, and the result is the same as the serial path.
+            // The destination field must not alias the source fields, however.
+        const UInt3 dims = As3DDims(dstValues.Dimensions());
+        const UInt3 margin = GetAdvectionMargin(dstValues.Dimensions(), settings);
+        ForEachBrick(
+            margin, dims - margin,
+            [&](UInt3 brickMins, UInt3 brickMaxs)
+            {
+                PerformAdvection_Internal<WrappingFlags>(
+                    dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings,
+                    brickMins, brickMaxs);
+            }, settings._tiled);
+    }
+
     template<typename Field, typename VelField>
         void PerformAdvection(
             Field dstValues, Field srcValues, 
@@ -384,41 +416,41 @@ namespace SceneEngine
             &&  settings._borderY != AdvectionBorder::Wrap 
             &&  settings._borderZ != AdvectionBorder::Wrap) {
 
-            PerformAdvection_Internal<RNFSample::WrapX|RNFSample::ClampY|RNFSample::ClampZ>(
+            PerformAdvection_Bricks<RNFSample::WrapX|RNFSample::ClampY|RNFSample::ClampZ>(
                 dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings);
 
         } else if ( settings._borderX != AdvectionBorder::Wrap 
             &&      settings._borderY == AdvectionBorder::Wrap 
             &&      settings._borderZ != AdvectionBorder::Wrap) {
 
-            PerformAdvection_Internal<RNFSample::ClampX|RNFSample::WrapY|RNFSample::ClampZ>(
+            PerformAdvection_Bricks<RNFSample::ClampX|RNFSample::WrapY|RNFSample::ClampZ>(
                 dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings);
 
         } else if ( settings._borderX != AdvectionBorder::Wrap 
             &&      settings._borderY != AdvectionBorder::Wrap 
             &&      settings._borderZ == AdvectionBorder::Wrap) {
 
-            PerformAdvection_Internal<RNFSample::ClampX|RNFSample::ClampY|RNFSample::WrapZ>(
+            PerformAdvection_Bricks<RNFSample::ClampX|RNFSample::ClampY|RNFSample::WrapZ>(
                 dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings);
 
         } else if ( settings._borderX == AdvectionBorder::Wrap 
             &&      settings._borderY == AdvectionBorder::Wrap 
             &&      settings._borderZ == AdvectionBorder::Wrap) {
 
-            PerformAdvection_Internal<RNFSample::WrapX|RNFSample::WrapY|RNFSample::WrapZ>(
+            PerformAdvection_Bricks<RNFSample::WrapX|RNFSample::WrapY|RNFSample::WrapZ>(
                 dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings);
 
         } else if ( settings._borderX == AdvectionBorder::Wrap 
             &&      settings._borderY == AdvectionBorder::Wrap 
             &&      settings._borderZ != AdvectionBorder::Wrap) {
 
-            PerformAdvection_Internal<RNFSample::WrapX|RNFSample::WrapY|RNFSample::ClampZ>(
+            PerformAdvection_Bricks<RNFSample::WrapX|RNFSample::WrapY|RNFSample::ClampZ>(
                 dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings);
 
         } else {
 
             assert(settings._borderX != AdvectionBorder::Wrap && settings._borderY != AdvectionBorder::Wrap && settings._borderZ != AdvectionBorder::Wrap);
-            PerformAdvection_Internal<RNFSample::ClampX|RNFSample::ClampY|RNFSample::ClampZ>(
+            PerformAdvection_Bricks<RNFSample::ClampX|RNFSample::ClampY|RNFSample::ClampZ>(
                 dstValues, srcValues, velFieldT0, velFieldT1, deltaTime, settings);
 
         }
@@ -432,6 +464,7 @@ namespace SceneEngine
         _borderX = AdvectionBorder::Margin; 
         _borderY = AdvectionBorder::Margin; 
         _borderZ = AdvectionBorder::Margin;
+        _tiled = true;
     }
 
     AdvectionSettings::AdvectionSettings(
@@ -446,6 +479,7 @@ namespace SceneEngine
         _borderX = borderX;
         _borderY = borderY;
         _borderZ = borderZ;
+        _tiled = true;
     }
 
     template void PerformAdvection(
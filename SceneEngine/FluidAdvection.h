@@ -19,6 +19,7 @@ namespace SceneEngine
         AdvectionInterp _interpolation;
         unsigned        _subSteps;
         AdvectionBorder _borderX, _borderY, _borderZ;
+        bool            _tiled;         ///< split into bricks, and run in parallel (see ForEachBrick)
 
         AdvectionSettings();
         AdvectionSettings(
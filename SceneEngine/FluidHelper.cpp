@@ -6,10 +6,61 @@
 
 #include "FluidHelper.h"
 #include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/TaskScheduler.h"
 
 namespace SceneEngine
 {
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        // 32x8x8 floats is 8KB per field -- so even the stages that touch 6 or 7
+        // fields at once should stay within L2
+    static const unsigned BrickWidth = 32, BrickHeight = 8, BrickDepth = 8;
+
+    void ForEachBrick(
+        UInt3 mins, UInt3 maxs,
+        const std::function<void(UInt3 brickMins, UInt3 brickMaxs)>& fn,
+        bool parallel)
+    {
+        if (mins[0] >= maxs[0] || mins[1] >= maxs[1] || mins[2] >= maxs[2]) return;
+
+            // for 2D fields, make the bricks taller to keep the same number of cells
+        const UInt3 brickSize(
+            BrickWidth, 
+            ((maxs[2] - mins[2]) > 1) ? BrickHeight : (BrickHeight * BrickDepth),
+            BrickDepth);
+        const UInt3 brickCounts(
+            (maxs[0] - mins[0] + brickSize[0] - 1) / brickSize[0],
+            (maxs[1] - mins[1] + brickSize[1] - 1) / brickSize[1],
+            (maxs[2] - mins[2] + brickSize[2] - 1) / brickSize[2]);
+        const auto brickCount = brickCounts[0] * brickCounts[1] * brickCounts[2];
+
+        auto runBrick = [&](unsigned brickIndex)
+        {
+            UInt3 b(
+                brickIndex % brickCounts[0],
+                (brickIndex / brickCounts[0]) % brickCounts[1],
+                brickIndex / (brickCounts[0] * brickCounts[1]));
+            UInt3 brickMins(
+                mins[0] + b[0] * brickSize[0],
+                mins[1] + b[1] * brickSize[1],
+                mins[2] + b[2] * brickSize[2]);
+            UInt3 brickMaxs(
+                std::min(maxs[0], brickMins[0] + brickSize[0]),
+                std::min(maxs[1], brickMins[1] + brickSize[1]),
+                std::min(maxs[2], brickMins[2] + brickSize[2]));
+            fn(brickMins, brickMaxs);
+        };
+
+        if (parallel) {
+            ParallelFor(ConsoleRig::GlobalServices::GetShortTaskThreadPool(), brickCount, runBrick);
+        } else {
+            for (unsigned c=0; c<brickCount; ++c)
+                runBrick(c);
+        }
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     static std::shared_ptr<PoissonSolver::PreparedMatrix> BuildDiffusionMethod(
@@ -39,12 +90,14 @@ namespace SceneEngine
         auto iterationsu = solver.Solve(
             AsScalarField1D(*vectorField._u), *_matrix, AsScalarField1D(*vectorField._u), 
             method);
+        auto solveTime = solver.GetLastSolveStatistics()._solveTime;
         auto iterationsv = solver.Solve(
             AsScalarField1D(*vectorField._v), *_matrix, AsScalarField1D(*vectorField._v), 
             method);
 
         if (name)
-            LogInfo << name << " diffusion took: (" << iterationsu << ", " << iterationsv << ") iterations.";
+            LogInfo << name << " diffusion took: (" << iterationsu << ", " << iterationsv << ") iterations, "
+                << solveTime + solver.GetLastSolveStatistics()._solveTime << "ms.";
     }
 
     void DiffusionHelper::Execute(
@@ -66,7 +119,8 @@ namespace SceneEngine
             method);
 
         if (name)
-            LogInfo << name << " diffusion took: (" << iterationsu << ") iterations.";
+            LogInfo << name << " diffusion took: (" << iterationsu << ") iterations, "
+                << solver.GetLastSolveStatistics()._solveTime << "ms.";
     }
 
     DiffusionHelper::DiffusionHelper() { _preparedValue = 0.f; _preparedMethod = (PoissonSolver::Method)~0u; _preparedWrapEdges = 0u; }
@@ -161,31 +215,39 @@ namespace SceneEngine
                 (*velField._v)[i] -= .5f*velFieldScale[1] * (qBuffer._u[i2] - qBuffer._u[i3]);
             }
 
-        LogInfo << "EnforceIncompressibility took: " << iterations << " iterations.";
+        LogInfo << "EnforceIncompressibility took: " << iterations << " iterations, " << solver.GetLastSolveStatistics()._solveTime << "ms.";
     }
 
     void EnforceIncompressibility(
         VectorField3D velField,
         const PoissonSolver& solver, const PoissonSolver::PreparedMatrix& A,
-        PoissonSolver::Method method)
+        PoissonSolver::Method method, bool parallel)
     {
         const auto dims = velField.Dimensions();
         VectorX delW(dims[0] * dims[1] * dims[2]), q(dims[0] * dims[1] * dims[2]);
         q.fill(0.f);    // when using the "SOR" method, q must be filled in to some initial estimate
         const UInt3 border(1,1,1);
         auto velFieldScale = Float3(float(dims[0]-2*border[0]), float(dims[1]-2*border[1]), float(dims[2]-2*border[2]));
-        for (unsigned z=border[2]; z<dims[2]-border[2]; ++z)
-            for (unsigned y=border[1]; y<dims[1]-border[1]; ++y)
-                for (unsigned x=border[0]; x<dims[0]-border[0]; ++x) {
-                    const auto i = (z*dims[1]+y)*dims[0]+x;
-                    delW[i] = 
-                        -0.5f * 
-                        (
-                              ((*velField._u)[i+1]               - (*velField._u)[i-1]) / velFieldScale[0]
-                            + ((*velField._v)[i+dims[0]]         - (*velField._v)[i-dims[0]]) / velFieldScale[1]
-                            + ((*velField._w)[i+dims[0]*dims[1]] - (*velField._w)[i-dims[0]*dims[1]])  / velFieldScale[2]
-                        );
-                }
+
+            // Both the divergence and the gradient passes only read from neighbouring cells
+            // of fields that aren't written in the same pass; so they can be split into bricks
+        ForEachBrick(
+            border, dims-border,
+            [&velField, &delW, dims, velFieldScale](UInt3 bMins, UInt3 bMaxs)
+            {
+                for (unsigned z=bMins[2]; z<bMaxs[2]; ++z)
+                    for (unsigned y=bMins[1]; y<bMaxs[1]; ++y)
+                        for (unsigned x=bMins[0]; x<bMaxs[0]; ++x) {
+                            const auto i = (z*dims[1]+y)*dims[0]+x;
+                            delW[i] = 
+                                -0.5f * 
+                                (
+                                      ((*velField._u)[i+1]               - (*velField._u)[i-1]) / velFieldScale[0]
+                                    + ((*velField._v)[i+dims[0]]         - (*velField._v)[i-dims[0]]) / velFieldScale[1]
+                                    + ((*velField._w)[i+dims[0]*dims[1]] - (*velField._w)[i-dims[0]*dims[1]])  / velFieldScale[2]
+                                );
+                        }
+            }, parallel);
 
         SmearBorder3D(delW, dims);
         auto iterations = solver.Solve(
@@ -193,16 +255,21 @@ namespace SceneEngine
             method);
         SmearBorder3D(q, dims);
 
-        for (unsigned z=border[2]; z<dims[2]-border[2]; ++z)
-            for (unsigned y=border[1]; y<dims[1]-border[1]; ++y)
-                for (unsigned x=border[0]; x<dims[0]-border[0]; ++x) {
-                    const auto i = (z*dims[1]+y)*dims[0]+x;
-                    (*velField._u)[i] -= .5f*velFieldScale[0] * (q[i+1]                 - q[i-1]);
-                    (*velField._v)[i] -= .5f*velFieldScale[1] * (q[i+dims[0]]           - q[i-dims[0]]);
-                    (*velField._w)[i] -= .5f*velFieldScale[2] * (q[i+dims[0]*dims[1]]   - q[i-dims[0]*dims[1]]);
-                }
-
-        LogInfo << "EnforceIncompressibility took: " << iterations << " iterations.";
+        ForEachBrick(
+            border, dims-border,
+            [&velField, &q, dims, velFieldScale](UInt3 bMins, UInt3 bMaxs)
+            {
+                for (unsigned z=bMins[2]; z<bMaxs[2]; ++z)
+                    for (unsigned y=bMins[1]; y<bMaxs[1]; ++y)
+                        for (unsigned x=bMins[0]; x<bMaxs[0]; ++x) {
+                            const auto i = (z*dims[1]+y)*dims[0]+x;
+                            (*velField._u)[i] -= .5f*velFieldScale[0] * (q[i+1]                 - q[i-1]);
+                            (*velField._v)[i] -= .5f*velFieldScale[1] * (q[i+dims[0]]           - q[i-dims[0]]);
+                            (*velField._w)[i] -= .5f*velFieldScale[2] * (q[i+dims[0]*dims[1]]   - q[i-dims[0]*dims[1]]);
+                        }
+            }, parallel);
+
+        LogInfo << "EnforceIncompressibility took: " << iterations << " iterations, " << solver.GetLastSolveStatistics()._solveTime << "ms.";
     }
 
     
@@ -11,6 +11,7 @@
 #include "../Math/PoissonSolver.h"
 #include "../Math/Vector.h"
 #include <memory>
+#include <functional>
 
 #pragma warning(disable:4714)
 #pragma push_macro("new")
@@ -29,6 +30,18 @@ namespace SceneEngine
 
     inline ScalarField1D AsScalarField1D(VectorX& v) { return ScalarField1D { v.data(), (unsigned)v.size() }; }
 
+        /// <summary>Runs "fn" over the cells in [mins, maxs), split into bricks</summary>
+        /// Bricks are small enough that the working set of a stencil operation fits in
+        /// cache. When "parallel" is true, the bricks are run on the short task pool; so
+        /// "fn" must only write to cells within its own brick. It can read from anywhere
+        /// in fields that aren't written during the same pass (so the halo around each
+        /// brick is just read directly from the neighbouring cells).
+        /// When "parallel" is false, the bricks are run in order on the calling thread.
+    void ForEachBrick(
+        UInt3 mins, UInt3 maxs,
+        const std::function<void(UInt3 brickMins, UInt3 brickMaxs)>& fn,
+        bool parallel = true);
+
     class DiffusionHelper
     {
     public:
@@ -85,7 +98,7 @@ namespace SceneEngine
     void EnforceIncompressibility(
         VectorField3D velField,
         const PoissonSolver& solver, const PoissonSolver::PreparedMatrix& A,
-        PoissonSolver::Method method);
+        PoissonSolver::Method method, bool parallel = true);
 
     class LightingParserContext;
     enum RenderFluidMode { Scalar, Vector };
@@ -84,7 +84,8 @@ namespace SceneEngine
             // because we want to get the result get right. But that means the
             // immediate context can't be doing anything else in another thread.
             //
-            // This will require more complex threading support in the future!
+            // This is now only a fallback for models without CPU side intersection
+            // data (see RayVsModel_CPU).
         assert(metalContext.IsImmediate());
 
             //  We need to invoke the render for the given object
@@ -139,35 +140,59 @@ namespace SceneEngine
                 {
                     float rayLength = Magnitude(worldSpaceRay.second - worldSpaceRay.first);
 
-                    auto cam = context.GetCameraDesc();
-                    ModelIntersectionStateContext stateContext(
-                        ModelIntersectionStateContext::RayTest,
-                        context.GetThreadContext(), context.GetTechniqueContext(), &cam);
-                    stateContext.SetRay(worldSpaceRay);
+                        //  We only use the GPU for models that don't have CPU side intersection
+                        //  data (see RayVsModel_CPU). The GPU test needs the immediate context and
+                        //  a stall while we wait for the results, so we only create it on demand.
+                    std::unique_ptr<ModelIntersectionStateContext> gpuStateContext;
 
-                    // note --  we could do this all in a single render call, except that there
-                    //          is no way to associate a low level intersection result with a specific
-                    //          draw call.
                     auto count = trans->GetObjectCount();
                     for (unsigned c=0; c<count; ++c) {
                         auto guid = trans->GetGuid(c);
-                        auto results = PlacementsIntersection(
-                            *metalContext.get(), stateContext, 
-                            *_placementsEditor->GetManager()->GetRenderer(), *_placements,
-                            guid);
+                        const auto& obj = trans->GetObject(c);
 
                         bool gotGoodResult = false;
                         unsigned drawCallIndex = 0;
                         uint64 materialGuid = 0;
                         float intersectionDistance = FLT_MAX;
-                        for (auto i=results.cbegin(); i!=results.cend(); ++i) {
-                            if (i->_intersectionDepth < intersectionDistance) {
-                                intersectionDistance = i->_intersectionDepth;
-                                drawCallIndex = i->_drawCallIndex;
-                                materialGuid = i->_materialGuid;
+
+                        bool needGPUTest = false;
+                        TRY
+                        {
+                            ModelIntersectionStateContext::ResultEntry hit;
+                            if (FirstRayVsModel_CPU(hit, obj._model.c_str(), obj._localToWorld, worldSpaceRay)) {
+                                intersectionDistance = hit._intersectionDepth;
+                                drawCallIndex = hit._drawCallIndex;
+                                materialGuid = hit._materialGuid;
                                 gotGoodResult = true;
                             }
                         }
+                        CATCH(const ::Assets::Exceptions::PendingAsset&) {}
+                        CATCH(const ::Assets::Exceptions::InvalidAsset&) { needGPUTest = true; }
+                        CATCH(const ::Assets::Exceptions::FormatError&) { needGPUTest = true; }
+                        CATCH_END
+
+                        if (needGPUTest) {
+                            if (!gpuStateContext) {
+                                auto cam = context.GetCameraDesc();
+                                gpuStateContext = std::make_unique<ModelIntersectionStateContext>(
+                                    ModelIntersectionStateContext::RayTest,
+                                    context.GetThreadContext(), context.GetTechniqueContext(), &cam);
+                                gpuStateContext->SetRay(worldSpaceRay);
+                            }
+
+                            auto results = PlacementsIntersection(
+                                *metalContext.get(), *gpuStateContext, 
+                                *_placementsEditor->GetManager()->GetRenderer(), *_placements,
+                                guid);
+                            for (auto i=results.cbegin(); i!=results.cend(); ++i) {
+                                if (i->_intersectionDepth < intersectionDistance) {
+                                    intersectionDistance = i->_intersectionDepth;
+                                    drawCallIndex = i->_drawCallIndex;
+                                    materialGuid = i->_materialGuid;
+                                    gotGoodResult = true;
+                                }
+                            }
+                        }
 
                         if (gotGoodResult && intersectionDistance < result._distance) {
                             result = Result();
@@ -180,7 +205,7 @@ namespace SceneEngine
                             result._drawCallIndex = drawCallIndex;
                             result._materialGuid = materialGuid;
                             result._materialName = trans->GetMaterialName(c, materialGuid);
-                            result._modelName = trans->GetObject(c)._model;
+                            result._modelName = obj._model;
                         }
                     }
                 }
@@ -234,24 +259,19 @@ namespace SceneEngine
 
                 TRY
                 {
-                    auto cam = context.GetCameraDesc();
-                    ModelIntersectionStateContext stateContext(
-                        ModelIntersectionStateContext::FrustumTest,
-                        context.GetThreadContext(), context.GetTechniqueContext(), &cam);
-                    stateContext.SetFrustum(worldToProjection);
-
-                    // note --  we could do this all in a single render call, except that there
-                    //          is no way to associate a low level intersection result with a specific
-                    //          draw call.
+                        // (as with the ray test, we only use the GPU as a fallback)
+                    std::unique_ptr<ModelIntersectionStateContext> gpuStateContext;
+
                     auto count = trans->GetObjectCount();
                     for (unsigned c=0; c<count; ++c) {
+                        const auto& obj = trans->GetObject(c);
                         
                             //  We only need to test the triangles if the bounding box is 
                             //  intersecting the edge of the frustum... If the entire bounding
                             //  box is within the frustum, then we must have a hit
                         auto boundary = trans->GetLocalBoundingBox(c);
                         auto boundaryTest = TestAABB(
-                            Combine(trans->GetObject(c)._localToWorld, worldToProjection),
+                            Combine(obj._localToWorld, worldToProjection),
                             boundary.first, boundary.second);
                         if (boundaryTest == AABBIntersection::Culled) continue; // (could happen because earlier tests were on the world space bounding box)
 
@@ -259,10 +279,30 @@ namespace SceneEngine
                         
                         bool isInside = boundaryTest == AABBIntersection::Within;
                         if (!isInside) {
-                            auto results = PlacementsIntersection(
-                                *metalContext.get(), stateContext, 
-                                *_placementsEditor->GetManager()->GetRenderer(), *_placements, guid);
-                            isInside = !results.empty();
+                            bool needGPUTest = false;
+                            TRY
+                            {
+                                isInside = AnyWithinFrustum_CPU(obj._model.c_str(), obj._localToWorld, worldToProjection);
+                            }
+                            CATCH(const ::Assets::Exceptions::PendingAsset&) {}
+                            CATCH(const ::Assets::Exceptions::InvalidAsset&) { needGPUTest = true; }
+                            CATCH(const ::Assets::Exceptions::FormatError&) { needGPUTest = true; }
+                            CATCH_END
+
+                            if (needGPUTest) {
+                                if (!gpuStateContext) {
+                                    auto cam = context.GetCameraDesc();
+                                    gpuStateContext = std::make_unique<ModelIntersectionStateContext>(
+                                        ModelIntersectionStateContext::FrustumTest,
+                                        context.GetThreadContext(), context.GetTechniqueContext(), &cam);
+                                    gpuStateContext->SetFrustum(worldToProjection);
+                                }
+
+                                auto results = PlacementsIntersection(
+                                    *metalContext.get(), *gpuStateContext, 
+                                    *_placementsEditor->GetManager()->GetRenderer(), *_placements, guid);
+                                isInside = !results.empty();
+                            }
                         }
 
                         if (isInside) {
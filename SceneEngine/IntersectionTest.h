@@ -79,10 +79,11 @@ namespace SceneEngine
     /// This object can calculate intersections of basic primitives against
     /// the scene. This is intended for tools to perform interactive operations
     /// (like selecting objects in the scene).
-    /// Note that much of the intersection math is performed on the GPU. This means
-    /// that any intersection operation will probably involve a GPU synchronisation.
-    /// This isn't intended to be used at runtime in a game, because it may cause
-    /// frame-rate hitches. But for tools, it should not be an issue.
+    /// Placement intersections are calculated on the CPU, using the BVH stored with
+    /// each model (see RayVsModel_CPU). However, terrain intersections (and placements
+    /// for models without CPU side intersection data) still use the GPU, and will involve
+    /// a GPU synchronisation. So tests against terrain may cause frame-rate hitches if
+    /// used at runtime in a game.
     class IntersectionTestScene
     {
     public:
@@ -42,9 +42,13 @@
 #include "../Utility/Streams/StreamFormatter.h"
 #include "../Utility/Streams/StreamDOM.h"
 #include "../Utility/Conversion.h"
+#include "../Utility/Threading/TaskScheduler.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Core/Types.h"
 
 #include <random>
+#include <cstddef>
 
 namespace RenderCore { 
     extern char VersionString[];
@@ -89,9 +93,13 @@ namespace SceneEngine
         unsigned                GetObjectReferenceCount() const;
         const void*             GetFilenamesBuffer() const;
         const uint64*           GetSupplementsBuffer() const;
+        IteratorRange<const uint8*> GetPrebuiltSpatialIndex() const;
+        const std::shared_ptr<MemoryMappedFile>& GetMappedFile() const { return _mappedFile; }
 
         void Write(const Assets::ResChar destinationFile[]) const;
         void LogDetails(const char title[]) const;
+        void DetachFromFile();
+        IteratorRange<const uint8*> GetSpatialIndexForWrite() const;
 
         Placements(const ResChar filename[]);
         Placements();
@@ -101,16 +109,30 @@ namespace SceneEngine
         std::vector<uint8>              _filenamesBuffer;
         std::vector<uint64>             _supplementsBuffer;
 
+            //  When loaded from a file, the object references, string table and
+            //  supplements are used in place, directly from a memory mapping of
+            //  the file. In that case, the vectors above are empty until DetachFromFile()
+        std::shared_ptr<MemoryMappedFile>       _mappedFile;
+        IteratorRange<const ObjectReference*>   _mappedObjects;
+        IteratorRange<const uint8*>             _mappedFilenames;
+        IteratorRange<const uint64*>            _mappedSupplements;
+        IteratorRange<const uint8*>             _mappedSpatialIndex;
+
+            //  Serialized BVH for the current objects, so we don't rebuild it on every
+            //  save. Cleared whenever the objects might change (see DynamicPlacements)
+        mutable std::vector<uint8>              _spatialIndexCache;
+
         std::shared_ptr<::Assets::DependencyValidation>   _dependencyValidation;
         void ReplaceString(const char oldString[], const char newString[]);
 
         static void Resolver(void*, IteratorRange<::Assets::AssetChunkResult*>);
     };
 
-    auto            Placements::GetObjectReferences() const -> const ObjectReference*   { return AsPointer(_objects.begin()); }
-    unsigned        Placements::GetObjectReferenceCount() const                         { return unsigned(_objects.size()); }
-    const void*     Placements::GetFilenamesBuffer() const                              { return AsPointer(_filenamesBuffer.begin()); }
-    const uint64*   Placements::GetSupplementsBuffer() const                            { return AsPointer(_supplementsBuffer.begin()); }
+    auto            Placements::GetObjectReferences() const -> const ObjectReference*   { return _mappedFile ? _mappedObjects.begin() : AsPointer(_objects.begin()); }
+    unsigned        Placements::GetObjectReferenceCount() const                         { return unsigned(_mappedFile ? _mappedObjects.size() : _objects.size()); }
+    const void*     Placements::GetFilenamesBuffer() const                              { return _mappedFile ? _mappedFilenames.begin() : AsPointer(_filenamesBuffer.begin()); }
+    const uint64*   Placements::GetSupplementsBuffer() const                            { return _mappedFile ? _mappedSupplements.begin() : AsPointer(_supplementsBuffer.begin()); }
+    IteratorRange<const uint8*> Placements::GetPrebuiltSpatialIndex() const             { return _mappedSpatialIndex; }
 
     static const uint64 ChunkType_Placements = ConstHash64<'Plac','emen','ts'>::Value;
 
@@ -124,29 +146,138 @@ namespace SceneEngine
         unsigned _dummy;
     };
 
+        //  From version 1, the header is followed by a table of offsets to each
+        //  section (relative to the start of the chunk). Every section begins on a
+        //  16 byte boundary in the file, so they can be used directly from a memory
+        //  mapping.
+    class PlacementsSectionTable
+    {
+    public:
+        unsigned _objectsOffset;
+        unsigned _filenamesOffset;
+        unsigned _supplementsOffset;
+        unsigned _spatialIndexOffset;
+        unsigned _spatialIndexSize;
+        unsigned _dummy[3];
+    };
+
+    static const unsigned PlacementsVersion_Legacy = 0;
+    static const unsigned PlacementsVersion_InPlace = 1;
+    static const unsigned PlacementsSectionAlignment = 16;
+
+        //  Chunk version 0 is only used for the legacy layout. The in-place layout is
+        //  always written with chunk version 1
+    static const unsigned PlacementsChunkVersion_Legacy = 0;
+    static const unsigned PlacementsChunkVersion = 1;
+
+        //  Object references are used in place from the file, so the layout on disk is
+        //  the in-memory layout. We write them member by member into zeroed records (so
+        //  the padding before "_guid" is deterministic), and check the layout here.
+    static_assert(sizeof(Placements::ObjectReference) == 96, "Unexpected ObjectReference size. Placements file layout must be updated");
+    static_assert(offsetof(Placements::ObjectReference, _cellSpaceBoundary) == 48, "Unexpected ObjectReference layout");
+    static_assert(offsetof(Placements::ObjectReference, _modelFilenameOffset) == 72, "Unexpected ObjectReference layout");
+    static_assert(offsetof(Placements::ObjectReference, _guid) == 88, "Unexpected ObjectReference layout");
+
+    IteratorRange<const uint8*> Placements::GetSpatialIndexForWrite() const
+    {
+            //  If we're still using the file in place, the objects haven't changed since
+            //  the BVH in the file was built. Otherwise we build a new one only if the
+            //  objects have changed since the last save.
+        if (_mappedFile) return _mappedSpatialIndex;
+
+        auto objectCount = GetObjectReferenceCount();
+        if (_spatialIndexCache.empty() && objectCount) {
+            PlacementsQuadTree bvh(
+                &GetObjectReferences()->_cellSpaceBoundary, sizeof(ObjectReference), objectCount,
+                PlacementsQuadTree::Type::BVH);
+            _spatialIndexCache = bvh.SerializeBVH();
+        }
+        return MakeIteratorRange(_spatialIndexCache);
+    }
+
     void Placements::Write(const Assets::ResChar destinationFile[]) const
     {
         using namespace Serialization::ChunkFile;
         SimpleChunkFileWriter fileWriter(
             1, RenderCore::VersionString, RenderCore::BuildDateString,
             std::make_tuple(destinationFile, "wb", 0));
-        fileWriter.BeginChunk(ChunkType_Placements, 0, "Placements");
-
-        PlacementsHeader hdr;
-        hdr._version = 0;
-        hdr._objectRefCount = (unsigned)_objects.size();
-        hdr._filenamesBufferSize = unsigned(_filenamesBuffer.size());
-        hdr._supplementsBufferSize = unsigned(_supplementsBuffer.size() * sizeof(uint64));
-        hdr._dummy = 0;
-        auto writeResult0 = fileWriter.Write(&hdr, sizeof(hdr), 1);
-        auto writeResult1 = fileWriter.Write(AsPointer(_objects.begin()), sizeof(ObjectReference), hdr._objectRefCount);
-        auto writeResult2 = fileWriter.Write(AsPointer(_filenamesBuffer.begin()), 1, hdr._filenamesBufferSize);
-        auto writeResult3 = fileWriter.Write(AsPointer(_supplementsBuffer.begin()), 1, hdr._supplementsBufferSize);
-
-        if (    writeResult0 != 1
-            ||  writeResult1 != hdr._objectRefCount
-            ||  writeResult2 != hdr._filenamesBufferSize
-            ||  writeResult3 != hdr._supplementsBufferSize)
+        fileWriter.BeginChunk(ChunkType_Placements, PlacementsChunkVersion, "Placements");
+        auto chunkStart = fileWriter.TellP();
+
+        auto* objects = GetObjectReferences();
+        auto objectCount = GetObjectReferenceCount();
+        auto filenamesSize = unsigned(_mappedFile ? _mappedFilenames.size() : _filenamesBuffer.size());
+        auto supplementsSize = unsigned((_mappedFile ? _mappedSupplements.size() : _supplementsBuffer.size()) * sizeof(uint64));
+
+            //  We write a prebuilt BVH along with the objects, so the renderer doesn't 
+            //  need to build one after loading.
+        auto spatialIndex = GetSpatialIndexForWrite();
+
+            //  Calculate the section offsets. Alignment is calculated in terms of the
+            //  position in the file, because the mapping will begin on a page boundary
+        auto alignSection = [chunkStart](size_t relativeOffset) -> unsigned
+            {
+                auto absolute = chunkStart + relativeOffset;
+                absolute = (absolute + PlacementsSectionAlignment - 1) & ~size_t(PlacementsSectionAlignment - 1);
+                return unsigned(absolute - chunkStart);
+            };
+        PlacementsSectionTable sections;
+        XlZeroMemory(sections);
+        sections._objectsOffset = alignSection(sizeof(PlacementsHeader) + sizeof(PlacementsSectionTable));
+        sections._filenamesOffset = alignSection(sections._objectsOffset + objectCount * sizeof(ObjectReference));
+        sections._supplementsOffset = alignSection(sections._filenamesOffset + filenamesSize);
+        sections._spatialIndexOffset = alignSection(sections._supplementsOffset + supplementsSize);
+        sections._spatialIndexSize = unsigned(spatialIndex.size());
+
+        const uint8 padding[PlacementsSectionAlignment] = {};
+        bool writeSuccess = true;
+        auto writeValue = [&](unsigned value)
+            {
+                if (fileWriter.Write(&value, sizeof(value), 1) != 1) writeSuccess = false;
+            };
+        auto writeSection = [&](unsigned sectionOffset, const void* data, size_t size)
+            {
+                auto padSize = size_t(chunkStart + sectionOffset - fileWriter.TellP());
+                if (padSize && fileWriter.Write(padding, 1, padSize) != padSize) writeSuccess = false;
+                if (size && fileWriter.Write(data, 1, size) != size) writeSuccess = false;
+            };
+
+            //  header & section table (member by member)
+        writeValue(PlacementsVersion_InPlace);
+        writeValue(objectCount);
+        writeValue(filenamesSize);
+        writeValue(supplementsSize);
+        writeValue(0);
+        writeValue(sections._objectsOffset);
+        writeValue(sections._filenamesOffset);
+        writeValue(sections._supplementsOffset);
+        writeValue(sections._spatialIndexOffset);
+        writeValue(sections._spatialIndexSize);
+        for (unsigned c=0; c<dimof(sections._dummy); ++c) writeValue(0);
+
+            //  object references, via zeroed records in batches
+        writeSection(sections._objectsOffset, nullptr, 0);
+        ObjectReference batch[64];
+        for (unsigned c=0; c<objectCount; c+=dimof(batch)) {
+            auto batchCount = std::min(objectCount - c, unsigned(dimof(batch)));
+            XlZeroMemory(batch);
+            for (unsigned q=0; q<batchCount; ++q) {
+                const auto& src = objects[c+q];
+                batch[q]._localToCell = src._localToCell;
+                batch[q]._cellSpaceBoundary = src._cellSpaceBoundary;
+                batch[q]._modelFilenameOffset = src._modelFilenameOffset;
+                batch[q]._materialFilenameOffset = src._materialFilenameOffset;
+                batch[q]._supplementsOffset = src._supplementsOffset;
+                batch[q]._guid = src._guid;
+            }
+            if (fileWriter.Write(batch, sizeof(ObjectReference), batchCount) != batchCount) writeSuccess = false;
+        }
+
+        writeSection(sections._filenamesOffset, GetFilenamesBuffer(), filenamesSize);
+        writeSection(sections._supplementsOffset, GetSupplementsBuffer(), supplementsSize);
+        writeSection(sections._spatialIndexOffset, spatialIndex.begin(), spatialIndex.size());
+
+        if (!writeSuccess)
             Throw(::Exceptions::BasicLabel("Failure in file write while saving placements"));
     }
 
@@ -154,13 +285,19 @@ namespace SceneEngine
     {
         // write some details about this placements file to the log
         LogInfo << "---<< Placements file: " << title << " >>---";
-        LogInfo << "    (" << _objects.size() << ") object references -- " << sizeof(ObjectReference) * _objects.size() / 1024.f << "k in objects, " << _filenamesBuffer.size() / 1024.f << "k in string table";
+        auto objects = MakeIteratorRange(GetObjectReferences(), GetObjectReferences() + GetObjectReferenceCount());
+        auto filenamesSize = _mappedFile ? _mappedFilenames.size() : _filenamesBuffer.size();
+        auto* supplements = GetSupplementsBuffer();
+        bool hasSupplements = _mappedFile ? !_mappedSupplements.empty() : !_supplementsBuffer.empty();
+        LogInfo << "    (" << objects.size() << ") object references -- " << sizeof(ObjectReference) * objects.size() / 1024.f << "k in objects, " << filenamesSize / 1024.f << "k in string table";
+        if (!_mappedSpatialIndex.empty())
+            LogInfo << "    " << _mappedSpatialIndex.size() / 1024.f << "k in prebuilt spatial index";
 
         unsigned configCount = 0;
-        auto i = _objects.cbegin();
-        while (i != _objects.cend()) {
+        auto i = objects.begin();
+        while (i != objects.end()) {
             auto starti = i;
-            while (i != _objects.cend() 
+            while (i != objects.end() 
                 && i->_materialFilenameOffset == starti->_materialFilenameOffset 
                 && i->_modelFilenameOffset == starti->_modelFilenameOffset
                 && i->_supplementsOffset == starti->_supplementsOffset) { ++i; }
@@ -168,23 +305,43 @@ namespace SceneEngine
         }
         LogInfo << "    (" << configCount << ") configurations";
 
-        i = _objects.cbegin();
-        while (i != _objects.cend()) {
+        i = objects.begin();
+        while (i != objects.end()) {
             auto starti = i;
-            while (i != _objects.cend() 
+            while (i != objects.end() 
                 && i->_materialFilenameOffset == starti->_materialFilenameOffset 
                 && i->_modelFilenameOffset == starti->_modelFilenameOffset
                 && i->_supplementsOffset == starti->_supplementsOffset) { ++i; }
 
-            auto modelName = (const ResChar*)PtrAdd(AsPointer(_filenamesBuffer.begin()), starti->_modelFilenameOffset + sizeof(uint64));
-            auto materialName = (const ResChar*)PtrAdd(AsPointer(_filenamesBuffer.begin()), starti->_materialFilenameOffset + sizeof(uint64));
-            auto supplementCount = !_supplementsBuffer.empty() ? _supplementsBuffer[starti->_supplementsOffset] : 0;
+            auto modelName = (const ResChar*)PtrAdd(GetFilenamesBuffer(), starti->_modelFilenameOffset + sizeof(uint64));
+            auto materialName = (const ResChar*)PtrAdd(GetFilenamesBuffer(), starti->_materialFilenameOffset + sizeof(uint64));
+            auto supplementCount = hasSupplements ? supplements[starti->_supplementsOffset] : 0;
             LogInfo << "    [" << (i-starti) << "] objects (" << modelName << "), (" << materialName << "), (" << supplementCount << ")";
         }
     }
 
+    void Placements::DetachFromFile()
+    {
+            //  Copy everything out of the memory mapped file, and release the mapping.
+            //  This is required before modifying the placements, and also before
+            //  overwriting the source file (because a file can't be truncated while
+            //  a mapping is open)
+        if (!_mappedFile) return;
+        _objects = std::vector<ObjectReference>(_mappedObjects.begin(), _mappedObjects.end());
+        _filenamesBuffer = std::vector<uint8>(_mappedFilenames.begin(), _mappedFilenames.end());
+        _supplementsBuffer = std::vector<uint64>(_mappedSupplements.begin(), _mappedSupplements.end());
+        _spatialIndexCache = std::vector<uint8>(_mappedSpatialIndex.begin(), _mappedSpatialIndex.end());
+        _mappedObjects = IteratorRange<const ObjectReference*>();
+        _mappedFilenames = IteratorRange<const uint8*>();
+        _mappedSupplements = IteratorRange<const uint64*>();
+        _mappedSpatialIndex = IteratorRange<const uint8*>();
+        _mappedFile.reset();
+    }
+
     void Placements::ReplaceString(const ResChar oldString[], const ResChar newString[])
     {
+        DetachFromFile();
+
         unsigned replacementStart = 0, preReplacementEnd = 0;
         unsigned postReplacementEnd = 0;
 
@@ -246,8 +403,8 @@ namespace SceneEngine
     {
         ::Assets::AssetChunkRequest
         {
-            "Placements", ChunkType_Placements, 0, 
-            ::Assets::AssetChunkRequest::DataType::Raw 
+            "Placements", ChunkType_Placements, ::Assets::AssetChunkRequest::AnyVersion,    // (checked in Resolver)
+            ::Assets::AssetChunkRequest::DataType::DontLoad
         }
     };
 
@@ -272,32 +429,103 @@ namespace SceneEngine
             //      times. It just helps reduce file size.
             //
 
-        void const* i = chunks[0]._buffer.get();
-        const auto& hdr = *(const PlacementsHeader*)i;
-        if (hdr._version != 0)
+            //  Rather than reading the chunk into memory and parsing it, we map the
+            //  file and use the data in place. Legacy (version 0) files are copied into
+            //  the vectors, because their sections aren't aligned.
+
+        auto mappedFile = std::make_shared<MemoryMappedFile>(plc->Filename().c_str(), 0ull, MemoryMappedFile::Access::Read);
+        if (!mappedFile->IsValid())
             Throw(::Exceptions::BasicLabel(
-                StringMeld<128>() << "Unexpected version number (" << hdr._version << ")"));
-        i = PtrAdd(i, sizeof(PlacementsHeader));
+                StringMeld<MaxPath>() << "Failed while mapping placements file (" << plc->Filename().c_str() << ")"));
 
+        const void* chunkStart = PtrAdd(mappedFile->GetData(), chunks[0]._offset);
+        const uint64 chunkSize = chunks[0]._size;
+        if (    chunkSize < sizeof(PlacementsHeader)
+            ||  uint64(chunks[0]._offset) + chunkSize > uint64(mappedFile->GetSize()))
+            Throw(::Exceptions::BasicLabel("Placements chunk is truncated"));
+
+        const auto& hdr = *(const PlacementsHeader*)chunkStart;
         plc->_objects.clear();
         plc->_filenamesBuffer.clear();
         plc->_supplementsBuffer.clear();
+        plc->_spatialIndexCache.clear();
+
+            //  The chunk version and the header version must agree. Files written
+            //  before the chunk version was introduced are always legacy layout.
+        if (chunks[0]._version == PlacementsChunkVersion && hdr._version == PlacementsVersion_InPlace) {
+            if (chunkSize < sizeof(PlacementsHeader) + sizeof(PlacementsSectionTable))
+                Throw(::Exceptions::BasicLabel("Placements chunk is truncated"));
+            const auto& sections = *(const PlacementsSectionTable*)PtrAdd(chunkStart, sizeof(PlacementsHeader));
+
+                //  Every section must be within the chunk, after the section table, and
+                //  aligned in the file (we use these in place).
+            auto checkSection = [&](unsigned offset, uint64 size, const char name[])
+                {
+                    if (    offset < sizeof(PlacementsHeader) + sizeof(PlacementsSectionTable)
+                        ||  uint64(offset) + size > chunkSize
+                        ||  ((chunks[0]._offset + offset) % PlacementsSectionAlignment) != 0)
+                        Throw(::Exceptions::BasicLabel(
+                            StringMeld<128>() << "Placements chunk is corrupt (bad " << name << " section)"));
+                };
+            checkSection(sections._objectsOffset, uint64(hdr._objectRefCount) * sizeof(ObjectReference), "objects");
+            checkSection(sections._filenamesOffset, hdr._filenamesBufferSize, "filenames");
+            checkSection(sections._supplementsOffset, hdr._supplementsBufferSize, "supplements");
+            checkSection(sections._spatialIndexOffset, sections._spatialIndexSize, "spatial index");
+            if (hdr._supplementsBufferSize % sizeof(uint64))
+                Throw(::Exceptions::BasicLabel("Placements chunk is corrupt (bad supplements size)"));
+
+            auto* objects = (const ObjectReference*)PtrAdd(chunkStart, sections._objectsOffset);
+            auto* filenames = (const uint8*)PtrAdd(chunkStart, sections._filenamesOffset);
+            auto* supplements = (const uint64*)PtrAdd(chunkStart, sections._supplementsOffset);
+            auto* spatialIndex = (const uint8*)PtrAdd(chunkStart, sections._spatialIndexOffset);
+
+                //  Object references point into the string table (a hash followed by a
+                //  null terminated string) and the supplements table. Check these 
+                //  now, so we don't need to check them every time they are used.
+            if (hdr._filenamesBufferSize && filenames[hdr._filenamesBufferSize-1] != 0)
+                Throw(::Exceptions::BasicLabel("Placements chunk is corrupt (string table isn't terminated)"));
+            const auto supplementsCount = hdr._supplementsBufferSize / sizeof(uint64);
+            for (unsigned c=0; c<hdr._objectRefCount; ++c) {
+                const auto& obj = objects[c];
+                if (    uint64(obj._modelFilenameOffset) + sizeof(uint64) >= hdr._filenamesBufferSize
+                    ||  uint64(obj._materialFilenameOffset) + sizeof(uint64) >= hdr._filenamesBufferSize)
+                    Throw(::Exceptions::BasicLabel("Placements chunk is corrupt (bad filename offset)"));
+                if (    obj._supplementsOffset 
+                    &&  (   obj._supplementsOffset >= supplementsCount
+                        ||  uint64(obj._supplementsOffset) + 1 + supplements[obj._supplementsOffset] > supplementsCount))
+                    Throw(::Exceptions::BasicLabel("Placements chunk is corrupt (bad supplements offset)"));
+            }
 
-        plc->_objects.insert(plc->_objects.end(),
-            (const ObjectReference*)i, (const ObjectReference*)i + hdr._objectRefCount);
-        i = (const ObjectReference*)i + hdr._objectRefCount;
-
-        plc->_filenamesBuffer.insert(plc->_filenamesBuffer.end(),
-            (const uint8*)i, (const uint8*)i + hdr._filenamesBufferSize);
-        i = (const uint8*)i + hdr._filenamesBufferSize;
-
-        plc->_supplementsBuffer.insert(plc->_supplementsBuffer.end(),
-            (const uint64*)i, (const uint64*)PtrAdd(i, hdr._supplementsBufferSize));
-        i = PtrAdd(i, hdr._supplementsBufferSize);
+            plc->_mappedObjects = MakeIteratorRange(objects, objects + hdr._objectRefCount);
+            plc->_mappedFilenames = MakeIteratorRange(filenames, filenames + hdr._filenamesBufferSize);
+            plc->_mappedSupplements = MakeIteratorRange(supplements, supplements + supplementsCount);
+            plc->_mappedSpatialIndex = MakeIteratorRange(spatialIndex, spatialIndex + sections._spatialIndexSize);
+            plc->_mappedFile = std::move(mappedFile);
+        } else if (chunks[0]._version == PlacementsChunkVersion_Legacy && hdr._version == PlacementsVersion_Legacy) {
+            if (    sizeof(PlacementsHeader) 
+                +   uint64(hdr._objectRefCount) * sizeof(ObjectReference)
+                +   hdr._filenamesBufferSize + hdr._supplementsBufferSize > chunkSize)
+                Throw(::Exceptions::BasicLabel("Placements chunk is truncated"));
+
+            void const* i = PtrAdd(chunkStart, sizeof(PlacementsHeader));
+            plc->_objects.insert(plc->_objects.end(),
+                (const ObjectReference*)i, (const ObjectReference*)i + hdr._objectRefCount);
+            i = (const ObjectReference*)i + hdr._objectRefCount;
+
+            plc->_filenamesBuffer.insert(plc->_filenamesBuffer.end(),
+                (const uint8*)i, (const uint8*)i + hdr._filenamesBufferSize);
+            i = (const uint8*)i + hdr._filenamesBufferSize;
+
+            plc->_supplementsBuffer.insert(plc->_supplementsBuffer.end(),
+                (const uint64*)i, (const uint64*)PtrAdd(i, hdr._supplementsBufferSize));
+        } else {
+            Throw(::Exceptions::BasicLabel(
+                StringMeld<128>() << "Unexpected version number (chunk: " << chunks[0]._version << ", header: " << hdr._version << ")"));
+        }
 
         #if defined(_DEBUG)
             const auto* filename = plc->Filename().c_str();
-            if (!plc->_objects.empty())
+            if (plc->GetObjectReferenceCount())
                 plc->LogDetails(filename);
         #endif
     }
@@ -423,6 +651,9 @@ namespace SceneEngine
             RenderCore::Techniques::ParsingContext& parserContext,
             const PlacementCell& cell);
 
+        class CellRenderInfo;
+        CellRenderInfo* ResolveCell(const PlacementCell& cell);
+
         void CullCell(
             std::vector<unsigned>& visiblePlacements,
             RenderCore::Techniques::ParsingContext& parserContext,
@@ -439,6 +670,7 @@ namespace SceneEngine
             const uint64* filterStart = nullptr, const uint64* filterEnd = nullptr);
 
         auto GetCachedQuadTree(uint64 cellFilenameHash) const -> const PlacementsQuadTree*;
+        void ReleaseCachedQuadTree(uint64 cellFilenameHash);
         ModelCache& GetModelCache() { return *_cache; }
 
         Pimpl(
@@ -451,13 +683,16 @@ namespace SceneEngine
         public:
             PlacementsCache::Item* _placements;
             std::unique_ptr<PlacementsQuadTree> _quadTree;
+            const void* _quadTreeSource;        // prebuilt spatial index used by _quadTree (if any)
 
-            CellRenderInfo() {}
+            CellRenderInfo() : _placements(nullptr), _quadTreeSource(nullptr) {}
             CellRenderInfo(CellRenderInfo&& moveFrom) never_throws
             : _placements(moveFrom._placements)
             , _quadTree(std::move(moveFrom._quadTree))
+            , _quadTreeSource(moveFrom._quadTreeSource)
             {
                 moveFrom._placements = nullptr;
+                moveFrom._quadTreeSource = nullptr;
             }
 
             CellRenderInfo& operator=(CellRenderInfo&& moveFrom) never_throws
@@ -465,6 +700,8 @@ namespace SceneEngine
                 _placements = moveFrom._placements;
                 moveFrom._placements = nullptr;
                 _quadTree = std::move(moveFrom._quadTree);
+                _quadTreeSource = moveFrom._quadTreeSource;
+                moveFrom._quadTreeSource = nullptr;
                 return *this;
             }
 
@@ -569,6 +806,18 @@ namespace SceneEngine
         return nullptr;
     }
 
+    void PlacementsRenderer::Pimpl::ReleaseCachedQuadTree(uint64 cellFilenameHash)
+    {
+            //  A quad tree built from a prebuilt spatial index keeps the placements file
+            //  mapped. Release it before the file is overwritten (it will be rebuilt on 
+            //  the next cull)
+        auto i2 = LowerBound(_cells, cellFilenameHash);
+        if (i2!=_cells.end() && i2->first == cellFilenameHash) {
+            i2->second._quadTree.reset();
+            i2->second._quadTreeSource = nullptr;
+        }
+    }
+
     Placements* PlacementsRenderer::Pimpl::CullCell(
         std::vector<unsigned>& visibleObjects,
         RenderCore::Techniques::ParsingContext& parserContext,
@@ -589,6 +838,24 @@ namespace SceneEngine
         //
         // It seems useful to me. But if the overhead becomes too great, we can just change
         // to a basic 2d addressing model.
+        auto* renderInfo = ResolveCell(cell);
+        if (!renderInfo) return nullptr;
+
+        CullCell(
+            visibleObjects, parserContext, 
+            *renderInfo->_placements->_placements, 
+            renderInfo->_quadTree.get(),
+            cell._cellToWorld);
+
+        return renderInfo->_placements->_placements.get();
+    }
+
+    auto PlacementsRenderer::Pimpl::ResolveCell(const PlacementCell& cell) -> CellRenderInfo*
+    {
+            //  Find (or create) the render info for this cell, reloading the placements and
+            //  rebuilding the quad tree as required. This modifies "_cells", so it must
+            //  only be called from one thread at a time. But the result can be culled
+            //  from any thread.
         if (cell._filename[0] == '[') return nullptr;   // hack -- if the cell filename begins with '[', it is a cell from the editor (and should be using _cellOverrides)
 
         auto i2 = LowerBound(_cells, cell._filenameHash);
@@ -604,20 +871,45 @@ namespace SceneEngine
             i2->second._quadTree.reset();
         }
 
+            //  The placements file may have a prebuilt BVH that we can use in place. If the 
+            //  placements have since been detached from the file, that data is gone, and
+            //  we must build a new tree.
+        auto& placements = *i2->second._placements->_placements;
+        auto prebuiltIndex = placements.GetPrebuiltSpatialIndex();
+        bool useBVH = Tweakable("PlacementsBVH", true);
+        if (i2->second._quadTreeSource && i2->second._quadTreeSource != prebuiltIndex.begin())
+            i2->second._quadTree.reset();
+
         if (!i2->second._quadTree) {
-            i2->second._quadTree = std::make_unique<PlacementsQuadTree>(
-                &i2->second._placements->_placements->GetObjectReferences()->_cellSpaceBoundary,
-                sizeof(Placements::ObjectReference), 
-                i2->second._placements->_placements->GetObjectReferenceCount());
-        }
+            i2->second._quadTreeSource = nullptr;
+            if (useBVH && !prebuiltIndex.empty()) {
+                    //  The prebuilt tree is validated on construction. If it is corrupt,
+                    //  or doesn't match the objects, just fall back to building a new one
+                TRY {
+                        //  (the tree holds a reference to the mapped file, so it stays valid even
+                        //  if the placements are detached from the file before we rebuild it)
+                    auto prebuilt = std::make_unique<PlacementsQuadTree>(
+                        prebuiltIndex.begin(), prebuiltIndex.size(), placements.GetMappedFile());
+                    if (prebuilt->GetMaxResults() == placements.GetObjectReferenceCount()) {
+                        i2->second._quadTree = std::move(prebuilt);
+                        i2->second._quadTreeSource = prebuiltIndex.begin();
+                    } else
+                        LogWarning << "Prebuilt spatial index doesn't match placements in cell (" << cell._filename << "). Rebuilding.";
+                } CATCH (const std::exception& e) {
+                    LogWarning << "Rejected prebuilt spatial index in cell (" << cell._filename << "): " << e.what() << ". Rebuilding.";
+                } CATCH_END
+            }
 
-        CullCell(
-            visibleObjects, parserContext, 
-            *i2->second._placements->_placements, 
-            i2->second._quadTree.get(),
-            cell._cellToWorld);
+            if (!i2->second._quadTree) {
+                i2->second._quadTree = std::make_unique<PlacementsQuadTree>(
+                    &placements.GetObjectReferences()->_cellSpaceBoundary,
+                    sizeof(Placements::ObjectReference), 
+                    placements.GetObjectReferenceCount(),
+                    useBVH ? PlacementsQuadTree::Type::BVH : PlacementsQuadTree::Type::QuadTree);
+            }
+        }
 
-        return i2->second._placements->_placements.get();
+        return &i2->second;
     }
 
     static SupplementRange AsSupplements(const uint64* supplementsBuffer, unsigned supplementsOffset)
@@ -770,44 +1062,86 @@ namespace SceneEngine
         return StringMeldAppend(parserContext._stringHelpers->_quickMetrics);
     }
 
-    void PlacementsRenderer::Pimpl::CullCell(
+    static const unsigned s_bruteForcePartitionSize = 4096;
+
+    static unsigned GetCullPartitionCount(const Placements& placements, const PlacementsQuadTree* quadTree)
+    {
+        if (quadTree) return quadTree->GetPartitionCount();
+        return std::max(1u, (placements.GetObjectReferenceCount() + s_bruteForcePartitionSize - 1) / s_bruteForcePartitionSize);
+    }
+
+    static void CullPlacements(
         std::vector<unsigned>& visiblePlacements,
-        RenderCore::Techniques::ParsingContext& parserContext,
+        const Float4x4& cellToCullSpaceUnaligned,
         const Placements& placements,
         const PlacementsQuadTree* quadTree,
-        const Float3x4& cellToWorld)
+        unsigned partition,
+        PlacementsQuadTree::Metrics* metrics)
     {
+            //  Find the visible objects in one partition of the given cell (or all
+            //  partitions when partition == PlacementsQuadTree::AllPartitions).
+            //  This doesn't touch any shared state, so can be called from any thread.
+            //  Note that the results are not sorted.
         auto placementCount = placements.GetObjectReferenceCount();
         if (!placementCount)
             return;
-        
-        __declspec(align(16)) auto cellToCullSpace = Combine(cellToWorld, parserContext.GetProjectionDesc()._worldToProjection);
 
+        __declspec(align(16)) auto cellToCullSpace = cellToCullSpaceUnaligned;
         const auto* objRef = placements.GetObjectReferences();
         
         if (quadTree) {
             auto cullResults = quadTree->GetMaxResults();
-            visiblePlacements.resize(cullResults);
-            PlacementsQuadTree::Metrics metrics;
+            auto existing = visiblePlacements.size();
+            visiblePlacements.resize(existing + cullResults);
             quadTree->CalculateVisibleObjects(
                 cellToCullSpace, &objRef->_cellSpaceBoundary,
                 sizeof(Placements::ObjectReference),
-                AsPointer(visiblePlacements.begin()), cullResults, cullResults,
-                &metrics);
-            visiblePlacements.resize(cullResults);
+                AsPointer(visiblePlacements.begin()) + existing, cullResults, cullResults,
+                metrics, partition);
+            visiblePlacements.resize(existing + cullResults);
+        } else {
+            unsigned begin = 0, end = placementCount;
+            if (partition != PlacementsQuadTree::AllPartitions) {
+                begin = std::min(partition * s_bruteForcePartitionSize, placementCount);
+                end = std::min(begin + s_bruteForcePartitionSize, placementCount);
+            }
+            visiblePlacements.reserve(visiblePlacements.size() + end - begin);
+
+                //  Test the objects in batches, with the batch frustum test
+            AABBBatchTester frustumTester(cellToCullSpace);
+            unsigned culledMask[8];
+            const unsigned batchSize = dimof(culledMask) * 32;
+            for (unsigned first=begin; first<end; first+=batchSize) {
+                auto count = std::min(end-first, batchSize);
+                frustumTester.TestBoxes(
+                    culledMask, nullptr, 
+                    &objRef[first]._cellSpaceBoundary, sizeof(Placements::ObjectReference),
+                    nullptr, count);
+                for (unsigned c=0; c<count; ++c)
+                    if (!(culledMask[c>>5] & (1u<<(c&31))))
+                        visiblePlacements.push_back(first+c);
+            }
+        }
+    }
+
+    void PlacementsRenderer::Pimpl::CullCell(
+        std::vector<unsigned>& visiblePlacements,
+        RenderCore::Techniques::ParsingContext& parserContext,
+        const Placements& placements,
+        const PlacementsQuadTree* quadTree,
+        const Float3x4& cellToWorld)
+    {
+        auto cellToCullSpace = Combine(cellToWorld, parserContext.GetProjectionDesc()._worldToProjection);
+        PlacementsQuadTree::Metrics metrics;
+        CullPlacements(
+            visiblePlacements, cellToCullSpace, placements, quadTree, 
+            PlacementsQuadTree::AllPartitions, &metrics);
 
-            QuickMetrics(parserContext) << "Cull placements cell... AABB test: (" << metrics._nodeAabbTestCount << ") nodes + (" << metrics._payloadAabbTestCount << ") payloads\n";
+        if (quadTree) {
+            QuickMetrics(parserContext) << "Cull placements cell... AABB test: (" << metrics._nodeAabbTestCount << ") nodes + (" << metrics._payloadAabbTestCount << ") payloads. Cull: " << metrics._cullTime << "ms, build: " << metrics._buildTime << "ms\n";
 
                 // we have to sort to return to our expected order
             std::sort(visiblePlacements.begin(), visiblePlacements.end());
-        } else {
-            visiblePlacements.reserve(placementCount);
-            for (unsigned c=0; c<placementCount; ++c) {
-                auto& obj = objRef[c];
-                if (CullAABB_Aligned(cellToCullSpace, obj._cellSpaceBoundary.first, obj._cellSpaceBoundary.second))
-                    continue;
-                visiblePlacements.push_back(c);
-            }
         }
     }
 
@@ -1047,55 +1381,144 @@ namespace SceneEngine
         RenderCore::Techniques::ParsingContext& parserContext,
         const PlacementCellSet& cellSet)
     {
-        auto* prepared = preparedScene.Allocate<PreCulledPlacements>((PreparedScene::Id)&cellSet);
+        PreparedScene* scenes[] = { &preparedScene };
+        const auto& worldToProj = parserContext.GetProjectionDesc()._worldToProjection;
+        PlacementsQuadTree::Metrics metrics;
+        CullToPreparedScenes(
+            MakeIteratorRange(scenes), MakeIteratorRange(&worldToProj, &worldToProj+1), 
+            cellSet, &metrics);
+
+        QuickMetrics(parserContext) << "Cull placements... AABB test: (" << metrics._nodeAabbTestCount << ") nodes + (" << metrics._payloadAabbTestCount << ") payloads. Cull: " << metrics._cullTime << "ms (summed over jobs), build: " << metrics._buildTime << "ms\n";
+    }
+
+    void PlacementsRenderer::CullToPreparedScenes(
+        IteratorRange<PreparedScene*const*> preparedScenes,
+        IteratorRange<const Float4x4*> worldToProjection,
+        const PlacementCellSet& cellSet,
+        PlacementsQuadTree::Metrics* metrics)
+    {
+            //  Culling happens in 3 phases:
+            //      1. on this thread, find the cells visible to any view, and make sure
+            //         their placements and quad trees are loaded
+            //      2. distribute the culling across the thread pool. There is one job per
+            //         view, per cell, per quad tree partition
+            //      3. on this thread, merge the results in a deterministic order
+            //  Only phase 2 is parallel, because phase 1 can load assets and modify
+            //  the cell cache.
+        assert(preparedScenes.size() == worldToProjection.size());
+        auto viewCount = unsigned(preparedScenes.size());
+        if (!viewCount) return;
+
+        class VisibleCell
+        {
+        public:
+            unsigned            _cellIndex;
+            Placements*         _placements;
+            const PlacementsQuadTree* _quadTree;
+            unsigned            _partitionCount;
+            unsigned            _firstJob;
+            PreCulledPlacements::Cell* _preCulled;
+        };
+
+        class Job
+        {
+        public:
+            unsigned                _visibleCell;
+            unsigned                _partition;
+            Float4x4                _cellToCullSpace;
+            std::vector<unsigned>   _objects;
+            PlacementsQuadTree::Metrics _metrics;
+        };
+
+        std::vector<PreCulledPlacements*> prepared;
+        prepared.reserve(viewCount);
+        for (auto* scene:preparedScenes)
+            prepared.push_back(scene->Allocate<PreCulledPlacements>((PreparedScene::Id)&cellSet));
+
+        std::vector<VisibleCell> visibleCells;
+        std::vector<Job> jobs;
 
         auto& cells = cellSet._pimpl->_cells;
-        const auto& worldToProj = parserContext.GetProjectionDesc()._worldToProjection;
-        for (unsigned c=0; c<(unsigned)cells.size(); ++c) {
-            auto& cell = cells[c];
-            if (CullAABB_Aligned(worldToProj, cell._aabbMin, cell._aabbMax))
-                continue;
+        for (unsigned v=0; v<viewCount; ++v) {
+            const auto& worldToProj = worldToProjection[v];
+            for (unsigned c=0; c<(unsigned)cells.size(); ++c) {
+                auto& cell = cells[c];
+                if (CullAABB(worldToProj, cell._aabbMin, cell._aabbMax))
+                    continue;
 
-            auto pcell = std::make_unique<PreCulledPlacements::Cell>();
-            pcell->_cellIndex = c;
-            pcell->_cellToWorld = cell._cellToWorld;
+                VisibleCell visCell;
+                visCell._cellIndex = c;
+                visCell._quadTree = nullptr;
 
-            auto ovr = LowerBound(cellSet._pimpl->_cellOverrides, cell._filenameHash);
-            if (ovr != cellSet._pimpl->_cellOverrides.end() && ovr->first == cell._filenameHash) {
-                _pimpl->CullCell(pcell->_objects, parserContext, *ovr->second.get(), nullptr, cell._cellToWorld);
-                pcell->_placements = ovr->second.get();
-            } else {
-                pcell->_placements = _pimpl->CullCell(pcell->_objects, parserContext, cell);
-                if (!pcell->_placements) continue;
-            }
+                auto ovr = LowerBound(cellSet._pimpl->_cellOverrides, cell._filenameHash);
+                if (ovr != cellSet._pimpl->_cellOverrides.end() && ovr->first == cell._filenameHash) {
+                    visCell._placements = ovr->second.get();
+                } else {
+                    auto* renderInfo = _pimpl->ResolveCell(cell);
+                    if (!renderInfo) continue;
+                    visCell._placements = renderInfo->_placements->_placements.get();
+                    visCell._quadTree = renderInfo->_quadTree.get();
+                }
 
-            #if 0
-                auto filenamesBuffer = pcell->_placements->GetFilenamesBuffer();
-                auto supplementsBuffer = pcell->_placements->GetSupplementsBuffer();
-
-                unsigned currentModel = 0;
-                unsigned currentMaterial = 0;
-                unsigned currentSupplements = 0;
-                unsigned currentLOD = 0;
-                for (auto o=pcell->_objects.cbegin(); o!=pcell->_objects.cend(); ++o) {
-                    const auto& obj = pcell->_placements->GetObjectReferences()[*o];
-
-                    auto LOD = 0u;   // todo -- clamp the LOD against max somehow
-                    if (    obj._modelFilenameOffset != currentModel || obj._materialFilenameOffset != currentMaterial 
-                        ||  obj._supplementsOffset != currentSupplements || LOD != currentLOD) {
-                        _pimpl->_cache->PrepareModel(
-                            (const ResChar*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset + sizeof(uint64)),
-                            (const ResChar*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset + sizeof(uint64)),
-                            AsSupplements(supplementsBuffer, obj._supplementsOffset),
-                            LOD);
-                        currentModel = obj._modelFilenameOffset;
-                        currentMaterial = obj._materialFilenameOffset;
-                        currentSupplements = obj._supplementsOffset;
-                    }
+                auto pcell = std::make_unique<PreCulledPlacements::Cell>();
+                pcell->_cellIndex = c;
+                pcell->_cellToWorld = cell._cellToWorld;
+                pcell->_placements = visCell._placements;
+                visCell._preCulled = pcell.get();
+                prepared[v]->_cells.emplace_back(std::move(pcell));
+
+                visCell._partitionCount = GetCullPartitionCount(*visCell._placements, visCell._quadTree);
+                visCell._firstJob = unsigned(jobs.size());
+                auto cellToCullSpace = Combine(cell._cellToWorld, worldToProj);
+                for (unsigned p=0; p<visCell._partitionCount; ++p) {
+                    Job job;
+                    job._visibleCell = unsigned(visibleCells.size());
+                    job._partition = (visCell._partitionCount > 1) ? p : PlacementsQuadTree::AllPartitions;
+                    job._cellToCullSpace = cellToCullSpace;
+                    jobs.push_back(std::move(job));
                 }
-            #endif
+                visibleCells.push_back(visCell);
+            }
+        }
+
+            //  Each job writes only to its own Job object (including the metrics), so
+            //  there's no synchronization required until the merge.
+        ParallelFor(
+            ConsoleRig::GlobalServices::GetShortTaskThreadPool(), unsigned(jobs.size()),
+            [&jobs, &visibleCells](unsigned jobIndex)
+            {
+                auto& job = jobs[jobIndex];
+                const auto& visCell = visibleCells[job._visibleCell];
+                CullPlacements(
+                    job._objects, job._cellToCullSpace,
+                    *visCell._placements, visCell._quadTree, 
+                    job._partition, &job._metrics);
+            });
+
+        if (metrics) {
+            for (const auto& job:jobs) {
+                metrics->_nodeAabbTestCount += job._metrics._nodeAabbTestCount;
+                metrics->_payloadAabbTestCount += job._metrics._payloadAabbTestCount;
+                metrics->_cullTime += job._metrics._cullTime;
+            }
+                // (every partition reports the build time for the whole quad tree)
+            for (const auto& visCell:visibleCells)
+                metrics->_buildTime += jobs[visCell._firstJob]._metrics._buildTime;
+        }
 
-            prepared->_cells.emplace_back(std::move(pcell));
+            //  Merge the partitions for each cell. We sort the result, so the final
+            //  order doesn't depend on how the jobs were scheduled.
+        for (const auto& visCell:visibleCells) {
+            auto& dst = visCell._preCulled->_objects;
+            size_t count = 0;
+            for (unsigned p=0; p<visCell._partitionCount; ++p)
+                count += jobs[visCell._firstJob + p]._objects.size();
+            dst.reserve(count);
+            for (unsigned p=0; p<visCell._partitionCount; ++p) {
+                const auto& src = jobs[visCell._firstJob + p]._objects;
+                dst.insert(dst.end(), src.begin(), src.end());
+            }
+            std::sort(dst.begin(), dst.end());
         }
     }
 
@@ -1195,7 +1618,9 @@ namespace SceneEngine
         std::vector<std::pair<Float3x4, ObjectBoundingBoxes>> result;
         for (auto i=cellSet._pimpl->_cells.begin(); i!=cellSet._pimpl->_cells.end(); ++i) {
             if (!CullAABB(worldToClip, i->_aabbMin, i->_aabbMax)) {
-                auto& placements = Assets::GetAsset<Placements>(i->_filename);
+                auto* cached = _pimpl->_placementsCache->Get(i->_filenameHash, i->_filename);
+                if (!cached) continue;
+                auto& placements = *cached->_placements;
                 ObjectBoundingBoxes obb;
                 obb._boundingBox = &placements.GetObjectReferences()->_cellSpaceBoundary;
                 obb._stride = sizeof(Placements::ObjectReference);
@@ -1292,7 +1717,7 @@ namespace SceneEngine
             SupplementRange supplements,
             uint64 objectGuid);
 
-        std::vector<ObjectReference>& GetObjects() { return _objects; }
+        std::vector<ObjectReference>& GetObjects() { _spatialIndexCache.clear(); return _objects; }
         bool HasObject(uint64 guid);
 
         unsigned AddString(StringSection<ResChar> str);
@@ -1384,6 +1809,7 @@ namespace SceneEngine
             [](const ObjectReference& lhs, const ObjectReference& rhs) { return lhs._guid < rhs._guid; });
         assert(i == _objects.end() || i->_guid != newReference._guid);  // hitting this means a GUID collision. Should be extremely unlikely
         _objects.insert(i, newReference);
+        _spatialIndexCache.clear();
 
         return newReference._guid;
     }
@@ -1400,7 +1826,9 @@ namespace SceneEngine
 
     DynamicPlacements::DynamicPlacements(const Placements& copyFrom)
         : Placements(copyFrom)
-    {}
+    {
+        DetachFromFile();
+    }
 
     DynamicPlacements::DynamicPlacements() {}
 
@@ -1479,9 +1907,13 @@ namespace SceneEngine
             assert(cell && cell->_filename[0]);
 
 			if (cell->_filename[0] != '[') {		// used in the editor for dynamic placements
+                    //  (use the placements cache, rather than a separate asset -- the cached
+                    //  placements are detached before the cell is saved, so they won't be 
+                    //  holding the file open)
 				TRY {
-					auto& sourcePlacements = Assets::GetAsset<Placements>(cell->_filename);
-					placements = std::make_shared<DynamicPlacements>(sourcePlacements);
+					auto* sourcePlacements = _placementsCache->Get(cellGuid, cell->_filename);
+					if (sourcePlacements)
+						placements = std::make_shared<DynamicPlacements>(*sourcePlacements->_placements);
 				} CATCH (const std::exception& e) {
 					LogWarning << "Got invalid resource while loading placements file (" << cell->_filename << "). If this file exists, but is corrupted, the next save will overwrite it. Error: (" << e.what() << ").";
 				} CATCH_END
@@ -1585,43 +2017,55 @@ namespace SceneEngine
         auto* p = GetPlacements(cell, set, *_placementsCache);
         if (!p) return;
 
-        for (unsigned c=0; c<p->GetObjectReferenceCount(); ++c) {
-            auto& obj = p->GetObjectReferences()[c];
-                //  We're only doing a very rough world space bounding box vs ray test here...
-                //  Ideally, we should follow up with a more accurate test using the object loca
-                //  space bounding box
-            if (CullAABB(cellToProjection, obj._cellSpaceBoundary.first, obj._cellSpaceBoundary.second)) {
-                continue;
-            }
+            //  We're only doing a very rough world space bounding box vs ray test here...
+            //  Ideally, we should follow up with a more accurate test using the object loca
+            //  space bounding box
+            //  The cell space boxes are tested in batches, with the batch frustum test
+        AABBBatchTester frustumTester(cellToProjection);
+        unsigned culledMask[8];
+        const unsigned batchSize = dimof(culledMask) * 32;
+        const auto* objects = p->GetObjectReferences();
+        const auto objectCount = p->GetObjectReferenceCount();
+        for (unsigned first=0; first<objectCount; first+=batchSize) {
+            auto count = std::min(objectCount-first, batchSize);
+            frustumTester.TestBoxes(
+                culledMask, nullptr,
+                &objects[first]._cellSpaceBoundary, sizeof(Placements::ObjectReference),
+                nullptr, count);
+
+            for (unsigned c=0; c<count; ++c) {
+                if (culledMask[c>>5] & (1u<<(c&31))) continue;
+                auto& obj = objects[first+c];
 
-            Placements::BoundingBox localBoundingBox;
-            auto assetState = TryGetBoundingBox(
-                localBoundingBox, *_modelCache, 
-                (const ResChar*)PtrAdd(p->GetFilenamesBuffer(), obj._modelFilenameOffset + sizeof(uint64)));
+                Placements::BoundingBox localBoundingBox;
+                auto assetState = TryGetBoundingBox(
+                    localBoundingBox, *_modelCache, 
+                    (const ResChar*)PtrAdd(p->GetFilenamesBuffer(), obj._modelFilenameOffset + sizeof(uint64)));
 
-                // When assets aren't yet ready, we can't perform any intersection tests on them
-            if (assetState != ::Assets::AssetState::Ready)
-                continue;
+                    // When assets aren't yet ready, we can't perform any intersection tests on them
+                if (assetState != ::Assets::AssetState::Ready)
+                    continue;
 
-            if (CullAABB(Combine(AsFloat4x4(obj._localToCell), cellToProjection), localBoundingBox.first, localBoundingBox.second)) {
-                continue;
-            }
+                if (CullAABB(Combine(AsFloat4x4(obj._localToCell), cellToProjection), localBoundingBox.first, localBoundingBox.second)) {
+                    continue;
+                }
 
-            if (predicate) {
-                IntersectionDef def;
-                def._localToWorld = Combine(obj._localToCell, cell._cellToWorld);
+                if (predicate) {
+                    IntersectionDef def;
+                    def._localToWorld = Combine(obj._localToCell, cell._cellToWorld);
 
-                    // note -- we have access to the cell space bounding box. But the local
-                    //          space box would be better.
-                def._localSpaceBoundingBox = localBoundingBox;
-                def._model = *(uint64*)PtrAdd(p->GetFilenamesBuffer(), obj._modelFilenameOffset);
-                def._material = *(uint64*)PtrAdd(p->GetFilenamesBuffer(), obj._materialFilenameOffset);
+                        // note -- we have access to the cell space bounding box. But the local
+                        //          space box would be better.
+                    def._localSpaceBoundingBox = localBoundingBox;
+                    def._model = *(uint64*)PtrAdd(p->GetFilenamesBuffer(), obj._modelFilenameOffset);
+                    def._material = *(uint64*)PtrAdd(p->GetFilenamesBuffer(), obj._materialFilenameOffset);
 
-                    // allow the predicate to exclude this item
-                if (!predicate(def)) { continue; }
-            }
+                        // allow the predicate to exclude this item
+                    if (!predicate(def)) { continue; }
+                }
 
-            result.push_back(std::make_pair(cell._filenameHash, obj._guid));
+                result.push_back(std::make_pair(cell._filenameHash, obj._guid));
+            }
         }
     }
 
@@ -2478,6 +2922,13 @@ namespace SceneEngine
 
             const auto* cell = _pimpl->GetCell(cellGuid);
             if (cell) {
+                    // the cached placements (and the renderer's quad tree for this cell) may be
+                    // mapping the file we're about to overwrite
+                auto* cached = _pimpl->_placementsCache->Get(cellGuid);
+                if (cached) cached->_placements->DetachFromFile();
+                if (_pimpl->_manager)
+                    _pimpl->_manager->GetRenderer()->_pimpl->ReleaseCachedQuadTree(cellGuid);
+
                 SavePlacements(cell->_filename, placements);
 
                     // clear the renderer links
@@ -6,9 +6,11 @@
 
 #pragma once
 
+#include "PlacementsQuadTree.h"         // (for PlacementsQuadTree::Metrics)
 #include "../RenderCore/Metal/Forward.h"
 #include "../Assets/Assets.h"
 #include "../Utility/UTFUtils.h"
+#include "../Utility/IteratorUtils.h"
 #include "../Math/Vector.h"
 #include "../Math/Matrix.h"
 #include "../Core/Types.h"
@@ -110,6 +112,18 @@ namespace SceneEngine
             RenderCore::Techniques::ParsingContext& parserContext,
             const PlacementCellSet& cellSet);
 
+            /// <summary>Cull for multiple views at the same time</summary>
+            /// Each view has its own PreparedScene. The culling work for all
+            /// views is distributed across the short task thread pool, split by
+            /// cell (and by quad tree partition, for large cells).
+            /// If "metrics" is given, the quad tree metrics for all jobs are added
+            /// to it (so the times are summed across threads).
+        void CullToPreparedScenes(
+            IteratorRange<PreparedScene*const*> preparedScenes,
+            IteratorRange<const Float4x4*> worldToProjection,
+            const PlacementCellSet& cellSet,
+            PlacementsQuadTree::Metrics* metrics = nullptr);
+
             // -------------- Render filtered --------------
         using DrawCallPredicate = std::function<bool(const RenderCore::Assets::DelayedDrawCall&)>;
         void RenderFiltered(
@@ -137,6 +151,8 @@ namespace SceneEngine
     protected:
         class Pimpl;
         std::unique_ptr<Pimpl> _pimpl;
+
+        friend class PlacementsEditor;
     };
 
     class PlacementsIntersections
@@ -7,8 +7,13 @@
 #include "PlacementsQuadTree.h"
 #include "../Math/ProjectionMath.h"
 #include "../Utility/PtrUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Core/Exceptions.h"
 #include "../Core/Prefix.h"
 #include <stack>
+#include <algorithm>
+#include <cstddef>
 
 #include "PlacementsQuadTreeDebugger.h"
 #include "PlacementsManager.h"
@@ -43,6 +48,38 @@ namespace SceneEngine
         std::vector<Payload>    _payloads;
         unsigned                _maxCullResults;
 
+            //  BVH nodes have up to 4 children. The bounding boxes of the children
+            //  are stored in the parent in SoA form, so we can test all of them
+            //  against the frustum in one go. Every node covers a contiguous range
+            //  of "_bvhObjects", so entirely visible nodes can be added with a
+            //  single copy.
+        class BVHNode
+        {
+        public:
+            float       _mins[3][4];
+            float       _maxs[3][4];
+            unsigned    _children[4];       // child node index, or BVHLeaf or BVHEmpty
+            unsigned    _firstObject[4];
+            unsigned    _objectCount[4];
+            unsigned    _treeDepth;
+            unsigned    _padding[3];        // (keeps the size a multiple of 16 bytes when serialized)
+        };
+        static const unsigned BVHLeaf = ~unsigned(0x0) - 1;
+        static const unsigned BVHEmpty = ~unsigned(0x0);
+
+        std::vector<BVHNode>    _bvhNodes;
+        std::vector<unsigned>   _bvhObjects;
+        unsigned                _bvhMaxDepth;
+
+            //  Culling always goes through these views. They either point into the vectors
+            //  above, or into serialized data that is used in place (see SerializeBVH)
+        IteratorRange<const BVHNode*>   _bvhNodeView;
+        IteratorRange<const unsigned*>  _bvhObjectView;
+        std::shared_ptr<Utility::MemoryMappedFile> _bvhSource;
+
+        Type::Enum              _type;
+        float                   _buildTime;
+
         class WorkingObject
         {
         public:
@@ -113,6 +150,32 @@ namespace SceneEngine
         {
             return (box.second[2] - box.first[2]) * (box.second[1] - box.first[1]) * (box.second[0] - box.first[0]);
         }
+
+        class BVHBuildNode
+        {
+        public:
+            BoundingBox     _boundary;
+            unsigned        _children[2];
+            unsigned        _firstObject, _objectCount;
+        };
+
+        void BuildBVH(std::vector<WorkingObject>& workingObjects);
+        static unsigned BuildBVHBinary(
+            std::vector<BVHBuildNode>& nodes, 
+            WorkingObject* objects, unsigned firstObject, unsigned objectCount);
+        unsigned CollapseBVH(const std::vector<BVHBuildNode>& binaryNodes, unsigned binaryNode, unsigned treeDepth);
+
+        bool CalculateVisibleObjectsBVH(
+            const Float4x4& cellToClipAligned,
+            const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
+            unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount,
+            unsigned& nodeAabbTestCount, unsigned& payloadAabbTestCount,
+            unsigned rootSlotMask) const;
+        bool CalculateVisibleObjectsQuadTree(
+            const Float4x4& cellToClipAligned,
+            const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
+            unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount,
+            unsigned& nodeAabbTestCount, unsigned& payloadAabbTestCount) const;
     };
 
     void PlacementsQuadTree::Pimpl::PushNode(   
@@ -367,28 +430,352 @@ namespace SceneEngine
         }
     }
 
-    bool PlacementsQuadTree::CalculateVisibleObjects(
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static float SurfaceArea(const PlacementsQuadTree::BoundingBox& box)
+    {
+        Float3 size = box.second - box.first;
+        return 2.f * (size[0] * size[1] + size[1] * size[2] + size[2] * size[0]);
+    }
+
+    static void AddToBoundary(PlacementsQuadTree::BoundingBox& box, const Float3& mins, const Float3& maxs)
+    {
+        box.first[0] = std::min(box.first[0], mins[0]);
+        box.first[1] = std::min(box.first[1], mins[1]);
+        box.first[2] = std::min(box.first[2], mins[2]);
+        box.second[0] = std::max(box.second[0], maxs[0]);
+        box.second[1] = std::max(box.second[1], maxs[1]);
+        box.second[2] = std::max(box.second[2], maxs[2]);
+    }
+
+    static PlacementsQuadTree::BoundingBox InvalidBoundary()
+    {
+        return std::make_pair(Float3(FLT_MAX, FLT_MAX, FLT_MAX), Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    }
+
+    unsigned PlacementsQuadTree::Pimpl::BuildBVHBinary(
+        std::vector<BVHBuildNode>& nodes, 
+        WorkingObject* objects, unsigned firstObject, unsigned objectCount)
+    {
+            //  Build a binary tree using the "binned" surface area heuristic.
+            //  For each axis, we divide the range of object centroids into a
+            //  fixed number of bins, and only consider splits on the bin
+            //  boundaries. This gives us an O(n log n) build, with a result
+            //  that's almost as good as a full sweep.
+        const unsigned minLeafSize = 4;
+        const unsigned maxLeafSize = 16;
+        const unsigned binCount = 16;
+
+        BVHBuildNode newNode;
+        newNode._boundary = InvalidBoundary();
+        newNode._children[0] = newNode._children[1] = ~unsigned(0x0);
+        newNode._firstObject = firstObject;
+        newNode._objectCount = objectCount;
+
+        auto centroidBoundary = InvalidBoundary();
+        auto* begin = objects + firstObject;
+        auto* end = begin + objectCount;
+        for (auto* i=begin; i!=end; ++i) {
+            AddToBoundary(newNode._boundary, i->_boundary.first, i->_boundary.second);
+            auto centroid = .5f * (i->_boundary.first + i->_boundary.second);
+            AddToBoundary(centroidBoundary, centroid, centroid);
+        }
+
+        auto nodeIndex = unsigned(nodes.size());
+        nodes.push_back(newNode);
+        if (objectCount <= minLeafSize) return nodeIndex;
+
+        class Bin
+        {
+        public:
+            BoundingBox _boundary;
+            unsigned _count;
+        };
+
+        float bestCost = FLT_MAX;
+        unsigned bestAxis = ~unsigned(0x0), bestSplit = 0;
+        for (unsigned axis=0; axis<3; ++axis) {
+            float axisMin = centroidBoundary.first[axis];
+            float axisExtent = centroidBoundary.second[axis] - axisMin;
+            if (axisExtent <= 0.f) continue;
+            float binScale = float(binCount) / axisExtent;
+
+            Bin bins[binCount];
+            for (auto& b:bins) { b._boundary = InvalidBoundary(); b._count = 0; }
+            for (auto* i=begin; i!=end; ++i) {
+                float centroid = .5f * (i->_boundary.first[axis] + i->_boundary.second[axis]);
+                auto b = std::min(unsigned((centroid - axisMin) * binScale), binCount-1);
+                AddToBoundary(bins[b]._boundary, i->_boundary.first, i->_boundary.second);
+                ++bins[b]._count;
+            }
+
+                //  sweep from the right to get the cost of everything after each
+                //  split, and then from the left to finish the calculation
+            float rightArea[binCount];
+            unsigned rightCount[binCount];
+            auto accumulator = InvalidBoundary();
+            unsigned count = 0;
+            for (unsigned b=binCount-1; b>0; --b) {
+                AddToBoundary(accumulator, bins[b]._boundary.first, bins[b]._boundary.second);
+                count += bins[b]._count;
+                rightArea[b] = count ? SurfaceArea(accumulator) : 0.f;
+                rightCount[b] = count;
+            }
+
+            accumulator = InvalidBoundary();
+            count = 0;
+            for (unsigned b=0; b<binCount-1; ++b) {
+                AddToBoundary(accumulator, bins[b]._boundary.first, bins[b]._boundary.second);
+                count += bins[b]._count;
+                if (!count || !rightCount[b+1]) continue;
+                float cost = float(count) * SurfaceArea(accumulator) + float(rightCount[b+1]) * rightArea[b+1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b+1;
+                }
+            }
+        }
+
+            //  Compare the split against the cost of just making a leaf here. We
+            //  treat the cost of a node test and an object test as the same.
+        float nodeArea = SurfaceArea(newNode._boundary);
+        float leafCost = float(objectCount) * nodeArea;
+        float splitCost = nodeArea + bestCost;
+        WorkingObject* middle;
+        if (bestAxis < 3 && (splitCost < leafCost || objectCount > maxLeafSize)) {
+            float axisMin = centroidBoundary.first[bestAxis];
+            float binScale = float(binCount) / (centroidBoundary.second[bestAxis] - axisMin);
+            middle = std::partition(
+                begin, end,
+                [bestAxis, axisMin, binScale, bestSplit, binCount](const WorkingObject& o)
+                {
+                    float centroid = .5f * (o._boundary.first[bestAxis] + o._boundary.second[bestAxis]);
+                    return std::min(unsigned((centroid - axisMin) * binScale), binCount-1) < bestSplit;
+                });
+        } else if (objectCount > maxLeafSize) {
+                //  All of the centroids are in the same place. We must split
+                //  anyway, to keep leaves small
+            middle = begin + objectCount/2;
+        } else {
+            return nodeIndex;
+        }
+
+        assert(middle != begin && middle != end);
+        auto leftCount = unsigned(middle - begin);
+        auto left = BuildBVHBinary(nodes, objects, firstObject, leftCount);
+        auto right = BuildBVHBinary(nodes, objects, firstObject + leftCount, objectCount - leftCount);
+        nodes[nodeIndex]._children[0] = left;
+        nodes[nodeIndex]._children[1] = right;
+        return nodeIndex;
+    }
+
+    unsigned PlacementsQuadTree::Pimpl::CollapseBVH(
+        const std::vector<BVHBuildNode>& binaryNodes, unsigned binaryNode, unsigned treeDepth)
+    {
+            //  Convert the binary tree into a tree with up to 4 children per node.
+            //  We start with the binary node's children, and then keep replacing the
+            //  largest non-leaf child with its own children, until we have 4.
+        const auto& src = binaryNodes[binaryNode];
+        unsigned slots[4];
+        unsigned slotCount = 0;
+        if (src._children[0] == ~unsigned(0x0)) {
+            slots[slotCount++] = binaryNode;
+        } else {
+            slots[slotCount++] = src._children[0];
+            slots[slotCount++] = src._children[1];
+            while (slotCount < 4) {
+                unsigned bestSlot = ~unsigned(0x0);
+                float bestArea = -1.f;
+                for (unsigned c=0; c<slotCount; ++c) {
+                    const auto& n = binaryNodes[slots[c]];
+                    if (n._children[0] == ~unsigned(0x0)) continue;
+                    float area = SurfaceArea(n._boundary);
+                    if (area > bestArea) { bestArea = area; bestSlot = c; }
+                }
+                if (bestSlot == ~unsigned(0x0)) break;
+
+                auto expanding = slots[bestSlot];
+                slots[bestSlot] = binaryNodes[expanding]._children[0];
+                slots[slotCount++] = binaryNodes[expanding]._children[1];
+            }
+        }
+
+        BVHNode newNode;
+        newNode._treeDepth = treeDepth;
+        newNode._padding[0] = newNode._padding[1] = newNode._padding[2] = 0;
+        for (unsigned c=0; c<4; ++c) {
+            if (c < slotCount) {
+                const auto& n = binaryNodes[slots[c]];
+                for (unsigned e=0; e<3; ++e) {
+                    newNode._mins[e][c] = n._boundary.first[e];
+                    newNode._maxs[e][c] = n._boundary.second[e];
+                }
+                newNode._children[c] = BVHLeaf;
+                newNode._firstObject[c] = n._firstObject;
+                newNode._objectCount[c] = n._objectCount;
+            } else {
+                for (unsigned e=0; e<3; ++e) newNode._mins[e][c] = newNode._maxs[e][c] = 0.f;
+                newNode._children[c] = BVHEmpty;
+                newNode._firstObject[c] = newNode._objectCount[c] = 0;
+            }
+        }
+
+        auto nodeIndex = unsigned(_bvhNodes.size());
+        _bvhNodes.push_back(newNode);
+        _bvhMaxDepth = std::max(_bvhMaxDepth, treeDepth);
+
+        for (unsigned c=0; c<slotCount; ++c) {
+            if (binaryNodes[slots[c]]._children[0] != ~unsigned(0x0)) {
+                auto child = CollapseBVH(binaryNodes, slots[c], treeDepth+1);
+                _bvhNodes[nodeIndex]._children[c] = child;
+            }
+        }
+        return nodeIndex;
+    }
+
+    void PlacementsQuadTree::Pimpl::BuildBVH(std::vector<WorkingObject>& workingObjects)
+    {
+        _bvhNodes.clear();
+        _bvhObjects.clear();
+        _bvhMaxDepth = 0;
+        _bvhNodeView = IteratorRange<const BVHNode*>();
+        _bvhObjectView = IteratorRange<const unsigned*>();
+        if (workingObjects.empty()) return;
+
+        std::vector<BVHBuildNode> binaryNodes;
+        binaryNodes.reserve(workingObjects.size() / 2);
+        BuildBVHBinary(binaryNodes, AsPointer(workingObjects.begin()), 0, unsigned(workingObjects.size()));
+
+            //  The build has reordered the working objects so that every node covers
+            //  a contiguous range of objects.
+        _bvhObjects.reserve(workingObjects.size());
+        for (const auto& o:workingObjects) _bvhObjects.push_back(o._id);
+
+        _bvhNodes.reserve(binaryNodes.size() / 2 + 1);
+        CollapseBVH(binaryNodes, 0, 0);
+
+        _bvhNodeView = MakeIteratorRange(_bvhNodes);
+        _bvhObjectView = MakeIteratorRange(_bvhObjects);
+    }
+
+        //  Test a list of objects against the frustum (in batches), and append the ones
+        //  that aren't culled to "visObjs". Returns false if "visObjs" overflows.
+    static bool TestPayloadObjects(
+        const AABBBatchTester& frustumTester,
+        const PlacementsQuadTree::BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
+        const unsigned objects[], size_t objectCount,
+        unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount)
+    {
+        unsigned culledMask[8];
+        const size_t batchSize = dimof(culledMask) * 32;
+        for (size_t first=0; first<objectCount; first+=batchSize) {
+            auto count = std::min(objectCount-first, batchSize);
+            frustumTester.TestBoxes(
+                culledMask, nullptr, objCellSpaceBoundingBoxes, objStride,
+                &objects[first], count);
+            for (unsigned c=0; c<unsigned(count); ++c) {
+                if (culledMask[c>>5] & (1u<<(c&31))) continue;
+                if ((visObjsCount+1) > visObjMaxCount) return false;
+                visObjs[visObjsCount++] = objects[first+c];
+            }
+        }
+        return true;
+    }
+
+    bool PlacementsQuadTree::Pimpl::CalculateVisibleObjectsBVH(
         const Float4x4& cellToClipAligned, 
         const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
         unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount,
-        Metrics* metrics) const
+        unsigned& nodeAabbTestCount, unsigned& payloadAabbTestCount,
+        unsigned rootSlotMask) const
     {
-        visObjsCount = 0;
-        assert((size_t(AsFloatArray(cellToClipAligned)) & 0xf) == 0);
+        if (_bvhNodeView.empty()) return true;
+
+            //  Each node can push at most 3 more nodes than it pops, so the
+            //  stack size is bounded by the depth of the tree.
+        unsigned fixedStack[128];
+        std::unique_ptr<unsigned[]> heapStack;
+        unsigned* stack = fixedStack;
+        auto stackSize = 3 * (_bvhMaxDepth+1) + 1;
+        if (stackSize > dimof(fixedStack)) {
+            heapStack = std::make_unique<unsigned[]>(stackSize);
+            stack = heapStack.get();
+        }
 
-        unsigned nodeAabbTestCount = 0, payloadAabbTestCount = 0;
+            //  The matrix is prepared for the batch tests just once, outside of the
+            //  traversal loop.
+        AABBBatchTester frustumTester(cellToClipAligned);
+
+            //  "rootSlotMask" selects which children of the root node to visit (see
+            //  GetPartitionCount). Every other node has all children enabled.
+        unsigned slotMask = rootSlotMask;
+        unsigned stackTop = 0;
+        stack[stackTop++] = 0;
+        while (stackTop) {
+            const auto& node = _bvhNodeView[stack[--stackTop]];
+
+                //  Test all 4 children at the same time. This uses the same rules
+                //  as TestAABB: culled if every corner is outside the same plane,
+                //  within if every corner is inside every plane.
+            const float* mins[3] = { node._mins[0], node._mins[1], node._mins[2] };
+            const float* maxs[3] = { node._maxs[0], node._maxs[1], node._maxs[2] };
+            unsigned culledMask, boundaryMask;
+            frustumTester.Test4(culledMask, boundaryMask, mins, maxs);
+
+            auto nodeSlotMask = slotMask;
+            slotMask = 0xf;
+            for (unsigned c=0; c<4; ++c) {
+                if (node._children[c] == BVHEmpty || !(nodeSlotMask & (1<<c))) continue;
+                ++nodeAabbTestCount;
+                if (culledMask & (1<<c)) continue;
+
+                auto first = node._firstObject[c];
+                auto count = node._objectCount[c];
+                if (!(boundaryMask & (1<<c))) {
+                        //  entirely within the frustum; all objects are visible without any
+                        //  further tests
+                    if ((visObjsCount + count) > visObjMaxCount) return false;
+                    std::copy(&_bvhObjectView[first], &_bvhObjectView[first] + count, &visObjs[visObjsCount]);
+                    visObjsCount += count;
+                } else if (node._children[c] != BVHLeaf) {
+                    stack[stackTop++] = node._children[c];
+                } else {
+                    if (!TestPayloadObjects(
+                        frustumTester, objCellSpaceBoundingBoxes, objStride,
+                        &_bvhObjectView[first], count,
+                        visObjs, visObjsCount, visObjMaxCount))
+                        return false;
+                    payloadAabbTestCount += count;
+                }
+            }
+        }
 
+        assert(visObjsCount <= visObjMaxCount);
+        return true;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    bool PlacementsQuadTree::Pimpl::CalculateVisibleObjectsQuadTree(
+        const Float4x4& cellToClipAligned, 
+        const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
+        unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount,
+        unsigned& nodeAabbTestCount, unsigned& payloadAabbTestCount) const
+    {
             //  Traverse through the quad tree, and find do bounding box level 
             //  culling on each object
-        static std::stack<unsigned> workingStack;
-        static std::stack<unsigned> entirelyVisibleStack;
-        assert(workingStack.empty() && entirelyVisibleStack.empty());
+            //  (these stacks must not be static, because multiple threads can
+            //  cull the same tree at the same time)
+        std::stack<unsigned, std::vector<unsigned>> workingStack;
+        std::stack<unsigned, std::vector<unsigned>> entirelyVisibleStack;
+        AABBBatchTester frustumTester(cellToClipAligned);
         workingStack.push(0);
         while (!workingStack.empty()) {
             auto nodeIndex = workingStack.top();
             workingStack.pop();
             
-            auto& node = _pimpl->_nodes[nodeIndex];
+            auto& node = _nodes[nodeIndex];
             auto test = TestAABB_Aligned(cellToClipAligned, node._boundary.first, node._boundary.second);
             ++nodeAabbTestCount;
             if (test == AABBIntersection::Culled) {
@@ -404,31 +791,28 @@ namespace SceneEngine
             } else {
 
                 for (unsigned c=0; c<4; ++c) {
-                    if (node._children[c] < _pimpl->_nodes.size()) {
+                    if (node._children[c] < _nodes.size()) {
                         workingStack.push(node._children[c]);
                     }
                 }
 
-                if (node._payloadID < _pimpl->_payloads.size()) {
-                    auto& payload = _pimpl->_payloads[node._payloadID];
-                    for (auto i=payload._objects.cbegin(); i!=payload._objects.cend(); ++i) {
-
-                            //  Test the "cell" space bounding box of the object itself
-                            //  This must be done inside of this function, we can't
-                            //  drop the responsibility to the caller. Because:
-                            //      * sometimes we can skip it entirely, when quad tree
-                            //          node bounding boxes are considered entirely within the frustum
-                            //      * it's best to reduce the result arrays to as small as
-                            //          possible (because the caller may need to sort them)
-
-                        const auto& boundary = *PtrAdd(objCellSpaceBoundingBoxes, (*i) * objStride);
-                        ++payloadAabbTestCount;
-                        if (!CullAABB_Aligned(cellToClipAligned, boundary.first, boundary.second)) {
-                            if ((visObjsCount+1) > visObjMaxCount) {
-                                return false;
-                            }
-                            visObjs[visObjsCount++] = *i; 
-                        }
+                if (node._payloadID < _payloads.size()) {
+                    auto& payload = _payloads[node._payloadID];
+
+                        //  Test the "cell" space bounding box of the object itself
+                        //  This must be done inside of this function, we can't
+                        //  drop the responsibility to the caller. Because:
+                        //      * sometimes we can skip it entirely, when quad tree
+                        //          node bounding boxes are considered entirely within the frustum
+                        //      * it's best to reduce the result arrays to as small as
+                        //          possible (because the caller may need to sort them)
+                    if (!payload._objects.empty()) {
+                        if (!TestPayloadObjects(
+                            frustumTester, objCellSpaceBoundingBoxes, objStride,
+                            AsPointer(payload._objects.cbegin()), payload._objects.size(),
+                            visObjs, visObjsCount, visObjMaxCount))
+                            return false;
+                        payloadAabbTestCount += unsigned(payload._objects.size());
                     }
                 }
 
@@ -442,15 +826,15 @@ namespace SceneEngine
             auto nodeIndex = entirelyVisibleStack.top();
             entirelyVisibleStack.pop();
 
-            auto& node = _pimpl->_nodes[nodeIndex];
+            auto& node = _nodes[nodeIndex];
             for (unsigned c=0; c<4; ++c) {
-                if (node._children[c] < _pimpl->_nodes.size()) {
+                if (node._children[c] < _nodes.size()) {
                     entirelyVisibleStack.push(node._children[c]);
                 }
             }
 
-            if (node._payloadID < _pimpl->_payloads.size()) {
-                auto& payload = _pimpl->_payloads[node._payloadID];
+            if (node._payloadID < _payloads.size()) {
+                auto& payload = _payloads[node._payloadID];
 
                 if ((visObjsCount + payload._objects.size()) > visObjMaxCount) {
                     return false;
@@ -463,12 +847,43 @@ namespace SceneEngine
         }
 
         assert(visObjsCount <= visObjMaxCount);
+        return true;
+    }
+
+    bool PlacementsQuadTree::CalculateVisibleObjects(
+        const Float4x4& cellToClipAligned, 
+        const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
+        unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount,
+        Metrics* metrics, unsigned partition) const
+    {
+        visObjsCount = 0;
+        assert((size_t(AsFloatArray(cellToClipAligned)) & 0xf) == 0);
+
+        auto startTime = metrics ? GetPerformanceCounter() : 0ull;
+        unsigned nodeAabbTestCount = 0, payloadAabbTestCount = 0;
+        bool result;
+        if (_pimpl->_type == Type::BVH) {
+            result = _pimpl->CalculateVisibleObjectsBVH(
+                cellToClipAligned, objCellSpaceBoundingBoxes, objStride,
+                visObjs, visObjsCount, visObjMaxCount,
+                nodeAabbTestCount, payloadAabbTestCount,
+                (partition < 4) ? (1u<<partition) : 0xfu);
+        } else {
+            assert(partition == 0 || partition == ~unsigned(0x0));
+            result = _pimpl->CalculateVisibleObjectsQuadTree(
+                cellToClipAligned, objCellSpaceBoundingBoxes, objStride,
+                visObjs, visObjsCount, visObjMaxCount,
+                nodeAabbTestCount, payloadAabbTestCount);
+        }
+
         if (metrics) {
             metrics->_nodeAabbTestCount = nodeAabbTestCount; 
             metrics->_payloadAabbTestCount = payloadAabbTestCount;
+            metrics->_buildTime = _pimpl->_buildTime;
+            metrics->_cullTime = float(GetPerformanceCounter() - startTime) * 1000.f / float(GetPerformanceCounterFrequency());
         }
 
-        return true;
+        return result;
     }
 
     unsigned PlacementsQuadTree::GetMaxResults() const
@@ -476,10 +891,26 @@ namespace SceneEngine
         return _pimpl->_maxCullResults;
     }
 
+    unsigned PlacementsQuadTree::GetPartitionCount() const
+    {
+            //  Only large BVHs are split into partitions. Each partition is one child
+            //  of the root node (children are always allocated from the first slot).
+        const unsigned partitionThreshold = 4096;
+        if (_pimpl->_type != Type::BVH || _pimpl->_bvhNodeView.empty() || _pimpl->_bvhObjectView.size() < partitionThreshold)
+            return 1;
+
+        const auto& root = _pimpl->_bvhNodeView[0];
+        unsigned result = 0;
+        while (result < 4 && root._children[result] != Pimpl::BVHEmpty) ++result;
+        return std::max(result, 1u);
+    }
+
     PlacementsQuadTree::PlacementsQuadTree(
         const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
-        size_t objCount)
+        size_t objCount, Type::Enum type)
     {
+        auto startTime = GetPerformanceCounter();
+
             //  Find the minimum and maximum XY of the placements in "placements", and
             //  divide this space up into a quad tree (ignoring height)
             //
@@ -511,12 +942,150 @@ namespace SceneEngine
             //  node based on the objects assigned to it.
 
         auto pimpl = std::make_unique<Pimpl>();
-        pimpl->PushNode(~unsigned(0x0), 0, workingObjects);
-        pimpl->_maxCullResults = pimpl->CalculateMaxResults();
+        pimpl->_type = type;
+        pimpl->_bvhMaxDepth = 0;
+        if (type == Type::BVH) {
+            pimpl->BuildBVH(workingObjects);
+            pimpl->_maxCullResults = unsigned(pimpl->_bvhObjectView.size());
+        } else {
+            pimpl->PushNode(~unsigned(0x0), 0, workingObjects);
+            pimpl->_maxCullResults = pimpl->CalculateMaxResults();
+        }
+        pimpl->_buildTime = float(GetPerformanceCounter() - startTime) * 1000.f / float(GetPerformanceCounterFrequency());
 
         _pimpl = std::move(pimpl);
     }
 
+    class SerializedBVHHeader
+    {
+    public:
+        unsigned _version;
+        unsigned _nodeCount;
+        unsigned _objectCount;
+        unsigned _maxDepth;
+        unsigned _nodeSize;
+        unsigned _dummy[3];
+    };
+    static const unsigned SerializedBVHVersion = 1;
+
+    static_assert((sizeof(SerializedBVHHeader) % 16) == 0, "Serialized BVH header should keep the nodes 16 byte aligned");
+
+    template<typename Type>
+        static void AppendBytes(std::vector<uint8>& dst, const Type& value)
+    {
+        auto* b = (const uint8*)&value;
+        dst.insert(dst.end(), b, b + sizeof(Type));
+    }
+
+    std::vector<uint8> PlacementsQuadTree::SerializeBVH() const
+    {
+        if (_pimpl->_type != Type::BVH)
+            Throw(::Exceptions::BasicLabel("Only BVH type trees can be serialized"));
+
+            //  The serialized nodes are used in place, so the layout written here
+            //  must match the in-memory layout of BVHNode exactly. There is no implicit
+            //  padding (every member is 4 bytes).
+        static_assert(sizeof(Pimpl::BVHNode) == 160, "Unexpected BVHNode size. Serialized BVH layout must be updated");
+        static_assert(offsetof(Pimpl::BVHNode, _maxs) == 48, "Unexpected BVHNode layout");
+        static_assert(offsetof(Pimpl::BVHNode, _children) == 96, "Unexpected BVHNode layout");
+        static_assert(offsetof(Pimpl::BVHNode, _firstObject) == 112, "Unexpected BVHNode layout");
+        static_assert(offsetof(Pimpl::BVHNode, _objectCount) == 128, "Unexpected BVHNode layout");
+        static_assert(offsetof(Pimpl::BVHNode, _treeDepth) == 144, "Unexpected BVHNode layout");
+
+            //  Everything is written member by member (rather than copying structures
+            //  wholesale), so padding and unused values are always written as zeroes.
+        auto nodeCount = unsigned(_pimpl->_bvhNodeView.size());
+        auto objectCount = unsigned(_pimpl->_bvhObjectView.size());
+        std::vector<uint8> result;
+        result.reserve(sizeof(SerializedBVHHeader) + nodeCount * sizeof(Pimpl::BVHNode) + objectCount * sizeof(unsigned));
+
+        AppendBytes(result, SerializedBVHVersion);
+        AppendBytes(result, nodeCount);
+        AppendBytes(result, objectCount);
+        AppendBytes(result, _pimpl->_bvhMaxDepth);
+        AppendBytes(result, unsigned(sizeof(Pimpl::BVHNode)));
+        for (unsigned c=0; c<dimof(SerializedBVHHeader::_dummy); ++c) AppendBytes(result, 0u);
+
+        for (const auto& n:_pimpl->_bvhNodeView) {
+            for (unsigned e=0; e<3; ++e) for (unsigned c=0; c<4; ++c) AppendBytes(result, n._mins[e][c]);
+            for (unsigned e=0; e<3; ++e) for (unsigned c=0; c<4; ++c) AppendBytes(result, n._maxs[e][c]);
+            for (unsigned c=0; c<4; ++c) AppendBytes(result, n._children[c]);
+            for (unsigned c=0; c<4; ++c) AppendBytes(result, n._firstObject[c]);
+            for (unsigned c=0; c<4; ++c) AppendBytes(result, n._objectCount[c]);
+            AppendBytes(result, n._treeDepth);
+            for (unsigned c=0; c<dimof(n._padding); ++c) AppendBytes(result, 0u);
+        }
+
+        for (auto o:_pimpl->_bvhObjectView) AppendBytes(result, o);
+        return std::move(result);
+    }
+
+    PlacementsQuadTree::PlacementsQuadTree(
+        const void* serializedBVH, size_t serializedBVHSize,
+        std::shared_ptr<Utility::MemoryMappedFile> source)
+    {
+            //  Use a BVH that was previously written with SerializeBVH, in place. There is
+            //  no allocation here (other than the pimpl) -- so the serialized data can come 
+            //  straight from a memory mapped file.
+            //  We do validate everything the culling code depends on, though: the sizes,
+            //  every child link (children always come after their parent, one level deeper,
+            //  so there can be no cycles and the depth limit holds), and every object range.
+        auto startTime = GetPerformanceCounter();
+        if (serializedBVHSize < sizeof(SerializedBVHHeader))
+            Throw(::Exceptions::BasicLabel("Serialized BVH is truncated"));
+        if ((size_t(serializedBVH) % sizeof(unsigned)) != 0)
+            Throw(::Exceptions::BasicLabel("Serialized BVH is misaligned"));
+        const auto& hdr = *(const SerializedBVHHeader*)serializedBVH;
+        if (hdr._version != SerializedBVHVersion)
+            Throw(::Exceptions::BasicLabel("Serialized BVH is an unsupported version (%i)", hdr._version));
+        if (hdr._nodeSize != sizeof(Pimpl::BVHNode))
+            Throw(::Exceptions::BasicLabel("Serialized BVH has unexpected node size (%i)", hdr._nodeSize));
+        if (hdr._maxDepth > hdr._nodeCount)
+            Throw(::Exceptions::BasicLabel("Serialized BVH is corrupt (bad depth)"));
+
+        auto expectedSize = 
+              uint64(sizeof(SerializedBVHHeader)) 
+            + uint64(hdr._nodeCount) * sizeof(Pimpl::BVHNode) 
+            + uint64(hdr._objectCount) * sizeof(unsigned);
+        if (expectedSize > serializedBVHSize)
+            Throw(::Exceptions::BasicLabel("Serialized BVH is truncated"));
+
+        auto nodes = MakeIteratorRange(
+            (const Pimpl::BVHNode*)PtrAdd(serializedBVH, sizeof(SerializedBVHHeader)),
+            (const Pimpl::BVHNode*)PtrAdd(serializedBVH, sizeof(SerializedBVHHeader)) + hdr._nodeCount);
+        auto objects = MakeIteratorRange((const unsigned*)nodes.end(), (const unsigned*)nodes.end() + hdr._objectCount);
+
+        if (!nodes.empty() && nodes[0]._treeDepth != 0)
+            Throw(::Exceptions::BasicLabel("Serialized BVH is corrupt (bad root node)"));
+        for (unsigned n=0; n<hdr._nodeCount; ++n) {
+            const auto& node = nodes[n];
+            if (node._treeDepth > hdr._maxDepth)
+                Throw(::Exceptions::BasicLabel("Serialized BVH is corrupt (node %i is too deep)", n));
+            for (unsigned c=0; c<4; ++c) {
+                auto child = node._children[c];
+                if (child == Pimpl::BVHEmpty) continue;
+                if (uint64(node._firstObject[c]) + uint64(node._objectCount[c]) > hdr._objectCount)
+                    Throw(::Exceptions::BasicLabel("Serialized BVH is corrupt (node %i has a bad object range)", n));
+                if (child == Pimpl::BVHLeaf) continue;
+                if (child <= n || child >= hdr._nodeCount || nodes[child]._treeDepth != node._treeDepth+1)
+                    Throw(::Exceptions::BasicLabel("Serialized BVH is corrupt (node %i has a bad child link)", n));
+            }
+        }
+        for (auto o:objects)
+            if (o >= hdr._objectCount)
+                Throw(::Exceptions::BasicLabel("Serialized BVH is corrupt (bad object index)"));
+
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_type = Type::BVH;
+        pimpl->_bvhMaxDepth = hdr._maxDepth;
+        pimpl->_bvhNodeView = nodes;
+        pimpl->_bvhObjectView = objects;
+        pimpl->_bvhSource = std::move(source);
+        pimpl->_maxCullResults = hdr._objectCount;
+        pimpl->_buildTime = float(GetPerformanceCounter() - startTime) * 1000.f / float(GetPerformanceCounterFrequency());
+        _pimpl = std::move(pimpl);
+    }
+
     PlacementsQuadTree::~PlacementsQuadTree() {}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -567,6 +1136,25 @@ namespace SceneEngine
                             cols[std::min((unsigned)dimof(cols), n->_treeDepth)], 0x2);
                     }
                 }
+
+                    //  BVH nodes store the bounding boxes of their children
+                auto& bvhNodes = quadTree->_pimpl->_bvhNodeView;
+                for (unsigned part=0x1; part<=0x2; ++part) {
+                    for (auto n=bvhNodes.cbegin(); n!=bvhNodes.cend(); ++n) {
+                        auto childDepth = n->_treeDepth+1;
+                        if (treeDepthFilter >= 0 && signed(childDepth) != treeDepthFilter) continue;
+                        for (unsigned c=0; c<4; ++c) {
+                            if (n->_children[c] == PlacementsQuadTree::Pimpl::BVHEmpty) continue;
+                            DrawBoundingBox(
+                                context, 
+                                std::make_pair(
+                                    Float3(n->_mins[0][c], n->_mins[1][c], n->_mins[2][c]),
+                                    Float3(n->_maxs[0][c], n->_maxs[1][c], n->_maxs[2][c])),
+                                cellToWorld,
+                                cols[std::min((unsigned)dimof(cols)-1, childDepth)], part);
+                        }
+                    }
+                }
             }
         } else {
             auto cells = _placementsManager->GetRenderer()->GetObjectBoundingBoxes(*_cells, context->GetProjectionDesc()._worldToProjection);
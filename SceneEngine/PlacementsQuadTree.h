@@ -8,9 +8,12 @@
 
 #include "../Math/Vector.h"
 #include "../Math/Matrix.h"
+#include "../Core/Types.h"
 #include <utility>
 #include <memory>
+#include <vector>
 
+namespace Utility { class MemoryMappedFile; }
 
 namespace SceneEngine
 {
@@ -28,6 +31,16 @@ namespace SceneEngine
     /// multiply. If the world space bounding box straddles the edge of the
     /// frustum, the caller may wish to perform a local space bounding
     /// box test to further improve the result.
+    ///
+    /// There are two possible arrangements, selected on construction:
+    ///     <list>
+    ///         <item>QuadTree -- the original balanced quad tree (ignores the Z axis)</item>
+    ///         <item>BVH -- a bounding volume hierarchy built with the binned surface
+    ///             area heuristic. Nodes have up to 4 children, and are stored in a
+    ///             flat array with the children's bounding boxes in SoA form, so
+    ///             all 4 children can be tested against the frustum at once.</item>
+    ///     </list>
+    /// The BVH is much quicker to build for large cells, and usually culls faster.
     class PlacementsQuadTree
     {
     public:
@@ -38,21 +51,51 @@ namespace SceneEngine
         public:
             unsigned _nodeAabbTestCount;
             unsigned _payloadAabbTestCount;
+            float _buildTime;           // in milliseconds
+            float _cullTime;            // in milliseconds
 
-            Metrics() : _nodeAabbTestCount(0), _payloadAabbTestCount(0) {}
+            Metrics() : _nodeAabbTestCount(0), _payloadAabbTestCount(0), _buildTime(0.f), _cullTime(0.f) {}
         };
 
+        struct Type
+        {
+            enum Enum { QuadTree, BVH };
+        };
+
+        static const unsigned AllPartitions = ~unsigned(0x0);
+
         bool CalculateVisibleObjects(
             const Float4x4& cellToClipAligned,
             const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
             unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount,
-            Metrics* metrics = nullptr) const;
+            Metrics* metrics = nullptr, unsigned partition = AllPartitions) const;
 
         unsigned GetMaxResults() const;
 
+            /// <summary>Number of independent parts of the tree</summary>
+            /// Large trees can be divided into a few independent partitions, so that
+            /// culling can be split across multiple threads. Passing each partition
+            /// index to CalculateVisibleObjects gives the same set of objects as
+            /// passing AllPartitions (though possibly in a different order).
+            /// CalculateVisibleObjects is thread safe.
+        unsigned GetPartitionCount() const;
+
+            /// <summary>Write a BVH in a form that can be used in place</summary>
+            /// The result can be stored in a file, and later passed to the constructor
+            /// that takes serialized data. Only BVH type trees can be serialized.
+        std::vector<uint8> SerializeBVH() const;
+
         PlacementsQuadTree(
             const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
-            size_t objCount);
+            size_t objCount, Type::Enum type = Type::QuadTree);
+
+            /// <summary>Reference a BVH written by SerializeBVH</summary>
+            /// The data is used in place. When it comes from a memory mapped file, pass
+            /// the file as "source", and the tree will keep the mapping alive (even if the
+            /// owner of the file releases it). Otherwise the data must outlive this object.
+        PlacementsQuadTree(
+            const void* serializedBVH, size_t serializedBVHSize,
+            std::shared_ptr<Utility::MemoryMappedFile> source = nullptr);
         ~PlacementsQuadTree();
 
     protected:
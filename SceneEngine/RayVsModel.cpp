@@ -14,6 +14,9 @@
 #include "../RenderCore/Techniques/CommonResources.h"
 #include "../RenderCore/Techniques/TechniqueUtils.h"
 #include "../RenderCore/Techniques/Techniques.h"
+#include "../RenderCore/Assets/ModelIntersection.h"
+#include "../Assets/Assets.h"
+#include "../Math/Transformations.h"
 #include "../BufferUploads/IBufferUploads.h"
 #include "../BufferUploads/DataPacket.h"
 #include "../BufferUploads/ResourceLocator.h"
@@ -261,6 +264,94 @@ namespace SceneEngine
         metalContext->UnbindSO();
         Metal::GeometryShader::SetDefaultStreamOutputInitializers(_pimpl->_oldSO);
     }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    using ResultEntry = ModelIntersectionStateContext::ResultEntry;
+
+    static ResultEntry AsResultEntry(
+        const RenderCore::Assets::ModelIntersectionHit& hit,
+        const Float3x4& localToWorld, float rayLength)
+    {
+        ResultEntry result;
+        result._intersectionDepth = hit._distance * rayLength;
+        for (unsigned c=0; c<3; ++c)
+            result._pt[c] = Expand(TransformPoint(localToWorld, hit._pts[c]), hit._barycentric[c]);
+        result._drawCallIndex = hit._drawCallIndex;
+        result._materialGuid = hit._materialGuid;
+        return result;
+    }
+
+    static std::pair<Float3, Float3> RayToLocal(const Float3x4& localToWorld, const std::pair<Float3, Float3>& worldSpaceRay)
+    {
+            //  Placements can have scale (possibly even non-uniform scale), so we
+            //  need the full inverse here. Since the transform is affine, the
+            //  parameter along the ray is unchanged.
+        auto worldToLocal = Inverse(AsFloat4x4(localToWorld));
+        return std::make_pair(
+            TransformPoint(worldToLocal, worldSpaceRay.first),
+            TransformPoint(worldToLocal, worldSpaceRay.second));
+    }
+
+    auto RayVsModel_CPU(
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const std::pair<Float3, Float3>& worldSpaceRay)
+        -> std::vector<ResultEntry>
+    {
+        auto& scaffold = ::Assets::GetAssetComp<RenderCore::Assets::ModelIntersectionScaffold>(modelFilename);
+        auto localRay = RayToLocal(localToWorld, worldSpaceRay);
+        auto hits = scaffold.RayTest(localRay.first, localRay.second);
+
+        float rayLength = Magnitude(worldSpaceRay.second - worldSpaceRay.first);
+        std::vector<ResultEntry> result;
+        result.reserve(hits.size());
+        for (const auto& h:hits)
+            result.push_back(AsResultEntry(h, localToWorld, rayLength));
+        return result;
+    }
+
+    bool FirstRayVsModel_CPU(
+        ResultEntry& result,
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const std::pair<Float3, Float3>& worldSpaceRay)
+    {
+        auto& scaffold = ::Assets::GetAssetComp<RenderCore::Assets::ModelIntersectionScaffold>(modelFilename);
+        auto localRay = RayToLocal(localToWorld, worldSpaceRay);
+        RenderCore::Assets::ModelIntersectionHit hit;
+        if (!scaffold.FirstRayIntersection(hit, localRay.first, localRay.second))
+            return false;
+
+        result = AsResultEntry(hit, localToWorld, Magnitude(worldSpaceRay.second - worldSpaceRay.first));
+        return true;
+    }
+
+    auto FrustumVsModel_CPU(
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const Float4x4& worldToProjection)
+        -> std::vector<ResultEntry>
+    {
+        auto& scaffold = ::Assets::GetAssetComp<RenderCore::Assets::ModelIntersectionScaffold>(modelFilename);
+        auto hits = scaffold.FrustumTest(Combine(localToWorld, worldToProjection));
+
+        std::vector<ResultEntry> result;
+        result.reserve(hits.size());
+        for (const auto& h:hits) {
+            auto entry = AsResultEntry(h, localToWorld, 0.f);
+                // (depth and barycentric values match the GPU frustum test)
+            entry._intersectionDepth = 1.f;
+            for (unsigned c=0; c<3; ++c) entry._pt[c][3] = 0.f;
+            result.push_back(entry);
+        }
+        return result;
+    }
+
+    bool AnyWithinFrustum_CPU(
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const Float4x4& worldToProjection)
+    {
+        auto& scaffold = ::Assets::GetAssetComp<RenderCore::Assets::ModelIntersectionScaffold>(modelFilename);
+        return scaffold.AnyWithinFrustum(Combine(localToWorld, worldToProjection));
+    }
 }
 
 
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "../RenderCore/IThreadContext_Forward.h"
+#include "../Assets/AssetsCore.h"
 #include "../Math/Vector.h"
 #include "../Math/Matrix.h"
 #include "../Core/Types.h"
@@ -57,5 +58,37 @@ namespace SceneEngine
 
         static const unsigned s_maxResultCount = 256;
     };
+
+        //  CPU side versions of the ray and frustum tests. These use the BVH that is stored
+        //  alongside the model scaffold (see RenderCore::Assets::ModelIntersectionScaffold),
+        //  and so don't require a device or the immediate context. They can be used from any
+        //  thread. Results are in the same form as the GPU tests (world space points, with
+        //  barycentric coordinates in w, and depths in world space units).
+        //
+        //  Differences from the GPU path: skinned geometry is tested in its default pose, the
+        //  top level of detail is always used, alpha tested materials are treated as opaque,
+        //  and draw call indices are in scaffold order (this matches the ModelRenderer draw
+        //  call indices unless some materials are "no-draw").
+        //
+        //  These will throw ::Assets::Exceptions::AssetException while the model is pending,
+        //  or if the model is invalid.
+    auto RayVsModel_CPU(
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const std::pair<Float3, Float3>& worldSpaceRay)
+        -> std::vector<ModelIntersectionStateContext::ResultEntry>;
+
+    bool FirstRayVsModel_CPU(
+        ModelIntersectionStateContext::ResultEntry& result,
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const std::pair<Float3, Float3>& worldSpaceRay);
+
+    auto FrustumVsModel_CPU(
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const Float4x4& worldToProjection)
+        -> std::vector<ModelIntersectionStateContext::ResultEntry>;
+
+    bool AnyWithinFrustum_CPU(
+        const ::Assets::ResChar modelFilename[], const Float3x4& localToWorld,
+        const Float4x4& worldToProjection);
 }
 
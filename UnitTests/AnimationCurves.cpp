@@ -0,0 +1,244 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/RawAnimationCurve.h"
+#include "../ConsoleRig/Log.h"
+#include "../Math/Vector.h"
+#include "../Math/Matrix.h"
+#include "../Math/Transformations.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <random>
+#include <intrin.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static RenderCore::Assets::RawAnimationCurve CreateLinearCurve(std::mt19937& rng, unsigned keyCount)
+    {
+        using namespace RenderCore::Assets;
+        auto timeMarkers = std::unique_ptr<float[], BlockSerializerDeleter<float[]>>(new float[keyCount]);
+        std::unique_ptr<uint8[], BlockSerializerDeleter<uint8[]>> keyBlock(new uint8[sizeof(Float3) * keyCount]);
+
+        float time = 0.f;
+        auto* keys = (Float3*)keyBlock.get();
+        for (unsigned c=0; c<keyCount; ++c) {
+            time += (float)std::uniform_real_distribution<>(0.01f, 0.1f)(rng);
+            timeMarkers[c] = time;
+            keys[c] = Float3(
+                (float)std::uniform_real_distribution<>(-100.f, 100.f)(rng),
+                (float)std::uniform_real_distribution<>(-100.f, 100.f)(rng),
+                (float)std::uniform_real_distribution<>(-100.f, 100.f)(rng));
+        }
+
+        return RawAnimationCurve(
+            keyCount, std::move(timeMarkers),
+            DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>(std::move(keyBlock), sizeof(Float3) * keyCount),
+            sizeof(Float3), RawAnimationCurve::Linear,
+            RenderCore::Metal::NativeFormat::R32G32B32_FLOAT,
+            RenderCore::Metal::NativeFormat::Unknown, RenderCore::Metal::NativeFormat::Unknown);
+    }
+
+        // smoothly changing scale/rotation/translation transforms, as Float4x4 keys
+        // (rotations are kept well away from 180 degrees, so there's no ambiguity in the
+        // direction of interpolation)
+    static RenderCore::Assets::RawAnimationCurve CreateTransformCurve(std::mt19937& rng, unsigned keyCount, std::vector<float>& keyTimes)
+    {
+        using namespace RenderCore::Assets;
+        auto timeMarkers = std::unique_ptr<float[], BlockSerializerDeleter<float[]>>(new float[keyCount]);
+        std::unique_ptr<uint8[], BlockSerializerDeleter<uint8[]>> keyBlock(new uint8[sizeof(Float4x4) * keyCount]);
+
+        float time = 0.f;
+        auto* keys = (Float4x4*)keyBlock.get();
+        std::uniform_real_distribution<float> smallStep(-0.05f, 0.05f);
+        Float3 axis(0.f, 0.f, 1.f), scale(1.f, 1.f, 1.f), translation(0.f, 0.f, 0.f);
+        float angle = 0.f;
+        for (unsigned c=0; c<keyCount; ++c) {
+            time += std::uniform_real_distribution<float>(0.01f, 0.1f)(rng);
+            timeMarkers[c] = time;
+            keyTimes.push_back(time);
+
+            axis = Normalize(axis + Float3(smallStep(rng), smallStep(rng), smallStep(rng)));
+            angle = Clamp(angle + 2.f * smallStep(rng), -1.f, 1.f);
+            for (unsigned q=0; q<3; ++q) {
+                scale[q] = Clamp(scale[q] + smallStep(rng), 0.5f, 2.f);
+                translation[q] = Clamp(translation[q] + 10.f * smallStep(rng), -10.f, 10.f);
+            }
+            keys[c] = AsFloat4x4(ScaleRotationTranslationQ(scale, MakeRotationQuaternion(axis, angle), translation));
+        }
+
+        return RawAnimationCurve(
+            keyCount, std::move(timeMarkers),
+            DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>(std::move(keyBlock), sizeof(Float4x4) * keyCount),
+            sizeof(Float4x4), RawAnimationCurve::Linear,
+            RenderCore::Metal::NativeFormat::Matrix4x4,
+            RenderCore::Metal::NativeFormat::Unknown, RenderCore::Metal::NativeFormat::Unknown);
+    }
+
+    static float    GlobalSink = 0.f;
+
+    TEST_CLASS(AnimationCurves)
+	{
+	public:
+		TEST_METHOD(KeyFrameLookup)
+		{
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+            std::vector<RawAnimationCurve> curves;
+            for (unsigned c=0; c<16; ++c)
+                curves.emplace_back(CreateLinearCurve(rng, 10000));
+
+            std::vector<const RawAnimationCurve*> curvePtrs;
+            for (const auto& c:curves) curvePtrs.push_back(&c);
+
+                // Compare the 3 evaluation methods against each other. Cursors and batched
+                // evaluation should never change the result
+            std::vector<unsigned> cursors(curves.size(), 0);
+            std::vector<unsigned> batchCursors(curves.size(), 0);
+            std::vector<Float3> batchResults(curves.size());
+            for (float time=-1.f; time<curves[0].EndTime() + 1.f; time += 0.037f) {
+                RawAnimationCurve::CalculateBatch(
+                    MakeIteratorRange(batchResults), MakeIteratorRange(curvePtrs),
+                    time, AsPointer(batchCursors.begin()));
+
+                for (unsigned c=0; c<curves.size(); ++c) {
+                    auto A = curves[c].Calculate<Float3>(time);
+                    auto B = curves[c].Calculate<Float3>(time, cursors[c]);
+                    Assert::IsTrue(Equivalent(A, B, 1e-5f), L"Cursor based curve evaluation doesn't match");
+                    Assert::IsTrue(Equivalent(A, batchResults[c], 1e-5f), L"Batched curve evaluation doesn't match");
+                }
+            }
+
+                // random (non-monotonic) times should also work with cursors
+            for (unsigned c=0; c<10000; ++c) {
+                auto time = (float)std::uniform_real_distribution<>(-1.f, curves[0].EndTime() + 1.f)(rng);
+                auto A = curves[0].Calculate<Float3>(time);
+                auto B = curves[0].Calculate<Float3>(time, cursors[0]);
+                Assert::IsTrue(Equivalent(A, B, 1e-5f), L"Cursor based curve evaluation doesn't match");
+            }
+        }
+
+        TEST_METHOD(CurveCompression)
+        {
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+            auto curve = CreateLinearCurve(rng, 10000);
+
+            RawAnimationCurve::CompressionSettings settings;
+            settings._quantize = true;
+            settings._keyReductionTolerance = 1e-2f;
+            auto compressed = curve.Compress(settings);
+            Assert::IsTrue(compressed.GetDataSize() < curve.GetDataSize(), L"Compressed curve is not smaller than the original");
+
+                // 16 bit quantization over a range of 200 gives us an error of about 0.0015
+                // per component, on top of whatever was lost from key reduction.
+            const float tolerance = settings._keyReductionTolerance + 200.f / 65535.f;
+            for (float time=-1.f; time<curve.EndTime() + 1.f; time += 0.037f) {
+                auto A = curve.Calculate<Float3>(time);
+                auto B = compressed.Calculate<Float3>(time);
+                Assert::IsTrue(Equivalent(A, B, tolerance), L"Compressed curve is outside of error tolerance");
+            }
+        }
+
+        TEST_METHOD(TransformCurveCompression)
+        {
+                //  Float4x4 curves should use the quantized transform encoding (smallest-three
+                //  quaternion, plus fixed point scale & translation).
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+            std::vector<float> keyTimes;
+            auto curve = CreateTransformCurve(rng, 2000, keyTimes);
+
+            RawAnimationCurve::CompressionSettings settings;
+            settings._quantize = true;
+            auto compressed = curve.Compress(settings);
+            Assert::AreEqual(curve.GetKeyCount(), compressed.GetKeyCount());
+            Assert::IsTrue(compressed.GetDataSize() * 2 < curve.GetDataSize(), L"Transform curve was not quantized");
+
+                // Check both the keys themselves and the interpolation between keys. The largest
+                // error comes from the translation (range of 20, with 16 bit precision) and the
+                // rotation (15 bits per component)
+            const float tolerance = 2e-3f;
+            unsigned cursor = 0;
+            for (float time=-1.f; time<curve.EndTime() + 1.f; time += 0.013f) {
+                auto A = curve.Calculate<Float4x4>(time);
+                auto B = compressed.Calculate<Float4x4>(time);
+                auto C = compressed.Calculate<Float4x4>(time, cursor);
+                Assert::IsTrue(Equivalent(A, B, tolerance), L"Compressed transform curve is outside of error tolerance");
+                Assert::IsTrue(Equivalent(B, C, 1e-6f), L"Cursor based evaluation of compressed curve doesn't match");
+            }
+
+                // With key reduction, the curve should have fewer keys, but still be within
+                // tolerance at the original key times
+            settings._keyReductionTolerance = 1e-2f;
+            auto reduced = curve.Compress(settings);
+            Assert::IsTrue(reduced.GetKeyCount() <= curve.GetKeyCount());
+            for (auto time:keyTimes) {
+                auto A = curve.Calculate<Float4x4>(time);
+                auto B = reduced.Calculate<Float4x4>(time);
+                Assert::IsTrue(Equivalent(A, B, settings._keyReductionTolerance + tolerance), L"Reduced transform curve is outside of error tolerance");
+            }
+        }
+
+        TEST_METHOD(KeyFrameLookupPerformance)
+        {
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+            const unsigned curveCount = 256;
+            std::vector<RawAnimationCurve> curves;
+            for (unsigned c=0; c<curveCount; ++c)
+                curves.emplace_back(CreateLinearCurve(rng, 10000));
+            std::vector<const RawAnimationCurve*> curvePtrs;
+            for (const auto& c:curves) curvePtrs.push_back(&c);
+
+            const unsigned frameCount = 1000;
+            const float endTime = curves[0].EndTime();
+            const float timeStep = endTime / float(frameCount);
+
+            auto start = __rdtsc();
+            for (unsigned f=0; f<frameCount; ++f)
+                for (const auto& c:curves)
+                    GlobalSink += c.Calculate<Float3>(f * timeStep)[0];
+            auto binarySearch = __rdtsc();
+
+            std::vector<unsigned> cursors(curveCount, 0);
+            for (unsigned f=0; f<frameCount; ++f)
+                for (unsigned c=0; c<curveCount; ++c)
+                    GlobalSink += curves[c].Calculate<Float3>(f * timeStep, cursors[c])[0];
+            auto cursor = __rdtsc();
+
+            std::vector<Float3> results(curveCount);
+            std::fill(cursors.begin(), cursors.end(), 0);
+            for (unsigned f=0; f<frameCount; ++f) {
+                RawAnimationCurve::CalculateBatch(
+                    MakeIteratorRange(results), MakeIteratorRange(curvePtrs),
+                    f * timeStep, AsPointer(cursors.begin()));
+                GlobalSink += results[0][0];
+            }
+            auto batch = __rdtsc();
+
+            const auto sampleCount = uint64(frameCount) * uint64(curveCount);
+            LogAlwaysWarning << "Binary search: " << (binarySearch-start) / sampleCount << " cycles per sample (10000 key curves)";
+            LogAlwaysWarning << "With cursor: " << (cursor-binarySearch) / sampleCount << " cycles per sample (10000 key curves)";
+            LogAlwaysWarning << "Batched with cursors: " << (batch-cursor) / sampleCount << " cycles per sample (10000 key curves)";
+        }
+    };
+}
+
@@ -0,0 +1,242 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Assets/ArchiveCache.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <map>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static const char ArchiveName[] = "int/unittest-archive/archive";
+
+    static std::string ArchiveLogName(unsigned generation)
+    {
+        return std::string(ArchiveName) + "." + std::to_string(generation) + ".log";
+    }
+
+    static void DeleteArchiveFiles()
+    {
+        XlDeleteFile((const utf8*)(std::string(ArchiveName) + ".dir").c_str());
+        for (unsigned g=0; g<16; ++g)
+            XlDeleteFile((const utf8*)ArchiveLogName(g).c_str());
+    }
+
+    static ::Assets::ArchiveCache::BlockAndSize BuildBlock(std::mt19937& rng, size_t size)
+    {
+        auto result = std::make_shared<std::vector<uint8>>(size);
+        for (auto& b:*result) b = (uint8)rng();
+        return result;
+    }
+
+    static bool MatchesBlock(const ::Assets::ArchiveCache& archive, uint64 id, const std::vector<uint8>& expected)
+    {
+        auto span = archive.TryOpenSpan(id);
+        if (!span || span._size != expected.size()) return false;
+        return expected.empty() || XlCompareMemory(span._data, AsPointer(expected.cbegin()), expected.size()) == 0;
+    }
+
+    TEST_CLASS(ArchiveCache)
+	{
+	public:
+		TEST_METHOD(ArchiveRoundTrip)
+		{
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            DeleteArchiveFiles();
+
+            std::mt19937 rng(0xa7c1);
+            std::map<uint64, std::vector<uint8>> expected;
+            unsigned flushCount = 0;
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                for (unsigned c=0; c<200; ++c) {
+                    auto id = uint64(rng()%150) + 1;     // (some ids are committed more than once)
+                    auto block = BuildBlock(rng, rng()%4096);
+                    expected[id] = *block;
+                    archive.Commit(id, std::move(block), std::string((StringMeld<64>() << "block " << unsigned(id)).get()), [&flushCount]() { ++flushCount; });
+                }
+                Assert::IsFalse(archive.HasItem(0));
+                Assert::IsFalse((bool)archive.TryOpenSpan(0));
+                for (const auto& e:expected) {
+                    Assert::IsTrue(archive.HasItem(e.first));
+                    Assert::IsTrue(MatchesBlock(archive, e.first, e.second), L"Archive block doesn't match committed data");
+                    auto copy = archive.TryOpenFromCache(e.first);
+                    Assert::IsTrue(copy && *copy == e.second);
+                }
+
+                    // flush callbacks are only called by FlushToDisk (and only once each)
+                Assert::AreEqual(0u, flushCount);
+                archive.FlushToDisk();
+                Assert::AreEqual(200u, flushCount);
+                archive.FlushToDisk();
+                Assert::AreEqual(200u, flushCount);
+
+                auto metrics = archive.GetMetrics();
+                Assert::AreEqual(unsigned(expected.size()), unsigned(metrics._blocks.size()));
+                Assert::IsTrue(metrics._allocatedFileSize >= metrics._usedSpace + metrics._deadSpace);
+                Assert::AreEqual(unsigned(GetFileSize(ArchiveLogName(metrics._generation).c_str())), metrics._allocatedFileSize);
+                for (const auto& b:metrics._blocks) {
+                    Assert::AreEqual(unsigned(expected[b._id].size()), b._size);
+                    Assert::IsTrue(b._attachedString == std::string((StringMeld<64>() << "block " << unsigned(b._id)).get()));
+                }
+            }
+
+                // reopen, and we should get back exactly the same blocks
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                Assert::AreEqual(unsigned(expected.size()), unsigned(archive.GetMetrics()._blocks.size()));
+                for (const auto& e:expected)
+                    Assert::IsTrue(MatchesBlock(archive, e.first, e.second), L"Archive block doesn't match after reopening");
+
+                    // replace some blocks, and then reopen again
+                for (unsigned c=0; c<20; ++c) {
+                    auto id = uint64(c*7) + 1;
+                    auto block = BuildBlock(rng, 100 + c);
+                    expected[id] = *block;
+                    archive.Commit(id, std::move(block), std::string(), nullptr);
+                }
+            }
+
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                for (const auto& e:expected)
+                    Assert::IsTrue(MatchesBlock(archive, e.first, e.second), L"Replaced archive block doesn't match after reopening");
+            }
+
+            DeleteArchiveFiles();
+        }
+
+        TEST_METHOD(ArchiveTornRecord)
+        {
+                //  Simulate a crash in the middle of writing the last record. The last record
+                //  should be discarded when the archive is reopened, but everything before it
+                //  should remain. And new records should be appended after the valid records.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            DeleteArchiveFiles();
+
+            std::mt19937 rng(0xa7c2);
+            auto blockA = BuildBlock(rng, 3000);
+            auto blockB = BuildBlock(rng, 5000);
+            auto blockC = BuildBlock(rng, 700);
+            auto copyA = *blockA, copyC = *blockC;
+            unsigned tornOffset = 0;
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                archive.Commit(1, std::move(blockA), "A", nullptr);
+                archive.Commit(2, std::move(blockB), "B", nullptr);
+                archive.FlushToDisk();
+                for (const auto& b:archive.GetMetrics()._blocks)
+                    if (b._id == 2) tornOffset = b._offset + b._size/2;
+                Assert::IsTrue(tornOffset != 0);
+            }
+
+                // modify the middle of the last record, as if the OS only wrote some of its pages
+            {
+                BasicFile file(ArchiveLogName(0).c_str(), "r+b");
+                file.Seek(tornOffset, SEEK_SET);
+                uint8 garbage[64];
+                for (auto& g:garbage) g = 0xcd;
+                file.Write(garbage, 1, sizeof(garbage));
+            }
+
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                Assert::IsTrue(MatchesBlock(archive, 1, copyA), L"Valid record lost after torn write");
+                Assert::IsFalse(archive.HasItem(2), L"Torn record accepted");
+                archive.Commit(3, std::move(blockC), "C", nullptr);
+            }
+
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                Assert::IsTrue(MatchesBlock(archive, 1, copyA));
+                Assert::IsFalse(archive.HasItem(2));
+                Assert::IsTrue(MatchesBlock(archive, 3, copyC), L"Record appended after torn write was lost");
+            }
+
+            DeleteArchiveFiles();
+        }
+
+        TEST_METHOD(ArchiveCompaction)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            DeleteArchiveFiles();
+
+            std::mt19937 rng(0xa7c3);
+            std::map<uint64, std::vector<uint8>> expected;
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                for (unsigned c=0; c<64; ++c) {
+                    auto block = BuildBlock(rng, 16*1024);
+                    expected[c] = *block;
+                    archive.Commit(c, std::move(block), std::string(), nullptr);
+                }
+
+                    //  hold a span across the compaction. It should still be readable afterwards,
+                    //  even though the block is replaced, and the log is moved
+                auto oldSpan = archive.TryOpenSpan(5);
+                auto oldSpanCopy = expected[5];
+                for (unsigned c=0; c<8; ++c) {
+                    auto block = BuildBlock(rng, 16*1024);
+                    expected[c] = *block;
+                    archive.Commit(c, std::move(block), std::string(), nullptr);
+                }
+
+                auto before = archive.GetMetrics();
+                Assert::IsTrue(before._deadSpace != 0);
+                archive.Compact();
+                auto after = archive.GetMetrics();
+                Assert::AreEqual(before._generation+1, after._generation);
+                Assert::AreEqual(0u, after._deadSpace);
+                Assert::AreEqual(before._usedSpace, after._usedSpace);
+                Assert::AreEqual(before._compactionCount+1, after._compactionCount);
+
+                for (const auto& e:expected)
+                    Assert::IsTrue(MatchesBlock(archive, e.first, e.second), L"Archive block doesn't match after compaction");
+                Assert::IsTrue(oldSpan._size == oldSpanCopy.size() && XlCompareMemory(oldSpan._data, AsPointer(oldSpanCopy.cbegin()), oldSpan._size) == 0,
+                    L"Span opened before compaction was invalidated");
+            }
+
+                //  reopen -- we should be using the new generation, and the old generation
+                //  should be deleted (it can't be deleted while the span above is alive)
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                Assert::AreEqual(1u, archive.GetMetrics()._generation);
+                Assert::IsFalse(DoesFileExist(ArchiveLogName(0).c_str()), L"Old archive generation not deleted");
+                for (const auto& e:expected)
+                    Assert::IsTrue(MatchesBlock(archive, e.first, e.second), L"Archive block doesn't match after reopening compacted archive");
+
+                    //  replace the same blocks many times, so there is enough dead space to queue
+                    //  a background compaction. Destroying the archive must wait for it to complete
+                for (unsigned c=0; c<1024; ++c) {
+                    auto id = uint64(c%16);
+                    auto block = BuildBlock(rng, 16*1024);
+                    expected[id] = *block;
+                    archive.Commit(id, std::move(block), std::string(), nullptr);
+                }
+            }
+
+            {
+                ::Assets::ArchiveCache archive(ArchiveName, "unittest", "unittest");
+                Assert::IsTrue(archive.GetMetrics()._generation > 1, L"Background compaction didn't happen");
+                for (const auto& e:expected)
+                    Assert::IsTrue(MatchesBlock(archive, e.first, e.second), L"Archive block doesn't match after background compaction");
+            }
+
+            DeleteArchiveFiles();
+        }
+	};
+}
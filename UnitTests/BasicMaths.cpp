@@ -7,8 +7,11 @@
 #include "../Math/Transformations.h"
 #include "../Math/ProjectionMath.h"
 #include "../Math/Geometry.h"
+#include "../ConsoleRig/Log.h"
 #include <CppUnitTest.h>
 #include <random>
+#include <vector>
+#include <intrin.h>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -175,5 +178,104 @@ namespace UnitTests
             }
         }
 
+        TEST_METHOD(BatchAABBTests)
+        {
+            std::mt19937 rng(0x9a3c);
+            const unsigned boxCount = 1024*1024 + 13;     // (deliberately not a multiple of 32)
+            std::vector<float> boxData[6];
+            for (auto& d:boxData) d.resize(boxCount);
+            for (unsigned b=0; b<boxCount; ++b) {
+                for (unsigned e=0; e<3; ++e) {
+                    auto centre = (float)std::uniform_real_distribution<>(-500.f, 500.f)(rng);
+                    auto radius = (float)std::uniform_real_distribution<>(0.f, 30.f)(rng);
+                    boxData[e][b] = centre - radius;
+                    boxData[3+e][b] = centre + radius;
+                }
+            }
+            const float* mins[3] = { boxData[0].data(), boxData[1].data(), boxData[2].data() };
+            const float* maxs[3] = { boxData[3].data(), boxData[4].data(), boxData[5].data() };
+
+            Float4x4 cameraToWorld = Identity<Float4x4>();
+            Combine_InPlace(RotationY(.3f), cameraToWorld);
+            Combine_InPlace(Float3(10.f, 20.f, -30.f), cameraToWorld);
+            __declspec(align(16)) Float4x4 localToProjection = Combine(
+                InvertOrthonormalTransform(cameraToWorld),
+                PerspectiveProjection(1.f, 1.5f, 0.1f, 800.f, GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive));
+
+                // Every kernel must give exactly the same result, and match the single box test
+            const auto wordCount = (boxCount+31)/32;
+            const AABBBatchKernel::Enum kernels[] = { AABBBatchKernel::Scalar, AABBBatchKernel::SSE, AABBBatchKernel::AVX };
+            std::vector<unsigned> culled[dimof(kernels)], boundary[dimof(kernels)];
+            for (unsigned k=0; k<dimof(kernels); ++k) {
+                if (!IsAABBBatchKernelSupported(kernels[k])) continue;
+                culled[k].resize(wordCount); boundary[k].resize(wordCount);
+                TestAABBs(culled[k].data(), boundary[k].data(), localToProjection, mins, maxs, boxCount, kernels[k]);
+                if (k != 0) {
+                    Assert::IsTrue(culled[k] == culled[0], L"Batch AABB kernels disagree on culled boxes");
+                    Assert::IsTrue(boundary[k] == boundary[0], L"Batch AABB kernels disagree on boundary boxes");
+                }
+            }
+
+            for (unsigned b=0; b<boxCount; ++b) {
+                auto expected = TestAABB(
+                    localToProjection, 
+                    Float3(mins[0][b], mins[1][b], mins[2][b]), Float3(maxs[0][b], maxs[1][b], maxs[2][b]));
+                bool isCulled = !!(culled[0][b>>5] & (1u<<(b&31)));
+                bool isBoundary = !!(boundary[0][b>>5] & (1u<<(b&31)));
+                Assert::IsTrue(isCulled == (expected == AABBIntersection::Culled), L"Batch AABB test doesn't match TestAABB");
+                Assert::IsTrue(isBoundary == (expected == AABBIntersection::Boundary), L"Batch AABB test doesn't match TestAABB");
+            }
+
+                // a quick performance measurement, compared to the single box path
+            auto start = __rdtsc();
+            unsigned perBoxCulled = 0;
+            for (unsigned b=0; b<boxCount; ++b)
+                perBoxCulled += CullAABB_Aligned(
+                    localToProjection, 
+                    Float3(mins[0][b], mins[1][b], mins[2][b]), Float3(maxs[0][b], maxs[1][b], maxs[2][b]));
+            auto middle = __rdtsc();
+            TestAABBs(culled[0].data(), nullptr, localToProjection, mins, maxs, boxCount);
+            auto end = __rdtsc();
+            Assert::IsTrue(perBoxCulled != 0);
+            LogAlwaysWarning << "CullAABB_Aligned: " << (middle-start) / boxCount << " cycles per box. TestAABBs: " << (end-middle) / boxCount << " cycles per box";
+
+                //  The prepared tester must match TestAABBs exactly, for every entry point
+                //  (including odd counts, where the AVX kernel uses its 4 wide & scalar tails)
+            TestAABBs(culled[0].data(), boundary[0].data(), localToProjection, mins, maxs, boxCount);
+            for (unsigned k=0; k<dimof(kernels); ++k) {
+                if (!IsAABBBatchKernelSupported(kernels[k])) continue;
+                AABBBatchTester tester(localToProjection, kernels[k]);
+                for (unsigned first=0; (first+4)<=boxCount; first+=4099) {
+                    const float* mins4[3] = { &mins[0][first], &mins[1][first], &mins[2][first] };
+                    const float* maxs4[3] = { &maxs[0][first], &maxs[1][first], &maxs[2][first] };
+                    unsigned c4, b4, cn[1], bn[1];
+                    tester.Test4(c4, b4, mins4, maxs4);
+                    tester.Test(cn, bn, mins4, maxs4, 4);
+                    Assert::AreEqual(c4, cn[0]);
+                    Assert::AreEqual(b4, bn[0]);
+                    for (unsigned b=0; b<4; ++b) {
+                        Assert::AreEqual(!!(culled[0][(first+b)>>5] & (1u<<((first+b)&31))), !!(c4 & (1u<<b)));
+                        Assert::AreEqual(!!(boundary[0][(first+b)>>5] & (1u<<((first+b)&31))), !!(b4 & (1u<<b)));
+                    }
+                }
+
+                    //  gather through an index list (every third box, in reverse order)
+                std::vector<std::pair<Float3, Float3>> boxes(1000);
+                std::vector<unsigned> indices;
+                for (unsigned b=0; b<unsigned(boxes.size()); ++b)
+                    boxes[b] = std::make_pair(Float3(mins[0][b], mins[1][b], mins[2][b]), Float3(maxs[0][b], maxs[1][b], maxs[2][b]));
+                for (unsigned b=unsigned(boxes.size()); b>=3; b-=3) indices.push_back(b-1);
+                for (unsigned count=1; count<=unsigned(indices.size()); count+=37) {
+                    std::vector<unsigned> c((count+31)/32), bnd((count+31)/32);
+                    tester.TestBoxes(c.data(), bnd.data(), boxes.data(), sizeof(boxes[0]), indices.data(), count);
+                    for (unsigned q=0; q<count; ++q) {
+                        auto b = indices[q];
+                        Assert::AreEqual(!!(culled[0][b>>5] & (1u<<(b&31))), !!(c[q>>5] & (1u<<(q&31))));
+                        Assert::AreEqual(!!(boundary[0][b>>5] & (1u<<(b&31))), !!(bnd[q>>5] & (1u<<(q&31))));
+                    }
+                }
+            }
+        }
+
 	};
 }
\ No newline at end of file
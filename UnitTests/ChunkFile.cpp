@@ -0,0 +1,204 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Assets/ChunkFile.h"
+#include "../Assets/ChunkFileAsset.h"
+#include "../Assets/AssetServices.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace Serialization::ChunkFile;
+
+    static const ::Assets::ResChar ChunkTestFile[] = "int/unittest-chunkfile.chunk";
+
+    static const TypeIdentifier ChunkType_TestRaw = 0x1001;
+    static const TypeIdentifier ChunkType_TestMapped = 0x1002;
+    static const TypeIdentifier ChunkType_TestSkipped = 0x1003;
+
+    static std::vector<uint8> BuildChunkData(std::mt19937& rng, size_t size)
+    {
+        std::vector<uint8> result(size);
+        for (auto& b:result) b = (uint8)rng();
+        return result;
+    }
+
+    static void WriteTestChunkFile(const std::vector<uint8> chunks[3])
+    {
+        SimpleChunkFileWriter file(
+            3, "unittest", "unittest",
+            std::make_tuple(ChunkTestFile, "wb", 0));
+        const TypeIdentifier types[] = { ChunkType_TestRaw, ChunkType_TestMapped, ChunkType_TestSkipped };
+        for (unsigned c=0; c<3; ++c) {
+            file.BeginChunk(types[c], 0, "unittest");
+            file.Write(AsPointer(chunks[c].cbegin()), 1, chunks[c].size());
+        }
+    }
+
+    static const ::Assets::AssetChunkRequest TestChunkRequests[]
+    {
+        ::Assets::AssetChunkRequest { "Raw", ChunkType_TestRaw, 0, ::Assets::AssetChunkRequest::DataType::Raw },
+        ::Assets::AssetChunkRequest { "Mapped", ChunkType_TestMapped, 0, ::Assets::AssetChunkRequest::DataType::Mapped },
+        ::Assets::AssetChunkRequest { "Skipped", ChunkType_TestSkipped, 0, ::Assets::AssetChunkRequest::DataType::DontLoad }
+    };
+
+        //  Loads a Raw chunk and a Mapped chunk, and keeps copies of both (but not the
+        //  mapping itself, so the file is released as soon as the load is finished)
+    class TestChunkAsset : public ::Assets::ChunkFileAsset
+    {
+    public:
+        std::vector<uint8> _rawChunk;
+        std::vector<uint8> _mappedChunk;
+        bool _mappedInPlace;
+        bool _skippedChunkLoaded;
+        size_t _skippedChunkSize;
+
+        TestChunkAsset(const ::Assets::ResChar filename[])
+        : ChunkFileAsset("TestChunkAsset"), _mappedInPlace(false), _skippedChunkLoaded(false), _skippedChunkSize(0)
+        {
+            Prepare(filename, ResolveOp{MakeIteratorRange(TestChunkRequests), &Resolver});
+        }
+
+    private:
+        static void Resolver(void* obj, IteratorRange<::Assets::AssetChunkResult*> chunks)
+        {
+            auto* asset = (TestChunkAsset*)obj;
+            auto* raw = (const uint8*)chunks[0]._buffer.get();
+            asset->_rawChunk = std::vector<uint8>(raw, raw + chunks[0]._size);
+
+            auto* mapped = (const uint8*)chunks[1]._mappedData;
+            asset->_mappedChunk = std::vector<uint8>(mapped, mapped + chunks[1]._size);
+            const auto& file = chunks[1]._mappedFile;
+            asset->_mappedInPlace =
+                !chunks[1]._buffer && file
+                && mapped >= (const uint8*)file->GetData()
+                && (mapped + chunks[1]._size) <= PtrAdd((const uint8*)file->GetData(), file->GetSize());
+
+            asset->_skippedChunkSize = chunks[2]._size;
+            asset->_skippedChunkLoaded = !!chunks[2]._buffer;
+        }
+    };
+
+    TEST_CLASS(ChunkFile)
+	{
+	public:
+		TEST_METHOD(ChunkTableBoundsChecks)
+		{
+                //  LoadChunkTable for mapped memory must reject anything that would let a
+                //  caller read past the end of the mapping (because the chunks are used in place)
+            const unsigned chunkCount = 2, chunkSize = 32;
+            const auto dataStart = sizeof(ChunkFileHeader) + chunkCount * sizeof(ChunkHeader);
+            std::vector<uint8> image(dataStart + chunkCount * chunkSize, 0);
+            {
+                auto header = MakeChunkFileHeader(chunkCount, "unittest", "unittest");
+                XlCopyMemory(AsPointer(image.begin()), &header, sizeof(header));
+                auto* chunks = (ChunkHeader*)PtrAdd(AsPointer(image.begin()), sizeof(ChunkFileHeader));
+                for (unsigned c=0; c<chunkCount; ++c) {
+                    chunks[c] = ChunkHeader(0x1000+c, 0, "unittest", chunkSize);
+                    chunks[c]._fileOffset = SizeType(dataStart + c * chunkSize);
+                }
+            }
+
+            std::vector<uint8> buffer;
+            auto tryLoad = [&](size_t size, const std::function<void(ChunkFileHeader&, ChunkHeader*)>& modify) -> bool
+                {
+                    buffer = image;
+                    modify(*(ChunkFileHeader*)AsPointer(buffer.begin()), (ChunkHeader*)PtrAdd(AsPointer(buffer.begin()), sizeof(ChunkFileHeader)));
+                    bool result = false;
+                    TRY {
+                        auto chunks = LoadChunkTable(AsPointer(buffer.cbegin()), size);
+                        result = chunks.size() == chunkCount;
+                    } CATCH (const ::Assets::Exceptions::FormatError&) {
+                    } CATCH_END
+                    return result;
+                };
+            auto noChange = [](ChunkFileHeader&, ChunkHeader*) {};
+
+                // (the last chunk ends exactly at the end of the file)
+            Assert::IsTrue(tryLoad(image.size(), noChange), L"Valid chunk table was rejected");
+
+            Assert::IsFalse(tryLoad(0, noChange), L"Empty file accepted");
+            Assert::IsFalse(tryLoad(sizeof(ChunkFileHeader)-1, noChange), L"Truncated file header accepted");
+            Assert::IsFalse(tryLoad(dataStart-1, noChange), L"Truncated chunk table accepted");
+            Assert::IsFalse(tryLoad(image.size()-1, noChange), L"Truncated chunk accepted");
+            Assert::IsFalse(tryLoad(image.size(), [](ChunkFileHeader& h, ChunkHeader*) { h._magic = 0; }), L"Bad magic accepted");
+            Assert::IsFalse(tryLoad(image.size(), [](ChunkFileHeader& h, ChunkHeader*) { h._fileVersionNumber = ChunkFileVersion+1; }), L"Bad file version accepted");
+
+                // chunk counts that would overflow the table size calculation
+            Assert::IsFalse(tryLoad(image.size(), [](ChunkFileHeader& h, ChunkHeader*) { h._chunkCount = ~0u; }), L"Huge chunk count accepted");
+            Assert::IsFalse(tryLoad(image.size(), [](ChunkFileHeader& h, ChunkHeader*) { h._chunkCount = 0x80000000u; }), L"Huge chunk count accepted");
+
+                // chunks that start or finish outside of the file (including offset + size overflow)
+            Assert::IsFalse(tryLoad(image.size(), [&](ChunkFileHeader&, ChunkHeader* c) { c[1]._size = chunkSize+1; }), L"Chunk past the end of file accepted");
+            Assert::IsFalse(tryLoad(image.size(), [&](ChunkFileHeader&, ChunkHeader* c) { c[0]._fileOffset = SizeType(image.size()+1); c[0]._size = 0; }), L"Chunk offset past the end of file accepted");
+            Assert::IsFalse(tryLoad(image.size(), [&](ChunkFileHeader&, ChunkHeader* c) { c[0]._size = ~SizeType(0); }), L"Huge chunk accepted");
+            Assert::IsFalse(tryLoad(image.size(), [&](ChunkFileHeader&, ChunkHeader* c) { c[1]._fileOffset = ~SizeType(0) - 8; }), L"Chunk with overflowing offset accepted");
+            Assert::IsTrue(tryLoad(image.size(), [&](ChunkFileHeader&, ChunkHeader* c) { c[1]._fileOffset = SizeType(image.size()); c[1]._size = 0; }), L"Empty chunk at the end of the file was rejected");
+		}
+
+        TEST_METHOD(ChunkFileAssetMappedLoad)
+        {
+                //  Load raw & mapped chunks through ChunkFileAsset, and check that they match
+                //  what was written. Once loaded, the file must be released, so a recompile
+                //  can overwrite it (even if it was prefetched first).
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            std::mt19937 rng(0xc4f1);
+            std::vector<uint8> chunks[3] = { BuildChunkData(rng, 1000), BuildChunkData(rng, 64*1024+3), BuildChunkData(rng, 300) };
+            WriteTestChunkFile(chunks);
+
+            {
+                TestChunkAsset asset(ChunkTestFile);
+                Assert::IsTrue(asset._rawChunk == chunks[0], L"Raw chunk doesn't match");
+                Assert::IsTrue(asset._mappedChunk == chunks[1], L"Mapped chunk doesn't match");
+                Assert::IsTrue(asset._mappedInPlace, L"Mapped chunk wasn't used in place from the mapping");
+                Assert::IsFalse(asset._skippedChunkLoaded, L"DontLoad chunk was loaded");
+                Assert::AreEqual(chunks[2].size(), asset._skippedChunkSize);
+
+                    // rewrite the file while the asset is alive (as a recompile would)
+                chunks[1] = BuildChunkData(rng, 2000);
+                WriteTestChunkFile(chunks);
+            }
+
+                //  A prefetch holds a mapping until it is used by a load (or released).
+                //  Either way, the file must be writable afterwards
+            const ::Assets::AssetChunkRequest prefetchRequests[]
+            {
+                ::Assets::AssetChunkRequest { "Mapped", ChunkType_TestMapped, 0, ::Assets::AssetChunkRequest::DataType::Mapped }
+            };
+            ::Assets::PrefetchChunkFile(ChunkTestFile, MakeIteratorRange(prefetchRequests));
+            {
+                TestChunkAsset asset(ChunkTestFile);
+                Assert::IsTrue(asset._mappedChunk == chunks[1], L"Mapped chunk doesn't match after prefetch");
+            }
+            chunks[1] = BuildChunkData(rng, 3000);
+            WriteTestChunkFile(chunks);
+
+            ::Assets::PrefetchChunkFile(ChunkTestFile, MakeIteratorRange(prefetchRequests));
+            ::Assets::ReleasePrefetchedChunkFile(ChunkTestFile);
+            chunks[1] = BuildChunkData(rng, 5000);
+            WriteTestChunkFile(chunks);
+            {
+                TestChunkAsset asset(ChunkTestFile);
+                Assert::IsTrue(asset._mappedChunk == chunks[1], L"Mapped chunk doesn't match after rewriting file");
+            }
+
+            XlDeleteFile((const utf8*)ChunkTestFile);
+        }
+	};
+}
@@ -0,0 +1,250 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/CompilationThread.h"
+#include "../Assets/AssetUtils.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/StringUtils.h"
+#include <CppUnitTest.h>
+#include <atomic>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using RenderCore::Assets::CompilationThread;
+    using RenderCore::Assets::QueuedCompileOperation;
+
+    static const uint64 TestType_Model = 1;
+    static const uint64 TestType_Skeleton = 2;
+    static const uint64 TestType_AnimationSet = 3;
+
+    static std::shared_ptr<QueuedCompileOperation> MakeTestOp(uint64 typeCode, const char initializer[], const char destination[] = "")
+    {
+        auto op = std::make_shared<QueuedCompileOperation>();
+        op->SetInitializer(initializer);
+        XlCopyString(op->_initializer0, initializer);
+        XlCopyString(op->GetLocator()._sourceID0, destination);
+        op->_initializer1[0] = '\0';
+        op->_destinationStore = nullptr;
+        op->_typeCode = typeCode;
+        return op;
+    }
+
+        //  Records the start and end of every compile (as "+name" and "-name"). A compile of
+        //  "gate" doesn't finish until the gate is opened, so the test can fill up the queue
+        //  while the worker is busy
+    class CompileRecorder
+    {
+    public:
+        std::vector<std::string> _events;
+        std::atomic<bool> _gateStarted;
+        std::atomic<bool> _gateOpen;
+        unsigned _sleepMilliseconds;
+
+        void Compile(QueuedCompileOperation& op)
+        {
+            Record(std::string("+") + op._initializer0);
+            if (XlEqString(op._initializer0, "gate")) {
+                _gateStarted = true;
+                while (!_gateOpen) Threading::YieldTimeSlice();
+            } else if (_sleepMilliseconds) {
+                Threading::Sleep(_sleepMilliseconds);
+            }
+            Record(std::string("-") + op._initializer0);
+        }
+
+        bool WaitForGate() const
+        {
+            auto startTime = Millisecond_Now();
+            while (!_gateStarted) {
+                if ((Millisecond_Now() - startTime) > 10 * 1000) return false;
+                Threading::YieldTimeSlice();
+            }
+            return true;
+        }
+
+        std::vector<std::string> StartOrder()
+        {
+            ScopedLock(_lock);
+            std::vector<std::string> result;
+            for (const auto& e:_events)
+                if (e[0] == '+') result.push_back(e.substr(1));
+            return result;
+        }
+
+        size_t IndexOf(const std::string& e)
+        {
+            ScopedLock(_lock);
+            return std::find(_events.begin(), _events.end(), e) - _events.begin();
+        }
+
+        CompileRecorder() : _gateStarted(false), _gateOpen(false), _sleepMilliseconds(0) {}
+    private:
+        Threading::Mutex _lock;
+        void Record(const std::string& e) { ScopedLock(_lock); _events.push_back(e); }
+    };
+
+    static bool SkeletonFirst(const QueuedCompileOperation& first, const QueuedCompileOperation& second)
+    {
+        return first._typeCode == TestType_Skeleton && second._typeCode == TestType_AnimationSet;
+    }
+
+    static bool Matches(const std::vector<std::string>& lhs, std::initializer_list<const char*> rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    }
+
+    TEST_CLASS(CompilationThreadTests)
+	{
+	public:
+		TEST_METHOD(CompilationPriorityOrder)
+		{
+                //  Higher priority operations start first. Within a priority, operations
+                //  start in push order
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            CompileRecorder recorder;
+            std::vector<std::shared_ptr<QueuedCompileOperation>> ops;
+            {
+                CompilationThread thread([&recorder](QueuedCompileOperation& op) { recorder.Compile(op); }, 1);
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "gate")));
+                Assert::IsTrue(recorder.WaitForGate());
+
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "a"), TaskPriority::Low));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "b"), TaskPriority::Normal));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "c"), TaskPriority::High));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "d"), TaskPriority::Normal));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "e"), TaskPriority::High));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "f"), TaskPriority::Low));
+
+                recorder._gateOpen = true;
+                thread.StallOnPendingOperations(false);
+            }
+
+            Assert::IsTrue(Matches(recorder.StartOrder(), {"gate", "c", "e", "b", "d", "a", "f"}), L"Compiles started in the wrong order");
+        }
+
+        TEST_METHOD(CompilationDedupe)
+        {
+                //  Pushing a compile identical to one that is queued or running returns the
+                //  existing operation. A higher priority push raises the priority of the
+                //  queued operation, but a lower priority push doesn't lower it
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            CompileRecorder recorder;
+            std::vector<std::shared_ptr<QueuedCompileOperation>> ops;
+            bool runningDuplicate = false, raisedDuplicate = false, loweredDuplicate = false, differentType = false;
+            {
+                CompilationThread thread([&recorder](QueuedCompileOperation& op) { recorder.Compile(op); }, 1);
+                auto gate = thread.Push(MakeTestOp(TestType_Model, "gate"));
+                Assert::IsTrue(recorder.WaitForGate());
+
+                auto a = thread.Push(MakeTestOp(TestType_Model, "a"), TaskPriority::Low);
+                auto b = thread.Push(MakeTestOp(TestType_Model, "b"), TaskPriority::Normal);
+                auto c = thread.Push(MakeTestOp(TestType_Model, "c"), TaskPriority::Normal);
+
+                    //  (we can't assert while the gate is closed, because the worker would
+                    //  never finish)
+                runningDuplicate = thread.Push(MakeTestOp(TestType_Model, "gate")) == gate;
+                raisedDuplicate = thread.Push(MakeTestOp(TestType_Model, "a"), TaskPriority::High) == a;
+                loweredDuplicate = thread.Push(MakeTestOp(TestType_Model, "c"), TaskPriority::Low) == c;
+
+                    // (same initializer, but a different type, is a different compile)
+                auto other = MakeTestOp(TestType_Skeleton, "b");
+                differentType = thread.Push(other) == other;
+
+                ops = { gate, a, b, c, other };
+                recorder._gateOpen = true;
+                thread.StallOnPendingOperations(false);
+            }
+
+            Assert::IsTrue(runningDuplicate, L"Duplicate of a running compile was queued");
+            Assert::IsTrue(raisedDuplicate && loweredDuplicate, L"Duplicate of a queued compile was queued");
+            Assert::IsTrue(differentType, L"Compile of a different type was merged");
+            Assert::IsTrue(Matches(recorder.StartOrder(), {"gate", "a", "b", "c", "b"}), L"Duplicate compiles weren't merged correctly");
+        }
+
+        TEST_METHOD(CompilationSkeletonBeforeAnimation)
+        {
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  An animation set must wait for the skeleton, even when it has a higher
+                //  priority, and was pushed first
+            {
+                CompileRecorder recorder;
+                std::vector<std::shared_ptr<QueuedCompileOperation>> ops;
+                {
+                    CompilationThread thread([&recorder](QueuedCompileOperation& op) { recorder.Compile(op); }, 1, &SkeletonFirst);
+                    ops.push_back(thread.Push(MakeTestOp(TestType_Model, "gate")));
+                    Assert::IsTrue(recorder.WaitForGate());
+
+                    ops.push_back(thread.Push(MakeTestOp(TestType_AnimationSet, "anim"), TaskPriority::High));
+                    ops.push_back(thread.Push(MakeTestOp(TestType_Model, "model"), TaskPriority::Normal));
+                    ops.push_back(thread.Push(MakeTestOp(TestType_Skeleton, "skel"), TaskPriority::Low));
+
+                    recorder._gateOpen = true;
+                    thread.StallOnPendingOperations(false);
+                }
+
+                    // (the model isn't blocked, so it can go ahead of the skeleton)
+                Assert::IsTrue(Matches(recorder.StartOrder(), {"gate", "model", "skel", "anim"}), L"Animation set compiled before skeleton");
+            }
+
+                //  With more than one worker, the animation set must not start until the
+                //  skeleton compile has finished (not just started)
+            {
+                CompileRecorder recorder;
+                recorder._gateOpen = true;
+                recorder._sleepMilliseconds = 50;
+                std::vector<std::shared_ptr<QueuedCompileOperation>> ops;
+                {
+                    CompilationThread thread([&recorder](QueuedCompileOperation& op) { recorder.Compile(op); }, 2, &SkeletonFirst);
+                    ops.push_back(thread.Push(MakeTestOp(TestType_Skeleton, "skel"), TaskPriority::Low));
+                    ops.push_back(thread.Push(MakeTestOp(TestType_AnimationSet, "anim"), TaskPriority::High));
+                    thread.StallOnPendingOperations(false);
+                }
+
+                auto skelEnd = recorder.IndexOf("-skel"), animStart = recorder.IndexOf("+anim");
+                Assert::IsTrue(skelEnd < recorder._events.size() && animStart < recorder._events.size(), L"Compile missing");
+                Assert::IsTrue(skelEnd < animStart, L"Animation set started while skeleton was still compiling");
+            }
+        }
+
+        TEST_METHOD(CompilationSameDestination)
+        {
+                //  Materials from the same model are different compiles (different initializers),
+                //  but they all write to the same rawmat file. They must not run at the same
+                //  time, even with many workers.
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            CompileRecorder recorder;
+            recorder._gateOpen = true;
+            recorder._sleepMilliseconds = 50;
+            std::vector<std::shared_ptr<QueuedCompileOperation>> ops;
+            {
+                CompilationThread thread([&recorder](QueuedCompileOperation& op) { recorder.Compile(op); }, 4);
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "model.dae:matA", "int/model.dae-rawmat:matA")));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "model.dae:matB", "int/model.dae-rawmat:matB")));
+                ops.push_back(thread.Push(MakeTestOp(TestType_Model, "model.dae:matC", "int/model.dae-rawmat:matC")));
+                thread.StallOnPendingOperations(false);
+            }
+
+            Assert::AreEqual(size_t(3), std::set<std::shared_ptr<QueuedCompileOperation>>(ops.begin(), ops.end()).size(), L"Compiles for different materials were merged");
+
+            Assert::AreEqual(size_t(6), recorder._events.size(), L"Compile missing");
+            for (unsigned c=0; c<recorder._events.size(); c+=2) {
+                Assert::IsTrue(recorder._events[c][0] == '+');
+                Assert::IsTrue(recorder._events[c+1] == "-" + recorder._events[c].substr(1), L"Compiles writing the same file ran at the same time");
+            }
+        }
+	};
+}
@@ -0,0 +1,126 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/DualContour.h"
+#include "../Math/Vector.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include <CppUnitTest.h>
+#include <map>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    class SphereDensityFunction : public SceneEngine::IVolumeDensityFunction
+    {
+    public:
+        Boundary    GetBoundary() const     { return std::make_pair(Float3(-10.f, -10.f, -10.f), Float3(10.f, 10.f, 10.f)); }
+        float       GetDensity(const Float3& pt) const { return 6.5f - Magnitude(pt); }
+        Float3      GetNormal(const Float3& pt) const { return Normalize(pt); }
+    };
+
+        // small sphere, away from the center, which counts the number of density evaluations
+    class CountingDensityFunction : public SceneEngine::IVolumeDensityFunction
+    {
+    public:
+        mutable Interlocked::Value _evaluationCount;
+
+        Boundary    GetBoundary() const     { return std::make_pair(Float3(-10.f, -10.f, -10.f), Float3(10.f, 10.f, 10.f)); }
+        float       GetDensity(const Float3& pt) const { return 1.5f - Magnitude(pt - Float3(1.f, 2.f, 0.f)); }
+        Float3      GetNormal(const Float3& pt) const { return Normalize(pt - Float3(1.f, 2.f, 0.f)); }
+
+        void GetDensities(float dst[], const Float3 pts[], unsigned count) const
+        {
+            Interlocked::Add(&_evaluationCount, Interlocked::Value(count));
+            IVolumeDensityFunction::GetDensities(dst, pts, count);
+        }
+
+        CountingDensityFunction() : _evaluationCount(0) {}
+    };
+
+    static bool IsWatertight(const SceneEngine::DualContourMesh& mesh)
+    {
+            // every edge of a closed surface should be shared by exactly 2 quads
+            // (quad vertices are in a "Z" pattern)
+        const unsigned ring[] = { 0, 1, 3, 2 };
+        std::map<std::pair<unsigned, unsigned>, unsigned> edges;
+        for (const auto& q:mesh._quads)
+            for (unsigned c=0; c<4; ++c) {
+                auto a = q._verts[ring[c]], b = q._verts[ring[(c+1)%4]];
+                ++edges[std::make_pair(std::min(a, b), std::max(a, b))];
+            }
+        for (const auto& e:edges)
+            if (e.second != 2) return false;
+        return !edges.empty();
+    }
+
+    static void AssertSameMesh(const SceneEngine::DualContourMesh& lhs, const SceneEngine::DualContourMesh& rhs)
+    {
+        Assert::AreEqual(lhs._vertices.size(), rhs._vertices.size());
+        Assert::AreEqual(lhs._quads.size(), rhs._quads.size());
+        for (size_t c=0; c<lhs._vertices.size(); ++c)
+            for (unsigned e=0; e<3; ++e)
+                Assert::AreEqual(lhs._vertices[c]._pt[e], rhs._vertices[c]._pt[e]);
+        for (size_t c=0; c<lhs._quads.size(); ++c)
+            for (unsigned v=0; v<4; ++v)
+                Assert::AreEqual(lhs._quads[c]._verts[v], rhs._quads[c]._verts[v]);
+    }
+
+    TEST_CLASS(DualContour)
+	{
+	public:
+		TEST_METHOD(BrickedBuildIsConsistent)
+		{
+                //  Parallel and adaptive builds should give exactly the same mesh as
+                //  the serial build, and the mesh should be closed across the brick 
+                //  boundaries. (Here the sphere crosses every brick, so adaptive mode
+                //  can't skip anything -- see AdaptiveBuildSkipsEmptyBricks)
+            using namespace SceneEngine;
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned gridDims = 41;    // (not a multiple of the brick size)
+            SphereDensityFunction fn;
+            DualContourSettings serial, parallel, adaptive;
+            serial._parallel = false;
+            adaptive._adaptive = true;
+
+            auto serialMesh = DualContourMesh_Build(gridDims, fn, serial);
+            auto parallelMesh = DualContourMesh_Build(gridDims, fn, parallel);
+            auto adaptiveMesh = DualContourMesh_Build(gridDims, fn, adaptive);
+
+            Assert::IsTrue(IsWatertight(serialMesh));
+            AssertSameMesh(serialMesh, parallelMesh);
+            AssertSameMesh(serialMesh, adaptiveMesh);
+		}
+
+        TEST_METHOD(AdaptiveBuildSkipsEmptyBricks)
+        {
+                //  A small surface in a large grid. Most bricks are empty, so adaptive mode 
+                //  should need far fewer density evaluations -- but still produce exactly
+                //  the same mesh.
+            using namespace SceneEngine;
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned gridDims = 128;
+            CountingDensityFunction fullFn, adaptiveFn;
+            DualContourSettings full, adaptive;
+            adaptive._adaptive = true;
+
+            auto fullMesh = DualContourMesh_Build(gridDims, fullFn, full);
+            auto adaptiveMesh = DualContourMesh_Build(gridDims, adaptiveFn, adaptive);
+
+            Assert::IsTrue(IsWatertight(fullMesh));
+            AssertSameMesh(fullMesh, adaptiveMesh);
+
+            auto fullCount = Interlocked::Load(&fullFn._evaluationCount);
+            auto adaptiveCount = Interlocked::Load(&adaptiveFn._evaluationCount);
+            Assert::IsTrue(fullCount >= Interlocked::Value(gridDims*gridDims*gridDims));
+            Assert::IsTrue(adaptiveCount * 4 < fullCount, L"Adaptive build didn't skip empty bricks");
+        }
+	};
+}
+
@@ -0,0 +1,179 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/Fluid.h"
+#include "../Math/PoissonSolver.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Builds a right hand side with a few smooth "heat sources". Cells within
+        //  "margin" of the edge are zero, so the solution is (almost) zero on the border.
+    static std::vector<float> BuildPoissonInput(const unsigned dims[3], unsigned margin)
+    {
+        std::vector<float> result(dims[0]*dims[1]*dims[2], 0.f);
+        const float centres[3][3] = { {.3f, .4f, .5f}, {.7f, .6f, .35f}, {.5f, .25f, .7f} };
+        const float strength[3] = { 3.f, -2.f, 1.5f };
+        for (unsigned z=0; z<dims[2]; ++z)
+            for (unsigned y=margin; y<dims[1]-margin; ++y)
+                for (unsigned x=margin; x<dims[0]-margin; ++x) {
+                    if (dims[2] > 1 && (z < margin || z >= dims[2]-margin)) continue;
+                    float v = 0.f;
+                    for (unsigned c=0; c<3; ++c) {
+                        float dx = float(x) - centres[c][0] * dims[0];
+                        float dy = float(y) - centres[c][1] * dims[1];
+                        float dz = (dims[2] > 1) ? (float(z) - centres[c][2] * dims[2]) : 0.f;
+                        v += strength[c] * std::exp(-(dx*dx + dy*dy + dz*dz) / 18.f);
+                    }
+                    result[(z*dims[1]+y)*dims[0]+x] = v;
+                }
+        return result;
+    }
+
+        //  Serial reference for the diffusion matrix (a0 on the diagonal, a1 for each
+        //  neighbour) on the interior cells, with the border held at zero. This is a
+        //  plain lexicographic Gauss-Seidel in double precision, run until converged.
+    static std::vector<double> SolvePoissonReference(
+        const std::vector<float>& b, const unsigned dims[3], unsigned dimensionality, float diffusion)
+    {
+        const double a1 = -diffusion;
+        const double a0 = 1.0 + 2.0 * dimensionality * diffusion;
+        const unsigned width = dims[0], planeStride = dims[0]*dims[1];
+        const unsigned zBegin = (dimensionality==3) ? 1u : 0u;
+        const unsigned zEnd = (dimensionality==3) ? (dims[2]-1) : 1u;
+
+        std::vector<double> x(b.size(), 0.0);
+        for (unsigned k=0; k<1000; ++k) {
+            double maxChange = 0.0;
+            for (unsigned z=zBegin; z<zEnd; ++z)
+                for (unsigned y=1; y<dims[1]-1; ++y)
+                    for (unsigned q=1; q<dims[0]-1; ++q) {
+                        auto i = z*planeStride + y*width + q;
+                        double n = x[i-1] + x[i+1] + x[i-width] + x[i+width];
+                        if (dimensionality==3) n += x[i-planeStride] + x[i+planeStride];
+                        double v = (double(b[i]) - a1 * n) / a0;
+                        maxChange = std::max(maxChange, std::abs(v - x[i]));
+                        x[i] = v;
+                    }
+            if (maxChange < 1e-12) break;
+        }
+        return x;
+    }
+
+        //  Returns the largest difference between the solver result and the reference
+        //  on the interior cells, relative to the largest reference value
+    static double CompareToPoissonReference(
+        const std::vector<float>& x, const std::vector<double>& reference,
+        const unsigned dims[3], unsigned dimensionality)
+    {
+        const unsigned zBegin = (dimensionality==3) ? 1u : 0u;
+        const unsigned zEnd = (dimensionality==3) ? (dims[2]-1) : 1u;
+        double maxDiff = 0.0, maxValue = 0.0;
+        for (unsigned z=zBegin; z<zEnd; ++z)
+            for (unsigned y=1; y<dims[1]-1; ++y)
+                for (unsigned q=1; q<dims[0]-1; ++q) {
+                    auto i = (z*dims[1]+y)*dims[0]+q;
+                    Assert::IsTrue(std::isfinite(x[i]));
+                    maxDiff = std::max(maxDiff, std::abs(double(x[i]) - reference[i]));
+                    maxValue = std::max(maxValue, std::abs(reference[i]));
+                }
+        Assert::IsTrue(maxValue > 0.0);
+        return maxDiff / maxValue;
+    }
+
+    static void TestPoissonSolver(
+        unsigned dimensionality, unsigned dims[3], 
+        const XLEMath::PoissonSolver::Method methods[], const double tolerances[], unsigned methodCount)
+    {
+        using namespace XLEMath;
+        const float diffusion = 0.1f;
+        auto b = BuildPoissonInput(dims, 4);
+        auto reference = SolvePoissonReference(b, dims, dimensionality, diffusion);
+
+        PoissonSolver solver(dimensionality, dims);
+        for (unsigned m=0; m<methodCount; ++m) {
+            auto A = solver.PrepareDiffusionMatrix(diffusion, methods[m], 0u);
+            auto x = b;     // (the solver doesn't write to every border cell, so start with b)
+            solver.Solve(
+                ScalarField1D { x.data(), (unsigned)x.size() }, *A,
+                ScalarField1D { b.data(), (unsigned)b.size() }, methods[m]);
+            auto error = CompareToPoissonReference(x, reference, dims, dimensionality);
+            Assert::IsTrue(error < tolerances[m], L"Poisson solver result doesn't match serial reference");
+        }
+    }
+
+    TEST_CLASS(FluidSolver)
+	{
+	public:
+		TEST_METHOD(TiledExecutionMatchesSerial)
+		{
+                //  The tiled path splits each stage into bricks, but every cell is still
+                //  calculated in exactly the same way. So the result should be identical
+                //  to the serial path (not just close).
+            using namespace SceneEngine;
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const UInt3 dims(45, 38, 21);    // (not a multiple of the brick size)
+            FluidSolver3D serial(dims), tiled(dims);
+            FluidSolver3D::Settings serialSettings, tiledSettings;
+            serialSettings._tiledExecution = 0;
+            tiledSettings._tiledExecution = 1;
+
+            for (unsigned t=0; t<8; ++t) {
+                UInt3 coords(dims[0]/2 + t%3, dims[1]/2, 1);
+                serial.AddDensity(coords, 10.f);
+                tiled.AddDensity(coords, 10.f);
+                serial.Tick(1.f/30.f, serialSettings);
+                tiled.Tick(1.f/30.f, tiledSettings);
+            }
+
+            const auto cellCount = (dims[0]+2) * (dims[1]+2) * (dims[2]+2);
+            auto* serialDensity = serial.GetDensityField();
+            auto* tiledDensity = tiled.GetDensityField();
+            float totalDensity = 0.f;
+            for (unsigned c=0; c<cellCount; ++c) {
+                Assert::AreEqual(serialDensity[c], tiledDensity[c]);
+                totalDensity += serialDensity[c];
+            }
+            Assert::IsTrue(totalDensity > 0.f);
+		}
+
+		TEST_METHOD(PoissonSolverMatchesSerial)
+		{
+                //  The solver kernels are split across the short task thread pool. Compare
+                //  each method against a simple serial solve of the same system, both for
+                //  small systems (that run as a single chunk) and systems large enough to
+                //  be split into many chunks.
+                //  The CG methods aren't tested in 3D, because Multiply() doesn't yet
+                //  handle the borders of 3D matrices. And the multigrid method only
+                //  runs a single V-cycle, so it gets a looser tolerance.
+            using namespace XLEMath;
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const PoissonSolver::Method methods2D[] = 
+                { PoissonSolver::Method::PlainCG, PoissonSolver::Method::PreconCG, PoissonSolver::Method::SOR, PoissonSolver::Method::Multigrid };
+            const double tolerances2D[] = { 1e-3, 1e-3, 1e-3, 1e-1 };
+            unsigned small2D[] = { 34, 27, 1 };
+            unsigned large2D[] = { 258, 131, 1 };
+            TestPoissonSolver(2, small2D, methods2D, tolerances2D, dimof(methods2D));
+            TestPoissonSolver(2, large2D, methods2D, tolerances2D, dimof(methods2D));
+
+            const PoissonSolver::Method methods3D[] = { PoissonSolver::Method::SOR };
+            const double tolerances3D[] = { 1e-3 };
+            unsigned small3D[] = { 18, 14, 12 };
+            unsigned large3D[] = { 34, 34, 34 };
+            TestPoissonSolver(3, small3D, methods3D, tolerances3D, dimof(methods3D));
+            TestPoissonSolver(3, large3D, methods3D, tolerances3D, dimof(methods3D));
+		}
+	};
+}
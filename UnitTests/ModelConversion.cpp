@@ -11,6 +11,7 @@
 #include "../RenderCore/Assets/Services.h"
 #include "../ColladaConversion/DLLInterface.h"
 #include "../ColladaConversion/NascentModel.h"
+#include "../ColladaConversion/ScaffoldParsingUtil.h"
 #include "../Assets/IntermediateAssets.h"
 #include "../Assets/Assets.h"
 #include "../Assets/AssetServices.h"
@@ -24,10 +25,16 @@
 #include "../Utility/TimeUtils.h"
 #include "../Utility/Threading/ThreadingUtils.h"
 #include "../Utility/Conversion.h"
+#include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/StreamDOM.h"
 #include "../Utility/Streams/XmlStreamFormatter.h"
+#include "../Utility/FastParseValue.h"
 #include "../Core/SelectConfiguration.h"
 #include <CppUnitTest.h>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <thread>
 
 #include "../Core/WinAPI/IncludeWindows.h"
 
@@ -60,6 +67,132 @@ namespace UnitTests
         }
     }
 
+        //  Builds a large document that looks like the geometry part of a collada
+        //  file (mostly long <float_array> and <p> lists), without requiring a
+        //  huge sample file in the repository
+    static std::vector<utf8> BuildSyntheticColladaDocument(size_t targetSize)
+    {
+            //  (reserve enough for the last geometry, which goes past targetSize, so the
+            //  vector is never reallocated; that would briefly need twice the memory)
+        std::vector<utf8> result;
+        result.reserve(targetSize + 256*1024);
+        auto append = [&result](const char str[]) { result.insert(result.end(), (const utf8*)str, (const utf8*)&str[XlStringLen(str)]); };
+
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> floatDist(-100.f, 100.f);
+        std::uniform_int_distribution<unsigned> intDist(0, 65535);
+        char buffer[64];
+
+        append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\r\n  <library_geometries>\r\n");
+        for (unsigned geo=0; result.size() < targetSize; ++geo) {
+            const unsigned floatCount = 3 * 4096, indexCount = 3 * 4096;
+            _snprintf_s(buffer, _TRUNCATE, "    <geometry id=\"geo%i\">\r\n      <mesh>\r\n", geo); append(buffer);
+            _snprintf_s(buffer, _TRUNCATE, "        <float_array id=\"geo%i-positions\" count=\"%i\">", geo, floatCount); append(buffer);
+            for (unsigned c=0; c<floatCount; ++c) {
+                _snprintf_s(buffer, _TRUNCATE, (c%3)==2 ? "%g\r\n" : "%g ", floatDist(rng)); append(buffer);
+            }
+            append("</float_array>\r\n        <p>");
+            for (unsigned c=0; c<indexCount; ++c) {
+                _snprintf_s(buffer, _TRUNCATE, "%u ", intDist(rng)); append(buffer);
+            }
+            append("</p>\r\n      </mesh>\r\n    </geometry>\r\n");
+        }
+        append("  </library_geometries>\r\n</COLLADA>\r\n");
+        return std::move(result);
+    }
+
+        //  Walk through all of the elements and attributes in the document, and record
+        //  the character data sections for <float_array> and <p> elements.
+    __declspec(noinline) static void XmlTokenizerPerformanceTest(
+        const utf8*start, const utf8*end,
+        std::vector<XmlInputStreamFormatter<utf8>::InteriorSection>& floatArrays,
+        std::vector<XmlInputStreamFormatter<utf8>::InteriorSection>& indexArrays)
+    {
+        XmlInputStreamFormatter<utf8> formatter(MemoryMappedInputStream(start, end));
+        using Blob = XmlInputStreamFormatter<utf8>::Blob;
+        XmlInputStreamFormatter<utf8>::InteriorSection name, value, eleName;
+        for (;;) {
+            switch (formatter.PeekNext(true)) {
+            case Blob::BeginElement:    formatter.TryBeginElement(eleName); break;
+            case Blob::EndElement:      formatter.TryEndElement(); eleName = XmlInputStreamFormatter<utf8>::InteriorSection(); break;
+            case Blob::AttributeName:   formatter.TryAttribute(name, value); break;
+            case Blob::CharacterData:
+                formatter.TryCharacterData(value);
+                if (XlEqString(eleName, (const utf8*)"float_array")) floatArrays.push_back(value);
+                else if (XlEqString(eleName, (const utf8*)"p")) indexArrays.push_back(value);
+                break;
+            default: return;
+            }
+        }
+    }
+
+        //  Builds a collada file with many independent meshes (each is a small grid with
+        //  positions & texture coordinates, instanced once in the scene with its own transform)
+    static std::string BuildManyMeshColladaDocument(unsigned meshCount, unsigned gridSize)
+    {
+        std::string result;
+        std::mt19937 rng(meshCount);
+        std::uniform_real_distribution<float> heightDist(-1.f, 1.f);
+        char buffer[256];
+
+        result += "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\r\n";
+        result += "  <asset><unit name=\"meter\" meter=\"1\"/><up_axis>Z_UP</up_axis></asset>\r\n";
+        result += "  <library_effects><effect id=\"fx0\"><profile_COMMON><technique sid=\"common\"><lambert><diffuse><color>0.8 0.8 0.8 1</color></diffuse></lambert></technique></profile_COMMON></effect></library_effects>\r\n";
+        result += "  <library_materials><material id=\"mat0\" name=\"mat0\"><instance_effect url=\"#fx0\"/></material></library_materials>\r\n";
+        result += "  <library_geometries>\r\n";
+        const unsigned vertexCount = gridSize * gridSize;
+        const unsigned triangleCount = (gridSize-1) * (gridSize-1) * 2;
+        for (unsigned m=0; m<meshCount; ++m) {
+            _snprintf_s(buffer, _TRUNCATE, "    <geometry id=\"geo%u\" name=\"geo%u\"><mesh>\r\n", m, m); result += buffer;
+
+            _snprintf_s(buffer, _TRUNCATE, "      <source id=\"geo%u-positions\"><float_array id=\"geo%u-positions-array\" count=\"%u\">", m, m, vertexCount*3); result += buffer;
+            for (unsigned y=0; y<gridSize; ++y)
+                for (unsigned x=0; x<gridSize; ++x) {
+                    _snprintf_s(buffer, _TRUNCATE, "%g %g %g ", float(x), float(y), heightDist(rng)); result += buffer;
+                }
+            _snprintf_s(buffer, _TRUNCATE, "</float_array><technique_common><accessor source=\"#geo%u-positions-array\" count=\"%u\" stride=\"3\"><param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>\r\n", m, vertexCount); result += buffer;
+
+            _snprintf_s(buffer, _TRUNCATE, "      <source id=\"geo%u-uvs\"><float_array id=\"geo%u-uvs-array\" count=\"%u\">", m, m, vertexCount*2); result += buffer;
+            for (unsigned y=0; y<gridSize; ++y)
+                for (unsigned x=0; x<gridSize; ++x) {
+                    _snprintf_s(buffer, _TRUNCATE, "%g %g ", float(x)/float(gridSize-1), float(y)/float(gridSize-1)); result += buffer;
+                }
+            _snprintf_s(buffer, _TRUNCATE, "</float_array><technique_common><accessor source=\"#geo%u-uvs-array\" count=\"%u\" stride=\"2\"><param name=\"S\" type=\"float\"/><param name=\"T\" type=\"float\"/></accessor></technique_common></source>\r\n", m, vertexCount); result += buffer;
+
+            _snprintf_s(buffer, _TRUNCATE, "      <vertices id=\"geo%u-vertices\"><input semantic=\"POSITION\" source=\"#geo%u-positions\"/></vertices>\r\n", m, m); result += buffer;
+            _snprintf_s(buffer, _TRUNCATE, "      <triangles material=\"mat\" count=\"%u\"><input semantic=\"VERTEX\" source=\"#geo%u-vertices\" offset=\"0\"/><input semantic=\"TEXCOORD\" source=\"#geo%u-uvs\" offset=\"1\" set=\"0\"/><p>", triangleCount, m, m); result += buffer;
+            for (unsigned y=0; y<gridSize-1; ++y)
+                for (unsigned x=0; x<gridSize-1; ++x) {
+                    unsigned i0 = y*gridSize+x, i1 = i0+1, i2 = i0+gridSize, i3 = i2+1;
+                    _snprintf_s(buffer, _TRUNCATE, "%u %u %u %u %u %u %u %u %u %u %u %u ", i0, i0, i1, i1, i3, i3, i0, i0, i3, i3, i2, i2); result += buffer;
+                }
+            result += "</p></triangles>\r\n    </mesh></geometry>\r\n";
+        }
+        result += "  </library_geometries>\r\n  <library_visual_scenes><visual_scene id=\"scene\" name=\"scene\">\r\n";
+        for (unsigned m=0; m<meshCount; ++m) {
+            _snprintf_s(buffer, _TRUNCATE, "    <node id=\"node%u\" name=\"node%u\" type=\"NODE\"><matrix sid=\"transform\">1 0 0 %u 0 1 0 %u 0 0 1 0 0 0 0 1</matrix>", m, m, (m%20)*gridSize, (m/20)*gridSize); result += buffer;
+            _snprintf_s(buffer, _TRUNCATE, "<instance_geometry url=\"#geo%u\"><bind_material><technique_common><instance_material symbol=\"mat\" target=\"#mat0\"/></technique_common></bind_material></instance_geometry></node>\r\n", m); result += buffer;
+        }
+        result += "  </visual_scene></library_visual_scenes>\r\n  <scene><instance_visual_scene url=\"#scene\"/></scene>\r\n</COLLADA>\r\n";
+        return result;
+    }
+
+    static void AssertChunksIdentical(
+        const RenderCore::ColladaConversion::NascentChunkArray& lhs,
+        const RenderCore::ColladaConversion::NascentChunkArray& rhs)
+    {
+        Assert::IsTrue(lhs && rhs);
+        Assert::AreEqual(lhs->size(), rhs->size(), L"Different chunk count");
+        for (size_t c=0; c<lhs->size(); ++c) {
+            const auto& l = (*lhs)[c];
+            const auto& r = (*rhs)[c];
+            Assert::AreEqual(l._hdr._type, r._hdr._type);
+            Assert::AreEqual(l._hdr._chunkVersion, r._hdr._chunkVersion);
+            Assert::AreEqual(l._hdr._size, r._hdr._size, L"Different chunk size");
+            Assert::IsTrue(l._data == r._data, L"Serialized chunk differs between preconverted and serial conversion");
+        }
+    }
+
 	TEST_CLASS(ModelConversion)
 	{
 	public:
@@ -190,6 +323,222 @@ namespace UnitTests
             }
         }
 
+        TEST_METHOD(ColladaArrayParsePerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  A 32 bit process often can't find 500MB of contiguous address space
+                //  (and there's 2GB of address space in total), so we use a smaller
+                //  document there. It's still much larger than the caches.
+            #if TARGET_64BIT
+                const size_t documentSize = 500 * 1024 * 1024;
+            #else
+                const size_t documentSize = 64 * 1024 * 1024;
+            #endif
+            auto doc = BuildSyntheticColladaDocument(documentSize);
+            auto* start = AsPointer(doc.cbegin());
+            auto* end = AsPointer(doc.cend());
+            const auto freq = double(GetPerformanceCounterFrequency());
+            auto mbPerSecond = [freq](size_t bytes, uint64 counterTime) { return unsigned(double(bytes) / (1024.0 * 1024.0) / (double(counterTime) / freq)); };
+
+            std::vector<XmlInputStreamFormatter<utf8>::InteriorSection> floatArrays, indexArrays;
+            auto tokenizerStart = GetPerformanceCounter();
+            auto tokenizerStartCycles = __rdtsc();
+            XmlTokenizerPerformanceTest(start, end, floatArrays, indexArrays);
+            auto tokenizerEndCycles = __rdtsc();
+            auto tokenizerEnd = GetPerformanceCounter();
+
+            size_t floatBytes = 0, totalFloats = 0;
+            std::vector<float> floats(3 * 4096);
+            auto fastParseStart = GetPerformanceCounter();
+            for (const auto& a:floatArrays) {
+                size_t parsedCount = 0;
+                FastParseList(AsPointer(floats.begin()), floats.size(), a._start, a._end, parsedCount);
+                totalFloats += parsedCount;
+                floatBytes += a._end - a._start;
+            }
+            auto fastParseEnd = GetPerformanceCounter();
+
+                // std::strtof relies on the whitespace after the last element to stop it
+                // running off the end of the array (the </float_array> that follows)
+            size_t strtofFloats = 0;
+            auto strtofStart = GetPerformanceCounter();
+            for (const auto& a:floatArrays) {
+                const char* i = (const char*)a._start;
+                while (i < (const char*)a._end) {
+                    char* next = nullptr;
+                    floats[strtofFloats % floats.size()] = std::strtof(i, &next);
+                    if (next == i) break;
+                    ++strtofFloats;
+                    i = next;
+                }
+            }
+            auto strtofEnd = GetPerformanceCounter();
+
+            size_t indexBytes = 0, totalIndices = 0;
+            std::vector<uint32> indices(3 * 4096);
+            auto indexParseStart = GetPerformanceCounter();
+            for (const auto& a:indexArrays) {
+                size_t parsedCount = 0;
+                FastParseList(AsPointer(indices.begin()), indices.size(), a._start, a._end, parsedCount);
+                totalIndices += parsedCount;
+                indexBytes += a._end - a._start;
+            }
+            auto indexParseEnd = GetPerformanceCounter();
+
+            Assert::AreEqual(totalFloats, strtofFloats);
+
+            LogAlwaysWarning << "Synthetic collada document: " << doc.size() / (1024*1024) << "MB, with " << totalFloats << " floats and " << totalIndices << " indices";
+            LogAlwaysWarning << "XML tokenizer: " << mbPerSecond(doc.size(), tokenizerEnd-tokenizerStart) << "MB/s (" << float(tokenizerEndCycles-tokenizerStartCycles) / float(doc.size()) << " cycles per byte)";
+            LogAlwaysWarning << "FastParseList<float>: " << mbPerSecond(floatBytes, fastParseEnd-fastParseStart) << "MB/s";
+            LogAlwaysWarning << "std::strtof: " << mbPerSecond(floatBytes, strtofEnd-strtofStart) << "MB/s";
+            LogAlwaysWarning << "FastParseList<uint32>: " << mbPerSecond(indexBytes, indexParseEnd-indexParseStart) << "MB/s";
+        }
+
+        TEST_METHOD(ColladaParseXMLListOverflow)
+        {
+                //  Lists that are longer than the destination must stop at the end of the
+                //  destination (without writing past it). The return value points to the first
+                //  element that wasn't parsed, and the element count includes everything in
+                //  the list (even the elements that didn't fit).
+            using Section = XmlInputStreamFormatter<utf8>::InteriorSection;
+            const unsigned destCount = 8, guardCount = 4;
+            const uint32 guardValue = 0xcdcdcdcd;
+
+            for (unsigned listLength:{ 0u, 1u, 7u, 8u, 9u, 20u, 8u+64u, 8u+65u, 200u }) {
+                std::string list = "\r\n  ";
+                std::vector<size_t> elementStarts;
+                for (unsigned c=0; c<listLength; ++c) {
+                    elementStarts.push_back(list.size());
+                    list += std::to_string(c * 3) + ((c%5)==4 ? "\r\n" : " ");
+                }
+                Section section((const utf8*)list.c_str(), (const utf8*)(list.c_str() + list.size()));
+
+                uint32 buffer[destCount + guardCount];
+                std::fill(buffer, &buffer[dimof(buffer)], guardValue);
+                unsigned eleCount = ~0u;
+                auto* parseEnd = ::ColladaConversion::ParseXMLList(buffer, destCount, section, &eleCount);
+
+                Assert::AreEqual(listLength, eleCount, L"ParseXMLList returned the wrong element count");
+                for (unsigned c=0; c<std::min(listLength, destCount); ++c)
+                    Assert::AreEqual(c * 3, buffer[c]);
+                for (unsigned c=std::min(listLength, destCount); c<dimof(buffer); ++c)
+                    Assert::AreEqual(guardValue, buffer[c], L"ParseXMLList wrote past the end of the destination");
+
+                    // (when the list doesn't fit, we should stop at the first element that didn't fit)
+                if (listLength > destCount) {
+                    Assert::IsTrue(parseEnd == section._start + elementStarts[destCount]);
+                } else if (listLength == destCount) {
+                    Assert::IsTrue(parseEnd == section._end);
+                }
+
+                    // same again, without asking for the element count
+                std::fill(buffer, &buffer[dimof(buffer)], guardValue);
+                auto* parseEnd2 = ::ColladaConversion::ParseXMLList(buffer, destCount, section);
+                Assert::IsTrue(parseEnd2 == parseEnd);
+                for (unsigned c=destCount; c<dimof(buffer); ++c)
+                    Assert::AreEqual(guardValue, buffer[c], L"ParseXMLList wrote past the end of the destination");
+            }
+
+                // floats, with a list that ends without trailing whitespace
+            {
+                const char list[] = "1.5 -2 3e2 4.25 5 6 7";
+                Section section((const utf8*)list, (const utf8*)&list[dimof(list)-1]);
+                float buffer[4 + guardCount];
+                std::fill(buffer, &buffer[dimof(buffer)], -1234.f);
+                unsigned eleCount = 0;
+                auto* parseEnd = ::ColladaConversion::ParseXMLList(buffer, 4, section, &eleCount);
+                Assert::AreEqual(7u, eleCount);
+                Assert::AreEqual(1.5f, buffer[0]); Assert::AreEqual(-2.f, buffer[1]);
+                Assert::AreEqual(300.f, buffer[2]); Assert::AreEqual(4.25f, buffer[3]);
+                for (unsigned c=4; c<dimof(buffer); ++c)
+                    Assert::AreEqual(-1234.f, buffer[c], L"ParseXMLList wrote past the end of the destination");
+                Assert::IsTrue(parseEnd == (const utf8*)&list[16]);
+            }
+        }
+
+        TEST_METHOD(ColladaPreconvertedIdentical)
+        {
+                //  SerializeSkin converts all of the geometry in parallel before instantiating it.
+                //  The result must be byte-for-byte identical to converting each object while
+                //  instantiating it (SerializeSkinSerial). We also measure the speed-up on a
+                //  scene with many independent meshes.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            {
+                #if TARGET_64BIT
+                    #if defined(_DEBUG)
+                        ConsoleRig::AttachableLibrary lib("../Finals_Debug64/ColladaConversion.dll");
+                    #else
+                        ConsoleRig::AttachableLibrary lib("../Finals_Profile64/ColladaConversion.dll");
+                    #endif
+                #else
+                    #if defined(_DEBUG)
+                        ConsoleRig::AttachableLibrary lib("../Finals_Debug32/ColladaConversion.dll");
+                    #else
+                        ConsoleRig::AttachableLibrary lib("../Finals_Profile32/ColladaConversion.dll");
+                    #endif
+                #endif
+                Assert::IsTrue(lib.TryAttach(), L"Could not attach ColladaConversion dll");
+
+                using namespace RenderCore::ColladaConversion;
+                #if !TARGET_64BIT
+                    auto createScaffold = lib.GetFunction<CreateColladaScaffoldFn*>("?CreateColladaScaffold@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@VColladaScaffold@ColladaConversion@RenderCore@@@std@@QBD@Z");
+                    auto serializeSkin = lib.GetFunction<ModelSerializeFn*>("?SerializeSkin@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@V?$vector@VNascentChunk@ColladaConversion@RenderCore@@V?$allocator@VNascentChunk@ColladaConversion@RenderCore@@@std@@@std@@@std@@ABVColladaScaffold@12@QBD@Z");
+                    auto serializeSkinSerial = lib.GetFunction<ModelSerializeFn*>("?SerializeSkinSerial@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@V?$vector@VNascentChunk@ColladaConversion@RenderCore@@V?$allocator@VNascentChunk@ColladaConversion@RenderCore@@@std@@@std@@@std@@ABVColladaScaffold@12@QBD@Z");
+                #else
+                    auto createScaffold = lib.GetFunction<CreateColladaScaffoldFn*>("?CreateColladaScaffold@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@VColladaScaffold@ColladaConversion@RenderCore@@@std@@QEBD@Z");
+                    auto serializeSkin = lib.GetFunction<ModelSerializeFn*>("?SerializeSkin@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@V?$vector@VNascentChunk@ColladaConversion@RenderCore@@V?$allocator@VNascentChunk@ColladaConversion@RenderCore@@@std@@@std@@@std@@AEBVColladaScaffold@12@QEBD@Z");
+                    auto serializeSkinSerial = lib.GetFunction<ModelSerializeFn*>("?SerializeSkinSerial@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@V?$vector@VNascentChunk@ColladaConversion@RenderCore@@V?$allocator@VNascentChunk@ColladaConversion@RenderCore@@@std@@@std@@@std@@AEBVColladaScaffold@12@QEBD@Z");
+                #endif
+                Assert::IsTrue(createScaffold && serializeSkin && serializeSkinSerial);
+
+                {
+                    auto scaffold = (*createScaffold)("game/model/galleon/galleon.dae");
+                    auto parallel = (*serializeSkin)(*scaffold, nullptr);
+                    auto serial = (*serializeSkinSerial)(*scaffold, nullptr);
+                    AssertChunksIdentical(parallel, serial);
+                }
+
+                const char manyMeshFile[] = "int/unittest-300meshes.dae";
+                const unsigned meshCount = 300;
+                {
+                    auto doc = BuildManyMeshColladaDocument(meshCount, 48);
+                    BasicFile file(manyMeshFile, "wb");
+                    file.Write(doc.c_str(), 1, doc.size());
+                }
+
+                {
+                    auto scaffold = (*createScaffold)(manyMeshFile);
+
+                        // (take the best of a few runs of each, to reduce noise)
+                    const unsigned iterations = 3;
+                    uint64 bestParallel = ~uint64(0), bestSerial = ~uint64(0);
+                    RenderCore::ColladaConversion::NascentChunkArray parallel, serial;
+                    for (unsigned c=0; c<iterations; ++c) {
+                        auto start = GetPerformanceCounter();
+                        parallel = (*serializeSkin)(*scaffold, nullptr);
+                        auto middle = GetPerformanceCounter();
+                        serial = (*serializeSkinSerial)(*scaffold, nullptr);
+                        auto end = GetPerformanceCounter();
+                        bestParallel = std::min(bestParallel, middle-start);
+                        bestSerial = std::min(bestSerial, end-middle);
+                    }
+                    AssertChunksIdentical(parallel, serial);
+
+                    auto freq = float(GetPerformanceCounterFrequency());
+                    LogAlwaysWarning << meshCount << " mesh scene, " << std::thread::hardware_concurrency() << " hardware threads";
+                    LogAlwaysWarning << "Serial conversion: " << float(bestSerial) * 1000.f / freq << "ms";
+                    LogAlwaysWarning << "Preconverted in parallel: " << float(bestParallel) * 1000.f / freq << "ms";
+                    LogAlwaysWarning << "Speed-up: " << float(bestSerial) / float(bestParallel) << "x";
+                }
+
+                XlDeleteFile((const utf8*)manyMeshFile);
+            }
+        }
+
         TEST_METHOD(ColladaScaffold)
 		{
             UnitTest_SetWorkingDirectory();
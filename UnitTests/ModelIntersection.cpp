@@ -0,0 +1,318 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/ModelIntersection.h"
+#include "../RenderCore/Assets/AssetUtils.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/ChunkFile.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Math/Transformations.h"
+#include "../Math/ProjectionMath.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <set>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets;
+
+    static const ::Assets::ResChar IntersectionTestFile[] = "int/unittest-intersection.chunk";
+
+    static std::vector<ModelIntersectionTriangle> BuildRandomTriangles(std::mt19937& rng, unsigned count)
+    {
+            //  Small triangles scattered through a box, with a few large ones that cut across
+            //  the whole box (so many BVH nodes overlap). Each triangle gets a unique draw
+            //  call index, so we can identify it in the results.
+        std::vector<ModelIntersectionTriangle> result;
+        result.reserve(count);
+        std::uniform_real_distribution<float> centreDist(-10.f, 10.f);
+        for (unsigned c=0; c<count; ++c) {
+            float size = (c%50)==0 ? 12.f : 1.f;
+            std::uniform_real_distribution<float> offsetDist(-size, size);
+            Float3 centre(centreDist(rng), centreDist(rng), centreDist(rng));
+            ModelIntersectionTriangle tri;
+            for (unsigned q=0; q<3; ++q)
+                tri._pts[q] = centre + Float3(offsetDist(rng), offsetDist(rng), offsetDist(rng));
+            tri._drawCallIndex = c;
+            tri._materialGuid = 0x1000ull + c;
+            result.push_back(tri);
+        }
+        return result;
+    }
+
+    static void WriteIntersectionFile(const std::vector<uint8>& intersectionChunk)
+    {
+            //  ModelIntersectionScaffold also checks the version of the scaffold chunk, so we
+            //  need an (empty) scaffold chunk in the file as well.
+        using namespace Serialization::ChunkFile;
+        SimpleChunkFileWriter file(
+            2, "unittest", "unittest",
+            std::make_tuple(IntersectionTestFile, "wb", 0));
+        file.BeginChunk(ChunkType_ModelScaffold, ModelScaffoldVersion, "unittest");
+        file.BeginChunk(ChunkType_ModelIntersection, ModelIntersectionVersion, "unittest");
+        file.Write(AsPointer(intersectionChunk.cbegin()), 1, intersectionChunk.size());
+    }
+
+    class BruteForceHit
+    {
+    public:
+        float       _distance;
+        unsigned    _drawCallIndex;
+        bool        _ambiguous;     // (close enough to an edge that rounding could go either way)
+    };
+
+    static std::vector<BruteForceHit> BruteForceRayTest(
+        const std::vector<ModelIntersectionTriangle>& triangles,
+        const Float3& rayStart, const Float3& rayEnd)
+    {
+            //  Simple Moller-Trumbore test against every triangle, in double precision. The
+            //  limits match ModelIntersectionScaffold (both faces, and hits very close to the
+            //  ray start are rejected).
+        const double edgeEpsilon = 1e-4;
+        double dir[3], origin[3];
+        for (unsigned c=0; c<3; ++c) { dir[c] = rayEnd[c] - rayStart[c]; origin[c] = rayStart[c]; }
+        double length = std::sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+        double minT = 1e-5 / std::max(length, 1e-5);
+
+        std::vector<BruteForceHit> result;
+        for (const auto& tri:triangles) {
+            double v0[3], e1[3], e2[3];
+            for (unsigned c=0; c<3; ++c) {
+                v0[c] = tri._pts[0][c];
+                e1[c] = double(tri._pts[1][c]) - double(tri._pts[0][c]);
+                e2[c] = double(tri._pts[2][c]) - double(tri._pts[0][c]);
+            }
+            double h[3] = { dir[1]*e2[2] - dir[2]*e2[1], dir[2]*e2[0] - dir[0]*e2[2], dir[0]*e2[1] - dir[1]*e2[0] };
+            double a = e1[0]*h[0] + e1[1]*h[1] + e1[2]*h[2];
+            if (a == 0.0) continue;
+            double f = 1.0 / a;
+            double s[3] = { origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2] };
+            double u = f * (s[0]*h[0] + s[1]*h[1] + s[2]*h[2]);
+            double q[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+            double v = f * (dir[0]*q[0] + dir[1]*q[1] + dir[2]*q[2]);
+            double t = f * (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]);
+
+            bool ambiguous =
+                   std::abs(u) < edgeEpsilon || std::abs(v) < edgeEpsilon || std::abs(1.0 - u - v) < edgeEpsilon
+                || std::abs(t - minT) < edgeEpsilon || std::abs(t - 1.0) < edgeEpsilon;
+            bool hit = u >= 0.0 && v >= 0.0 && (u+v) <= 1.0 && t > minT && t < 1.0;
+            if (hit || ambiguous)
+                result.push_back(BruteForceHit{float(t), tri._drawCallIndex, ambiguous});
+        }
+        std::sort(result.begin(), result.end(),
+            [](const BruteForceHit& lhs, const BruteForceHit& rhs) { return lhs._distance < rhs._distance; });
+        return result;
+    }
+
+    static bool BruteForceTriangleInFrustum(const Float4x4& modelToProjection, const ModelIntersectionTriangle& tri)
+    {
+            //  A triangle is rejected only if all of its points are outside of the same
+            //  frustum plane (with a 0 to w depth range)
+        Float4 p[3];
+        for (unsigned q=0; q<3; ++q)
+            p[q] = modelToProjection * Expand(tri._pts[q], 1.f);
+        if (p[0][0] < -p[0][3] && p[1][0] < -p[1][3] && p[2][0] < -p[2][3]) return false;
+        if (p[0][0] >  p[0][3] && p[1][0] >  p[1][3] && p[2][0] >  p[2][3]) return false;
+        if (p[0][1] < -p[0][3] && p[1][1] < -p[1][3] && p[2][1] < -p[2][3]) return false;
+        if (p[0][1] >  p[0][3] && p[1][1] >  p[1][3] && p[2][1] >  p[2][3]) return false;
+        if (p[0][2] < 0.f      && p[1][2] < 0.f      && p[2][2] < 0.f) return false;
+        if (p[0][2] >  p[0][3] && p[1][2] >  p[1][3] && p[2][2] >  p[2][3]) return false;
+        return true;
+    }
+
+    static Float3 RandomPoint(std::mt19937& rng, float range)
+    {
+        std::uniform_real_distribution<float> d(-range, range);
+        return Float3(d(rng), d(rng), d(rng));
+    }
+
+    static Float4x4 BuildRandomModelToProjection(std::mt19937& rng)
+    {
+        Float4x4 cameraToWorld = Identity<Float4x4>();
+        Combine_InPlace(RotationX(std::uniform_real_distribution<float>(-1.5f, 1.5f)(rng)), cameraToWorld);
+        Combine_InPlace(RotationY(std::uniform_real_distribution<float>(-3.14f, 3.14f)(rng)), cameraToWorld);
+        Combine_InPlace(RandomPoint(rng, 15.f), cameraToWorld);
+        return Combine(
+            InvertOrthonormalTransform(cameraToWorld),
+            PerspectiveProjection(
+                std::uniform_real_distribution<float>(.3f, 1.5f)(rng), 1.5f, 0.1f,
+                std::uniform_real_distribution<float>(5.f, 40.f)(rng),
+                GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive));
+    }
+
+    TEST_CLASS(ModelIntersection)
+	{
+	public:
+		TEST_METHOD(IntersectionMatchesBruteForce)
+		{
+                //  Build a BVH from random triangles, and compare the ray and frustum queries
+                //  against a brute force test of every triangle. Rays exactly along the axes
+                //  are included, because they exercise the infinite inverse direction case
+                //  in the node tests.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            std::mt19937 rng(0x1b5e);
+            auto triangles = BuildRandomTriangles(rng, 3000);
+            WriteIntersectionFile(BuildModelIntersectionChunk(MakeIteratorRange(triangles)));
+
+            {
+                ModelIntersectionScaffold scaffold(IntersectionTestFile);
+                Assert::AreEqual(unsigned(triangles.size()), scaffold.GetTriangleCount());
+
+                    // the bounding box should exactly match the input
+                auto bb = scaffold.GetBoundingBox();
+                for (unsigned c=0; c<3; ++c) {
+                    float mins = std::numeric_limits<float>::max(), maxs = -std::numeric_limits<float>::max();
+                    for (const auto& t:triangles)
+                        for (unsigned q=0; q<3; ++q) {
+                            mins = std::min(mins, t._pts[q][c]);
+                            maxs = std::max(maxs, t._pts[q][c]);
+                        }
+                    Assert::AreEqual(mins, bb.first[c]);
+                    Assert::AreEqual(maxs, bb.second[c]);
+                }
+
+                unsigned totalHits = 0;
+                for (unsigned r=0; r<500; ++r) {
+                    Float3 rayStart, rayEnd;
+                    if (r < 100) {
+                            // axis aligned rays
+                        rayStart = RandomPoint(rng, 10.f);
+                        rayEnd = rayStart;
+                        rayStart[r%3] = -30.f;
+                        rayEnd[r%3] = 30.f;
+                    } else if (r < 200) {
+                            // short rays starting inside of the model
+                        rayStart = RandomPoint(rng, 10.f);
+                        rayEnd = rayStart + RandomPoint(rng, 3.f);
+                    } else {
+                        rayStart = Normalize(RandomPoint(rng, 1.f)) * 30.f;
+                        rayEnd = RandomPoint(rng, 10.f) * 2.f - rayStart;
+                    }
+
+                    auto expected = BruteForceRayTest(triangles, rayStart, rayEnd);
+                    auto hits = scaffold.RayTest(rayStart, rayEnd);
+
+                        // every hit from the BVH must be a brute force hit, and every
+                        // unambiguous brute force hit must be found by the BVH
+                    for (unsigned h=0; h<unsigned(hits.size()); ++h) {
+                        if (h) Assert::IsTrue(hits[h-1]._distance <= hits[h]._distance, L"RayTest results not sorted");
+                        auto i = std::find_if(expected.cbegin(), expected.cend(),
+                            [&hits, h](const BruteForceHit& e) { return e._drawCallIndex == hits[h]._drawCallIndex; });
+                        Assert::IsTrue(i != expected.cend(), L"RayTest found a hit that doesn't exist");
+                        Assert::AreEqual(i->_distance, hits[h]._distance, 1e-4f);
+                        Assert::IsTrue(hits[h]._materialGuid == triangles[hits[h]._drawCallIndex]._materialGuid);
+                        auto b = hits[h]._barycentric;
+                        Assert::AreEqual(1.f, b[0] + b[1] + b[2], 1e-4f);
+
+                            // the barycentric coordinates should give us the point on the ray
+                        auto pt = b[0] * hits[h]._pts[0] + b[1] * hits[h]._pts[1] + b[2] * hits[h]._pts[2];
+                        auto onRay = rayStart + (rayEnd - rayStart) * hits[h]._distance;
+                        Assert::IsTrue(Magnitude(pt - onRay) < 1e-2f);
+                    }
+                    for (const auto& e:expected) {
+                        if (e._ambiguous) continue;
+                        auto i = std::find_if(hits.cbegin(), hits.cend(),
+                            [&e](const ModelIntersectionHit& h) { return h._drawCallIndex == e._drawCallIndex; });
+                        Assert::IsTrue(i != hits.cend(), L"RayTest missed a hit");
+                    }
+                    totalHits += unsigned(hits.size());
+
+                        // FirstRayIntersection should find the closest hit
+                    ModelIntersectionHit first;
+                    bool gotFirst = scaffold.FirstRayIntersection(first, rayStart, rayEnd);
+                    Assert::AreEqual(!hits.empty(), gotFirst);
+                    if (gotFirst) {
+                        Assert::AreEqual(hits[0]._distance, first._distance);
+                        if (!expected[0]._ambiguous)
+                            Assert::AreEqual(expected[0]._distance, first._distance, 1e-4f);
+                    }
+                }
+                Assert::IsTrue(totalHits > 500);    // (make sure the test isn't trivial)
+
+                unsigned totalInFrustum = 0;
+                for (unsigned f=0; f<200; ++f) {
+                    auto modelToProjection = BuildRandomModelToProjection(rng);
+                    std::set<unsigned> expected;
+                    for (const auto& t:triangles)
+                        if (BruteForceTriangleInFrustum(modelToProjection, t))
+                            expected.insert(t._drawCallIndex);
+
+                    auto hits = scaffold.FrustumTest(modelToProjection);
+                    std::set<unsigned> found;
+                    for (const auto& h:hits) {
+                        Assert::IsTrue(found.insert(h._drawCallIndex).second, L"FrustumTest returned a triangle twice");
+                        Assert::AreEqual(0.f, h._distance);
+                    }
+                    Assert::IsTrue(found == expected, L"FrustumTest doesn't match brute force");
+                    Assert::AreEqual(!expected.empty(), scaffold.AnyWithinFrustum(modelToProjection));
+                    totalInFrustum += unsigned(expected.size());
+                }
+                Assert::IsTrue(totalInFrustum > 0);
+            }
+
+                //  an empty model should give no results (rather than crash). The new file is
+                //  written while the old scaffold is still alive, as happens when a model is
+                //  recompiled. The old scaffold must not be holding the file open.
+            {
+                ModelIntersectionScaffold oldScaffold(IntersectionTestFile);
+                WriteIntersectionFile(BuildModelIntersectionChunk(IteratorRange<const ModelIntersectionTriangle*>()));
+                Assert::AreEqual(unsigned(triangles.size()), oldScaffold.GetTriangleCount());
+
+                ModelIntersectionScaffold scaffold(IntersectionTestFile);
+                Assert::AreEqual(0u, scaffold.GetTriangleCount());
+                Assert::IsTrue(scaffold.RayTest(Float3(-30.f, 0.f, 0.f), Float3(30.f, 0.f, 0.f)).empty());
+                ModelIntersectionHit first;
+                Assert::IsFalse(scaffold.FirstRayIntersection(first, Float3(-30.f, 0.f, 0.f), Float3(30.f, 0.f, 0.f)));
+                Assert::IsFalse(scaffold.AnyWithinFrustum(BuildRandomModelToProjection(rng)));
+            }
+
+            XlDeleteFile((const utf8*)IntersectionTestFile);
+		}
+
+        TEST_METHOD(IntersectionDegenerateInput)
+        {
+                //  Many triangles with the same centroid (so the binned split can't separate
+                //  them) must still produce a valid tree (within the runtime stack depth).
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+
+            std::vector<ModelIntersectionTriangle> triangles;
+            for (unsigned c=0; c<1000; ++c) {
+                ModelIntersectionTriangle tri;
+                float s = 1.f + float(c) * .01f;
+                tri._pts[0] = Float3(-s, -s, 0.f);
+                tri._pts[1] = Float3( s, -s, 0.f);
+                tri._pts[2] = Float3( 0.f, s, 0.f);
+                tri._drawCallIndex = c;
+                tri._materialGuid = c;
+                triangles.push_back(tri);
+            }
+            WriteIntersectionFile(BuildModelIntersectionChunk(MakeIteratorRange(triangles)));
+
+            {
+                ModelIntersectionScaffold scaffold(IntersectionTestFile);
+                auto hits = scaffold.RayTest(Float3(0.f, 0.f, -5.f), Float3(0.f, 0.f, 5.f));
+                Assert::AreEqual(unsigned(triangles.size()), unsigned(hits.size()));
+                ModelIntersectionHit first;
+                Assert::IsTrue(scaffold.FirstRayIntersection(first, Float3(0.f, 0.f, -5.f), Float3(0.f, 0.f, 5.f)));
+                Assert::AreEqual(.5f, first._distance, 1e-5f);
+            }
+
+            XlDeleteFile((const utf8*)IntersectionTestFile);
+        }
+	};
+}
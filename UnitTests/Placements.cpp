@@ -0,0 +1,450 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/PlacementsManager.h"
+#include "../SceneEngine/PlacementsQuadTree.h"
+#include "../SceneEngine/PreparedScene.h"
+#include "../RenderCore/Assets/ModelCache.h"
+#include "../RenderCore/Assets/Services.h"
+#include "../Assets/AssetServices.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Math/Transformations.h"
+#include "../Math/ProjectionMath.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/StringUtils.h"
+#include <CppUnitTest.h>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    typedef SceneEngine::PlacementsQuadTree::BoundingBox BoundingBox;
+
+    static std::vector<BoundingBox> BuildRandomBoxes(std::mt19937& rng, unsigned count)
+    {
+        std::vector<BoundingBox> result;
+        result.reserve(count);
+        for (unsigned c=0; c<count; ++c) {
+            Float3 centre, radius;
+            for (unsigned e=0; e<3; ++e) {
+                centre[e] = std::uniform_real_distribution<float>(e==2 ? 0.f : -1000.f, e==2 ? 100.f : 1000.f)(rng);
+                radius[e] = std::uniform_real_distribution<float>(.5f, 20.f)(rng);
+            }
+            result.push_back(std::make_pair(centre - radius, centre + radius));
+        }
+        return result;
+    }
+
+    static Float4x4 BuildRandomCellToClip(std::mt19937& rng)
+    {
+        Float4x4 cameraToWorld = Identity<Float4x4>();
+        Combine_InPlace(RotationX(std::uniform_real_distribution<float>(-.5f, .5f)(rng)), cameraToWorld);
+        Combine_InPlace(RotationY(std::uniform_real_distribution<float>(-3.14f, 3.14f)(rng)), cameraToWorld);
+        Combine_InPlace(
+            Float3(
+                std::uniform_real_distribution<float>(-1000.f, 1000.f)(rng),
+                std::uniform_real_distribution<float>(-1000.f, 1000.f)(rng),
+                std::uniform_real_distribution<float>(0.f, 100.f)(rng)),
+            cameraToWorld);
+        return Combine(
+            InvertOrthonormalTransform(cameraToWorld),
+            PerspectiveProjection(1.f, 1.5f, 0.1f, 800.f, GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive));
+    }
+
+    static std::vector<unsigned> CullAll(
+        const SceneEngine::PlacementsQuadTree& tree, const Float4x4& cellToClip,
+        const std::vector<BoundingBox>& boxes)
+    {
+        std::vector<unsigned> result(tree.GetMaxResults());
+        unsigned resultCount = 0;
+        tree.CalculateVisibleObjects(
+            cellToClip, AsPointer(boxes.cbegin()), sizeof(BoundingBox),
+            AsPointer(result.begin()), resultCount, unsigned(result.size()));
+        result.resize(resultCount);
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    TEST_CLASS(Placements)
+	{
+	public:
+		TEST_METHOD(BVHCulling)
+		{
+                //  Both arrangements must find exactly the objects that pass a culling
+                //  test on their own bounding box
+            using namespace SceneEngine;
+            std::mt19937 rng(0x5e19);
+            auto boxes = BuildRandomBoxes(rng, 5000);
+            PlacementsQuadTree bvh(
+                AsPointer(boxes.cbegin()), sizeof(BoundingBox), boxes.size(),
+                PlacementsQuadTree::Type::BVH);
+            PlacementsQuadTree quadTree(
+                AsPointer(boxes.cbegin()), sizeof(BoundingBox), boxes.size(),
+                PlacementsQuadTree::Type::QuadTree);
+
+            for (unsigned f=0; f<64; ++f) {
+                __declspec(align(16)) Float4x4 cellToClip = BuildRandomCellToClip(rng);
+                std::vector<unsigned> bruteForce;
+                for (unsigned c=0; c<boxes.size(); ++c)
+                    if (!CullAABB_Aligned(cellToClip, boxes[c].first, boxes[c].second))
+                        bruteForce.push_back(c);
+                Assert::IsTrue(CullAll(bvh, cellToClip, boxes) == bruteForce, L"BVH culling doesn't match brute force culling");
+                Assert::IsTrue(CullAll(quadTree, cellToClip, boxes) == bruteForce, L"Quad tree culling doesn't match brute force culling");
+            }
+        }
+
+		TEST_METHOD(SerializedBVHRoundTrip)
+		{
+                //  Build a BVH, serialize it, and use the serialized form in place from
+                //  a different address. Culling must give exactly the same result as the
+                //  original tree, and the same result as testing every box individually.
+            using namespace SceneEngine;
+            std::mt19937 rng(0x5e1a);
+            auto boxes = BuildRandomBoxes(rng, 5000);
+            PlacementsQuadTree original(
+                AsPointer(boxes.cbegin()), sizeof(BoundingBox), boxes.size(),
+                PlacementsQuadTree::Type::BVH);
+            auto serialized = original.SerializeBVH();
+            Assert::IsTrue(!serialized.empty());
+
+                // (serialize again -- the result must be deterministic, including the padding)
+            Assert::IsTrue(serialized == original.SerializeBVH(), L"BVH serialization isn't deterministic");
+
+            AlignedUniquePtr<uint8> copy((uint8*)XlMemAlign(serialized.size(), 16));
+            XlCopyMemory(copy.get(), AsPointer(serialized.cbegin()), serialized.size());
+            PlacementsQuadTree inPlace(copy.get(), serialized.size());
+            Assert::AreEqual(original.GetMaxResults(), inPlace.GetMaxResults());
+
+            for (unsigned f=0; f<64; ++f) {
+                __declspec(align(16)) Float4x4 cellToClip = BuildRandomCellToClip(rng);
+                auto originalResult = CullAll(original, cellToClip, boxes);
+                auto inPlaceResult = CullAll(inPlace, cellToClip, boxes);
+                Assert::IsTrue(originalResult == inPlaceResult, L"Serialized BVH culls differently to the original");
+
+                std::vector<unsigned> bruteForce;
+                for (unsigned c=0; c<boxes.size(); ++c)
+                    if (!CullAABB_Aligned(cellToClip, boxes[c].first, boxes[c].second))
+                        bruteForce.push_back(c);
+                Assert::IsTrue(inPlaceResult == bruteForce, L"Serialized BVH culling doesn't match brute force culling");
+            }
+        }
+
+        TEST_METHOD(SerializedBVHCorruption)
+        {
+                //  The in place constructor validates the data before using it. Each of
+                //  these modifications should cause an exception.
+            using namespace SceneEngine;
+            std::mt19937 rng(0x5e1b);
+            auto boxes = BuildRandomBoxes(rng, 1000);
+            PlacementsQuadTree original(
+                AsPointer(boxes.cbegin()), sizeof(BoundingBox), boxes.size(),
+                PlacementsQuadTree::Type::BVH);
+            auto serialized = original.SerializeBVH();
+
+                //  Layout (see PlacementsQuadTree.cpp):
+                //      header: version, node count, object count, max depth, node size, 3 x dummy
+                //      nodes: 160 bytes each (children at +96, first object at +112, object count at +128)
+                //      objects: one unsigned per object
+            const size_t headerSize = 32, nodeSize = 160;
+            auto nodeCount = *(const unsigned*)&serialized[4];
+            auto objectCount = *(const unsigned*)&serialized[8];
+            Assert::IsTrue(nodeCount > 1 && objectCount == boxes.size());
+            Assert::AreEqual(headerSize + nodeCount * nodeSize + objectCount * sizeof(unsigned), serialized.size());
+
+            AlignedUniquePtr<uint8> buffer((uint8*)XlMemAlign(serialized.size(), 16));
+            auto tryLoad = [&](size_t size, const std::function<void(uint8*)>& modify) -> bool
+                {
+                    XlCopyMemory(buffer.get(), AsPointer(serialized.cbegin()), serialized.size());
+                    modify(buffer.get());
+                    bool result = false;
+                    TRY {
+                        PlacementsQuadTree tree(buffer.get(), size);
+                        result = true;
+                    } CATCH (const std::exception&) {
+                    } CATCH_END
+                    return result;
+                };
+            auto noChange = [](uint8*) {};
+
+            Assert::IsTrue(tryLoad(serialized.size(), noChange), L"Valid serialized BVH was rejected");
+            Assert::IsFalse(tryLoad(serialized.size()-1, noChange), L"Truncated BVH accepted");
+            Assert::IsFalse(tryLoad(16, noChange), L"Truncated BVH accepted");
+            Assert::IsFalse(tryLoad(serialized.size(), [](uint8* b) { ((unsigned*)b)[0] = 0; }), L"BVH with bad version accepted");
+            Assert::IsFalse(tryLoad(serialized.size(), [](uint8* b) { ((unsigned*)b)[4] = 128; }), L"BVH with bad node size accepted");
+            Assert::IsFalse(tryLoad(serialized.size(), [](uint8* b) { ((unsigned*)b)[1] = ~0u; }), L"BVH with bad node count accepted");
+
+                // find an internal child link in the root, and break it in a few ways
+            unsigned internalChild = ~0u;
+            auto* rootChildren = (unsigned*)PtrAdd(AsPointer(serialized.begin()), headerSize + 96);
+            for (unsigned c=0; c<4; ++c)
+                if (rootChildren[c] > 0 && rootChildren[c] < nodeCount) { internalChild = c; break; }
+            Assert::IsTrue(internalChild != ~0u, L"Expecting the root of a large BVH to have internal children");
+
+            auto setRootChild = [=](unsigned value)
+                {
+                    return [=](uint8* b) { ((unsigned*)PtrAdd(b, headerSize + 96))[internalChild] = value; };
+                };
+            Assert::IsFalse(tryLoad(serialized.size(), setRootChild(0)), L"BVH with cyclic child link accepted");
+            Assert::IsFalse(tryLoad(serialized.size(), setRootChild(nodeCount)), L"BVH with out of range child link accepted");
+
+                // out of range object range in the root
+            Assert::IsFalse(
+                tryLoad(serialized.size(),
+                    [=](uint8* b) { ((unsigned*)PtrAdd(b, headerSize + 128))[internalChild] = objectCount+1; }),
+                L"BVH with bad object range accepted");
+
+                // bad object index in the object list
+            Assert::IsFalse(
+                tryLoad(serialized.size(),
+                    [=](uint8* b) { ((unsigned*)PtrAdd(b, headerSize + nodeCount * nodeSize))[objectCount/2] = objectCount; }),
+                L"BVH with bad object index accepted");
+        }
+
+        TEST_METHOD(PlacementsSaveLoad)
+        {
+                //  Create some placements in the editor, save them and load them back
+                //  in through a normal placements cell. We should get back the same objects,
+                //  and saving twice should give exactly the same file.
+            using namespace SceneEngine;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+            auto raservices = std::make_shared<RenderCore::Assets::Services>(nullptr);
+            raservices->InitColladaCompilers();
+
+            const ::Assets::ResChar fileA[] = "unittest-placements-a.plc";
+            const ::Assets::ResChar fileB[] = "unittest-placements-b.plc";
+            const Float2 cellMins(0.f, 0.f), cellMaxs(512.f, 512.f);
+            std::vector<uint64> createdGuids;
+            std::vector<std::pair<Float3, Float3>> createdBoxes;
+
+            auto modelCache = std::make_shared<RenderCore::Assets::ModelCache>();
+            auto manager = std::make_shared<PlacementsManager>(modelCache);
+            {
+                auto editor = manager->CreateEditor(std::make_shared<PlacementCellSet>(WorldPlacementsConfig(), Zero<Float3>()));
+                auto cellId = editor->CreateCell("[unittest]", cellMins, cellMaxs);
+
+                std::mt19937 rng(0x5e1c);
+                auto transaction = editor->Transaction_Begin(nullptr, nullptr);
+                for (unsigned c=0; c<300; ++c) {
+                    auto localToWorld = AsFloat4x4(RotationZ(std::uniform_real_distribution<float>(-3.14f, 3.14f)(rng)));
+                    SetTranslation(localToWorld, Float3(
+                        std::uniform_real_distribution<float>(cellMins[0] + 10.f, cellMaxs[0] - 10.f)(rng),
+                        std::uniform_real_distribution<float>(cellMins[1] + 10.f, cellMaxs[1] - 10.f)(rng),
+                        0.f));
+                    Assert::IsTrue(transaction->Create(PlacementsEditor::ObjTransDef(
+                        Truncate(localToWorld), "game/model/simple/box.dae", "game/model/simple/box.dae", std::string())));
+                }
+                for (unsigned c=0; c<transaction->GetObjectCount(); ++c) {
+                    Assert::AreEqual(cellId, transaction->GetGuid(c).first);
+                    createdGuids.push_back(transaction->GetGuid(c).second);
+                    createdBoxes.push_back(transaction->GetWorldBoundingBox(c));
+                }
+                transaction->Commit();
+
+                editor->WriteCell(cellId, fileA);
+                editor->WriteCell(cellId, fileB);
+            }
+
+            {
+                size_t sizeA = 0, sizeB = 0;
+                auto blockA = LoadFileAsMemoryBlock(fileA, &sizeA);
+                auto blockB = LoadFileAsMemoryBlock(fileB, &sizeB);
+                Assert::IsTrue(sizeA != 0 && sizeA == sizeB, L"Placements file sizes differ");
+                Assert::IsTrue(XlCompareMemory(blockA.get(), blockB.get(), sizeA) == 0, L"Saving placements isn't deterministic");
+            }
+
+            {
+                WorldPlacementsConfig cfg;
+                WorldPlacementsConfig::Cell cell;
+                cell._offset = Zero<Float3>();
+                cell._mins = Expand(cellMins, -1000.f);
+                cell._maxs = Expand(cellMaxs, 1000.f);
+                XlCopyString(cell._file, fileA);
+                cfg._cells.push_back(cell);
+                PlacementCellSet cellSet(cfg, Zero<Float3>());
+
+                auto intersections = manager->GetIntersections();
+                auto all = intersections->Find_BoxIntersection(
+                    cellSet, Float3(-1e5f, -1e5f, -1e5f), Float3(1e5f, 1e5f, 1e5f), nullptr);
+                std::vector<uint64> loadedGuids;
+                for (const auto& g:all) loadedGuids.push_back(g.second);
+                std::sort(loadedGuids.begin(), loadedGuids.end());
+                auto expectedGuids = createdGuids;
+                std::sort(expectedGuids.begin(), expectedGuids.end());
+                Assert::IsTrue(loadedGuids == expectedGuids, L"Loaded placements don't match the saved placements");
+
+                    // smaller queries should match the bounding boxes we created
+                std::mt19937 rng(0x5e1d);
+                for (unsigned q=0; q<32; ++q) {
+                    Float3 mins(
+                        std::uniform_real_distribution<float>(cellMins[0], cellMaxs[0])(rng),
+                        std::uniform_real_distribution<float>(cellMins[1], cellMaxs[1])(rng),
+                        -10.f);
+                    Float3 maxs = mins + Float3(50.f, 50.f, 20.f);
+                    auto found = intersections->Find_BoxIntersection(cellSet, mins, maxs, nullptr);
+                    std::vector<uint64> foundGuids;
+                    for (const auto& g:found) foundGuids.push_back(g.second);
+                    std::sort(foundGuids.begin(), foundGuids.end());
+
+                    std::vector<uint64> bruteForce;
+                    for (unsigned c=0; c<createdBoxes.size(); ++c) {
+                        const auto& b = createdBoxes[c];
+                        if (    b.second[0] < mins[0] || b.second[1] < mins[1] || b.second[2] < mins[2]
+                            ||  b.first[0] > maxs[0] || b.first[1] > maxs[1] || b.first[2] > maxs[2])
+                            continue;
+                        bruteForce.push_back(createdGuids[c]);
+                    }
+                    std::sort(bruteForce.begin(), bruteForce.end());
+                    Assert::IsTrue(foundGuids == bruteForce, L"Box intersection on loaded placements doesn't match brute force");
+                }
+            }
+
+            manager.reset();
+            modelCache.reset();
+            XlDeleteFile((const utf8*)fileA);
+            XlDeleteFile((const utf8*)fileB);
+        }
+
+        TEST_METHOD(PlacementsCullAfterDetach)
+        {
+            using namespace SceneEngine;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+            auto raservices = std::make_shared<RenderCore::Assets::Services>(nullptr);
+            raservices->InitColladaCompilers();
+
+                //  A BVH used in place from a mapped file must remain valid after everything
+                //  else has released the mapping (as Placements::DetachFromFile does)
+            {
+                const ::Assets::ResChar bvhFile[] = "unittest-placements-bvh.bin";
+                std::mt19937 rng(0x5e1e);
+                auto boxes = BuildRandomBoxes(rng, 2000);
+                PlacementsQuadTree original(
+                    AsPointer(boxes.cbegin()), sizeof(BoundingBox), boxes.size(),
+                    PlacementsQuadTree::Type::BVH);
+                {
+                    auto serialized = original.SerializeBVH();
+                    BasicFile file(bvhFile, "wb");
+                    file.Write(AsPointer(serialized.cbegin()), 1, serialized.size());
+                }
+
+                {
+                    auto mappedFile = std::make_shared<MemoryMappedFile>(bvhFile, 0ull, MemoryMappedFile::Access::Read);
+                    Assert::IsTrue(mappedFile->IsValid());
+                    PlacementsQuadTree inPlace(mappedFile->GetData(), mappedFile->GetSize(), mappedFile);
+                    mappedFile.reset();
+
+                    for (unsigned f=0; f<16; ++f) {
+                        __declspec(align(16)) Float4x4 cellToClip = BuildRandomCellToClip(rng);
+                        Assert::IsTrue(
+                            CullAll(original, cellToClip, boxes) == CullAll(inPlace, cellToClip, boxes), 
+                            L"BVH culls differently after its mapping was released");
+                    }
+                }
+                XlDeleteFile((const utf8*)bvhFile);
+            }
+
+                //  Cull a cell through the renderer (which uses the prebuilt BVH from the cell
+                //  file in place), then edit & save the cell. Saving detaches the cached placements
+                //  and overwrites the file, so the renderer must not be holding onto it. Culling
+                //  again afterwards must still work.
+            const ::Assets::ResChar cellFile[] = "unittest-placements-detach.plc";
+            const Float2 cellMins(0.f, 0.f), cellMaxs(512.f, 512.f);
+            const unsigned objectCount = 200;
+            auto modelCache = std::make_shared<RenderCore::Assets::ModelCache>();
+            auto manager = std::make_shared<PlacementsManager>(modelCache);
+            {
+                auto editor = manager->CreateEditor(std::make_shared<PlacementCellSet>(WorldPlacementsConfig(), Zero<Float3>()));
+                auto cellId = editor->CreateCell("[unittest]", cellMins, cellMaxs);
+                std::mt19937 rng(0x5e1f);
+                auto transaction = editor->Transaction_Begin(nullptr, nullptr);
+                for (unsigned c=0; c<objectCount; ++c) {
+                    auto localToWorld = Identity<Float4x4>();
+                    SetTranslation(localToWorld, Float3(
+                        std::uniform_real_distribution<float>(cellMins[0] + 10.f, cellMaxs[0] - 10.f)(rng),
+                        std::uniform_real_distribution<float>(cellMins[1] + 10.f, cellMaxs[1] - 10.f)(rng),
+                        0.f));
+                    Assert::IsTrue(transaction->Create(PlacementsEditor::ObjTransDef(
+                        Truncate(localToWorld), "game/model/simple/box.dae", "game/model/simple/box.dae", std::string())));
+                }
+                transaction->Commit();
+                editor->WriteCell(cellId, cellFile);
+            }
+
+            WorldPlacementsConfig cfg;
+            WorldPlacementsConfig::Cell cell;
+            cell._offset = Zero<Float3>();
+            cell._mins = Expand(cellMins, -1000.f);
+            cell._maxs = Expand(cellMaxs, 1000.f);
+            XlCopyString(cell._file, cellFile);
+            cfg._cells.push_back(cell);
+            auto cellSet = std::make_shared<PlacementCellSet>(cfg, Zero<Float3>());
+
+                //  Looking straight down on the whole cell, so every object is visible. We don't
+                //  know the order of the objects in the file, so we give the tree boxes that
+                //  cover the whole cell, and expect every object index exactly once
+            auto cameraToWorld = Identity<Float4x4>();
+            SetTranslation(cameraToWorld, Float3(256.f, 256.f, 600.f));
+            __declspec(align(16)) Float4x4 worldToProj = Combine(
+                InvertOrthonormalTransform(cameraToWorld),
+                PerspectiveProjection(1.5f, 1.f, 1.f, 2000.f, GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive));
+            std::vector<BoundingBox> cellBoxes(objectCount + 16, std::make_pair(Expand(cellMins, -10.f), Expand(cellMaxs, 20.f)));
+
+            auto renderer = manager->GetRenderer();
+            auto cullAndCheck = [&]()
+                {
+                    PreparedScene scene;
+                    PreparedScene* scenePtr = &scene;
+                    renderer->CullToPreparedScenes(
+                        MakeIteratorRange(&scenePtr, &scenePtr+1),
+                        MakeIteratorRange(&worldToProj, &worldToProj+1),
+                        *cellSet);
+
+                    auto trees = renderer->GetVisibleQuadTrees(*cellSet, worldToProj);
+                    Assert::AreEqual(size_t(1), trees.size());
+                    Assert::IsTrue(trees[0].second != nullptr, L"No quad tree cached for the cell after culling");
+                    const auto& tree = *trees[0].second;
+                    Assert::IsTrue(tree.GetMaxResults() >= objectCount && tree.GetMaxResults() <= cellBoxes.size());
+
+                    __declspec(align(16)) Float4x4 cellToClip = Combine(AsFloat4x4(trees[0].first), worldToProj);
+                    std::vector<unsigned> expected(tree.GetMaxResults());
+                    std::iota(expected.begin(), expected.end(), 0u);
+                    Assert::IsTrue(CullAll(tree, cellToClip, cellBoxes) == expected, L"Culling the cached quad tree gave the wrong objects");
+                };
+
+            cullAndCheck();
+            {
+                auto editor = manager->CreateEditor(cellSet);
+                auto transaction = editor->Transaction_Begin(nullptr, nullptr);
+                auto localToWorld = Identity<Float4x4>();
+                SetTranslation(localToWorld, Float3(256.f, 256.f, 0.f));
+                Assert::IsTrue(transaction->Create(PlacementsEditor::ObjTransDef(
+                    Truncate(localToWorld), "game/model/simple/box.dae", "game/model/simple/box.dae", std::string())));
+                transaction->Commit();
+
+                    // (throws if the file can't be overwritten)
+                editor->WriteAllCells();
+            }
+            cullAndCheck();
+
+            renderer.reset();
+            cellSet.reset();
+            manager.reset();
+            modelCache.reset();
+            XlDeleteFile((const utf8*)cellFile);
+        }
+
+	};
+}
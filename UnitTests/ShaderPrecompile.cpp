@@ -0,0 +1,96 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/ShaderPrecompiler.h"
+#include "../RenderCore/Assets/LocalCompiledShaderSource.h"
+#include "../RenderCore/ShaderService.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/IntermediateAssets.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Stands in for the real shader compiler, so we can test the scheduling
+        //  and archive writing parts of the precompile pipeline on their own
+    class StubShaderCompiler : public RenderCore::ShaderService::ILowLevelCompiler
+    {
+    public:
+        void AdaptShaderModel(
+            ::Assets::ResChar destination[], const size_t destinationCount,
+            const ::Assets::ResChar source[]) const
+        {
+            XlCopyString(destination, destinationCount, source);
+        }
+
+        bool DoLowLevelCompile(
+            Payload& payload, Payload& errors,
+            std::vector<::Assets::DependentFileState>& dependencies,
+            const void* sourceCode, size_t sourceCodeLength,
+            const RenderCore::ShaderService::ResId& shaderPath,
+            const ::Assets::ResChar definesTable[]) const
+        {
+            Interlocked::Increment(&_compileCount);
+            auto hash = HashCombine(Hash64(sourceCode, PtrAdd(sourceCode, sourceCodeLength)), Hash64(definesTable));
+            payload = std::make_shared<std::vector<uint8>>((const uint8*)&hash, (const uint8*)PtrAdd(&hash, sizeof(hash)));
+            dependencies.push_back(::Assets::IntermediateAssets::Store::GetDependentFileState(shaderPath._filename));
+            return true;
+        }
+
+        std::string MakeShaderMetricsString(const void*, size_t) const { return "stub"; }
+
+        mutable Interlocked::Value _compileCount;
+        StubShaderCompiler() : _compileCount(0) {}
+    };
+
+    TEST_CLASS(ShaderPrecompile)
+	{
+	public:
+		TEST_METHOD(PrecompileWithStubCompiler)
+		{
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto assetServices = std::make_shared<::Assets::Services>(0);
+
+            auto compiler = std::make_shared<StubShaderCompiler>();
+            auto shaderSource = std::make_shared<LocalCompiledShaderSource>(compiler);
+            ::Assets::IntermediateAssets::Store store("int/unittest-precompile", "unittest", "stub");
+
+            ShaderVariationDomain domain;
+            domain.Add((const utf8*)"GEO_HAS_TEXCOORD", { "0", "1" });
+            domain.Add((const utf8*)"GEO_HAS_NORMAL", { "0", "1" });
+
+            ShaderPrecompiler precompiler(shaderSource, store);
+            precompiler.AddShaderType("game/xleres/techniques/illum.tech", domain);
+            auto requestCount = unsigned(precompiler.GetRequestCount());
+            Assert::IsTrue(requestCount > 0);
+
+                // (some shaders may already be in the archive from a previous run)
+            auto firstRun = precompiler.Execute();
+            Assert::AreEqual(0u, firstRun._failed);
+            Assert::AreEqual(requestCount, firstRun._compiled + firstRun._alreadyInArchive);
+            Assert::AreEqual(long(firstRun._compiled), long(Interlocked::Load(&compiler->_compileCount)));
+
+                // everything should be found in the archives now
+            auto secondRun = precompiler.Execute();
+            Assert::AreEqual(0u, secondRun._compiled);
+            Assert::AreEqual(requestCount, secondRun._alreadyInArchive);
+
+                // round trip through a request list
+            precompiler.SaveRequestList("int/unittest-precompile/requests.txt");
+            ShaderPrecompiler replay(shaderSource, store);
+            replay.LoadRequestList("int/unittest-precompile/requests.txt");
+            Assert::AreEqual(size_t(requestCount), replay.GetRequestCount());
+		}
+	};
+}
+
@@ -0,0 +1,330 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/CPUSkinning.h"
+#include "../RenderCore/Assets/ModelRunTime.h"
+#include "../RenderCore/Assets/ModelImmutableData.h"
+#include "../RenderCore/Assets/ModelScaffoldInternal.h"
+#include "../RenderCore/Assets/ModelRendererInternal.h"     // for WriteJointTransforms
+#include "../RenderCore/Assets/SkeletonScaffoldInternal.h"
+#include "../RenderCore/Assets/MeshDatabase.h"
+#include "../RenderCore/Assets/Services.h"
+#include "../RenderCore/Metal/Format.h"
+#include "../Assets/Assets.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/CompileAndAsyncManager.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../ConsoleRig/Log.h"
+#include "../Math/Transformations.h"
+#include "../Math/Vector.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <random>
+#include <thread>
+#include <intrin.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static void BuildRandomSkinnedVertices(
+        RenderCore::Assets::SkinnedVertexStreamsSoA& dst,
+        std::mt19937& rng, size_t vertexCount, unsigned jointCount)
+    {
+        dst.Resize(vertexCount, 4, true);
+        std::uniform_real_distribution<float> posDist(-10.f, 10.f);
+        std::uniform_int_distribution<unsigned> jointDist(0, jointCount-1);
+        for (size_t v=0; v<dst.GetPaddedVertexCount(); ++v) {
+            for (unsigned c=0; c<3; ++c) {
+                dst._positions[c][v] = posDist(rng);
+                dst._normals[c][v] = posDist(rng);
+            }
+            float weights[4], total = 0.f;
+            for (unsigned i=0; i<4; ++i) { weights[i] = std::uniform_real_distribution<float>(0.f, 1.f)(rng); total += weights[i]; }
+            for (unsigned i=0; i<4; ++i) {
+                dst._weights[i][v] = weights[i] / total;
+                dst._jointIndices[i][v] = uint16(jointDist(rng));
+            }
+        }
+    }
+
+    static const RenderCore::Assets::VertexElement* FindVertexElement(
+        const RenderCore::Assets::GeoInputAssembly& ia, const char semantic[])
+    {
+        for (const auto& e:ia._elements)
+            if (XlEqStringI(e._semanticName, semantic) && e._semanticIndex == 0)
+                return &e;
+        return nullptr;
+    }
+
+        //  Simple scalar skinning of a model mesh, straight from the scaffold data.
+        //  This is used as a reference for CPUSkinningMachine (which goes through the SoA
+        //  streams, the SIMD kernel and the thread pool)
+    static void ReferenceSkinning(
+        std::vector<Float3>& positions, std::vector<Float3>& normals,
+        const RenderCore::Assets::BoundSkinnedGeometry& geo, const void* largeBlocks,
+        const Float4x4 machineResult[], const RenderCore::Assets::SkeletonBinding& binding)
+    {
+        using namespace RenderCore::Assets;
+        std::vector<Float3x4> joints(geo._jointMatrixCount);
+        WriteJointTransforms(AsPointer(joints.begin()), joints.size(), geo, machineResult, binding);
+
+        const auto& animIA = geo._animatedVertexElements._ia;
+        const auto& bindIA = geo._skeletonBinding._ia;
+        auto vertexCount = std::min(
+            geo._animatedVertexElements._size / animIA._vertexStride,
+            geo._skeletonBinding._size / bindIA._vertexStride);
+        const void* animStart = PtrAdd(largeBlocks, geo._animatedVertexElements._offset);
+        const void* animEnd = PtrAdd(animStart, geo._animatedVertexElements._size);
+
+        GeoProc::MeshDatabase mesh;
+        const char* semantics[] = { "POSITION", "NORMAL" };
+        for (auto s:semantics) {
+            auto* ele = FindVertexElement(animIA, s);
+            if (!ele) continue;
+            mesh.AddStream(
+                GeoProc::CreateRawDataSource(
+                    PtrAdd(animStart, ele->_alignedByteOffset), animEnd,
+                    vertexCount, animIA._vertexStride,
+                    Metal::NativeFormat::Enum(ele->_nativeFormat)),
+                std::vector<unsigned>(), ele->_semanticName, ele->_semanticIndex);
+        }
+        auto posElement = mesh.FindElement("POSITION");
+        auto normalElement = mesh.FindElement("NORMAL");
+        Assert::IsTrue(posElement != ~0u, L"Skinned mesh in test model has no positions");
+
+            //  Vertices that aren't part of any preskinning draw call are passed through unchanged
+        positions.resize(vertexCount);
+        normals.resize((normalElement != ~0u) ? vertexCount : 0);
+        for (size_t v=0; v<vertexCount; ++v) {
+            positions[v] = mesh.GetUnifiedElement<Float3>(v, posElement);
+            if (normalElement != ~0u)
+                normals[v] = mesh.GetUnifiedElement<Float3>(v, normalElement);
+        }
+
+        auto* weightsEle = FindVertexElement(bindIA, "WEIGHTS");
+        auto* indicesEle = FindVertexElement(bindIA, "JOINTINDICES");
+        Assert::IsTrue(weightsEle && indicesEle, L"Skinned mesh in test model has no skeleton binding");
+        const void* bindStart = PtrAdd(largeBlocks, geo._skeletonBinding._offset);
+        for (unsigned d=0; d<geo._preskinningDrawCallCount; ++d) {
+            const auto& drawCall = geo._preskinningDrawCalls[d];
+            auto influenceCount = std::min(drawCall._subMaterialIndex, 4u);
+            if (!influenceCount) continue;
+
+            auto vEnd = std::min(size_t(drawCall._firstVertex + drawCall._indexCount), vertexCount);
+            for (size_t v=drawCall._firstVertex; v<vEnd; ++v) {
+                auto* weights = (const uint8*)PtrAdd(bindStart, v*bindIA._vertexStride + weightsEle->_alignedByteOffset);
+                auto* indices = (const uint8*)PtrAdd(bindStart, v*bindIA._vertexStride + indicesEle->_alignedByteOffset);
+                Float3 pos(0.f, 0.f, 0.f), normal(0.f, 0.f, 0.f);
+                for (unsigned i=0; i<influenceCount; ++i) {
+                    if (indices[i] >= geo._jointMatrixCount) continue;
+                    const auto& j = joints[indices[i]];
+                    auto w = float(weights[i]) / 255.f;
+                    const auto& p = positions[v];
+                    for (unsigned r=0; r<3; ++r)
+                        pos[r] += w * (j(r,0) * p[0] + j(r,1) * p[1] + j(r,2) * p[2] + j(r,3));
+                    if (!normals.empty()) {
+                        const auto& n = normals[v];
+                        for (unsigned r=0; r<3; ++r)
+                            normal[r] += w * (j(r,0) * n[0] + j(r,1) * n[1] + j(r,2) * n[2]);
+                    }
+                }
+                positions[v] = pos;
+                if (!normals.empty()) normals[v] = normal;
+            }
+        }
+    }
+
+    static const RenderCore::Assets::ModelScaffold& CompileModelScaffold(
+        ::Assets::CompileAndAsyncManager& asyncMan, const char filename[])
+    {
+        using RenderCore::Assets::ModelScaffold;
+        auto startTime = Millisecond_Now();
+        for (;;) {
+            TRY {
+                auto& scaffold = ::Assets::GetAssetComp<ModelScaffold>(filename);
+                scaffold.ImmutableData();       // (throws PendingAsset while compiling)
+                return scaffold;
+            } 
+            CATCH(const ::Assets::Exceptions::PendingAsset&) {}
+            CATCH_END
+
+            if ((Millisecond_Now() - startTime) > 30 * 1000)
+                Throw(::Exceptions::BasicLabel("Timeout while compiling model scaffold (%s)", filename));
+
+            Threading::YieldTimeSlice();
+            asyncMan.Update();
+        }
+    }
+
+    TEST_CLASS(Skinning)
+	{
+	public:
+		TEST_METHOD(SoASkinning)
+		{
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+            const unsigned jointCount = 64;
+            std::vector<Float3x4> joints;
+            for (unsigned c=0; c<jointCount; ++c) {
+                auto transform = AsFloat4x4(ArbitraryRotation(
+                    Normalize(Float3(
+                        std::uniform_real_distribution<float>(-1.f, 1.f)(rng),
+                        std::uniform_real_distribution<float>(-1.f, 1.f)(rng),
+                        std::uniform_real_distribution<float>(-1.f, 1.f)(rng) + 2.f)),
+                    std::uniform_real_distribution<float>(-3.f, 3.f)(rng)));
+                SetTranslation(transform, Float3(
+                    std::uniform_real_distribution<float>(-5.f, 5.f)(rng),
+                    std::uniform_real_distribution<float>(-5.f, 5.f)(rng),
+                    std::uniform_real_distribution<float>(-5.f, 5.f)(rng)));
+                joints.push_back(Truncate(transform));
+            }
+
+            JointPaletteSoA palette;
+            palette.Set(MakeIteratorRange(joints));
+            Assert::AreEqual(jointCount, palette.GetIdentityJoint());
+
+            SkinnedVertexStreamsSoA src;
+            BuildRandomSkinnedVertices(src, rng, 10001, jointCount);
+            Assert::AreEqual(size_t(10004), src.GetPaddedVertexCount());
+
+            auto paddedCount = src.GetPaddedVertexCount();
+            std::vector<float> positions[3], normals[3];
+            float* dstPositions[3], *dstNormals[3];
+            for (unsigned c=0; c<3; ++c) {
+                positions[c].resize(paddedCount); normals[c].resize(paddedCount);
+                dstPositions[c] = AsPointer(positions[c].begin());
+                dstNormals[c] = AsPointer(normals[c].begin());
+            }
+
+                // do the work in 2 parts, to check that ranges work as expected
+            SkinVerticesSoA(dstPositions, dstNormals, src, palette, 0, 4096);
+            SkinVerticesSoA(dstPositions, dstNormals, src, palette, 4096, paddedCount);
+
+                // compare against a simple scalar implementation
+            for (size_t v=0; v<src._vertexCount; ++v) {
+                Float3 inputPos(src._positions[0][v], src._positions[1][v], src._positions[2][v]);
+                Float3 inputNormal(src._normals[0][v], src._normals[1][v], src._normals[2][v]);
+                Float3 expectedPos(0.f, 0.f, 0.f), expectedNormal(0.f, 0.f, 0.f);
+                for (unsigned i=0; i<src._influenceCount; ++i) {
+                    const auto& j = joints[src._jointIndices[i][v]];
+                    auto w = src._weights[i][v];
+                    for (unsigned r=0; r<3; ++r) {
+                        expectedPos[r] += w * (j(r,0) * inputPos[0] + j(r,1) * inputPos[1] + j(r,2) * inputPos[2] + j(r,3));
+                        expectedNormal[r] += w * (j(r,0) * inputNormal[0] + j(r,1) * inputNormal[1] + j(r,2) * inputNormal[2]);
+                    }
+                }
+
+                Float3 pos(positions[0][v], positions[1][v], positions[2][v]);
+                Float3 normal(normals[0][v], normals[1][v], normals[2][v]);
+                Assert::IsTrue(Equivalent(pos, expectedPos, 1e-3f), L"SoA skinned position doesn't match reference");
+                Assert::IsTrue(Equivalent(normal, expectedNormal, 1e-3f), L"SoA skinned normal doesn't match reference");
+            }
+
+                // a quick performance measurement
+            const unsigned iterations = 100;
+            auto start = __rdtsc();
+            for (unsigned c=0; c<iterations; ++c)
+                SkinVerticesSoA(dstPositions, dstNormals, src, palette, 0, paddedCount);
+            auto end = __rdtsc();
+            LogAlwaysWarning << "SoA skinning: " << (end-start) / (uint64(iterations) * paddedCount) << " cycles per vertex (4 influences, with normals)";
+        }
+
+        TEST_METHOD(CPUSkinningModel)
+        {
+                //  Compile a skinned model, and skin it with CPUSkinningMachine.
+                //  Compare the result to a simple scalar implementation working directly
+                //  from the scaffold data. Then run the machine from several threads at
+                //  the same time (all sharing the short task thread pool), and make sure
+                //  we get exactly the same result every time.
+            using namespace RenderCore::Assets;
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto aservices = std::make_shared<::Assets::Services>(0);
+            auto raservices = std::make_shared<RenderCore::Assets::Services>(nullptr);
+            raservices->InitColladaCompilers();
+
+            const auto& scaffold = CompileModelScaffold(aservices->GetAsyncMan(), "game/model/character/skin.dae");
+            const auto& skeleton = scaffold.EmbeddedSkeleton();
+            SkeletonBinding binding(skeleton.GetOutputInterface(), scaffold.CommandStream().GetInputInterface());
+
+                //  Move the skeleton away from the bind pose, so the joint transforms
+                //  aren't trivial
+            std::mt19937 rng(0);
+            auto params = skeleton.GetDefaultParameters();
+            for (size_t c=0; c<params.GetFloat1ParametersCount(); ++c)
+                params.GetFloat1Parameters()[c] += std::uniform_real_distribution<float>(-15.f, 15.f)(rng);
+            for (size_t c=0; c<params.GetFloat3ParametersCount(); ++c)
+                params.GetFloat3Parameters()[c] += Float3(
+                    std::uniform_real_distribution<float>(-.1f, .1f)(rng),
+                    std::uniform_real_distribution<float>(-.1f, .1f)(rng),
+                    std::uniform_real_distribution<float>(-.1f, .1f)(rng));
+            std::vector<Float4x4> machineResult(skeleton.GetOutputMatrixCount());
+            skeleton.GenerateOutputTransforms(AsPointer(machineResult.begin()), unsigned(machineResult.size()), &params);
+
+            CPUSkinningMachine cpuSkinning(scaffold);
+            auto output = cpuSkinning.CreateOutput();
+            Assert::IsTrue(!output._meshes.empty(), L"No skinned meshes loaded by CPUSkinningMachine");
+            cpuSkinning.PrepareAnimation(output, AsPointer(machineResult.begin()), machineResult.size(), binding);
+
+            {
+                MemoryMappedFile file(scaffold.Filename().c_str(), 0ull, MemoryMappedFile::Access::Read);
+                Assert::IsTrue(file.IsValid(), L"Could not map model scaffold file");
+                const void* largeBlocks = PtrAdd(file.GetData(), scaffold.LargeBlocksOffset());
+                const auto& immData = scaffold.ImmutableData();
+
+                for (const auto& m:output._meshes) {
+                    std::vector<Float3> refPositions, refNormals;
+                    ReferenceSkinning(
+                        refPositions, refNormals, 
+                        immData._boundSkinnedControllers[m._geoId], largeBlocks,
+                        AsPointer(machineResult.begin()), binding);
+                    Assert::AreEqual(refPositions.size(), m._vertexCount);
+                    Assert::AreEqual(refNormals.empty(), m._normals[0].empty());
+
+                    for (size_t v=0; v<m._vertexCount; ++v) {
+                        auto tolerance = 1e-3f * std::max(1.f, Magnitude(refPositions[v]));
+                        Assert::IsTrue(Equivalent(m.GetPosition(v), refPositions[v], tolerance), L"CPU skinned position doesn't match reference");
+                        if (!refNormals.empty())
+                            Assert::IsTrue(Equivalent(m.GetNormal(v), refNormals[v], 1e-3f), L"CPU skinned normal doesn't match reference");
+                    }
+                }
+            }
+
+                //  Every chunk of vertices is written by exactly one task, and the kernel
+                //  doesn't depend on how the work is split, so threaded results must match
+                //  the first result exactly
+            const unsigned threadCount = 4, iterationCount = 8;
+            std::vector<CPUSkinningMachine::Output> threadOutputs;
+            for (unsigned c=0; c<threadCount; ++c) threadOutputs.push_back(cpuSkinning.CreateOutput());
+            std::vector<std::thread> threads;
+            for (unsigned c=0; c<threadCount; ++c)
+                threads.emplace_back(
+                    [&cpuSkinning, &machineResult, &binding, &threadOutputs, c]()
+                    {
+                        for (unsigned i=0; i<iterationCount; ++i)
+                            cpuSkinning.PrepareAnimation(threadOutputs[c], AsPointer(machineResult.begin()), machineResult.size(), binding);
+                    });
+            for (auto& t:threads) t.join();
+
+            for (const auto& o:threadOutputs)
+                for (size_t m=0; m<output._meshes.size(); ++m)
+                    for (unsigned c=0; c<3; ++c) {
+                        Assert::IsTrue(o._meshes[m]._positions[c] == output._meshes[m]._positions[c], L"Threaded CPU skinning result doesn't match");
+                        Assert::IsTrue(o._meshes[m]._normals[c] == output._meshes[m]._normals[c], L"Threaded CPU skinning result doesn't match");
+                    }
+        }
+    };
+}
@@ -11,8 +11,12 @@
 #include "../ConsoleRig/GlobalServices.h"
 #include "../Utility/Streams/StreamFormatter.h"
 #include "../Utility/Streams/StreamDOM.h"
+#include "../Utility/Streams/XmlStreamFormatter.h"
+#include "../Utility/FastParseValue.h"
 #include "../Utility/Conversion.h"
 #include <string>
+#include <random>
+#include <cmath>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -136,5 +140,78 @@ DiffuseDims={512u, 512u}v; NormalDims={512u, 512u}v; ParamDims={512u, 512u}v
             LogAlwaysWarning << "Old style serialization: " << (end-middle) / iterationCount << " cycles per iteration.";
         }
 
+        TEST_METHOD(XmlTokenizerLineTracking)
+        {
+                // Mix of new line styles, and long runs of whitespace and character data, so
+                // that the bulk scanning methods cross block boundaries in different places.
+            std::string xml = "<?xml version=\"1.0\"?>\r\n<root>\r\n";
+            for (unsigned c=0; c<50; ++c) {
+                xml += std::string(c, ' ') + "<e a=\"" + std::string(c, 'x') + "\">";
+                xml += std::string(c, 'z') + ((c&1) ? "\r" : "\n") + std::string(c%7, '\t') + "</e>";
+                xml += (c%3 == 0) ? "\r\n" : ((c%3 == 1) ? "\n" : "\r");
+            }
+            xml += "</root>\n";
+
+            MemoryMappedInputStream stream(AsPointer(xml.begin()), AsPointer(xml.end()));
+            XmlInputStreamFormatter<utf8> formatter(stream);
+            XmlInputStreamFormatter<utf8>::InteriorSection name, value, cdata;
+            Assert::IsTrue(formatter.TryBeginElement(name));
+
+            unsigned expectedLine = 3;
+            for (unsigned c=0; c<50; ++c) {
+                Assert::IsTrue(formatter.TryBeginElement(name));
+                Assert::AreEqual(expectedLine, formatter.GetLocation()._lineIndex);
+                Assert::IsTrue(formatter.TryAttribute(name, value));
+                Assert::AreEqual(ptrdiff_t(c), value._end - value._start);
+                Assert::IsTrue(formatter.TryCharacterData(cdata));
+                Assert::IsTrue(formatter.TryEndElement());
+                expectedLine += 2;
+                Assert::AreEqual(expectedLine-1, formatter.GetLocation()._lineIndex);
+            }
+
+            Assert::IsTrue(formatter.TryEndElement());
+            Assert::IsTrue(formatter.PeekNext() == XmlInputStreamFormatter<utf8>::Blob::None);
+        }
+
+        TEST_METHOD(FastParseValues)
+        {
+                // FastParseElement should give exactly the same result as strtof (including rounding)
+                // Also, 9 significant digits should be enough to round trip any float
+            std::mt19937 rng(0);
+            char buffer[64];
+            for (unsigned c=0; c<1000000; ++c) {
+                auto bits = uint32(rng());
+                float original = *(const float*)&bits;
+                if (!std::isfinite(original)) continue;
+
+                if (c & 1)  _snprintf_s(buffer, _TRUNCATE, "%.9g", original);
+                else        _snprintf_s(buffer, _TRUNCATE, "%.*g", 1 + (c%12), original);
+                auto len = XlStringLen(buffer);
+
+                float parsed = 0.f;
+                auto* parseEnd = FastParseElement(parsed, (const utf8*)buffer, (const utf8*)&buffer[len]);
+                char* strtofEnd = nullptr;
+                float expected = std::strtof(buffer, &strtofEnd);
+                Assert::IsTrue(parseEnd == (const utf8*)strtofEnd);
+                Assert::AreEqual(*(const uint32*)&expected, *(const uint32*)&parsed);
+                if (c & 1)
+                    Assert::AreEqual(bits, *(const uint32*)&parsed);
+            }
+
+            const char list[] = "  12345678901 4294967295 0 7\t\r\n18 999999999 12x 5";
+            uint32 values[16];
+            size_t parsedCount = 0;
+            auto* listEnd = FastParseList(values, dimof(values), (const utf8*)list, (const utf8*)&list[dimof(list)-1], parsedCount);
+            const uint32 expectedValues[] = { uint32(12345678901ull), 4294967295u, 0u, 7u, 18u, 999999999u, 12u };
+            Assert::AreEqual(dimof(expectedValues), parsedCount);
+            Assert::IsTrue(std::equal(expectedValues, &expectedValues[dimof(expectedValues)], values));
+            Assert::AreEqual(utf8('x'), *listEnd);
+
+            const char int64Str[] = "-9223372036854775807";
+            int64 int64Value = 0;
+            FastParseElement(int64Value, (const utf8*)int64Str, (const utf8*)&int64Str[dimof(int64Str)-1]);
+            Assert::AreEqual(-9223372036854775807ll, int64Value);
+        }
+
 	};
 }
\ No newline at end of file
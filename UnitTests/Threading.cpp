@@ -6,8 +6,18 @@
 
 #include "UnitTestHelper.h"
 #include "../Assets/AsyncLoadOperation.h"
-#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Assets/AssetSetInternal.h"
+#include "../Utility/Threading/TaskScheduler.h"
+#include "../Utility/Threading/LockFree.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../ConsoleRig/Log.h"
+#include "../Core/Exceptions.h"
 #include <CppUnitTest.h>
+#include <thread>
+#include <vector>
+#include <intrin.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
@@ -22,19 +32,61 @@ namespace UnitTests
         }
     };
 
+        //  Each producer pushes the values [1, itemsPerProducer], and the consumers
+        //  sum everything they pop. The sum tells us if anything was lost or duplicated
+    template<typename PushFn, typename PopFn>
+        static void QueueContentionBenchmark(
+            const char name[], unsigned producerCount, unsigned consumerCount,
+            unsigned itemsPerProducer, PushFn&& push, PopFn&& pop)
+    {
+        const unsigned totalItems = producerCount * itemsPerProducer;
+        Interlocked::Value poppedCount = 0;
+        std::vector<uint64> sums(consumerCount, 0);
+
+        auto start = __rdtsc();
+        std::vector<std::thread> threads;
+        for (unsigned p=0; p<producerCount; ++p)
+            threads.emplace_back(
+                [&push, itemsPerProducer]()
+                {
+                    for (unsigned i=1; i<=itemsPerProducer; ++i) push(i);
+                });
+        for (unsigned c=0; c<consumerCount; ++c)
+            threads.emplace_back(
+                [&pop, &sums, &poppedCount, totalItems, c]()
+                {
+                    uint64 sum = 0;
+                    unsigned value;
+                    while (unsigned(Interlocked::Load(&poppedCount)) < totalItems) {
+                        if (pop(value)) {
+                            sum += value;
+                            Interlocked::Increment(&poppedCount);
+                        }
+                    }
+                    sums[c] = sum;
+                });
+        for (auto& t:threads) t.join();
+        auto end = __rdtsc();
+
+        uint64 total = 0;
+        for (auto s:sums) total += s;
+        Assert::IsTrue(total == producerCount * (uint64(itemsPerProducer) * (itemsPerProducer+1) / 2), L"Queue lost or duplicated items");
+        LogAlwaysWarning << name << " (" << producerCount << " producers, " << consumerCount << " consumers): " << (end-start) / totalItems << " cycles per item";
+    }
+
     TEST_CLASS(Threading)
 	{
 	public:
-		TEST_METHOD(CompletionThreadPoolTest)
+		TEST_METHOD(TaskSchedulerTest)
 		{
             UnitTest_SetWorkingDirectory();
 
             {
-                CompletionThreadPool pool(4);
+                TaskScheduler pool(4);
             }
 
             {
-                CompletionThreadPool pool(4);
+                TaskScheduler pool(4);
                 volatile unsigned temp = 0;
                 for (unsigned c=0; c<128; ++c)
                     pool.Enqueue([&temp]() {++temp;});
@@ -42,7 +94,7 @@ namespace UnitTests
             }
 
             {
-                CompletionThreadPool pool(4);
+                TaskScheduler pool(4);
                 std::vector<std::shared_ptr<AsyncLoadTest>> tests;
                 for (unsigned c=0; c<128; ++c) {
                     auto t = std::make_shared<AsyncLoadTest>();
@@ -51,6 +103,168 @@ namespace UnitTests
                 }
             }
         }
+
+        TEST_METHOD(TaskGroupForkJoin)
+        {
+                //  Recursive fork/join. Tasks running on the worker threads create their own
+                //  groups and wait on them (which means they must execute other tasks while
+                //  waiting, otherwise this will deadlock with only 2 workers)
+            TaskScheduler pool(2);
+            struct Helper
+            {
+                static uint64 Sum(TaskScheduler& pool, uint64 begin, uint64 end)
+                {
+                    if ((end - begin) <= 1024) {
+                        uint64 result = 0;
+                        for (auto i=begin; i<end; ++i) result += i;
+                        return result;
+                    }
+
+                    auto middle = begin + (end - begin) / 2;
+                    uint64 left = 0, right = 0;
+                    TaskGroup group(pool);
+                    group.Run([&pool, &left, begin, middle]() { left = Sum(pool, begin, middle); });
+                    right = Sum(pool, middle, end);
+                    group.Wait();
+                    return left + right;
+                }
+            };
+
+            const uint64 count = 1024*1024;
+            uint64 result = 0;
+            TaskGroup outer(pool);
+            outer.Run([&pool, &result, count]() { result = Helper::Sum(pool, 0, count); });
+            outer.Wait();
+            Assert::IsTrue(result == count * (count-1) / 2, L"Incorrect result from recursive fork/join");
+
+                // exceptions thrown by a task should be rethrown from Wait()
+            bool gotException = false;
+            TaskGroup throwingGroup(pool);
+            for (unsigned c=0; c<16; ++c)
+                throwingGroup.Run([c]() { if (c == 7) Throw(::Exceptions::BasicLabel("Test exception")); });
+            TRY { throwingGroup.Wait(); } CATCH (...) { gotException = true; } CATCH_END
+            Assert::IsTrue(gotException, L"Exception from task group was not rethrown");
+        }
+
+        TEST_METHOD(TaskGroupFromExternalThread)
+        {
+                //  Fork/join from a thread that isn't part of the scheduler, while every
+                //  worker is busy with a long task. The waiting thread must be able to run
+                //  the group's tasks itself (otherwise they would be stuck until a worker
+                //  becomes free -- here, that would never happen)
+            TaskScheduler pool(2);
+            volatile bool releaseWorkers = false;
+            Interlocked::Value blockedWorkers = 0;
+            for (unsigned c=0; c<2; ++c)
+                pool.Enqueue(
+                    [&releaseWorkers, &blockedWorkers]()
+                    {
+                        Interlocked::Increment(&blockedWorkers);
+                        while (!releaseWorkers) Threading::YieldTimeSlice();
+                    });
+            while (Interlocked::Load(&blockedWorkers) < 2) Threading::YieldTimeSlice();
+
+            Interlocked::Value completed = 0;
+            {
+                TaskGroup group(pool);
+                for (unsigned c=0; c<64; ++c)
+                    group.Run([&completed]() { Interlocked::Increment(&completed); });
+                group.Wait();
+            }
+            Assert::AreEqual(64, int(Interlocked::Load(&completed)));
+
+            releaseWorkers = true;
+
+                // Once the workers are free, they must also pick up tasks that were
+                // submitted from outside
+            Interlocked::Value completedByWorkers = 0;
+            for (unsigned c=0; c<32; ++c)
+                pool.Enqueue([&completedByWorkers]() { Interlocked::Increment(&completedByWorkers); });
+            while (Interlocked::Load(&completedByWorkers) < 32) Threading::YieldTimeSlice();
+        }
+
+        TEST_METHOD(LockFreeQueueContention)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            const unsigned itemsPerProducer = 250000;
+
+            {
+                    // (baseline -- only a single consumer is allowed)
+                auto queue = std::make_unique<LockFree::FixedSizeQueue<unsigned, 1024>>();
+                QueueContentionBenchmark(
+                    "FixedSizeQueue", 4, 1, itemsPerProducer,
+                    [&queue](unsigned v) { queue->push_overflow(v); },
+                    [&queue](unsigned& v) 
+                    {
+                        unsigned* front;
+                        if (!queue->try_front(front)) return false;
+                        v = *front; queue->pop();
+                        return true;
+                    });
+            }
+
+            {
+                auto queue = std::make_unique<LockFree::MPSCQueue<unsigned>>();
+                QueueContentionBenchmark(
+                    "MPSCQueue", 4, 1, itemsPerProducer,
+                    [&queue](unsigned v) { queue->push(v); },
+                    [&queue](unsigned& v) { return queue->try_pop(v); });
+            }
+
+            for (unsigned threadCount=1; threadCount<=4; threadCount*=2) {
+                auto queue = std::make_unique<LockFree::BoundedQueue<unsigned, 1024>>();
+                QueueContentionBenchmark(
+                    "BoundedQueue", threadCount, threadCount, itemsPerProducer,
+                    [&queue](unsigned v) { while (!queue->push(v)) Threading::Pause(); },
+                    [&queue](unsigned& v) { return queue->try_pop(v); });
+            }
+
+            {
+                auto queue = std::make_unique<LockFree::SPSCQueue<unsigned, 1024>>();
+                QueueContentionBenchmark(
+                    "SPSCQueue", 1, 1, itemsPerProducer,
+                    [&queue](unsigned v) { while (!queue->push(v)) Threading::Pause(); },
+                    [&queue](unsigned& v) { return queue->try_pop(v); });
+            }
+        }
+
+        TEST_METHOD(AssetTableConcurrentLookup)
+        {
+                // Readers search the table while a single writer inserts (and causes 
+                // the shards to grow). Every value a reader finds must be the correct one
+            ::Assets::Internal::AssetTable<uint64> table;
+            const unsigned count = 100000;
+            auto keyForIndex = [](unsigned index) { return (uint64(index) * 0x9E3779B97F4A7C15ull) ^ (uint64(index) << 17); };
+
+            volatile unsigned insertedCount = 0;
+            volatile bool errorFound = false;
+            std::vector<std::thread> readers;
+            for (unsigned t=0; t<4; ++t)
+                readers.emplace_back(
+                    [&table, &insertedCount, &errorFound, keyForIndex, count, t]()
+                    {
+                        unsigned i = t;
+                        while (insertedCount < count) {
+                            auto limit = insertedCount;
+                            if (!limit) continue;
+                            auto index = (i++ * 7919u) % limit;
+                            auto* v = table.Find(keyForIndex(index));
+                            if (!v || *v != keyForIndex(index)) errorFound = true;
+                        }
+                    });
+
+            for (unsigned c=0; c<count; ++c) {
+                table.Insert(keyForIndex(c), std::make_unique<uint64>(keyForIndex(c)));
+                insertedCount = c+1;
+            }
+            for (auto& r:readers) r.join();
+
+            Assert::IsFalse(errorFound, L"Lock free lookup returned an incorrect result during inserts");
+            Assert::AreEqual(size_t(count), table.size());
+            Assert::IsTrue(table.Find(keyForIndex(count)) == nullptr);
+            Assert::IsTrue(table.Find(0) != nullptr);     // (keyForIndex(0) is zero, which is stored separately)
+        }
     };
 }
 
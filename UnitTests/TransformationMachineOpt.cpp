@@ -6,6 +6,9 @@
 
 #include "UnitTestHelper.h"
 #include "../RenderCore/Assets/TransformationCommands.h"
+#include "../RenderCore/Assets/NascentTransformationMachine.h"
+#include "../RenderCore/Assets/SkeletonScaffoldInternal.h"
+#include "../Assets/BlockSerializer.h"
 #include "../Math/Geometry.h"
 #include "../ConsoleRig/Log.h"
 #include <CppUnitTest.h>
@@ -153,6 +156,82 @@ namespace UnitTests
         return true;
     }
 
+    static bool NearEquivalent(const Float4x4& lhs, const Float4x4& rhs, float threshold)
+    {
+            // like RelativeEquivalent, but elements near zero are compared absolutely
+        for (unsigned j=0;j<4;++j)
+            for (unsigned i=0;i<4;++i) {
+                auto diff = XlAbs(lhs(i, j) - rhs(i, j));
+                if (diff > threshold * std::max(1.f, std::max(XlAbs(lhs(i, j)), XlAbs(rhs(i, j)))))
+                    return false;
+            }
+        return true;
+    }
+
+    static std::vector<uint32> BuildParameterizedMachine(std::mt19937& rng, unsigned outputCount)
+    {
+            // Build a machine that uses every parameter command type, with a few
+            // static transforms and push/pops mixed in. Parameter "c" of each type
+            // is used by output "c"
+        using namespace RenderCore::Assets;
+        std::vector<uint32> machine;
+        for (unsigned c=0; c<outputCount; ++c) {
+            machine.push_back((uint32)TransformStackCommand::PushLocalToWorld);
+            InsertRandomTransforms(machine, rng, 2, false);
+
+            const uint32 paramCmds[] = {
+                (uint32)TransformStackCommand::TransformFloat4x4_Parameter,
+                (uint32)TransformStackCommand::Translate_Parameter,
+                (uint32)TransformStackCommand::RotateX_Parameter,
+                (uint32)TransformStackCommand::RotateY_Parameter,
+                (uint32)TransformStackCommand::RotateZ_Parameter,
+                (uint32)TransformStackCommand::Rotate_Parameter,
+                (uint32)TransformStackCommand::UniformScale_Parameter,
+                (uint32)TransformStackCommand::ArbitraryScale_Parameter
+            };
+            for (auto cmd:paramCmds) {
+                machine.push_back(cmd);
+                machine.push_back(c);
+            }
+
+            if (c & 1) {
+                machine.push_back((uint32)TransformStackCommand::TransformFloat4x4AndWrite_Parameter);
+                machine.push_back(c);
+                machine.push_back(c);
+            } else {
+                machine.push_back((uint32)TransformStackCommand::WriteOutputMatrix);
+                machine.push_back(c);
+            }
+
+                // static transforms after a write must not change the output already written
+            InsertRandomTransforms(machine, rng, 1, false);
+            if (c & 2) {
+                machine.push_back((uint32)TransformStackCommand::PopLocalToWorld);
+                machine.push_back(1);
+            }
+        }
+        return machine;
+    }
+
+    static std::vector<RenderCore::Assets::TransformationParameterSet> BuildRandomParameterSets(
+        std::mt19937& rng, unsigned setCount, unsigned parametersPerType)
+    {
+        using namespace RenderCore::Assets;
+        std::vector<TransformationParameterSet> paramSets(setCount);
+        for (auto& p:paramSets) {
+            for (unsigned c=0; c<parametersPerType; ++c) {
+                p.GetFloat4x4ParametersVector().push_back(RandomComplexTransform(rng));
+                p.GetFloat3ParametersVector().push_back(RandomTranslationVector(rng));
+                p.GetFloat4ParametersVector().push_back(Float4(RandomUnitVector(rng), (float)std::uniform_real_distribution<>(-180.f, 180.f)(rng)));
+
+                    // the same float1 parameter is used for rotations & uniform scale, so keep it away from zero
+                auto f = (float)std::uniform_real_distribution<>(1.f, 180.f)(rng);
+                p.GetFloat1ParametersVector().push_back(RandomSign(rng) * f);
+            }
+        }
+        return paramSets;
+    }
+
     TEST_CLASS(TransformationMachineOpt)
 	{
 	public:
@@ -215,5 +294,196 @@ namespace UnitTests
                 }
             }
         }
+
+        TEST_METHOD(BatchEvaluation)
+        {
+            using namespace RenderCore::Assets;
+
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+
+                // Evaluate a machine with many different parameter sets, and compare 
+                // the batched result against the scalar interpreter.
+            const unsigned outputCount = 16;
+            auto machine = BuildParameterizedMachine(rng, outputCount);
+
+            const unsigned instanceCount = 37;     // (deliberately not a multiple of the SIMD width)
+            auto paramSets = BuildRandomParameterSets(rng, instanceCount, outputCount);
+
+            std::vector<const TransformationParameterSet*> paramSetPtrs;
+            for (const auto& p:paramSets) paramSetPtrs.push_back(&p);
+
+            std::vector<Float4x4> batchResults(instanceCount * outputCount);
+            GenerateOutputTransformsBatch(
+                AsPointer(batchResults.begin()), outputCount, 
+                MakeIteratorRange(paramSetPtrs), MakeIteratorRange(machine));
+
+            for (unsigned i=0; i<instanceCount; ++i) {
+                Float4x4 scalarResults[outputCount];
+                GenerateOutputTransformsFree(scalarResults, outputCount, &paramSets[i], MakeIteratorRange(machine));
+                for (unsigned c=0; c<outputCount; ++c)
+                    Assert::IsTrue(
+                        NearEquivalent(scalarResults[c], batchResults[i*outputCount+c], 1e-3f), 
+                        L"Batched transformation machine result doesn't match scalar result");
+            }
+        }
+
+        TEST_METHOD(FlattenedMachine)
+        {
+            using namespace RenderCore::Assets;
+
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+
+                // Compile machines into the flattened form, and compare the result
+                // against the interpreter. We'll try both the unoptimized and optimized
+                // streams (since the optimizer produces the more specialized commands)
+            for (unsigned t=0; t<100; ++t) {
+                const unsigned outputCount = 16;
+                auto machine = BuildParameterizedMachine(rng, outputCount);
+                Optimizer opt;
+                auto optimized = OptimizeTransformationMachine(MakeIteratorRange(machine), opt);
+                auto paramSets = BuildRandomParameterSets(rng, 4, outputCount);
+
+                const std::vector<uint32>* streams[] = { &machine, &optimized };
+                for (auto s:streams) {
+                    auto program = CompileTransformationMachine(MakeIteratorRange(*s), outputCount);
+                    std::vector<Float4x4> workingSpace(program.GetNodeCount());
+
+                    for (const auto& p:paramSets) {
+                        Float4x4 interpreted[outputCount], flattened[outputCount];
+                        GenerateOutputTransformsFree(interpreted, outputCount, &p, MakeIteratorRange(*s));
+                        program.GenerateOutputTransforms(flattened, outputCount, &p, MakeIteratorRange(workingSpace));
+                        for (unsigned c=0; c<outputCount; ++c)
+                            Assert::IsTrue(
+                                NearEquivalent(interpreted[c], flattened[c], 1e-3f), 
+                                L"Flattened transformation machine result doesn't match interpreter");
+                    }
+                }
+            }
+
+                // With no parameter set (or an empty or truncated one), parameter indices are bad. The
+                // interpreter skips those commands (and TransformFloat4x4AndWrite_Parameter
+                // skips the write entirely). The program must give the same result for
+                // every output.
+            for (unsigned t=0; t<10; ++t) {
+                const unsigned outputCount = 8;
+                auto machine = BuildParameterizedMachine(rng, outputCount);
+                Optimizer opt;
+                auto optimized = OptimizeTransformationMachine(MakeIteratorRange(machine), opt);
+                TransformationParameterSet emptySet;
+                auto partialSet = BuildRandomParameterSets(rng, 1, outputCount)[0];
+                partialSet.GetFloat4x4ParametersVector().resize(outputCount/2);     // (later outputs get bad indices)
+                const TransformationParameterSet* sets[] = { nullptr, &emptySet, &partialSet };
+
+                const std::vector<uint32>* streams[] = { &machine, &optimized };
+                for (auto s:streams) {
+                    auto program = CompileTransformationMachine(MakeIteratorRange(*s), outputCount);
+                    std::vector<Float4x4> workingSpace(program.GetNodeCount());
+                    for (auto p:sets) {
+                        Float4x4 interpreted[outputCount], flattened[outputCount];
+                        GenerateOutputTransformsFree(interpreted, outputCount, p, MakeIteratorRange(*s));
+                        program.GenerateOutputTransforms(flattened, outputCount, p, MakeIteratorRange(workingSpace));
+                        for (unsigned c=0; c<outputCount; ++c)
+                            Assert::IsTrue(NearEquivalent(interpreted[c], flattened[c], 1e-3f), L"Flattened transformation machine doesn't match with bad parameters");
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(RelativeSkeletonBlock)
+        {
+            using namespace RenderCore::Assets;
+
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            std::mt19937 rng(0);
+
+                // Build a machine with default parameters and joints, and write it in
+                // both block formats. The machine bound to the relative block must behave
+                // exactly like the one initialized from the absolute block
+            const unsigned outputCount = 16;
+            auto stream = BuildParameterizedMachine(rng, outputCount);
+            auto defaults = BuildRandomParameterSets(rng, 1, outputCount)[0];
+
+            NascentTransformationMachine nascent;
+            nascent.MakeOutputMatrixMarker(outputCount-1);     // (just sets the output count; the stream writes this output again)
+            nascent.PushCommand(AsPointer(stream.begin()), stream.size() * sizeof(uint32));
+            for (unsigned c=0; c<outputCount; ++c) {
+                auto nodeName = std::string("node") + std::to_string(c);
+                nascent.AddParameter(defaults.GetFloat4x4Parameters()[c], c*4+0, nodeName.c_str());
+                nascent.AddParameter(defaults.GetFloat4Parameters()[c], c*4+1, nodeName.c_str());
+                nascent.AddParameter(defaults.GetFloat3Parameters()[c], c*4+2, nodeName.c_str());
+                nascent.AddParameter(defaults.GetFloat1Parameters()[c], c*4+3, nodeName.c_str());
+                nascent.RegisterJointName(std::string("joint") + std::to_string(c), RandomComplexTransform(rng), c);
+            }
+
+            Serialization::NascentBlockSerializer absoluteSerializer(Serialization::BlockFormat::Absolute);
+            Serialization::NascentBlockSerializer relativeSerializer(Serialization::BlockFormat::Relative);
+            nascent.Serialize(absoluteSerializer);
+            nascent.Serialize(relativeSerializer);
+
+            auto absoluteBlock = absoluteSerializer.AsMemoryBlock();
+            Serialization::Block_Initialize(absoluteBlock.get());
+            const auto& absoluteMachine = *(const TransformationMachine*)Serialization::Block_GetFirstObject(absoluteBlock.get());
+
+                // (move the relative block before binding, to be sure nothing depends on its original address)
+            auto relativeBlock = Serialization::Block_Duplicate(relativeSerializer.AsMemoryBlock().get());
+            Assert::IsTrue(Serialization::Block_IsPositionIndependent(relativeBlock.get()));
+            TransformationMachine relativeMachine(
+                *(const TransformationMachine::RelativeImage*)Serialization::Block_GetFirstObject(relativeBlock.get()));
+
+            Assert::AreEqual(absoluteMachine.GetOutputMatrixCount(), relativeMachine.GetOutputMatrixCount());
+            Assert::AreEqual(outputCount, relativeMachine.GetOutputMatrixCount());
+
+            const auto& absIn = absoluteMachine.GetInputInterface();
+            const auto& relIn = relativeMachine.GetInputInterface();
+            Assert::AreEqual(absIn._parameterCount, relIn._parameterCount);
+            Assert::AreEqual(size_t(outputCount*4), relIn._parameterCount);
+            for (size_t c=0; c<relIn._parameterCount; ++c) {
+                Assert::IsTrue(absIn._parameters[c]._name == relIn._parameters[c]._name);
+                Assert::AreEqual(absIn._parameters[c]._index, relIn._parameters[c]._index);
+                Assert::IsTrue(absIn._parameters[c]._type == relIn._parameters[c]._type);
+            }
+
+            const auto& absOut = absoluteMachine.GetOutputInterface();
+            const auto& relOut = relativeMachine.GetOutputInterface();
+            Assert::AreEqual(absOut._outputMatrixNameCount, relOut._outputMatrixNameCount);
+            for (size_t c=0; c<relOut._outputMatrixNameCount; ++c) {
+                Assert::IsTrue(absOut._outputMatrixNames[c] == relOut._outputMatrixNames[c]);
+                Assert::IsTrue(Equivalent(absOut._skeletonInverseBindMatrices[c], relOut._skeletonInverseBindMatrices[c], 1e-6f));
+            }
+
+            const auto& relDefaults = relativeMachine.GetDefaultParameters();
+            Assert::AreEqual(size_t(outputCount), relDefaults.GetFloat4x4ParametersCount());
+            Assert::AreEqual(size_t(outputCount), relDefaults.GetFloat4ParametersCount());
+            Assert::AreEqual(size_t(outputCount), relDefaults.GetFloat3ParametersCount());
+            Assert::AreEqual(size_t(outputCount), relDefaults.GetFloat1ParametersCount());
+
+                // Both the precompiled program and the interpreter (via the debug iterator
+                // overload) must agree with the nascent machine
+            auto expected = nascent.GenerateOutputTransforms(defaults);
+            auto paramSets = BuildRandomParameterSets(rng, 4, outputCount);
+            const TransformationParameterSet* sets[] = { &relDefaults, &paramSets[0], &paramSets[1], &paramSets[2], &paramSets[3] };
+            for (auto p:sets) {
+                Float4x4 absResult[outputCount], relResult[outputCount], relInterpreted[outputCount];
+                absoluteMachine.GenerateOutputTransforms(absResult, outputCount, p);
+                relativeMachine.GenerateOutputTransforms(relResult, outputCount, p);
+                relativeMachine.GenerateOutputTransforms(relInterpreted, outputCount, p, [](const Float4x4&, const Float4x4&) {});
+                for (unsigned c=0; c<outputCount; ++c) {
+                    Assert::IsTrue(Equivalent(absResult[c], relResult[c], 1e-6f), L"Relative skeleton block doesn't match absolute block");
+                    Assert::IsTrue(NearEquivalent(relResult[c], relInterpreted[c], 1e-3f), L"Relative skeleton program doesn't match its command stream");
+                    if (p == &relDefaults)
+                        Assert::IsTrue(NearEquivalent(expected[c], relResult[c], 1e-3f), L"Relative skeleton block doesn't match nascent machine");
+                }
+            }
+
+            absoluteMachine.~TransformationMachine();
+        }
     };
 }
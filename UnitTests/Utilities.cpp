@@ -6,6 +6,7 @@
 
 #include "UnitTestHelper.h"
 #include "../Utility/ParameterBox.h"
+#include "../Utility/FlatParameterBox.h"
 #include "../Utility/SystemUtils.h"
 #include "../Utility/StringFormat.h"
 #include "../Utility/Streams/Stream.h"
@@ -14,8 +15,12 @@
 #include "../Utility/FunctionUtils.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Math/Vector.h"
+#include "../Assets/BlockSerializer.h"
+#include "../Utility/Streams/Serialization.h"
+#include "../ConsoleRig/Log.h"
 #include <CppUnitTest.h>
 #include <stdexcept>
+#include <intrin.h>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -36,6 +41,129 @@ namespace UnitTests
     bool ThrowOnDestructor::s_expectingDestroy = false;
     unsigned ThrowOnDestructor::s_destroyCount = 0;
 
+    class BlockTestChild
+    {
+    public:
+        std::string         _name;
+        std::vector<float>  _weights;
+
+        void Serialize(Serialization::NascentBlockSerializer& serializer) const
+        {
+            ::Serialize(serializer, _name);
+            ::Serialize(serializer, _weights);
+        }
+    };
+
+    class BlockTestRoot
+    {
+    public:
+        uint32                      _id;
+        std::vector<uint32>         _values;
+        std::string                 _name;
+        std::vector<BlockTestChild> _children;
+
+        void Serialize(Serialization::NascentBlockSerializer& serializer) const
+        {
+            ::Serialize(serializer, _id);
+            ::Serialize(serializer, _values);
+            ::Serialize(serializer, _name);
+            ::Serialize(serializer, _children);
+        }
+    };
+
+        // runtime side of the above, as read from a BlockFormat::Absolute block (after Block_Initialize)
+    #pragma pack(push)
+    #pragma pack(1)
+        class AbsoluteBlockTestChild
+        {
+        public:
+            std::string                     _name;
+            SerializableVector<float>       _weights;
+        };
+
+        class AbsoluteBlockTestRoot
+        {
+        public:
+            uint32                                      _id;
+            SerializableVector<uint32>                  _values;
+            std::string                                 _name;
+            SerializableVector<AbsoluteBlockTestChild>  _children;
+        };
+    #pragma pack(pop)
+
+        // runtime side of the above, as read from a BlockFormat::Relative block
+    #pragma pack(push)
+    #pragma pack(1)
+        class RelativeBlockTestChild
+        {
+        public:
+            Serialization::RelativeString           _name;
+            Serialization::RelativeArray<float>     _weights;
+        };
+
+        class RelativeBlockTestRoot
+        {
+        public:
+            uint32                                              _id;
+            Serialization::RelativeArray<uint32>                _values;
+            Serialization::RelativeString                       _name;
+            Serialization::RelativeArray<RelativeBlockTestChild> _children;
+        };
+    #pragma pack(pop)
+
+    static bool IsWithinBlock(const void* begin, const void* end, const void* block)
+    {
+        return begin <= end
+            && (const uint8*)begin >= (const uint8*)block
+            && (const uint8*)end <= (const uint8*)block + Serialization::Block_GetSize(block);
+    }
+
+    template<typename Type, typename Allocator>
+        static bool IsWithinBlock(const std::vector<Type, Allocator>& v, const void* block)
+        {
+            return IsWithinBlock(AsPointer(v.cbegin()), AsPointer(v.cend()), block);
+        }
+
+    template<typename Type>
+        static bool IsWithinBlock(const Serialization::RelativeArray<Type>& v, const void* block)
+        {
+            return IsWithinBlock(v.begin(), v.end(), block);
+        }
+
+    static void CompareBlockTestRoots(
+        const AbsoluteBlockTestRoot& absolute, const void* absoluteBlock,
+        const RelativeBlockTestRoot& relative, const void* relativeBlock)
+    {
+            //  Every field of the relative view must match the initialized absolute block.
+            //  And every array must resolve to memory within its own block. (Strings in the
+            //  absolute block are copied out by Block_Initialize, so only their contents are
+            //  compared)
+        Assert::AreEqual(absolute._id, relative._id);
+
+        Assert::IsTrue(IsWithinBlock(absolute._values, absoluteBlock));
+        Assert::IsTrue(IsWithinBlock(relative._values, relativeBlock), L"Relative array resolves outside of its block");
+        Assert::AreEqual(absolute._values.size(), relative._values.size());
+        Assert::IsTrue(std::equal(absolute._values.cbegin(), absolute._values.cend(), relative._values.begin()));
+
+        Assert::IsTrue(IsWithinBlock(relative._name, relativeBlock), L"Relative string resolves outside of its block");
+        Assert::AreEqual(absolute._name, std::string(relative._name.begin(), relative._name.end()));
+
+        Assert::IsTrue(IsWithinBlock(absolute._children, absoluteBlock));
+        Assert::IsTrue(IsWithinBlock(relative._children, relativeBlock), L"Relative array resolves outside of its block");
+        Assert::AreEqual(absolute._children.size(), relative._children.size());
+        for (size_t c=0; c<absolute._children.size(); ++c) {
+            const auto& a = absolute._children[c];
+            const auto& r = relative._children[c];
+            Assert::IsTrue(IsWithinBlock(r._name, relativeBlock), L"Relative string resolves outside of its block");
+            Assert::AreEqual(a._name, std::string(r._name.begin(), r._name.end()));
+
+            Assert::IsTrue(IsWithinBlock(a._weights, absoluteBlock));
+            Assert::IsTrue(IsWithinBlock(r._weights, relativeBlock), L"Relative array resolves outside of its block");
+            Assert::AreEqual(a._weights.size(), r._weights.size());
+            Assert::IsTrue(std::equal(a._weights.cbegin(), a._weights.cend(), r._weights.begin()));
+        }
+    }
+
     TEST_CLASS(Utilities)
     {
     public:
@@ -75,6 +203,122 @@ namespace UnitTests
 
         }
 
+        TEST_METHOD(FlatParameterBoxTest)
+        {
+            ParameterBox classic(
+                {
+                    std::make_pair((const utf8*)"SomeParam", "1u"),
+                    std::make_pair((const utf8*)"SomeParam1", ".4f"),
+                    std::make_pair((const utf8*)"VectorParam", "{4.5f, 7.5f, 9.5f}v"),
+                    std::make_pair((const utf8*)"StringParam", "SomeString")
+                });
+            FlatParameterBox flat(classic);
+            Assert::AreEqual(classic.GetCount(), flat.GetCount());
+            Assert::AreEqual(flat.GetParameter<unsigned>((const utf8*)"SomeParam").second, 1u);
+            Assert::AreEqual(flat.GetParameter<float>((const utf8*)"SomeParam1").second, .4f);
+            Assert::IsTrue(flat.GetParameterType((const utf8*)"StringParam")._typeHint == ImpliedTyping::TypeHint::String);
+            Assert::IsFalse(flat.HasParameter((const utf8*)"NotAParam"));
+
+                // changing the size of a value, and changing back, should restore the hash
+            auto initialHash = flat.GetHash();
+            flat.SetParameter((const utf8*)"SomeParam", Float4(1.f, 2.f, 3.f, 4.f));
+            Assert::AreNotEqual(initialHash, flat.GetHash());
+            flat.SetParameter((const utf8*)"SomeParam", 1u);
+            Assert::AreEqual(initialHash, flat.GetHash());
+
+                // grow past the inline storage
+            for (unsigned c=0; c<64; ++c)
+                flat.SetParameter((const utf8*)(StringMeld<32>() << "Extra" << c).get(), c);
+            Assert::AreEqual(size_t(68), flat.GetCount());
+            Assert::AreEqual(flat.GetParameter<unsigned>((const utf8*)"Extra37").second, 37u);
+
+                // the filtered hash should match the hash we get after merging
+            FlatParameterBox overrides;
+            overrides.SetParameter((const utf8*)"SomeParam", 5u);
+            overrides.SetParameter((const utf8*)"Extra12", 8u);
+            overrides.SetParameter((const utf8*)"NotInFlat", 3u);
+            auto filteredHash = flat.CalculateFilteredHashValue(overrides);
+
+            auto merged = flat;
+            merged.MergeIn(overrides);
+            Assert::AreEqual(size_t(69), merged.GetCount());
+            Assert::AreEqual(merged.GetParameter<unsigned>((const utf8*)"Extra12").second, 8u);
+            Assert::IsFalse(merged.AreParameterNamesEqual(flat));
+
+            FlatParameterBox mergedAndFiltered = flat;
+            mergedAndFiltered.SetParameter((const utf8*)"SomeParam", 5u);
+            mergedAndFiltered.SetParameter((const utf8*)"Extra12", 8u);
+            Assert::AreEqual(filteredHash, mergedAndFiltered.GetHash());
+            Assert::IsTrue(mergedAndFiltered.AreParameterNamesEqual(flat));
+        }
+
+        TEST_METHOD(ParameterBoxPerformance)
+        {
+                //  Typical pattern while resolving techniques -- build a few small
+                //  boxes, merge them together, calculate the filtered hash against
+                //  a technique's parameters and look up some values.
+            const unsigned iterations = 10000;
+            const utf8* names[] = {
+                (const utf8*)"GEO_HAS_TEXCOORD", (const utf8*)"GEO_HAS_NORMAL", (const utf8*)"GEO_HAS_TANGENT_FRAME",
+                (const utf8*)"GEO_HAS_COLOUR", (const utf8*)"GEO_HAS_SKIN_WEIGHTS", (const utf8*)"RES_HAS_DiffuseTexture",
+                (const utf8*)"RES_HAS_NormalsTexture", (const utf8*)"RES_HAS_ParametersTexture", (const utf8*)"MAT_ALPHA_TEST",
+                (const utf8*)"MAT_DOUBLE_SIDED_LIGHTING", (const utf8*)"SKIP_MATERIAL_DIFFUSE", (const utf8*)"OUTPUT_TEXCOORD" };
+            const unsigned nameCount = dimof(names);
+            ParameterBox::ParameterNameHash hashes[nameCount];
+            for (unsigned c=0; c<nameCount; ++c) hashes[c] = ParameterBox::MakeParameterNameHash(names[c]);
+
+            uint64 setCycles[2] = {0,0}, mergeCycles[2] = {0,0}, filterCycles[2] = {0,0}, lookupCycles[2] = {0,0};
+            unsigned sum[2] = {0,0};
+
+            {
+                ParameterBox filter;
+                for (unsigned c=0; c<nameCount; ++c) filter.SetParameter(names[c], 0u);
+
+                for (unsigned i=0; i<iterations; ++i) {
+                    auto t0 = __rdtsc();
+                    ParameterBox geo, material;
+                    for (unsigned c=0; c<nameCount/2; ++c) geo.SetParameter(names[c], (i+c)&1);
+                    for (unsigned c=nameCount/2; c<nameCount; ++c) material.SetParameter(names[c], (i+c)&1);
+                    auto t1 = __rdtsc();
+                    geo.MergeIn(material);
+                    auto t2 = __rdtsc();
+                    sum[0] += unsigned(filter.CalculateFilteredHashValue(geo) + geo.GetHash());
+                    auto t3 = __rdtsc();
+                    for (unsigned c=0; c<nameCount; ++c) sum[0] += geo.GetParameter<unsigned>(hashes[c]).second;
+                    auto t4 = __rdtsc();
+                    setCycles[0] += t1-t0; mergeCycles[0] += t2-t1; filterCycles[0] += t3-t2; lookupCycles[0] += t4-t3;
+                }
+            }
+
+            {
+                FlatParameterBox filter;
+                for (unsigned c=0; c<nameCount; ++c) filter.SetParameter(names[c], 0u);
+
+                for (unsigned i=0; i<iterations; ++i) {
+                    auto t0 = __rdtsc();
+                    FlatParameterBox geo, material;
+                    for (unsigned c=0; c<nameCount/2; ++c) geo.SetParameter(names[c], (i+c)&1);
+                    for (unsigned c=nameCount/2; c<nameCount; ++c) material.SetParameter(names[c], (i+c)&1);
+                    auto t1 = __rdtsc();
+                    geo.MergeIn(material);
+                    auto t2 = __rdtsc();
+                    sum[1] += unsigned(filter.CalculateFilteredHashValue(geo) + geo.GetHash());
+                    auto t3 = __rdtsc();
+                    for (unsigned c=0; c<nameCount; ++c) sum[1] += geo.GetParameter<unsigned>(hashes[c]).second;
+                    auto t4 = __rdtsc();
+                    setCycles[1] += t1-t0; mergeCycles[1] += t2-t1; filterCycles[1] += t3-t2; lookupCycles[1] += t4-t3;
+                }
+            }
+
+            const char* labels[] = { "ParameterBox", "FlatParameterBox" };
+            for (unsigned c=0; c<2; ++c) {
+                LogAlwaysWarning << labels[c] << ": set " << setCycles[c] / iterations
+                    << ", merge " << mergeCycles[c] / iterations
+                    << ", filtered hash " << filterCycles[c] / iterations
+                    << ", lookup " << lookupCycles[c] / iterations << " cycles per iteration (" << sum[c] << ")";
+            }
+        }
+
         TEST_METHOD(ImpliedTypingTest)
         {
             UnitTest_SetWorkingDirectory();
@@ -258,6 +502,65 @@ namespace UnitTests
                 ConstHash64<'1234', '5678', '90qw', 'erty'>::Value,
                 ConstHash64FromString(s1.begin(), s1.end()));
         }
+
+        TEST_METHOD(RelativeBlockSerializerTest)
+        {
+            using namespace Serialization;
+
+            BlockTestRoot root;
+            root._id = 0x1234;
+            root._values = std::vector<uint32>{ 1, 2, 3, 5, 8, 13 };
+            root._name = "root object";
+            for (unsigned c=0; c<3; ++c) {
+                BlockTestChild child;
+                child._name = std::string("child") + char('0' + c);
+                child._weights = std::vector<float>(c+1, float(c));
+                root._children.push_back(child);
+            }
+
+            NascentBlockSerializer absoluteSerializer(BlockFormat::Absolute);
+            NascentBlockSerializer relativeSerializer(BlockFormat::Relative);
+            Serialize(absoluteSerializer, root);
+            Serialize(relativeSerializer, root);
+
+            auto absoluteBlock = absoluteSerializer.AsMemoryBlock();
+            auto relativeBlock = relativeSerializer.AsMemoryBlock();
+            Assert::IsFalse(Block_IsPositionIndependent(absoluteBlock.get()));
+            Assert::IsTrue(Block_IsPositionIndependent(relativeBlock.get()));
+            Assert::AreEqual(relativeSerializer.Size(), Block_GetSize(relativeBlock.get()));
+
+                //  The absolute block, after Block_Initialize, is the reference. The relative
+                //  view must match it field by field, before and after moving the block
+            Block_Initialize(absoluteBlock.get());
+            const auto& abs = *(const AbsoluteBlockTestRoot*)Block_GetFirstObject(absoluteBlock.get());
+            Assert::AreEqual(root._id, abs._id);
+            Assert::IsTrue(abs._values == SerializableVector<uint32>(root._values.cbegin(), root._values.cend()));
+            Assert::AreEqual(root._name, abs._name);
+            Assert::AreEqual(root._children.size(), abs._children.size());
+            for (size_t c=0; c<root._children.size(); ++c) {
+                Assert::AreEqual(root._children[c]._name, abs._children[c]._name);
+                Assert::IsTrue(std::equal(
+                    abs._children[c]._weights.cbegin(), abs._children[c]._weights.cend(),
+                    root._children[c]._weights.cbegin(), root._children[c]._weights.cend()));
+            }
+
+            CompareBlockTestRoots(
+                abs, absoluteBlock.get(),
+                *(const RelativeBlockTestRoot*)Block_GetFirstObject(relativeBlock.get()), relativeBlock.get());
+
+                // Relative blocks should be readable from anywhere, without Block_Initialize.
+                // Copy it somewhere else and clobber the original to make sure.
+            auto relocated = Block_Duplicate(relativeBlock.get());
+            Assert::IsTrue(relocated.get() != relativeBlock.get());
+            XlSetMemory(relativeBlock.get(), 0xcd, relativeSerializer.Size());
+
+            CompareBlockTestRoots(
+                abs, absoluteBlock.get(),
+                *(const RelativeBlockTestRoot*)Block_GetFirstObject(relocated.get()), relocated.get());
+
+                // (the absolute block owns the strings constructed by Block_Initialize)
+            abs.~AbsoluteBlockTestRoot();
+        }
     };
 }
 
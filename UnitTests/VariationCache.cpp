@@ -0,0 +1,120 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Techniques/VariationTable.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using RenderCore::Techniques::VariationTable;
+    using RenderCore::Techniques::ResolvedShader;
+
+    class BoxHashes
+    {
+    public:
+        uint64 _values[VariationTable::BoxHashCount];
+        BoxHashes(std::mt19937_64& rng) { for (auto& v:_values) v = rng(); }
+    };
+
+        // (adds a global state that maps onto the given filtered entry, as Technique does after a miss)
+    static void InsertGlobal(VariationTable& table, const BoxHashes& boxes, uint64 interfaceHash, VariationTable::Entry* filtered)
+    {
+        table.InsertGlobal(VariationTable::CalculateInputHash(boxes._values) ^ interfaceHash, filtered);
+    }
+
+    TEST_CLASS(VariationCache)
+	{
+	public:
+		TEST_METHOD(VariationCacheHitMissEviction)
+		{
+            using LookupResult = VariationTable::LookupResult;
+
+            std::mt19937_64 rng(0);
+            const uint64 interfaceHash = 0x5a5a1234ull;
+            const uint64 filteredHash = 0x100ull;
+
+            ResolvedShader shaders[2];
+            shaders[0]._variationHash = filteredHash;
+            shaders[1]._variationHash = filteredHash;
+
+            VariationTable table;
+            BoxHashes a(rng), b(rng);
+            LookupResult::Enum result;
+
+                // miss before anything is built
+            Assert::IsTrue(table.Find(a._values, interfaceHash, &result) == nullptr);
+            Assert::IsTrue(result == LookupResult::Miss);
+
+                // build the variation; the first lookup finds it in the tables, the next in the memo
+            auto* entry = table.InsertFiltered(filteredHash ^ interfaceHash, &shaders[0]);
+            InsertGlobal(table, a, interfaceHash, entry);
+            Assert::IsTrue(table.Find(a._values, interfaceHash, &result) == &shaders[0]);
+            Assert::IsTrue(result == LookupResult::TableHit);
+            Assert::IsTrue(table.Find(a._values, interfaceHash, &result) == &shaders[0]);
+            Assert::IsTrue(result == LookupResult::MemoHit);
+
+                // a different technique interface is a different variation
+            Assert::IsTrue(table.Find(a._values, interfaceHash+1, &result) == nullptr);
+            Assert::IsTrue(result == LookupResult::Miss);
+
+                // a second global state with the same filtered state shares the resolved shader
+            Assert::IsTrue(table.FindGlobal(VariationTable::CalculateInputHash(b._values) ^ interfaceHash) == nullptr);
+            Assert::IsTrue(table.FindFiltered(filteredHash ^ interfaceHash) == entry);
+            InsertGlobal(table, b, interfaceHash, entry);
+            Assert::IsTrue(table.Find(b._values, interfaceHash, &result) == &shaders[0]);
+            Assert::IsTrue(result == LookupResult::TableHit);
+
+                // the memo is never shared between tables (ie, between techniques)
+            {
+                VariationTable otherTable;
+                Assert::IsTrue(otherTable.Find(a._values, interfaceHash, &result) == nullptr);
+                Assert::IsTrue(result == LookupResult::Miss);
+            }
+
+                // after a rebuild is published, lookups (even memo hits) return the new shader
+            Assert::IsTrue(table.Find(a._values, interfaceHash) == &shaders[0]);
+            VariationTable::Publish(*entry, &shaders[1]);
+            Assert::IsTrue(table.Find(a._values, interfaceHash, &result) == &shaders[1]);
+            Assert::IsTrue(result == LookupResult::MemoHit);
+            Assert::IsTrue(table.Find(b._values, interfaceHash) == &shaders[1]);
+
+                // many other global states will evict "a" from the (direct mapped) memo. It must
+                // then come from the tables again, and go back into the memo
+            std::vector<BoxHashes> others;
+            for (unsigned c=0; c<1024; ++c) {
+                others.emplace_back(rng);
+                InsertGlobal(table, others.back(), interfaceHash, entry);
+            }
+            for (const auto& o:others)
+                Assert::IsTrue(table.Find(o._values, interfaceHash) == &shaders[1]);
+            Assert::IsTrue(table.Find(a._values, interfaceHash, &result) == &shaders[1]);
+            Assert::IsTrue(result == LookupResult::TableHit);
+            Assert::IsTrue(table.Find(a._values, interfaceHash, &result) == &shaders[1]);
+            Assert::IsTrue(result == LookupResult::MemoHit);
+
+                // the memo is per-thread, so another thread starts by hitting the tables
+            LookupResult::Enum threadResults[2];
+            const ResolvedShader* threadShaders[2];
+            std::thread thread(
+                [&]()
+                {
+                    threadShaders[0] = table.Find(a._values, interfaceHash, &threadResults[0]);
+                    threadShaders[1] = table.Find(a._values, interfaceHash, &threadResults[1]);
+                });
+            thread.join();
+            Assert::IsTrue(threadShaders[0] == &shaders[1] && threadShaders[1] == &shaders[1]);
+            Assert::IsTrue(threadResults[0] == LookupResult::TableHit);
+            Assert::IsTrue(threadResults[1] == LookupResult::MemoHit);
+        }
+    };
+}
+
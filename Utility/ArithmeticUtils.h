@@ -189,10 +189,10 @@ namespace Utility
 
     #elif COMPILER_ACTIVE == COMPILER_GCC
 
-        inline uint32 xl_ctz4(const uint32& x) { __builtin_ctz(x); }
-        inline uint32 xl_clz4(const uint32& x) { __builtin_clz(x); }
-        inline uint32 xl_ctz8(const uint64& x) { __builtin_ctzll(x); }
-        inline uint32 xl_clz8(const uint64& x) { __builtin_clzll(x); }
+        inline uint32 xl_ctz4(const uint32& x) { return __builtin_ctz(x); }
+        inline uint32 xl_clz4(const uint32& x) { return __builtin_clz(x); }
+        inline uint32 xl_ctz8(const uint64& x) { return __builtin_ctzll(x); }
+        inline uint32 xl_clz8(const uint64& x) { return __builtin_clzll(x); }
 
     #else
 
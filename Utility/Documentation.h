@@ -21,7 +21,7 @@
         by the standard library.
             Class | Description
             ----- | -----------
-            CompletionThreadPool | <i>basic thread pool with windows completion ports</i>
+            TaskScheduler | <i>work stealing thread pool, with fork/join task groups</i>
             Utility::Interlocked namespace | <i>layer over atomic CPU instructions</i> 
 
     ## Streams
@@ -0,0 +1,275 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "FastParseValue.h"
+#include "ArithmeticUtils.h"
+#include "../Core/Prefix.h"
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <tmmintrin.h>
+
+namespace Utility
+{
+    template<typename CharType>
+        static inline bool IsWhitespace(CharType chr)
+    {
+        return chr == 0x20 || chr == 0x9 || chr == 0xD || chr == 0xA;
+    }
+
+    static const uint64 s_integerPowersOf10[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull };
+
+        // all of these are exactly representable as doubles
+    static const double s_powersOf10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        // Shuffle masks for right aligning the first N digits of a 16 byte block
+        // into the first 8 bytes (with zeroes in the unused leading bytes)
+    static const int8 s_digitAlignShuffle[9][16] =
+    {
+        { -1, -1, -1, -1, -1, -1, -1, -1,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1, -1,  0,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1,  0,  1,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1,  0,  1,  2,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1,  0,  1,  2,  3,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1,  0,  1,  2,  3,  4,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1,  0,  1,  2,  3,  4,  5,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1,  0,  1,  2,  3,  4,  5,  6,   -1, -1, -1, -1, -1, -1, -1, -1 },
+        {  0,  1,  2,  3,  4,  5,  6,  7,   -1, -1, -1, -1, -1, -1, -1, -1 },
+    };
+
+        // Parse the run of decimal digits at the start of the given 16 byte block (up to a
+        // maximum of 8 digits). Returns the number of digits in the run (which will be 8 if
+        // there may be more digits following).
+        // We find the length of the run with a single compare, and then convert all 8 digits
+        // at once with the multiply-add instructions. This avoids the long dependency chain
+        // in the "result = result * 10 + digit" style loop.
+    static inline unsigned ParseDigitRun8(const uint8* ptr, uint32& value)
+    {
+        auto chars = _mm_loadu_si128((const __m128i*)ptr);
+        auto digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+        auto isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+        auto runLength = xl_ctz4(~uint32(_mm_movemask_epi8(isDigit)));     // (upper 16 bits of the inverted mask are always set)
+        if (!runLength) return 0;
+        if (runLength > 8) runLength = 8;
+
+        auto aligned = _mm_shuffle_epi8(digits, _mm_loadu_si128((const __m128i*)s_digitAlignShuffle[runLength]));
+        auto pairs = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+        auto quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+        value = uint32(_mm_cvtsi128_si32(quads)) * 10000u + uint32(_mm_cvtsi128_si32(_mm_srli_si128(quads, 4)));
+        return runLength;
+    }
+
+        // Accumulate the run of decimal digits starting at "ptr" into "result" (which will
+        // wrap on overflow). Returns the end of the run
+    template<typename CharType>
+        static inline const CharType* AccumulateDigits(uint64& result, const CharType* ptr, const CharType* end)
+    {
+        if (constant_expression<sizeof(CharType) == 1>::result()) {
+            while ((end - ptr) >= 16) {
+                uint32 block;
+                auto runLength = ParseDigitRun8((const uint8*)ptr, block);
+                if (!runLength) return ptr;
+                result = result * s_integerPowersOf10[runLength] + block;
+                ptr += runLength;
+                if (runLength < 8) return ptr;
+            }
+        }
+
+        while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+            result = (result * 10ull) + uint64((*ptr) - '0');
+            ++ptr;
+        }
+        return ptr;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename CharType>
+        const CharType* FastParseElement(int64& dst, const CharType* start, const CharType* end)
+    {
+        bool positive = true;
+        dst = 0;
+
+        if (start >= end) return start;
+        auto* i = start;
+        if (*i == '-') { positive = false; ++i; }
+        else if (*i == '+') ++i;
+
+        uint64 result = 0;
+        auto* digitsEnd = AccumulateDigits(result, i, end);
+        if (digitsEnd == i) return start;
+        dst = positive ? result : -int64(result);
+        return digitsEnd;
+    }
+
+    template<typename CharType>
+        const CharType* FastParseElement(uint64& dst, const CharType* start, const CharType* end)
+    {
+        dst = 0;
+        return AccumulateDigits(dst, start, end);
+    }
+
+    template<typename CharType>
+        const CharType* FastParseElement(uint32& dst, const CharType* start, const CharType* end)
+    {
+        uint64 result = 0;
+        auto* i = AccumulateDigits(result, start, end);
+        dst = uint32(result);
+        return i;
+    }
+
+    template<typename CharType>
+        static const CharType* ParseFloatFallback(float& dst, const CharType* start, const CharType* end)
+    {
+            // std::strtof requires a null terminated string (and might read beyond "end" otherwise).
+            // So we have to copy the number into a temporary buffer first.
+        char buffer[64];
+        unsigned len = 0;
+        for (auto* i=start; i<end && !IsWhitespace(*i) && len < (dimof(buffer)-1); ++i, ++len)
+            buffer[len] = char(*i);
+        buffer[len] = '\0';
+
+        char* newEnd = nullptr;
+        dst = std::strtof(buffer, &newEnd);
+        return start + (newEnd - buffer);
+    }
+
+    template<typename CharType>
+        const CharType* FastParseElement(float& dst, const CharType* start, const CharType* end)
+    {
+            // We're going to read the number as a decimal integer "mantissa" and a power 10 exponent.
+            // When the mantissa fits exactly in a double, and the power of 10 is small, we can get
+            // a correctly rounded double with a single multiply or divide (because both operands are
+            // exact, and IEEE guarantees the result is correctly rounded). See Clinger, "How to read
+            // floating point numbers accurately".
+            // For all other cases, we fall back to strtof. Fortunately, most of the numbers we find in
+            // Collada files are within the fast path.
+        auto* i = start;
+        bool negative = false;
+        if (i < end && (*i == '-' || *i == '+')) { negative = *i == '-'; ++i; }
+
+        uint64 mantissa = 0;
+        auto* intStart = i;
+        i = AccumulateDigits(mantissa, i, end);
+        auto digitCount = i - intStart;
+
+        int exponent = 0;
+        if (i < end && *i == '.') {
+            ++i;
+
+                // some printf implementations will write special values in the form
+                // "-1.#IND". We need to to at least detect these cases, and skip over
+                // them. Maybe it's not critical to return the exact error type referenced.
+            if (i < end && *i == '#') {
+                while (i < end && !IsWhitespace(*i)) ++i;
+                dst = std::numeric_limits<float>::quiet_NaN();
+                return i;
+            }
+
+            auto* fracStart = i;
+            i = AccumulateDigits(mantissa, i, end);
+            exponent = -int(i - fracStart);
+            digitCount += i - fracStart;
+        }
+
+            // no digits means this might be something like "inf" or "nan"
+        if (!digitCount)
+            return ParseFloatFallback(dst, start, end);
+
+        if (i < end && (*i == 'e' || *i == 'E')) {
+            auto* e = i+1;
+            bool negativeExp = false;
+            if (e < end && (*e == '-' || *e == '+')) { negativeExp = *e == '-'; ++e; }
+
+            int explicitExponent = 0;
+            auto* expStart = e;
+            while (e < end && *e >= '0' && *e <= '9') {
+                if (explicitExponent < 100000)
+                    explicitExponent = explicitExponent * 10 + int((*e) - '0');
+                ++e;
+            }
+
+                // (if there are no digits after the "e", it's not part of the number)
+            if (e != expStart) {
+                exponent += negativeExp ? -explicitExponent : explicitExponent;
+                i = e;
+            }
+        }
+
+            // more than 19 digits may have overflowed the mantissa
+        if (digitCount > 19 || mantissa > (1ull << 53))
+            return ParseFloatFallback(dst, start, end);
+
+        if (!mantissa) {
+            dst = negative ? -0.f : 0.f;
+            return i;
+        }
+
+        if (exponent < -22 || exponent > 22)
+            return ParseFloatFallback(dst, start, end);
+
+        double d = double(mantissa);
+        if (exponent < 0)   d /= s_powersOf10[-exponent];
+        else                d *= s_powersOf10[exponent];
+
+            // "d" is now correctly rounded, but when we round again to single precision
+            // we can get the wrong result if "d" lies exactly half way between 2 floats
+            // (because the first rounding may have moved it there). In that case, the lower
+            // 29 bits of the double's mantissa will be 0x10000000.
+            // Very small and very large results must also go through strtof (to get
+            // the denormal and overflow cases right).
+        uint64 dBits;
+        std::memcpy(&dBits, &d, sizeof(dBits));
+        if ((dBits & 0x1fffffffull) == 0x10000000ull
+            || d < double(std::numeric_limits<float>::min())
+            || d > double(std::numeric_limits<float>::max()))
+            return ParseFloatFallback(dst, start, end);
+
+        dst = negative ? -float(d) : float(d);
+        return i;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename Type, typename CharType>
+        const CharType* FastParseList(
+            Type dst[], size_t dstCount,
+            const CharType* start, const CharType* end,
+            size_t& parsedCount)
+    {
+        size_t count = 0;
+        auto* i = start;
+        while (count < dstCount) {
+            while (i < end && IsWhitespace(*i)) ++i;
+
+            auto* eleEnd = FastParseElement(dst[count], i, end);
+            if (eleEnd == i) break;
+
+            ++count;
+            i = eleEnd;
+        }
+
+        parsedCount = count;
+        return i;
+    }
+
+    template const utf8* FastParseElement(int64& dst, const utf8* start, const utf8* end);
+    template const utf8* FastParseElement(uint64& dst, const utf8* start, const utf8* end);
+    template const utf8* FastParseElement(uint32& dst, const utf8* start, const utf8* end);
+    template const utf8* FastParseElement(float& dst, const utf8* start, const utf8* end);
+
+    template const utf8* FastParseList(int64 dst[], size_t, const utf8*, const utf8*, size_t&);
+    template const utf8* FastParseList(uint64 dst[], size_t, const utf8*, const utf8*, size_t&);
+    template const utf8* FastParseList(uint32 dst[], size_t, const utf8*, const utf8*, size_t&);
+    template const utf8* FastParseList(float dst[], size_t, const utf8*, const utf8*, size_t&);
+}
+
@@ -0,0 +1,45 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "UTFUtils.h"
+#include "../Core/Types.h"
+
+namespace Utility
+{
+        //
+        //  Fast parsing for numbers in text files (such as the large arrays of
+        //  numbers we find in Collada files). Unlike the standard library functions,
+        //  these work on strings that aren't null terminated.
+        //
+        //  Each function returns a pointer to the character just after the parsed value,
+        //  or "start" if no value could be parsed. Leading whitespace is not skipped.
+        //
+        //  The float parser returns the correctly rounded result (ie, the same result as
+        //  std::strtof). The common cases are handled with a fast path, and we fall back to
+        //  std::strtof for very long or very small/large numbers.
+        //
+    template<typename CharType> const CharType* FastParseElement(uint32& dst, const CharType* start, const CharType* end);
+    template<typename CharType> const CharType* FastParseElement(int64& dst, const CharType* start, const CharType* end);
+    template<typename CharType> const CharType* FastParseElement(uint64& dst, const CharType* start, const CharType* end);
+    template<typename CharType> const CharType* FastParseElement(float& dst, const CharType* start, const CharType* end);
+
+        /// <summary>Parse a whitespace separated list of values into a contiguous buffer</summary>
+        /// Parses up to "dstCount" values, and writes the number actually parsed into "parsedCount".
+        /// Parsing stops early on the first thing that isn't a valid value.
+        ///
+        /// Returns a pointer to just after the last parsed value when the buffer is filled. Otherwise
+        /// returns a pointer to the point where parsing failed (which will be "end" if the list
+        /// ended before the buffer was full).
+    template<typename Type, typename CharType>
+        const CharType* FastParseList(
+            Type dst[], size_t dstCount,
+            const CharType* start, const CharType* end,
+            size_t& parsedCount);
+}
+
+using namespace Utility;
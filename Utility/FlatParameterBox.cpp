@@ -0,0 +1,478 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "FlatParameterBox.h"
+#include "MemoryUtils.h"
+#include "PtrUtils.h"
+#include "StringUtils.h"
+#include "../Core/Prefix.h"
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace Utility
+{
+    static const unsigned NativeRepMaxSize = MaxPath * 4;
+
+        //  Below this count, we search the name hashes with a linear SSE2 scan
+        //  (which avoids the unpredictable branches in a binary search)
+    static const unsigned LinearSearchThreshold = 32;
+
+    static const uint8 s_bitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+    static uint64 HashValue(ParameterBox::ParameterNameHash name, const void* value, size_t valueSize)
+    {
+        return Hash64(value, PtrAdd(value, valueSize), DefaultSeed64 + name);
+    }
+
+    static uint64 HashName(ParameterBox::ParameterNameHash name)
+    {
+        return IntegerHash64(name);
+    }
+
+    static unsigned AlignUp(unsigned value, unsigned alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    unsigned FlatParameterBox::LowerBound(ParameterNameHash hash) const
+    {
+        auto* hashes = HashNames();
+        if (_count > LinearSearchThreshold)
+            return unsigned(std::lower_bound(hashes, &hashes[_count], hash) - hashes);
+
+            //  Count the number of hashes less than the one we're looking for. The
+            //  hashes are sorted, so that count is the lower bound. SSE2 only has a signed
+            //  compare, so we need to flip the sign bits first.
+            //  Note that we can read past _count here (up to the next multiple of 4), because
+            //  _paramCapacity is always a multiple of 4. Those lanes are masked out.
+        const auto bias = _mm_set1_epi32(int(0x80000000u));
+        const auto key = _mm_xor_si128(_mm_set1_epi32(int(hash)), bias);
+        unsigned result = 0;
+        for (unsigned c=0; c<_count; c+=4) {
+            auto h = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&hashes[c]), bias);
+            auto mask = unsigned(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(h, key))));
+            if ((c+4) > _count) mask &= (1u << (_count-c)) - 1u;
+            result += s_bitCount[mask];
+        }
+        return result;
+    }
+
+    unsigned FlatParameterBox::Find(ParameterNameHash hash) const
+    {
+        auto index = LowerBound(hash);
+        if (index < _count && HashNames()[index] == hash) return index;
+        return ~0u;
+    }
+
+    void FlatParameterBox::Reserve(unsigned paramCount, unsigned extraData)
+    {
+        auto paramCapacity = _paramCapacity;
+        while (paramCapacity < paramCount) paramCapacity *= 2;
+        if (paramCapacity == _paramCapacity && (_dataSize + extraData) <= _dataCapacity)
+            return;
+
+            //  Rebuilding compacts the data (dropping the garbage), but values might
+            //  need some extra padding after they've been moved around
+        auto requiredData = _dataSize - _garbageSize + 3 * _count + extraData;
+        auto dataCapacity = _dataCapacity;
+        while (dataCapacity < requiredData) dataCapacity *= 2;
+        Rebuild(paramCapacity, dataCapacity);
+    }
+
+    void FlatParameterBox::Rebuild(unsigned paramCapacity, unsigned dataCapacity)
+    {
+        assert((paramCapacity % 4) == 0 && paramCapacity >= _count);
+        auto blockSize = paramCapacity * (sizeof(ParameterNameHash) + sizeof(Entry)) + dataCapacity;
+
+        uint64 tempInline[dimof(_inlineBlock)];
+        std::unique_ptr<uint8[]> newHeapBlock;
+        uint8* dst;
+        if (blockSize <= sizeof(_inlineBlock)) {
+            dst = (uint8*)tempInline;
+        } else {
+            newHeapBlock.reset(new uint8[blockSize]);
+            dst = newHeapBlock.get();
+        }
+
+        auto* dstEntries = (Entry*)PtrAdd(dst, paramCapacity * sizeof(ParameterNameHash));
+        auto* dstData = (uint8*)PtrAdd(dstEntries, paramCapacity * sizeof(Entry));
+        XlCopyMemory(dst, HashNames(), _count * sizeof(ParameterNameHash));
+
+        auto* srcEntries = Entries();
+        auto* srcData = Data();
+        unsigned dataSize = 0;
+        for (unsigned c=0; c<_count; ++c) {
+            auto e = srcEntries[c];
+            auto nameLength = unsigned(XlStringLen((const utf8*)&srcData[e._nameOffset]) + 1);
+            XlCopyMemory(&dstData[dataSize], &srcData[e._nameOffset], nameLength);
+            e._nameOffset = dataSize;
+            dataSize = AlignUp(dataSize + nameLength, 4);
+            XlCopyMemory(&dstData[dataSize], &srcData[e._valueOffset], e._valueSize);
+            e._valueOffset = dataSize;
+            dataSize += e._valueSize;
+            dstEntries[c] = e;
+        }
+        assert(dataSize <= dataCapacity);
+
+        if (!newHeapBlock)
+            XlCopyMemory(_inlineBlock, tempInline, blockSize);
+        _heapBlock = std::move(newHeapBlock);
+        _paramCapacity = paramCapacity;
+        _dataCapacity = dataCapacity;
+        _dataSize = dataSize;
+        _garbageSize = 0;
+    }
+
+    uint32 FlatParameterBox::AppendData(const void* data, size_t size, size_t alignment)
+    {
+        auto offset = AlignUp(_dataSize, unsigned(alignment));
+        assert(offset + size <= _dataCapacity);
+        XlCopyMemory(PtrAdd(Data(), offset), data, size);
+        _dataSize = unsigned(offset + size);
+        return offset;
+    }
+
+    void FlatParameterBox::WriteValue(
+        Entry& entry, const void* value, const TypeDesc& type, uint64 valueHash)
+    {
+            //  (caller must reserve space for the new value, if the size is changing)
+        auto valueSize = type.GetSize();
+        if (entry._valueSize == valueSize) {
+            XlCopyMemory(PtrAdd(Data(), entry._valueOffset), value, valueSize);
+        } else {
+            _garbageSize += entry._valueSize;
+            entry._valueOffset = AppendData(value, valueSize, 4);
+            entry._valueSize = valueSize;
+        }
+        _hash += valueHash - entry._valueHash;
+        entry._valueHash = valueHash;
+        entry._type = type;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void FlatParameterBox::SetParameter(const utf8 name[], const void* value, const TypeDesc& type)
+    {
+        auto hash = ParameterBox::MakeParameterNameHash(name);
+        auto valueSize = type.GetSize();
+        auto valueHash = HashValue(hash, value, valueSize);
+
+        auto index = LowerBound(hash);
+        if (index < _count && HashNames()[index] == hash) {
+            assert(!XlCompareString((const utf8*)PtrAdd(Data(), Entries()[index]._nameOffset), name));
+            if (Entries()[index]._valueSize != valueSize)
+                Reserve(_count, valueSize + 3);
+            WriteValue(Entries()[index], value, type, valueHash);
+            return;
+        }
+
+        auto nameLength = XlStringLen(name) + 1;
+        Reserve(_count + 1, unsigned(nameLength + valueSize + 3));
+
+        auto* hashes = HashNames();
+        auto* entries = Entries();
+        XlMoveMemory(&hashes[index+1], &hashes[index], (_count-index) * sizeof(ParameterNameHash));
+        XlMoveMemory(&entries[index+1], &entries[index], (_count-index) * sizeof(Entry));
+
+        hashes[index] = hash;
+        auto& e = entries[index];
+        e._nameOffset = AppendData(name, nameLength, 1);
+        e._valueOffset = AppendData(value, valueSize, 4);
+        e._valueSize = valueSize;
+        e._valueHash = valueHash;
+        e._type = type;
+        ++_count;
+
+        _hash += valueHash;
+        _namesHash += HashName(hash);
+    }
+
+    void FlatParameterBox::SetParameter(const utf8 name[], const char* stringDataBegin, const char* stringDataEnd)
+    {
+        using namespace ImpliedTyping;
+        if (!stringDataBegin || stringDataBegin == stringDataEnd) {
+            SetParameter(name, nullptr, TypeDesc(TypeCat::Void, 0));
+            return;
+        }
+
+        uint8 buffer[NativeRepMaxSize];
+        auto typeDesc = Parse(stringDataBegin, stringDataEnd, buffer, sizeof(buffer));
+        if (typeDesc._type != TypeCat::Void) {
+            SetParameter(name, buffer, typeDesc);
+        } else {
+            SetParameter(
+                name, stringDataBegin,
+                TypeDesc(TypeCat::UInt8, (uint16)(stringDataEnd-stringDataBegin), TypeHint::String));
+        }
+    }
+
+    void FlatParameterBox::SetParameter(const utf8 name[], const char* stringDataBegin)
+    {
+        SetParameter(name, stringDataBegin, stringDataBegin ? XlStringEnd(stringDataBegin) : nullptr);
+    }
+
+    void FlatParameterBox::SetParameter(const utf8 name[], const std::string& stringData)
+    {
+        SetParameter(name, AsPointer(stringData.cbegin()), AsPointer(stringData.cend()));
+    }
+
+    bool FlatParameterBox::GetParameter(ParameterName name, void* dest, const TypeDesc& destType) const
+    {
+        auto index = Find(name._hash);
+        if (index == ~0u) return false;
+
+        const auto& e = Entries()[index];
+        const auto* value = PtrAdd(Data(), e._valueOffset);
+        if (e._type == destType) {
+            XlCopyMemory(dest, value, destType.GetSize());
+            return true;
+        }
+        return ImpliedTyping::Cast(dest, destType.GetSize(), destType, value, e._type);
+    }
+
+    bool FlatParameterBox::HasParameter(ParameterName name) const
+    {
+        return Find(name._hash) != ~0u;
+    }
+
+    auto FlatParameterBox::GetParameterType(ParameterName name) const -> TypeDesc
+    {
+        auto index = Find(name._hash);
+        if (index == ~0u) return TypeDesc(ImpliedTyping::TypeCat::Void, 0);
+        return Entries()[index]._type;
+    }
+
+    const void* FlatParameterBox::GetParameterRawValue(ParameterName name) const
+    {
+        auto index = Find(name._hash);
+        if (index == ~0u) return nullptr;
+        return PtrAdd(Data(), Entries()[index]._valueOffset);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    uint64 FlatParameterBox::CalculateFilteredHashValue(const FlatParameterBox& source) const
+    {
+            //  This is the hash value we would get if we merged in the parameters from
+            //  "source" that are also in this box (casting them to the types in this box).
+            //  Values with matching types already have the right hash in the source box.
+        uint8 castBuffer[NativeRepMaxSize];
+
+        auto* hashes = HashNames();
+        auto* entries = Entries();
+        auto* srcHashes = source.HashNames();
+        auto* srcEntries = source.Entries();
+
+        uint64 result = 0;
+        unsigned i2 = 0;
+        for (unsigned i=0; i<_count; ++i) {
+            while (i2 < source._count && srcHashes[i2] < hashes[i]) ++i2;
+            if (i2 == source._count || srcHashes[i2] != hashes[i]) {
+                result += entries[i]._valueHash;
+                continue;
+            }
+
+            const auto& e = entries[i];
+            const auto& se = srcEntries[i2];
+            if (e._type == se._type) {
+                result += se._valueHash;
+            } else {
+                bool castSuccess =
+                        e._valueSize <= sizeof(castBuffer)
+                    &&  ImpliedTyping::Cast(
+                            castBuffer, e._valueSize, e._type,
+                            PtrAdd(source.Data(), se._valueOffset), se._type);
+                assert(castSuccess);  // type mis-match when attempting to build filtered hash value
+                result += castSuccess ? HashValue(hashes[i], castBuffer, e._valueSize) : e._valueHash;
+            }
+            ++i2;
+        }
+        return result;
+    }
+
+    bool FlatParameterBox::AreParameterNamesEqual(const FlatParameterBox& other) const
+    {
+        return _count == other._count && _namesHash == other._namesHash;
+    }
+
+    void FlatParameterBox::MergeIn(const FlatParameterBox& source)
+    {
+        if (&source == this || !source._count) return;
+
+        auto* srcHashes = source.HashNames();
+        auto* srcEntries = source.Entries();
+        auto* srcData = source.Data();
+
+            //  First pass -- count the new parameters, so we only need to
+            //  reserve space once
+        unsigned newParams = 0, extraData = 0;
+        {
+            auto* hashes = HashNames();
+            auto* entries = Entries();
+            unsigned i = 0;
+            for (unsigned j=0; j<source._count; ++j) {
+                while (i < _count && hashes[i] < srcHashes[j]) ++i;
+                if (i < _count && hashes[i] == srcHashes[j]) {
+                    if (entries[i]._valueSize != srcEntries[j]._valueSize)
+                        extraData += srcEntries[j]._valueSize + 3;
+                } else {
+                    ++newParams;
+                    extraData += srcEntries[j]._valueSize + 3 + unsigned(XlStringLen((const utf8*)&srcData[srcEntries[j]._nameOffset]) + 1);
+                }
+            }
+        }
+
+        Reserve(_count + newParams, extraData);
+
+            //  Second pass -- merge from the back, so every entry
+            //  is moved at most once
+        auto* hashes = HashNames();
+        auto* entries = Entries();
+        signed i = signed(_count) - 1, j = signed(source._count) - 1;
+        signed k = signed(_count + newParams) - 1;
+        while (j >= 0) {
+            auto srcHash = srcHashes[j];
+            if (i >= 0 && hashes[i] > srcHash) {
+                hashes[k] = hashes[i];
+                entries[k] = entries[i];
+                --i; --k;
+                continue;
+            }
+
+            const auto& se = srcEntries[j];
+            if (i >= 0 && hashes[i] == srcHash) {
+                auto e = entries[i];
+                WriteValue(e, &srcData[se._valueOffset], se._type, se._valueHash);
+                entries[k] = e;
+                --i;
+            } else {
+                Entry e;
+                const auto* name = &srcData[se._nameOffset];
+                e._nameOffset = AppendData(name, XlStringLen((const utf8*)name) + 1, 1);
+                e._valueOffset = AppendData(&srcData[se._valueOffset], se._valueSize, 4);
+                e._valueSize = se._valueSize;
+                e._valueHash = se._valueHash;
+                e._type = se._type;
+                entries[k] = e;
+                _hash += se._valueHash;
+                _namesHash += HashName(srcHash);
+            }
+            hashes[k] = srcHash;
+            --j; --k;
+        }
+        _count += newParams;
+    }
+
+    void FlatParameterBox::MergeIn(const ParameterBox& source)
+    {
+        for (auto i=source.Begin(); !i.IsEnd(); ++i)
+            SetParameter(i.Name(), i.RawValue(), i.Type());
+    }
+
+    void FlatParameterBox::Clear()
+    {
+        _count = _dataSize = _garbageSize = 0;
+        _hash = _namesHash = 0;
+    }
+
+    ParameterBox FlatParameterBox::AsParameterBox() const
+    {
+        ParameterBox result;
+        for (auto i=Begin(); !i.IsEnd(); ++i)
+            result.SetParameter(i.Name(), i.RawValue(), i.Type());
+        return result;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    FlatParameterBox::FlatParameterBox()
+    {
+        _count = _dataSize = _garbageSize = 0;
+        _paramCapacity = InlineParameterCount;
+        _dataCapacity = InlineDataSize;
+        _hash = _namesHash = 0;
+    }
+
+    FlatParameterBox::FlatParameterBox(const ParameterBox& copyFrom)
+    : FlatParameterBox()
+    {
+        MergeIn(copyFrom);
+    }
+
+    FlatParameterBox::FlatParameterBox(std::initializer_list<std::pair<const utf8*, const char*>> init)
+    : FlatParameterBox()
+    {
+        for (auto i=init.begin(); i!=init.end(); ++i)
+            SetParameter(i->first, i->second);
+    }
+
+    void FlatParameterBox::CopyFrom(const FlatParameterBox& copyFrom)
+    {
+        auto blockSize = copyFrom._paramCapacity * (sizeof(ParameterNameHash) + sizeof(Entry)) + copyFrom._dataCapacity;
+        if (copyFrom._heapBlock) {
+            _heapBlock.reset(new uint8[blockSize]);
+            XlCopyMemory(_heapBlock.get(), copyFrom._heapBlock.get(), blockSize);
+        } else {
+            _heapBlock.reset();
+            XlCopyMemory(_inlineBlock, copyFrom._inlineBlock, blockSize);
+        }
+        _count = copyFrom._count;
+        _paramCapacity = copyFrom._paramCapacity;
+        _dataSize = copyFrom._dataSize;
+        _dataCapacity = copyFrom._dataCapacity;
+        _garbageSize = copyFrom._garbageSize;
+        _hash = copyFrom._hash;
+        _namesHash = copyFrom._namesHash;
+    }
+
+    FlatParameterBox::FlatParameterBox(const FlatParameterBox& copyFrom)
+    {
+        CopyFrom(copyFrom);
+    }
+
+    FlatParameterBox& FlatParameterBox::operator=(const FlatParameterBox& copyFrom)
+    {
+        if (&copyFrom != this) CopyFrom(copyFrom);
+        return *this;
+    }
+
+    FlatParameterBox::FlatParameterBox(FlatParameterBox&& moveFrom) never_throws
+    : FlatParameterBox()
+    {
+        *this = std::move(moveFrom);
+    }
+
+    FlatParameterBox& FlatParameterBox::operator=(FlatParameterBox&& moveFrom) never_throws
+    {
+        if (&moveFrom == this) return *this;
+
+        if (moveFrom._heapBlock) {
+            _heapBlock = std::move(moveFrom._heapBlock);
+        } else {
+            _heapBlock.reset();
+            auto blockSize = moveFrom._paramCapacity * (sizeof(ParameterNameHash) + sizeof(Entry)) + moveFrom._dataCapacity;
+            XlCopyMemory(_inlineBlock, moveFrom._inlineBlock, blockSize);
+        }
+        _count = moveFrom._count;
+        _paramCapacity = moveFrom._paramCapacity;
+        _dataSize = moveFrom._dataSize;
+        _dataCapacity = moveFrom._dataCapacity;
+        _garbageSize = moveFrom._garbageSize;
+        _hash = moveFrom._hash;
+        _namesHash = moveFrom._namesHash;
+
+        moveFrom._count = moveFrom._dataSize = moveFrom._garbageSize = 0;
+        moveFrom._paramCapacity = InlineParameterCount;
+        moveFrom._dataCapacity = InlineDataSize;
+        moveFrom._hash = moveFrom._namesHash = 0;
+        return *this;
+    }
+
+    FlatParameterBox::~FlatParameterBox() {}
+}
+
@@ -0,0 +1,192 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "ParameterBox.h"
+#include "../Core/Types.h"
+#include <memory>
+#include <utility>
+
+namespace Utility
+{
+        //////////////////////////////////////////////////////////////////
+            //      F L A T   P A R A M E T E R   B O X             //
+        //////////////////////////////////////////////////////////////////
+
+    /// <summary>ParameterBox alternative, optimised for building and merging at runtime</summary>
+    /// ParameterBox keeps 5 separate vectors, and calculates hash values lazily
+    /// (so every change costs a few allocations, and the next GetHash() must rehash
+    /// every value). That's fine for the boxes we load from disk; but it's expensive
+    /// for boxes that are built and merged every frame (eg, while resolving techniques).
+    ///
+    /// FlatParameterBox keeps everything in a single block:
+    ///  <list>
+    ///     <item>sorted parameter name hashes (searched with SSE2 for small boxes)</item>
+    ///     <item>per parameter type, offsets & value hash</item>
+    ///     <item>value & name data (append only; reclaimed when the block grows)</item>
+    ///  </list>
+    /// Small boxes fit in inline storage, and never allocate.
+    ///
+    /// The hash value is maintained incrementally as parameters are set, so GetHash() and
+    /// GetParameterNamesHash() are O(1), and CalculateFilteredHashValue() only hashes values
+    /// that need to be cast.
+    ///
+    /// Note that the hash values are not the same as the ParameterBox hash values for the
+    /// same parameters. Don't mix the two when building keys for a cache.
+    class FlatParameterBox
+    {
+    public:
+        using ParameterNameHash = ParameterBox::ParameterNameHash;
+        using ParameterName = ParameterBox::ParameterName;
+        using TypeDesc = ImpliedTyping::TypeDesc;
+
+        static const unsigned InlineParameterCount = 8;
+        static const unsigned InlineDataSize = 256;
+
+        void            SetParameter(const utf8 name[], const void* data, const TypeDesc& type);
+        void            SetParameter(const utf8 name[], const char* stringDataBegin, const char* stringDataEnd);
+        void            SetParameter(const utf8 name[], const char* stringDataBegin);
+        void            SetParameter(const utf8 name[], const std::string& stringData);
+        T1(Type) void   SetParameter(const utf8 name[], Type value);
+
+        T1(Type) std::pair<bool, Type>  GetParameter(ParameterName name) const;
+        T1(Type) Type   GetParameter(ParameterName name, const Type& def) const;
+        bool            GetParameter(ParameterName name, void* dest, const TypeDesc& destType) const;
+        bool            HasParameter(ParameterName name) const;
+        TypeDesc        GetParameterType(ParameterName name) const;
+        const void*     GetParameterRawValue(ParameterName name) const;
+
+        uint64  GetHash() const                 { return _hash; }
+        uint64  GetParameterNamesHash() const   { return _namesHash; }
+        uint64  CalculateFilteredHashValue(const FlatParameterBox& source) const;
+        bool    AreParameterNamesEqual(const FlatParameterBox& other) const;
+
+        void    MergeIn(const FlatParameterBox& source);
+        void    MergeIn(const ParameterBox& source);
+        void    Clear();
+
+        ParameterBox AsParameterBox() const;
+
+        class Iterator
+        {
+        public:
+            bool                IsEnd() const               { return _index >= _box->_count; }
+            const utf8*         Name() const;
+            const void*         RawValue() const;
+            const TypeDesc&     Type() const;
+            ParameterNameHash   HashName() const;
+
+            void operator++()   { ++_index; }
+
+        private:
+            unsigned                _index;
+            const FlatParameterBox* _box;
+
+            Iterator(const FlatParameterBox& box, unsigned index) : _index(index), _box(&box) {}
+            friend class FlatParameterBox;
+        };
+
+        Iterator    Begin() const           { return Iterator(*this, 0); }
+        size_t      GetCount() const        { return _count; }
+
+        FlatParameterBox();
+        explicit FlatParameterBox(const ParameterBox& copyFrom);
+        FlatParameterBox(std::initializer_list<std::pair<const utf8*, const char*>>);
+        FlatParameterBox(const FlatParameterBox& copyFrom);
+        FlatParameterBox& operator=(const FlatParameterBox& copyFrom);
+        FlatParameterBox(FlatParameterBox&& moveFrom) never_throws;
+        FlatParameterBox& operator=(FlatParameterBox&& moveFrom) never_throws;
+        ~FlatParameterBox();
+
+    private:
+        class Entry
+        {
+        public:
+            uint64      _valueHash;
+            TypeDesc    _type;
+            uint32      _valueOffset;
+            uint32      _nameOffset;
+            uint32      _valueSize;
+        };
+
+        unsigned    _count;
+        unsigned    _paramCapacity;
+        unsigned    _dataSize;
+        unsigned    _dataCapacity;
+        unsigned    _garbageSize;
+
+        uint64      _hash;
+        uint64      _namesHash;
+
+        std::unique_ptr<uint8[]>    _heapBlock;
+        uint64      _inlineBlock[(InlineParameterCount * (sizeof(ParameterNameHash) + sizeof(Entry)) + InlineDataSize + 7) / 8];
+
+        uint8*                  Block()             { return _heapBlock ? _heapBlock.get() : (uint8*)_inlineBlock; }
+        const uint8*            Block() const       { return _heapBlock ? _heapBlock.get() : (const uint8*)_inlineBlock; }
+        ParameterNameHash*      HashNames()         { return (ParameterNameHash*)Block(); }
+        const ParameterNameHash* HashNames() const  { return (const ParameterNameHash*)Block(); }
+        Entry*                  Entries()           { return (Entry*)(Block() + _paramCapacity * sizeof(ParameterNameHash)); }
+        const Entry*            Entries() const     { return (const Entry*)(Block() + _paramCapacity * sizeof(ParameterNameHash)); }
+        uint8*                  Data()              { return Block() + _paramCapacity * (sizeof(ParameterNameHash) + sizeof(Entry)); }
+        const uint8*            Data() const        { return Block() + _paramCapacity * (sizeof(ParameterNameHash) + sizeof(Entry)); }
+
+        unsigned    LowerBound(ParameterNameHash hash) const;
+        unsigned    Find(ParameterNameHash hash) const;
+        void        Reserve(unsigned paramCount, unsigned extraData);
+        void        Rebuild(unsigned paramCapacity, unsigned dataCapacity);
+        uint32      AppendData(const void* data, size_t size, size_t alignment);
+        void        WriteValue(Entry& entry, const void* value, const TypeDesc& type, uint64 valueHash);
+        void        CopyFrom(const FlatParameterBox& copyFrom);
+    };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename Type>
+        void FlatParameterBox::SetParameter(const utf8 name[], Type value)
+    {
+        SetParameter(name, &value, ImpliedTyping::TypeOf<Type>());
+    }
+
+    template<typename Type>
+        std::pair<bool, Type> FlatParameterBox::GetParameter(ParameterName name) const
+    {
+        Type result;
+        if (GetParameter(name, &result, ImpliedTyping::TypeOf<Type>()))
+            return std::make_pair(true, result);
+        return std::make_pair(false, Type());
+    }
+
+    template<typename Type>
+        Type FlatParameterBox::GetParameter(ParameterName name, const Type& def) const
+    {
+        auto q = GetParameter<Type>(name);
+        if (q.first) return q.second;
+        return def;
+    }
+
+    inline const utf8* FlatParameterBox::Iterator::Name() const
+    {
+        return (const utf8*)(_box->Data() + _box->Entries()[_index]._nameOffset);
+    }
+
+    inline const void* FlatParameterBox::Iterator::RawValue() const
+    {
+        return _box->Data() + _box->Entries()[_index]._valueOffset;
+    }
+
+    inline auto FlatParameterBox::Iterator::Type() const -> const TypeDesc&
+    {
+        return _box->Entries()[_index]._type;
+    }
+
+    inline auto FlatParameterBox::Iterator::HashName() const -> ParameterNameHash
+    {
+        return _box->HashNames()[_index];
+    }
+}
+
+using namespace Utility;
@@ -107,6 +107,17 @@ namespace Utility
         bool            IsValid()           { return _mappedData != 0; }
         size_t          GetSize() const;
 
+            /// Ask the OS to start reading part of the file into memory, without
+            /// waiting for it to complete. Later accesses to this range (through this
+            /// mapping or any other view of the same file) should not need to stall
+            /// on disk. This is only a hint; it does nothing on systems that don't
+            /// support it.
+        void            Prefetch(size_t offset, size_t size) const;
+
+            /// Write any modified pages in the given range to disk, and wait for
+            /// the write to complete. Returns false on failure.
+        bool            Flush(size_t offset, size_t size) const;
+
         MemoryMappedFile(
             const char filename[], uint64 size, 
             Access::BitField access,
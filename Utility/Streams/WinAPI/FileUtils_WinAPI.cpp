@@ -549,5 +549,32 @@ namespace Utility
         GetFileSizeEx(_fileHandle, &fileSize);
         return (size_t)fileSize.QuadPart;
     }
+
+    void MemoryMappedFile::Prefetch(size_t offset, size_t size) const
+    {
+            //  PrefetchVirtualMemory is only available on Windows 8 and later, so
+            //  we have to look it up dynamically. (we use our own declaration of
+            //  WIN32_MEMORY_RANGE_ENTRY, because older SDKs don't have it)
+        struct MemoryRangeEntry { void* _virtualAddress; size_t _numberOfBytes; };
+        using PrefetchFn = BOOL (WINAPI*)(HANDLE, ULONG_PTR, MemoryRangeEntry*, ULONG);
+        static auto prefetchFn = (PrefetchFn)GetProcAddress(GetModuleHandle(TEXT("kernel32.dll")), "PrefetchVirtualMemory");
+        if (!prefetchFn || !_mappedData) return;
+
+        auto fileSize = GetSize();
+        if (offset >= fileSize) return;
+        if (size > fileSize - offset) size = fileSize - offset;
+
+        MemoryRangeEntry range { (uint8*)_mappedData + offset, size };
+        (*prefetchFn)(GetCurrentProcess(), 1, &range, 0);
+    }
+
+    bool MemoryMappedFile::Flush(size_t offset, size_t size) const
+    {
+            //  FlushViewOfFile only starts the writes for the dirty pages. We also need
+            //  FlushFileBuffers to wait for them to reach the disk.
+        if (!_mappedData) return false;
+        if (size && !FlushViewOfFile((uint8*)_mappedData + offset, size)) return false;
+        return FlushFileBuffers(_fileHandle) != FALSE;
+    }
 }
 
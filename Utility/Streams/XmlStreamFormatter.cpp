@@ -5,6 +5,8 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "XmlStreamFormatter.h"
+#include "../ArithmeticUtils.h"
+#include <emmintrin.h>
 
 namespace Utility
 {
@@ -32,6 +34,108 @@ namespace Utility
         ++_ptr;
     }
 
+    namespace Internal
+    {
+        static const unsigned ScanBlockSize = 32;
+
+        static inline uint32 MatchMask32(const uint8* ptr, __m128i chr)
+        {
+            auto a = _mm_loadu_si128((const __m128i*)ptr);
+            auto b = _mm_loadu_si128((const __m128i*)(ptr+16));
+            return uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(a, chr)))
+                | (uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(b, chr))) << 16);
+        }
+
+        static inline uint32 WhitespaceMask32(const uint8* ptr)
+        {
+            const auto space = _mm_set1_epi8(0x20), tab = _mm_set1_epi8(0x9);
+            const auto cr = _mm_set1_epi8(0xd), lf = _mm_set1_epi8(0xa);
+            auto a = _mm_loadu_si128((const __m128i*)ptr);
+            auto b = _mm_loadu_si128((const __m128i*)(ptr+16));
+            auto wa = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(a, space), _mm_cmpeq_epi8(a, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(a, lf)));
+            auto wb = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(b, space), _mm_cmpeq_epi8(b, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(b, cr), _mm_cmpeq_epi8(b, lf)));
+            return uint32(_mm_movemask_epi8(wa)) | (uint32(_mm_movemask_epi8(wb)) << 16);
+        }
+
+            // Returns a bit for every character in the block that begins a new line
+            // (using the same rules as AdvanceCheckNewLine -- 0xd0xa counts as a single new line, 
+            // and the bit is set for the 0xa). Reads one byte past the end of the block.
+        static inline uint32 LineBreakMask32(const uint8* ptr)
+        {
+            const auto cr = _mm_set1_epi8(0xd), lf = _mm_set1_epi8(0xa);
+            auto lfMask = MatchMask32(ptr, lf);
+            auto crMask = MatchMask32(ptr, cr);
+            auto nextIsLF = MatchMask32(ptr+1, lf);
+            return lfMask | (crMask & ~nextIsLF);
+        }
+
+            // Scan forward in blocks of 32 bytes until "stopMaskFn" returns a non-zero mask.
+            // Returns the position of the first stop character, or the start of the remaining
+            // tail (which is too short for a full block, and must be processed by the caller)
+        template<typename StopMaskFn>
+            static const uint8* ScanBlocks(
+                const uint8* ptr, const uint8* end, StopMaskFn&& stopMaskFn,
+                unsigned& lineIndex, const uint8*& lineStart)
+        {
+            while ((end - ptr) > ptrdiff_t(ScanBlockSize)) {     // (LineBreakMask32 needs ScanBlockSize+1 bytes)
+                auto stop = stopMaskFn(ptr);
+                auto breaks = LineBreakMask32(ptr);
+                unsigned advance = ScanBlockSize;
+                if (stop) {
+                    advance = xl_ctz4(stop);
+                    breaks &= (1u << advance) - 1u;
+                }
+
+                if (breaks) {
+                    lineIndex += popcount(breaks);
+                    lineStart = ptr + ScanBlockSize - xl_clz4(breaks);
+                }
+
+                ptr += advance;
+                if (stop) break;
+            }
+            return ptr;
+        }
+    }
+
+    template<typename CharType>
+        void TextStreamMarker<CharType>::AdvanceToChar(CharType chr)
+    {
+        assert(chr != 0xd && chr != 0xa);
+        if (constant_expression<sizeof(CharType) == 1>::result()) {
+            auto matchChr = _mm_set1_epi8(char(chr));
+            auto lineStart = (const uint8*)_lineStart;
+            _ptr = (const CharType*)Internal::ScanBlocks(
+                (const uint8*)_ptr, (const uint8*)_end,
+                [matchChr](const uint8* ptr) { return Internal::MatchMask32(ptr, matchChr); },
+                _lineIndex, lineStart);
+            _lineStart = (const CharType*)lineStart;
+        }
+
+        while (_ptr < _end && *_ptr != chr)
+            AdvanceCheckNewLine();
+    }
+
+    template<typename CharType>
+        void TextStreamMarker<CharType>::AdvanceOverWhitespace()
+    {
+        if (constant_expression<sizeof(CharType) == 1>::result()) {
+            auto lineStart = (const uint8*)_lineStart;
+            _ptr = (const CharType*)Internal::ScanBlocks(
+                (const uint8*)_ptr, (const uint8*)_end,
+                [](const uint8* ptr) { return ~Internal::WhitespaceMask32(ptr); },
+                _lineIndex, lineStart);
+            _lineStart = (const CharType*)lineStart;
+        }
+
+        while (_ptr < _end && (*_ptr == 0x20 || *_ptr == 0x9 || *_ptr == 0xD || *_ptr == 0xA))
+            AdvanceCheckNewLine();
+    }
+
     template<typename CharType>
         TextStreamMarker<CharType>::TextStreamMarker(const MemoryMappedInputStream& stream)
     : _ptr((const CharType*)stream.ReadPointer())
@@ -47,12 +151,6 @@ namespace Utility
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-    template<typename CharType>
-        bool IsWhitespace(CharType chr)
-    {
-        return chr == 0x20 || chr == 0x9 || chr == 0xD || chr == 0xA;
-    }
-
     template<typename CharType>
         bool IsNameStartChar(CharType chr)
     {
@@ -146,6 +244,7 @@ namespace Utility
             const char exceptionMsg[], const StreamLocation& exceptionLoc)
     {
         for (;;) {
+            mark.AdvanceToChar(endPattern[0]);
             auto er = TryEat(endPattern, mark);
             if (er == Clipped)
                 Throw(FormatException(exceptionMsg, exceptionLoc));
@@ -159,13 +258,9 @@ namespace Utility
     {
             // scan forward over any whitespace or "character data"
             // we need to record line breaks, however
-        for (;;) {
-            if (mark.Remaining() < 1)
-                Throw(FormatException(exceptionMsg, mark.GetLocation()));
-
-            if (!IsWhitespace(*mark)) break;
-            mark.AdvanceCheckNewLine();
-        }
+        mark.AdvanceOverWhitespace();
+        if (mark.Remaining() < 1)
+            Throw(FormatException(exceptionMsg, mark.GetLocation()));
     }
 
     template<typename CharType>
@@ -182,22 +277,14 @@ namespace Utility
                 // currently only supporting "processing instruction"
                 // objects for the xml header. If a processing instruction
                 // appears elsewhere in the file, it will fail to parse
-            while (mark.Remaining() >= 1 && IsWhitespace(*mark))
-                mark.AdvanceCheckNewLine();
+            mark.AdvanceOverWhitespace();
             
             for (;;) {
                 auto piStart = mark.GetLocation();
                 if (TryEat(Const::PIStart, mark) == Match) {
                         // this is a <? ... ?> "processing instruction
                         // we will ignore everything until we find the closing ?>
-                    for (;;) {
-                        auto er = TryEat(Const::PIEnd, mark);
-                        if (er == Clipped)
-                            Throw(FormatException("End of file found in processing exception", piStart));
-                        if (er == Match) break;
-
-                        mark.AdvanceCheckNewLine();
-                    }
+                    ScanToClosing(Const::PIEnd, mark, "End of file found in processing exception", piStart);
                 } else break;
             }
 
@@ -218,14 +305,11 @@ namespace Utility
                 {
                         // scan forward over any whitespace or "character data"
                         // we need to record line breaks, however
-                    for (;;) {
-                        if (mark.Remaining() < 1) { 
-                                // reached end of tile
-                            if (scopeType == Scope::Type::None) { _marker = mark; return Blob::None; }
-                            Throw(FormatException("Unexpected end of file in element", mark.GetLocation()));
-                        }
-                        if (*mark == '<') break;
-                        mark.AdvanceCheckNewLine();
+                    mark.AdvanceToChar('<');
+                    if (mark.Remaining() < 1) { 
+                            // reached end of tile
+                        if (scopeType == Scope::Type::None) { _marker = mark; return Blob::None; }
+                        Throw(FormatException("Unexpected end of file in element", mark.GetLocation()));
                     }
 
                     ++mark;
@@ -320,13 +404,9 @@ namespace Utility
 
                 // next should come either an attribute list, or ">" or "/>" style deliminator
 
-            for (;;) {
-                if (_marker.Remaining() < 1)
-                    Throw(FormatException("Unexpected end of file in element", _marker.GetLocation()));
-
-                if (!IsWhitespace(*_marker)) break;
-                _marker.AdvanceCheckNewLine();
-            }
+            _marker.AdvanceOverWhitespace();
+            if (_marker.Remaining() < 1)
+                Throw(FormatException("Unexpected end of file in element", _marker.GetLocation()));
 
             if (IsNameStartChar(*_marker)
                 || (*_marker == '/' && _marker.Remaining() >= 2 && _marker[1] == '>')) {
@@ -430,27 +510,9 @@ namespace Utility
 
         cdata._start = _marker.Pointer();
 
-        bool gotEnd = false;
-        while (_marker.Remaining() >= 64 && !gotEnd) {
-            for (unsigned c=0; c<64; ++c) {
-                if (*_marker == '<') { gotEnd = true; break; }
-                _marker.AdvanceCheckNewLine();
-            }
-        }
-
-        if (!gotEnd) {
-            for (;;) {
-                if (_marker.Remaining() < 1) { 
-                        // reached end of tile
-                    if (_scopeStack.top()._type != Scope::Type::None) {
-                        Throw(FormatException("Unexpected end of file in element", _marker.GetLocation()));
-                        break;
-                    }
-                }
-                if (*_marker == '<') break;
-                _marker.AdvanceCheckNewLine();
-            }
-        }
+        _marker.AdvanceToChar('<');
+        if (_marker.Remaining() < 1 && _scopeStack.top()._type != Scope::Type::None)
+            Throw(FormatException("Unexpected end of file in element", _marker.GetLocation()));
 
         cdata._end = _marker.Pointer();
 
@@ -25,6 +25,11 @@ namespace Utility
         StreamLocation GetLocation() const;
         void AdvanceCheckNewLine();
 
+            // Bulk scanning methods. These will advance the marker while keeping track of
+            // new lines. For single byte character types, they test 32 bytes at a time.
+        void AdvanceToChar(CharType chr);       // stops on "chr", or the end of the stream
+        void AdvanceOverWhitespace();           // stops on the first non-whitespace char, or the end of the stream
+
         TextStreamMarker(const MemoryMappedInputStream& stream);
         ~TextStreamMarker();
     protected:
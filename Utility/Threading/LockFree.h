@@ -10,6 +10,8 @@
 #include "../PtrUtils.h"
 #include "Mutex.h"
 #include <queue>
+#include <type_traits>
+#include <algorithm>
 #include <assert.h>
 
 namespace Utility
@@ -382,6 +384,440 @@ namespace LockFree
         {
             return _event;
         }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const unsigned CacheLineSize = 64;
+
+        //  Note that we rely on MSVC "volatile" semantics for the following queues. Volatile
+        //  loads have acquire semantics, and volatile stores have release semantics (this is
+        //  the same assumption made by Interlocked::Load)
+    force_inline void StoreRelease(Interlocked::Value volatile* target, Interlocked::Value value) { *target = value; }
+
+    /// <summary>Bounded multi-producer, multi-consumer queue</summary>
+    /// Based on Dmitry Vyukov's bounded MPMC queue. Every cell has a sequence number
+    /// that tells pushers and poppers whether the cell is ready for them. Pushing and popping
+    /// each require a single compare-exchange on the shared position (and there's no
+    /// stall waiting for other threads to finish their operations, unlike FixedSizeQueue).
+    ///
+    /// push() returns false when the queue is full; there is no overflow queue.
+    /// "Count" must be a power of 2.
+    template<typename Type, int Count>
+        class BoundedQueue
+    {
+    public:
+        bool push(const Type& newItem);
+        bool push(Type&& newItem);
+        bool try_pop(Type& result);
+        size_t size() const;
+
+        BoundedQueue();
+        ~BoundedQueue();
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    private:
+        static_assert((Count & (Count-1)) == 0, "BoundedQueue count must be a power of 2");
+
+        class Cell
+        {
+        public:
+            Interlocked::Value _sequence;
+            typename std::aligned_storage<sizeof(Type), std::alignment_of<Type>::value>::type _storage;
+        };
+
+        Cell                _cells[Count];
+        uint8               _padding0[CacheLineSize];
+        Interlocked::Value  _pushPos;
+        uint8               _padding1[CacheLineSize - sizeof(Interlocked::Value)];
+        Interlocked::Value  _popPos;
+        uint8               _padding2[CacheLineSize - sizeof(Interlocked::Value)];
+
+        Cell* BeginPush();
+    };
+
+    /// <summary>Single-producer, single-consumer ring buffer</summary>
+    /// Only one thread may push, and only one thread may pop. In this case, we don't
+    /// need any interlocked operations. The read and write positions are on separate
+    /// cache lines, and each side keeps a cached copy of the other side's position, so
+    /// the two threads only touch the same cache line when the cached value is out of date.
+    /// "Count" must be a power of 2.
+    template<typename Type, int Count>
+        class SPSCQueue
+    {
+    public:
+        bool push(const Type& newItem);
+        bool push(Type&& newItem);
+        void push_stall(Type&& newItem);
+
+        bool try_front(Type*& result);
+        void pop();
+        bool try_pop(Type& result);
+        size_t size() const;
+
+        SPSCQueue();
+        ~SPSCQueue();
+        SPSCQueue(const SPSCQueue&) = delete;
+        SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    private:
+        static_assert((Count & (Count-1)) == 0, "SPSCQueue count must be a power of 2");
+
+        typename std::aligned_storage<sizeof(Type), std::alignment_of<Type>::value>::type _storage[Count];
+
+            // (written by the pushing thread)
+        uint8               _padding0[CacheLineSize];
+        Interlocked::Value  _writePos;
+        Interlocked::Value  _cachedReadPos;
+        uint8               _padding1[CacheLineSize - 2*sizeof(Interlocked::Value)];
+
+            // (written by the popping thread)
+        Interlocked::Value  _readPos;
+        Interlocked::Value  _cachedWritePos;
+        uint8               _padding2[CacheLineSize - 2*sizeof(Interlocked::Value)];
+
+        Type* Slot(Interlocked::Value pos) { return (Type*)&_storage[pos & (Count-1)]; }
+        bool HasSpace();
+    };
+
+    /// <summary>Unbounded multi-producer, single-consumer queue</summary>
+    /// Based on Dmitry Vyukov's intrusive MPSC queue. Pushing is a single exchange on
+    /// the head pointer (so it never fails and never waits for other pushers). Only one
+    /// thread may pop.
+    ///
+    /// Nodes are allocated in segments, and recycled through a BoundedQueue. So, once the
+    /// queue has grown to its working size, there are no further allocations. Segments are
+    /// only released when the queue is destroyed.
+    ///
+    /// Note that try_pop() can return false for a short time after a push has started,
+    /// (even if other items were pushed after it) because the pusher has not yet linked
+    /// its node into the list.
+    template<typename Type>
+        class MPSCQueue
+    {
+    public:
+        void push(const Type& newItem);
+        void push(Type&& newItem);
+        bool try_pop(Type& result);
+
+        MPSCQueue();
+        ~MPSCQueue();
+        MPSCQueue(const MPSCQueue&) = delete;
+        MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    private:
+        class Node
+        {
+        public:
+            Node* volatile  _next;
+            typename std::aligned_storage<sizeof(Type), std::alignment_of<Type>::value>::type _storage;
+            Type* Value() { return (Type*)&_storage; }
+        };
+
+        static const unsigned NodesPerSegment = 64;
+        class Segment
+        {
+        public:
+            Segment*    _nextSegment;
+            Node        _nodes[NodesPerSegment];
+        };
+
+        uint8               _padding0[CacheLineSize];
+        Node* volatile      _head;          // (pushers)
+        uint8               _padding1[CacheLineSize - sizeof(Node*)];
+        Node*               _tail;          // (popper)
+        uint8               _padding2[CacheLineSize - sizeof(Node*)];
+
+        Node                _stub;
+        Segment* volatile   _segments;
+        BoundedQueue<Node*, 256> _freeNodes;
+
+        Node* AllocateNode();
+        void PushNode(Node* node);
+    };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    #undef new
+
+    template<typename Type, int Count>
+        auto BoundedQueue<Type,Count>::BeginPush() -> Cell*
+        {
+                //  Claim the cell at _pushPos. The cell is ready for us if its
+                //  sequence number is equal to the position. If the sequence
+                //  number is behind, the queue is full.
+            auto pos = Interlocked::Load(&_pushPos);
+            for (;;) {
+                auto* cell = &_cells[pos & (Count-1)];
+                auto seq = Interlocked::Load(&cell->_sequence);
+                auto diff = Interlocked::Value(seq - pos);
+                if (diff == 0) {
+                    auto prev = Interlocked::CompareExchange(&_pushPos, pos+1, pos);
+                    if (prev == pos) return cell;
+                    pos = prev;
+                } else if (diff < 0) {
+                    return nullptr;
+                } else {
+                    pos = Interlocked::Load(&_pushPos);
+                }
+            }
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::push(const Type& newItem)
+        {
+            auto* cell = BeginPush();
+            if (!cell) return false;
+            auto pos = cell->_sequence;
+            new(&cell->_storage) Type(newItem);
+            StoreRelease(&cell->_sequence, pos+1);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::push(Type&& newItem)
+        {
+            auto* cell = BeginPush();
+            if (!cell) return false;
+            auto pos = cell->_sequence;
+            new(&cell->_storage) Type(std::move(newItem));
+            StoreRelease(&cell->_sequence, pos+1);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::try_pop(Type& result)
+        {
+            auto pos = Interlocked::Load(&_popPos);
+            Cell* cell;
+            for (;;) {
+                cell = &_cells[pos & (Count-1)];
+                auto seq = Interlocked::Load(&cell->_sequence);
+                auto diff = Interlocked::Value(seq - (pos+1));
+                if (diff == 0) {
+                    auto prev = Interlocked::CompareExchange(&_popPos, pos+1, pos);
+                    if (prev == pos) break;
+                    pos = prev;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = Interlocked::Load(&_popPos);
+                }
+            }
+
+            auto* item = (Type*)&cell->_storage;
+            result = std::move(*item);
+            item->~Type();
+            StoreRelease(&cell->_sequence, pos+Count);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        size_t BoundedQueue<Type,Count>::size() const
+        {
+                // (only approximate, if other threads are pushing or popping)
+            auto popPos = Interlocked::Load(const_cast<Interlocked::Value*>(&_popPos));
+            auto pushPos = Interlocked::Load(const_cast<Interlocked::Value*>(&_pushPos));
+            return size_t(std::max(Interlocked::Value(pushPos - popPos), Interlocked::Value(0)));
+        }
+
+    template<typename Type, int Count>
+        BoundedQueue<Type,Count>::BoundedQueue()
+        {
+            for (int c=0; c<Count; ++c) _cells[c]._sequence = c;
+            _pushPos = _popPos = 0;
+        }
+
+    template<typename Type, int Count>
+        BoundedQueue<Type,Count>::~BoundedQueue()
+        {
+                // destroy any items that were never popped
+            for (auto pos=_popPos; pos!=_pushPos; ++pos) {
+                auto& cell = _cells[pos & (Count-1)];
+                if (cell._sequence == pos+1)
+                    ((Type*)&cell._storage)->~Type();
+            }
+        }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename Type, int Count>
+        bool SPSCQueue<Type,Count>::HasSpace()
+        {
+            if (Interlocked::Value(_writePos - _cachedReadPos) < Count) return true;
+            _cachedReadPos = Interlocked::Load(&_readPos);
+            return Interlocked::Value(_writePos - _cachedReadPos) < Count;
+        }
+
+    template<typename Type, int Count>
+        bool SPSCQueue<Type,Count>::push(const Type& newItem)
+        {
+            if (!HasSpace()) return false;
+            new(Slot(_writePos)) Type(newItem);
+            StoreRelease(&_writePos, _writePos+1);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        bool SPSCQueue<Type,Count>::push(Type&& newItem)
+        {
+            if (!HasSpace()) return false;
+            new(Slot(_writePos)) Type(std::move(newItem));
+            StoreRelease(&_writePos, _writePos+1);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        void SPSCQueue<Type,Count>::push_stall(Type&& newItem)
+        {
+            while (!HasSpace())
+                Threading::YieldTimeSlice();
+            push(std::move(newItem));
+        }
+
+    template<typename Type, int Count>
+        bool SPSCQueue<Type,Count>::try_front(Type*& result)
+        {
+            if (_readPos == _cachedWritePos) {
+                _cachedWritePos = Interlocked::Load(&_writePos);
+                if (_readPos == _cachedWritePos) return false;
+            }
+            result = Slot(_readPos);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        void SPSCQueue<Type,Count>::pop()
+        {
+            assert(_readPos != _cachedWritePos);
+            Slot(_readPos)->~Type();
+            StoreRelease(&_readPos, _readPos+1);
+        }
+
+    template<typename Type, int Count>
+        bool SPSCQueue<Type,Count>::try_pop(Type& result)
+        {
+            Type* front;
+            if (!try_front(front)) return false;
+            result = std::move(*front);
+            pop();
+            return true;
+        }
+
+    template<typename Type, int Count>
+        size_t SPSCQueue<Type,Count>::size() const
+        {
+            auto readPos = Interlocked::Load(const_cast<Interlocked::Value*>(&_readPos));
+            auto writePos = Interlocked::Load(const_cast<Interlocked::Value*>(&_writePos));
+            return size_t(Interlocked::Value(writePos - readPos));
+        }
+
+    template<typename Type, int Count>
+        SPSCQueue<Type,Count>::SPSCQueue()
+        {
+            _writePos = _cachedReadPos = 0;
+            _readPos = _cachedWritePos = 0;
+        }
+
+    template<typename Type, int Count>
+        SPSCQueue<Type,Count>::~SPSCQueue()
+        {
+            Type* t = nullptr;
+            while (try_front(t)) pop();
+        }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename Type>
+        auto MPSCQueue<Type>::AllocateNode() -> Node*
+        {
+            Node* result = nullptr;
+            if (_freeNodes.try_pop(result)) return result;
+
+                //  Allocate a new segment of nodes, and add it to the segment list
+                //  (segments are never removed from that list, so there is no ABA problem)
+            auto* segment = new Segment;
+            Segment* prevHead;
+            do {
+                prevHead = (Segment*)Interlocked::LoadPointer((void* volatile const*)&_segments);
+                segment->_nextSegment = prevHead;
+            } while (Interlocked::CompareExchangePointer((void* volatile*)&_segments, segment, prevHead) != prevHead);
+
+            for (unsigned c=1; c<NodesPerSegment; ++c)
+                if (!_freeNodes.push(&segment->_nodes[c])) break;
+            return &segment->_nodes[0];
+        }
+
+    template<typename Type>
+        void MPSCQueue<Type>::PushNode(Node* node)
+        {
+            node->_next = nullptr;
+            auto* prev = (Node*)Interlocked::ExchangePointer((void* volatile*)&_head, node);
+            prev->_next = node;     // (volatile store -- publishes the node to the popper)
+        }
+
+    template<typename Type>
+        void MPSCQueue<Type>::push(const Type& newItem)
+        {
+            auto* node = AllocateNode();
+            new(node->Value()) Type(newItem);
+            PushNode(node);
+        }
+
+    template<typename Type>
+        void MPSCQueue<Type>::push(Type&& newItem)
+        {
+            auto* node = AllocateNode();
+            new(node->Value()) Type(std::move(newItem));
+            PushNode(node);
+        }
+
+    template<typename Type>
+        bool MPSCQueue<Type>::try_pop(Type& result)
+        {
+                //  _tail is always a node whose value has already been consumed (or the
+                //  stub). The next value to pop is in _tail->_next.
+            auto* tail = _tail;
+            auto* next = tail->_next;
+            if (!next) return false;
+
+            result = std::move(*next->Value());
+            next->Value()->~Type();
+            _tail = next;
+
+            if (tail != &_stub && !_freeNodes.push(tail)) {
+                // free list is full. The node remains owned by its segment
+            }
+            return true;
+        }
+
+    template<typename Type>
+        MPSCQueue<Type>::MPSCQueue()
+        {
+            _stub._next = nullptr;
+            _head = &_stub;
+            _tail = &_stub;
+            _segments = nullptr;
+        }
+
+    template<typename Type>
+        MPSCQueue<Type>::~MPSCQueue()
+        {
+                // destroy any items that were never popped
+            for (auto* n=_tail->_next; n; n=n->_next)
+                n->Value()->~Type();
+
+            auto* s = _segments;
+            while (s) {
+                auto* next = s->_nextSegment;
+                delete s;
+                s = next;
+            }
+        }
+
+    #if defined(DEBUG_NEW)
+        #define new DEBUG_NEW
+    #endif
 }
 
 }
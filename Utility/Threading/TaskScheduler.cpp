@@ -0,0 +1,480 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TaskScheduler.h"
+#include "LockFree.h"       // (for XlCreateEvent, etc)
+#include "../../ConsoleRig/Log.h"
+#include "../../Core/Exceptions.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <assert.h>
+
+namespace Utility
+{
+        //  Interlocked::Load is just a volatile read. In a few places below we need
+        //  a full memory barrier, so we use an interlocked operation that doesn't
+        //  change the value.
+    static Interlocked::Value LoadWithBarrier(Interlocked::Value volatile* target)
+    {
+        return Interlocked::Add(target, 0);
+    }
+
+    static Interlocked::Value64 LoadWithBarrier64(Interlocked::Value64 volatile* target)
+    {
+        return Interlocked::CompareExchange64(target, 0, 0);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  Chase-Lev work stealing deque (see "Dynamic Circular Work-Stealing Deque",
+        //  Chase & Lev, 2005).
+        //  The owning thread pushes and pops at the "bottom" end, without locks. Other
+        //  threads steal from the "top" end, with a single compare-exchange. The ring buffer
+        //  grows as required; old ring buffers are retained until the deque is destroyed
+        //  because a thief could still be reading from them.
+    class WorkStealingDeque
+    {
+    public:
+        void            Push(ScheduledTask* task);      // (owner thread only)
+        ScheduledTask*  Pop();                          // (owner thread only)
+        ScheduledTask*  Steal();
+        bool            IsEmpty() const;
+
+        WorkStealingDeque();
+        ~WorkStealingDeque();
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    private:
+        class RingBuffer
+        {
+        public:
+            Interlocked::Value64        _mask;
+            std::vector<ScheduledTask*> _items;
+
+            ScheduledTask* Get(Interlocked::Value64 index) const
+            {
+                return (ScheduledTask*)Interlocked::LoadPointer((void* volatile const*)&_items[size_t(index & _mask)]);
+            }
+
+            void Put(Interlocked::Value64 index, ScheduledTask* task)
+            {
+                *(ScheduledTask* volatile*)&_items[size_t(index & _mask)] = task;
+            }
+
+            RingBuffer(size_t size) : _mask(Interlocked::Value64(size-1)), _items(size, nullptr) {}
+        };
+
+        Interlocked::Value64    _top;
+        Interlocked::Value64    _bottom;
+        RingBuffer* volatile    _ringBuffer;
+        std::vector<std::unique_ptr<RingBuffer>> _allRingBuffers;
+    };
+
+    void WorkStealingDeque::Push(ScheduledTask* task)
+    {
+        auto b = Interlocked::Load64(&_bottom);
+        auto t = Interlocked::Load64(&_top);
+        auto* ring = _ringBuffer;
+        if ((b - t) > ring->_mask) {
+            auto newRing = std::make_unique<RingBuffer>(size_t(ring->_mask+1) * 2);
+            for (auto i=t; i<b; ++i) newRing->Put(i, ring->Get(i));
+            ring = newRing.get();
+            _allRingBuffers.push_back(std::move(newRing));
+            Interlocked::ExchangePointer((void* volatile*)&_ringBuffer, ring);
+        }
+
+        ring->Put(b, task);
+        Interlocked::Exchange64(&_bottom, b+1);
+    }
+
+    ScheduledTask* WorkStealingDeque::Pop()
+    {
+        auto b = Interlocked::Load64(&_bottom) - 1;
+        auto* ring = _ringBuffer;
+        Interlocked::Exchange64(&_bottom, b);       // (full barrier between this write and reading _top)
+        auto t = Interlocked::Load64(&_top);
+
+        if (t > b) {
+            Interlocked::Exchange64(&_bottom, b+1);  // empty
+            return nullptr;
+        }
+
+        auto* task = ring->Get(b);
+        if (t == b) {
+                // this is the last item -- we must race any thieves for it
+            if (Interlocked::CompareExchange64(&_top, t+1, t) != t)
+                task = nullptr;
+            Interlocked::Exchange64(&_bottom, b+1);
+        }
+        return task;
+    }
+
+    ScheduledTask* WorkStealingDeque::Steal()
+    {
+        auto t = LoadWithBarrier64(&_top);
+        auto b = Interlocked::Load64(&_bottom);
+        if (t >= b) return nullptr;
+
+        auto* ring = (RingBuffer*)Interlocked::LoadPointer((void* volatile const*)&_ringBuffer);
+        auto* task = ring->Get(t);
+        if (Interlocked::CompareExchange64(&_top, t+1, t) != t)
+            return nullptr;     // lost a race with another thief (or the owner)
+        return task;
+    }
+
+    bool WorkStealingDeque::IsEmpty() const
+    {
+        return Interlocked::Load64(&_bottom) <= Interlocked::Load64(&_top);
+    }
+
+    WorkStealingDeque::WorkStealingDeque()
+    {
+        _top = _bottom = 0;
+        _allRingBuffers.push_back(std::make_unique<RingBuffer>(256));
+        _ringBuffer = _allRingBuffers[0].get();
+    }
+
+    WorkStealingDeque::~WorkStealingDeque() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class TaskWorker
+    {
+    public:
+        WorkStealingDeque _deques[TaskPriority::Max];
+
+            // recycled task objects (only accessed from the worker thread)
+        ScheduledTask* _freeTasks;
+        unsigned _freeTaskCount;
+
+        TaskWorker() : _freeTasks(nullptr), _freeTaskCount(0) {}
+    };
+
+    class TaskScheduler::Pimpl
+    {
+    public:
+        std::vector<std::unique_ptr<TaskWorker>> _workers;
+        std::vector<std::thread> _workerThreads;
+
+        XlHandle _events[2];
+        volatile bool _workerQuit;
+        Interlocked::Value _sleepingCount;
+
+            // tasks from threads outside of the scheduler are queued here. Any worker
+            // (or any thread waiting on a TaskGroup) can take them
+        Threading::Mutex _injectedLock;
+        std::deque<ScheduledTask*> _injected[TaskPriority::Max];
+        Interlocked::Value _injectedCount;
+
+            // recycled task objects for threads outside of the scheduler
+        Threading::Mutex _sharedFreeTasksLock;
+        ScheduledTask* _sharedFreeTasks;
+
+        ScheduledTask* FindWork(TaskWorker* worker, unsigned workerIndex);
+        ScheduledTask* TrySteal(unsigned firstVictim, TaskPriority::Enum priority);
+        ScheduledTask* TryTakeInjected(TaskPriority::Enum priority);
+        void Execute(ScheduledTask* task, TaskWorker* worker);
+        void ReleaseTask(ScheduledTask* task, TaskWorker* worker);
+        void WakeOne();
+        void WorkerThread(unsigned workerIndex);
+    };
+
+    static thread_local TaskScheduler::Pimpl* s_currentScheduler = nullptr;
+    static thread_local unsigned s_currentWorkerIndex = 0;
+    static const unsigned MaxWorkerFreeTasks = 256;
+
+    ScheduledTask* TaskScheduler::Pimpl::TrySteal(unsigned firstVictim, TaskPriority::Enum priority)
+    {
+            //  Steal will fail if we lose a race with another thread. In that case, there's
+            //  probably still work in that deque, so we go around again.
+        auto workerCount = unsigned(_workers.size());
+        for (;;) {
+            bool foundWork = false;
+            for (unsigned c=0; c<workerCount; ++c) {
+                auto& deque = _workers[(firstVictim + c) % workerCount]->_deques[priority];
+                if (deque.IsEmpty()) continue;
+                foundWork = true;
+                auto* task = deque.Steal();
+                if (task) return task;
+            }
+            if (!foundWork) return nullptr;
+            Threading::Pause();
+        }
+    }
+
+    ScheduledTask* TaskScheduler::Pimpl::TryTakeInjected(TaskPriority::Enum priority)
+    {
+        if (!LoadWithBarrier(&_injectedCount)) return nullptr;
+
+        ScheduledTask* task = nullptr;
+        bool moreRemaining = false;
+        {
+            ScopedLock(_injectedLock);
+            auto& queue = _injected[priority];
+            if (queue.empty()) return nullptr;
+            task = queue.front();
+            queue.pop_front();
+            moreRemaining = Interlocked::Decrement(&_injectedCount) > 1;
+        }
+
+            // (there may be other workers asleep that could take the remainder)
+        if (moreRemaining) WakeOne();
+        return task;
+    }
+
+    ScheduledTask* TaskScheduler::Pimpl::FindWork(TaskWorker* worker, unsigned workerIndex)
+    {
+        for (unsigned p=0; p<TaskPriority::Max; ++p) {
+            if (worker) {
+                auto* task = worker->_deques[p].Pop();
+                if (task) return task;
+            }
+
+            auto* task = TryTakeInjected(TaskPriority::Enum(p));
+            if (task) return task;
+
+            task = TrySteal(workerIndex+1, TaskPriority::Enum(p));
+            if (task) return task;
+        }
+        return nullptr;
+    }
+
+    void TaskScheduler::Pimpl::Execute(ScheduledTask* task, TaskWorker* worker)
+    {
+        auto* group = task->_group;
+        TRY
+        {
+            task->_invoke(task->_fn);
+        } CATCH(const std::exception& e) {
+            if (group) group->SetException(std::current_exception());
+            else LogAlwaysError << "Suppressing exception in thread pool thread: " << e.what();
+        } CATCH(...) {
+            if (group) group->SetException(std::current_exception());
+            else LogAlwaysError << "Suppressing unknown exception in thread pool thread.";
+        } CATCH_END
+
+        task->_destroy(task->_fn);
+        ReleaseTask(task, worker);
+        if (group) Interlocked::Decrement(&group->_pendingCount);
+    }
+
+    void TaskScheduler::Pimpl::ReleaseTask(ScheduledTask* task, TaskWorker* worker)
+    {
+        if (worker && worker->_freeTaskCount < MaxWorkerFreeTasks) {
+            task->_nextFree = worker->_freeTasks;
+            worker->_freeTasks = task;
+            ++worker->_freeTaskCount;
+            return;
+        }
+
+            // tasks enqueued from outside of the scheduler tend to end up here
+        ScopedLock(_sharedFreeTasksLock);
+        task->_nextFree = _sharedFreeTasks;
+        _sharedFreeTasks = task;
+    }
+
+    void TaskScheduler::Pimpl::WakeOne()
+    {
+        if (LoadWithBarrier(&_sleepingCount))
+            XlSetEvent(_events[0]);
+    }
+
+    void TaskScheduler::Pimpl::WorkerThread(unsigned workerIndex)
+    {
+        s_currentScheduler = this;
+        s_currentWorkerIndex = workerIndex;
+        auto* worker = _workers[workerIndex].get();
+
+        while (!_workerQuit) {
+            auto* task = FindWork(worker, workerIndex);
+            if (task) {
+                Execute(task, worker);
+                continue;
+            }
+
+                //  Before we go to sleep, we must register as sleeping and then check for
+                //  work once more. Otherwise a task could be enqueued between FindWork and
+                //  the wait, and we would miss the wake up.
+            Interlocked::Increment(&_sleepingCount);
+            task = FindWork(worker, workerIndex);
+            if (!task && !_workerQuit) {
+                    // Wait for the event with the "alertable" flag set true
+                    // note -- this is why we can't use std::condition_variable
+                    //      (because threads waiting on a condition variable won't
+                    //      be woken to execute completion routines)
+                XlWaitForMultipleSyncObjects(2, _events, false, XL_INFINITE, true);
+            }
+            Interlocked::Decrement(&_sleepingCount);
+
+            if (task) {
+                    // there may be more work; so make sure other threads get a chance at it
+                WakeOne();
+                Execute(task, worker);
+            }
+        }
+
+        while (worker->_freeTasks) {
+            auto* next = worker->_freeTasks->_nextFree;
+            delete worker->_freeTasks;
+            worker->_freeTasks = next;
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    ScheduledTask* TaskScheduler::AllocateTask()
+    {
+        ScheduledTask* result = nullptr;
+        if (s_currentScheduler == _pimpl.get()) {
+            auto* worker = _pimpl->_workers[s_currentWorkerIndex].get();
+            if (worker->_freeTasks) {
+                result = worker->_freeTasks;
+                worker->_freeTasks = result->_nextFree;
+                --worker->_freeTaskCount;
+            }
+        } else {
+            ScopedLock(_pimpl->_sharedFreeTasksLock);
+            if (_pimpl->_sharedFreeTasks) {
+                result = _pimpl->_sharedFreeTasks;
+                _pimpl->_sharedFreeTasks = result->_nextFree;
+            }
+        }
+
+        if (!result) result = new ScheduledTask;
+        result->_group = nullptr;
+        result->_nextFree = nullptr;
+        return result;
+    }
+
+    void TaskScheduler::Submit(ScheduledTask* task, TaskPriority::Enum priority)
+    {
+        assert(unsigned(priority) < TaskPriority::Max);
+        if (s_currentScheduler == _pimpl.get()) {
+            _pimpl->_workers[s_currentWorkerIndex]->_deques[priority].Push(task);
+        } else {
+            ScopedLock(_pimpl->_injectedLock);
+            _pimpl->_injected[priority].push_back(task);
+            Interlocked::Increment(&_pimpl->_injectedCount);
+        }
+
+        _pimpl->WakeOne();
+    }
+
+    bool TaskScheduler::TryRunOneTask()
+    {
+        ScheduledTask* task;
+        TaskWorker* worker = nullptr;
+        if (s_currentScheduler == _pimpl.get()) {
+            worker = _pimpl->_workers[s_currentWorkerIndex].get();
+            task = _pimpl->FindWork(worker, s_currentWorkerIndex);
+        } else {
+                //  Threads outside of the scheduler don't have a deque, but they can
+                //  take injected tasks, or steal
+            task = _pimpl->FindWork(nullptr, 0);
+        }
+
+        if (!task) return false;
+        _pimpl->Execute(task, worker);
+        return true;
+    }
+
+    unsigned TaskScheduler::GetWorkerCount() const { return unsigned(_pimpl->_workers.size()); }
+    bool TaskScheduler::IsWorkerThread() const { return s_currentScheduler == _pimpl.get(); }
+
+    TaskScheduler::TaskScheduler(unsigned threadCount)
+    {
+        _pimpl = std::make_unique<Pimpl>();
+            // one event is an "auto-reset" event, which should wake a single thread
+            // another event is a "manual-reset" event, used to wake all threads on shutdown
+        _pimpl->_events[0] = XlCreateEvent(false);
+        _pimpl->_events[1] = XlCreateEvent(true);
+        _pimpl->_workerQuit = false;
+        _pimpl->_sleepingCount = 0;
+        _pimpl->_injectedCount = 0;
+        _pimpl->_sharedFreeTasks = nullptr;
+
+        threadCount = std::max(threadCount, 1u);
+        for (unsigned i=0; i<threadCount; ++i)
+            _pimpl->_workers.push_back(std::make_unique<TaskWorker>());
+
+        auto* pimpl = _pimpl.get();
+        for (unsigned i=0; i<threadCount; ++i)
+            _pimpl->_workerThreads.emplace_back([pimpl, i]() { pimpl->WorkerThread(i); });
+    }
+
+    TaskScheduler::~TaskScheduler()
+    {
+        _pimpl->_workerQuit = true;
+        XlSetEvent(_pimpl->_events[1]);   // trigger a manual reset event should wake all threads (and keep them awake)
+        for (auto&t : _pimpl->_workerThreads) t.join();
+
+            // tasks that were never executed are just destroyed
+        for (unsigned p=0; p<TaskPriority::Max; ++p) {
+            std::vector<ScheduledTask*> remaining(_pimpl->_injected[p].begin(), _pimpl->_injected[p].end());
+            _pimpl->_injected[p].clear();
+            for (auto& w:_pimpl->_workers) {
+                ScheduledTask* task;
+                while ((task = w->_deques[p].Pop()) != nullptr)
+                    remaining.push_back(task);
+            }
+            for (auto* t:remaining) {
+                t->_destroy(t->_fn);
+                if (t->_group) Interlocked::Decrement(&t->_group->_pendingCount);
+                delete t;
+            }
+        }
+
+        while (_pimpl->_sharedFreeTasks) {
+            auto* next = _pimpl->_sharedFreeTasks->_nextFree;
+            delete _pimpl->_sharedFreeTasks;
+            _pimpl->_sharedFreeTasks = next;
+        }
+
+        XlCloseSyncObject(_pimpl->_events[0]);
+        XlCloseSyncObject(_pimpl->_events[1]);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void TaskGroup::Wait()
+    {
+        while (Interlocked::Load(&_pendingCount)) {
+            if (!_scheduler->TryRunOneTask())
+                Threading::YieldTimeSlice();
+        }
+
+        std::exception_ptr exception;
+        {
+            ScopedLock(_exceptionLock);
+            std::swap(exception, _exception);
+        }
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+
+    void TaskGroup::SetException(std::exception_ptr exception)
+    {
+        ScopedLock(_exceptionLock);
+        if (!_exception) _exception = std::move(exception);
+    }
+
+    TaskGroup::TaskGroup(TaskScheduler& scheduler)
+    : _scheduler(&scheduler), _pendingCount(0)
+    {}
+
+    TaskGroup::~TaskGroup()
+    {
+            // we can't allow tasks to outlive the group, so we must wait here
+        while (Interlocked::Load(&_pendingCount)) {
+            if (!_scheduler->TryRunOneTask())
+                Threading::YieldTimeSlice();
+        }
+    }
+}
+
@@ -0,0 +1,228 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "ThreadingUtils.h"
+#include "Mutex.h"
+#include "../../Core/Types.h"
+#include <memory>
+#include <functional>
+#include <exception>
+#include <type_traits>
+
+namespace Utility
+{
+    namespace TaskPriority
+    {
+        enum Enum { High, Normal, Low, Max };
+    }
+
+    class TaskGroup;
+
+        /// <summary>A single task, as stored in the scheduler's queues</summary>
+        /// Small functors are constructed directly within the task object (so
+        /// enqueuing doesn't need to allocate). Task objects themselves are recycled
+        /// via free lists in the scheduler.
+    class ScheduledTask
+    {
+    public:
+        static const size_t InlineStorageSize = 48;
+
+        void        (*_invoke)(void*);
+        void        (*_destroy)(void*);
+        void*       _fn;
+        TaskGroup*  _group;
+        ScheduledTask* _nextFree;
+        std::aligned_storage<InlineStorageSize, 8>::type _storage;
+
+        template<typename Fn>
+            void Construct(Fn&& fn);
+    };
+
+    /// <summary>Work stealing thread pool</summary>
+    /// Each worker thread has a "Chase-Lev" deque for each priority lane. Tasks enqueued
+    /// from a worker thread are pushed onto that worker's own deque (without locking),
+    /// and idle workers steal from the other end of the other workers' deques.
+    ///
+    /// Tasks enqueued from other threads go into a shared injection queue (one per priority
+    /// lane). Every worker checks this queue before stealing, and so do threads outside of
+    /// the scheduler waiting in TaskGroup::Wait(). So an injected task can't get stuck
+    /// behind a single busy or sleeping worker.
+    ///
+    /// Idle workers wait in an "alertable" state. So completion routines (eg, from
+    /// ReadFileEx) queued by a task will be executed on the same thread when it is idle.
+    ///
+    /// Use TaskGroup for fork/join style parallelism.
+    class TaskScheduler
+    {
+    public:
+        template<class Fn>
+            void Enqueue(Fn&& fn);
+
+        template<class Fn, class Arg0, class... Args>
+            void Enqueue(Fn&& fn, Arg0&& arg0, Args&&... args);
+
+        template<class Fn>
+            void EnqueueWithPriority(TaskPriority::Enum priority, Fn&& fn);
+
+        unsigned GetWorkerCount() const;
+        bool IsWorkerThread() const;
+
+        TaskScheduler(unsigned threadCount);
+        ~TaskScheduler();
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+        TaskScheduler(TaskScheduler&&) = delete;
+        TaskScheduler& operator=(TaskScheduler&&) = delete;
+
+        class Pimpl;
+    private:
+        std::unique_ptr<Pimpl> _pimpl;
+
+        ScheduledTask* AllocateTask();
+        void Submit(ScheduledTask* task, TaskPriority::Enum priority);
+        bool TryRunOneTask();
+
+        friend class TaskGroup;
+    };
+
+    /// <summary>Set of tasks that can be waited on together</summary>
+    /// Wait() doesn't block the calling thread while there is other work to do. Instead, it
+    /// will execute pending tasks from the scheduler (including tasks that aren't part of this
+    /// group) until all tasks in the group have completed.
+    ///
+    /// If any task in the group throws an exception, the first exception will be rethrown
+    /// from Wait().
+    /// <code>
+    ///     TaskGroup group(ConsoleRig::GlobalServices::GetShortTaskThreadPool());
+    ///     for (unsigned c=0; c<chunkCount; ++c)
+    ///         group.Run([c]() { ProcessChunk(c); });
+    ///     group.Wait();
+    /// </code>
+    class TaskGroup
+    {
+    public:
+        template<class Fn>
+            void Run(Fn&& fn, TaskPriority::Enum priority = TaskPriority::Normal);
+        void Wait();
+
+        TaskGroup(TaskScheduler& scheduler);
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+    private:
+        TaskScheduler* _scheduler;
+        Interlocked::Value _pendingCount;
+
+        Threading::Mutex _exceptionLock;
+        std::exception_ptr _exception;
+
+        void SetException(std::exception_ptr exception);
+        friend class TaskScheduler;
+    };
+
+        /// <summary>Split [0, count) into chunks of "grain" items, and run them in parallel</summary>
+        /// Calls fn(begin, end) for each chunk. The calling thread runs the first chunk itself,
+        /// and then executes other tasks while it waits for the rest (see TaskGroup::Wait).
+        /// If there is only a single chunk, it's run directly, without involving the scheduler.
+    template<typename Fn>
+        void ParallelFor(TaskScheduler& scheduler, unsigned count, unsigned grain, Fn&& fn);
+
+        /// <summary>Calls fn(index) for each index in [0, count), in parallel</summary>
+        /// Each index is a separate task -- so this is intended for a small number of
+        /// large jobs. Use the "grain" version for many small jobs.
+    template<typename Fn>
+        void ParallelFor(TaskScheduler& scheduler, unsigned count, Fn&& fn);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    #undef new
+
+    template<typename Fn>
+        void ScheduledTask::Construct(Fn&& fn)
+        {
+            typedef typename std::decay<Fn>::type FnType;
+            if (    constant_expression<sizeof(FnType) <= InlineStorageSize>::result()
+                &&  constant_expression<std::alignment_of<FnType>::value <= 8>::result()) {
+                _fn = new(&_storage) FnType(std::forward<Fn>(fn));
+                _destroy = [](void* f) { ((FnType*)f)->~FnType(); };
+            } else {
+                _fn = new FnType(std::forward<Fn>(fn));
+                _destroy = [](void* f) { delete (FnType*)f; };
+            }
+            _invoke = [](void* f) { (*(FnType*)f)(); };
+        }
+
+    #if defined(DEBUG_NEW)
+        #define new DEBUG_NEW
+    #endif
+
+    template<class Fn>
+        void TaskScheduler::Enqueue(Fn&& fn)
+        {
+            auto* task = AllocateTask();
+            task->Construct(std::forward<Fn>(fn));
+            Submit(task, TaskPriority::Normal);
+        }
+
+    template<class Fn, class Arg0, class... Args>
+        void TaskScheduler::Enqueue(Fn&& fn, Arg0&& arg0, Args&&... args)
+        {
+            Enqueue(std::bind(std::forward<Fn>(fn), std::forward<Arg0>(arg0), std::forward<Args>(args)...));
+        }
+
+    template<class Fn>
+        void TaskScheduler::EnqueueWithPriority(TaskPriority::Enum priority, Fn&& fn)
+        {
+            auto* task = AllocateTask();
+            task->Construct(std::forward<Fn>(fn));
+            Submit(task, priority);
+        }
+
+    template<class Fn>
+        void TaskGroup::Run(Fn&& fn, TaskPriority::Enum priority)
+        {
+            auto* task = _scheduler->AllocateTask();
+            task->Construct(std::forward<Fn>(fn));
+            task->_group = this;
+            Interlocked::Increment(&_pendingCount);
+            _scheduler->Submit(task, priority);
+        }
+
+    template<typename Fn>
+        void ParallelFor(TaskScheduler& scheduler, unsigned count, unsigned grain, Fn&& fn)
+        {
+            if (!count) return;
+            if (!grain) grain = 1;
+            auto chunkCount = (count + grain - 1) / grain;
+            if (chunkCount <= 1) {
+                fn(0u, count);
+                return;
+            }
+
+            TaskGroup group(scheduler);
+            for (unsigned c=1; c<chunkCount; ++c) {
+                auto begin = c*grain;
+                auto end = ((count - begin) > grain) ? (begin + grain) : count;
+                group.Run([&fn, begin, end]() { fn(begin, end); });
+            }
+            fn(0u, grain);
+            group.Wait();
+        }
+
+    template<typename Fn>
+        void ParallelFor(TaskScheduler& scheduler, unsigned count, Fn&& fn)
+        {
+            ParallelFor(
+                scheduler, count, 1u,
+                [&fn](unsigned begin, unsigned end) { for (auto i=begin; i<end; ++i) fn(i); });
+        }
+}
+
+using namespace Utility;